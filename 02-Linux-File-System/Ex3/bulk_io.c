@@ -0,0 +1,231 @@
+#define _GNU_SOURCE /* copy_file_range, sync_file_range, MADV_* */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+#include "bulk_io.h"
+
+/* Write all len bytes, continuing after short writes */
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Close fd without losing the errno of an earlier failure */
+static void close_keep_errno(int fd) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+}
+
+off_t bulk_read(const char *filename, off_t num_bytes, int out_fd) {
+    struct stat st;
+    off_t size, offset;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd == -1) {
+        return -1;
+    }
+    if (fstat(fd, &st) == -1) {
+        close_keep_errno(fd);
+        return -1;
+    }
+    size = st.st_size;
+    if (num_bytes > 0 && num_bytes < size) {
+        size = num_bytes;
+    }
+    /* Ask for a large readahead; each window is also marked sequential below */
+    posix_fadvise(fd, 0, size, POSIX_FADV_SEQUENTIAL);
+
+    for (offset = 0; offset < size; offset += BULK_WINDOW) {
+        size_t len = size - offset < BULK_WINDOW ? (size_t)(size - offset) : BULK_WINDOW;
+        char *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, offset);
+        if (map == MAP_FAILED) {
+            close_keep_errno(fd);
+            return -1;
+        }
+        madvise(map, len, MADV_SEQUENTIAL);
+        if (offset + (off_t)len < size) {
+            posix_fadvise(fd, offset + len, BULK_WINDOW, POSIX_FADV_WILLNEED); /* Next window */
+        }
+        int result = write_all(out_fd, map, len);
+        munmap(map, len);
+        if (result == -1) {
+            close_keep_errno(fd);
+            return -1;
+        }
+        /* Done with these pages: do not let a multi-GB export push out the page cache */
+        posix_fadvise(fd, offset, len, POSIX_FADV_DONTNEED);
+    }
+    close(fd);
+    return size;
+}
+
+/* Fill len bytes with the pattern, starting at position start of the pattern */
+static void fill_pattern(char *dest, size_t len, const char *data, size_t data_len, size_t start) {
+    size_t done = 0;
+
+    /* First a whole pattern (from start), then copy what is filled in doubling steps */
+    while (done < len && done < data_len) {
+        dest[done] = data[(start + done) % data_len];
+        done++;
+    }
+    while (done < len) {
+        size_t step = done < len - done ? done : len - done;
+        memcpy(dest + done, dest, step);
+        done += step;
+    }
+}
+
+off_t bulk_write(const char *filename, off_t num_bytes, const char *data, size_t data_len) {
+    off_t offset, previous = -1;
+    int fd;
+
+    if (num_bytes <= 0 || data_len == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+    /* Reserve the blocks up front; some file systems only support growing the file */
+    int err = posix_fallocate(fd, 0, num_bytes);
+    if (err == EOPNOTSUPP || err == EINVAL) {
+        err = ftruncate(fd, num_bytes) == -1 ? errno : 0;
+    }
+    if (err != 0) {
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    for (offset = 0; offset < num_bytes; offset += BULK_WINDOW) {
+        size_t len = num_bytes - offset < BULK_WINDOW ? (size_t)(num_bytes - offset) : BULK_WINDOW;
+        char *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+        if (map == MAP_FAILED) {
+            close_keep_errno(fd);
+            return -1;
+        }
+        madvise(map, len, MADV_SEQUENTIAL);
+        fill_pattern(map, len, data, data_len, (size_t)(offset % (off_t)data_len));
+        munmap(map, len);
+
+        /* Start writing this window back, then wait for the one before and drop it,
+         * so at most two windows of dirty pages exist at any time */
+        sync_file_range(fd, offset, len, SYNC_FILE_RANGE_WRITE);
+        if (previous >= 0) {
+            sync_file_range(fd, previous, BULK_WINDOW, SYNC_FILE_RANGE_WAIT_BEFORE |
+                            SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(fd, previous, BULK_WINDOW, POSIX_FADV_DONTNEED);
+        }
+        previous = offset;
+    }
+    if (close(fd) == -1) {
+        return -1;
+    }
+    return num_bytes;
+}
+
+/* Copy with read/write, for files the kernel cannot copy directly */
+static off_t copy_read_write(int in_fd, int out_fd, off_t copied) {
+    char *buffer = malloc(BULK_BUFFER);
+    ssize_t n;
+
+    if (buffer == NULL) {
+        return -1;
+    }
+    while ((n = read(in_fd, buffer, BULK_BUFFER)) != 0) {
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (write_all(out_fd, buffer, (size_t)n) == -1) {
+            n = -1;
+            break;
+        }
+        copied += n;
+    }
+    free(buffer);
+    return n == -1 ? -1 : copied;
+}
+
+off_t bulk_copy(const char *source, const char *destination) {
+    struct stat st;
+    off_t copied = 0;
+    int use_copy_file_range = 1;
+    int in_fd, out_fd;
+
+    in_fd = open(source, O_RDONLY);
+    if (in_fd == -1) {
+        return -1;
+    }
+    if (fstat(in_fd, &st) == -1) {
+        close_keep_errno(in_fd);
+        return -1;
+    }
+    out_fd = open(destination, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+    if (out_fd == -1) {
+        close_keep_errno(in_fd);
+        return -1;
+    }
+    posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    while (1) {
+        ssize_t n;
+        if (use_copy_file_range) {
+            /* Stays in the kernel, and may share or offload blocks on the same file system */
+            n = copy_file_range(in_fd, NULL, out_fd, NULL, BULK_CHUNK, 0);
+        } else {
+            n = sendfile(out_fd, in_fd, NULL, BULK_CHUNK);
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && copied == 0 && (errno == EXDEV || errno == EINVAL ||
+                                       errno == ENOSYS || errno == EOPNOTSUPP)) {
+            /* Not supported between these files: next method */
+            if (use_copy_file_range) {
+                use_copy_file_range = 0;
+                continue;
+            }
+            copied = copy_read_write(in_fd, out_fd, 0);
+            break;
+        }
+        if (n <= 0) {
+            if (n == -1) {
+                copied = -1;
+            }
+            break;
+        }
+        posix_fadvise(in_fd, copied, n, POSIX_FADV_DONTNEED);
+        copied += n;
+    }
+    if (copied == -1) {
+        close_keep_errno(in_fd);
+        close_keep_errno(out_fd);
+        return -1;
+    }
+    close(in_fd);
+    if (close(out_fd) == -1) {
+        return -1;
+    }
+    return copied;
+}
@@ -0,0 +1,28 @@
+#ifndef BULK_IO_H
+#define BULK_IO_H
+
+#include <sys/types.h>
+
+/* Bytes of a file mapped at a time; memory use stays near this for any file size */
+#define BULK_WINDOW (64L * 1024 * 1024)
+
+/* Bytes handed to one copy_file_range/sendfile call */
+#define BULK_CHUNK (64L * 1024 * 1024)
+
+/* Buffer of the read/write fallback copy */
+#define BULK_BUFFER (1024 * 1024)
+
+/* Write the first num_bytes of filename (the whole file if num_bytes is 0) to out_fd,
+ * mapping one window at a time. Returns the bytes written, or -1 with errno set. */
+off_t bulk_read(const char *filename, off_t num_bytes, int out_fd);
+
+/* Create or truncate filename and fill num_bytes with data (data_len bytes) repeated,
+ * through mapped windows that are flushed and dropped from the page cache as the
+ * fill moves on. Returns num_bytes, or -1 with errno set. */
+off_t bulk_write(const char *filename, off_t num_bytes, const char *data, size_t data_len);
+
+/* Copy source to destination in the kernel: copy_file_range, else sendfile, else
+ * read/write. Returns the bytes copied, or -1 with errno set. */
+off_t bulk_copy(const char *source, const char *destination);
+
+#endif /* BULK_IO_H */
@@ -6,10 +6,69 @@
 #include <errno.h>
 #include <ctype.h>
 
+#include "bulk_io.h"
+
+/* Print usage of every mode */
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s filename num-bytes [r/w/rw] \"data\"\n", prog);
+    fprintf(stderr, "       %s -b filename num-bytes [r/w/rw] \"data\"   (large files)\n", prog);
+    fprintf(stderr, "       %s -c source destination                  (copy)\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+/* Large-file mode: w fills num-bytes with data repeated, r streams num-bytes (0 for
+ * the whole file) to stdout. Both go through mmap windows, so memory use does not grow
+ * with the file. Status goes to stderr since stdout carries the file contents. */
+static int run_bulk(const char *filename, const char *num_arg, const char *mode, const char *data) {
+    char *endptr;
+    long long num_bytes = strtoll(num_arg, &endptr, 10);
+
+    if (*endptr != '\0' || num_bytes < 0) {
+        fprintf(stderr, "Invalid num-bytes: %s\n", num_arg);
+        return EXIT_FAILURE;
+    }
+    if (strcmp(mode, "r") != 0 && strcmp(mode, "w") != 0 && strcmp(mode, "rw") != 0) {
+        fprintf(stderr, "Invalid mode: %s. Must be 'r', 'w', or 'rw'.\n", mode);
+        return EXIT_FAILURE;
+    }
+
+    if (strchr(mode, 'w') != NULL) {
+        if (num_bytes == 0 || *data == '\0') {
+            fprintf(stderr, "Writing needs num-bytes > 0 and non-empty data.\n");
+            return EXIT_FAILURE;
+        }
+        if (bulk_write(filename, (off_t)num_bytes, data, strlen(data)) == -1) {
+            perror("bulk write");
+            return EXIT_FAILURE;
+        }
+        fprintf(stderr, "Wrote %lld bytes to file.\n", num_bytes);
+    }
+    if (strchr(mode, 'r') != NULL) {
+        off_t bytes_read = bulk_read(filename, (off_t)num_bytes, STDOUT_FILENO);
+        if (bytes_read == -1) {
+            perror("bulk read");
+            return EXIT_FAILURE;
+        }
+        fprintf(stderr, "Read %lld bytes from file.\n", (long long)bytes_read);
+    }
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
+    if (argc == 6 && strcmp(argv[1], "-b") == 0) {
+        return run_bulk(argv[2], argv[3], argv[4], argv[5]);
+    }
+    if (argc == 4 && strcmp(argv[1], "-c") == 0) {
+        off_t copied = bulk_copy(argv[2], argv[3]);
+        if (copied == -1) {
+            perror("copy");
+            exit(EXIT_FAILURE);
+        }
+        printf("Copied %lld bytes.\n", (long long)copied);
+        return 0;
+    }
     if (argc != 5) {
-        fprintf(stderr, "Usage: %s filename num-bytes [r/w/rw] \"data\"\n", argv[0]);
-        exit(EXIT_FAILURE);
+        usage(argv[0]);
     }
 
     const char *filename = argv[1];
@@ -2,48 +2,33 @@
 #include <stdlib.h>
 #include <pthread.h>
 
-#define ARRAY_SIZE 1000000
-#define NUM_THREADS 4
-
-/* sum and mutex */
-long long global_sum = 0;
-pthread_mutex_t sum_mutex;
+#include "thread_pool.h"
 
-/* Thread data */
-typedef struct {
-    int *array;
-    int start_index;
-    int end_index;
-} thread_data_t;
+#define ARRAY_SIZE 1000000
 
-/* Thread function to calculate partial sum */
-void *calculate_partial_sum(void *arg) {
-    thread_data_t *data = (thread_data_t *)arg;
+/* Sum of one chunk, added to the worker's own partial sum (no mutex needed) */
+void sum_chunk(size_t start, size_t end, void *partial, void *arg) {
+    const int *array = (const int *)arg;
     long long local_sum = 0;
 
     /* Calculate the sum of the assigned portion of the array */
-    for (int i = data->start_index; i < data->end_index; i++) {
-        local_sum += data->array[i];
+    for (size_t i = start; i < end; i++) {
+        local_sum += array[i];
     }
+    *(long long *)partial += local_sum;
+}
 
-    /* Print the partial sum */
-    printf("Partial sum for range [%d, %d): %lld\n", data->start_index, data->end_index, local_sum);
-
-    /* Lock the mutex before updating the global sum */
-    pthread_mutex_lock(&sum_mutex);
-    global_sum += local_sum;
-    /* Unlock the mutex */
-    pthread_mutex_unlock(&sum_mutex);
-
-    pthread_exit(NULL);
+/* Add a worker's partial sum to the total */
+void add_partial(void *result, const void *partial, void *arg) {
+    (void)arg;
+    *(long long *)result += *(const long long *)partial;
 }
 
 int main() {
     int *numbers;
-    pthread_t threads[NUM_THREADS];
-    thread_data_t thread_data[NUM_THREADS];
-    int ret;
-    int chunk_size;
+    thread_pool_t *pool;
+    long long zero = 0;
+    long long global_sum = 0;
 
     /* Allocate memory for the array */
     numbers = (int *)malloc(ARRAY_SIZE * sizeof(int));
@@ -57,42 +42,24 @@ int main() {
         numbers[i] = i + 1;
     }
 
-    /* Calculate the chunk size for each thread */
-    chunk_size = ARRAY_SIZE / NUM_THREADS;
-
-    /* Initialize the mutex */
-    ret = pthread_mutex_init(&sum_mutex, NULL);
-    if (ret != 0) {
-        perror("pthread_mutex_init failed");
+    /* Create a pool with one worker per core */
+    pool = thread_pool_create(0);
+    if (pool == NULL) {
+        perror("thread_pool_create failed");
         exit(EXIT_FAILURE);
     }
+    printf("Thread pool with %d workers\n", thread_pool_size(pool));
 
-    /* Create threads and assign work */
-    for (int i = 0; i < NUM_THREADS; i++) {
-        thread_data[i].array = numbers;
-        thread_data[i].start_index = i * chunk_size;
-        thread_data[i].end_index = (i == NUM_THREADS - 1) ? ARRAY_SIZE : (i + 1) * chunk_size; // Last thread takes remaining elements
-
-        ret = pthread_create(&threads[i], NULL, calculate_partial_sum, &thread_data[i]);
-        if (ret != 0) {
-            perror("pthread_create failed");
-            exit(EXIT_FAILURE);
-        }
-    }
-
-    /* Wait for all threads to complete */
-    for (int i = 0; i < NUM_THREADS; i++) {
-        pthread_join(threads[i], NULL);
-    }
-
-    /* Destroy the mutex */
-    pthread_mutex_destroy(&sum_mutex);
+    /* Sum the array: workers take chunks and steal from each other when done */
+    thread_pool_reduce(pool, 0, ARRAY_SIZE, 0, &zero, sizeof(zero),
+                       sum_chunk, add_partial, numbers, &global_sum);
 
     /* Print the final sum */
     printf("Total sum: %lld\n", global_sum);
 
-    /* Free allocated memory */
+    /* Stop the pool and free allocated memory */
+    thread_pool_destroy(pool);
     free(numbers);
 
     return 0;
-}
\ No newline at end of file
+}
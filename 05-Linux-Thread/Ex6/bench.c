@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "thread_pool.h"
+
+#define ARRAY_SIZE 1000000
+#define NUM_THREADS 4
+#define DEFAULT_ITERATIONS 200
+
+/* --- Spawn-per-call version (the original Test.c pattern) --- */
+
+/* sum and mutex */
+long long global_sum = 0;
+pthread_mutex_t sum_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Thread data */
+typedef struct {
+    int *array;
+    int start_index;
+    int end_index;
+} thread_data_t;
+
+/* Thread function to calculate partial sum */
+void *calculate_partial_sum(void *arg) {
+    thread_data_t *data = (thread_data_t *)arg;
+    long long local_sum = 0;
+
+    for (int i = data->start_index; i < data->end_index; i++) {
+        local_sum += data->array[i];
+    }
+
+    /* Lock the mutex before updating the global sum */
+    pthread_mutex_lock(&sum_mutex);
+    global_sum += local_sum;
+    pthread_mutex_unlock(&sum_mutex);
+
+    return NULL;
+}
+
+/* Sum the array with NUM_THREADS freshly created threads */
+long long spawn_sum(int *numbers) {
+    pthread_t threads[NUM_THREADS];
+    thread_data_t thread_data[NUM_THREADS];
+    int chunk_size = ARRAY_SIZE / NUM_THREADS;
+
+    global_sum = 0;
+    for (int i = 0; i < NUM_THREADS; i++) {
+        thread_data[i].array = numbers;
+        thread_data[i].start_index = i * chunk_size;
+        thread_data[i].end_index = (i == NUM_THREADS - 1) ? ARRAY_SIZE : (i + 1) * chunk_size;
+        if (pthread_create(&threads[i], NULL, calculate_partial_sum, &thread_data[i]) != 0) {
+            perror("pthread_create failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return global_sum;
+}
+
+/* --- Thread pool version --- */
+
+/* Sum of one chunk into the worker's own partial sum */
+void sum_chunk(size_t start, size_t end, void *partial, void *arg) {
+    const int *array = (const int *)arg;
+    long long local_sum = 0;
+
+    for (size_t i = start; i < end; i++) {
+        local_sum += array[i];
+    }
+    *(long long *)partial += local_sum;
+}
+
+/* Add a worker's partial sum to the total */
+void add_partial(void *result, const void *partial, void *arg) {
+    (void)arg;
+    *(long long *)result += *(const long long *)partial;
+}
+
+/* Sum the array with the pool's persistent workers */
+long long pool_sum(thread_pool_t *pool, int *numbers) {
+    long long zero = 0;
+    long long sum = 0;
+
+    thread_pool_reduce(pool, 0, ARRAY_SIZE, 0, &zero, sizeof(zero),
+                       sum_chunk, add_partial, numbers, &sum);
+    return sum;
+}
+
+/* --- Benchmark --- */
+
+double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Time iterations sums of one version and check every result */
+void report(const char *name, int threads, double seconds, int iterations, int ok) {
+    printf("%-28s %2d threads  %9.1f us/call%s\n", name, threads,
+           seconds * 1e6 / iterations, ok ? "" : "  WRONG SUM");
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    long long expected = (long long)ARRAY_SIZE * (ARRAY_SIZE + 1) / 2;
+    int *numbers;
+    int ok;
+    double start;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* Allocate and initialize the array */
+    numbers = (int *)malloc(ARRAY_SIZE * sizeof(int));
+    if (numbers == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < ARRAY_SIZE; i++) {
+        numbers[i] = i + 1;
+    }
+    printf("Summing %d ints, %d calls per version\n", ARRAY_SIZE, iterations);
+
+    /* Spawn-per-call */
+    ok = 1;
+    start = now_sec();
+    for (int i = 0; i < iterations; i++) {
+        ok &= spawn_sum(numbers) == expected;
+    }
+    report("spawn per call + mutex", NUM_THREADS, now_sec() - start, iterations, ok);
+
+    /* Pool with the same number of threads, then one sized to the machine */
+    int sizes[2] = { NUM_THREADS, 0 };
+    for (int s = 0; s < 2; s++) {
+        thread_pool_t *pool = thread_pool_create(sizes[s]);
+        if (pool == NULL) {
+            perror("thread_pool_create failed");
+            exit(EXIT_FAILURE);
+        }
+        pool_sum(pool, numbers); /* Warm up: workers are started and waiting */
+        ok = 1;
+        start = now_sec();
+        for (int i = 0; i < iterations; i++) {
+            ok &= pool_sum(pool, numbers) == expected;
+        }
+        report(sizes[s] ? "thread pool" : "thread pool (one per core)",
+               thread_pool_size(pool), now_sec() - start, iterations, ok);
+        thread_pool_destroy(pool);
+    }
+
+    free(numbers);
+    return 0;
+}
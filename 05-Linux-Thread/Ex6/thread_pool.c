@@ -0,0 +1,309 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+/* Chunks given to each worker per job when the caller leaves the grain to the pool */
+#define CHUNKS_PER_WORKER 16
+
+/* Chunks a worker still has to run: next chunk in the low 32 bits, end in the high 32.
+ * The owner takes chunks from the front and thieves split off the back, both with a
+ * compare-and-swap of the whole pair. Padded so each worker's pair has its own line. */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t range;
+} worker_range_t;
+
+/* Per-worker partial result of a reduction, one cache line each */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) unsigned char data[THREAD_POOL_PARTIAL_MAX];
+} partial_t;
+
+/* Pool state */
+struct thread_pool {
+    int num_workers;            /* Workers, counting the caller */
+    pthread_t *threads;         /* The num_workers - 1 pool threads */
+    worker_range_t *ranges;     /* One per worker */
+    partial_t *partials;        /* One per worker */
+
+    /* Job hand-off */
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;  /* Signaled when a job is posted or the pool stops */
+    pthread_cond_t done_cond;   /* Signaled when the last worker finished a job */
+    unsigned long generation;   /* Number of jobs posted */
+    int stop;
+    atomic_int pending;         /* Workers still running the current job */
+
+    /* Current job */
+    size_t begin;
+    size_t end;
+    size_t grain;
+    range_fn_t body;            /* Parallel for body, or NULL for a reduction */
+    reduce_fn_t reduce;
+    void *arg;
+};
+
+/* Worker argument */
+typedef struct {
+    thread_pool_t *pool;
+    int worker;
+} worker_arg_t;
+
+static uint64_t pack_range(uint32_t next, uint32_t end) {
+    return ((uint64_t)end << 32) | next;
+}
+
+/* Run one chunk of the current job */
+static void run_chunk(thread_pool_t *pool, int worker, uint32_t chunk) {
+    size_t start = pool->begin + (size_t)chunk * pool->grain;
+    size_t end = start + pool->grain;
+    if (end > pool->end || end < start) {
+        end = pool->end;
+    }
+    if (pool->body != NULL) {
+        pool->body(start, end, worker, pool->arg);
+    } else {
+        pool->reduce(start, end, pool->partials[worker].data, pool->arg);
+    }
+}
+
+/* Take the next chunk of a worker's own range. Returns 0 if it is empty. */
+static int take_own(thread_pool_t *pool, int worker, uint32_t *chunk) {
+    _Atomic uint64_t *range = &pool->ranges[worker].range;
+    uint64_t old = atomic_load_explicit(range, memory_order_acquire);
+    while (1) {
+        uint32_t next = (uint32_t)old, end = (uint32_t)(old >> 32);
+        if (next >= end) {
+            return 0;
+        }
+        if (atomic_compare_exchange_weak_explicit(range, &old, pack_range(next + 1, end),
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+            *chunk = next;
+            return 1;
+        }
+    }
+}
+
+/* Move the back half of another worker's remaining chunks to a worker's own (empty)
+ * range. Returns 0 if every other worker's range is empty. */
+static int steal(thread_pool_t *pool, int worker) {
+    for (int i = 1; i < pool->num_workers; i++) {
+        int victim = (worker + i) % pool->num_workers;
+        _Atomic uint64_t *range = &pool->ranges[victim].range;
+        uint64_t old = atomic_load_explicit(range, memory_order_acquire);
+        while (1) {
+            uint32_t next = (uint32_t)old, end = (uint32_t)(old >> 32);
+            if (next >= end) {
+                break;
+            }
+            uint32_t mid = end - (end - next + 1) / 2;
+            if (atomic_compare_exchange_weak_explicit(range, &old, pack_range(next, mid),
+                                                      memory_order_acq_rel, memory_order_acquire)) {
+                atomic_store_explicit(&pool->ranges[worker].range, pack_range(mid, end),
+                                      memory_order_release);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Run chunks of the current job until there are none left anywhere */
+static void run_worker(thread_pool_t *pool, int worker) {
+    uint32_t chunk;
+    do {
+        while (take_own(pool, worker, &chunk)) {
+            run_chunk(pool, worker, chunk);
+        }
+    } while (steal(pool, worker));
+}
+
+/* Note that a worker finished the current job; the last one wakes the caller */
+static void finish_job(thread_pool_t *pool) {
+    if (atomic_fetch_sub_explicit(&pool->pending, 1, memory_order_acq_rel) == 1) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->done_cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/* Pool thread: waits for a job, runs its share, repeats until the pool stops */
+static void *pool_thread(void *arg) {
+    worker_arg_t *worker_arg = (worker_arg_t *)arg;
+    thread_pool_t *pool = worker_arg->pool;
+    int worker = worker_arg->worker;
+    unsigned long seen = 0;
+
+    free(worker_arg);
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop && pool->generation == seen) {
+            pthread_cond_wait(&pool->start_cond, &pool->lock);
+        }
+        if (pool->stop) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_worker(pool, worker);
+        finish_job(pool);
+    }
+    return NULL;
+}
+
+thread_pool_t *thread_pool_create(int num_threads) {
+    thread_pool_t *pool;
+
+    if (num_threads <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = cores > 0 ? (int)cores : 1;
+    }
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->num_workers = num_threads;
+    pool->threads = calloc(num_threads, sizeof(pthread_t));
+    pool->ranges = aligned_alloc(CACHE_LINE_SIZE, num_threads * sizeof(worker_range_t));
+    pool->partials = aligned_alloc(CACHE_LINE_SIZE, num_threads * sizeof(partial_t));
+    if (pool->threads == NULL || pool->ranges == NULL || pool->partials == NULL) {
+        free(pool->threads);
+        free(pool->ranges);
+        free(pool->partials);
+        free(pool);
+        return NULL;
+    }
+    for (int i = 0; i < num_threads; i++) {
+        atomic_init(&pool->ranges[i].range, 0);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    /* Worker 0 is the caller: start the others */
+    for (int i = 1; i < num_threads; i++) {
+        worker_arg_t *arg = malloc(sizeof(*arg));
+        if (arg == NULL) {
+            pool->num_workers = i;
+            break;
+        }
+        arg->pool = pool;
+        arg->worker = i;
+        if (pthread_create(&pool->threads[i], NULL, pool_thread, arg) != 0) {
+            free(arg);
+            pool->num_workers = i; /* Run with the workers started so far */
+            break;
+        }
+    }
+    return pool;
+}
+
+void thread_pool_destroy(thread_pool_t *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 1; i < pool->num_workers; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->threads);
+    free(pool->ranges);
+    free(pool->partials);
+    free(pool);
+}
+
+int thread_pool_size(const thread_pool_t *pool) {
+    return pool->num_workers;
+}
+
+/* Split the job into chunks, hand every worker its share and run it */
+static void run_job(thread_pool_t *pool, size_t begin, size_t end, size_t grain) {
+    int n = pool->num_workers;
+    size_t count = end - begin;
+    uint64_t chunks;
+
+    if (grain == 0) {
+        grain = count / ((size_t)n * CHUNKS_PER_WORKER);
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+    chunks = (count + grain - 1) / grain;
+    if (chunks > UINT32_MAX) {
+        grain = (count + UINT32_MAX - 1) / UINT32_MAX; /* Keep chunk numbers in 32 bits */
+        chunks = (count + grain - 1) / grain;
+    }
+    pool->begin = begin;
+    pool->end = end;
+    pool->grain = grain;
+    for (int i = 0; i < n; i++) {
+        uint32_t first = (uint32_t)(chunks * i / n);
+        uint32_t last = (uint32_t)(chunks * (i + 1) / n);
+        atomic_store_explicit(&pool->ranges[i].range, pack_range(first, last), memory_order_relaxed);
+    }
+    if (n == 1) {
+        run_worker(pool, 0);
+        return;
+    }
+
+    /* Post the job; the mutex publishes the job fields to the workers */
+    atomic_store_explicit(&pool->pending, n, memory_order_relaxed);
+    pthread_mutex_lock(&pool->lock);
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_worker(pool, 0);
+    atomic_fetch_sub_explicit(&pool->pending, 1, memory_order_acq_rel);
+
+    /* Wait for the workers still running chunks */
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load_explicit(&pool->pending, memory_order_acquire) != 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_parallel_for(thread_pool_t *pool, size_t begin, size_t end, size_t grain,
+                              range_fn_t body, void *arg) {
+    if (end <= begin) {
+        return;
+    }
+    pool->body = body;
+    pool->reduce = NULL;
+    pool->arg = arg;
+    run_job(pool, begin, end, grain);
+}
+
+int thread_pool_reduce(thread_pool_t *pool, size_t begin, size_t end, size_t grain,
+                       const void *identity, size_t partial_size,
+                       reduce_fn_t reduce, combine_fn_t combine, void *arg, void *result) {
+    if (partial_size > THREAD_POOL_PARTIAL_MAX) {
+        return -1;
+    }
+    for (int i = 0; i < pool->num_workers; i++) {
+        memcpy(pool->partials[i].data, identity, partial_size);
+    }
+    if (end > begin) {
+        pool->body = NULL;
+        pool->reduce = reduce;
+        pool->arg = arg;
+        run_job(pool, begin, end, grain);
+    }
+    /* Every worker wrote only its own partial; merge them in a fixed order */
+    for (int i = 0; i < pool->num_workers; i++) {
+        combine(result, pool->partials[i].data, arg);
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+/* Size of a cache line: per-worker data is padded to it so workers never share one */
+#define CACHE_LINE_SIZE 64
+
+/* Largest per-worker partial result of a reduction (one cache line) */
+#define THREAD_POOL_PARTIAL_MAX CACHE_LINE_SIZE
+
+/* Persistent pool of worker threads; the calling thread works as worker 0 */
+typedef struct thread_pool thread_pool_t;
+
+/* Body of a parallel for: handles indexes [start, end) as worker number worker */
+typedef void (*range_fn_t)(size_t start, size_t end, int worker, void *arg);
+
+/* Body of a reduction: folds indexes [start, end) into the worker's partial result */
+typedef void (*reduce_fn_t)(size_t start, size_t end, void *partial, void *arg);
+
+/* Merges a worker's partial result into the final result */
+typedef void (*combine_fn_t)(void *result, const void *partial, void *arg);
+
+/* Create a pool of num_threads workers (counting the caller), 0 for one per online core.
+ * Returns NULL on failure. */
+thread_pool_t *thread_pool_create(int num_threads);
+
+/* Stop and join the workers and free the pool */
+void thread_pool_destroy(thread_pool_t *pool);
+
+/* Number of workers, counting the caller */
+int thread_pool_size(const thread_pool_t *pool);
+
+/* Run body over [begin, end) split into chunks of grain indexes (0 picks one).
+ * Each worker starts with an equal share of the chunks and, once done, steals half of
+ * the remaining chunks of another worker. Returns when every index was handled.
+ * Calls must not overlap: one caller at a time. */
+void thread_pool_parallel_for(thread_pool_t *pool, size_t begin, size_t end, size_t grain,
+                              range_fn_t body, void *arg);
+
+/* Reduce [begin, end): every worker folds its chunks into its own partial result,
+ * started as a copy of identity (partial_size bytes, at most THREAD_POOL_PARTIAL_MAX),
+ * then the partials are combined into result in worker order. No lock is taken.
+ * Returns 0, or -1 if partial_size is too large. */
+int thread_pool_reduce(thread_pool_t *pool, size_t begin, size_t end, size_t grain,
+                       const void *identity, size_t partial_size,
+                       reduce_fn_t reduce, combine_fn_t combine, void *arg, void *result);
+
+#endif /* THREAD_POOL_H */
@@ -0,0 +1,398 @@
+#define _GNU_SOURCE /* For splice(), vmsplice(), tee() and F_SETPIPE_SZ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+/* Bulk version of Test.c: the parent streams a payload to child1, which forwards it to
+ * child2, either by copying through user-space buffers (read/write, as Test.c does) or
+ * without copying (vmsplice into the first pipe, splice from pipe to pipe, splice into
+ * the sink). The payload repeats a CHUNK_SIZE pattern that child2 can verify. */
+
+#define BUFFER_SIZE 256               /* Copy buffer of Test.c */
+#define CHUNK_SIZE (1024 * 1024)      /* Pattern the parent sends over and over */
+#define PIPE_CAPACITY (1024 * 1024)   /* Enlarged pipe size of the splice mode */
+#define DEFAULT_SIZE_MB 256           /* Payload size */
+
+/* Pipeline options */
+typedef struct {
+    int splice_mode;      /* 1: splice/vmsplice/tee, 0: read/write copies */
+    size_t buffer_size;   /* Copy buffer of the copy mode */
+    long long total;      /* Payload bytes */
+    const char *tap;      /* File child1 also saves the stream to, or NULL */
+    int verify;           /* Child2 checks the pattern instead of discarding the data */
+} options_t;
+
+/* Byte at offset i of the pattern chunk */
+static unsigned char pattern_byte(size_t i) {
+    return (unsigned char)(i * 31 + 7);
+}
+
+/* Set a pipe's capacity; pipes can move up to that much per splice call */
+static void enlarge_pipe(int fd) {
+    if (fcntl(fd, F_SETPIPE_SZ, PIPE_CAPACITY) == -1) {
+        perror("F_SETPIPE_SZ (keeping the default size)");
+    }
+}
+
+/* Write all of buf, continuing after partial writes */
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Parent: send opts->total bytes of the pattern into the pipe */
+static int send_payload(int fd, const options_t *opts, const unsigned char *chunk) {
+    long long left = opts->total;
+
+    while (left > 0) {
+        size_t len = left < CHUNK_SIZE ? (size_t)left : CHUNK_SIZE;
+        if (opts->splice_mode) {
+            /* Map the chunk's pages into the pipe; the chunk is never modified, so the
+             * same pages can be queued again while child1 still holds earlier ones */
+            struct iovec iov = { .iov_base = (void *)chunk, .iov_len = len };
+            while (iov.iov_len > 0) {
+                ssize_t n = vmsplice(fd, &iov, 1, 0);
+                if (n == -1) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    perror("vmsplice in parent");
+                    return -1;
+                }
+                iov.iov_base = (char *)iov.iov_base + n;
+                iov.iov_len -= n;
+            }
+        } else {
+            /* Copy the chunk through a buffer_size buffer, like Test.c's single write */
+            for (size_t off = 0; off < len; off += opts->buffer_size) {
+                size_t part = len - off < opts->buffer_size ? len - off : opts->buffer_size;
+                if (write_all(fd, (const char *)chunk + off, part) == -1) {
+                    perror("write in parent");
+                    return -1;
+                }
+            }
+        }
+        left -= len;
+    }
+    return 0;
+}
+
+/* Child1, copy mode: read from the parent and write to child2 (and the tap) */
+static int relay_copy(int in, int out, int tap, size_t buffer_size) {
+    char *buffer = malloc(buffer_size);
+    ssize_t n;
+
+    if (buffer == NULL) {
+        perror("malloc in child1");
+        return -1;
+    }
+    while ((n = read(in, buffer, buffer_size)) != 0) {
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read in child1");
+            free(buffer);
+            return -1;
+        }
+        if (write_all(out, buffer, n) == -1 || (tap != -1 && write_all(tap, buffer, n) == -1)) {
+            perror("write in child1");
+            free(buffer);
+            return -1;
+        }
+    }
+    free(buffer);
+    return 0;
+}
+
+/* Move len bytes from pipe in to out with splice(); the pages are moved, not copied */
+static int splice_all(int in, int out, size_t len) {
+    while (len > 0) {
+        ssize_t n = splice(in, NULL, out, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+/* Child1, splice mode: move the data from parent's pipe to child2's pipe. With a tap,
+ * tee() first duplicates the data into child2's pipe (the pages are shared, not copied)
+ * and splice() then moves the original pages into the tap file. */
+static int relay_splice(int in, int out, int tap) {
+    while (1) {
+        ssize_t n;
+        if (tap != -1) {
+            n = tee(in, out, PIPE_CAPACITY, 0);
+            if (n > 0 && splice_all(in, tap, n) == -1) {
+                perror("splice to tap in child1");
+                return -1;
+            }
+        } else {
+            n = splice(in, NULL, out, NULL, PIPE_CAPACITY, SPLICE_F_MOVE | SPLICE_F_MORE);
+        }
+        if (n == 0) {
+            return 0; /* Parent closed its end */
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror(tap != -1 ? "tee in child1" : "splice in child1");
+            return -1;
+        }
+    }
+}
+
+/* Child2: consume the stream, checking the pattern when asked. Returns bytes received. */
+static long long consume(int in, const options_t *opts) {
+    long long received = 0;
+    ssize_t n;
+
+    if (!opts->verify) {
+        /* Discard: the copy mode reads into a buffer, the splice mode into /dev/null */
+        int sink = opts->splice_mode ? open("/dev/null", O_WRONLY) : -1;
+        char *buffer = opts->splice_mode ? NULL : malloc(opts->buffer_size);
+        while (1) {
+            if (opts->splice_mode) {
+                n = splice(in, NULL, sink, NULL, PIPE_CAPACITY, SPLICE_F_MOVE);
+            } else {
+                n = read(in, buffer, opts->buffer_size);
+            }
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            received += n;
+        }
+        free(buffer);
+        if (sink != -1) {
+            close(sink);
+        }
+        return n == -1 ? -1 : received;
+    }
+
+    /* Verify: read everything and compare with the pattern */
+    char buffer[65536];
+    while ((n = read(in, buffer, sizeof(buffer))) != 0) {
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            if ((unsigned char)buffer[i] != pattern_byte((received + i) % CHUNK_SIZE)) {
+                fprintf(stderr, "Child2: wrong byte at offset %lld\n", received + i);
+                return -1;
+            }
+        }
+        received += n;
+    }
+    return received;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Run parent -> child1 -> child2 once. Returns the elapsed seconds, or -1 on failure. */
+static double run_pipeline(const options_t *opts, const unsigned char *chunk) {
+    int pipe_parent_child1[2]; /* Pipe for parent -> child1 communication */
+    int pipe_child1_child2[2]; /* Pipe for child1 -> child2 communication */
+    pid_t child1_pid, child2_pid;
+    int status, failed = 0;
+    double start = now_sec();
+
+    if (pipe(pipe_parent_child1) == -1 || pipe(pipe_child1_child2) == -1) {
+        perror("pipe");
+        return -1;
+    }
+    if (opts->splice_mode) {
+        enlarge_pipe(pipe_parent_child1[1]);
+        enlarge_pipe(pipe_child1_child2[1]);
+    }
+
+    /* Fork the first child (child1); flush first so it does not inherit buffered output */
+    fflush(stdout);
+    child1_pid = fork();
+    if (child1_pid == -1) {
+        perror("fork child1");
+        return -1;
+    }
+    if (child1_pid == 0) { /* Child1 process */
+        int tap = -1;
+        close(pipe_parent_child1[1]);
+        close(pipe_child1_child2[0]);
+        if (opts->tap != NULL) {
+            tap = open(opts->tap, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (tap == -1) {
+                perror("open tap");
+                exit(EXIT_FAILURE);
+            }
+        }
+        int ret = opts->splice_mode ? relay_splice(pipe_parent_child1[0], pipe_child1_child2[1], tap)
+                                    : relay_copy(pipe_parent_child1[0], pipe_child1_child2[1], tap,
+                                                 opts->buffer_size);
+        exit(ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    /* Fork the second child (child2) */
+    child2_pid = fork();
+    if (child2_pid == -1) {
+        perror("fork child2");
+        return -1;
+    }
+    if (child2_pid == 0) { /* Child2 process */
+        close(pipe_parent_child1[0]);
+        close(pipe_parent_child1[1]);
+        close(pipe_child1_child2[1]);
+        long long received = consume(pipe_child1_child2[0], opts);
+        if (received != opts->total) {
+            fprintf(stderr, "Child2 received %lld of %lld bytes\n", received, opts->total);
+            exit(EXIT_FAILURE);
+        }
+        exit(EXIT_SUCCESS);
+    }
+
+    /* Parent process */
+    close(pipe_parent_child1[0]);
+    close(pipe_child1_child2[0]);
+    close(pipe_child1_child2[1]);
+    if (send_payload(pipe_parent_child1[1], opts, chunk) == -1) {
+        failed = 1;
+    }
+    close(pipe_parent_child1[1]);
+
+    /* Wait for both child processes to finish */
+    for (int i = 0; i < 2; i++) {
+        if (wait(&status) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            failed = 1;
+        }
+    }
+    return failed ? -1 : now_sec() - start;
+}
+
+/* Print the throughput of one run */
+static void report(const char *name, const options_t *opts, double seconds) {
+    double mb = opts->total / (1024.0 * 1024.0);
+    if (seconds < 0) {
+        printf("%-24s failed\n", name);
+    } else {
+        printf("%-24s %8.0f MiB in %6.3f s  %8.1f MiB/s\n", name, mb, seconds, mb / seconds);
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-m copy|splice] [-s MiB] [-b buffer bytes] [-t tap file] [-v] [-B]\n"
+            "  -m  how child1 moves the data (default splice)\n"
+            "  -s  payload size (default %d MiB)\n"
+            "  -b  copy buffer size (default %d, as in Test.c)\n"
+            "  -t  child1 also saves the stream to this file (tee in splice mode)\n"
+            "  -v  child2 verifies the payload\n"
+            "  -B  benchmark: copy with %d and 64 KiB buffers against splice\n"
+            "      (with -v every version's child2 reads and checks the data)\n",
+            prog, DEFAULT_SIZE_MB, BUFFER_SIZE, BUFFER_SIZE);
+}
+
+int main(int argc, char *argv[]) {
+    options_t opts = { .splice_mode = 1, .buffer_size = BUFFER_SIZE,
+                       .total = (long long)DEFAULT_SIZE_MB * 1024 * 1024 };
+    int bench = 0, opt;
+    unsigned char *chunk;
+
+    while ((opt = getopt(argc, argv, "m:s:b:t:vB")) != -1) {
+        switch (opt) {
+        case 'm':
+            if (strcmp(optarg, "copy") != 0 && strcmp(optarg, "splice") != 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            opts.splice_mode = strcmp(optarg, "splice") == 0;
+            break;
+        case 's':
+            opts.total = atoll(optarg) * 1024 * 1024;
+            break;
+        case 'b':
+            opts.buffer_size = (size_t)atol(optarg);
+            break;
+        case 't':
+            opts.tap = optarg;
+            break;
+        case 'v':
+            opts.verify = 1;
+            break;
+        case 'B':
+            bench = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (opts.total <= 0 || opts.buffer_size == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* The pattern chunk, page-aligned so vmsplice hands over whole pages */
+    chunk = aligned_alloc(4096, CHUNK_SIZE);
+    if (chunk == NULL) {
+        perror("aligned_alloc");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < CHUNK_SIZE; i++) {
+        chunk[i] = pattern_byte(i);
+    }
+
+    if (!bench) {
+        double seconds = run_pipeline(&opts, chunk);
+        report(opts.splice_mode ? "splice/vmsplice" : "read/write copy", &opts, seconds);
+        free(chunk);
+        return seconds < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    /* Benchmark: the same payload through each version */
+    char name[64];
+    options_t run = opts;
+    run.splice_mode = 0;
+    run.buffer_size = BUFFER_SIZE;
+    snprintf(name, sizeof(name), "copy, %d B buffer", BUFFER_SIZE);
+    report(name, &run, run_pipeline(&run, chunk));
+    run.buffer_size = 65536;
+    report("copy, 64 KiB buffer", &run, run_pipeline(&run, chunk));
+    run.splice_mode = 1;
+    report("splice, 1 MiB pipes", &run, run_pipeline(&run, chunk));
+
+    free(chunk);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "shm_ring.h"
+
+/* Define the ring name (a POSIX shared memory object, see /dev/shm) */
+#define RING_NAME         "/my_test_ring"
+/* Define message properties, as in the mqueue examples */
+#define MAX_MSG_SIZE      256
+#define MAX_MESSAGES      10
+#define PRIORITY_LEVELS   32
+
+/* A message and the priority it is sent with */
+typedef struct {
+    const char *text;
+    unsigned int priority;
+} test_message_t;
+
+/* Sent in this order; received highest priority first, equal priorities in order */
+static const test_message_t messages[] = {
+    { "low priority, sent first", 1 },
+    { "normal priority", 10 },
+    { "urgent!", 20 },
+    { "low priority, sent last", 1 },
+    { "another normal priority message, a longer one", 10 },
+};
+#define NUM_MESSAGES (sizeof(messages) / sizeof(messages[0]))
+
+int main() {
+    shm_ring_t *ring;              /* Ring handle */
+    shm_ring_attr_t attr;          /* Ring attributes */
+    pid_t pid;
+    int status;
+
+    /* Initialize ring attributes */
+    attr.maxmsg = MAX_MESSAGES;    /* Messages per priority level */
+    attr.msgsize = MAX_MSG_SIZE;   /* Max message size */
+    attr.levels = PRIORITY_LEVELS; /* Priorities 0 .. 31 */
+
+    /* Create the ring */
+    ring = shm_ring_open(RING_NAME, O_CREAT | O_EXCL, 0666, &attr);
+    if (ring == NULL) {
+        perror("shm_ring_open failed");
+        exit(EXIT_FAILURE);
+    }
+    printf("- Ring '%s' created.\n", RING_NAME);
+
+    /* Queue every message before the reader exists, so the order it sees is only
+     * decided by the priorities */
+    for (size_t i = 0; i < NUM_MESSAGES; i++) {
+        printf("- Parent sending (Priority: %u): '%s'\n", messages[i].priority, messages[i].text);
+        if (shm_ring_send(ring, messages[i].text, strlen(messages[i].text), messages[i].priority) == -1) {
+            perror("shm_ring_send failed");
+            shm_ring_close(ring);
+            shm_ring_unlink(RING_NAME);
+            exit(EXIT_FAILURE);
+        }
+    }
+    fflush(stdout); /* Do not hand the buffered output to the child */
+
+    pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        shm_ring_close(ring);
+        shm_ring_unlink(RING_NAME);
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid == 0) {
+        /* ----- Child Process ----- */
+        char buffer[MAX_MSG_SIZE + 1];
+        unsigned int priority;
+        ssize_t bytes_received;
+        shm_ring_t *child_ring;
+
+        shm_ring_close(ring); /* Open it by name, as an unrelated process would */
+        child_ring = shm_ring_open(RING_NAME, 0, 0, NULL);
+        if (child_ring == NULL) {
+            perror("Child shm_ring_open failed");
+            exit(EXIT_FAILURE);
+        }
+        printf("- Child (PID: %d) receiving %zu messages...\n", getpid(), NUM_MESSAGES);
+        for (size_t i = 0; i < NUM_MESSAGES; i++) {
+            /* Each receive returns one whole message, the highest priority one */
+            bytes_received = shm_ring_receive(child_ring, buffer, MAX_MSG_SIZE, &priority);
+            if (bytes_received == -1) {
+                perror("Child shm_ring_receive failed");
+                shm_ring_close(child_ring);
+                exit(EXIT_FAILURE);
+            }
+            buffer[bytes_received] = '\0';
+            printf("- Child received %zd bytes (Priority: %u): '%s'\n", bytes_received, priority, buffer);
+        }
+        shm_ring_close(child_ring);
+        printf("- Child finished and closed ring.\n");
+        exit(EXIT_SUCCESS);
+    }
+
+    /* ----- Parent Process ----- */
+    if (waitpid(pid, &status, 0) == -1) {
+        perror("waitpid failed");
+    } else {
+        printf("- Parent detected child has finished.\n");
+    }
+
+    /* Close and unlink the ring */
+    shm_ring_close(ring);
+    if (shm_ring_unlink(RING_NAME) == -1) {
+        perror("shm_ring_unlink failed");
+    }
+    printf("- Parent unlinked ring '%s'.\n", RING_NAME);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,285 @@
+#define _GNU_SOURCE /* F_SETPIPE_SZ, F_GETPIPE_SZ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <mqueue.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "shm_ring.h"
+
+/* Define message properties, as in the mqueue examples */
+#define MAX_MSG_SIZE      256
+#define DEFAULT_MAX_MESSAGES 10
+
+#define DEFAULT_MSG_SIZE  64
+#define DEFAULT_ROUND_TRIPS 20000
+#define DEFAULT_MESSAGES  200000
+
+/* Names of the two channels: parent to child and child to parent */
+static const char *ring_names[2] = { "/bench_ring_p2c", "/bench_ring_c2p" };
+static const char *mq_names[2] = { "/bench_mq_p2c", "/bench_mq_c2p" };
+static const char *fifo_names[2] = { "/tmp/bench_fifo_p2c", "/tmp/bench_fifo_c2p" };
+
+typedef enum { TRANSPORT_SHM, TRANSPORT_MQUEUE, TRANSPORT_FIFO, NUM_TRANSPORTS } transport_t;
+
+static const char *transport_names[NUM_TRANSPORTS] = { "shm ring", "mqueue", "fifo" };
+
+/* Depth asked of every transport. The ring rounds it up to a power of two, and a pipe
+ * buffer is at least one page, so a FIFO is sized to the closest it can get */
+static long max_messages = DEFAULT_MAX_MESSAGES;
+
+/* Depth in messages each transport actually got, as reported once it is open */
+static long depths[NUM_TRANSPORTS];
+
+/* One direction of communication over one of the transports */
+typedef struct {
+    transport_t transport;
+    shm_ring_t *ring;
+    mqd_t mq;
+    int fd;
+} channel_t;
+
+/* Create both channels before the fork */
+static void create_channels(transport_t transport) {
+    for (int i = 0; i < 2; i++) {
+        if (transport == TRANSPORT_SHM) {
+            shm_ring_attr_t attr = { max_messages, MAX_MSG_SIZE, 1 };
+            shm_ring_t *ring;
+            shm_ring_unlink(ring_names[i]); /* Left over by an interrupted run */
+            ring = shm_ring_open(ring_names[i], O_CREAT | O_EXCL, 0600, &attr);
+            if (ring == NULL) {
+                perror("shm_ring_open failed");
+                exit(EXIT_FAILURE);
+            }
+            shm_ring_close(ring);
+        } else if (transport == TRANSPORT_MQUEUE) {
+            struct mq_attr attr = { 0, max_messages, MAX_MSG_SIZE, 0, { 0 } };
+            mqd_t mq;
+            mq_unlink(mq_names[i]);
+            mq = mq_open(mq_names[i], O_CREAT | O_EXCL | O_RDWR, 0600, &attr);
+            if (mq == (mqd_t)-1) {
+                perror("mq_open failed (the depth is capped by /proc/sys/fs/mqueue/msg_max)");
+                exit(EXIT_FAILURE);
+            }
+            mq_close(mq);
+        } else {
+            unlink(fifo_names[i]);
+            if (mkfifo(fifo_names[i], 0600) == -1) {
+                perror("mkfifo failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+}
+
+/* Remove both channels once the child is gone */
+static void destroy_channels(transport_t transport) {
+    for (int i = 0; i < 2; i++) {
+        if (transport == TRANSPORT_SHM) {
+            shm_ring_unlink(ring_names[i]);
+        } else if (transport == TRANSPORT_MQUEUE) {
+            mq_unlink(mq_names[i]);
+        } else {
+            unlink(fifo_names[i]);
+        }
+    }
+}
+
+/* Open channel number index for sending or receiving, and note the depth it got */
+static void open_channel(channel_t *channel, transport_t transport, int index, int sender, size_t msg_size) {
+    channel->transport = transport;
+    if (transport == TRANSPORT_SHM) {
+        channel->ring = shm_ring_open(ring_names[index], 0, 0, NULL);
+        if (channel->ring == NULL) {
+            perror("shm_ring_open failed");
+            exit(EXIT_FAILURE);
+        }
+        shm_ring_attr_t attr;
+        shm_ring_getattr(channel->ring, &attr);
+        depths[transport] = attr.maxmsg;
+    } else if (transport == TRANSPORT_MQUEUE) {
+        struct mq_attr attr;
+        channel->mq = mq_open(mq_names[index], sender ? O_WRONLY : O_RDONLY);
+        if (channel->mq == (mqd_t)-1) {
+            perror("mq_open failed");
+            exit(EXIT_FAILURE);
+        }
+        mq_getattr(channel->mq, &attr);
+        depths[transport] = attr.mq_maxmsg;
+    } else {
+        /* Blocks until the other end is opened too */
+        channel->fd = open(fifo_names[index], sender ? O_WRONLY : O_RDONLY);
+        if (channel->fd == -1) {
+            perror("open fifo failed");
+            exit(EXIT_FAILURE);
+        }
+        /* The default 64 KiB pipe buffer would hold about a thousand small messages. Both
+         * ends set it, so it is in place before either side looks at it */
+        if (fcntl(channel->fd, F_SETPIPE_SZ, (int)(max_messages * msg_size)) == -1) {
+            perror("F_SETPIPE_SZ failed");
+        }
+        depths[transport] = fcntl(channel->fd, F_GETPIPE_SZ) / (long)msg_size;
+    }
+}
+
+static void close_channel(channel_t *channel) {
+    if (channel->transport == TRANSPORT_SHM) {
+        shm_ring_close(channel->ring);
+    } else if (channel->transport == TRANSPORT_MQUEUE) {
+        mq_close(channel->mq);
+    } else {
+        close(channel->fd);
+    }
+}
+
+static void send_message(channel_t *channel, const char *msg, size_t len) {
+    int result;
+    if (channel->transport == TRANSPORT_SHM) {
+        result = shm_ring_send(channel->ring, msg, len, 0);
+    } else if (channel->transport == TRANSPORT_MQUEUE) {
+        result = mq_send(channel->mq, msg, len, 0);
+    } else {
+        /* Writes of at most PIPE_BUF bytes are never split */
+        result = write(channel->fd, msg, len) == (ssize_t)len ? 0 : -1;
+    }
+    if (result == -1) {
+        perror("send failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Receive one message into buffer (MAX_MSG_SIZE bytes). A FIFO has no message
+ * boundaries, so there every message is read as exactly len bytes. */
+static void receive_message(channel_t *channel, char *buffer, size_t len) {
+    ssize_t result;
+    if (channel->transport == TRANSPORT_SHM) {
+        result = shm_ring_receive(channel->ring, buffer, MAX_MSG_SIZE, NULL);
+    } else if (channel->transport == TRANSPORT_MQUEUE) {
+        result = mq_receive(channel->mq, buffer, MAX_MSG_SIZE, NULL);
+    } else {
+        size_t done = 0;
+        result = 0;
+        while (done < len) {
+            result = read(channel->fd, buffer + done, len - done);
+            if (result <= 0) {
+                break;
+            }
+            done += (size_t)result;
+        }
+    }
+    if (result <= 0) {
+        fprintf(stderr, "receive failed: %s\n", result == 0 ? "end of file" : strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Child side of both tests: receive count messages, answering each one (echo) or
+ * only the last one (sink) */
+static void run_child(transport_t transport, int echo, long count, size_t msg_size) {
+    char buffer[MAX_MSG_SIZE];
+    channel_t in, out;
+
+    open_channel(&in, transport, 0, 0, msg_size);
+    open_channel(&out, transport, 1, 1, msg_size);
+    for (long i = 0; i < count; i++) {
+        receive_message(&in, buffer, msg_size);
+        if (echo || i == count - 1) {
+            send_message(&out, buffer, msg_size);
+        }
+    }
+    close_channel(&in);
+    close_channel(&out);
+    exit(EXIT_SUCCESS);
+}
+
+/* Fork a child and time count messages sent to it. With echo, every message is a
+ * round trip; without, the child answers only the last one. Returns seconds. */
+static double run_test(transport_t transport, int echo, long count, size_t msg_size) {
+    char buffer[MAX_MSG_SIZE];
+    channel_t out, in;
+    double start, elapsed;
+    pid_t pid;
+
+    memset(buffer, 'x', sizeof(buffer));
+    create_channels(transport);
+    fflush(stdout); /* Do not hand the buffered output to the child */
+    pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        destroy_channels(transport);
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        run_child(transport, echo, count, msg_size);
+    }
+
+    open_channel(&out, transport, 0, 1, msg_size);
+    open_channel(&in, transport, 1, 0, msg_size);
+    start = now_seconds();
+    for (long i = 0; i < count; i++) {
+        send_message(&out, buffer, msg_size);
+        if (echo) {
+            receive_message(&in, buffer, msg_size);
+        }
+    }
+    if (!echo) {
+        receive_message(&in, buffer, msg_size);
+    }
+    elapsed = now_seconds() - start;
+
+    close_channel(&out);
+    close_channel(&in);
+    waitpid(pid, NULL, 0);
+    destroy_channels(transport);
+    return elapsed;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-s msg_size] [-r round_trips] [-n messages] [-m max_messages]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    size_t msg_size = DEFAULT_MSG_SIZE;
+    long round_trips = DEFAULT_ROUND_TRIPS;
+    long messages = DEFAULT_MESSAGES;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:r:n:m:")) != -1) {
+        switch (opt) {
+        case 's': msg_size = strtoul(optarg, NULL, 10); break;
+        case 'r': round_trips = atol(optarg); break;
+        case 'n': messages = atol(optarg); break;
+        case 'm': max_messages = atol(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (msg_size == 0 || msg_size > MAX_MSG_SIZE || msg_size > PIPE_BUF ||
+        round_trips <= 0 || messages <= 0 || max_messages <= 0) {
+        usage(argv[0]);
+    }
+
+    printf("- %zu-byte messages, %ld round trips, %ld one-way messages, queues of %ld asked\n",
+           msg_size, round_trips, messages, max_messages);
+    printf("%-10s %8s %14s %14s %12s\n", "transport", "depth", "latency (us)", "msgs/s", "MB/s");
+    for (int t = 0; t < NUM_TRANSPORTS; t++) {
+        /* Half a round trip is the time from a send to the matching receive */
+        double latency = run_test((transport_t)t, 1, round_trips, msg_size) / round_trips / 2;
+        double rate = messages / run_test((transport_t)t, 0, messages, msg_size);
+        printf("%-10s %8ld %14.2f %14.0f %12.1f\n", transport_names[t], depths[t], latency * 1e6,
+               rate, rate * msg_size / 1e6);
+    }
+    return 0;
+}
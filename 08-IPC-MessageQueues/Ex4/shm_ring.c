@@ -0,0 +1,316 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "shm_ring.h"
+
+/* Written last by the creator: an opener only uses a ring that carries it */
+#define SHM_RING_MAGIC 0x52494e47u
+
+/* Defaults when a ring is created without attributes (those of the mqueue examples) */
+#define DEFAULT_MAXMSG  10
+#define DEFAULT_MSGSIZE 256
+
+/* Limits on the attributes of a new ring */
+#define MAXMSG_LIMIT  (1L << 16)
+#define MSGSIZE_LIMIT (1L << 20)
+
+/* One priority level: a ring of capacity slots. Counters run freely and wrap; the
+ * producer only writes tail and the consumer only writes head, each on its own line. */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t tail;  /* Messages sent */
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t head;  /* Messages received */
+} lane_t;
+
+/* Start of the shared memory object; the slots of every level follow it */
+typedef struct {
+    _Atomic uint32_t magic;
+    uint32_t capacity;      /* Slots per level, a power of two */
+    uint32_t msgsize;
+    uint32_t levels;
+    uint32_t slot_size;     /* Length word plus msgsize, rounded to 8 bytes */
+
+    /* Futex words, bumped only when the other side announced it is going to sleep */
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t data_seq;   /* A message was sent */
+    _Atomic uint32_t receiver_waiting;
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t space_seq;  /* A slot was freed */
+    _Atomic uint32_t sender_waiting;
+
+    lane_t lanes[SHM_RING_PRIO_MAX];
+} ring_header_t;
+
+/* Slot: length of the message, then its bytes */
+typedef struct {
+    uint32_t len;
+    unsigned char data[];
+} slot_t;
+
+/* Per-process handle. The cached counters of the other side save reading its
+ * cache line until the ring looks full (sender) or empty (receiver). */
+struct shm_ring {
+    ring_header_t *hdr;
+    size_t map_size;
+    int nonblock;
+    uint32_t cached_head[SHM_RING_PRIO_MAX];
+    uint32_t cached_tail[SHM_RING_PRIO_MAX];
+};
+
+static size_t ring_size(uint32_t capacity, uint32_t slot_size, uint32_t levels) {
+    return sizeof(ring_header_t) + (size_t)levels * capacity * slot_size;
+}
+
+static slot_t *ring_slot(const shm_ring_t *ring, unsigned int level, uint32_t index) {
+    const ring_header_t *hdr = ring->hdr;
+    size_t slot = (size_t)level * hdr->capacity + (index & (hdr->capacity - 1));
+    return (slot_t *)((char *)ring->hdr + sizeof(ring_header_t) + slot * hdr->slot_size);
+}
+
+/* Shared (not process-private) futex wait and wake */
+static void futex_wait(_Atomic uint32_t *word, uint32_t expected) {
+    syscall(SYS_futex, word, FUTEX_WAIT, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/* Wake the other side if it announced a sleep on seq. The fence orders the counter
+ * just published before the waiting flag is read; the sleeper does the reverse, so
+ * one of the two always sees the other. */
+static void notify(_Atomic uint32_t *seq, _Atomic uint32_t *waiting) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiting, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(seq, 1, memory_order_relaxed);
+        futex_wake(seq);
+    }
+}
+
+/* Sleep on seq unless ready() turns true after the sleep was announced */
+static void wait_on(shm_ring_t *ring, _Atomic uint32_t *seq, _Atomic uint32_t *waiting,
+                    int (*ready)(shm_ring_t *, unsigned int), unsigned int level) {
+    uint32_t seen = atomic_load_explicit(seq, memory_order_relaxed);
+    atomic_store_explicit(waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!ready(ring, level)) {
+        futex_wait(seq, seen); /* Returns at once if seq moved since it was read */
+    }
+    atomic_store_explicit(waiting, 0, memory_order_relaxed);
+}
+
+/* Does level have a free slot? Reloads the consumer's counter. */
+static int has_space(shm_ring_t *ring, unsigned int level) {
+    lane_t *lane = &ring->hdr->lanes[level];
+    uint32_t tail = atomic_load_explicit(&lane->tail, memory_order_relaxed);
+    ring->cached_head[level] = atomic_load_explicit(&lane->head, memory_order_acquire);
+    return tail - ring->cached_head[level] < ring->hdr->capacity;
+}
+
+/* Highest level holding a message, or -1. Reloads the producer's counters only for
+ * levels that look empty. */
+static int find_message(shm_ring_t *ring) {
+    for (int level = (int)ring->hdr->levels - 1; level >= 0; level--) {
+        lane_t *lane = &ring->hdr->lanes[level];
+        uint32_t head = atomic_load_explicit(&lane->head, memory_order_relaxed);
+        if (ring->cached_tail[level] == head) {
+            ring->cached_tail[level] = atomic_load_explicit(&lane->tail, memory_order_acquire);
+        }
+        if (ring->cached_tail[level] != head) {
+            return level;
+        }
+    }
+    return -1;
+}
+
+static int has_message(shm_ring_t *ring, unsigned int level) {
+    (void)level;
+    return find_message(ring) >= 0;
+}
+
+/* Create and initialize the object behind fd */
+static ring_header_t *create_ring(int fd, const shm_ring_attr_t *attr, size_t *map_size) {
+    long maxmsg = attr ? attr->maxmsg : DEFAULT_MAXMSG;
+    long msgsize = attr ? attr->msgsize : DEFAULT_MSGSIZE;
+    long levels = attr ? attr->levels : SHM_RING_PRIO_MAX;
+    uint32_t capacity = 1;
+    ring_header_t *hdr;
+
+    if (maxmsg <= 0 || maxmsg > MAXMSG_LIMIT || msgsize <= 0 || msgsize > MSGSIZE_LIMIT ||
+        levels <= 0 || levels > SHM_RING_PRIO_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+    while (capacity < (uint32_t)maxmsg) {
+        capacity <<= 1;
+    }
+    uint32_t slot_size = (uint32_t)((sizeof(slot_t) + msgsize + 7) & ~(size_t)7);
+    *map_size = ring_size(capacity, slot_size, (uint32_t)levels);
+    if (ftruncate(fd, (off_t)*map_size) == -1) {
+        return NULL;
+    }
+    hdr = mmap(NULL, *map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED) {
+        return NULL;
+    }
+    /* The new object reads as zeros: counters, flags and futex words start at 0 */
+    hdr->capacity = capacity;
+    hdr->msgsize = (uint32_t)msgsize;
+    hdr->levels = (uint32_t)levels;
+    hdr->slot_size = slot_size;
+    atomic_store_explicit(&hdr->magic, SHM_RING_MAGIC, memory_order_release);
+    return hdr;
+}
+
+/* Map an existing object and check that it is a ring */
+static ring_header_t *map_ring(int fd, size_t *map_size) {
+    struct stat st;
+    ring_header_t *hdr;
+
+    if (fstat(fd, &st) == -1) {
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(ring_header_t)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    *map_size = (size_t)st.st_size;
+    hdr = mmap(NULL, *map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED) {
+        return NULL;
+    }
+    if (atomic_load_explicit(&hdr->magic, memory_order_acquire) != SHM_RING_MAGIC ||
+        hdr->levels == 0 || hdr->levels > SHM_RING_PRIO_MAX ||
+        ring_size(hdr->capacity, hdr->slot_size, hdr->levels) > *map_size) {
+        munmap(hdr, *map_size);
+        errno = EINVAL;
+        return NULL;
+    }
+    return hdr;
+}
+
+shm_ring_t *shm_ring_open(const char *name, int oflag, mode_t mode, const shm_ring_attr_t *attr) {
+    shm_ring_t *ring = calloc(1, sizeof(*ring));
+    int created = 0;
+    int fd = -1;
+
+    if (ring == NULL) {
+        return NULL;
+    }
+    /* Both sides write to the ring, so it is always opened read/write */
+    if (oflag & O_CREAT) {
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, mode);
+        created = fd != -1;
+        if (fd == -1 && errno == EEXIST && !(oflag & O_EXCL)) {
+            fd = shm_open(name, O_RDWR, 0);
+        }
+    } else {
+        fd = shm_open(name, O_RDWR, 0);
+    }
+    if (fd == -1) {
+        free(ring);
+        return NULL;
+    }
+    ring->hdr = created ? create_ring(fd, attr, &ring->map_size) : map_ring(fd, &ring->map_size);
+    if (ring->hdr == NULL) {
+        int saved = errno;
+        if (created) {
+            shm_unlink(name);
+        }
+        close(fd);
+        free(ring);
+        errno = saved;
+        return NULL;
+    }
+    close(fd); /* The mapping keeps the object */
+
+    ring->nonblock = (oflag & O_NONBLOCK) != 0;
+    for (uint32_t i = 0; i < ring->hdr->levels; i++) {
+        ring->cached_head[i] = atomic_load_explicit(&ring->hdr->lanes[i].head, memory_order_acquire);
+        ring->cached_tail[i] = atomic_load_explicit(&ring->hdr->lanes[i].tail, memory_order_acquire);
+    }
+    return ring;
+}
+
+int shm_ring_close(shm_ring_t *ring) {
+    int result = munmap(ring->hdr, ring->map_size);
+    free(ring);
+    return result;
+}
+
+int shm_ring_unlink(const char *name) {
+    return shm_unlink(name);
+}
+
+void shm_ring_getattr(const shm_ring_t *ring, shm_ring_attr_t *attr) {
+    attr->maxmsg = ring->hdr->capacity;
+    attr->msgsize = ring->hdr->msgsize;
+    attr->levels = ring->hdr->levels;
+}
+
+int shm_ring_send(shm_ring_t *ring, const void *msg, size_t len, unsigned int prio) {
+    ring_header_t *hdr = ring->hdr;
+
+    if (len > hdr->msgsize) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (prio >= hdr->levels) {
+        errno = EINVAL;
+        return -1;
+    }
+    lane_t *lane = &hdr->lanes[prio];
+    uint32_t tail = atomic_load_explicit(&lane->tail, memory_order_relaxed);
+    while (tail - ring->cached_head[prio] >= hdr->capacity && !has_space(ring, prio)) {
+        if (ring->nonblock) {
+            errno = EAGAIN;
+            return -1;
+        }
+        wait_on(ring, &hdr->space_seq, &hdr->sender_waiting, has_space, prio);
+    }
+
+    slot_t *slot = ring_slot(ring, prio, tail);
+    slot->len = (uint32_t)len;
+    memcpy(slot->data, msg, len);
+    atomic_store_explicit(&lane->tail, tail + 1, memory_order_release);
+    notify(&hdr->data_seq, &hdr->receiver_waiting);
+    return 0;
+}
+
+ssize_t shm_ring_receive(shm_ring_t *ring, void *buf, size_t len, unsigned int *prio) {
+    ring_header_t *hdr = ring->hdr;
+    int level;
+
+    if (len < hdr->msgsize) {
+        errno = EMSGSIZE; /* As mq_receive: the buffer must fit any message */
+        return -1;
+    }
+    while ((level = find_message(ring)) < 0) {
+        if (ring->nonblock) {
+            errno = EAGAIN;
+            return -1;
+        }
+        wait_on(ring, &hdr->data_seq, &hdr->receiver_waiting, has_message, 0);
+    }
+
+    lane_t *lane = &hdr->lanes[level];
+    uint32_t head = atomic_load_explicit(&lane->head, memory_order_relaxed);
+    const slot_t *slot = ring_slot(ring, (unsigned int)level, head);
+    uint32_t msg_len = slot->len;
+    if (msg_len > hdr->msgsize) {
+        msg_len = hdr->msgsize; /* Never trust the other process with our buffer */
+    }
+    memcpy(buf, slot->data, msg_len);
+    atomic_store_explicit(&lane->head, head + 1, memory_order_release);
+    notify(&hdr->space_seq, &hdr->sender_waiting);
+    if (prio != NULL) {
+        *prio = (unsigned int)level;
+    }
+    return (ssize_t)msg_len;
+}
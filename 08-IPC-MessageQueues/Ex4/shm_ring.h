@@ -0,0 +1,55 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Size of a cache line: the producer and consumer indexes each get their own */
+#define CACHE_LINE_SIZE 64
+
+/* Most priority levels a ring can have (priorities 0 .. levels - 1) */
+#define SHM_RING_PRIO_MAX 32
+
+/* Message ring in a POSIX shared memory object, used like a POSIX message queue:
+ * every receive returns exactly one sent message, the highest priority one first,
+ * messages of equal priority in the order they were sent.
+ * One process sends and one process receives at a time (single producer, single
+ * consumer); sending and receiving take no system call unless the other side has
+ * to be woken from, or has to go to, a futex sleep. */
+typedef struct shm_ring shm_ring_t;
+
+/* Attributes given when the ring is created */
+typedef struct {
+    long maxmsg;   /* Messages each priority level holds, rounded up to a power of two */
+    long msgsize;  /* Largest message in bytes */
+    long levels;   /* Number of priority levels, 1 .. SHM_RING_PRIO_MAX */
+} shm_ring_attr_t;
+
+/* Open the ring called name ("/name", as for shm_open). oflag takes O_CREAT, O_EXCL
+ * and O_NONBLOCK; a new ring gets mode and attr, an existing one keeps its own.
+ * attr->maxmsg is rounded up to a power of two, so a ring asked for 10 messages
+ * per level holds 16.
+ * Returns NULL and sets errno on failure. */
+shm_ring_t *shm_ring_open(const char *name, int oflag, mode_t mode, const shm_ring_attr_t *attr);
+
+/* Unmap the ring; it stays in the system until shm_ring_unlink */
+int shm_ring_close(shm_ring_t *ring);
+
+/* Remove the name of the ring (like mq_unlink) */
+int shm_ring_unlink(const char *name);
+
+/* Attributes of an open ring; maxmsg is the rounded depth each level really has */
+void shm_ring_getattr(const shm_ring_t *ring, shm_ring_attr_t *attr);
+
+/* Copy a message of len bytes into the ring with priority prio.
+ * Blocks while that priority level is full, unless the ring was opened O_NONBLOCK.
+ * Returns 0, or -1 with errno EMSGSIZE, EINVAL (bad prio) or EAGAIN. */
+int shm_ring_send(shm_ring_t *ring, const void *msg, size_t len, unsigned int prio);
+
+/* Copy the highest priority message into buf, which must hold msgsize bytes, and
+ * store its priority in prio if not NULL. Blocks while the ring is empty, unless it
+ * was opened O_NONBLOCK. Returns the message length, or -1 with errno EMSGSIZE or
+ * EAGAIN. */
+ssize_t shm_ring_receive(shm_ring_t *ring, void *buf, size_t len, unsigned int *prio);
+
+#endif /* SHM_RING_H */
@@ -14,8 +14,15 @@
  /* Returns true on success, false on failure with error message */
  bool connect_to_peer(const char* ip, int port);
  
- /* Function to send a message to a connection */
- /* Sends the message via the specified connection ID */
- void send_message(int id, const char* message);
+ /* Function to send a message to connections */
+ /* Queues one copy of the message to each of the count connection IDs */
+ void send_message(const int* ids, int count, const char* message);
+ 
+ /* Function to send a message to every connection */
+ void broadcast_message(const char* message);
+ 
+ /* Function to send a file to a connection */
+ /* Queues the file at path; the peer saves it in its working directory */
+ void send_file(int id, const char* path);
  
  #endif /* CLIENT_H */
\ No newline at end of file
@@ -10,9 +10,11 @@
  #include <stdbool.h>
  #include <pthread.h>
  #include <arpa/inet.h>
+ #include "protocol.h"
  
  /* Maximum number of simultaneous connections supported */
- #define MAX_CONNECTIONS 100
+ /* (one event loop serves them all, so this is bounded by file descriptors, not threads) */
+ #define MAX_CONNECTIONS 1024
  
  /* Structure to store connection details */
  typedef struct {
@@ -20,37 +22,79 @@
      int sock;      /* Socket file descriptor for the connection */
      char ip[INET_ADDRSTRLEN]; /* IP address of the connected peer (IPv4 string) */
      int port;      /* Port number of the connected peer */
+     bool connecting; /* Outgoing connect still in progress, not usable yet */
+     out_queue_t out; /* Frames waiting to be written by the event loop */
+     pthread_mutex_t out_mutex; /* Protects out between the senders and the event loop */
  } connection_t;
  
+ /* Results of queueing a frame to a connection */
+ #define QUEUE_OK         0  /* Queued; the event loop writes it */
+ #define QUEUE_NOT_FOUND -1  /* No such connection (or still connecting) */
+ #define QUEUE_FULL      -2  /* The peer is not keeping up (see MAX_QUEUED_BYTES) */
+ 
  /* Global array to store all connections */
  extern connection_t connections[MAX_CONNECTIONS];
  /* Global counter for the next connection ID */
  extern int next_id;
- /* Mutex to protect access to the connections array */
- extern pthread_mutex_t connections_mutex;
+ /* Reader-writer lock protecting the connections array and its indexes */
+ /* Lookups (receive, send, list) share it; only adding and removing connections is exclusive */
+ extern pthread_rwlock_t connections_lock;
  
  /* Function to initialize the connection manager */
  /* Sets all connection sockets to -1 (inactive) */
  void init_connections();
  
  /* Function to add a new connection */
+ /* connecting: an outgoing connect is still in progress */
  /* Returns the assigned ID or -1 if no slots are available */
- int add_connection(int sock, const char* ip, int port);
+ int add_connection(int sock, const char* ip, int port, bool connecting);
+ 
+ /* Function to mark an outgoing connection as established */
+ void set_connection_connected(int id);
+ 
+ /* Function to drop a connection whose connect failed or whose stream broke */
+ /* Closes the socket without sending the close frame */
+ void remove_pending_connection(int id);
+ 
+ /* Function to close a connection by socket */
+ /* Used by the event loop when the peer closed the connection or it failed */
+ void close_connection_by_socket(int sock);
+ 
+ /* Function to close every connection */
+ /* Used at exit; does not send the close frame */
+ void close_all_connections();
  
  /* Function to remove a connection by ID */
  /* Closes the socket and marks it as inactive */
  void remove_connection(int id);
  
  /* Function to list all active connections */
- /* Prints connection details to the log pipe */
+ /* Prints connection details to the console */
  void list_connections();
  
  /* Function to check for duplicate connections */
  /* Returns true if a connection to the IP and port already exists */
  bool is_duplicate_connection(const char* ip, int port);
  
- /* Function to get the socket for a connection ID */
- /* Returns the socket descriptor or -1 if not found */
- int get_connection_socket(int id);
+ /* Function to queue a frame to several connections */
+ /* Looks them all up under one shared lock; stores a QUEUE_* result per ID in status
+  * and returns how many connections it was queued to */
+ int queue_frame(const int* ids, int count, frame_buf_t* frame, int* status);
+ 
+ /* Function to queue a frame to every connection */
+ /* Returns how many connections it was queued to */
+ int broadcast_frame(frame_buf_t* frame);
+ 
+ /* Function to queue a file frame to a connection */
+ /* header comes from make_file_header(); on QUEUE_OK the queue owns the open file fd */
+ int queue_file(int id, frame_buf_t* header, int fd, off_t size);
+ 
+ /* Function to write the queued frames of a connection, called by the event loop */
+ /* Returns 0 when its queue is empty, 1 if the socket is full, -1 if the connection broke */
+ int flush_connection(int sock);
+ 
+ /* Function to find a connection by socket */
+ /* Copies its slot in connections[], IP, port and connecting state; returns its ID or -1 if not found */
+ int find_connection_by_socket(int sock, int* slot, char* ip, int* port, bool* connecting);
  
  #endif
\ No newline at end of file
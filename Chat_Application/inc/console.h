@@ -0,0 +1,29 @@
+/*
+ * File: console.h
+ * Author: Chau Bui
+ * Description: This header file declares the console writer: every thread hands
+ *              its formatted output to a lock-free queue, and one writer thread
+ *              copies the queued messages to stdout in batches.
+ */
+
+ #ifndef CONSOLE_H
+ #define CONSOLE_H
+ #include <stdbool.h>
+
+ /* Most messages gathered by one writev() call of the writer thread */
+ #define CONSOLE_BATCH_MAX 64
+
+ /* Function to start the console writer thread */
+ /* Returns false if it cannot be started */
+ bool console_init(void);
+
+ /* Function to print to the console */
+ /* Formats in the calling thread, then queues the text without taking a lock;
+  * messages of one thread appear in the order they were printed */
+ void console_printf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+ /* Function to stop the console writer thread */
+ /* Returns once everything queued before the call is written */
+ void console_shutdown(void);
+
+ #endif /* CONSOLE_H */
@@ -0,0 +1,137 @@
+/*
+ * File: protocol.h
+ * Author: Chau Bui
+ * Description: This header file defines the wire protocol between peers: every
+ *              message is a length-prefixed frame, serialized once, queued to the
+ *              output queue of every recipient, written with writev()/sendfile()
+ *              and reassembled on the receiving side by a frame reader.
+ */
+
+ #ifndef PROTOCOL_H
+ #define PROTOCOL_H
+ #include <stdbool.h>
+ #include <stddef.h>
+ #include <stdint.h>
+ #include <stdatomic.h>
+ #include <sys/types.h>
+ 
+ /* Frame header: 1 byte type, then the payload length as 4 bytes in network byte order */
+ #define FRAME_HEADER_SIZE 5
+ 
+ /* Frame types */
+ #define FRAME_TEXT  1  /* Payload: the message text (not NUL-terminated) */
+ #define FRAME_CLOSE 2  /* Empty payload: the peer is closing the connection */
+ #define FRAME_FILE  3  /* Payload: 2 byte name length, the file name, then the file contents */
+ 
+ /* Largest text payload a reader reassembles (files are streamed, not buffered) */
+ #define MAX_MESSAGE_SIZE (1024 * 1024)
+ /* Longest file name carried by a file frame */
+ #define MAX_FILE_NAME 255
+ /* Largest file a file frame carries: the payload length is 32 bits */
+ #define MAX_FILE_SIZE (UINT32_MAX - 2 - MAX_FILE_NAME)
+ /* Frame bytes a connection's output queue may hold before it stops accepting messages
+  * (queued file contents are read from the file as they go out and do not count) */
+ #define MAX_QUEUED_BYTES (8 * 1024 * 1024)
+ /* Most buffers gathered by one writev() call */
+ #define FLUSH_IOV_MAX 64
+ 
+ /* What a frame reader found in the received bytes */
+ typedef enum {
+     FRAME_EVENT_NONE,        /* All bytes consumed, the frame is not complete yet */
+     FRAME_EVENT_TEXT,        /* A whole text frame */
+     FRAME_EVENT_CLOSE,       /* A close frame */
+     FRAME_EVENT_FILE_START,  /* A file frame began: name and size are known */
+     FRAME_EVENT_FILE_DATA,   /* A chunk of the file contents */
+     FRAME_EVENT_FILE_END,    /* The file frame is complete */
+     FRAME_EVENT_ERROR        /* Malformed frame: the stream cannot be resynchronized */
+ } frame_event_t;
+ 
+ /* Serialized frame, shared by every output queue it is queued to */
+ typedef struct {
+     atomic_int refs;        /* Queue entries (and makers) holding it */
+     size_t len;
+     unsigned char data[];   /* Header and payload as sent */
+ } frame_buf_t;
+ 
+ /* Output queue entry: a frame, or the contents of a file following its header */
+ typedef struct out_item {
+     struct out_item* next;
+     frame_buf_t* frame;     /* NULL for file contents */
+     size_t offset;          /* Bytes of the frame written so far */
+     int file_fd;            /* File sent by a contents entry, -1 otherwise */
+     off_t file_offset;      /* Next byte of the file to send */
+     off_t file_end;
+ } out_item_t;
+ 
+ /* Frames waiting to be written to one connection */
+ typedef struct {
+     out_item_t* head;
+     out_item_t* tail;
+     size_t bytes;           /* Frame bytes queued (see MAX_QUEUED_BYTES) */
+ } out_queue_t;
+ 
+ /* Reassembly state of one connection's incoming byte stream */
+ typedef struct {
+     int state;                              /* Part of the frame being read (see protocol.c) */
+     unsigned char header[FRAME_HEADER_SIZE]; /* Header (or file name length) bytes so far */
+     size_t header_len;
+     uint8_t type;                           /* Type of the current frame */
+     uint32_t remaining;                     /* Payload bytes of the current frame not read yet */
+     char* text;                             /* Reassembly buffer of text frames */
+     size_t text_len;
+     size_t text_capacity;
+     char name[MAX_FILE_NAME + 1];           /* File name of the current file frame */
+     size_t name_len;
+     size_t name_expected;
+ } frame_reader_t;
+ 
+ /* Function to serialize a text frame */
+ /* Returns a frame holding one reference, or NULL if the text is too long or memory ran out */
+ frame_buf_t* make_text_frame(const char* text, size_t len);
+ 
+ /* Function to serialize the header and name of a file frame */
+ /* The size bytes of contents must follow it; returns NULL if memory ran out */
+ frame_buf_t* make_file_header(const char* name, uint32_t size);
+ 
+ /* Function to take another reference to a frame */
+ void frame_buf_ref(frame_buf_t* frame);
+ 
+ /* Function to drop a reference to a frame */
+ /* Frees it when the last reference is gone */
+ void frame_buf_unref(frame_buf_t* frame);
+ 
+ /* Function to initialize an empty output queue */
+ void out_queue_init(out_queue_t* queue);
+ 
+ /* Function to append a frame to an output queue */
+ /* Takes its own reference to the frame; with file_fd other than -1 the queue also takes
+  * over the open file and sends file_size bytes of it after the frame (see make_file_header).
+  * Returns false if memory ran out */
+ bool out_queue_push(out_queue_t* queue, frame_buf_t* frame, int file_fd, off_t file_size);
+ 
+ /* Function to write as much of an output queue as the socket takes without blocking */
+ /* Returns 0 once the queue is empty, 1 if the socket is full, -1 if the connection broke */
+ int out_queue_flush(out_queue_t* queue, int sock);
+ 
+ /* Function to drop everything left in an output queue */
+ void out_queue_clear(out_queue_t* queue);
+ 
+ /* Function to send a close frame */
+ /* Best effort, without blocking: used when the output queue is empty */
+ bool send_close_frame(int sock);
+ 
+ /* Function to initialize a frame reader */
+ void frame_reader_init(frame_reader_t* reader);
+ 
+ /* Function to reset a frame reader for a new connection */
+ /* Frees its reassembly buffer */
+ void frame_reader_reset(frame_reader_t* reader);
+ 
+ /* Function to feed received bytes to a frame reader */
+ /* Consumes bytes from *data (advancing it and *len) until something happened and returns it; for TEXT
+  * (*out, *out_len) is the message, for FILE_START *out is the file name and *out_len
+  * its size, for FILE_DATA the chunk. Call again until it returns NONE or ERROR */
+ frame_event_t frame_reader_next(frame_reader_t* reader, const char** data, size_t* len,
+                                 const char** out, size_t* out_len);
+ 
+ #endif /* PROTOCOL_H */
@@ -2,20 +2,34 @@
  * File: server.h
  * Author: Chau Bui
  * Description: This header file declares the server-side components, including
- *              the listening socket, log pipe, and the server thread function.
+ *              the listening socket and the server thread function.
  */
 
  #ifndef SERVER_H
  #define SERVER_H
  #include <pthread.h>
+ #include <stdbool.h>
  
  /* External declaration of the listening socket for incoming connections */
  extern int listen_sock;
  
- /* External declaration of the log pipe for output redirection */
- extern int log_pipe[2];
+ /* Function to set up the event loop, called once listen_sock is listening */
+ /* Returns false if the epoll instance cannot be created */
+ bool init_server(void);
  
- /* Function to run the server thread, handling incoming connections */
+ /* Function to add a non-blocking peer socket to the event loop */
+ /* connecting: the socket's connect is in progress; returns false on failure */
+ bool watch_peer(int sock, bool connecting);
+ 
+ /* Function to ask the event loop to write a peer's output queue, or stop asking */
+ /* Called with the connection's out_mutex held */
+ void set_peer_output(int sock, bool on);
+ 
+ /* Function to wake the server thread so it sees running cleared and returns */
+ void stop_server(void);
+ 
+ /* Function to run the server thread: one epoll event loop for the listening
+  * socket and every peer socket, incoming and outgoing */
  void* server_thread(void* arg);
  
  #endif
\ No newline at end of file
@@ -25,4 +25,8 @@
  /* Frees the token array and its contents */
  void free_tokens(char** tokens, int num_tokens);
  
+ /* Function to parse a list of connection IDs such as "1,4,7" */
+ /* Stores up to max IDs; returns how many, or -1 if the list is malformed */
+ int parse_id_list(const char* list, int* ids, int max);
+ 
  #endif /* UTILS_H */
\ No newline at end of file
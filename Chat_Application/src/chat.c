@@ -17,11 +17,14 @@
  #include "connection_manager.h"
  #include "server.h"
  #include "client.h"
+ #include "console.h"
+ 
+ /* Longest command line accepted, which bounds the messages typed at the prompt */
+ #define MAX_LINE 4096
  
  /* Global variables */
  volatile sig_atomic_t running = 1; /* Flag to control program execution */
  int listen_sock;                   /* Listening socket for incoming connections */
- int log_pipe[2];                   /* Pipe for logging output */
  char* myip;                        /* Local IP address */
  int myport;                        /* Listening port number */
  
@@ -31,32 +34,32 @@
      running = 0;
  }
  
- /* Thread function to handle logging */
- /* Reads from log_pipe and writes to stdout */
- void* logging_thread(void* arg) {
-     char buffer[1024];
-     while (true) {
-         ssize_t n = read(log_pipe[0], buffer, sizeof(buffer));
-         if (n <= 0) break; /* Exit on pipe close or error */
-         write(STDOUT_FILENO, buffer, n); /* Write to console */
-     }
-     return NULL;
- }
- 
  /* Function to print the help message */
  /* Displays available commands and their descriptions */
  void print_help() {
-     dprintf(log_pipe[1], "\nAvailable commands:\n"
+     console_printf("\nAvailable commands:\n"
             "help - Display this help message\n"
             "myip - Display the IP address of this process\n"
             "myport - Display the port this process is listening on\n"
             "connect <destination> <port> - Connect to another peer\n"
             "list - List all connections\n"
             "terminate <connection id> - Terminate a connection\n"
-            "send <connection id> <message> - Send a message (max 100 chars)\n"
+            "send <connection id>[,<connection id>...] <message> - Send a message\n"
+            "broadcast <message> - Send a message to every connection\n"
+            "sendfile <connection id> <path> - Send a file\n"
             "exit - Exit the program\n");
  }
  
+ /* Function to rebuild a message from its tokens */
+ /* Joins them with single spaces into message, which holds MAX_LINE characters */
+ void join_tokens(char** tokens, int num_tokens, char* message) {
+     message[0] = '\0'; /* The rest of the line always fits */
+     for (int i = 0; i < num_tokens; i++) {
+         strcat(message, tokens[i]);
+         if (i < num_tokens - 1) strcat(message, " ");
+     }
+ }
+ 
  /* Main function */
  /* Entry point of the chat application */
  int main(int argc, char* argv[]) {
@@ -70,31 +73,37 @@
      myip = get_local_ip();  /* Get local IP address */
      init_connections();     /* Initialize connection manager */
  
-     /* Create pipe for logging */
-     if (pipe(log_pipe) == -1) {
-         perror("Failed to create pipe");
+     /* Start the console writer all output goes through */
+     if (!console_init()) {
+         perror("Failed to start the console writer");
          return 1;
      }
  
-     /* Spawn logging thread */
-     pthread_t log_thread;
-     pthread_create(&log_thread, NULL, logging_thread, NULL);
-     pthread_detach(log_thread);
- 
      signal(SIGINT, signal_handler); /* Set up signal handler */
+     signal(SIGPIPE, SIG_IGN);       /* A peer closing mid-send is reported by sendfile() instead */
  
      /* Create listening socket */
-     listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+     listen_sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0); /* Non-blocking: the event loop accepts until EAGAIN */
      if (listen_sock < 0) {
-         dprintf(log_pipe[1], "Failed to create socket\n");
+         console_printf("Failed to create socket\n");
+         console_shutdown();
          return 1;
      }
  
      /* Set up server address and bind socket */
      struct sockaddr_in server_addr = { .sin_family = AF_INET, .sin_addr.s_addr = INADDR_ANY, .sin_port = htons(myport) };
-     if (bind(listen_sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0 || listen(listen_sock, 5) < 0) {
-         dprintf(log_pipe[1], "Failed to bind or listen on socket\n");
+     if (bind(listen_sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0 || listen(listen_sock, SOMAXCONN) < 0) {
+         console_printf("Failed to bind or listen on socket\n");
          close(listen_sock);
+         console_shutdown();
+         return 1;
+     }
+ 
+     /* Set up the event loop serving the listening socket and every peer */
+     if (!init_server()) {
+         console_printf("Failed to set up the event loop\n");
+         close(listen_sock);
+         console_shutdown();
          return 1;
      }
  
@@ -103,13 +112,20 @@
      pthread_create(&server_thread_id, NULL, server_thread, NULL);
      pthread_detach(server_thread_id);
  
-     dprintf(log_pipe[1], "Chat started on %s:%d\n", myip, myport);
+     console_printf("Chat started on %s:%d\n", myip, myport);
  
      /* Main command loop */
      while (running) {
-         dprintf(log_pipe[1], "> "); /* Prompt user for input */
-         char line[256];
+         console_printf("> "); /* Prompt user for input */
+         char line[MAX_LINE];
          if (!fgets(line, sizeof(line), stdin)) break; /* Read command */
+         if (!strchr(line, '\n') && !feof(stdin)) {
+             /* Discard the rest of an overlong line instead of running it as commands */
+             int c;
+             while ((c = getchar()) != '\n' && c != EOF);
+             console_printf("Command too long\n");
+             continue;
+         }
          line[strcspn(line, "\n")] = 0; /* Remove newline */
  
          int num_tokens;
@@ -121,44 +137,43 @@
  
          /* Process commands */
          if (!strcmp(tokens[0], "help")) print_help();
-         else if (!strcmp(tokens[0], "myip")) dprintf(log_pipe[1], "%s\n", myip);
-         else if (!strcmp(tokens[0], "myport")) dprintf(log_pipe[1], "%d\n", myport);
+         else if (!strcmp(tokens[0], "myip")) console_printf("%s\n", myip);
+         else if (!strcmp(tokens[0], "myport")) console_printf("%d\n", myport);
          else if (!strcmp(tokens[0], "connect") && num_tokens == 3) 
              connect_to_peer(tokens[1], atoi(tokens[2]));
          else if (!strcmp(tokens[0], "list")) list_connections();
          else if (!strcmp(tokens[0], "terminate") && num_tokens == 2) 
              remove_connection(atoi(tokens[1]));
          else if (!strcmp(tokens[0], "send") && num_tokens >= 3) {
-             int id = atoi(tokens[1]);
-             char message[101] = {0}; /* Buffer for message (max 100 chars + null) */
-             /* Construct message from tokens */
-             for (int i = 2; i < num_tokens; i++) {
-                 strncat(message, tokens[i], 100 - strlen(message));
-                 if (i < num_tokens - 1) strncat(message, " ", 100 - strlen(message));
+             int ids[MAX_CONNECTIONS];
+             int count = parse_id_list(tokens[1], ids, MAX_CONNECTIONS);
+             if (count < 0) {
+                 console_printf("Invalid connection ID list\n");
+             } else {
+                 char message[MAX_LINE];
+                 join_tokens(tokens + 2, num_tokens - 2, message);
+                 send_message(ids, count, message);
              }
-             if (strlen(message) > 100) 
-                 dprintf(log_pipe[1], "Message too long\n");
-             else 
-                 send_message(id, message);
          }
+         else if (!strcmp(tokens[0], "broadcast") && num_tokens >= 2) {
+             char message[MAX_LINE];
+             join_tokens(tokens + 1, num_tokens - 1, message);
+             broadcast_message(message);
+         }
+         else if (!strcmp(tokens[0], "sendfile") && num_tokens == 3)
+             send_file(atoi(tokens[1]), tokens[2]);
          else if (!strcmp(tokens[0], "exit")) running = 0;
-         else dprintf(log_pipe[1], "Unknown command\n");
+         else console_printf("Unknown command\n");
  
          free_tokens(tokens, num_tokens); /* Clean up tokens */
      }
  
      /* Cleanup on exit */
+     stop_server();      /* Wake the event loop so it returns */
      close(listen_sock); /* Close listening socket */
-     pthread_mutex_lock(&connections_mutex);
-     for (int i = 0; i < MAX_CONNECTIONS; i++) {
-         if (connections[i].sock != -1) {
-             close(connections[i].sock); /* Close all active connections */
-             connections[i].sock = -1;
-         }
-     }
-     pthread_mutex_unlock(&connections_mutex);
-     close(log_pipe[1]); /* Close write end of log pipe */
+     close_all_connections(); /* Close all active connections */
      sleep(1);           /* Allow threads to exit gracefully */
+     console_shutdown(); /* Write out everything still queued */
      dprintf(STDERR_FILENO, "Program exited.\n");
      free(myip);         /* Free allocated IP string */
      return 0;
@@ -9,85 +9,149 @@
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
+ #include <errno.h>        /* For errno */
  #include <unistd.h>       /* For close() */
+ #include <fcntl.h>        /* For open() */
+ #include <sys/stat.h>     /* For fstat() */
  #include <sys/socket.h>   /* For socket operations */
  #include <netinet/in.h>   /* For sockaddr_in */
  #include <arpa/inet.h>    /* For inet_pton */
- #include <pthread.h>      /* For threading */
  #include "connection_manager.h"
+ #include "console.h"
+ #include "protocol.h"
+ #include "server.h"       /* For watch_peer() */
  #include "utils.h"
  
  /* External declarations of global variables and functions */
- extern int log_pipe[2];
- extern void* handle_client(void* arg);
  extern char* myip;
  extern int myport;
  
  /* Function to connect to a peer */
- /* Establishes a TCP connection and spawns a handler thread */
+ /* Starts a non-blocking TCP connect and hands the socket to the event loop,
+  * which reports the outcome; returns false if the connect could not be started */
  bool connect_to_peer(const char* ip, int port) {
      if (!is_valid_ip(ip)) {
-         dprintf(log_pipe[1], "Invalid IP address\n");
+         console_printf("Invalid IP address\n");
          return false;
      }
      /* Prevent self-connection */
      if (strcmp(ip, myip) == 0 && port == myport) {
-         dprintf(log_pipe[1], "Cannot connect to self\n");
+         console_printf("Cannot connect to self\n");
          return false;
      }
      /* Prevent duplicate connections */
      if (is_duplicate_connection(ip, port)) {
-         dprintf(log_pipe[1], "Already connected to this peer\n");
+         console_printf("Already connected to this peer\n");
          return false;
      }
-     /* Create a TCP socket */
-     int sock = socket(AF_INET, SOCK_STREAM, 0);
+     /* Create a non-blocking TCP socket */
+     int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
      if (sock < 0) {
-         dprintf(log_pipe[1], "Failed to create socket\n");
+         console_printf("Failed to create socket\n");
          return false;
      }
      /* Set up server address structure */
      struct sockaddr_in server_addr = { .sin_family = AF_INET, .sin_port = htons(port) };
      if (inet_pton(AF_INET, ip, &server_addr.sin_addr) <= 0) {
-         dprintf(log_pipe[1], "Invalid IP address\n");
+         console_printf("Invalid IP address\n");
          close(sock);
          return false;
      }
-     /* Attempt to connect to the peer */
+     /* Start connecting; it usually completes later, in the event loop */
+     bool connecting = false;
      if (connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-         dprintf(log_pipe[1], "Connection to %s:%d failed\n", ip, port);
-         close(sock);
-         return false;
+         if (errno != EINPROGRESS) {
+             console_printf("Connection to %s:%d failed\n", ip, port);
+             close(sock);
+             return false;
+         }
+         connecting = true;
      }
      /* Add the connection to the list */
-     int id = add_connection(sock, ip, port);
+     int id = add_connection(sock, ip, port, connecting);
      if (id == -1) {
-         dprintf(log_pipe[1], "Maximum connections reached\n");
+         console_printf("Maximum connections reached\n");
          close(sock);
          return false;
      }
-     dprintf(log_pipe[1], "Connected to %s:%d as connection ID %d\n", ip, port, id);
-     /* Spawn a thread to handle incoming messages */
-     int* sock_ptr = malloc(sizeof(int));
-     *sock_ptr = sock;
-     pthread_t thread;
-     pthread_create(&thread, NULL, handle_client, sock_ptr);
-     pthread_detach(thread);
+     if (!watch_peer(sock, connecting)) {
+         console_printf("Connection to %s:%d failed\n", ip, port);
+         remove_pending_connection(id);
+         return false;
+     }
+     if (connecting) {
+         console_printf("Connecting to %s:%d...\n", ip, port);
+     } else {
+         console_printf("Connected to %s:%d as connection ID %d\n", ip, port, id);
+     }
      return true;
  }
  
- /* Function to send a message to a connection */
- /* Sends the message via the specified connection ID */
- void send_message(int id, const char* message) {
-     int sock = get_connection_socket(id);
-     if (sock == -1) {
-         dprintf(log_pipe[1], "Connection %d not found\n", id);
+ /* Function to send a message to connections */
+ /* Serializes the message once and queues it to every listed connection ID */
+ void send_message(const int* ids, int count, const char* message) {
+     frame_buf_t* frame = make_text_frame(message, strlen(message));
+     if (frame == NULL) {
+         console_printf("Failed to send message\n");
+         return;
+     }
+     int status[MAX_CONNECTIONS];
+     queue_frame(ids, count, frame, status);
+     frame_buf_unref(frame); /* The queues hold their own references */
+     /* Report the result for each connection */
+     for (int i = 0; i < count; i++) {
+         if (status[i] == QUEUE_OK) {
+             console_printf("Message sent to %d\n", ids[i]);
+         } else if (status[i] == QUEUE_FULL) {
+             console_printf("Connection %d is not keeping up, message dropped\n", ids[i]);
+         } else {
+             console_printf("Connection %d not found\n", ids[i]);
+         }
+     }
+ }
+ 
+ /* Function to send a message to every connection */
+ /* Serializes the message once and queues it to all of them */
+ void broadcast_message(const char* message) {
+     frame_buf_t* frame = make_text_frame(message, strlen(message));
+     if (frame == NULL) {
+         console_printf("Failed to send message\n");
          return;
      }
-     /* Send the message and check for errors */
-     if (send(sock, message, strlen(message), 0) < 0) {
-         dprintf(log_pipe[1], "Failed to send message to %d\n", id);
+     int queued = broadcast_frame(frame);
+     frame_buf_unref(frame);
+     console_printf("Message sent to %d connection%s\n", queued, queued == 1 ? "" : "s");
+ }
+ 
+ /* Function to send a file to a connection */
+ /* Queues the file; the event loop streams it with sendfile() and the peer saves it
+  * under its base name */
+ void send_file(int id, const char* path) {
+     int fd = open(path, O_RDONLY | O_CLOEXEC);
+     struct stat st;
+     if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+         console_printf("Cannot read file %s\n", path);
+         if (fd >= 0) close(fd);
+         return;
+     }
+     const char* name = strrchr(path, '/');
+     name = name ? name + 1 : path;
+     frame_buf_t* header = st.st_size <= MAX_FILE_SIZE ? make_file_header(name, (uint32_t)st.st_size) : NULL;
+     if (header == NULL) {
+         console_printf("File %s cannot be sent (name or size too long)\n", path);
+         close(fd);
+         return;
+     }
+     int result = queue_file(id, header, fd, st.st_size);
+     frame_buf_unref(header);
+     if (result == QUEUE_OK) {
+         console_printf("Sending file %s (%lld bytes) to %d\n", name, (long long)st.st_size, id);
+         return; /* The queue closes the file once it is sent */
+     }
+     if (result == QUEUE_FULL) {
+         console_printf("Connection %d is not keeping up, file not sent\n", id);
      } else {
-         dprintf(log_pipe[1], "Message sent to %d\n", id);
+         console_printf("Connection %d not found\n", id);
      }
+     close(fd);
  }
\ No newline at end of file
@@ -9,116 +9,376 @@
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
+ #include <stdint.h>
  #include <unistd.h>      /* For close() */
+ #include "console.h"
+ #include "protocol.h"
+ #include "server.h"      /* For set_peer_output() */
  #include "utils.h"
  
- /* External declaration of log pipe for output */
- extern int log_pipe[2];
+ /* Number of entries in each index: a power of two at least twice MAX_CONNECTIONS,
+  * so lookups stay a probe or two however full the connection table is */
+ #define INDEX_BITS 11
+ #define INDEX_SIZE (1 << INDEX_BITS)
+ 
+ /* Index entry mapping a key (ID, socket or address) to a connection slot */
+ typedef struct {
+     uint64_t key;
+     int slot;      /* Slot in connections[], -1 if the entry is empty */
+ } index_entry_t;
+ 
+ /* Open-addressing hash table with linear probing */
+ typedef struct {
+     index_entry_t entries[INDEX_SIZE];
+ } slot_index_t;
  
  /* Global variables defined here (declared in header) */
  connection_t connections[MAX_CONNECTIONS];
  int next_id = 1;
- pthread_mutex_t connections_mutex = PTHREAD_MUTEX_INITIALIZER;
+ pthread_rwlock_t connections_lock = PTHREAD_RWLOCK_INITIALIZER;
+ 
+ /* Connection details copied out by list_connections() */
+ typedef struct {
+     int id;
+     char ip[INET_ADDRSTRLEN];
+     int port;
+ } listed_t;
+ 
+ /* Indexes over connections[], updated with connections_lock held for writing */
+ static slot_index_t id_index;    /* Connection ID -> slot */
+ static slot_index_t sock_index;  /* Socket -> slot */
+ static slot_index_t addr_index;  /* (IP, port) -> slot, for duplicate detection */
+ static int free_slots[MAX_CONNECTIONS]; /* Stack of inactive slots */
+ static int free_count;
+ 
+ /* Function to compute the home position of a key in an index */
+ /* Fibonacci hashing: the top INDEX_BITS bits of the product */
+ static unsigned int index_home(uint64_t key) {
+     return (unsigned int)((key * 0x9E3779B97F4A7C15ull) >> (64 - INDEX_BITS));
+ }
+ 
+ /* Function to find the slot stored for a key */
+ /* Returns the slot or -1 if the key is not in the index */
+ static int index_find(const slot_index_t* index, uint64_t key) {
+     for (unsigned int i = index_home(key); ; i = (i + 1) & (INDEX_SIZE - 1)) {
+         const index_entry_t* entry = &index->entries[i];
+         if (entry->slot == -1) return -1;
+         if (entry->key == key) return entry->slot;
+     }
+ }
+ 
+ /* Function to store the slot for a key */
+ /* Never fails: the index has more entries than there are slots */
+ static void index_insert(slot_index_t* index, uint64_t key, int slot) {
+     unsigned int i = index_home(key);
+     while (index->entries[i].slot != -1) {
+         i = (i + 1) & (INDEX_SIZE - 1);
+     }
+     index->entries[i].key = key;
+     index->entries[i].slot = slot;
+ }
+ 
+ /* Function to remove the entry of a key and slot */
+ /* Shifts the following entries back so no probe sequence is broken */
+ static void index_remove(slot_index_t* index, uint64_t key, int slot) {
+     unsigned int i = index_home(key);
+     while (index->entries[i].slot != slot || index->entries[i].key != key) {
+         if (index->entries[i].slot == -1) return; /* Not in the index */
+         i = (i + 1) & (INDEX_SIZE - 1);
+     }
+     for (unsigned int j = (i + 1) & (INDEX_SIZE - 1); ; j = (j + 1) & (INDEX_SIZE - 1)) {
+         if (index->entries[j].slot == -1) break;
+         /* The entry at j may move to i unless its home lies cyclically in (i, j] */
+         unsigned int home = index_home(index->entries[j].key);
+         if (((j - home) & (INDEX_SIZE - 1)) >= ((j - i) & (INDEX_SIZE - 1))) {
+             index->entries[i] = index->entries[j];
+             i = j;
+         }
+     }
+     index->entries[i].slot = -1;
+ }
+ 
+ /* Function to build the address key of a peer */
+ /* Packs the binary IPv4 address and the port, so equal addresses always match */
+ static uint64_t address_key(const char* ip, int port) {
+     struct in_addr addr = { 0 };
+     inet_pton(AF_INET, ip, &addr);
+     return ((uint64_t)ntohl(addr.s_addr) << 16) | (uint16_t)port;
+ }
+ 
+ /* Function to find the slot of an active connection ID */
+ /* Caller holds connections_lock; returns -1 if not found */
+ static int find_slot(int id) {
+     return index_find(&id_index, (uint64_t)id);
+ }
+ 
+ /* Function to free a connection slot */
+ /* Caller holds connections_lock for writing; the socket is closed by the caller */
+ static void release_slot(int slot) {
+     connection_t* conn = &connections[slot];
+     index_remove(&id_index, (uint64_t)conn->id, slot);
+     index_remove(&sock_index, (uint64_t)conn->sock, slot);
+     index_remove(&addr_index, address_key(conn->ip, conn->port), slot);
+     out_queue_clear(&conn->out); /* No sender or flush holds the shared lock */
+     conn->sock = -1; /* Mark as inactive */
+     free_slots[free_count++] = slot;
+ }
  
  /* Function to initialize the connection manager */
  /* Marks all connection slots as inactive by setting sock to -1 */
  void init_connections() {
      for (int i = 0; i < MAX_CONNECTIONS; i++) {
          connections[i].sock = -1;
+         out_queue_init(&connections[i].out);
+         pthread_mutex_init(&connections[i].out_mutex, NULL);
+         free_slots[i] = MAX_CONNECTIONS - 1 - i; /* Lowest slot on top */
+     }
+     free_count = MAX_CONNECTIONS;
+     for (int i = 0; i < INDEX_SIZE; i++) {
+         id_index.entries[i].slot = -1;
+         sock_index.entries[i].slot = -1;
+         addr_index.entries[i].slot = -1;
      }
  }
  
  /* Function to add a new connection */
  /* Assigns an ID and stores connection details; returns ID or -1 if full */
- int add_connection(int sock, const char* ip, int port) {
-     pthread_mutex_lock(&connections_mutex); /* Protect shared resource */
-     for (int i = 0; i < MAX_CONNECTIONS; i++) {
-         if (connections[i].sock == -1) { /* Find an empty slot */
-             connections[i].id = next_id++; /* Assign and increment ID */
-             connections[i].sock = sock;
-             strncpy(connections[i].ip, ip, INET_ADDRSTRLEN);
-             connections[i].port = port;
-             pthread_mutex_unlock(&connections_mutex);
-             return connections[i].id;
-         }
+ int add_connection(int sock, const char* ip, int port, bool connecting) {
+     pthread_rwlock_wrlock(&connections_lock); /* Protect shared resource */
+     if (free_count == 0) {
+         pthread_rwlock_unlock(&connections_lock);
+         return -1; /* Return -1 if no slots are available */
      }
-     pthread_mutex_unlock(&connections_mutex);
-     return -1; /* Return -1 if no slots are available */
+     int slot = free_slots[--free_count]; /* Take an empty slot */
+     connection_t* conn = &connections[slot];
+     conn->id = next_id++; /* Assign and increment ID */
+     conn->sock = sock;
+     strncpy(conn->ip, ip, INET_ADDRSTRLEN - 1);
+     conn->ip[INET_ADDRSTRLEN - 1] = '\0';
+     conn->port = port;
+     conn->connecting = connecting;
+     index_insert(&id_index, (uint64_t)conn->id, slot);
+     index_insert(&sock_index, (uint64_t)sock, slot);
+     index_insert(&addr_index, address_key(conn->ip, port), slot);
+     int id = conn->id;
+     pthread_rwlock_unlock(&connections_lock);
+     return id;
  }
  
  /* Function to remove a connection by ID */
  /* Closes the socket and marks it as inactive */
  void remove_connection(int id) {
-     pthread_mutex_lock(&connections_mutex);
+     pthread_rwlock_wrlock(&connections_lock);
+     int slot = find_slot(id);
+     if (slot != -1) {
+         /* Send a close frame to the peer before closing, unless frames are still queued:
+          * a partly written frame cannot be followed by one, so the peer just sees the end */
+         if (connections[slot].out.head == NULL) {
+             send_close_frame(connections[slot].sock);
+         }
+         close(connections[slot].sock); /* Close the socket */
+         release_slot(slot);
+     }
+     pthread_rwlock_unlock(&connections_lock);
+     if (slot != -1) {
+         console_printf("Connection %d terminated\n", id);
+     }
+ }
+ 
+ /* Function to mark an outgoing connection as established */
+ /* Called by the event loop once the non-blocking connect completed */
+ void set_connection_connected(int id) {
+     pthread_rwlock_wrlock(&connections_lock);
+     int slot = find_slot(id);
+     if (slot != -1) {
+         connections[slot].connecting = false;
+     }
+     pthread_rwlock_unlock(&connections_lock);
+ }
+ 
+ /* Function to drop a connection without the close frame */
+ /* Closes the socket and marks the slot as inactive */
+ void remove_pending_connection(int id) {
+     pthread_rwlock_wrlock(&connections_lock);
+     int slot = find_slot(id);
+     if (slot != -1) {
+         close(connections[slot].sock);
+         release_slot(slot);
+     }
+     pthread_rwlock_unlock(&connections_lock);
+ }
+ 
+ /* Function to close a connection by socket */
+ /* Called by the event loop when the peer closed it or it failed */
+ void close_connection_by_socket(int sock) {
+     pthread_rwlock_wrlock(&connections_lock);
+     int slot = index_find(&sock_index, (uint64_t)sock);
+     int id = -1;
+     if (slot != -1) {
+         id = connections[slot].id;
+         close(sock); /* Close the socket */
+         release_slot(slot);
+     }
+     pthread_rwlock_unlock(&connections_lock);
+     if (id != -1) {
+         console_printf("\nConnection %d closed\n> ", id);
+     }
+ }
+ 
+ /* Function to close every connection */
+ /* Used at exit; no close frame is sent */
+ void close_all_connections() {
+     pthread_rwlock_wrlock(&connections_lock);
      for (int i = 0; i < MAX_CONNECTIONS; i++) {
-         if (connections[i].id == id && connections[i].sock != -1) {
-             /* Send a "CLOSE" signal to the peer before closing */
-             send(connections[i].sock, "XXXXX", 5, 0);
-             close(connections[i].sock); /* Close the socket */
-             connections[i].sock = -1;  /* Mark as inactive */
-             dprintf(log_pipe[1], "Connection %d terminated\n", id);
-             break;
+         if (connections[i].sock != -1) {
+             close(connections[i].sock); /* Close all active connections */
+             release_slot(i);
          }
      }
-     pthread_mutex_unlock(&connections_mutex);
+     pthread_rwlock_unlock(&connections_lock);
  }
  
  /* Function to list all active connections */
- /* Prints a formatted table of connection details */
+ /* Copies them under the shared lock and formats the table after releasing it */
  void list_connections() {
-     pthread_mutex_lock(&connections_mutex);
+     listed_t* list = malloc(sizeof(listed_t) * MAX_CONNECTIONS);
+     if (list == NULL) {
+         console_printf("Out of memory\n");
+         return;
+     }
      int count = 0;
-     /* Count active connections */
+     pthread_rwlock_rdlock(&connections_lock);
      for (int i = 0; i < MAX_CONNECTIONS; i++) {
-         if (connections[i].sock != -1) {
+         if (connections[i].sock != -1 && !connections[i].connecting) {
+             list[count].id = connections[i].id;
+             memcpy(list[count].ip, connections[i].ip, INET_ADDRSTRLEN);
+             list[count].port = connections[i].port;
              count++;
          }
      }
+     pthread_rwlock_unlock(&connections_lock);
      if (count == 0) {
-         dprintf(log_pipe[1], "List is empty\n");
-     } else {
-         /* Print header */
-         dprintf(log_pipe[1], "%-5s %-15s %-10s\n", "ID", "IP address", "Port");
-         /* Print each active connection */
-         for (int i = 0; i < MAX_CONNECTIONS; i++) {
-             if (connections[i].sock != -1) {
-                 dprintf(log_pipe[1], "%-5d %-15s %-10d\n", 
-                         connections[i].id, 
-                         connections[i].ip, 
-                         connections[i].port);
-             }
+         console_printf("List is empty\n");
+         free(list);
+         return;
+     }
+     /* Print the table as one console message */
+     size_t size = 64 + (size_t)count * 64;
+     char* table = malloc(size);
+     if (table != NULL) {
+         size_t len = snprintf(table, size, "%-5s %-15s %-10s\n", "ID", "IP address", "Port");
+         for (int i = 0; i < count; i++) {
+             len += snprintf(table + len, size - len, "%-5d %-15s %-10d\n",
+                             list[i].id,
+                             list[i].ip,
+                             list[i].port);
          }
+         console_printf("%s", table);
+         free(table);
      }
-     pthread_mutex_unlock(&connections_mutex);
+     free(list);
  }
  
  /* Function to check for duplicate connections */
  /* Returns true if a connection to the same IP and port exists */
  bool is_duplicate_connection(const char* ip, int port) {
-     pthread_mutex_lock(&connections_mutex);
+     pthread_rwlock_rdlock(&connections_lock);
+     bool found = index_find(&addr_index, address_key(ip, port)) != -1;
+     pthread_rwlock_unlock(&connections_lock);
+     return found;
+ }
+ 
+ /* Function to queue a frame to the connection in a slot */
+ /* Caller holds connections_lock; asks the event loop to write when the queue was empty */
+ static int enqueue(int slot, frame_buf_t* frame, int file_fd, off_t file_size) {
+     connection_t* conn = &connections[slot];
+     if (conn->connecting) {
+         return QUEUE_NOT_FOUND;
+     }
+     int result = QUEUE_OK;
+     pthread_mutex_lock(&conn->out_mutex);
+     bool was_empty = conn->out.head == NULL;
+     if (conn->out.bytes + frame->len > MAX_QUEUED_BYTES ||
+         !out_queue_push(&conn->out, frame, file_fd, file_size)) {
+         result = QUEUE_FULL;
+     } else if (was_empty) {
+         set_peer_output(conn->sock, true);
+     }
+     pthread_mutex_unlock(&conn->out_mutex);
+     return result;
+ }
+ 
+ /* Function to queue a frame to several connections */
+ /* The frame is shared: each queue takes a reference, none copies it */
+ int queue_frame(const int* ids, int count, frame_buf_t* frame, int* status) {
+     int queued = 0;
+     pthread_rwlock_rdlock(&connections_lock);
+     for (int i = 0; i < count; i++) {
+         int slot = find_slot(ids[i]);
+         status[i] = slot == -1 ? QUEUE_NOT_FOUND : enqueue(slot, frame, -1, 0);
+         if (status[i] == QUEUE_OK) queued++;
+     }
+     pthread_rwlock_unlock(&connections_lock);
+     return queued;
+ }
+ 
+ /* Function to queue a frame to every connection */
+ /* Connections whose queue is full are skipped */
+ int broadcast_frame(frame_buf_t* frame) {
+     int queued = 0;
+     pthread_rwlock_rdlock(&connections_lock);
      for (int i = 0; i < MAX_CONNECTIONS; i++) {
-         if (connections[i].sock != -1 && 
-             strcmp(connections[i].ip, ip) == 0 && 
-             connections[i].port == port) {
-             pthread_mutex_unlock(&connections_mutex);
-             return true;
+         if (connections[i].sock != -1 && enqueue(i, frame, -1, 0) == QUEUE_OK) {
+             queued++;
          }
      }
-     pthread_mutex_unlock(&connections_mutex);
-     return false;
+     pthread_rwlock_unlock(&connections_lock);
+     return queued;
  }
  
- /* Function to get the socket for a connection ID */
- /* Returns the socket descriptor or -1 if not found */
- int get_connection_socket(int id) {
-     pthread_mutex_lock(&connections_mutex);
-     for (int i = 0; i < MAX_CONNECTIONS; i++) {
-         if (connections[i].id == id && connections[i].sock != -1) {
-             int sock = connections[i].sock;
-             pthread_mutex_unlock(&connections_mutex);
-             return sock;
+ /* Function to queue a file frame to a connection */
+ /* The contents are read from the file by sendfile() as the socket drains */
+ int queue_file(int id, frame_buf_t* header, int fd, off_t size) {
+     pthread_rwlock_rdlock(&connections_lock);
+     int slot = find_slot(id);
+     int result = slot == -1 ? QUEUE_NOT_FOUND : enqueue(slot, header, fd, size);
+     pthread_rwlock_unlock(&connections_lock);
+     return result;
+ }
+ 
+ /* Function to write the queued frames of a connection */
+ /* Stops asking for writability once the queue is empty, while still holding out_mutex
+  * so a sender queueing meanwhile cannot have its request undone */
+ int flush_connection(int sock) {
+     int result = 0;
+     pthread_rwlock_rdlock(&connections_lock);
+     int slot = index_find(&sock_index, (uint64_t)sock);
+     if (slot != -1) {
+         connection_t* conn = &connections[slot];
+         pthread_mutex_lock(&conn->out_mutex);
+         result = out_queue_flush(&conn->out, sock);
+         if (result == 0) {
+             set_peer_output(sock, false);
          }
+         pthread_mutex_unlock(&conn->out_mutex);
      }
-     pthread_mutex_unlock(&connections_mutex);
-     return -1;
- }
\ No newline at end of file
+     pthread_rwlock_unlock(&connections_lock);
+     return result;
+ }
+ 
+ /* Function to find the connection using a socket */
+ /* Copies its details and returns its ID, or -1 if the socket is not a connection */
+ int find_connection_by_socket(int sock, int* slot_out, char* ip, int* port, bool* connecting) {
+     pthread_rwlock_rdlock(&connections_lock);
+     int slot = index_find(&sock_index, (uint64_t)sock);
+     int id = -1;
+     if (slot != -1) {
+         id = connections[slot].id;
+         strcpy(ip, connections[slot].ip);
+         *port = connections[slot].port;
+         *connecting = connections[slot].connecting;
+         *slot_out = slot;
+     }
+     pthread_rwlock_unlock(&connections_lock);
+     return id;
+ }
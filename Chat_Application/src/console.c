@@ -0,0 +1,176 @@
+/*
+ * File: console.c
+ * Author: Chau Bui
+ * Description: This file implements the console writer: a lock-free multi-producer,
+ *              single-consumer queue of formatted messages and the thread that
+ *              writes them to stdout.
+ */
+
+ #include "console.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <stdarg.h>
+ #include <stdint.h>
+ #include <string.h>
+ #include <errno.h>        /* For errno */
+ #include <stdatomic.h>    /* For the lock-free queue */
+ #include <unistd.h>       /* For read(), write() and close() */
+ #include <pthread.h>      /* For the writer thread */
+ #include <sys/uio.h>      /* For writev() */
+ #include <sys/eventfd.h>  /* For waking the writer thread */
+
+ /* Formatted message waiting to be written */
+ typedef struct console_msg {
+     struct console_msg* next;
+     size_t len;
+     char text[];
+ } console_msg_t;
+
+ /* Queue of messages: producers push onto this stack with a compare-and-swap, and the
+  * writer takes the whole stack at once and reverses it back into printing order */
+ static _Atomic(console_msg_t*) pending = NULL;
+ static int wake_fd = -1;            /* Readable when messages were queued to an empty queue */
+ static atomic_bool stopping = false;
+ static pthread_t writer_thread_id;
+
+ /* Function to write a batch of messages to stdout */
+ /* Frees them; continues after partial writes */
+ static void write_batch(console_msg_t** batch, int count) {
+     struct iovec iov[CONSOLE_BATCH_MAX];
+     for (int i = 0; i < count; i++) {
+         iov[i].iov_base = batch[i]->text;
+         iov[i].iov_len = batch[i]->len;
+     }
+     struct iovec* next = iov;
+     int left = count;
+     while (left > 0) {
+         ssize_t written = writev(STDOUT_FILENO, next, left);
+         if (written < 0 && errno == EINTR) continue;
+         if (written < 0) break; /* Nowhere to report it */
+         while (left > 0 && (size_t)written >= next->iov_len) {
+             written -= next->iov_len;
+             next++;
+             left--;
+         }
+         if (left > 0) {
+             next->iov_base = (char*)next->iov_base + written;
+             next->iov_len -= written;
+         }
+     }
+     for (int i = 0; i < count; i++) {
+         free(batch[i]);
+     }
+ }
+
+ /* Function to write every queued message */
+ /* Returns false if the queue was empty */
+ static bool drain(void) {
+     console_msg_t* stack = atomic_exchange_explicit(&pending, NULL, memory_order_acquire);
+     if (stack == NULL) {
+         return false;
+     }
+     /* The stack holds the newest message first: reverse it */
+     console_msg_t* ordered = NULL;
+     while (stack) {
+         console_msg_t* next = stack->next;
+         stack->next = ordered;
+         ordered = stack;
+         stack = next;
+     }
+     console_msg_t* batch[CONSOLE_BATCH_MAX];
+     int count = 0;
+     while (ordered) {
+         batch[count++] = ordered;
+         ordered = ordered->next;
+         if (count == CONSOLE_BATCH_MAX) {
+             write_batch(batch, count);
+             count = 0;
+         }
+     }
+     write_batch(batch, count);
+     return true;
+ }
+
+ /* Thread function of the console writer */
+ /* Sleeps on wake_fd while the queue is empty */
+ static void* writer_thread(void* arg) {
+     (void)arg;
+     while (true) {
+         if (drain()) {
+             continue; /* More may have been queued while writing */
+         }
+         if (atomic_load(&stopping)) {
+             break;
+         }
+         uint64_t count;
+         ssize_t n = read(wake_fd, &count, sizeof(count));
+         (void)n; /* EINTR or a wake-up: look at the queue again either way */
+     }
+     return NULL;
+ }
+
+ /* Function to start the console writer thread */
+ bool console_init(void) {
+     wake_fd = eventfd(0, EFD_CLOEXEC);
+     if (wake_fd < 0) {
+         return false;
+     }
+     if (pthread_create(&writer_thread_id, NULL, writer_thread, NULL) != 0) {
+         close(wake_fd);
+         wake_fd = -1;
+         return false;
+     }
+     return true;
+ }
+
+ /* Function to wake the writer thread */
+ static void wake_writer(void) {
+     uint64_t one = 1;
+     ssize_t n = write(wake_fd, &one, sizeof(one)); /* Cannot fail short of a closed fd */
+     (void)n;
+ }
+
+ /* Function to print to the console */
+ /* Only the transition from an empty queue wakes the writer, one write() per burst */
+ void console_printf(const char* format, ...) {
+     char small[512];
+     va_list args, copy;
+     va_start(args, format);
+     va_copy(copy, args);
+     int len = vsnprintf(small, sizeof(small), format, args);
+     va_end(args);
+     console_msg_t* msg = len < 0 ? NULL : malloc(sizeof(console_msg_t) + len + 1);
+     if (msg != NULL) {
+         if ((size_t)len < sizeof(small)) {
+             memcpy(msg->text, small, len + 1);
+         } else {
+             vsnprintf(msg->text, len + 1, format, copy); /* Longer than small */
+         }
+         msg->len = len;
+     }
+     va_end(copy);
+     if (msg == NULL) {
+         return;
+     }
+     console_msg_t* head = atomic_load_explicit(&pending, memory_order_relaxed);
+     do {
+         msg->next = head;
+     } while (!atomic_compare_exchange_weak_explicit(&pending, &head, msg,
+                                                     memory_order_release, memory_order_relaxed));
+     if (head == NULL && wake_fd != -1) {
+         wake_writer();
+     }
+ }
+
+ /* Function to stop the console writer thread */
+ void console_shutdown(void) {
+     if (wake_fd == -1) {
+         return;
+     }
+     atomic_store(&stopping, true);
+     wake_writer();
+     pthread_join(writer_thread_id, NULL);
+     close(wake_fd);
+     wake_fd = -1;
+     drain(); /* Anything printed by a thread that raced with the shutdown */
+ }
@@ -0,0 +1,335 @@
+/*
+ * File: protocol.c
+ * Author: Chau Bui
+ * Description: This file implements the framing of the wire protocol: building
+ *              shared frames, flushing output queues, and reassembling incoming frames.
+ */
+
+ #include "protocol.h"
+ #include <stdlib.h>
+ #include <string.h>
+ #include <errno.h>        /* For errno */
+ #include <unistd.h>       /* For close() */
+ #include <sys/socket.h>   /* For send() */
+ #include <sys/uio.h>      /* For writev() */
+ #include <sys/sendfile.h> /* For sendfile() */
+ #include <arpa/inet.h>    /* For htonl() and ntohl() */
+ 
+ /* Parts of a frame a reader can be in the middle of */
+ #define READ_HEADER    0  /* Frame header */
+ #define READ_TEXT      1  /* Text payload */
+ #define READ_NAME_LEN  2  /* Name length of a file frame */
+ #define READ_NAME      3  /* File name */
+ #define READ_FILE_DATA 4  /* File contents */
+ 
+ /* Function to fill in a frame header */
+ static void make_header(unsigned char* header, uint8_t type, uint32_t len) {
+     uint32_t len_be = htonl(len);
+     header[0] = type;
+     memcpy(header + 1, &len_be, sizeof(len_be));
+ }
+ 
+ /* Function to allocate a frame holding one reference */
+ static frame_buf_t* alloc_frame(size_t len) {
+     frame_buf_t* frame = malloc(sizeof(frame_buf_t) + len);
+     if (frame != NULL) {
+         atomic_init(&frame->refs, 1);
+         frame->len = len;
+     }
+     return frame;
+ }
+ 
+ /* Function to serialize a text frame */
+ /* Header and text are laid out once, however many connections it is queued to */
+ frame_buf_t* make_text_frame(const char* text, size_t len) {
+     if (len > MAX_MESSAGE_SIZE) {
+         return NULL;
+     }
+     frame_buf_t* frame = alloc_frame(FRAME_HEADER_SIZE + len);
+     if (frame != NULL) {
+         make_header(frame->data, FRAME_TEXT, (uint32_t)len);
+         memcpy(frame->data + FRAME_HEADER_SIZE, text, len);
+     }
+     return frame;
+ }
+ 
+ /* Function to serialize the header and name of a file frame */
+ frame_buf_t* make_file_header(const char* name, uint32_t size) {
+     size_t name_len = strlen(name);
+     if (name_len == 0 || name_len > MAX_FILE_NAME || size > MAX_FILE_SIZE) {
+         return NULL;
+     }
+     frame_buf_t* frame = alloc_frame(FRAME_HEADER_SIZE + 2 + name_len);
+     if (frame != NULL) {
+         make_header(frame->data, FRAME_FILE, (uint32_t)(2 + name_len + size));
+         frame->data[FRAME_HEADER_SIZE] = (unsigned char)(name_len >> 8);
+         frame->data[FRAME_HEADER_SIZE + 1] = (unsigned char)name_len;
+         memcpy(frame->data + FRAME_HEADER_SIZE + 2, name, name_len);
+     }
+     return frame;
+ }
+ 
+ /* Function to take another reference to a frame */
+ void frame_buf_ref(frame_buf_t* frame) {
+     atomic_fetch_add_explicit(&frame->refs, 1, memory_order_relaxed);
+ }
+ 
+ /* Function to drop a reference to a frame */
+ void frame_buf_unref(frame_buf_t* frame) {
+     if (atomic_fetch_sub_explicit(&frame->refs, 1, memory_order_acq_rel) == 1) {
+         free(frame);
+     }
+ }
+ 
+ /* Function to initialize an empty output queue */
+ void out_queue_init(out_queue_t* queue) {
+     queue->head = NULL;
+     queue->tail = NULL;
+     queue->bytes = 0;
+ }
+ 
+ /* Function to append an entry to an output queue */
+ static void append_item(out_queue_t* queue, out_item_t* item) {
+     item->next = NULL;
+     if (queue->tail) {
+         queue->tail->next = item;
+     } else {
+         queue->head = item;
+     }
+     queue->tail = item;
+ }
+ 
+ /* Function to free the entry at the head of an output queue */
+ /* Drops its frame reference or closes its file */
+ static void pop_item(out_queue_t* queue) {
+     out_item_t* item = queue->head;
+     queue->head = item->next;
+     if (queue->head == NULL) {
+         queue->tail = NULL;
+     }
+     if (item->frame) {
+         queue->bytes -= item->frame->len;
+         frame_buf_unref(item->frame);
+     }
+     if (item->file_fd != -1) {
+         close(item->file_fd);
+     }
+     free(item);
+ }
+ 
+ /* Function to append a frame to an output queue */
+ /* A file's contents get their own entry, sent with sendfile() once the frame is out */
+ bool out_queue_push(out_queue_t* queue, frame_buf_t* frame, int file_fd, off_t file_size) {
+     out_item_t* item = calloc(1, sizeof(*item));
+     out_item_t* contents = NULL;
+     if (item == NULL || (file_fd != -1 && (contents = calloc(1, sizeof(*contents))) == NULL)) {
+         free(item);
+         return false;
+     }
+     frame_buf_ref(frame);
+     item->frame = frame;
+     item->file_fd = -1;
+     append_item(queue, item);
+     queue->bytes += frame->len;
+     if (contents) {
+         contents->file_fd = file_fd;
+         contents->file_end = file_size;
+         append_item(queue, contents);
+     }
+     return true;
+ }
+ 
+ /* Function to write as much of an output queue as the socket takes without blocking */
+ /* Consecutive frames leave in one writev() call; file contents with sendfile() */
+ int out_queue_flush(out_queue_t* queue, int sock) {
+     while (queue->head) {
+         out_item_t* item = queue->head;
+         if (item->frame == NULL) {
+             /* File contents: the kernel copies them straight from the file */
+             if (item->file_offset < item->file_end) {
+                 ssize_t sent = sendfile(sock, item->file_fd, &item->file_offset,
+                                         item->file_end - item->file_offset);
+                 if (sent < 0 && errno == EINTR) continue;
+                 if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 1;
+                 if (sent <= 0) return -1; /* Broken connection, or the file shrank */
+                 if (item->file_offset < item->file_end) continue;
+             }
+             pop_item(queue);
+             continue;
+         }
+         /* Gather the frames up to the next file contents entry */
+         struct iovec iov[FLUSH_IOV_MAX];
+         int count = 0;
+         for (out_item_t* it = item; it && it->frame && count < FLUSH_IOV_MAX; it = it->next) {
+             iov[count].iov_base = it->frame->data + it->offset;
+             iov[count].iov_len = it->frame->len - it->offset;
+             count++;
+         }
+         ssize_t written = writev(sock, iov, count);
+         if (written < 0 && errno == EINTR) continue;
+         if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 1;
+         if (written < 0) return -1;
+         /* Free the frames written completely, then note how much of the next one went */
+         size_t left = (size_t)written;
+         while (left > 0 && left >= queue->head->frame->len - queue->head->offset) {
+             left -= queue->head->frame->len - queue->head->offset;
+             pop_item(queue);
+         }
+         if (left > 0) {
+             queue->head->offset += left;
+             return 1; /* A short write means the socket buffer is full */
+         }
+     }
+     return 0;
+ }
+ 
+ /* Function to drop everything left in an output queue */
+ void out_queue_clear(out_queue_t* queue) {
+     while (queue->head) {
+         pop_item(queue);
+     }
+ }
+ 
+ /* Function to send a close frame */
+ bool send_close_frame(int sock) {
+     unsigned char header[FRAME_HEADER_SIZE];
+     make_header(header, FRAME_CLOSE, 0);
+     return send(sock, header, sizeof(header), MSG_NOSIGNAL | MSG_DONTWAIT) == sizeof(header);
+ }
+ 
+ /* Function to initialize a frame reader */
+ void frame_reader_init(frame_reader_t* reader) {
+     memset(reader, 0, sizeof(*reader));
+     reader->state = READ_HEADER;
+ }
+ 
+ /* Function to reset a frame reader for a new connection */
+ void frame_reader_reset(frame_reader_t* reader) {
+     free(reader->text);
+     frame_reader_init(reader);
+ }
+ 
+ /* Function to collect the bytes of a fixed-size field */
+ /* Returns true once reader->header holds want bytes */
+ static bool collect(frame_reader_t* reader, size_t want, const char** data, size_t* len) {
+     size_t take = want - reader->header_len;
+     if (take > *len) take = *len;
+     memcpy(reader->header + reader->header_len, *data, take);
+     reader->header_len += take;
+     *data += take;
+     *len -= take;
+     return reader->header_len == want;
+ }
+ 
+ /* Function to start reading the frame whose header was collected */
+ /* Returns the event of a frame that is already complete, NONE or ERROR */
+ static frame_event_t start_frame(frame_reader_t* reader) {
+     uint32_t len_be;
+     memcpy(&len_be, reader->header + 1, sizeof(len_be));
+     reader->type = reader->header[0];
+     reader->remaining = ntohl(len_be);
+     reader->header_len = 0;
+     switch (reader->type) {
+     case FRAME_TEXT:
+         if (reader->remaining > MAX_MESSAGE_SIZE) return FRAME_EVENT_ERROR;
+         if (reader->remaining > reader->text_capacity) {
+             char* text = realloc(reader->text, reader->remaining);
+             if (text == NULL) return FRAME_EVENT_ERROR;
+             reader->text = text;
+             reader->text_capacity = reader->remaining;
+         }
+         reader->text_len = 0;
+         if (reader->remaining == 0) return FRAME_EVENT_TEXT;
+         reader->state = READ_TEXT;
+         return FRAME_EVENT_NONE;
+     case FRAME_CLOSE:
+         return reader->remaining == 0 ? FRAME_EVENT_CLOSE : FRAME_EVENT_ERROR;
+     case FRAME_FILE:
+         if (reader->remaining < 2) return FRAME_EVENT_ERROR;
+         reader->remaining -= 2;
+         reader->state = READ_NAME_LEN;
+         return FRAME_EVENT_NONE;
+     default:
+         return FRAME_EVENT_ERROR;
+     }
+ }
+ 
+ /* Function to feed received bytes to a frame reader */
+ /* Runs the state machine over the bytes until an event or the end of the data */
+ frame_event_t frame_reader_next(frame_reader_t* reader, const char** data, size_t* len,
+                                 const char** out, size_t* out_len) {
+     while (true) {
+         switch (reader->state) {
+         case READ_HEADER: {
+             if (*len == 0) return FRAME_EVENT_NONE;
+             if (!collect(reader, FRAME_HEADER_SIZE, data, len)) return FRAME_EVENT_NONE;
+             frame_event_t event = start_frame(reader);
+             if (event == FRAME_EVENT_TEXT) {
+                 *out = "";
+                 *out_len = 0;
+             }
+             if (event != FRAME_EVENT_NONE) return event;
+             break;
+         }
+         case READ_TEXT: {
+             if (*len == 0) return FRAME_EVENT_NONE;
+             size_t take = reader->remaining < *len ? reader->remaining : *len;
+             memcpy(reader->text + reader->text_len, *data, take);
+             reader->text_len += take;
+             reader->remaining -= take;
+             *data += take;
+             *len -= take;
+             if (reader->remaining > 0) return FRAME_EVENT_NONE;
+             reader->state = READ_HEADER;
+             *out = reader->text;
+             *out_len = reader->text_len;
+             return FRAME_EVENT_TEXT;
+         }
+         case READ_NAME_LEN:
+             if (*len == 0) return FRAME_EVENT_NONE;
+             if (!collect(reader, 2, data, len)) return FRAME_EVENT_NONE;
+             reader->name_expected = ((size_t)reader->header[0] << 8) | reader->header[1];
+             reader->header_len = 0;
+             if (reader->name_expected == 0 || reader->name_expected > MAX_FILE_NAME ||
+                 reader->name_expected > reader->remaining) {
+                 return FRAME_EVENT_ERROR;
+             }
+             reader->remaining -= reader->name_expected;
+             reader->name_len = 0;
+             reader->state = READ_NAME;
+             break;
+         case READ_NAME: {
+             if (*len == 0) return FRAME_EVENT_NONE;
+             size_t take = reader->name_expected - reader->name_len;
+             if (take > *len) take = *len;
+             memcpy(reader->name + reader->name_len, *data, take);
+             reader->name_len += take;
+             *data += take;
+             *len -= take;
+             if (reader->name_len < reader->name_expected) return FRAME_EVENT_NONE;
+             reader->name[reader->name_len] = '\0';
+             if (strlen(reader->name) != reader->name_len) return FRAME_EVENT_ERROR; /* Embedded NUL */
+             reader->state = READ_FILE_DATA;
+             *out = reader->name;
+             *out_len = reader->remaining;
+             return FRAME_EVENT_FILE_START;
+         }
+         case READ_FILE_DATA: {
+             if (reader->remaining == 0) {
+                 reader->state = READ_HEADER;
+                 return FRAME_EVENT_FILE_END;
+             }
+             if (*len == 0) return FRAME_EVENT_NONE;
+             size_t take = reader->remaining < *len ? reader->remaining : *len;
+             *out = *data;
+             *out_len = take;
+             reader->remaining -= take;
+             *data += take;
+             *len -= take;
+             return FRAME_EVENT_FILE_DATA;
+         }
+         default:
+             return FRAME_EVENT_ERROR;
+         }
+     }
+ }
@@ -1,114 +1,297 @@
 /*
  * File: server.c
  * Author: Chau Bui
- * Description: This file contains the server-side logic for accepting incoming
- *              connections and handling client communication in separate threads.
+ * Description: This file contains the server-side logic: a single-threaded epoll
+ *              event loop that accepts incoming connections, completes outgoing
+ *              connects and receives messages from every peer.
  */
 
+ #define _GNU_SOURCE      /* For accept4() */
  #include "server.h"
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
+ #include <errno.h>        /* For errno */
  #include <unistd.h>       /* For close() */
  #include <sys/socket.h>   /* For socket operations */
+ #include <sys/epoll.h>    /* For the event loop */
+ #include <sys/eventfd.h>  /* For waking the event loop at exit */
  #include <netinet/in.h>   /* For sockaddr_in */
  #include <arpa/inet.h>    /* For inet_ntop */
  #include <pthread.h>      /* For threading */
  #include <signal.h>       /* For signal handling */
+ #include <fcntl.h>        /* For open() */
  #include "connection_manager.h"
+ #include "console.h"
+ #include "protocol.h"
  #include "utils.h"
  
+ /* Maximum number of events handled per epoll_wait() call */
+ #define MAX_EVENTS 64
+ /* Bytes read from a peer per recv() call */
+ #define RECV_BUFFER_SIZE 65536
+ 
+ /* Receive state of a connection, indexed like connections[] */
+ typedef struct {
+     int id;               /* Connection the state belongs to, 0 if none */
+     frame_reader_t reader; /* Reassembly of its incoming frames */
+     int file_fd;          /* File an incoming file frame is saved to, -1 if none */
+ } peer_t;
+ 
  /* External declarations of global variables */
- extern int log_pipe[2];
- extern connection_t connections[MAX_CONNECTIONS];
- extern pthread_mutex_t connections_mutex;
  extern volatile sig_atomic_t running;
  extern int listen_sock;
  
- /* Function to handle communication with a connected client */
- /* Runs in a separate thread for each client connection */
- void* handle_client(void* arg) {
-     int sock = *(int*)arg; /* Extract socket from argument */
-     free(arg);             /* Free allocated memory for argument */
-     char buffer[1024];
+ /* Event loop state, set up by init_server() */
+ static int epoll_fd = -1;  /* Watches the listening socket, the wake-up eventfd and every peer */
+ static int wake_fd = -1;   /* Readable once stop_server() was called */
+ static peer_t peers[MAX_CONNECTIONS]; /* Only used by the event loop thread */
+ 
+ /* Function to accept every pending incoming connection */
+ /* New sockets are non-blocking and watched for messages */
+ static void accept_connections(void) {
      while (true) {
-         /* Receive data from the client */
-         int bytes_received = recv(sock, buffer, sizeof(buffer) - 1, 0);
-         if (bytes_received <= 0) { /* Connection closed or error */
-             break;
+         struct sockaddr_in client_addr;
+         socklen_t client_len = sizeof(client_addr);
+         /* Accept incoming connection */
+         int client_sock = accept4(listen_sock, (struct sockaddr*)&client_addr, &client_len,
+                                   SOCK_NONBLOCK | SOCK_CLOEXEC);
+         if (client_sock < 0) {
+             if (errno == EINTR || errno == ECONNABORTED) continue;
+             break; /* EAGAIN: none left; other errors (e.g. EMFILE) are retried on the next event */
+         }
+         /* Extract client IP and port */
+         char ip[INET_ADDRSTRLEN];
+         inet_ntop(AF_INET, &client_addr.sin_addr, ip, INET_ADDRSTRLEN);
+         int port = ntohs(client_addr.sin_port);
+         /* Add new connection */
+         int id = add_connection(client_sock, ip, port, false);
+         if (id == -1) {
+             console_printf("Maximum connections reached\n");
+             close(client_sock);
+             continue;
          }
+         if (!watch_peer(client_sock, false)) {
+             console_printf("Failed to watch connection %d\n", id);
+             close_connection_by_socket(client_sock);
+             continue;
+         }
+         console_printf("\nNew connection from %s:%d assigned ID %d\n> ", ip, port, id);
+     }
+ }
  
-         buffer[bytes_received] = '\0'; /* Null-terminate the received data */
+ /* Function to complete a non-blocking connect once the socket is writable */
+ /* On success the socket is watched for messages from then on */
+ static void finish_connect(int sock, int id, const char* ip, int port) {
+     int error = 0;
+     socklen_t len = sizeof(error);
+     if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
+         error = errno;
+     }
+     if (error != 0) {
+         console_printf("\nConnection to %s:%d failed: %s\n> ", ip, port, strerror(error));
+         remove_pending_connection(id);
+         return;
+     }
+     struct epoll_event event = { .events = EPOLLIN | EPOLLRDHUP, .data.fd = sock };
+     epoll_ctl(epoll_fd, EPOLL_CTL_MOD, sock, &event);
+     set_connection_connected(id);
+     console_printf("\nConnected to %s:%d as connection ID %d\n> ", ip, port, id);
+ }
  
-         /* Check for close signal from peer */
-         if (strcmp(buffer, "XXXXX") == 0) {
-             break; /* Peer signaled connection closure */
+ /* Function to reset the receive state of a slot for the connection using it now */
+ /* Closes a file left incomplete by the slot's previous connection */
+ static peer_t* claim_peer(int slot, int id) {
+     peer_t* peer = &peers[slot];
+     if (peer->id != id) {
+         if (peer->file_fd != -1) {
+             close(peer->file_fd);
+             console_printf("\nFile %s from connection %d is incomplete\n> ", peer->reader.name, peer->id);
          }
-         
-         /* Retrieve connection details */
-         int id = -1;
-         char ip[INET_ADDRSTRLEN];
-         int port;
-         pthread_mutex_lock(&connections_mutex);
-         for (int i = 0; i < MAX_CONNECTIONS; i++) {
-             if (connections[i].sock == sock) {
-                 id = connections[i].id;
-                 strcpy(ip, connections[i].ip);
-                 port = connections[i].port;
-                 break;
+         frame_reader_reset(&peer->reader);
+         peer->id = id;
+         peer->file_fd = -1;
+     }
+     return peer;
+ }
+ 
+ /* Function to create the file a file frame is saved to */
+ /* Uses the last path component of the name in the current directory and never
+  * overwrites an existing file; returns -1 if it cannot be created */
+ static int create_received_file(const char* name) {
+     const char* base = strrchr(name, '/');
+     base = base ? base + 1 : name;
+     if (*base == '\0' || strcmp(base, ".") == 0 || strcmp(base, "..") == 0) {
+         errno = EINVAL;
+         return -1;
+     }
+     return open(base, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+ }
+ 
+ /* Function to act on what the frame reader found in the received bytes */
+ /* Returns false if the connection must be closed */
+ static bool handle_frames(peer_t* peer, const char* ip, int port, const char* data, size_t len) {
+     while (true) {
+         const char* out;
+         size_t out_len;
+         switch (frame_reader_next(&peer->reader, &data, &len, &out, &out_len)) {
+         case FRAME_EVENT_NONE:
+             return true;
+         case FRAME_EVENT_TEXT:
+             /* Print received message with sender details */
+             console_printf("\nMessage received from %s\nSender's Port: %d\nMessage: %.*s\n> ",
+                     ip, port, (int)out_len, out);
+             break;
+         case FRAME_EVENT_CLOSE:
+             return false; /* Peer signaled connection closure */
+         case FRAME_EVENT_FILE_START:
+             peer->file_fd = create_received_file(out);
+             if (peer->file_fd == -1) {
+                 console_printf("\nCannot save file %s from %s:%d: %s\n> ", out, ip, port, strerror(errno));
+             } else {
+                 console_printf("\nReceiving file %s (%zu bytes) from %s:%d\n> ", out, out_len, ip, port);
+             }
+             break;
+         case FRAME_EVENT_FILE_DATA:
+             /* A file that cannot be written is still read to its end, but discarded */
+             while (peer->file_fd != -1 && out_len > 0) {
+                 ssize_t written = write(peer->file_fd, out, out_len);
+                 if (written < 0 && errno == EINTR) continue;
+                 if (written < 0) {
+                     console_printf("\nFailed to write file %s: %s\n> ", peer->reader.name, strerror(errno));
+                     close(peer->file_fd);
+                     peer->file_fd = -1;
+                     break;
+                 }
+                 out += written;
+                 out_len -= written;
              }
+             break;
+         case FRAME_EVENT_FILE_END:
+             if (peer->file_fd != -1) {
+                 close(peer->file_fd);
+                 peer->file_fd = -1;
+                 console_printf("\nFile %s received from %s:%d\n> ", peer->reader.name, ip, port);
+             }
+             break;
+         case FRAME_EVENT_ERROR:
+             console_printf("\nMalformed frame from %s:%d\n> ", ip, port);
+             return false;
          }
-         pthread_mutex_unlock(&connections_mutex);
-         if (id != -1) {
-             /* Print received message with sender details */
-             dprintf(log_pipe[1], "\nMessage received from %s\nSender's Port: %d\nMessage: %s\n> ", 
-                     ip, port, buffer);
+     }
+ }
+ 
+ /* Function to receive everything a peer sent */
+ /* Reads until the socket would block; closes the connection on EOF, error, close frame
+  * or malformed frame */
+ static void receive_messages(int sock, peer_t* peer, const char* ip, int port) {
+     static char buffer[RECV_BUFFER_SIZE]; /* Only the event loop thread receives */
+     while (true) {
+         /* Receive data from the client */
+         ssize_t bytes_received = recv(sock, buffer, sizeof(buffer), 0);
+         if (bytes_received < 0 && errno == EINTR) continue;
+         if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+         if (bytes_received <= 0) { /* Connection closed or error */
+             break;
+         }
+         /* Frames may span several reads and one read may hold several frames */
+         if (!handle_frames(peer, ip, port, buffer, (size_t)bytes_received)) {
+             break;
          }
      }
      /* Clean up connection when disconnected */
-     pthread_mutex_lock(&connections_mutex);
+     claim_peer(peer - peers, 0); /* Close a file left incomplete */
+     close_connection_by_socket(sock);
+ }
+ 
+ /* Function to set up the event loop */
+ /* Creates the epoll instance and watches the listening socket; returns false on failure */
+ bool init_server(void) {
      for (int i = 0; i < MAX_CONNECTIONS; i++) {
-         if (connections[i].sock == sock) {
-             close(sock); /* Close the socket */
-             connections[i].sock = -1; /* Mark as inactive */
-             dprintf(log_pipe[1], "\nConnection %d closed\n> ", connections[i].id);
-             break;
-         }
+         frame_reader_init(&peers[i].reader);
+         peers[i].file_fd = -1;
      }
-     pthread_mutex_unlock(&connections_mutex);
-     return NULL;
+     epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+     wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+     if (epoll_fd < 0 || wake_fd < 0) {
+         return false;
+     }
+     struct epoll_event listen_event = { .events = EPOLLIN, .data.fd = listen_sock };
+     struct epoll_event wake_event = { .events = EPOLLIN, .data.fd = wake_fd };
+     return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_sock, &listen_event) == 0 &&
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &wake_event) == 0;
+ }
+ 
+ /* Function to add a peer socket to the event loop */
+ /* A connecting socket is watched for writability until its connect completes */
+ bool watch_peer(int sock, bool connecting) {
+     struct epoll_event event = { .events = connecting ? EPOLLOUT : EPOLLIN | EPOLLRDHUP, .data.fd = sock };
+     return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &event) == 0;
+ }
+ 
+ /* Function to ask the event loop to write a peer's output queue, or stop asking */
+ /* Level-triggered: the loop keeps getting EPOLLOUT until the queue is empty */
+ void set_peer_output(int sock, bool on) {
+     struct epoll_event event = { .events = EPOLLIN | EPOLLRDHUP | (on ? EPOLLOUT : 0), .data.fd = sock };
+     epoll_ctl(epoll_fd, EPOLL_CTL_MOD, sock, &event);
+ }
+ 
+ /* Function to stop the event loop */
+ /* Wakes server_thread, which returns once it sees running cleared */
+ void stop_server(void) {
+     uint64_t one = 1;
+     ssize_t written = write(wake_fd, &one, sizeof(one)); /* Cannot fail short of a closed fd */
+     (void)written;
  }
  
  /* Function to run the server thread */
- /* Listens for incoming connections and spawns client handlers */
+ /* Dispatches the events of the listening socket and of every peer, one thread for all */
  void* server_thread(void* arg) {
+     (void)arg;
+     struct epoll_event events[MAX_EVENTS];
      while (running) {
-         struct sockaddr_in client_addr;
-         socklen_t client_len = sizeof(client_addr);
-         /* Accept incoming connection */
-         int client_sock = accept(listen_sock, (struct sockaddr*)&client_addr, &client_len);
-         if (client_sock < 0) {
-             if (!running) break; /* Exit if program is shutting down */
-             continue;            /* Skip on error */
+         int count = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+         if (count < 0) {
+             if (errno == EINTR) continue;
+             console_printf("Event loop failed: %s\n", strerror(errno));
+             break;
          }
-         /* Extract client IP and port */
-         char ip[INET_ADDRSTRLEN];
-         inet_ntop(AF_INET, &client_addr.sin_addr, ip, INET_ADDRSTRLEN);
-         int port = ntohs(client_addr.sin_port);
-         /* Add new connection */
-         int id = add_connection(client_sock, ip, port);
-         if (id == -1) {
-             dprintf(log_pipe[1], "Maximum connections reached\n");
-             close(client_sock);
-             continue;
+         for (int i = 0; i < count && running; i++) {
+             int fd = events[i].data.fd;
+             if (fd == wake_fd) {
+                 continue; /* running was cleared */
+             }
+             if (fd == listen_sock) {
+                 accept_connections();
+                 continue;
+             }
+             /* A peer: skip it if it was closed by an earlier event or by terminate */
+             char ip[INET_ADDRSTRLEN];
+             int slot, port;
+             bool connecting;
+             int id = find_connection_by_socket(fd, &slot, ip, &port, &connecting);
+             if (id == -1) {
+                 continue;
+             }
+             if (connecting) {
+                 finish_connect(fd, id, ip, port);
+                 continue;
+             }
+             /* Write queued frames first: receiving may close the connection */
+             if ((events[i].events & EPOLLOUT) && flush_connection(fd) == -1) {
+                 claim_peer(slot, 0); /* Close a file left incomplete */
+                 close_connection_by_socket(fd);
+                 continue;
+             }
+             if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                 receive_messages(fd, claim_peer(slot, id), ip, port);
+             }
          }
-         dprintf(log_pipe[1], "\nNew connection from %s:%d assigned ID %d\n> ", ip, port, id);
-         /* Spawn a thread to handle the client */
-         int* sock_ptr = malloc(sizeof(int));
-         *sock_ptr = client_sock;
-         pthread_t thread;
-         pthread_create(&thread, NULL, handle_client, sock_ptr);
-         pthread_detach(thread); /* Detach to clean up automatically */
      }
+     for (int i = 0; i < MAX_CONNECTIONS; i++) {
+         claim_peer(i, 0); /* Close files left incomplete and free reassembly buffers */
+     }
+     close(epoll_fd);
+     close(wake_fd);
      return NULL;
- }
\ No newline at end of file
+ }
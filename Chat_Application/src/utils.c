@@ -9,6 +9,7 @@
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
+ #include <limits.h>       /* For INT_MAX */
  #include <ifaddrs.h>      /* For network interface info */
  #include <netinet/in.h>   /* For sockaddr_in */
  #include <arpa/inet.h>    /* For inet_ntop and INADDR_LOOPBACK */
@@ -75,4 +76,20 @@
          free(tokens[i]); /* Free each token string */
      }
      free(tokens); /* Free the token array */
+ }
+ 
+ /* Function to parse a comma-separated list of connection IDs */
+ /* Fills ids with at most max positive IDs; returns their count, or -1 if the list is malformed */
+ int parse_id_list(const char* list, int* ids, int max) {
+     int count = 0;
+     const char* p = list;
+     while (true) {
+         char* end;
+         long id = strtol(p, &end, 10);
+         if (end == p || id <= 0 || id > INT_MAX || count == max) return -1;
+         ids[count++] = (int)id;
+         if (*end == '\0') return count;
+         if (*end != ',') return -1;
+         p = end + 1;
+     }
  }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#ifndef ALERT_RULES_H
+#define ALERT_RULES_H
+
+#include "common.h"  /* Required for gateway_error_t, sensor_id_t */
+
+/* Alert rules of the data manager, read from ALERT_RULES_FILE_NAME. Each line is
+ *   scope,id,low,high,hysteresis,max_rate,max_zscore
+ * with scope 'default' (id ignored), 'room' (a room ID of the map) or 'sensor' (a sensor ID).
+ * An empty or missing field is inherited: a sensor line overrides its room's line, which
+ * overrides the default line, which overrides the built-in thresholds (the settings
+ * temp_too_cold_threshold and temp_too_hot_threshold) and ALERT_DEFAULT_HYSTERESIS (rate and
+ * z-score checks off).
+ * 'off' disables a check. Later lines for the same scope and id override the fields they set.
+ *   low / high:  the running average is too cold below low, too hot above high
+ *   hysteresis:  a crossed threshold clears once the average is this far back inside
+ *   max_rate:    largest change between two readings, per second (at least one second apart)
+ *   max_zscore:  largest distance of a reading from the sensor's mean, in standard deviations
+ * Rules are resolved into one alert_profile_t per sensor when its room or the rules change,
+ * so a reading costs the same whatever the number of rules. */
+
+/* The checks in effect for one sensor; disabled checks hold an infinite limit */
+typedef struct {
+    double low;                  /* Too cold below this (-INFINITY = off) */
+    double high;                 /* Too hot above this (INFINITY = off) */
+    double hysteresis;           /* Distance back inside a threshold before its alert clears */
+    double max_rate;             /* Largest change per second (INFINITY = off) */
+    double max_zscore;           /* Largest z-score of a reading (INFINITY = off) */
+} alert_profile_t;
+
+/* A rule of one room or sensor, with the fields it sets */
+typedef struct {
+    int key;                     /* Room or sensor ID */
+    int line;                    /* Line of the file, orders rules with the same key */
+    unsigned int set;            /* Bit per field of values that the rule sets */
+    double values[5];            /* low, high, hysteresis, max_rate, max_zscore */
+} alert_rule_t;
+
+/* A loaded rules file. Read-only once loaded; a reload loads a new one */
+typedef struct {
+    alert_profile_t base;        /* Built-in defaults with the 'default' line applied */
+    alert_rule_t *rooms;         /* Room rules, sorted by room ID, one per room */
+    int room_count;
+    alert_rule_t *sensors;       /* Sensor rules, sorted by sensor ID, one per sensor */
+    int sensor_count;
+    int line_count;              /* Rule lines accepted */
+    unsigned int generation;     /* Set by the data manager when the rules are published (starts at 1) */
+} alert_rules_t;
+
+/**
+ * @brief Loads a rules file. A missing file is not an error: the rules then hold the built-in
+ *        defaults only. Invalid lines are logged and skipped.
+ * @param filename The rules file, or NULL for the built-in defaults.
+ * @param rules Receives the rules.
+ * @return GATEWAY_SUCCESS, or GATEWAY_ERROR_NOMEM.
+ */
+gateway_error_t alert_rules_load(const char *filename, alert_rules_t **rules);
+
+/**
+ * @brief Computes the checks in effect for a sensor.
+ * @param rules The rules.
+ * @param sensor_id The sensor.
+ * @param room_id Its room in the map, -1 if the map does not list it.
+ * @param profile Receives the checks.
+ */
+void alert_rules_resolve(const alert_rules_t *rules, sensor_id_t sensor_id, int room_id, alert_profile_t *profile);
+
+/**
+ * @brief Frees rules. Safe to call with *rules NULL; sets *rules to NULL.
+ */
+void alert_rules_free(alert_rules_t **rules);
+
+#endif /* ALERT_RULES_H */
@@ -0,0 +1,91 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common.h"  /* Required for sensor_data_t and gateway_error_t */
+
+/* Compressed columnar archive of sensor readings.
+ * The archive is a directory of append-only files (archive-<YYYYMMDD>.gar, by the UTC day of
+ * a block's first reading). A file is a 32 byte header followed by blocks, each holding the
+ * readings of one sensor: a fixed header (sensor, count, time range, first reading) and a bit
+ * stream with delta-of-delta encoded timestamps and XOR encoded values (as in Facebook's Gorilla).
+ * Blocks are 8 byte aligned so a mapped file can be walked block by block; a reader skips the
+ * blocks of other sensors and other time ranges without decoding them.
+ * A writer is used by a single thread; readers may run concurrently and see sealed blocks only. */
+
+/* A block being filled for one sensor */
+typedef struct archive_block archive_block_t;
+
+/* State of an archive open for appending */
+typedef struct {
+    char dir[256];               /* Directory holding the archive files */
+    archive_block_t *blocks;     /* Open blocks, one per sensor seen */
+    size_t block_count;          /* Blocks in use */
+    size_t block_capacity;       /* Allocated blocks */
+    int fd;                      /* Archive file appended to, -1 if none */
+    int fd_day;                  /* UTC day (YYYYMMDD) of fd */
+    unsigned long blocks_written; /* Sealed blocks since archive_open() */
+    unsigned long readings_written; /* Readings in those blocks */
+    unsigned long dropped;       /* Readings lost to write errors */
+} archive_writer_t;
+
+/**
+ * @brief Called by archive_scan() for each reading found, in file order.
+ * @param reading The reading.
+ * @param ctx The context passed to archive_scan().
+ * @return true to continue the scan, false to stop it.
+ */
+typedef bool (*archive_visit_fn)(const sensor_data_t *reading, void *ctx);
+
+/**
+ * @brief Opens (creating it if needed) an archive directory for appending.
+ * @param archive The writer to set up.
+ * @param dir Directory for the archive files.
+ * @return GATEWAY_SUCCESS, GATEWAY_ERROR_INVALID_ARG, or ARCHIVE_IO_ERR (errno is kept).
+ */
+gateway_error_t archive_open(archive_writer_t *archive, const char *dir);
+
+/**
+ * @brief Seals the open blocks (archive_flush()) and closes the writer.
+ * @param archive The writer; safe to call on one that failed to open.
+ */
+void archive_close(archive_writer_t *archive);
+
+/**
+ * @brief Adds readings to the open block of their sensor. A block is written out once full,
+ *        so readings become visible to archive_scan() only in whole blocks.
+ * @param archive The writer.
+ * @param data The readings.
+ * @param count Number of readings.
+ * @return GATEWAY_SUCCESS, GATEWAY_ERROR_NOMEM or ARCHIVE_IO_ERR (readings are counted as dropped).
+ */
+gateway_error_t archive_append(archive_writer_t *archive, const sensor_data_t *data, size_t count);
+
+/**
+ * @brief Writes out the open blocks that were started at least max_age_sec ago (wall clock).
+ *        A max_age_sec of 0 seals every open block.
+ * @param archive The writer.
+ * @param max_age_sec Age of the blocks to seal.
+ * @return GATEWAY_SUCCESS, or ARCHIVE_IO_ERR if a block could not be written.
+ */
+gateway_error_t archive_flush(archive_writer_t *archive, unsigned int max_age_sec);
+
+/**
+ * @brief Calls visit for every archived reading of one sensor in [from, to].
+ *        Only the blocks of that sensor overlapping the range are decoded.
+ * @param dir The archive directory.
+ * @param id The sensor.
+ * @param from First timestamp of the range.
+ * @param to Last timestamp of the range.
+ * @param visit Called for each reading; may stop the scan.
+ * @param ctx Passed to visit.
+ * @param found Set to the number of readings visited (may be NULL).
+ * @return GATEWAY_SUCCESS, or ARCHIVE_IO_ERR if the directory or a file could not be read.
+ */
+gateway_error_t archive_scan(const char *dir, sensor_id_t id, sensor_ts_t from, sensor_ts_t to,
+                             archive_visit_fn visit, void *ctx, size_t *found);
+
+#endif /* ARCHIVE_H */
@@ -0,0 +1,67 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"  /* Required for sensor_data_t and gateway_error_t */
+
+/* Capture of the readings the connection manager decodes, fed back by sensor_replay.
+ * A capture file is a CAPTURE_HEADER_SIZE byte header (CAPTURE_MAGIC, then the wall clock time
+ * the capture started, in microseconds) followed by CAPTURE_RECORD_SIZE byte records in arrival
+ * order. Everything is little-endian. A record holds:
+ *   uint32 microseconds since the previous record (or the start), on the monotonic clock
+ *   uint16 stream: the socket the reading arrived on, so a replay can keep connections apart
+ *   uint16 sensor ID, int64 sensor timestamp (seconds), IEEE-754 double value
+ * The readings of one received block share their arrival time, so all but the first have a
+ * delta of 0. Gaps longer than UINT32_MAX microseconds (71 minutes) are shortened to that. */
+
+#define CAPTURE_MAGIC "SGWCAP01"
+#define CAPTURE_MAGIC_SIZE 8
+#define CAPTURE_HEADER_SIZE (CAPTURE_MAGIC_SIZE + sizeof(uint64_t))
+#define CAPTURE_RECORD_SIZE (sizeof(uint32_t) + 2 * sizeof(uint16_t) + sizeof(int64_t) + sizeof(double))
+
+/* One decoded record */
+typedef struct {
+    uint32_t delta_us;    /* Arrival time since the previous record */
+    uint16_t stream;      /* Socket of the connection (or datagram socket) it arrived on */
+    sensor_data_t reading;
+} capture_record_t;
+
+/**
+ * @brief Starts capturing to a file, which is created or truncated.
+ * @param path The capture file.
+ * @return GATEWAY_SUCCESS, or CAPTURE_IO_ERR (errno is kept).
+ */
+gateway_error_t capture_open(const char *path);
+
+/**
+ * @brief Appends a block of readings that arrived together. Does nothing unless a capture is open.
+ *        Thread-safe; a write error is logged and ends the capture.
+ * @param stream The socket the readings arrived on.
+ * @param readings The decoded readings.
+ * @param count Number of readings.
+ */
+void capture_write(int stream, const sensor_data_t *readings, size_t count);
+
+/**
+ * @brief Flushes and closes the capture file, if one is open.
+ */
+void capture_close(void);
+
+/**
+ * @brief Checks a capture file header.
+ * @param header The first CAPTURE_HEADER_SIZE bytes of the file.
+ * @param start_us Receives the wall clock time the capture started, in microseconds.
+ * @return GATEWAY_SUCCESS, or GATEWAY_ERROR_INVALID_ARG if it is not a capture file.
+ */
+gateway_error_t capture_parse_header(const uint8_t *header, uint64_t *start_us);
+
+/**
+ * @brief Decodes one record.
+ * @param data CAPTURE_RECORD_SIZE bytes of the file.
+ * @param record Receives the record (reading.ingest_us is 0).
+ */
+void capture_decode_record(const uint8_t *data, capture_record_t *record);
+
+#endif /* CAPTURE_H */
@@ -1,9 +1,12 @@
 #ifndef CMDIF_H
 #define CMDIF_H
 
+#include "sbuffer.h" /* Required for sbuffer_t */
+
 /* Structure for arguments */
 typedef struct {
     const char *socket_path;
+    sbuffer_t *buffer;       /* Shared buffer, for the 'buffer' command (may be NULL) */
 } cmdif_args_t;
 
 /**
@@ -13,10 +13,32 @@ typedef time_t sensor_ts_t;      /* Type for timestamp (seconds since epoch) */
 /* Structure to hold a single sensor data reading */
 typedef struct {
     sensor_id_t id;
+    uint32_t ingest_us;          /* Low 32 bits of CLOCK_MONOTONIC in microseconds when received,
+                                    0 if unknown; fits in the padding after id, never stored */
     sensor_value_t value;
     sensor_ts_t ts;
 } sensor_data_t;
 
+/* What a rollup row aggregates */
+typedef enum {
+    ROLLUP_SCOPE_SENSOR = 0,     /* key is a sensor ID */
+    ROLLUP_SCOPE_ROOM = 1        /* key is a room ID */
+} rollup_scope_t;
+
+/* Summary of the readings of one sensor or room in one time bucket.
+ * Rows are mergeable: several rows for the same bucket (e.g. one per data manager
+ * worker for a room) combine as SUM(count), SUM(sum), MIN(min), MAX(max). */
+typedef struct {
+    rollup_scope_t scope;        /* Sensor or room */
+    int key;                     /* Sensor or room ID */
+    int period;                  /* Bucket length in seconds */
+    sensor_ts_t start;           /* Bucket start, a multiple of period */
+    uint32_t count;              /* Readings in the bucket */
+    double sum;                  /* Sum of their values */
+    double min;                  /* Smallest value */
+    double max;                  /* Largest value */
+} rollup_row_t;
+
 /* -- General Error Codes -- */
 /* Using negative values for errors, 0 for success */
 typedef enum {
@@ -42,6 +64,7 @@ typedef enum {
     DB_TABLE_CREATE_ERROR = -22,  /* Failed to create database table */
     DB_INSERT_ERROR = -23,        /* Failed to insert data into database */
     DB_DISCONNECT_ERROR = -24,    /* Failed to disconnect database */
+    DB_OUT_OF_RANGE = -25,        /* Reading outside the partitions kept; retrying cannot help */
 
     /* Connection Manager Errors */
     CONNMGR_ERROR = -30,          /* Generic connection manager error */
@@ -52,6 +75,8 @@ typedef enum {
     CONNMGR_ACCEPT_ERR = -35,     /* Failed to accept new connection */
     CONNMGR_CLIENT_READ_ERR = -36,/* Failed to read from client socket */
     CONNMGR_CLIENT_CLOSE_ERR = -37,/* Error closing client socket */
+    CONNMGR_PROTOCOL_ERR = -38,   /* Malformed frame received from a sensor */
+    CONNMGR_URING_ERR = -39,      /* io_uring unavailable or missing a required feature */
 
     /* Logger/FIFO Errors */
     LOGGER_ERROR = -40,           /* Generic logger error */
@@ -73,6 +98,18 @@ typedef enum {
     THREAD_COND_WAIT_ERR = -57,   /* Error waiting on condition variable */
     THREAD_COND_SIGNAL_ERR = -58, /* Error signaling condition variable */
 
+    /* Spill Log Errors */
+    SPILL_IO_ERR = -60,           /* Failed to create, map or remove a spill segment */
+
+    /* Archive Errors */
+    ARCHIVE_IO_ERR = -70,         /* Failed to read or write an archive file */
+
+    /* Capture Errors */
+    CAPTURE_IO_ERR = -80,         /* Failed to create or write a capture file */
+
+    /* Settings Errors */
+    SETTINGS_IO_ERR = -90,        /* Failed to read a settings file */
+
 } gateway_error_t;
 
 
@@ -1,18 +1,44 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+/* Defaults of the gateway. Those listed in settings.h can also be set in GATEWAY_CONFIG_FILE_NAME,
+ * on the command line (-o name=value) and, for some, with the 'set' command while running. */
+
+/* -- Settings File -- */
+
+/* Read at startup if it exists; -f names another file, which must exist */
+#define GATEWAY_CONFIG_FILE_NAME "gateway.conf"
+
 /* -- Network Configuration -- */
 
 /* Maximum number of pending connections in the listen queue */
-#define TCP_BACKLOG 10          
+#define TCP_BACKLOG 1024          
+
+/* Default number of connection manager reactor threads, override with -r */
+#define CONMGT_REACTORS 1
+/* Upper bound for the number of reactor threads */
+#define CONMGT_MAX_REACTORS 16
+
+/* TCP connections open at once; their state is reserved at startup and further ones are refused */
+#define CONMGT_MAX_CLIENTS 4096
+
+/* Size of the block each sensor socket read may return (several frames per read) */
+#define CONMGT_RX_BUFFER_SIZE 16384
+
+/* Write buffer of the capture file (-c), records reach the file in blocks of this size */
+#define CONMGT_CAPTURE_BUFFER_SIZE (256 * 1024)
 
 /* Timeout duration in seconds for inactive sensors */
 #define SENSOR_TIMEOUT_SEC 5   
+/* Largest sensor timeout the 'sensor_timeout_sec' setting accepts (bounded by the timer wheel) */
+#define SENSOR_TIMEOUT_MAX_SEC 60
 
 /* -- Shared Buffer Configuration -- */
 
-/* Size of the shared buffer (number of sensor_data_t elements) */
+/* Default size of the shared buffer (number of sensor_data_t elements), override with -b */
 #define SBUFFER_SIZE 15         
+/* Default limit the shared buffer may grow to under backpressure (0 = fixed size), override with -B */
+#define SBUFFER_MAX_SIZE 0
 
 /* -- Database Configuration -- */
 
@@ -20,23 +46,297 @@
 #define DB_NAME "sensordata.db" 
 /* Name of the table within the database */
 #define DB_TABLE_NAME "SensorData" 
+/* Name of the table holding the per-sensor and per-room rollups */
+#define DB_ROLLUP_TABLE_NAME "SensorRollup"
+/* Partitioned storage: readings go to one table per this many hours (UTC), DB_TABLE_NAME becomes
+ * a UNION ALL view over them; 0 keeps the single DB_TABLE_NAME table */
+#define DB_PARTITION_HOURS 24
+/* Partitions kept, counted back from the current one by wall clock; older ones are dropped, and
+ * readings that would belong to them are refused (0 = keep all) */
+#ifndef DB_RETENTION_PARTITIONS
+#define DB_RETENTION_PARTITIONS 0
+#endif
+/* Readings stamped more than this ahead of the wall clock are refused, and partitions beyond it are
+ * left out of the view, so a sensor with a wrong clock cannot create tables retention never reaches (s) */
+#define DB_MAX_FUTURE_SEC 3600
+/* Insert statements kept prepared per connection, one per recently written partition */
+#define DB_PARTITION_STMT_CACHE 4
+/* How long a statement waits for another connection's lock before failing (ms) */
+#define DB_BUSY_TIMEOUT_MS 1000
 /* Number of retry attempts if DB connection fails */
 #define DB_CONNECT_RETRY_ATTEMPTS 3 
 /* Delay in seconds between DB connection retry attempts */
 #define DB_CONNECT_RETRY_DELAY_SEC 5 
 
+/* Storage profile: 1 = WAL journal with synchronous=NORMAL and background checkpoints, 0 = SQLite defaults */
+#define DB_WAL_PROFILE 1
+/* Page cache per connection (KiB) */
+#define DB_CACHE_SIZE_KB 8192
+/* Bytes of the database file accessed through mmap (0 = plain reads) */
+#define DB_MMAP_SIZE (64L * 1024 * 1024)
+/* Interval between the passive WAL checkpoints of the checkpoint thread (ms) */
+#define DB_CHECKPOINT_INTERVAL_MS 1000
+
+/* Readings the storage manager inserts per transaction (one journal sync each) */
+#define STORAGEMGT_BATCH_SIZE 256
+/* How long a batch waits for more readings once its first one arrived (ms) */
+#define STORAGEMGT_BATCH_LINGER_MS 50
+/* Filled batches queued between the sbuffer drain thread and the DB writer */
+#define STORAGEMGT_BATCH_QUEUE_DEPTH 2
+/* Readings per transaction while the storage manager drains at shutdown */
+#define STORAGEMGT_DRAIN_BATCH_SIZE 8192
+/* Longest the shutdown drain commits for; what is left then goes to the spill log (ms) */
+#define STORAGEMGT_DRAIN_TIMEOUT_MS 2000
+
+/* Failed readings the retry queue keeps in memory before spilling to disk */
+#define STORAGEMGT_RETRY_MEM_ITEMS 4096
+/* Directory of the on-disk spill log, replayed after a restart */
+#define STORAGEMGT_SPILL_DIR "spill"
+/* Size of one memory-mapped spill segment file (bytes) */
+#define STORAGEMGT_SPILL_SEGMENT_BYTES (1024 * 1024)
+/* Segments kept at most (>= 2); beyond that the oldest one is dropped */
+#define STORAGEMGT_SPILL_MAX_SEGMENTS 64
+
+/* Keep a compressed archive of the committed readings for long-term storage (0 disables) */
+#define STORAGEMGT_ARCHIVE 1
+/* Directory of the archive files */
+#define STORAGEMGT_ARCHIVE_DIR "archive"
+/* Bit stream space of one archive block, held in memory per sensor while it fills (bytes) */
+#define STORAGEMGT_ARCHIVE_BLOCK_BYTES 4096
+/* Open archive blocks are written out after this long even if not full (s) */
+#define STORAGEMGT_ARCHIVE_SEAL_SEC 600
+
+/* Duplicates: the data and storage managers remember each sensor's last readings as (timestamp,
+ * value hash) pairs and drop a reading matching one of them (0 = keep every reading) */
+#define DEDUP_WINDOW_READINGS 64
+/* Reorder buffer: the storage manager holds readings until the newest timestamp seen, or the
+ * clock, is this far past theirs and commits them in timestamp order (s, 0 = order each batch) */
+#define STORAGEMGT_REORDER_LATENESS_SEC 1
+/* Readings the reorder buffer holds; when it is full the oldest are committed early */
+#define STORAGEMGT_REORDER_MAX_READINGS 16384
+
 /* -- Logging Configuration -- */
 
 /* Name of the FIFO used for logging events */
 #define LOG_FIFO_NAME "logFifo" 
 /* Name of the output log file */
 #define LOG_FILE_NAME "gateway.log" 
+/* Size of each thread's log ring (bytes, power of two); log_message() only copies into it */
+#define LOG_RING_BYTES (64 * 1024)
+/* How often the flusher thread drains the rings into the FIFO (ms) */
+#define LOG_FLUSH_INTERVAL_MS 20
+/* When a thread's ring is full: 1 waits for the flusher, 0 drops the message (drops are counted
+ * and logged, errors always wait) */
+#define LOG_RING_BLOCK_WHEN_FULL 0
+/* Longest a thread waits for room in its ring before the message is dropped (ms) */
+#define LOG_RING_MAX_WAIT_MS 50
+/* How often dropped and delayed messages are reported in the log, if any (s) */
+#define LOG_STATS_INTERVAL_SEC 60
+/* How long the flusher keeps writing to a full FIFO once the logger is shutting down (ms) */
+#define LOG_SHUTDOWN_WAIT_MS 2000
+/* 1 hands log messages to the log process through a shared memory ring (log_shm.h), which
+ * log_message() fills directly; 0, or a ring that can't be set up, uses the rings, flusher and
+ * FIFO above. Override with make LOG_SHM=<0|1> */
+#ifndef LOG_SHM
+#define LOG_SHM 1
+#endif
+/* Slots of the shared memory ring (power of two) ... */
+#define LOG_SHM_SLOTS 8192
+/* ... and the bytes of one, 8 of them for its header; a longer message takes consecutive slots */
+#define LOG_SHM_SLOT_BYTES 128
+/* How often an idle log process checks that the gateway still runs (ms) */
+#define LOG_SHM_IDLE_CHECK_MS 1000
+/* Most verbose level built in, 0 (fatal) to 4 (debug); LOG_DEBUG() and friends above it
+ * compile to nothing. Override with make LOG_COMPILE_LEVEL=<n> */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 4
+#endif
+/* Most verbose level logged at startup (0-4); the 'loglevel' command changes it at runtime */
+#define LOG_RUNTIME_LEVEL 4
+/* 1 sends binary records (format ID, level, timestamp, raw arguments) through the FIFO and
+ * leaves formatting to the log process; 0 formats the text in log_message().
+ * Override with make LOG_BINARY=<0|1> */
+#ifndef LOG_BINARY
+#define LOG_BINARY 0
+#endif
+/* With LOG_BINARY, 1 makes the log process store the records in LOG_BINARY_FILE_NAME
+ * (decoded offline by log_decode) instead of formatting them into LOG_FILE_NAME */
+#define LOG_BINARY_STORE 0
+/* Name of the stored binary log */
+#define LOG_BINARY_FILE_NAME "gateway.blog"
+/* The log process writes its output in batches: once this much is pending (bytes) ... */
+#define LOG_PROCESS_FLUSH_BYTES (64 * 1024)
+/* ... or this long after the oldest pending line (ms); FATAL lines are written at once */
+#define LOG_PROCESS_FLUSH_MS 200
+/* The log file (and a stored binary log) is renamed to <name>.<YYYYMMDD-HHMMSS> and started
+ * anew once it reaches this size (bytes) ... */
+#define LOG_ROTATE_BYTES (16 * 1024 * 1024)
+/* ... or this age (s, 0 for size only) */
+#define LOG_ROTATE_AGE_SEC (24 * 60 * 60)
+/* Rotated files kept; older ones are deleted */
+#define LOG_ROTATE_KEEP 5
+/* 1 compresses rotated files with gzip in a child of the log process */
+#define LOG_ROTATE_COMPRESS 1
 
 /* -- Data Manager Configuration -- */
 #define MAP_FILE_NAME "room_sensor.map"
+/* Per-room and per-sensor alert thresholds and anomaly checks (format in alert_rules.h).
+ * Optional; reloaded together with the map */
+#define ALERT_RULES_FILE_NAME "alert_rules.conf"
+/* Hysteresis of a threshold without a rule (0 = an alert clears as soon as the average is back inside) */
+#define ALERT_DEFAULT_HYSTERESIS 0.0
+/* Z-score check: weight of the newest reading in each sensor's mean and variance (0 < alpha <= 1) */
+#define ALERT_ZSCORE_ALPHA 0.05
+/* Z-score check: readings of a sensor before the check applies */
+#define ALERT_ZSCORE_MIN_READINGS 20
+/* Alerts of one sensor are logged at most once per this many seconds; the alerts in between are
+ * counted and logged as one summary when the interval is over (0 = log every alert) */
+#define ALERT_MIN_INTERVAL_SEC 30
+/* Alert and summary lines all data manager workers log per second at most; alerts over the limit
+ * are held back for the summaries like those of the interval (0 = no limit) */
+#define ALERT_MAX_PER_SEC 50
+
+/* Running average the temperature alerts are based on:
+ * DATAMGT_AVG_WINDOW keeps each sensor's last readings in a circular array,
+ * DATAMGT_AVG_EWMA keeps an exponentially weighted average and no history. */
+#define DATAMGT_AVG_WINDOW 0
+#define DATAMGT_AVG_EWMA 1
+#define DATAMGT_AVG_MODE DATAMGT_AVG_WINDOW
+/* Window mode: number of readings averaged */
+#define DATAMGT_WINDOW_SIZE 16
+/* Window mode: also drop readings older than this many seconds (0 = count only) */
+#define DATAMGT_WINDOW_SEC 0
+/* EWMA mode: weight of the newest reading (0 < alpha <= 1) */
+#define DATAMGT_EWMA_ALPHA 0.2
+/* 1 runs the batch kernels of the data manager (alert thresholds, rollup clock) with AVX2 or
+ * NEON where available, 0 always with plain loops. Override with make SENSOR_BATCH_SIMD=<0|1> */
+#ifndef SENSOR_BATCH_SIMD
+#define SENSOR_BATCH_SIMD 1
+#endif
+
+/* Default number of data manager workers, each owning the sensors with id % workers == shard; override with -w */
+#define DATAMGT_WORKERS 1
+/* Upper bound for the number of data manager workers */
+#define DATAMGT_MAX_WORKERS 16
+/* Capacity of the queue feeding each worker when there is more than one (readings) */
+#define DATAMGT_SHARD_QUEUE_SIZE 1024
+
+/* Sensor statistics reserved at startup, in chunks of 256 sensors shared by all workers;
+ * readings of further sensors are not processed (gateway_datamgt_untracked_total). Each worker
+ * takes whole chunks, so with several workers the partly used chunk of each one leaves the
+ * real limit below DATAMGT_STATS_CHUNKS * 256 sensors, by up to 255 per worker */
+#define DATAMGT_STATS_CHUNKS 32
+
+/* Live 'subscribe' feeds served at once */
+#define DATAMGT_MAX_SUBSCRIBERS 8
+/* Readings a feed holds for its subscriber (power of two); a slow one loses the oldest */
+#define DATAMGT_SUBSCRIBER_RING 1024
+
+/* Rollups: count/sum/min/max per sensor and per room in fixed buckets, written to DB_ROLLUP_TABLE_NAME (0 = off) */
+#define DATAMGT_ROLLUPS 1
+/* Bucket lengths in seconds of the two rollup tiers */
+#define DATAMGT_ROLLUP_MINUTE_SEC 60
+#define DATAMGT_ROLLUP_HOUR_SEC 3600
+/* Completed rows waiting for the storage manager before new ones are dropped */
+#define STORAGEMGT_ROLLUP_QUEUE_MAX 65536
+/* At shutdown, how long the storage manager waits for the data manager's final rollups */
+#define STORAGEMGT_ROLLUP_DRAIN_SEC 10
+
+/* Warm restart: each worker saves its sensors' statistics (averages, threshold states, anomaly
+ * baselines, open rollup buckets) this often and when it stops, and the next start loads them (s, 0 = off) */
+#define DATAMGT_SNAPSHOT_INTERVAL_SEC 60
+/* Directory of the snapshot files, one per worker */
+#define DATAMGT_SNAPSHOT_DIR "snapshot"
+/* Snapshots older than this are not loaded (s, 0 = any age) */
+#define DATAMGT_SNAPSHOT_MAX_AGE_SEC 3600
 
 /* -- Command Interface Configuration -- */
 #define CMD_SOCKET_PATH "/tmp/sensor_gateway_cmd.sock"
+/* Rows one 'query' command returns at most; it holds a read snapshot until done */
+#define CMD_QUERY_MAX_ROWS 100000
+/* A client that does not read its responses for this long is dropped (ms) */
+#define CMD_SEND_TIMEOUT_MS 2000
+/* Command sessions open at once; more connections are refused */
+#define CMD_MAX_SESSIONS 32
+/* A session that sends no command for this long is closed */
+#define CMD_SESSION_IDLE_SEC 300
+/* A session stops running commands while this many response bytes wait to be sent */
+#define CMD_SESSION_PENDING_MAX (64 * 1024)
+/* How often the readings of 'subscribe' feeds are sent (ms) */
+#define CMD_SUBSCRIBE_POLL_MS 100
+/* Output buffer a session keeps after a larger response was sent */
+#define CMD_SESSION_KEEP_BYTES (64 * 1024)
+
+/* -- Forwarder Configuration -- */
+/* Upstream gateway every reading is forwarded to, "host:port" ("" = no forwarding) */
+#define FORWARDER_UPSTREAM ""
+/* Readings sent upstream and not acknowledged yet, kept in memory for a resend. Readings
+ * beyond them, and all readings while the upstream is unreachable, go to the spill log */
+#define FORWARDER_WINDOW_READINGS 16384
+/* Readings taken from the shared buffer, or the spill log, and sent together at most */
+#define FORWARDER_SEND_BATCH 1024
+/* Spill log of the readings waiting to be forwarded; segment sizes as STORAGEMGT_SPILL_* */
+#define FORWARDER_SPILL_DIR "forward_spill"
+/* The connection is restarted when sent readings stay unacknowledged this long (ms) */
+#define FORWARDER_ACK_TIMEOUT_MS 5000
+/* An idle connection sends an acknowledgement request this often, so the upstream
+ * keeps it open (below its sensor timeout) and answers it (ms) */
+#define FORWARDER_KEEPALIVE_MS 1000
+/* Delay before the first reconnection attempt; it doubles up to the maximum (ms) */
+#define FORWARDER_RECONNECT_MIN_MS 500
+#define FORWARDER_RECONNECT_MAX_MS 30000
+/* Longest wait for a connect or a send before the connection is given up (ms) */
+#define FORWARDER_IO_TIMEOUT_MS 5000
+
+/* -- Memory Pool Configuration -- */
+/* Free objects each thread keeps per pool, moved to and from the shared free list in halves */
+#define POOL_THREAD_CACHE 32
+
+/* -- Thread Placement Configuration -- */
+/* CPUs each manager thread may run on, as a list such as "0-1,3" ("" = any). The threads a
+ * manager starts itself (reactors, workers, storage drain and checkpoint) inherit its CPUs and
+ * scheduling; LOGGER_* apply to the log process. E.g. on a 4-core board: "0", "1", "2", "3", "3" */
+#define CONMGT_CPUS ""
+#define DATAMGT_CPUS ""
+#define STORAGEMGT_CPUS ""
+#define FORWARDER_CPUS ""
+#define CMDIF_CPUS ""
+#define LOGGER_CPUS ""
+/* Real-time priority (1-99 runs the thread SCHED_FIFO, needs CAP_SYS_NICE; 0 = SCHED_OTHER) */
+#define CONMGT_SCHED_PRIORITY 0
+#define DATAMGT_SCHED_PRIORITY 0
+#define STORAGEMGT_SCHED_PRIORITY 0
+#define FORWARDER_SCHED_PRIORITY 0
+#define CMDIF_SCHED_PRIORITY 0
+#define LOGGER_SCHED_PRIORITY 0
+/* Nice value under SCHED_OTHER (-20 to 19; below 0 needs CAP_SYS_NICE) */
+#define CONMGT_NICE 0
+#define DATAMGT_NICE 0
+#define STORAGEMGT_NICE 0
+#define FORWARDER_NICE 0
+#define CMDIF_NICE 0
+#define LOGGER_NICE 0
+/* Stack size of the manager threads (KiB, 0 = the system default) */
+#define THREAD_STACK_KB 0
+/* Placement the kernel refuses (CPU offline, no permission) is logged and the thread starts unplaced */
+
+/* -- System Monitor Configuration -- */
+/* Interval between the samples of the sysmon thread; CPU figures cover one interval (ms) */
+#define SYSMON_INTERVAL_MS 1000
+/* Cores and gateway threads a sample reports at most */
+#define SYSMON_MAX_CPUS 64
+#define SYSMON_MAX_THREADS 64
+
+/* -- Metrics Configuration -- */
+/* TCP port answering HTTP requests with the metrics in Prometheus text format (0 = off;
+ * the 'metrics' command exports them either way) */
+#ifndef METRICS_HTTP_PORT
+#define METRICS_HTTP_PORT 0
+#endif
+/* Address the metrics endpoint listens on */
+#define METRICS_HTTP_BIND_ADDR "127.0.0.1"
+/* Request bytes read before answering; the request itself is not parsed */
+#define METRICS_HTTP_REQUEST_MAX 1024
 
 /* Max connections from the same IP */
 #define MAX_CONNECTIONS_PER_IP 5 
@@ -8,28 +8,52 @@
 /* Include project-specific headers */
 #include "sbuffer.h" /* Required for sbuffer_t */
 #include "common.h"  /* Required for gateway_error_t */
+#include "protocol.h" /* Required for protocol_stream_t, PROTOCOL_MAX_FRAME_SIZE */
+
+/* Event loop implementation of the connection manager */
+typedef enum {
+    CONMGT_BACKEND_EPOLL = 0,  /* Readiness notification, the reactor reads the sockets itself */
+    CONMGT_BACKEND_IO_URING,   /* Multishot accept/recv into provided buffers (Linux 6.0+), falls back to epoll */
+} conmgt_backend_id_t;
 
 /* Structure to pass arguments to the connection manager thread */
 typedef struct {
     int server_port;   /* The TCP port number to listen on */
     sbuffer_t *buffer; /* Pointer to the shared buffer */
+    int num_reactors;  /* Number of reactor threads sharing the port (1..CONMGT_MAX_REACTORS) */
+    bool udp_enabled;  /* Also ingest datagrams on a UDP socket bound to server_port */
+    conmgt_backend_id_t backend; /* Event loop implementation of every reactor */
+    const char *capture_file; /* Append every decoded reading to this file (capture.h), NULL = off */
 } conmgt_args_t;
 
-/* Structure to hold information about each connected client */
-typedef struct {
+/* Structure to hold information about each connected client.
+ * Allocated per connection and used as the epoll event's data pointer or the io_uring request's user_data. */
+typedef struct client_info {
     int socket_fd;
     sensor_id_t sensor_id;
     time_t last_active_ts;
     bool id_received;
     char client_ip[INET_ADDRSTRLEN]; /* Store client IP address string */
     int client_port;                 /* Store client port number */
+    uint8_t ip_key[16];              /* Peer address as counted in the per-IP connection table */
     time_t connection_start_ts;      /* Store connection start timestamp */
+    protocol_stream_t stream;        /* Protocol negotiated on the first byte */
+    uint8_t rx_partial[PROTOCOL_MAX_FRAME_SIZE]; /* Incomplete frame carried over to the next read */
+    size_t rx_partial_len;           /* Number of bytes in rx_partial */
+    uint64_t readings_accepted;      /* Readings inserted into the shared buffer, for acknowledgements */
+    struct client_info *prev;        /* Links in the connection manager's client list */
+    struct client_info *next;
+    time_t timer_deadline;           /* Second at which the client times out, 0 if not scheduled */
+    struct client_info *timer_prev;  /* Links in the timer wheel slot of timer_deadline */
+    struct client_info *timer_next;
+    bool recv_armed;                 /* io_uring backend: a multishot receive still references the client */
 } client_info_t;
 
 /**
 * The main function for the Connection Manager thread.
-* Sets up the server socket, listens for incoming TCP connections, 
+* Sets up one SO_REUSEPORT listening socket per reactor, listens for incoming TCP connections, 
 * accepts clients, reads sensor data, and inserts it into the shared buffer.
+* Extra reactors run in their own threads, the calling thread runs the first one and joins the rest.
 * Manages active connections and handles timeouts.
 * @param arg A pointer to a connmgr_args_t struct containing thread arguments.
 * @return Always returns NULL. Errors should be handled internally or logged.
@@ -38,7 +62,7 @@ void *conmgt_run(void *arg);
 
 /**
 * @brief Signals the Connection Manager thread to stop gracefully.
-* Writes to a shutdown pipe to interrupt the select() loop.
+* Writes to every reactor's shutdown pipe to interrupt its epoll loop.
 */
 void conmgt_stop(void);
 
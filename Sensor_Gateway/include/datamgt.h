@@ -12,11 +12,14 @@ typedef struct {
     sensor_id_t sensor_id;
 } room_sensor_entry_t;
 
-/* Structure to hold the entire map (dynamic array) */
+/* Structure to hold the entire map (dynamic array).
+ * Once loaded, entries are sorted by sensor_id with one entry per sensor, for binary search.
+ * A published map is read-only; a reload publishes a new map instead of changing it. */
 typedef struct {
     room_sensor_entry_t *entries; /* Pointer to the array of entries */
     int count;                    /* Number of valid entries */
     int capacity;                 /* Allocated capacity */
+    unsigned int generation;      /* Set by the data manager when the map is published (starts at 1) */
 } room_sensor_map_t;
 
 /* --- Thread Arguments --- */
@@ -24,9 +27,18 @@ typedef struct {
 /* Structure to pass arguments to the data manager thread */
 typedef struct {
     sbuffer_t *buffer;           /* Pointer to the shared buffer */
-    room_sensor_map_t *map;      /* Pointer to the loaded room-sensor map */
+    int reader_id;               /* Read cursor registered on the shared buffer */
+    room_sensor_map_t *map;      /* Loaded room-sensor map (may be NULL). The data manager takes it over
+                                    and stores the map it ends with here when datamgt_run returns */
+    const char *map_filename;    /* File read again by datamgt_reload_room_sensor_map() */
+    const char *rules_filename;  /* Alert rules file (see alert_rules.h), read at startup and on every
+                                    reload; NULL for the built-in thresholds only */
+    int num_workers;             /* Worker threads sharding the sensors by ID (0 selects DATAMGT_WORKERS) */
 } datamgt_args_t;
 
+/* A live feed of the readings passing through the data manager (see datamgt_subscribe()) */
+typedef struct datamgt_subscription datamgt_subscription_t;
+
 /* --- Thread Function --- */
 
 /**
@@ -34,6 +46,8 @@ typedef struct {
  * Reads sensor data from the shared buffer, performs calculations
  * (e.g., running average), checks for conditions (e.g., temperature thresholds),
  * potentially using the room_sensor_map, and logs relevant events.
+ * With more than one worker this thread only dispatches: each reading is routed to the
+ * queue of worker (id % num_workers), which alone owns the statistics of its sensors.
  * @param arg A pointer to a datamgt_args_t struct containing thread arguments.
  * @return Always returns NULL. Errors should be handled internally or logged.
  */
@@ -47,10 +61,56 @@ void *datamgt_run(void *arg);
 
 /* --- Map Loading/Freeing Functions --- */
 
+/**
+ * @brief Loads the map file again and publishes it to the running data manager.
+ * The file is parsed in the calling thread. The new map then replaces the old one
+ * with an atomic pointer swap, and workers pick it up at their next batch without
+ * taking a lock. The old map is freed after every worker has left it.
+ * On a parse error the current map stays in place.
+ * The alert rules file is read again as well and swapped the same way.
+ * @param entries Where the number of entries in the new map is stored (may be NULL).
+ * @return GATEWAY_SUCCESS, GATEWAY_ERROR if the data manager is not running, or the load error.
+ */
+gateway_error_t datamgt_reload_room_sensor_map(int *entries);
+
+/* --- Live Subscriptions --- */
+
+/**
+ * @brief Starts a live feed of readings. The data manager copies every matching reading it
+ * takes from the shared buffer into the subscription's ring of DATAMGT_SUBSCRIBER_RING
+ * readings, without locks or waits; a subscriber that reads too slowly loses the oldest.
+ * @param room_id Feed the sensors of this room in the room-sensor map (resolved again on
+ *                every reload), or -1 to use the sensor list.
+ * @param sensor_ids Sensors to feed; all sensors if count is 0 and room_id is -1.
+ * @param count Number of sensor_ids.
+ * @param subscription Receives the subscription.
+ * @return GATEWAY_SUCCESS, GATEWAY_ERROR if all DATAMGT_MAX_SUBSCRIBERS slots are taken.
+ */
+gateway_error_t datamgt_subscribe(int room_id, const sensor_id_t *sensor_ids, size_t count,
+                                  datamgt_subscription_t **subscription);
+
+/**
+ * @brief Takes the readings fed since the last call, oldest first. Only one thread may read
+ *        a subscription.
+ * @param subscription The subscription.
+ * @param readings Receives the readings.
+ * @param max_count Size of readings.
+ * @param dropped Incremented by the number of readings lost since the last call.
+ * @return The number of readings stored.
+ */
+size_t datamgt_subscription_read(datamgt_subscription_t *subscription, sensor_data_t *readings,
+                                 size_t max_count, unsigned long *dropped);
+
+/**
+ * @brief Ends a subscription. Waits (briefly) until the data manager no longer writes to it.
+ */
+void datamgt_unsubscribe(datamgt_subscription_t *subscription);
+
 /**
 * @brief Loads the room-to-sensor mapping from a file.
 * Assumes CSV format: room_id,sensor_id per line. Ignores empty lines and lines starting with #.
-* Allocates memory for the map structure and its entries.
+* Allocates memory for the map structure and its entries, and sorts them by sensor ID.
+* If a sensor is listed more than once, its first line wins.
 * @param filename The path to the map file.
 * @param map A pointer to a room_sensor_map_t* variable where the pointer to the loaded map will be stored.
 * @return GATEWAY_SUCCESS on success, an error code otherwise (e.g., GATEWAY_ERROR_NOMEM, file errors).
@@ -3,29 +3,155 @@
 
 #include <sqlite3.h> /* Required for sqlite3* */
 #include "common.h"  /* Required for sensor_data_t and gateway_error_t */
+#include "config.h"  /* Required for DB_PARTITION_STMT_CACHE */
+
+/* INSERT statement of one partition table (DB_PARTITION_HOURS > 0) */
+typedef struct {
+    sensor_ts_t start;           /* Partition start (UTC), a multiple of DB_PARTITION_HOURS */
+    sqlite3_stmt *stmt;          /* INSERT into that partition, NULL if the slot is unused */
+    unsigned long last_use;      /* For evicting the least recently used slot */
+} db_partition_stmt_t;
+
+/* An open database connection with its statements, prepared once in db_connect() */
+typedef struct {
+    sqlite3 *conn;               /* SQLite connection */
+    sqlite3_stmt *insert_stmt;   /* INSERT into DB_TABLE_NAME (single table mode only) */
+    db_partition_stmt_t partitions[DB_PARTITION_STMT_CACHE]; /* Partition INSERTs, prepared on first use */
+    unsigned long partition_clock; /* Incremented on every partition lookup */
+    sqlite3_stmt *rollup_stmt;   /* INSERT into DB_ROLLUP_TABLE_NAME */
+    sqlite3_stmt *begin_stmt;    /* BEGIN */
+    sqlite3_stmt *commit_stmt;   /* COMMIT */
+    sqlite3_stmt *rollback_stmt; /* ROLLBACK */
+} db_handle_t;
+
+/* What db_query_range() returns for a sensor and time range */
+typedef enum {
+    DB_QUERY_RAW = 0,            /* Every reading, oldest first */
+    DB_QUERY_SUMMARY,            /* One row summarizing the readings */
+    DB_QUERY_MINUTE,             /* The minute rollup buckets (DATAMGT_ROLLUP_MINUTE_SEC) */
+    DB_QUERY_HOUR                /* The hour rollup buckets (DATAMGT_ROLLUP_HOUR_SEC) */
+} db_query_agg_t;
+
+/* One result row of db_query_range(); a raw reading has count 1 and avg = min = max = its value */
+typedef struct {
+    sensor_ts_t ts;              /* Reading time, bucket start, or the range start for a summary */
+    uint32_t count;              /* Readings covered */
+    double avg;
+    double min;
+    double max;
+} db_query_row_t;
+
+/**
+ * Called by db_query_range() for each result row.
+ * @param row The row.
+ * @param ctx The context passed to db_query_range().
+ * @return true to continue, false to stop the query.
+ */
+typedef bool (*db_query_fn)(const db_query_row_t *row, void *ctx);
 
 /**
  * Connects to the SQLite database.
- * Creates the database file and the required table if they don't exist.
+ * Creates the database file, the required tables and the (SensorID, Timestamp) index
+ * if they don't exist, applies the storage profile (see DB_WAL_PROFILE), and prepares
+ * the INSERT statements reused by every insert on this handle.
  * @param db_name The filename of the database.
- * @param db A pointer to a sqlite3* variable where the database handle will be stored.
+ * @param db A pointer to a db_handle_t* variable where the new handle will be stored.
  * @return GATEWAY_SUCCESS on success, an error code otherwise (e.g., DB_CONNECT_ERROR, DB_TABLE_CREATE_ERROR).
  */
-gateway_error_t db_connect(const char *db_name, sqlite3 **db);
+gateway_error_t db_connect(const char *db_name, db_handle_t **db);
 
 /**
- * Disconnects from the SQLite database.
- * @param db The sqlite3 database handle to disconnect.
+ * Opens a read-only connection for queries, next to the inserting one.
+ * Nothing is created or prepared; in WAL mode its reads never block the writer.
+ * @param db_name The filename of the database.
+ * @param db A pointer to a db_handle_t* variable where the new handle will be stored.
+ * @return GATEWAY_SUCCESS on success, DB_CONNECT_ERROR otherwise.
+ */
+gateway_error_t db_connect_readonly(const char *db_name, db_handle_t **db);
+
+/**
+ * Disconnects from the SQLite database: finalizes the statements, closes the connection and frees the handle.
+ * @param db The handle to disconnect (may be NULL).
  * @return GATEWAY_SUCCESS on success, DB_DISCONNECT_ERROR otherwise.
  */
-gateway_error_t db_disconnect(sqlite3 *db);
+gateway_error_t db_disconnect(db_handle_t *db);
 
 /**
  * Inserts sensor data into the specified table in the database.
- * @param db The sqlite3 database handle.
+ * In partitioned mode the row goes to the partition of its timestamp, created on first use;
+ * creating a partition also refreshes the view and applies DB_RETENTION_PARTITIONS.
+ * A reading of a partition retention has already dropped, or stamped more than DB_MAX_FUTURE_SEC
+ * ahead of the wall clock, is refused before anything is created.
+ * @param db The database handle.
  * @param data A pointer to the sensor_data_t struct containing the data to insert.
+ * @return GATEWAY_SUCCESS on success, DB_OUT_OF_RANGE for a refused reading (nothing was written,
+ *         the transaction can go on), DB_INSERT_ERROR otherwise.
+ */
+gateway_error_t db_insert_sensor_data(db_handle_t *db, const sensor_data_t *data);
+
+/**
+ * Inserts a rollup summary row into the rollup table.
+ * @param db The database handle.
+ * @param row A pointer to the rollup_row_t to insert.
  * @return GATEWAY_SUCCESS on success, DB_INSERT_ERROR otherwise.
  */
-gateway_error_t db_insert_sensor_data(sqlite3 *db, const sensor_data_t *data);
+gateway_error_t db_insert_rollup(db_handle_t *db, const rollup_row_t *row);
+
+/**
+ * Starts a transaction: the inserts that follow share one journal sync at db_commit().
+ * @param db The database handle.
+ * @return GATEWAY_SUCCESS on success, DB_INSERT_ERROR otherwise.
+ */
+gateway_error_t db_begin(db_handle_t *db);
+
+/**
+ * Commits the transaction started by db_begin().
+ * @param db The database handle.
+ * @return GATEWAY_SUCCESS on success, DB_INSERT_ERROR otherwise (call db_rollback() then).
+ */
+gateway_error_t db_commit(db_handle_t *db);
+
+/**
+ * Rolls back the open transaction, if any; does nothing when none is open.
+ * @param db The database handle (may be NULL).
+ */
+void db_rollback(db_handle_t *db);
+
+/**
+ * Runs a passive WAL checkpoint: copies committed frames back into the database file
+ * without waiting for readers or blocking the writer. A no-op outside WAL mode.
+ * @param db The database handle (a separate connection from the inserting one).
+ * @param wal_frames Receives the number of frames in the WAL (may be NULL).
+ * @param checkpointed Receives the number of frames written back (may be NULL).
+ * @return GATEWAY_SUCCESS on success, DB_HANDLER_ERROR otherwise.
+ */
+gateway_error_t db_checkpoint(db_handle_t *db, int *wal_frames, int *checkpointed);
+
+/**
+ * Runs a range query over the stored readings of one sensor, or over its rollup rows.
+ * Rows are handed to fn one by one as SQLite steps, nothing is collected in memory.
+ * @param db The database handle (typically from db_connect_readonly()).
+ * @param id The sensor.
+ * @param from First timestamp of the range.
+ * @param to Last timestamp of the range.
+ * @param agg What to return.
+ * @param fn Called for each row; may stop the query.
+ * @param ctx Passed to fn.
+ * @param rows Receives the number of rows handed to fn (may be NULL).
+ * @return GATEWAY_SUCCESS on success (also when fn stopped it), DB_HANDLER_ERROR otherwise.
+ */
+gateway_error_t db_query_range(db_handle_t *db, sensor_id_t id, sensor_ts_t from, sensor_ts_t to,
+                               db_query_agg_t agg, db_query_fn fn, void *ctx, size_t *rows);
+
+/**
+ * Tells, for each of count rollup rows, whether a row of the same bucket is already stored.
+ * Only scope, key, period and start of the rows are compared.
+ * @param db The database handle (typically from db_connect_readonly()).
+ * @param rows The buckets to look up.
+ * @param count Number of rows.
+ * @param exists Receives, per row, whether the bucket has a stored row.
+ * @return GATEWAY_SUCCESS on success, DB_HANDLER_ERROR otherwise.
+ */
+gateway_error_t db_rollup_rows_exist(db_handle_t *db, const rollup_row_t *rows, size_t count, bool *exists);
 
 #endif /* DB_HANDLER_H */
\ No newline at end of file
@@ -0,0 +1,64 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config.h"  /* Required for DEDUP_WINDOW_READINGS */
+#include "common.h"  /* Required for sensor_data_t, gateway_error_t */
+
+/* Duplicate detection. A sensor's window remembers its last DEDUP_WINDOW_READINGS readings as
+ * (timestamp, value hash) pairs, 8 bytes each; a reading matching one of them is a duplicate,
+ * e.g. a reading a relay sent again after a reconnect. A reading newer than every remembered
+ * one is never a duplicate, so in-order streams only compare one timestamp. Readings of one
+ * sensor with the same timestamp and value are indistinguishable from duplicates and kept once.
+ * Windows start empty: a duplicate of a reading received before a restart is not detected.
+ * A window or table is used by a single thread. */
+
+#if DEDUP_WINDOW_READINGS > 0
+
+/* One remembered reading */
+typedef struct {
+    uint32_t ts;                 /* Low 32 bits of the timestamp */
+    uint32_t hash;               /* Hash of the value bits */
+} dedup_entry_t;
+
+/* Recent readings of one sensor, zero-initialized when empty */
+typedef struct {
+    sensor_ts_t newest;          /* Newest timestamp remembered */
+    uint32_t next;               /* Slot the next reading is remembered in */
+    uint32_t count;              /* Valid entries */
+    dedup_entry_t entries[DEDUP_WINDOW_READINGS];
+} dedup_window_t;
+
+/* Windows of every sensor, direct-indexed by the 16-bit sensor ID */
+typedef struct {
+    dedup_window_t **index;      /* NULL for a sensor not seen yet */
+} dedup_table_t;
+
+/**
+ * @brief Checks a reading against a window and remembers it unless it is a duplicate.
+ * @return true if the window already holds the reading.
+ */
+bool dedup_window_seen(dedup_window_t *window, sensor_ts_t ts, sensor_value_t value);
+
+/**
+ * @brief Allocates the index of an empty table; windows are allocated as sensors appear.
+ * @return GATEWAY_SUCCESS or GATEWAY_ERROR_NOMEM.
+ */
+gateway_error_t dedup_table_init(dedup_table_t *table);
+
+/**
+ * @brief Frees a table and its windows. Safe to call on one that failed to initialize.
+ */
+void dedup_table_free(dedup_table_t *table);
+
+/**
+ * @brief dedup_window_seen() with the window of the reading's sensor. A reading whose window
+ *        cannot be allocated is not a duplicate.
+ */
+bool dedup_table_seen(dedup_table_t *table, const sensor_data_t *reading);
+
+#endif /* DEDUP_WINDOW_READINGS > 0 */
+
+#endif /* DEDUP_H */
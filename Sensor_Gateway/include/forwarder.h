@@ -0,0 +1,35 @@
+#ifndef FORWARDER_H
+#define FORWARDER_H
+
+#include "sbuffer.h" /* Required for sbuffer_t */
+#include "common.h"  /* Required for gateway_error_t */
+
+/* Structure to pass arguments to the forwarder thread */
+typedef struct {
+    sbuffer_t *buffer;    /* Pointer to the shared buffer */
+    int reader_id;        /* Read cursor registered on the shared buffer */
+    const char *upstream; /* Gateway the readings go to, "host:port" */
+} forwarder_args_t;
+
+/**
+ * The main function of the forwarder thread.
+ * Reads every reading from the shared buffer and streams it to the upstream gateway in packed
+ * v2 frames over one persistent TCP connection (protocol.h). The upstream acknowledges what it
+ * accepted; up to FORWARDER_WINDOW_READINGS unacknowledged readings stay in memory and are sent
+ * again after a reconnection. Readings beyond them, and all readings while the upstream is
+ * unreachable, wait in the spill log in FORWARDER_SPILL_DIR, also across restarts. The thread
+ * never blocks on the network, so a slow or lost upstream does not hold up the shared buffer.
+ * Delivery is at least once: readings whose acknowledgement was lost arrive twice.
+ * @param arg A pointer to a forwarder_args_t struct.
+ * @return Always returns NULL.
+ */
+void *forwarder_run(void *arg);
+
+/**
+ * @brief Signals the forwarder thread to stop. It stops sending, moves the unacknowledged
+ * readings and whatever is left in the shared buffer to the spill log until the buffer is
+ * shut down, and exits. Returns at once.
+ */
+void forwarder_stop(void);
+
+#endif /* FORWARDER_H */
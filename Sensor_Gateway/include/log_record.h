@@ -0,0 +1,142 @@
+#ifndef LOG_RECORD_H
+#define LOG_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>   /* Required for va_list */
+#include <limits.h>   /* Required for PIPE_BUF */
+
+#include "common.h"   /* Required for gateway_error_t */
+
+/* Binary log records (LOG_BINARY builds).
+ * log_message() sends a record holding the address of its format string as the format ID,
+ * the level, a timestamp and the raw arguments; the text is produced later by the log process
+ * or by the log_decode tool. Before the first message with a format, each thread sends a
+ * format record mapping the ID to the format text, so a stream (or a stored file) can be
+ * decoded on its own. Records are self-delimiting (they start with their size), use the
+ * native byte order and are never aligned, so readers copy fields out with memcpy. */
+
+#define LOG_RECORD_HEADER_SIZE 20           /* size(2) type(1) level(1) format_id(8) time_us(8) */
+#define LOG_RECORD_MAX_SIZE (PIPE_BUF / 2)  /* Longer string arguments and texts are truncated */
+#define LOG_RECORD_MAX_ARGS 16              /* Formats with more arguments are sent as text */
+#define LOG_RECORD_FILE_MAGIC "GWBLOG1\n"   /* First 8 bytes of a stored binary log */
+
+typedef enum {
+    LOG_RECORD_MESSAGE = 1,  /* Format ID and encoded arguments */
+    LOG_RECORD_FORMAT = 2,   /* Format ID and the format text */
+    LOG_RECORD_TEXT = 3      /* Message already formatted by the sender */
+} log_record_type_t;
+
+/* Fixed part of a record, decoded */
+typedef struct {
+    uint16_t size;           /* Whole record, header included */
+    uint8_t type;            /* log_record_type_t */
+    uint8_t level;           /* log_level_t; unused for LOG_RECORD_FORMAT */
+    uint64_t format_id;      /* Unused for LOG_RECORD_TEXT */
+    int64_t time_us;         /* Wall clock of the sender, microseconds since the epoch */
+} log_record_header_t;
+
+/* Argument types of a format string, one character per va_arg() */
+typedef struct {
+    bool supported;          /* false if the format can't be encoded (%n, %ls, too many args) */
+    uint8_t count;           /* Arguments, '*' widths and precisions included */
+    char types[LOG_RECORD_MAX_ARGS];
+} log_signature_t;
+
+/* Format texts by ID, as learned from format records */
+typedef struct {
+    struct log_format_entry *entries;
+    size_t count;
+    size_t capacity;         /* Power of two, 0 until the first log_dict_add() */
+} log_dict_t;
+
+/**
+ * @brief Parses the conversions of a printf format.
+ * @param format The format string.
+ * @param signature Receives the argument types.
+ * @return signature->supported.
+ */
+bool log_signature_parse(const char *format, log_signature_t *signature);
+
+/**
+ * @brief Encodes a message record. The arguments are read with va_arg() as the signature says.
+ * @param buffer Receives the record; at least LOG_RECORD_MAX_SIZE bytes.
+ * @param level The log level.
+ * @param time_us The timestamp.
+ * @param format_id ID of the format.
+ * @param signature Signature of the format (supported).
+ * @param args The arguments.
+ * @return The record size.
+ */
+size_t log_record_encode(uint8_t *buffer, int level, int64_t time_us, uint64_t format_id,
+                         const log_signature_t *signature, va_list args);
+
+/**
+ * @brief Encodes a format record.
+ * @param buffer Receives the record; at least LOG_RECORD_MAX_SIZE bytes.
+ * @param format_id ID of the format.
+ * @param format The format text.
+ * @return The record size, 0 if the format is too long for a record.
+ */
+size_t log_record_encode_format(uint8_t *buffer, uint64_t format_id, const char *format);
+
+/**
+ * @brief Encodes a text record; text longer than a record allows is truncated.
+ * @param buffer Receives the record; at least LOG_RECORD_MAX_SIZE bytes.
+ * @param level The log level.
+ * @param time_us The timestamp.
+ * @param text The message.
+ * @param length Length of the message.
+ * @return The record size.
+ */
+size_t log_record_encode_text(uint8_t *buffer, int level, int64_t time_us, const char *text, size_t length);
+
+/**
+ * @brief Reads the header of the record at the start of a buffer.
+ * @param buffer The buffer.
+ * @param available Bytes in the buffer.
+ * @param header Receives the header.
+ * @return 1 if the whole record is in the buffer, 0 if more bytes are needed,
+ *         -1 if the bytes are not a record (the stream is corrupt).
+ */
+int log_record_peek(const uint8_t *buffer, size_t available, log_record_header_t *header);
+
+/**
+ * @brief Formats a message or text record as a log line (no newline):
+ *        "YYYY-MM-DD HH:MM:SS [LEVEL]  message", as text mode log_message() writes it.
+ * @param record The record (log_record_peek() returned 1).
+ * @param header Its header.
+ * @param dict Formats learned so far; a message of an unknown format is shown by ID.
+ * @param line Receives the line, always terminated.
+ * @param size Size of line.
+ * @return The line length.
+ */
+size_t log_record_render(const uint8_t *record, const log_record_header_t *header,
+                         const log_dict_t *dict, char *line, size_t size);
+
+/**
+ * @brief Returns the bracketed, padded tag of a level, e.g. "[INFO]   ".
+ */
+const char *log_record_level_tag(int level);
+
+/**
+ * @brief Initializes an empty dictionary.
+ */
+void log_dict_init(log_dict_t *dict);
+
+/**
+ * @brief Learns the format of a format record, replacing an earlier one with the same ID.
+ * @param dict The dictionary.
+ * @param record The record.
+ * @param header Its header (type LOG_RECORD_FORMAT).
+ * @return GATEWAY_SUCCESS or GATEWAY_ERROR_NOMEM.
+ */
+gateway_error_t log_dict_add(log_dict_t *dict, const uint8_t *record, const log_record_header_t *header);
+
+/**
+ * @brief Frees the formats of a dictionary.
+ */
+void log_dict_free(log_dict_t *dict);
+
+#endif /* LOG_RECORD_H */
@@ -0,0 +1,72 @@
+#ifndef LOG_SHM_H
+#define LOG_SHM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <limits.h>      /* Required for PIPE_BUF */
+#include <sys/types.h>
+
+#include "common.h"  /* Required for gateway_error_t */
+
+/* Shared memory channel from the gateway threads to the log process.
+ * An anonymous MAP_SHARED region, mapped before the log process is forked, holds a ring of
+ * LOG_SHM_SLOTS fixed-size slots. Any thread of the gateway appends a message by claiming
+ * consecutive slots with a compare-and-swap on the ring's position and publishing each slot
+ * through its sequence number; the log process copies published messages out in ring order.
+ * A message takes as many slots as its length needs. The log process sleeps on an eventfd
+ * doorbell, which a writer only rings after the log process announced that it is going to
+ * sleep, so sending a message normally makes no system call. */
+
+/* Longest message, the same limit as a single write to the FIFO */
+#define LOG_SHM_MAX_MESSAGE PIPE_BUF
+
+/**
+ * @brief Maps the ring and creates its doorbell. Must be called before fork().
+ * @return GATEWAY_SUCCESS, or LOGGER_ERROR if the region or the eventfd could not be had
+ *         (errno is kept); the caller then uses the FIFO.
+ */
+gateway_error_t log_shm_create(void);
+
+/**
+ * @brief Tells whether log_shm_create() succeeded (in this process or before the fork).
+ */
+bool log_shm_available(void);
+
+/**
+ * @brief Appends one message. Thread-safe, lock-free, no system call unless the log process sleeps.
+ * @param message The message, at most LOG_SHM_MAX_MESSAGE bytes.
+ * @param len Its length.
+ * @return false if the ring has no room for it (or it is too long); nothing was copied.
+ */
+bool log_shm_send(const void *message, size_t len);
+
+/**
+ * @brief Tells the log process that no more messages come, once it has read those sent.
+ *        Called by the gateway when the logger shuts down.
+ */
+void log_shm_close_writer(void);
+
+/**
+ * @brief Waits until messages can be read, the writer closed, or timeout_ms passed.
+ *        Log process only. While waiting indefinitely (timeout_ms -1) it also notices a
+ *        gateway that died without closing, and then treats the channel as closed.
+ * @return 1 if log_shm_read() has something to report, 0 on timeout.
+ */
+int log_shm_wait(int timeout_ms);
+
+/**
+ * @brief Copies whole messages, oldest first, into buffer. Log process only.
+ *        The messages are concatenated the way they would arrive from the FIFO.
+ * @param buffer Receives the messages.
+ * @param size Its capacity; at least LOG_SHM_MAX_MESSAGE bytes.
+ * @return The bytes copied, 0 once the writer closed and every message was read,
+ *         or -1 with errno EAGAIN if there is nothing to read yet.
+ */
+ssize_t log_shm_read(void *buffer, size_t size);
+
+/**
+ * @brief Unmaps the ring and closes the doorbell of the calling process.
+ */
+void log_shm_destroy(void);
+
+#endif /* LOG_SHM_H */
@@ -3,6 +3,7 @@
 
 #include <stdbool.h> /* Required for bool type */
 #include "common.h"  /* Required for gateway_error_t */
+#include "config.h"  /* Required for LOG_COMPILE_LEVEL */
 #include <stdarg.h> /* Required for va_list */
 
 /* Define Log Levels */
@@ -14,20 +15,63 @@ typedef enum {
     LOG_LEVEL_DEBUG      // Detailed debug information
 } log_level_t;
 
+/* Message counters of the logger, by log_level_t */
+typedef struct {
+    unsigned long sent[LOG_LEVEL_DEBUG + 1];    /* Handed to the flusher */
+    unsigned long dropped[LOG_LEVEL_DEBUG + 1]; /* Lost because the thread's ring stayed full */
+    unsigned long delayed[LOG_LEVEL_DEBUG + 1]; /* Sent after the thread waited for ring space */
+    unsigned long fifo_stalls;                  /* Times the FIFO was full (log process behind) */
+    unsigned long fifo_stall_us;                /* Time the flusher waited for it */
+} logger_stats_t;
+
+/* Most verbose level log_message() formats, set by logger_set_level() */
+extern int logger_level;
+
+/**
+ * Logs through log_message() when level is built in (LOG_COMPILE_LEVEL) and enabled at
+ * runtime (logger_set_level()). Both checks come before the arguments are evaluated,
+ * so a compiled-out call costs nothing and a disabled one a single load.
+ */
+#define LOG_AT(level, ...) \
+    do { \
+        if ((int)(level) <= LOG_COMPILE_LEVEL && \
+            (int)(level) <= __atomic_load_n(&logger_level, __ATOMIC_RELAXED)) { \
+            log_message((level), __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_FATAL(...)   LOG_AT(LOG_LEVEL_FATAL, __VA_ARGS__)
+#define LOG_ERROR(...)   LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT(LOG_LEVEL_WARNING, __VA_ARGS__)
+#define LOG_INFO(...)    LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...)   LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
 /**
  * Initializes the logging system.
- * This might involve creating/opening the FIFO.
- * Should be called appropriately by the main process and potentially the log process.
+ * This maps the shared memory ring to the log process (LOG_SHM), or creates the FIFO.
+ * Must be called by the main process before it forks the log process.
  * @return GATEWAY_SUCCESS on success, an error code otherwise (e.g., LOGGER_FIFO_CREATE_ERR).
  */
 gateway_error_t logger_init(void);
 
 /**
- * Opens the FIFO for writing. Called by the main process AFTER fork().
+ * Opens the FIFO for writing, or starts writing to the shared memory ring.
+ * Called by the main process AFTER fork().
  * @return GATEWAY_SUCCESS on success, LOGGER_FIFO_OPEN_ERR otherwise.
  */
 gateway_error_t logger_open_write_fifo(void);
 
+/**
+ * Returns how messages reach the log process, "shared memory" or "FIFO".
+ */
+const char *logger_transport_name(void);
+
+/**
+ * Tells whether log_message() reaches the log process yet: false before logger_open_write_fifo()
+ * succeeded and after logger_cleanup(). Code that also runs at startup logs to stderr until then.
+ */
+bool logger_is_open(void);
+
 /**
  * @brief Logs a formatted message with a specific log level to the FIFO.
  * This function is thread-safe.
@@ -38,6 +82,39 @@ gateway_error_t logger_open_write_fifo(void);
  */
  void log_message(log_level_t level, const char *format, ...);
 
+/**
+ * Sets the most verbose level that is logged from now on; more verbose messages are
+ * discarded before any formatting. Levels above LOG_COMPILE_LEVEL stay compiled out
+ * for the LOG_*() macros. Thread-safe.
+ * @param level The new level.
+ */
+void logger_set_level(log_level_t level);
+
+/**
+ * Returns the level set by logger_set_level() (LOG_RUNTIME_LEVEL at startup).
+ */
+log_level_t logger_get_level(void);
+
+/**
+ * Looks up a level by its name ("fatal", "error", "warning", "info" or "debug").
+ * @param name The name.
+ * @param level Receives the level.
+ * @return true if the name is known.
+ */
+bool logger_parse_level(const char *name, log_level_t *level);
+
+/**
+ * Reads the message counters; they are also logged every LOG_STATS_INTERVAL_SEC when
+ * anything was dropped or delayed. Thread-safe.
+ * @param stats Receives the counters.
+ */
+void logger_get_stats(logger_stats_t *stats);
+
+/**
+ * Returns the lower case name of a level, as accepted by logger_parse_level().
+ */
+const char *logger_level_name(log_level_t level);
+
 /**
  * Cleans up logging resources.
  * This might involve closing any open file descriptors (like the FIFO write end).
@@ -46,7 +123,7 @@ void logger_cleanup(void);
 
 /**
  * The main function for the dedicated log process.
- * Reads log messages from the FIFO and writes them to the log file.
+ * Reads log messages from the shared memory ring or the FIFO and writes them to the log file.
  * This function runs indefinitely until an error occurs or termination is signaled.
  */
 void run_log_process(void);
@@ -0,0 +1,150 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "common.h"   /* Required for sensor_data_t */
+
+/* Process wide counters, gauges and histograms, exported in the Prometheus text format.
+ * Counters and histograms are kept in per-thread shards: the hot paths only ever do relaxed
+ * stores to their own cache lines, and an export sums the shards of every thread. Gauges are
+ * single atomics, or a function sampled at export time. */
+
+/* Counters (monotonic) */
+typedef enum {
+    METRIC_CONN_ACCEPTS = 0,     /* TCP connections accepted */
+    METRIC_CONN_BYTES,           /* Bytes received from sensors, TCP and UDP */
+    METRIC_CONN_FRAMES,          /* Readings decoded */
+    METRIC_CONN_PARSE_ERRORS,    /* Malformed frames (TCP) and datagrams (UDP) */
+    METRIC_DATAMGT_READINGS,     /* Readings processed by the data manager */
+    METRIC_DATAMGT_DUPLICATES,   /* Duplicate readings the data manager skipped */
+    METRIC_DATAMGT_UNTRACKED,    /* Readings dropped because the stats pool had no entry left for their sensor */
+    METRIC_ALERTS_LOGGED,        /* Alert and alert summary lines logged by the data manager */
+    METRIC_ALERTS_SUPPRESSED,    /* Alerts held back by the alert interval or rate limit */
+    METRIC_STORAGE_READINGS,     /* Readings committed to the database */
+    METRIC_STORAGE_DUPLICATES,   /* Duplicate readings the storage manager dropped */
+    METRIC_STORAGE_LATE,         /* Readings committed out of timestamp order, later than the reorder bound */
+    METRIC_STORAGE_REFUSED,      /* Readings refused for a timestamp outside the partitions kept */
+    METRIC_FORWARD_SENT,         /* Readings sent to the upstream gateway, resends included */
+    METRIC_FORWARD_ACKED,        /* Readings the upstream gateway acknowledged */
+    METRIC_COUNTERS
+} metric_counter_t;
+
+/* Gauges (current values) */
+typedef enum {
+    METRIC_CONN_ACTIVE = 0,      /* Open TCP connections */
+    METRIC_SBUFFER_DEPTH,        /* Readings queued in the shared buffer */
+    METRIC_STORAGE_RETRY_DEPTH,  /* Readings waiting in the retry queue and the spill log */
+    METRIC_FORWARD_BACKLOG,      /* Readings not acknowledged by the upstream gateway yet */
+    METRIC_GAUGES
+} metric_gauge_t;
+
+/* Histograms of unsigned values */
+typedef enum {
+    METRIC_SBUFFER_WAIT_US = 0,  /* Time an insert waited for room, microseconds */
+    METRIC_STORAGE_COMMIT_US,    /* Time of a database transaction, microseconds */
+    METRIC_STORAGE_BATCH_SIZE,   /* Readings per transaction */
+    METRIC_LATENCY_DEQUEUE_US,   /* Receipt to removal from the shared buffer, microseconds */
+    METRIC_LATENCY_PROCESSED_US, /* Receipt to processed by the data manager, microseconds */
+    METRIC_LATENCY_COMMITTED_US, /* Receipt to committed to the database, microseconds */
+    METRIC_HISTOGRAMS
+} metric_histogram_t;
+
+/* Histogram buckets are log-linear: values below 8 have a bucket each, every power of two
+ * above is split into 8 buckets, so a bucket is at most 12.5% wide. Values of 2^METRIC_HIST_MAX_BITS
+ * and more share the last bucket. */
+#define METRIC_HIST_SUB_BUCKETS 8
+#define METRIC_HIST_MAX_BITS 40
+#define METRIC_HIST_BUCKETS ((METRIC_HIST_MAX_BITS - 2) * METRIC_HIST_SUB_BUCKETS)
+
+/* Receives the exported text, line by line */
+typedef void (*metrics_write_fn)(const char *text, size_t len, void *ctx);
+
+/* Returns the current value of a sampled gauge */
+typedef long (*metrics_gauge_fn)(void *ctx);
+
+/**
+ * @brief Adds to a counter of the calling thread's shard.
+ */
+void metrics_add(metric_counter_t counter, uint64_t value);
+
+/** @brief Adds one to a counter. */
+static inline void metrics_inc(metric_counter_t counter) {
+    metrics_add(counter, 1);
+}
+
+/**
+ * @brief Sums a counter over the shards of every thread.
+ */
+uint64_t metrics_counter_total(metric_counter_t counter);
+
+/**
+ * @brief Sets a gauge.
+ */
+void metrics_gauge_set(metric_gauge_t gauge, long value);
+
+/**
+ * @brief Makes a gauge sampled at export time instead; pass NULL to go back to metrics_gauge_set().
+ * @param gauge The gauge.
+ * @param fn Returns the value; called from the exporting thread.
+ * @param ctx Passed to fn.
+ */
+void metrics_gauge_source(metric_gauge_t gauge, metrics_gauge_fn fn, void *ctx);
+
+/**
+ * @brief Records a value in a histogram of the calling thread's shard.
+ */
+void metrics_observe(metric_histogram_t histogram, uint64_t value);
+
+/**
+ * @brief Returns the ingest stamp for readings received now (sensor_data_t.ingest_us).
+ * Stamps wrap every 71 minutes, ages are computed modulo 2^32.
+ */
+static inline uint32_t metrics_ingest_stamp(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint32_t stamp = (uint32_t)((uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u);
+    return stamp != 0 ? stamp : 1; /* 0 means not stamped */
+}
+
+/**
+ * @brief Records the age of every stamped reading in a histogram, reading the clock once.
+ * @param histogram One of the METRIC_LATENCY_* histograms.
+ * @param readings The readings; those with ingest_us 0 are skipped.
+ * @param count Number of readings.
+ */
+void metrics_observe_latency(metric_histogram_t histogram, const sensor_data_t *readings, size_t count);
+
+/**
+ * @brief Estimates a quantile of a histogram from its buckets.
+ * @param histogram The histogram.
+ * @param quantile Between 0 and 1, e.g. 0.99.
+ * @param count Receives the number of values recorded (may be NULL).
+ * @return The upper bound of the bucket holding the quantile (at most 12.5% above the
+ *         exact value), 0 if the histogram is empty.
+ */
+uint64_t metrics_quantile(metric_histogram_t histogram, double quantile, uint64_t *count);
+
+/**
+ * @brief Writes every metric in the Prometheus text exposition format.
+ * @param writer Receives the text, one line at a time.
+ * @param ctx Passed to writer.
+ */
+void metrics_export(metrics_write_fn writer, void *ctx);
+
+/**
+ * @brief Main function of the metrics HTTP thread: answers every request on
+ *        METRICS_HTTP_PORT with the output of metrics_export().
+ * @param arg Unused.
+ * @return Always returns NULL.
+ */
+void *metrics_http_run(void *arg);
+
+/**
+ * @brief Signals the metrics HTTP thread to stop and unblocks its accept().
+ */
+void metrics_http_stop(void);
+
+#endif /* METRICS_H */
@@ -0,0 +1,64 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+#include "common.h"  /* Required for gateway_error_t */
+
+/* Fixed-size object pools. Each pool reserves room for all of its objects when it is created
+ * and never grows, so memory use is bounded and the heap is not fragmented by churn. Threads
+ * keep a few free objects of each pool in a cache of their own and move them to and from the
+ * shared free list in batches, so most pool_alloc()/pool_free() calls take no lock. Any
+ * thread may free an object, whichever thread allocated it. */
+
+/* Pools alive at once */
+#define POOL_MAX_POOLS 8
+
+/* An object pool (opaque) */
+typedef struct pool pool_t;
+
+/* Usage of a pool, for the 'memory' command */
+typedef struct {
+    char name[24];               /* Name given to pool_create() */
+    size_t object_size;          /* Bytes per object, rounded up for alignment */
+    size_t capacity;             /* Objects reserved */
+    size_t in_use;               /* Objects allocated now */
+    size_t peak;                 /* Highest in_use so far */
+    unsigned long failures;      /* pool_alloc() calls that found the pool exhausted */
+} pool_stats_t;
+
+/**
+ * @brief Creates a pool and reserves memory for all of its objects.
+ * @param pool Receives the pool.
+ * @param name Shown by pool_get_stats().
+ * @param object_size Bytes per object.
+ * @param capacity Number of objects.
+ * @return GATEWAY_SUCCESS, GATEWAY_ERROR_NOMEM, or GATEWAY_ERROR if POOL_MAX_POOLS pools exist.
+ */
+gateway_error_t pool_create(pool_t **pool, const char *name, size_t object_size, size_t capacity);
+
+/**
+ * @brief Releases a pool and all of its objects, allocated or not. Safe to call with *pool NULL.
+ */
+void pool_destroy(pool_t **pool);
+
+/**
+ * @brief Takes an object (contents undefined).
+ * @return The object, or NULL if all capacity objects are in use.
+ */
+void *pool_alloc(pool_t *pool);
+
+/**
+ * @brief Returns an object taken from the same pool. NULL is ignored.
+ */
+void pool_free(pool_t *pool, void *object);
+
+/**
+ * @brief Reports every pool alive.
+ * @param stats Receives one entry per pool.
+ * @param max_count Size of stats.
+ * @return The number of entries stored.
+ */
+int pool_get_stats(pool_stats_t *stats, int max_count);
+
+#endif /* POOL_H */
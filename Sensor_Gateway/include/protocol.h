@@ -0,0 +1,93 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common.h"  /* Required for sensor_data_t, gateway_error_t */
+
+/* --- Wire Format --- */
+
+/* Legacy (v1) frame: uint16 sensor id (network order) followed by the value as a raw double.
+ * The reading is timestamped by the gateway on arrival. */
+#define PROTOCOL_LEGACY_FRAME_SIZE (sizeof(uint16_t) + sizeof(double))
+
+/* Batched (v2) frame, all fields big-endian:
+ *   uint8  magic   PROTOCOL_V2_MAGIC
+ *   uint8  version PROTOCOL_V2_VERSION
+ *   uint16 count   number of records (1..PROTOCOL_V2_MAX_RECORDS)
+ *   count records of { uint16 sensor id, int64 device timestamp (s), uint64 IEEE-754 value bits }
+ * A stream speaks v2 if its very first byte is the magic, legacy sensor ids 0xA500-0xA5FF
+ * therefore cannot open a connection. A device timestamp of 0 means "use the arrival time". */
+#define PROTOCOL_V2_MAGIC 0xA5
+#define PROTOCOL_V2_VERSION 2
+#define PROTOCOL_V2_HEADER_SIZE 4
+#define PROTOCOL_V2_RECORD_SIZE (sizeof(uint16_t) + sizeof(int64_t) + sizeof(uint64_t))
+#define PROTOCOL_V2_MAX_RECORDS 64
+
+/* Packed v2 frame, for streams between gateways. Same magic, version PROTOCOL_V2_PACKED_VERSION:
+ *   uint8  magic, uint8 version, uint16 count (1..PROTOCOL_V2_MAX_RECORDS), uint16 payload bytes
+ *   count records of { varint zigzag(id - previous id), varint zigzag(ts - previous ts),
+ *                      value bits XOR previous bits as one byte (leading zero bytes << 4 |
+ *                      trailing zero bytes) followed by the bytes between them, most significant first }
+ * Varints are little-endian base 128. The previous record of the first one is all zero, so each
+ * frame decodes on its own. Readings of one room in time order take about half the v2 size.
+ * Both kinds of frames may be mixed on a v2 stream. */
+#define PROTOCOL_V2_PACKED_VERSION 3
+#define PROTOCOL_V2_PACKED_HEADER_SIZE 6
+#define PROTOCOL_V2_PACKED_MAX_RECORD_SIZE (3 + 10 + 9) /* Largest varint id, varint ts and value */
+#define PROTOCOL_V2_PACKED_MAX_SIZE (PROTOCOL_V2_PACKED_HEADER_SIZE + PROTOCOL_V2_MAX_RECORDS * PROTOCOL_V2_PACKED_MAX_RECORD_SIZE)
+
+/* Fewest bytes a reading takes in a stream (a packed record repeating its predecessor) */
+#define PROTOCOL_MIN_READING_SIZE 3
+
+/* Acknowledgements: a v2 frame with a count of 0 asks the gateway to acknowledge the stream.
+ * From then on it answers every block of received frames with the number of readings of the
+ * stream it has accepted into its shared buffer so far, as a big-endian uint64. Gateways
+ * without acknowledgements close the stream at the empty frame. */
+#define PROTOCOL_ACK_SIZE sizeof(uint64_t)
+
+/* Largest number of bytes a stream can be left holding of an incomplete frame (a packed frame
+ * of incompressible records is the largest frame) */
+#define PROTOCOL_MAX_FRAME_SIZE PROTOCOL_V2_PACKED_MAX_SIZE
+
+/* Per-stream decoder state */
+typedef struct {
+    uint8_t version; /* 0 until the first byte arrived, then 1 (legacy) or PROTOCOL_V2_VERSION */
+    bool acked;      /* The peer asked for acknowledgements */
+} protocol_stream_t;
+
+/* --- Decoding --- */
+
+/**
+ * Decodes every complete frame at the start of a block of received bytes.
+ * The first byte of a stream selects its protocol version. Trailing bytes of an
+ * incomplete frame are not consumed, the caller keeps them and prepends them to
+ * the next block read from the same stream.
+ * @param stream Decoder state of the stream, zero-initialized for a new stream (or datagram).
+ * @param data The received bytes.
+ * @param len Number of bytes in data.
+ * @param now Timestamp given to readings whose frame does not carry one.
+ * @param out Array receiving the decoded readings.
+ * @param max_out Capacity of out, decoding stops before a frame whose readings do not fit.
+ * @param consumed Where the number of bytes consumed from data is stored.
+ * @param decoded Where the number of readings written to out is stored.
+ * @return GATEWAY_SUCCESS, or CONNMGR_PROTOCOL_ERR if the stream holds a malformed frame
+ * (consumed and decoded still describe the frames before it).
+ */
+gateway_error_t protocol_decode(protocol_stream_t *stream, const uint8_t *data, size_t len, sensor_ts_t now,
+                                sensor_data_t *out, size_t max_out, size_t *consumed, size_t *decoded);
+
+/* --- Encoding --- */
+
+/**
+ * Encodes readings as one packed v2 frame.
+ * @param readings The readings, at most PROTOCOL_V2_MAX_RECORDS (more are not encoded).
+ * @param count Number of readings, at least 1.
+ * @param out Receives the frame, at least PROTOCOL_V2_PACKED_MAX_SIZE bytes.
+ * @return The frame size in bytes.
+ */
+size_t protocol_encode_packed(const sensor_data_t *readings, size_t count, uint8_t *out);
+
+#endif /* PROTOCOL_H */
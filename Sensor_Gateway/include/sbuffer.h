@@ -2,30 +2,104 @@
 #define SBUFFER_H
 
 #include <pthread.h> /* Required for pthread types */
+#include <stddef.h>  /* Required for size_t */
 #include "common.h"  /* Required for sensor_data_t and gateway_error_t */
 #include "config.h"  /* Required for SBUFFER_SIZE */
 
-/* * Structure definition for the shared buffer (circular buffer).
+/* Snapshot of buffer sizing counters, used to tune the buffer size from real data */
+typedef struct {
+    size_t capacity;                    /* Current number of slots */
+    size_t max_capacity;                /* Limit the buffer may grow to under backpressure */
+    size_t count;                       /* Elements not yet read by the slowest reader */
+    size_t high_watermark;              /* Highest count observed since init */
+    unsigned long blocked_inserts;      /* Number of inserts that had to wait for space */
+    unsigned long long blocked_time_us; /* Total time producers spent waiting for space */
+    unsigned long grow_events;          /* Number of times the buffer was enlarged */
+} sbuffer_stats_t;
+
+/* Maximum number of consumers that can register a read cursor on one buffer */
+#define SBUFFER_MAX_READERS 4
+
+#ifdef SBUFFER_LOCKFREE
+
+#include <stdatomic.h> /* Required for atomic cursors */
+
+/* Cache line size used to keep cursors written by different threads apart */
+#define SBUFFER_CACHE_LINE 64
+
+/* One slot of the lock-free ring: data plus the sequence number it was published with */
+typedef struct {
+    atomic_ulong seq;                   /* (position + 1) of the element stored here, 0 if never written */
+    sensor_data_t data;                 /* The stored element */
+} sbuffer_slot_t;
+
+/* Per-reader cursor, padded so readers do not share a cache line */
+typedef struct {
+    _Alignas(SBUFFER_CACHE_LINE) atomic_ulong pos; /* Position of the next element to read */
+} sbuffer_cursor_t;
+
+/* * Structure definition for the shared buffer (lock-free multi-reader ring).
+ * Selected at build time with SBUFFER_BACKEND=lockfree (defines SBUFFER_LOCKFREE).
+ * Producers claim positions with an atomic counter, readers advance their own cursor.
+ * The ring size is the requested capacity rounded up to a power of two and never grows.
+ * Threads only sleep on a futex when a reader finds the ring empty (or a producer finds it full).
+ */
+typedef struct {
+    sbuffer_slot_t *slots;              /* Ring storage (capacity elements) */
+    unsigned long capacity;             /* Number of slots, always a power of two */
+    unsigned long mask;                 /* capacity - 1, for cheap index computation */
+    _Alignas(SBUFFER_CACHE_LINE) atomic_ulong head; /* Next position to be claimed by a producer */
+    sbuffer_cursor_t read_pos[SBUFFER_MAX_READERS]; /* Per-reader cursors */
+    atomic_int num_readers;             /* Number of registered readers */
+    atomic_ulong high_watermark;        /* Highest occupancy seen by a producer */
+    atomic_ulong blocked_inserts;       /* Inserts that had to wait for space */
+    atomic_ullong blocked_time_us;      /* Total time producers spent waiting for space */
+    _Alignas(SBUFFER_CACHE_LINE) atomic_uint data_seq; /* Futex word bumped when data is published to sleeping readers */
+    atomic_uint data_waiters;           /* Number of readers sleeping on data_seq */
+    _Alignas(SBUFFER_CACHE_LINE) atomic_uint space_seq; /* Futex word bumped when slots are freed for sleeping producers */
+    atomic_uint space_waiters;          /* Number of producers sleeping on space_seq */
+    atomic_bool shutdown_flag;          /* Flag to indicate if shutdown is requested */
+} sbuffer_t;
+
+#else /* Default mutex/condvar backend */
+
+/* * Structure definition for the shared buffer (multi-reader circular buffer).
+ * Every element is stored once; each registered reader owns its own read cursor.
+ * A slot is only reused once the slowest reader has moved past it.
+ * Cursors are monotonically increasing sequence numbers, slot index = seq % capacity.
+ * The capacity is chosen at init time and may grow up to max_capacity when a producer would block.
  * Uses mutex and condition variables for thread safety.
  */
 typedef struct {
-    sensor_data_t buffer[SBUFFER_SIZE]; /* The actual buffer storage */
-    int head;                           /* Index where the next element will be inserted */
-    int tail;                           /* Index from where the next element will be removed */
-    int count;                          /* Number of elements currently in the buffer */
+    sensor_data_t *buffer;              /* The actual buffer storage (capacity elements) */
+    size_t capacity;                    /* Current number of slots */
+    size_t max_capacity;                /* Growth limit (== capacity when growth is disabled) */
+    unsigned long head;                 /* Sequence number of the next element to be inserted */
+    unsigned long tail;                 /* Sequence number of the oldest element still unread by some reader */
+    unsigned long read_pos[SBUFFER_MAX_READERS]; /* Per-reader sequence number of the next element to read */
+    int num_readers;                    /* Number of registered readers */
+    size_t high_watermark;              /* Highest number of elements held at once */
+    unsigned long blocked_inserts;      /* Inserts that had to wait for space */
+    unsigned long long blocked_time_us; /* Total time producers spent waiting for space */
+    unsigned long grow_events;          /* Number of times the storage was enlarged */
     pthread_mutex_t mutex;              /* Mutex to protect access to buffer fields */
     pthread_cond_t not_full;            /* Condition variable signaled when buffer is not full */
     pthread_cond_t not_empty;           /* Condition variable signaled when buffer is not empty */
     bool shutdown_flag;                 /* Flag to indicate if shutdown is requested */
 } sbuffer_t;
 
+#endif /* SBUFFER_LOCKFREE */
+
 /**
  * Allocates and initializes a shared buffer.
  * @param buffer A pointer to the pointer of the buffer struct to be initialized.
  * The function will allocate memory for the buffer struct.
+ * @param capacity Number of elements the buffer holds initially (0 selects SBUFFER_SIZE).
+ * @param max_capacity Limit the buffer may grow to when a producer would block,
+ * or 0 (or anything <= capacity) to disable growth. The lock-free backend never grows.
  * @return GATEWAY_SUCCESS on success, an error code otherwise (e.g., GATEWAY_ERROR_NOMEM, THREAD_MUTEX_INIT_ERR, THREAD_COND_INIT_ERR).
  */
-gateway_error_t sbuffer_init(sbuffer_t **buffer);
+gateway_error_t sbuffer_init(sbuffer_t **buffer, size_t capacity, size_t max_capacity);
 
 /**
  * Deallocates the shared buffer and destroys associated mutex and condition variables.
@@ -46,14 +120,77 @@ gateway_error_t sbuffer_free(sbuffer_t **buffer);
 gateway_error_t sbuffer_insert(sbuffer_t *buffer, const sensor_data_t *data);
 
 /**
- * Removes sensor data from the shared buffer.
- * Blocks if the buffer is empty until data becomes available.
+ * Registers a new reader (consumer) on the shared buffer.
+ * The reader's cursor starts at the current head, so it sees every element inserted afterwards.
+ * Readers should be registered before producers start, otherwise early elements are missed.
  * This function is thread-safe.
  * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id A pointer where the id of the new reader will be stored.
+ * @return GATEWAY_SUCCESS on success, SBUFFER_ERROR if SBUFFER_MAX_READERS is reached.
+ */
+gateway_error_t sbuffer_register_reader(sbuffer_t *buffer, int *reader_id);
+
+/**
+ * Reads the next unread sensor data for the given reader.
+ * Blocks if the reader has consumed everything until new data becomes available.
+ * The slot is released only once all registered readers have read it.
+ * This function is thread-safe.
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id The id returned by sbuffer_register_reader().
  * @param data A pointer to a sensor_data_t struct where the removed data will be copied.
  * @return GATEWAY_SUCCESS on success, an error code otherwise.
  */
-gateway_error_t sbuffer_remove(sbuffer_t *buffer, sensor_data_t *data);
+gateway_error_t sbuffer_remove(sbuffer_t *buffer, int reader_id, sensor_data_t *data);
+
+/**
+ * Inserts several sensor data elements into the shared buffer at once.
+ * Takes the lock (or claims ring positions) and wakes readers once per chunk that fits,
+ * instead of once per element. Blocks while the buffer is full.
+ * This function is thread-safe. Elements of one batch stay contiguous for every reader.
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param data A pointer to an array of count sensor_data_t elements to insert.
+ * @param count Number of elements in data.
+ * @return GATEWAY_SUCCESS when all elements were inserted, an error code otherwise
+ * (SBUFFER_SHUTDOWN if shutdown interrupted the batch).
+ */
+gateway_error_t sbuffer_insert_batch(sbuffer_t *buffer, const sensor_data_t *data, size_t count);
+
+/**
+ * Reads up to max_count unread elements for the given reader at once.
+ * Blocks until at least one element is available, then returns everything
+ * available (bounded by max_count) with a single lock acquisition and wakeup.
+ * This function is thread-safe.
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id The id returned by sbuffer_register_reader().
+ * @param data A pointer to an array of at least max_count elements receiving the data.
+ * @param max_count Capacity of the data array (must be > 0).
+ * @param removed A pointer where the number of elements copied will be stored.
+ * @return GATEWAY_SUCCESS on success, an error code otherwise.
+ */
+gateway_error_t sbuffer_remove_batch(sbuffer_t *buffer, int reader_id, sensor_data_t *data,
+                                     size_t max_count, size_t *removed);
+
+/**
+ * Reads up to max_count unread elements like sbuffer_remove_batch(), but waits
+ * at most timeout_ms milliseconds for the first one. This function is thread-safe.
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id The id returned by sbuffer_register_reader().
+ * @param data A pointer to an array of at least max_count elements receiving the data.
+ * @param max_count Capacity of the data array (must be > 0).
+ * @param removed A pointer where the number of elements copied will be stored (0 on timeout).
+ * @param timeout_ms Maximum wait in milliseconds; 0 only takes what is already available.
+ * @return GATEWAY_SUCCESS on success, SBUFFER_EMPTY on timeout, SBUFFER_SHUTDOWN once
+ * shutdown was signalled and nothing is left to read, another error code otherwise.
+ */
+gateway_error_t sbuffer_remove_batch_timed(sbuffer_t *buffer, int reader_id, sensor_data_t *data,
+                                           size_t max_count, size_t *removed, unsigned int timeout_ms);
+
+/**
+ * Copies the current sizing counters of the buffer. Thread-safe.
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param stats A pointer to the struct receiving the snapshot.
+ */
+void sbuffer_get_stats(sbuffer_t *buffer, sbuffer_stats_t *stats);
 
 /**
  * @brief Signals all threads waiting on the buffer to wake up for shutdown.
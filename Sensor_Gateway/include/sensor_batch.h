@@ -0,0 +1,70 @@
+#ifndef SENSOR_BATCH_H
+#define SENSOR_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"  /* Required for sensor_data_t */
+
+/* Readings of one batch as separate arrays (struct of arrays), so the kernels below load four
+ * values or timestamps per vector instruction instead of picking them out of 24-byte readings.
+ * The kernels use AVX2 where the CPU has it (checked at run time), NEON on 64-bit ARM, and
+ * plain loops otherwise, or everywhere with SENSOR_BATCH_SIMD set to 0. They give the same
+ * results on every path. */
+
+/* Readings a batch holds; also the width of the classification masks */
+#define SENSOR_BATCH_CAPACITY 64
+
+typedef struct {
+    size_t count;                                                     /* Valid entries */
+    sensor_id_t ids[SENSOR_BATCH_CAPACITY] __attribute__((aligned(32)));
+    sensor_value_t values[SENSOR_BATCH_CAPACITY] __attribute__((aligned(32)));
+    sensor_ts_t ts[SENSOR_BATCH_CAPACITY] __attribute__((aligned(32)));
+} sensor_batch_t;
+
+/**
+ * @brief Fills a batch from readings (ingest_us is not kept).
+ * @param batch The batch.
+ * @param readings The readings.
+ * @param count Number of readings, at most SENSOR_BATCH_CAPACITY (more are ignored).
+ */
+void sensor_batch_load(sensor_batch_t *batch, const sensor_data_t *readings, size_t count);
+
+/**
+ * @brief Compares each value against its own two thresholds. Bit i of the masks describes
+ *        values[i]; a NaN is in neither mask.
+ * @param values The values.
+ * @param lows Values below their low set their bit in below.
+ * @param highs Values above their high set their bit in above.
+ * @param count Number of values, at most SENSOR_BATCH_CAPACITY.
+ * @param below Receives the mask of values[i] < lows[i].
+ * @param above Receives the mask of values[i] > highs[i].
+ */
+void sensor_batch_classify(const double *values, const double *lows, const double *highs, size_t count,
+                           uint64_t *below, uint64_t *above);
+
+/**
+ * @brief Finds the values further from their center than their limit. An infinite or NaN
+ *        limit never matches.
+ * @param values The values.
+ * @param centers The center of each value.
+ * @param limits The largest allowed |values[i] - centers[i]|.
+ * @param count Number of values, at most SENSOR_BATCH_CAPACITY.
+ * @return The mask of values with |values[i] - centers[i]| > limits[i].
+ */
+uint64_t sensor_batch_deviates(const double *values, const double *centers, const double *limits, size_t count);
+
+/**
+ * @brief Returns the newest of some timestamps.
+ * @param ts The timestamps.
+ * @param count Number of timestamps.
+ * @param floor Returned if it is newer than all of them (or count is 0).
+ */
+sensor_ts_t sensor_batch_max_ts(const sensor_ts_t *ts, size_t count, sensor_ts_t floor);
+
+/**
+ * @brief Names the kernels in use: "avx2", "neon" or "scalar".
+ */
+const char *sensor_batch_kernels(void);
+
+#endif /* SENSOR_BATCH_H */
@@ -0,0 +1,100 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "common.h"  /* Required for gateway_error_t */
+
+/* Tunables read at run time instead of compiled in. The defaults are the config.h values;
+ * GATEWAY_CONFIG_FILE_NAME (or the file of -f) overrides them, command line options
+ * (-b, -B, -r, -w, -o name=value) override the file. The file holds one setting per line:
+ *   # comment
+ *   sbuffer_size = 4096
+ *   temp_too_hot_threshold = 27.5
+ * Each setting applies at one of three points:
+ *   startup: read while the gateway starts, changing it needs a restart
+ *   runtime: the 'set' command changes it while the gateway runs, taking effect at its next use
+ *   reload:  'set' changes it, taking effect when the alert rules are next reloaded
+ * Startup settings are only written before the manager threads start and are read directly.
+ * Runtime and reload settings may change under their readers, who read them with SETTING(). */
+
+#define SETTINGS_TEXT_MAX 256        /* Longest text setting (file names), with the terminator */
+
+typedef struct {
+    /* startup */
+    long sbuffer_size;               /* Initial shared buffer capacity (SBUFFER_SIZE) */
+    long sbuffer_max_size;           /* Shared buffer growth limit, 0 = fixed (SBUFFER_MAX_SIZE) */
+    long conmgt_reactors;            /* Connection manager reactor threads (CONMGT_REACTORS) */
+    long datamgt_workers;            /* Data manager workers (DATAMGT_WORKERS) */
+    long tcp_backlog;                /* Listen queue of each reactor (TCP_BACKLOG) */
+    char map_file[SETTINGS_TEXT_MAX];   /* Room-sensor map (MAP_FILE_NAME) */
+    char rules_file[SETTINGS_TEXT_MAX]; /* Alert rules (ALERT_RULES_FILE_NAME) */
+    char forward_upstream[SETTINGS_TEXT_MAX]; /* Gateway readings are forwarded to (FORWARDER_UPSTREAM) */
+    /* runtime */
+    long sensor_timeout_sec;         /* Inactive sensors are dropped after this (SENSOR_TIMEOUT_SEC) */
+    long max_connections_per_ip;     /* TCP connections per address, 0 = no limit (MAX_CONNECTIONS_PER_IP) */
+    long db_connect_retry_attempts;  /* Database connection attempts (DB_CONNECT_RETRY_ATTEMPTS) */
+    long db_connect_retry_delay_sec; /* Delay between them (DB_CONNECT_RETRY_DELAY_SEC) */
+    long storagemgt_batch_linger_ms; /* Wait for more readings of a batch (STORAGEMGT_BATCH_LINGER_MS) */
+    long storagemgt_lateness_sec;    /* Hold of the reorder buffer (STORAGEMGT_REORDER_LATENESS_SEC) */
+    long alert_min_interval_sec;     /* Alert lines per sensor at most once per this (ALERT_MIN_INTERVAL_SEC) */
+    long alert_max_per_sec;          /* Alert lines per second of all workers, 0 = no limit (ALERT_MAX_PER_SEC) */
+    /* reload */
+    double temp_too_cold_threshold;  /* Built-in low threshold of the alert rules (TEMP_TOO_COLD_THRESHOLD) */
+    double temp_too_hot_threshold;   /* Built-in high threshold of the alert rules (TEMP_TOO_HOT_THRESHOLD) */
+} gateway_settings_t;
+
+/* The settings in effect, initialised with the config.h defaults */
+extern gateway_settings_t gateway_settings;
+
+/* Reads a runtime or reload setting that another thread may be changing */
+#define SETTING(field) __extension__ ({ \
+        __typeof__(gateway_settings.field) setting_value_; \
+        __atomic_load(&gateway_settings.field, &setting_value_, __ATOMIC_RELAXED); \
+        setting_value_; })
+
+/**
+ * @brief Applies a settings file.
+ * @param filename The file.
+ * @param required false to accept a missing file (the settings stay as they are).
+ * @param error Receives a description of the first problem (may be NULL).
+ * @param error_size Size of error.
+ * @return GATEWAY_SUCCESS, SETTINGS_IO_ERR if the file cannot be read, or
+ *         GATEWAY_ERROR_INVALID_ARG for an unknown setting or an invalid value. Lines before
+ *         the invalid one stay applied; the caller is expected to stop.
+ */
+gateway_error_t settings_load_file(const char *filename, bool required, char *error, size_t error_size);
+
+/**
+ * @brief Changes one setting.
+ * @param name The setting.
+ * @param value Its new value, as in the file.
+ * @param running true once the gateway runs: startup settings are refused then.
+ * @param error Receives a description of the problem (may be NULL).
+ * @param error_size Size of error.
+ * @return GATEWAY_SUCCESS, or GATEWAY_ERROR_INVALID_ARG for an unknown or (while running)
+ *         startup setting or an invalid value.
+ */
+gateway_error_t settings_set(const char *name, const char *value, bool running, char *error, size_t error_size);
+
+/**
+ * @brief Applies a "name=value" command line override, as settings_set() before startup.
+ */
+gateway_error_t settings_set_assignment(const char *assignment, char *error, size_t error_size);
+
+/**
+ * @brief Describes when a setting applies.
+ * @return "startup", "runtime" or "reload", or NULL if there is no such setting.
+ */
+const char *settings_applies(const char *name);
+
+/**
+ * @brief Lists every setting with its value and when it applies, one per line.
+ * @param buf Receives the text (always terminated).
+ * @param size Size of buf.
+ * @return Length of the full text; a value of size or more means it was truncated.
+ */
+size_t settings_format(char *buf, size_t size);
+
+#endif /* SETTINGS_H */
@@ -0,0 +1,78 @@
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common.h"  /* Required for sensor_data_t and gateway_error_t */
+
+/* Append-only spill log of sensor readings on disk.
+ * The log is a directory of fixed-size segment files (spill-<seq>.seg), each memory-mapped
+ * while it is read or written. Records are appended to the newest segment and consumed from
+ * the oldest one; a segment is deleted once consumed. The consumed count is kept in the
+ * segment header, so a restarted gateway resumes where the previous one stopped.
+ * A log is used by a single thread. */
+
+/* State of an open spill log */
+typedef struct {
+    char dir[256];               /* Directory holding the segments */
+    bool empty;                  /* No segment exists (head/tail fields unused) */
+    unsigned int head_seq;       /* Oldest segment, read from */
+    unsigned int tail_seq;       /* Newest segment, appended to */
+    uint8_t *head_map;           /* Mapping of the head segment */
+    uint8_t *tail_map;           /* Mapping of the tail segment (same as head_map if one segment) */
+    size_t tail_written;         /* Records in the tail segment */
+    size_t count;                /* Unconsumed records across all segments */
+    unsigned long dropped;       /* Records lost because the segment limit was reached */
+} spill_log_t;
+
+/**
+ * @brief Opens (creating it if needed) the spill log in a directory and recovers
+ *        the records a previous run left unconsumed.
+ * @param log The log to set up.
+ * @param dir Directory for the segment files.
+ * @return GATEWAY_SUCCESS, or SPILL_IO_ERR (errno is kept).
+ */
+gateway_error_t spill_open(spill_log_t *log, const char *dir);
+
+/**
+ * @brief Unmaps the segments. The files stay on disk for the next spill_open().
+ * @param log The log to close; safe to call on one that failed to open.
+ */
+void spill_close(spill_log_t *log);
+
+/**
+ * @brief Appends readings after the newest record, starting new segments as needed.
+ *        When STORAGEMGT_SPILL_MAX_SEGMENTS would be exceeded the oldest segment is dropped.
+ * @param log The log.
+ * @param data The readings to append.
+ * @param count Number of readings.
+ * @return GATEWAY_SUCCESS, or SPILL_IO_ERR if a segment could not be created (nothing more is appended).
+ */
+gateway_error_t spill_append(spill_log_t *log, const sensor_data_t *data, size_t count);
+
+/**
+ * @brief Copies up to max_count of the oldest records without consuming them.
+ *        Only the head segment is read, so fewer records than available may be returned.
+ * @param log The log.
+ * @param data Array of at least max_count elements receiving the readings, oldest first.
+ * @param max_count Capacity of data.
+ * @return The number of readings copied, 0 if the log is empty.
+ */
+size_t spill_peek(spill_log_t *log, sensor_data_t *data, size_t max_count);
+
+/**
+ * @brief Consumes the oldest records, deleting every segment that becomes fully consumed.
+ * @param log The log.
+ * @param count Number of records to consume (at most what the last spill_peek() returned).
+ */
+void spill_consume(spill_log_t *log, size_t count);
+
+/**
+ * @brief Returns the number of unconsumed records.
+ * @param log The log.
+ */
+size_t spill_count(const spill_log_t *log);
+
+#endif /* SPILL_H */
@@ -7,6 +7,7 @@
 /* Structure to pass arguments to the storage manager thread */
 typedef struct {
     sbuffer_t *buffer; /* Pointer to the shared buffer */
+    int reader_id;     /* Read cursor registered on the shared buffer */
 } storagemgt_args_t;
 
 /**
@@ -19,9 +20,32 @@ typedef struct {
  */
 void *storagemgt_run(void *arg);
 
+/* --- Rollup Rows --- */
+
+/**
+ * @brief Queues rollup summary rows for the storage manager to insert.
+ * Thread-safe; the rows are copied. They are written before the next raw reading.
+ * Rows beyond STORAGEMGT_ROLLUP_QUEUE_MAX pending ones are dropped with a warning.
+ * @param rows Array of count rows.
+ * @param count Number of rows.
+ * @return GATEWAY_SUCCESS, or GATEWAY_ERROR_NOMEM / SBUFFER_FULL if rows were dropped.
+ */
+gateway_error_t storagemgt_submit_rollups(const rollup_row_t *rows, size_t count);
+
+/**
+ * @brief Tells the storage manager that no more rollup rows will be submitted.
+ * Once its shared buffer is shut down, the storage manager waits for this call
+ * (at most STORAGEMGT_ROLLUP_DRAIN_SEC) so the final partial buckets are written too.
+ */
+void storagemgt_rollups_done(void);
+
 /* --- Shutdown Function --- */
 /**
- * @brief Signals the Storage Manager thread to stop gracefully.
+ * @brief Signals the Storage Manager thread to stop gracefully. It stops waiting for the
+ * database at once, commits the readings left in the retry queue and the shared buffer in
+ * transactions of STORAGEMGT_DRAIN_BATCH_SIZE until the buffer is shut down and empty, and
+ * keeps what it could not commit within STORAGEMGT_DRAIN_TIMEOUT_MS in the spill log.
+ * Returns at once; the thread exits when the drain is done.
  */
 void storagemgt_stop(void);
 
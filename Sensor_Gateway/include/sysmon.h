@@ -3,21 +3,49 @@
 
 #include <stddef.h>
 
-/* Structure to hold system resource info */
+#include "config.h"   /* For SYSMON_MAX_CPUS and SYSMON_MAX_THREADS */
+
+/* CPU usage of one gateway thread */
+typedef struct {
+    int tid;                  /* Kernel thread ID */
+    char name[16];            /* Thread name (comm) */
+    double cpu_percent;       /* Share of one CPU over the last interval */
+} sysmon_thread_t;
+
+/* Structure to hold system resource info, as of the last sample */
 typedef struct {
-    double cpu_usage_percent; /* Rough CPU usage */
+    double cpu_usage_percent; /* CPU usage of the whole system over the last interval */
     long ram_total_kb;        /* Total RAM in KB */
     long ram_free_kb;         /* Free RAM in KB */
     long ram_used_kb;         /* Used RAM in KB */
     double ram_usage_percent; /* RAM usage percentage */
+    double interval_sec;      /* Length of the interval the CPU figures cover (0 before two samples) */
+    int cpu_count;            /* Number of valid core_usage_percent entries */
+    double core_usage_percent[SYSMON_MAX_CPUS]; /* Usage of each core over the last interval */
+    double process_cpu_percent; /* Sum of the gateway threads, in shares of one CPU */
+    int thread_count;         /* Number of valid threads entries */
+    sysmon_thread_t threads[SYSMON_MAX_THREADS]; /* Gateway threads, in /proc order */
 } system_stats_t;
 
 /**
- * @brief Gets current system statistics (CPU, RAM).
- * NOTE: CPU usage calculation might be basic and require refinement.
+ * @brief Main function of the sampler thread: every SYSMON_INTERVAL_MS it re-reads
+ *        /proc/stat, /proc/meminfo and the stat file of each gateway thread (kept open)
+ *        and publishes a snapshot with the CPU usage since the previous sample.
+ * @param arg Unused.
+ * @return Always returns NULL.
+ */
+void *sysmon_run(void *arg);
+
+/**
+ * @brief Signals the sampler thread to stop; it exits at once.
+ */
+void sysmon_stop(void);
+
+/**
+ * @brief Copies the latest snapshot. Performs no file I/O.
  * @param stats Pointer to a system_stats_t struct to fill.
- * @return 0 on success, -1 on failure.
+ * @return 0 on success, -1 if the sampler has not published a snapshot.
  */
 int sysmon_get_stats(system_stats_t *stats);
 
-#endif /* SYSMON_H */
\ No newline at end of file
+#endif /* SYSMON_H */
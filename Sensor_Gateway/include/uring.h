@@ -0,0 +1,132 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <linux/io_uring.h>
+
+#include "common.h"  /* Required for gateway_error_t */
+
+/* Minimal io_uring wrapper on the raw system calls (no liburing dependency).
+ * A ring is driven by a single thread: SQEs are queued with uring_get_sqe() and
+ * submitted together by the next uring_submit_and_wait(). */
+
+/* Submission and completion queues mapped from the kernel */
+typedef struct {
+    int ring_fd;                  /* io_uring instance, -1 if not set up */
+    unsigned features;            /* IORING_FEAT_* reported by the kernel */
+
+    /* Submission queue */
+    void *sq_ptr;                 /* Mapping of the SQ ring */
+    size_t sq_size;
+    unsigned *sq_khead;           /* Kernel-owned head */
+    unsigned *sq_ktail;           /* Tail published to the kernel */
+    unsigned sq_mask;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;    /* SQE array */
+    size_t sqes_size;
+    unsigned sqe_tail;            /* Next SQE handed out by uring_get_sqe(), published on submit */
+
+    /* Completion queue */
+    void *cq_ptr;                 /* Mapping of the CQ ring (same as sq_ptr with IORING_FEAT_SINGLE_MMAP) */
+    size_t cq_size;
+    unsigned *cq_khead;           /* Head published back to the kernel */
+    unsigned *cq_ktail;           /* Kernel-owned tail */
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+} uring_t;
+
+/* Provided buffer ring: the kernel picks a buffer for each multishot receive */
+typedef struct {
+    struct io_uring_buf_ring *ring; /* Shared ring of buffer descriptors */
+    uint8_t *base;                /* entries * buf_size bytes of buffer memory */
+    size_t buf_size;              /* Size of each buffer */
+    unsigned entries;             /* Number of buffers, a power of two */
+    uint16_t bgid;                /* Buffer group id used in IOSQE_BUFFER_SELECT requests */
+    uint16_t tail;                /* Local tail, published by uring_buf_ring_publish() */
+} uring_buf_ring_t;
+
+/**
+ * @brief Creates an io_uring instance and maps its queues.
+ * @param ring The ring to set up.
+ * @param sq_entries Submission queue size (rounded up to a power of two by the kernel).
+ * @param cq_entries Completion queue size, larger than sq_entries so multishot requests do not overflow it.
+ * @return GATEWAY_SUCCESS, or CONNMGR_URING_ERR if the kernel does not provide io_uring (errno is kept).
+ */
+gateway_error_t uring_init(uring_t *ring, unsigned sq_entries, unsigned cq_entries);
+
+/**
+ * @brief Unmaps the queues and closes the instance, cancelling every request still in flight.
+ * @param ring The ring to free; safe to call on a ring that was never set up.
+ */
+void uring_free(uring_t *ring);
+
+/**
+ * @brief Hands out a zeroed SQE. When the submission queue is full the queued SQEs are submitted first.
+ * @param ring The ring.
+ * @return The SQE, or NULL if the queue could not be flushed.
+ */
+struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+
+/**
+ * @brief Submits every queued SQE and waits for at least one completion, in one system call.
+ * @param ring The ring.
+ * @param timeout_ms Maximum wait in milliseconds, -1 to wait indefinitely.
+ * @return 0 on success or timeout, a negative errno value otherwise.
+ */
+int uring_submit_and_wait(uring_t *ring, int timeout_ms);
+
+/**
+ * @brief Returns the next unread completion without waiting.
+ * @param ring The ring.
+ * @return The CQE, or NULL if the completion queue is empty. Release it with uring_cqe_seen().
+ */
+struct io_uring_cqe *uring_peek_cqe(uring_t *ring);
+
+/**
+ * @brief Marks the CQE returned by uring_peek_cqe() as consumed.
+ * @param ring The ring.
+ */
+void uring_cqe_seen(uring_t *ring);
+
+/**
+ * @brief Allocates a provided buffer ring and registers it with a ring.
+ * @param ring The ring the buffers are used with.
+ * @param bufs The buffer ring to set up.
+ * @param bgid Buffer group id.
+ * @param entries Number of buffers, a power of two up to 32768.
+ * @param buf_size Size of each buffer.
+ * @return GATEWAY_SUCCESS, GATEWAY_ERROR_NOMEM or CONNMGR_URING_ERR (errno is kept).
+ */
+gateway_error_t uring_buf_ring_init(uring_t *ring, uring_buf_ring_t *bufs, uint16_t bgid, unsigned entries, size_t buf_size);
+
+/**
+ * @brief Unregisters and frees a provided buffer ring.
+ * @param ring The ring the buffers were registered with (may already be freed).
+ * @param bufs The buffer ring to free; safe to call on one that was never set up.
+ */
+void uring_buf_ring_free(uring_t *ring, uring_buf_ring_t *bufs);
+
+/**
+ * @brief Returns the memory of a buffer picked by the kernel.
+ * @param bufs The buffer ring.
+ * @param bid Buffer id from the CQE flags.
+ * @return Pointer to the buffer.
+ */
+uint8_t *uring_buf_ring_buffer(uring_buf_ring_t *bufs, uint16_t bid);
+
+/**
+ * @brief Gives a consumed buffer back to the kernel. Takes effect at the next uring_buf_ring_publish().
+ * @param bufs The buffer ring.
+ * @param bid Buffer id to recycle.
+ */
+void uring_buf_ring_recycle(uring_buf_ring_t *bufs, uint16_t bid);
+
+/**
+ * @brief Makes every recycled buffer visible to the kernel with a single tail update.
+ * @param bufs The buffer ring.
+ */
+void uring_buf_ring_publish(uring_buf_ring_t *bufs);
+
+#endif /* URING_H */
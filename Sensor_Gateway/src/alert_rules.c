@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>    /* For strcasecmp() */
+#include <errno.h>
+#include <math.h>       /* For INFINITY */
+#include <ctype.h>      /* For isspace() */
+
+/* Include project-specific headers */
+#include "config.h"     /* For ALERT_DEFAULT_HYSTERESIS */
+#include "logger.h"
+#include "alert_rules.h"
+#include "settings.h"   /* For the built-in thresholds */
+
+/* --- Local Macros --- */
+
+#define RULE_LINE_BUFFER_SIZE 256       /* Longest line read from the rules file */
+#define RULE_INITIAL_CAPACITY 16        /* Initial slots of the room and sensor rule arrays */
+#define RULE_FIELD_COUNT 5              /* low, high, hysteresis, max_rate, max_zscore */
+
+enum { FIELD_LOW, FIELD_HIGH, FIELD_HYSTERESIS, FIELD_MAX_RATE, FIELD_MAX_ZSCORE };
+
+static const char *const field_names[RULE_FIELD_COUNT] = {"low", "high", "hysteresis", "max_rate", "max_zscore"};
+
+/* --- Helper Functions --- */
+
+/**
+ * @brief Applies the fields a rule sets to a profile.
+ */
+static void apply_rule(alert_profile_t *profile, const alert_rule_t *rule) {
+    if (rule->set & (1u << FIELD_LOW))        profile->low = rule->values[FIELD_LOW];
+    if (rule->set & (1u << FIELD_HIGH))       profile->high = rule->values[FIELD_HIGH];
+    if (rule->set & (1u << FIELD_HYSTERESIS)) profile->hysteresis = rule->values[FIELD_HYSTERESIS];
+    if (rule->set & (1u << FIELD_MAX_RATE))   profile->max_rate = rule->values[FIELD_MAX_RATE];
+    if (rule->set & (1u << FIELD_MAX_ZSCORE)) profile->max_zscore = rule->values[FIELD_MAX_ZSCORE];
+}
+
+/**
+ * @brief Trims a field in place.
+ */
+static char *trim(char *text) {
+    while (isspace((unsigned char)*text)) text++;
+    char *end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return text;
+}
+
+/**
+ * @brief Parses one value field into a rule.
+ * @return 0, or -1 if the field is invalid.
+ */
+static int parse_field(alert_rule_t *rule, int field, char *text) {
+    text = trim(text);
+    if (*text == '\0') {
+        return 0; /* Inherited */
+    }
+    if (strcasecmp(text, "off") == 0) {
+        rule->values[field] = field == FIELD_LOW ? -INFINITY : field == FIELD_HYSTERESIS ? 0.0 : INFINITY;
+    } else {
+        char *end;
+        double value = strtod(text, &end);
+        if (end == text || *end != '\0' || !isfinite(value)) {
+            return -1;
+        }
+        if ((field == FIELD_HYSTERESIS && value < 0.0) ||
+            ((field == FIELD_MAX_RATE || field == FIELD_MAX_ZSCORE) && value <= 0.0)) {
+            return -1;
+        }
+        rule->values[field] = value;
+    }
+    rule->set |= 1u << field;
+    return 0;
+}
+
+/**
+ * @brief Appends a rule to an array, growing it as needed.
+ * @return 0, or -1 if memory ran out.
+ */
+static int append_rule(alert_rule_t **rules, int *count, int *capacity, const alert_rule_t *rule) {
+    if (*count == *capacity) {
+        int new_capacity = *capacity > 0 ? *capacity * 2 : RULE_INITIAL_CAPACITY;
+        alert_rule_t *grown = realloc(*rules, (size_t)new_capacity * sizeof(alert_rule_t));
+        if (grown == NULL) {
+            return -1;
+        }
+        *rules = grown;
+        *capacity = new_capacity;
+    }
+    (*rules)[(*count)++] = *rule;
+    return 0;
+}
+
+/**
+ * @brief qsort comparator: by key, then by line.
+ */
+static int compare_rules(const void *a, const void *b) {
+    const alert_rule_t *ra = a, *rb = b;
+    if (ra->key != rb->key) {
+        return ra->key < rb->key ? -1 : 1;
+    }
+    return (ra->line > rb->line) - (ra->line < rb->line);
+}
+
+/**
+ * @brief Sorts rules by key and folds the rules of each key into one, later lines winning.
+ * @return The number of rules left.
+ */
+static int merge_rules(alert_rule_t *rules, int count) {
+    int out = 0;
+    if (count == 0) {
+        return 0;
+    }
+    qsort(rules, (size_t)count, sizeof(alert_rule_t), compare_rules);
+    for (int i = 1; i < count; ++i) {
+        if (rules[i].key == rules[out].key) {
+            for (int field = 0; field < RULE_FIELD_COUNT; ++field) {
+                if (rules[i].set & (1u << field)) {
+                    rules[out].values[field] = rules[i].values[field];
+                }
+            }
+            rules[out].set |= rules[i].set;
+        } else {
+            rules[++out] = rules[i];
+        }
+    }
+    return out + 1;
+}
+
+/**
+ * @brief Binary search of a merged rule array.
+ */
+static const alert_rule_t *find_rule(const alert_rule_t *rules, int count, int key) {
+    int lo = 0, hi = count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (rules[mid].key == key) {
+            return &rules[mid];
+        }
+        if (rules[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return NULL;
+}
+
+/* --- Public Functions --- */
+
+gateway_error_t alert_rules_load(const char *filename, alert_rules_t **rules) {
+    char line_buffer[RULE_LINE_BUFFER_SIZE];
+    int room_capacity = 0, sensor_capacity = 0, line_num = 0;
+    alert_rule_t default_rule = { .key = 0, .set = 0 };
+
+    if (rules == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    alert_rules_t *loaded = calloc(1, sizeof(alert_rules_t));
+    if (loaded == NULL) {
+        log_message(LOG_LEVEL_ERROR, "Failed to allocate memory for alert rules: %s", strerror(errno));
+        return GATEWAY_ERROR_NOMEM;
+    }
+    loaded->base.low = SETTING(temp_too_cold_threshold);
+    loaded->base.high = SETTING(temp_too_hot_threshold);
+    loaded->base.hysteresis = ALERT_DEFAULT_HYSTERESIS;
+    loaded->base.max_rate = INFINITY;
+    loaded->base.max_zscore = INFINITY;
+
+    FILE *fp = filename != NULL ? fopen(filename, "r") : NULL;
+    if (fp == NULL) {
+        if (filename != NULL) {
+            log_message(LOG_LEVEL_INFO, "No alert rules file '%s' (%s), using the built-in thresholds.", filename, strerror(errno));
+        }
+        *rules = loaded;
+        return GATEWAY_SUCCESS;
+    }
+
+    while (fgets(line_buffer, sizeof(line_buffer), fp) != NULL) {
+        char *fields[2 + RULE_FIELD_COUNT] = { NULL };
+        int field_count = 0;
+        char *line_ptr = line_buffer;
+
+        line_num++;
+        while (isspace((unsigned char)*line_ptr)) line_ptr++;
+        if (*line_ptr == '\0' || *line_ptr == '#') continue; /* Skip empty lines and comments */
+        line_ptr[strcspn(line_ptr, "\r\n")] = '\0';
+
+        /* Split at commas, keeping empty fields (strtok would drop them) */
+        while (line_ptr != NULL && field_count < 2 + RULE_FIELD_COUNT) {
+            fields[field_count++] = line_ptr;
+            line_ptr = strchr(line_ptr, ',');
+            if (line_ptr != NULL) {
+                *line_ptr++ = '\0';
+            }
+        }
+        if (line_ptr != NULL || field_count < 2) {
+            log_message(LOG_LEVEL_WARNING, "Invalid format in alert rules file '%s' at line %d, skipping.", filename, line_num);
+            continue;
+        }
+
+        alert_rule_t rule = { .line = line_num, .set = 0 };
+        const char *scope = trim(fields[0]);
+        char *id_text = trim(fields[1]), *end;
+        long id = strtol(id_text, &end, 10);
+        bool is_default = strcasecmp(scope, "default") == 0;
+        bool is_room = strcasecmp(scope, "room") == 0;
+        bool is_sensor = strcasecmp(scope, "sensor") == 0;
+
+        if (!is_default && !is_room && !is_sensor) {
+            log_message(LOG_LEVEL_WARNING, "Unknown scope '%s' in alert rules file '%s' at line %d, skipping.", scope, filename, line_num);
+            continue;
+        }
+        if (!is_default && (*id_text == '\0' || *end != '\0' || id < (is_sensor ? 1 : 0) ||
+                            id > (is_sensor ? UINT16_MAX : INT32_MAX))) {
+            log_message(LOG_LEVEL_WARNING, "Invalid %s ID '%s' in alert rules file '%s' at line %d, skipping.", scope, id_text, filename, line_num);
+            continue;
+        }
+        rule.key = (int)id;
+
+        int bad_field = -1;
+        for (int field = 0; field + 2 < field_count; ++field) {
+            if (parse_field(&rule, field, fields[field + 2]) != 0) {
+                bad_field = field;
+                break;
+            }
+        }
+        if (bad_field >= 0) {
+            log_message(LOG_LEVEL_WARNING, "Invalid %s in alert rules file '%s' at line %d, skipping.", field_names[bad_field], filename, line_num);
+            continue;
+        }
+
+        int failed = 0;
+        if (is_default) {
+            for (int field = 0; field < RULE_FIELD_COUNT; ++field) {
+                if (rule.set & (1u << field)) {
+                    default_rule.values[field] = rule.values[field];
+                }
+            }
+            default_rule.set |= rule.set;
+        } else if (is_room) {
+            failed = append_rule(&loaded->rooms, &loaded->room_count, &room_capacity, &rule);
+        } else {
+            failed = append_rule(&loaded->sensors, &loaded->sensor_count, &sensor_capacity, &rule);
+        }
+        if (failed) {
+            log_message(LOG_LEVEL_ERROR, "Failed to allocate memory for alert rules: %s", strerror(errno));
+            fclose(fp);
+            alert_rules_free(&loaded);
+            return GATEWAY_ERROR_NOMEM;
+        }
+        loaded->line_count++;
+    }
+    fclose(fp);
+
+    apply_rule(&loaded->base, &default_rule);
+    loaded->room_count = merge_rules(loaded->rooms, loaded->room_count);
+    loaded->sensor_count = merge_rules(loaded->sensors, loaded->sensor_count);
+    log_message(LOG_LEVEL_INFO, "Loaded %d alert rules from '%s' (%d rooms, %d sensors).",
+                loaded->line_count, filename, loaded->room_count, loaded->sensor_count);
+    *rules = loaded;
+    return GATEWAY_SUCCESS;
+}
+
+void alert_rules_resolve(const alert_rules_t *rules, sensor_id_t sensor_id, int room_id, alert_profile_t *profile) {
+    *profile = rules->base;
+    if (room_id >= 0) {
+        const alert_rule_t *room = find_rule(rules->rooms, rules->room_count, room_id);
+        if (room != NULL) {
+            apply_rule(profile, room);
+        }
+    }
+    const alert_rule_t *sensor = find_rule(rules->sensors, rules->sensor_count, sensor_id);
+    if (sensor != NULL) {
+        apply_rule(profile, sensor);
+    }
+}
+
+void alert_rules_free(alert_rules_t **rules) {
+    if (rules == NULL || *rules == NULL) {
+        return;
+    }
+    free((*rules)->rooms);
+    free((*rules)->sensors);
+    free(*rules);
+    *rules = NULL;
+}
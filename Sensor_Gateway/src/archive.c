@@ -0,0 +1,620 @@
+/* --- Include Standard Libraries --- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/* --- Include Project-Specific Headers --- */
+#include "config.h"     /* For STORAGEMGT_ARCHIVE_* */
+#include "logger.h"     /* For log_message */
+#include "archive.h"
+
+/* --- Local Macros and Types --- */
+
+#define ARCHIVE_FILE_MAGIC 0x5241474eu  /* "NGAR" in the file header */
+#define ARCHIVE_BLOCK_MAGIC 0x314b4c42u /* "BLK1" in every block header */
+#define ARCHIVE_VERSION 1
+
+/* Worst case bit stream size of one reading: '1111' + 64 bit delta-of-delta, '11' + 5 + 6 + 64 bit XOR */
+#define ARCHIVE_MAX_READING_BITS 145
+
+/* Blocks and their bit streams start on 8 byte boundaries */
+#define ARCHIVE_ALIGN(n) (((n) + 7u) & ~(size_t)7u)
+
+/* File header, followed by the blocks */
+typedef struct {
+    uint32_t magic;              /* ARCHIVE_FILE_MAGIC */
+    uint16_t version;            /* ARCHIVE_VERSION */
+    uint16_t block_header_size;  /* sizeof(archive_block_header_t) when written */
+    uint8_t reserved[24];        /* Pads the header to 32 bytes */
+} archive_file_header_t;
+
+/* Block header, followed by payload_bytes of bit stream and padding to 8 bytes */
+typedef struct {
+    uint32_t magic;              /* ARCHIVE_BLOCK_MAGIC */
+    uint16_t id;                 /* Sensor of all readings in the block */
+    uint16_t count;              /* Readings, the first one is stored here, the others in the bit stream */
+    uint32_t payload_bytes;      /* Length of the bit stream */
+    uint32_t reserved;
+    int64_t t_min;               /* Smallest timestamp in the block */
+    int64_t t_max;               /* Largest timestamp in the block */
+    int64_t t_first;             /* Timestamp of the first reading */
+    double v_first;              /* Value of the first reading */
+} archive_block_header_t;
+
+/* A block being filled; the bit stream is written most significant bit first */
+struct archive_block {
+    sensor_id_t id;
+    uint16_t count;              /* Readings so far, 0 if the block is empty */
+    size_t bits;                 /* Bits used in payload */
+    int64_t t_min, t_max, t_first;
+    int64_t t_prev;              /* Timestamp of the last reading */
+    int64_t delta_prev;          /* t_prev minus the timestamp before it */
+    double v_first;
+    uint64_t v_prev;             /* Bits of the last value */
+    unsigned int lead, trail;    /* Window of meaningful XOR bits of the last value that changed */
+    bool window;                 /* lead/trail are set */
+    time_t opened;               /* Wall clock time of the first reading */
+    uint8_t payload[STORAGEMGT_ARCHIVE_BLOCK_BYTES];
+};
+
+/* Bit stream being decoded */
+typedef struct {
+    const uint8_t *data;
+    size_t size_bits;
+    size_t pos;
+} bit_reader_t;
+
+/* --- Local Helper Functions --- */
+
+static uint64_t double_bits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static double bits_double(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief UTC day of a timestamp as YYYYMMDD, which names the archive file of a block.
+ */
+static int utc_day(sensor_ts_t ts) {
+    struct tm tm_utc;
+
+    gmtime_r(&ts, &tm_utc);
+    return (tm_utc.tm_year + 1900) * 10000 + (tm_utc.tm_mon + 1) * 100 + tm_utc.tm_mday;
+}
+
+static void file_path(const char *dir, int day, char *path, size_t size) {
+    snprintf(path, size, "%s/archive-%08d.gar", dir, day);
+}
+
+/**
+ * @brief Returns the block header at offset off of a mapped file, or NULL if no complete block
+ *        starts there (end of file, a block cut short by a crash, or garbage).
+ */
+static const archive_block_header_t *block_at(const uint8_t *map, size_t size, size_t off) {
+    if (off + sizeof(archive_block_header_t) > size) {
+        return NULL;
+    }
+    const archive_block_header_t *header = (const archive_block_header_t *)(map + off);
+    if (header->magic != ARCHIVE_BLOCK_MAGIC || header->count == 0 ||
+        header->payload_bytes > STORAGEMGT_ARCHIVE_BLOCK_BYTES ||
+        off + ARCHIVE_ALIGN(sizeof(*header) + header->payload_bytes) > size) {
+        return NULL;
+    }
+    return header;
+}
+
+static bool file_header_valid(const uint8_t *map, size_t size) {
+    const archive_file_header_t *header = (const archive_file_header_t *)map;
+    return size >= sizeof(*header) && header->magic == ARCHIVE_FILE_MAGIC &&
+           header->version == ARCHIVE_VERSION && header->block_header_size == sizeof(archive_block_header_t);
+}
+
+/**
+ * @brief Length of the valid part of an archive file: its header and the complete blocks after it.
+ * @return The length, or 0 if the file header is invalid.
+ */
+static size_t valid_length(const uint8_t *map, size_t size) {
+    const archive_block_header_t *header;
+    size_t off = sizeof(archive_file_header_t);
+
+    if (!file_header_valid(map, size)) {
+        return 0;
+    }
+    while ((header = block_at(map, size, off)) != NULL) {
+        off += ARCHIVE_ALIGN(sizeof(*header) + header->payload_bytes);
+    }
+    return off;
+}
+
+/**
+ * @brief Makes fd the archive file of a UTC day, creating it or cutting off a torn last block.
+ */
+static gateway_error_t open_day_file(archive_writer_t *archive, int day) {
+    char path[sizeof(archive->dir) + 32];
+    struct stat st;
+
+    if (archive->fd != -1 && archive->fd_day == day) {
+        return GATEWAY_SUCCESS;
+    }
+    if (archive->fd != -1) {
+        close(archive->fd);
+        archive->fd = -1;
+    }
+
+    file_path(archive->dir, day, path, sizeof(path));
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        log_message(LOG_LEVEL_ERROR, "Failed to open archive file %s: %s", path, strerror(errno));
+        if (fd != -1) close(fd);
+        return ARCHIVE_IO_ERR;
+    }
+
+    size_t size = (size_t)st.st_size;
+    size_t valid = 0;
+    if (size > 0) {
+        void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            log_message(LOG_LEVEL_ERROR, "Failed to map archive file %s: %s", path, strerror(errno));
+            close(fd);
+            return ARCHIVE_IO_ERR;
+        }
+        valid = valid_length(map, size);
+        munmap(map, size);
+        if (valid == 0) {
+            /* Appending to a foreign file would make it unreadable for both */
+            log_message(LOG_LEVEL_ERROR, "Archive file %s has an unknown format, not appending to it.", path);
+            close(fd);
+            return ARCHIVE_IO_ERR;
+        }
+        if (valid < size) {
+            log_message(LOG_LEVEL_WARNING, "Archive file %s ends in an incomplete block, cutting %zu bytes.",
+                        path, size - valid);
+            if (ftruncate(fd, (off_t)valid) == -1) {
+                log_message(LOG_LEVEL_ERROR, "Failed to truncate archive file %s: %s", path, strerror(errno));
+                close(fd);
+                return ARCHIVE_IO_ERR;
+            }
+        }
+    } else {
+        archive_file_header_t header;
+        memset(&header, 0, sizeof(header));
+        header.magic = ARCHIVE_FILE_MAGIC;
+        header.version = ARCHIVE_VERSION;
+        header.block_header_size = sizeof(archive_block_header_t);
+        if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+            log_message(LOG_LEVEL_ERROR, "Failed to write archive file %s: %s", path, strerror(errno));
+            close(fd);
+            unlink(path);
+            return ARCHIVE_IO_ERR;
+        }
+    }
+    archive->fd = fd;
+    archive->fd_day = day;
+    return GATEWAY_SUCCESS;
+}
+
+static void put_bits(archive_block_t *block, uint64_t value, unsigned int nbits) {
+    while (nbits > 0) {
+        unsigned int free_bits = 8 - (unsigned int)(block->bits % 8);
+        unsigned int n = nbits < free_bits ? nbits : free_bits;
+        uint8_t chunk = (uint8_t)((value >> (nbits - n)) & ((1u << n) - 1));
+
+        block->payload[block->bits / 8] |= (uint8_t)(chunk << (free_bits - n));
+        block->bits += n;
+        nbits -= n;
+    }
+}
+
+static bool get_bits(bit_reader_t *reader, unsigned int nbits, uint64_t *value) {
+    uint64_t result = 0;
+
+    if (reader->pos + nbits > reader->size_bits) {
+        return false;
+    }
+    while (nbits > 0) {
+        unsigned int avail = 8 - (unsigned int)(reader->pos % 8);
+        unsigned int n = nbits < avail ? nbits : avail;
+        uint8_t byte = reader->data[reader->pos / 8];
+
+        result = (result << n) | (uint64_t)((byte >> (avail - n)) & ((1u << n) - 1));
+        reader->pos += n;
+        nbits -= n;
+    }
+    *value = result;
+    return true;
+}
+
+static void start_block(archive_block_t *block, const sensor_data_t *data) {
+    block->count = 1;
+    block->bits = 0;
+    block->t_min = block->t_max = block->t_first = block->t_prev = (int64_t)data->ts;
+    block->delta_prev = 0;
+    block->v_first = data->value;
+    block->v_prev = double_bits(data->value);
+    block->window = false;
+    block->opened = time(NULL);
+    memset(block->payload, 0, sizeof(block->payload));
+}
+
+/**
+ * @brief Encodes a reading after the first one of a block.
+ */
+static void add_reading(archive_block_t *block, const sensor_data_t *data) {
+    int64_t ts = (int64_t)data->ts;
+    int64_t delta = ts - block->t_prev;
+    int64_t dod = delta - block->delta_prev;
+
+    /* Timestamps: regular intervals cost one bit */
+    if (dod == 0) {
+        put_bits(block, 0x0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+        put_bits(block, 0x2, 2);
+        put_bits(block, (uint64_t)(dod + 63), 7);
+    } else if (dod >= -255 && dod <= 256) {
+        put_bits(block, 0x6, 3);
+        put_bits(block, (uint64_t)(dod + 255), 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+        put_bits(block, 0xe, 4);
+        put_bits(block, (uint64_t)(dod + 2047), 12);
+    } else {
+        put_bits(block, 0xf, 4);
+        put_bits(block, (uint64_t)dod, 64);
+    }
+
+    /* Values: XOR with the previous one, storing only the bits that changed */
+    uint64_t bits = double_bits(data->value);
+    uint64_t xor = bits ^ block->v_prev;
+    if (xor == 0) {
+        put_bits(block, 0x0, 1);
+    } else {
+        unsigned int lead = (unsigned int)__builtin_clzll(xor);
+        unsigned int trail = (unsigned int)__builtin_ctzll(xor);
+        if (lead > 31) {
+            lead = 31; /* Stored in 5 bits */
+        }
+        if (block->window && lead >= block->lead && trail >= block->trail) {
+            put_bits(block, 0x2, 2);
+            put_bits(block, xor >> block->trail, 64 - block->lead - block->trail);
+        } else {
+            unsigned int significant = 64 - lead - trail;
+            put_bits(block, 0x3, 2);
+            put_bits(block, lead, 5);
+            put_bits(block, significant & 0x3f, 6); /* 64 is stored as 0 */
+            put_bits(block, xor >> trail, significant);
+            block->lead = lead;
+            block->trail = trail;
+            block->window = true;
+        }
+    }
+
+    block->count++;
+    block->t_prev = ts;
+    block->delta_prev = delta;
+    block->v_prev = bits;
+    if (ts < block->t_min) block->t_min = ts;
+    if (ts > block->t_max) block->t_max = ts;
+}
+
+/**
+ * @brief Appends a block to the archive file of its first reading's day and empties it.
+ */
+static gateway_error_t seal_block(archive_writer_t *archive, archive_block_t *block) {
+    archive_block_header_t header;
+    static const uint8_t padding[8] = {0};
+    gateway_error_t ret;
+
+    if (block->count == 0) {
+        return GATEWAY_SUCCESS;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = ARCHIVE_BLOCK_MAGIC;
+    header.id = block->id;
+    header.count = block->count;
+    header.payload_bytes = (uint32_t)((block->bits + 7) / 8);
+    header.t_min = block->t_min;
+    header.t_max = block->t_max;
+    header.t_first = block->t_first;
+    header.v_first = block->v_first;
+
+    size_t total = ARCHIVE_ALIGN(sizeof(header) + header.payload_bytes);
+    struct iovec iov[3] = {
+        { &header, sizeof(header) },
+        { block->payload, header.payload_bytes },
+        { (void *)padding, total - sizeof(header) - header.payload_bytes },
+    };
+
+    ret = open_day_file(archive, utc_day((sensor_ts_t)block->t_first));
+    if (ret == GATEWAY_SUCCESS) {
+        off_t end = lseek(archive->fd, 0, SEEK_END);
+        ssize_t written = writev(archive->fd, iov, 3);
+        if (written != (ssize_t)total) {
+            log_message(LOG_LEVEL_ERROR, "Failed to write archive block of sensor %u: %s",
+                        block->id, written < 0 ? strerror(errno) : "short write");
+            if (written > 0 && end != (off_t)-1 && ftruncate(archive->fd, end) == -1) {
+                /* Readers stop at the torn block, the next open_day_file() cuts it */
+                close(archive->fd);
+                archive->fd = -1;
+            }
+            ret = ARCHIVE_IO_ERR;
+        }
+    }
+
+    if (ret == GATEWAY_SUCCESS) {
+        archive->blocks_written++;
+        archive->readings_written += block->count;
+    } else {
+        archive->dropped += block->count;
+    }
+    block->count = 0;
+    return ret;
+}
+
+static archive_block_t *find_block(archive_writer_t *archive, sensor_id_t id) {
+    for (size_t i = 0; i < archive->block_count; ++i) {
+        if (archive->blocks[i].id == id) {
+            return &archive->blocks[i];
+        }
+    }
+    if (archive->block_count == archive->block_capacity) {
+        size_t new_capacity = archive->block_capacity > 0 ? archive->block_capacity * 2 : 16;
+        archive_block_t *new_blocks = realloc(archive->blocks, new_capacity * sizeof(archive_block_t));
+        if (new_blocks == NULL) {
+            return NULL;
+        }
+        archive->blocks = new_blocks;
+        archive->block_capacity = new_capacity;
+    }
+    archive_block_t *block = &archive->blocks[archive->block_count++];
+    block->id = id;
+    block->count = 0;
+    return block;
+}
+
+/* Decoder state of one block */
+typedef struct {
+    bit_reader_t reader;
+    int64_t ts;
+    int64_t delta;
+    uint64_t bits;
+    unsigned int lead, trail;
+} block_decoder_t;
+
+/**
+ * @brief Decodes the reading after the current one (the inverse of add_reading()).
+ * @return false if the bit stream ends early.
+ */
+static bool decode_next(block_decoder_t *dec) {
+    static const unsigned int dod_bits[] = { 0, 7, 9, 12, 64 };
+    static const int64_t dod_bias[] = { 0, 63, 255, 2047, 0 };
+    uint64_t flag, field;
+    unsigned int prefix = 0;
+
+    /* Delta-of-delta: '0', '10', '110', '1110' or '1111' prefix */
+    while (prefix < 4) {
+        if (!get_bits(&dec->reader, 1, &flag)) return false;
+        if (flag == 0) break;
+        prefix++;
+    }
+    if (prefix > 0) {
+        if (!get_bits(&dec->reader, dod_bits[prefix], &field)) return false;
+        dec->delta += (int64_t)field - dod_bias[prefix];
+    }
+    dec->ts += dec->delta;
+
+    /* XOR: '0' unchanged, '10' within the last window, '11' with a new window */
+    if (!get_bits(&dec->reader, 1, &flag)) return false;
+    if (flag == 1) {
+        if (!get_bits(&dec->reader, 1, &flag)) return false;
+        if (flag == 1) {
+            uint64_t significant;
+            if (!get_bits(&dec->reader, 5, &field) || !get_bits(&dec->reader, 6, &significant)) return false;
+            if (significant == 0) significant = 64;
+            if (field + significant > 64) return false;
+            dec->lead = (unsigned int)field;
+            dec->trail = 64 - dec->lead - (unsigned int)significant;
+        }
+        if (!get_bits(&dec->reader, 64 - dec->lead - dec->trail, &field)) return false;
+        dec->bits ^= field << dec->trail;
+    }
+    return true;
+}
+
+/**
+ * @brief Decodes one block, visiting its readings in [from, to].
+ * @return false if the visitor stopped the scan.
+ */
+static bool scan_block(const archive_block_header_t *header, sensor_ts_t from, sensor_ts_t to,
+                       archive_visit_fn visit, void *ctx, size_t *found) {
+    block_decoder_t dec = {
+        { (const uint8_t *)(header + 1), (size_t)header->payload_bytes * 8, 0 },
+        header->t_first, 0, double_bits(header->v_first), 0, 0
+    };
+    sensor_data_t reading;
+
+    reading.id = header->id;
+    for (uint16_t i = 0; i < header->count; ++i) {
+        if (i > 0 && !decode_next(&dec)) {
+            log_message(LOG_LEVEL_WARNING, "Archive block of sensor %u is cut short after %u of %u readings.",
+                        header->id, i, header->count);
+            break;
+        }
+        if (dec.ts >= (int64_t)from && dec.ts <= (int64_t)to) {
+            reading.ts = (sensor_ts_t)dec.ts;
+            reading.value = bits_double(dec.bits);
+            (*found)++;
+            if (!visit(&reading, ctx)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* --- Writer --- */
+
+gateway_error_t archive_open(archive_writer_t *archive, const char *dir) {
+    memset(archive, 0, sizeof(*archive));
+    archive->fd = -1;
+    if (dir == NULL || strlen(dir) >= sizeof(archive->dir)) {
+        errno = ENAMETOOLONG;
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    strcpy(archive->dir, dir);
+
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+        return ARCHIVE_IO_ERR;
+    }
+    return GATEWAY_SUCCESS;
+}
+
+void archive_close(archive_writer_t *archive) {
+    archive_flush(archive, 0);
+    if (archive->fd != -1) {
+        close(archive->fd);
+        archive->fd = -1;
+    }
+    free(archive->blocks);
+    archive->blocks = NULL;
+    archive->block_count = archive->block_capacity = 0;
+}
+
+gateway_error_t archive_append(archive_writer_t *archive, const sensor_data_t *data, size_t count) {
+    gateway_error_t ret = GATEWAY_SUCCESS;
+
+    for (size_t i = 0; i < count; ++i) {
+        archive_block_t *block = find_block(archive, data[i].id);
+        if (block == NULL) {
+            archive->dropped++;
+            ret = GATEWAY_ERROR_NOMEM;
+            continue;
+        }
+        if (block->count > 0 && (block->count == UINT16_MAX ||
+            block->bits + ARCHIVE_MAX_READING_BITS > sizeof(block->payload) * 8)) {
+            if (seal_block(archive, block) != GATEWAY_SUCCESS) {
+                ret = ARCHIVE_IO_ERR;
+            }
+        }
+        if (block->count == 0) {
+            start_block(block, &data[i]);
+        } else {
+            add_reading(block, &data[i]);
+        }
+    }
+    return ret;
+}
+
+gateway_error_t archive_flush(archive_writer_t *archive, unsigned int max_age_sec) {
+    gateway_error_t ret = GATEWAY_SUCCESS;
+    time_t now = time(NULL);
+
+    for (size_t i = 0; i < archive->block_count; ++i) {
+        archive_block_t *block = &archive->blocks[i];
+        if (block->count > 0 && (max_age_sec == 0 || now - block->opened >= (time_t)max_age_sec)) {
+            if (seal_block(archive, block) != GATEWAY_SUCCESS) {
+                ret = ARCHIVE_IO_ERR;
+            }
+        }
+    }
+    return ret;
+}
+
+/* --- Reader --- */
+
+gateway_error_t archive_scan(const char *dir, sensor_id_t id, sensor_ts_t from, sensor_ts_t to,
+                             archive_visit_fn visit, void *ctx, size_t *found) {
+    char **names = NULL;
+    size_t count = 0, capacity = 0;
+    size_t visited = 0;
+    gateway_error_t ret = GATEWAY_SUCCESS;
+    struct dirent *entry;
+    int last_day = utc_day(to);
+
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        return ARCHIVE_IO_ERR;
+    }
+    /* A file holds the blocks started on its day, which may reach into later days */
+    while ((entry = readdir(d)) != NULL) {
+        int day;
+        char tail;
+        if (sscanf(entry->d_name, "archive-%8d.ga%c", &day, &tail) != 2 || tail != 'r' || day > last_day) {
+            continue;
+        }
+        if (count == capacity) {
+            size_t new_capacity = capacity > 0 ? capacity * 2 : 16;
+            char **new_names = realloc(names, new_capacity * sizeof(char *));
+            if (new_names == NULL) {
+                ret = GATEWAY_ERROR_NOMEM;
+                break;
+            }
+            names = new_names;
+            capacity = new_capacity;
+        }
+        if ((names[count] = strdup(entry->d_name)) == NULL) {
+            ret = GATEWAY_ERROR_NOMEM;
+            break;
+        }
+        count++;
+    }
+    closedir(d);
+    qsort(names, count, sizeof(char *), compare_names);
+
+    bool more = true;
+    for (size_t i = 0; i < count && more && ret == GATEWAY_SUCCESS; ++i) {
+        char path[512];
+        struct stat st;
+
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1 || fstat(fd, &st) == -1) {
+            log_message(LOG_LEVEL_WARNING, "Failed to open archive file %s: %s", path, strerror(errno));
+            if (fd != -1) close(fd);
+            ret = ARCHIVE_IO_ERR;
+            break;
+        }
+        size_t size = (size_t)st.st_size;
+        void *map = (size > 0) ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (map == MAP_FAILED) {
+            continue; /* Empty, or being created */
+        }
+        if (file_header_valid(map, size)) {
+            const archive_block_header_t *header;
+            size_t off = sizeof(archive_file_header_t);
+            while (more && (header = block_at(map, size, off)) != NULL) {
+                if (header->id == id && header->t_max >= (int64_t)from && header->t_min <= (int64_t)to) {
+                    more = scan_block(header, from, to, visit, ctx, &visited);
+                }
+                off += ARCHIVE_ALIGN(sizeof(*header) + header->payload_bytes);
+            }
+        }
+        munmap(map, size);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        free(names[i]);
+    }
+    free(names);
+    if (found != NULL) {
+        *found = visited;
+    }
+    return ret;
+}
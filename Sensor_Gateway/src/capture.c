@@ -0,0 +1,187 @@
+/* --- Include Standard Libraries --- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <endian.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+/* --- Include Project-Specific Headers --- */
+#include "config.h"     /* For CONMGT_CAPTURE_BUFFER_SIZE */
+#include "logger.h"     /* For log_message */
+#include "capture.h"
+
+/* --- Module State --- */
+
+/* The capture file; every reactor appends under capture_mutex */
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *capture_file = NULL;
+static char *capture_buffer = NULL;   /* stdio buffer of capture_file */
+static bool capture_active = false;   /* Read without the lock to skip the call cheaply */
+static uint64_t last_us;              /* Monotonic arrival time of the previous record */
+static unsigned long long records_written;
+
+/* --- Helper Functions --- */
+
+/**
+ * @brief Returns CLOCK_MONOTONIC, or CLOCK_REALTIME with realtime set, in microseconds.
+ */
+static uint64_t clock_us(bool realtime) {
+    struct timespec now;
+    clock_gettime(realtime ? CLOCK_REALTIME : CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}
+
+/**
+ * @brief Encodes one record.
+ */
+static void encode_record(uint8_t *out, uint32_t delta_us, uint16_t stream, const sensor_data_t *reading) {
+    uint32_t delta = htole32(delta_us);
+    uint16_t stream_le = htole16(stream);
+    uint16_t id = htole16(reading->id);
+    uint64_t ts = htole64((uint64_t)(int64_t)reading->ts);
+    uint64_t bits;
+
+    memcpy(&bits, &reading->value, sizeof(bits));
+    bits = htole64(bits);
+    memcpy(out, &delta, sizeof(delta));
+    memcpy(out + 4, &stream_le, sizeof(stream_le));
+    memcpy(out + 6, &id, sizeof(id));
+    memcpy(out + 8, &ts, sizeof(ts));
+    memcpy(out + 16, &bits, sizeof(bits));
+}
+
+/**
+ * @brief Closes the file. Called with capture_mutex held.
+ * @return 0, or EOF if buffered records could not be written.
+ */
+static int close_locked(void) {
+    int rc = 0;
+    __atomic_store_n(&capture_active, false, __ATOMIC_RELAXED);
+    if (capture_file != NULL) {
+        rc = fclose(capture_file);
+        capture_file = NULL;
+    }
+    free(capture_buffer);
+    capture_buffer = NULL;
+    return rc;
+}
+
+/* --- Public Functions --- */
+
+gateway_error_t capture_open(const char *path) {
+    uint8_t header[CAPTURE_HEADER_SIZE];
+    uint64_t start = htole64(clock_us(true));
+
+    if (path == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&capture_mutex);
+    close_locked();
+    capture_file = fopen(path, "wb");
+    capture_buffer = malloc(CONMGT_CAPTURE_BUFFER_SIZE);
+    if (capture_file == NULL || capture_buffer == NULL) {
+        int saved = errno;
+        close_locked();
+        pthread_mutex_unlock(&capture_mutex);
+        errno = saved;
+        return CAPTURE_IO_ERR;
+    }
+    setvbuf(capture_file, capture_buffer, _IOFBF, CONMGT_CAPTURE_BUFFER_SIZE);
+
+    memcpy(header, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE);
+    memcpy(header + CAPTURE_MAGIC_SIZE, &start, sizeof(start));
+    if (fwrite(header, sizeof(header), 1, capture_file) != 1) {
+        int saved = errno;
+        close_locked();
+        pthread_mutex_unlock(&capture_mutex);
+        errno = saved;
+        return CAPTURE_IO_ERR;
+    }
+    last_us = clock_us(false);
+    records_written = 0;
+    __atomic_store_n(&capture_active, true, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&capture_mutex);
+
+    log_message(LOG_LEVEL_INFO, "Capturing received readings to '%s'.", path);
+    return GATEWAY_SUCCESS;
+}
+
+void capture_write(int stream, const sensor_data_t *readings, size_t count) {
+    uint8_t record[CAPTURE_RECORD_SIZE];
+
+    if (!__atomic_load_n(&capture_active, __ATOMIC_RELAXED) || count == 0) {
+        return;
+    }
+    pthread_mutex_lock(&capture_mutex);
+    if (capture_file == NULL) {
+        pthread_mutex_unlock(&capture_mutex);
+        return;
+    }
+    /* Taking the time under the lock keeps the records of all reactors in arrival order */
+    uint64_t now = clock_us(false);
+    uint64_t delta = now - last_us;
+    last_us = now;
+    for (size_t i = 0; i < count; ++i) {
+        encode_record(record, i == 0 ? (delta > UINT32_MAX ? UINT32_MAX : (uint32_t)delta) : 0,
+                      (uint16_t)stream, &readings[i]);
+        if (fwrite(record, sizeof(record), 1, capture_file) != 1) {
+            log_message(LOG_LEVEL_ERROR, "Capture stopped after %llu readings, write failed: %s",
+                        records_written, strerror(errno));
+            close_locked();
+            pthread_mutex_unlock(&capture_mutex);
+            return;
+        }
+        records_written++;
+    }
+    pthread_mutex_unlock(&capture_mutex);
+}
+
+void capture_close(void) {
+    pthread_mutex_lock(&capture_mutex);
+    if (capture_file == NULL) {
+        pthread_mutex_unlock(&capture_mutex);
+        return;
+    }
+    unsigned long long written = records_written;
+    int rc = close_locked();
+    pthread_mutex_unlock(&capture_mutex);
+
+    if (rc != 0) {
+        log_message(LOG_LEVEL_ERROR, "Capture file incomplete, final write failed: %s", strerror(errno));
+    } else {
+        log_message(LOG_LEVEL_INFO, "Capture closed with %llu readings.", written);
+    }
+}
+
+gateway_error_t capture_parse_header(const uint8_t *header, uint64_t *start_us) {
+    uint64_t start;
+    if (header == NULL || start_us == NULL || memcmp(header, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != 0) {
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    memcpy(&start, header + CAPTURE_MAGIC_SIZE, sizeof(start));
+    *start_us = le64toh(start);
+    return GATEWAY_SUCCESS;
+}
+
+void capture_decode_record(const uint8_t *data, capture_record_t *record) {
+    uint32_t delta;
+    uint16_t stream, id;
+    uint64_t ts, bits;
+
+    memcpy(&delta, data, sizeof(delta));
+    memcpy(&stream, data + 4, sizeof(stream));
+    memcpy(&id, data + 6, sizeof(id));
+    memcpy(&ts, data + 8, sizeof(ts));
+    memcpy(&bits, data + 16, sizeof(bits));
+    bits = le64toh(bits);
+
+    memset(record, 0, sizeof(*record));
+    record->delta_us = le32toh(delta);
+    record->stream = le16toh(stream);
+    record->reading.id = le16toh(id);
+    record->reading.ts = (sensor_ts_t)(int64_t)le64toh(ts);
+    memcpy(&record->reading.value, &bits, sizeof(bits));
+}
@@ -1,11 +1,18 @@
+#define _GNU_SOURCE /* For accept4() */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/un.h> // For UNIX domain sockets
 #include <sys/stat.h> // For socket file permissions if needed
+#include <sys/epoll.h> // For the event loop
+#include <sys/eventfd.h> // To wake the loop on cmdif_stop()
 #include <errno.h>
+#include <time.h> // For the session timeouts
 #include <pthread.h> // For thread safety if calling managers directly
 
 /* Include project-specific headers */
@@ -14,10 +21,46 @@
 #include "common.h" // For error codes maybe
 #include "conmgt.h" // To get connection info
 #include "sysmon.h" // To get system stats
+#include "pool.h" // For the 'memory' command
+#include "datamgt.h" // To reload the room-sensor map
+#include "db_handler.h" // For the read-only range queries
+#include "logger.h" // For the runtime log level
+#include "metrics.h" // For the Prometheus export
+#include "settings.h" // For the 'config' and 'set' commands
 
 /* Define buffer sizes for command and response handling */
-#define CMD_BUFFER_SIZE 128 /* Buffer size for incoming commands */
-#define RESPONSE_BUFFER_SIZE 4096 /* Buffer size for outgoing responses */
+#define CMD_BUFFER_SIZE 128 /* Longest command line */
+#define RESPONSE_BUFFER_SIZE 4096 /* Buffer size for fixed-size responses */
+#define CMD_EPOLL_EVENTS 16 /* Events taken per epoll_wait() */
+#define CMD_SUBSCRIBE_BATCH 256 /* Readings a subscription sends per loop iteration */
+#define CMD_SUBSCRIBE_MAX_IDS 64 /* Sensors one 'subscribe' lists at most */
+
+/**
+ * @brief One client connection. Commands are lines; a line still pending when the client
+ * shuts its write side down is run too, so one-shot clients need no newline. Responses are
+ * queued in out and sent as the socket accepts them; each ends with an empty line, which
+ * no response contains, so a persistent client can tell them apart.
+ */
+typedef struct cmd_session {
+    int sd;                             /* Client socket (non-blocking) */
+    char in[CMD_BUFFER_SIZE];           /* Received bytes not yet run as commands */
+    size_t in_len;
+    bool in_overflow;                   /* Discarding the rest of an overlong line */
+    bool peer_closed;                   /* The client sent EOF: close once out is sent */
+    char *out;                          /* Responses not yet sent */
+    size_t out_len;                     /* Bytes in out */
+    size_t out_sent;                    /* Bytes of out already sent */
+    size_t out_capacity;
+    bool has_stall;                     /* stall_start is set */
+    struct timespec stall_start;        /* When the socket first refused the pending output */
+    time_t last_active;                 /* Last command or progress, for CMD_SESSION_IDLE_SEC */
+    uint32_t events;                    /* Events requested from epoll */
+    datamgt_subscription_t *subscription; /* Live feed of a 'subscribe' command, NULL if none */
+    unsigned long feed_sent;            /* Readings of the feed sent */
+    unsigned long feed_dropped;         /* Readings of the feed lost because the client was slow */
+    unsigned long feed_reported;        /* feed_dropped when last reported to the client */
+    struct cmd_session *next;
+} cmd_session_t;
 
 /* Global flag to signal shutdown */
 static volatile int cmdif_terminate_flag = 0;
@@ -25,25 +68,749 @@ static volatile int cmdif_terminate_flag = 0;
 /* Listening socket descriptor */
 static int listen_sd = -1;
 
+/* Wakes the event loop for cmdif_stop() */
+static int wake_fd = -1;
+
+/* Open sessions, how many, and how many of them are subscribed */
+static cmd_session_t *sessions = NULL;
+static int session_count = 0;
+static int subscribed_count = 0;
+
+/* Shared buffer reported by the 'buffer' command */
+static sbuffer_t *shared_buffer = NULL;
+
+/* State of a 'query' command while its rows are formatted */
+typedef struct {
+    cmd_session_t *session;
+    size_t rows;                        /* Rows formatted so far */
+    db_query_agg_t agg;                 /* Row format */
+} query_stream_t;
+
+/* 
+ * Function: session_reserve
+ * -------------------------
+ * Makes room for at least extra more output bytes.
+ * Returns false if memory ran out (the output is then truncated).
+ */
+static bool session_reserve(cmd_session_t *session, size_t extra) {
+    if (session->out_capacity - session->out_len >= extra) {
+        return true;
+    }
+    if (session->out_sent > 0) {
+        /* Drop what was sent before growing */
+        memmove(session->out, session->out + session->out_sent, session->out_len - session->out_sent);
+        session->out_len -= session->out_sent;
+        session->out_sent = 0;
+        if (session->out_capacity - session->out_len >= extra) {
+            return true;
+        }
+    }
+    size_t capacity = session->out_capacity ? session->out_capacity : RESPONSE_BUFFER_SIZE;
+    while (capacity - session->out_len < extra) {
+        capacity *= 2;
+    }
+    char *out = realloc(session->out, capacity);
+    if (out == NULL) {
+        return false;
+    }
+    session->out = out;
+    session->out_capacity = capacity;
+    return true;
+}
+
+/* 
+ * Function: session_write
+ * -----------------------
+ * Queues bytes of a response.
+ */
+static void session_write(cmd_session_t *session, const char *text, size_t len) {
+    if (session_reserve(session, len)) {
+        memcpy(session->out + session->out_len, text, len);
+        session->out_len += len;
+    }
+}
+
+/* 
+ * Function: session_printf
+ * ------------------------
+ * Queues formatted text of a response.
+ */
+static void session_printf(cmd_session_t *session, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void session_printf(cmd_session_t *session, const char *format, ...) {
+    char line[512];
+    va_list args;
+
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (n > 0) {
+        session_write(session, line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+    }
+}
+
+/* 
+ * Function: session_pending
+ * -------------------------
+ * Bytes queued for the client and not sent yet.
+ */
+static size_t session_pending(const cmd_session_t *session) {
+    return session->out_len - session->out_sent;
+}
+
+/* 
+ * Function: stream_row
+ * --------------------
+ * db_query_fn formatting one result row; stops the query after CMD_QUERY_MAX_ROWS rows.
+ */
+static bool stream_row(const db_query_row_t *row, void *ctx) {
+    query_stream_t *stream = ctx;
+
+    if (stream->rows >= CMD_QUERY_MAX_ROWS) {
+        return false;
+    }
+    if (stream->agg == DB_QUERY_RAW) {
+        session_printf(stream->session, "%ld %.2f\n", (long)row->ts, row->avg);
+    } else if (row->count == 0) {
+        session_printf(stream->session, "%ld count=0\n", (long)row->ts);
+    } else {
+        session_printf(stream->session, "%ld count=%u avg=%.2f min=%.2f max=%.2f\n",
+                      (long)row->ts, row->count, row->avg, row->min, row->max);
+    }
+    stream->rows++;
+    return true;
+}
+
+/* 
+ * Function: handle_query
+ * ----------------------
+ * Runs 'query <sensor> <from> <to> [raw|summary|minute|hour]' on a read-only connection of
+ * its own and queues the rows for the client. In WAL mode the read never blocks the storage
+ * manager's inserts, and the snapshot is released before the rows are sent, however slowly
+ * the client reads them.
+ */
+static void handle_query(cmd_session_t *session, const char *args) {
+    query_stream_t stream;
+    unsigned int sensor_id;
+    long from, to;
+    char agg_name[16] = "raw";
+    db_handle_t *db = NULL;
+    size_t rows = 0;
+
+    memset(&stream, 0, sizeof(stream));
+    stream.session = session;
+
+    int fields = sscanf(args, "%u %ld %ld %15s", &sensor_id, &from, &to, agg_name);
+    if (fields < 3 || sensor_id > UINT16_MAX || from > to) {
+        session_printf(session, "ERROR: Usage: query <sensor> <from> <to> [raw|summary|minute|hour] (Unix times, from <= to)\n");
+        return;
+    }
+    if (strcmp(agg_name, "raw") == 0) {
+        stream.agg = DB_QUERY_RAW;
+    } else if (strcmp(agg_name, "summary") == 0) {
+        stream.agg = DB_QUERY_SUMMARY;
+    } else if (strcmp(agg_name, "minute") == 0) {
+        stream.agg = DB_QUERY_MINUTE;
+    } else if (strcmp(agg_name, "hour") == 0) {
+        stream.agg = DB_QUERY_HOUR;
+    } else {
+        session_printf(session, "ERROR: Unknown aggregation '%s'. Use 'raw', 'summary', 'minute' or 'hour'.\n", agg_name);
+        return;
+    }
+
+    if (db_connect_readonly(DB_NAME, &db) != GATEWAY_SUCCESS) {
+        session_printf(session, "ERROR: Database %s not available\n", DB_NAME);
+        return;
+    }
+    session_printf(session, "--- Sensor %u, %ld..%ld, %s ---\n", sensor_id, from, to, agg_name);
+    gateway_error_t ret = db_query_range(db, (sensor_id_t)sensor_id, (sensor_ts_t)from, (sensor_ts_t)to,
+                                         stream.agg, stream_row, &stream, &rows);
+    db_disconnect(db);
+
+    if (ret != GATEWAY_SUCCESS) {
+        session_printf(session, "ERROR: Query failed (Error %d)\n", ret);
+    } else if (stream.rows >= CMD_QUERY_MAX_ROWS) {
+        session_printf(session, "--- %zu rows (limit reached, narrow the range) ---\n", stream.rows);
+    } else {
+        session_printf(session, "--- %zu rows ---\n", stream.rows);
+    }
+}
+
+/* 
+ * Function: metric_line
+ * ---------------------
+ * metrics_write_fn queueing one exported line.
+ */
+static void metric_line(const char *text, size_t len, void *ctx) {
+    session_write((cmd_session_t *)ctx, text, len);
+}
+
+/* 
+ * Function: handle_status
+ * -----------------------
+ * Reports the connections and the latest sysmon snapshot: system, per-core and
+ * per-thread CPU usage over the last sample interval, and RAM usage.
+ */
+static void handle_status(cmd_session_t *session) {
+    static system_stats_t sys_stats; /* Only the cmdif thread runs commands */
+    int active_conn = conmgt_get_active_connections();
+
+    session_printf(session, "--- System Status ---\nActive Connections: %d\n", active_conn);
+    if (sysmon_get_stats(&sys_stats) != 0) {
+        session_printf(session, "ERROR: Could not retrieve system stats \n");
+        return;
+    }
+    session_printf(session,
+            "CPU Usage: %.2f %% (over %.2f s)\n"
+            "RAM Usage: %.2f %% (%ld / %ld KB used)\n",
+            sys_stats.cpu_usage_percent, sys_stats.interval_sec,
+            sys_stats.ram_usage_percent, sys_stats.ram_used_kb, sys_stats.ram_total_kb);
+    for (int i = 0; i < sys_stats.cpu_count; ++i) {
+        session_printf(session, "%s cpu%d %5.1f %%%s", i == 0 ? "Cores:" : (i % 8 == 0 ? "      " : ""), i,
+                       sys_stats.core_usage_percent[i], i % 8 == 7 || i == sys_stats.cpu_count - 1 ? "\n" : "");
+    }
+    session_printf(session, "Gateway CPU: %.2f %% of one core, %d threads\n"
+                            "%8s  %-15s  %7s\n",
+                   sys_stats.process_cpu_percent, sys_stats.thread_count, "TID", "Thread", "CPU %");
+    for (int i = 0; i < sys_stats.thread_count; ++i) {
+        session_printf(session, "%8d  %-15s  %7.2f\n", sys_stats.threads[i].tid, sys_stats.threads[i].name,
+                       sys_stats.threads[i].cpu_percent);
+    }
+}
+
+/* 
+ * Function: handle_subscribe
+ * --------------------------
+ * Runs 'subscribe [room <id> | <sensor>[,<sensor>...]]': the session receives every matching
+ * reading as "<timestamp> <sensor> <value>" lines until it sends another line.
+ */
+static void handle_subscribe(cmd_session_t *session, const char *args) {
+    sensor_id_t ids[CMD_SUBSCRIBE_MAX_IDS];
+    size_t count = 0;
+    int room_id = -1;
+    char description[64];
+
+    args += strspn(args, " ");
+    if (strncmp(args, "room", 4) == 0 && (args[4] == ' ' || args[4] == '\0')) {
+        char *end;
+        long room = strtol(args + 4, &end, 10);
+        if (end == args + 4 || *end != '\0' || room < 0 || room > INT32_MAX) {
+            session_printf(session, "ERROR: Usage: subscribe [room <id> | <sensor>[,<sensor>...]]\n\n");
+            return;
+        }
+        room_id = (int)room;
+        snprintf(description, sizeof(description), "room %d", room_id);
+    } else {
+        const char *p = args;
+        while (*p != '\0') {
+            char *end;
+            long id = strtol(p, &end, 10);
+            if (end == p || id < 0 || id > UINT16_MAX || count == CMD_SUBSCRIBE_MAX_IDS) {
+                session_printf(session, "ERROR: Usage: subscribe [room <id> | <sensor>[,<sensor>...]] (at most %d sensors)\n\n",
+                               CMD_SUBSCRIBE_MAX_IDS);
+                return;
+            }
+            ids[count++] = (sensor_id_t)id;
+            p = end + strspn(end, " ,");
+        }
+        if (count == 0) {
+            snprintf(description, sizeof(description), "all sensors");
+        } else {
+            snprintf(description, sizeof(description), "%zu sensor%s", count, count == 1 ? "" : "s");
+        }
+    }
+
+    if (datamgt_subscribe(room_id, ids, count, &session->subscription) != GATEWAY_SUCCESS) {
+        session_printf(session, "ERROR: Too many subscriptions (at most %d)\n\n", DATAMGT_MAX_SUBSCRIBERS);
+        session->subscription = NULL;
+        return;
+    }
+    session->feed_sent = 0;
+    session->feed_dropped = 0;
+    session->feed_reported = 0;
+    subscribed_count++;
+    session_printf(session, "--- Subscribed to %s, send any line to stop ---\n", description);
+}
+
+/* 
+ * Function: end_subscription
+ * --------------------------
+ * Stops the live feed of a session and ends its response.
+ */
+static void end_subscription(cmd_session_t *session) {
+    datamgt_unsubscribe(session->subscription);
+    session->subscription = NULL;
+    subscribed_count--;
+    session_printf(session, "--- Subscription ended (%lu readings, %lu dropped) ---\n\n",
+                   session->feed_sent, session->feed_dropped);
+}
+
+/* 
+ * Function: session_pump
+ * ----------------------
+ * Queues readings of a session's live feed, as long as the client keeps up; readings it
+ * doesn't take in time are overwritten in the feed, never held back in the data manager.
+ */
+static void session_pump(cmd_session_t *session) {
+    sensor_data_t readings[CMD_SUBSCRIBE_BATCH];
+
+    while (session_pending(session) <= CMD_SESSION_PENDING_MAX) {
+        size_t n = datamgt_subscription_read(session->subscription, readings, CMD_SUBSCRIBE_BATCH, &session->feed_dropped);
+        if (session->feed_dropped != session->feed_reported) {
+            session_printf(session, "# dropped %lu readings\n", session->feed_dropped - session->feed_reported);
+            session->feed_reported = session->feed_dropped;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            session_printf(session, "%ld %u %.2f\n", (long)readings[i].ts, readings[i].id, readings[i].value);
+        }
+        session->feed_sent += n;
+        if (n < CMD_SUBSCRIBE_BATCH) {
+            break;
+        }
+    }
+}
+
+/* 
+ * Function: execute_command
+ * -------------------------
+ * Runs one command line and queues its response.
+ */
+static void execute_command(cmd_session_t *session, const char *command) {
+    static char response_buffer[RESPONSE_BUFFER_SIZE]; /* Only the cmdif thread runs commands */
+
+    printf("DEBUG: Received command: '%s'\n", command);
+    response_buffer[0] = '\0';
+    if (strcmp(command, "stats") == 0) {
+        /* Retrieve connection stats */
+        int count = conmgt_get_connection_stats(response_buffer, sizeof(response_buffer));
+        if (count < 0) {
+            snprintf(response_buffer, sizeof(response_buffer), "ERROR: Failed to get stats or buffer too small\n");
+        } else if (count == 0) {
+            snprintf(response_buffer, sizeof(response_buffer), "No active connections.\n");
+        }
+
+    } else if (strcmp(command, "status") == 0) {
+        /* Queues its own response, which grows with the cores and threads */
+        handle_status(session);
+
+    } else if (strcmp(command, "buffer") == 0) {
+        /* Retrieve shared buffer sizing counters */
+        sbuffer_stats_t sb_stats;
+        if (shared_buffer == NULL) {
+            snprintf(response_buffer, sizeof(response_buffer), "ERROR: Shared buffer not available\n");
+        } else {
+            sbuffer_get_stats(shared_buffer, &sb_stats);
+            snprintf(response_buffer, sizeof(response_buffer),
+                    "--- Shared Buffer ---\n"
+                    "Capacity: %zu (max %zu, grown %lu times)\n"
+                    "Queued: %zu\n"
+                    "High Watermark: %zu\n"
+                    "Blocked Inserts: %lu (%.3f s total)\n",
+                    sb_stats.capacity, sb_stats.max_capacity, sb_stats.grow_events,
+                    sb_stats.count,
+                    sb_stats.high_watermark,
+                    sb_stats.blocked_inserts, sb_stats.blocked_time_us / 1e6);
+        }
+
+    } else if (strcmp(command, "reload") == 0) {
+        /* Re-read the room-sensor map and swap it in for the data manager */
+        int entries = 0;
+        gateway_error_t reload_ret = datamgt_reload_room_sensor_map(&entries);
+        if (reload_ret == GATEWAY_SUCCESS) {
+            snprintf(response_buffer, sizeof(response_buffer), "Room sensor map reloaded (%d entries).\n", entries);
+        } else {
+            snprintf(response_buffer, sizeof(response_buffer), "ERROR: Failed to reload room sensor map (Error %d), current map kept.\n", reload_ret);
+        }
+
+    } else if (strcmp(command, "loglevel") == 0 || strncmp(command, "loglevel ", 9) == 0) {
+        /* Show or change the most verbose level that is logged */
+        log_level_t level;
+        const char *name = command + 8;
+        name += strspn(name, " ");
+        if (*name != '\0' && !logger_parse_level(name, &level)) {
+            snprintf(response_buffer, sizeof(response_buffer), "ERROR: Unknown log level '%s'. Use 'fatal', 'error', 'warning', 'info' or 'debug'.\n", name);
+        } else {
+            if (*name != '\0') {
+                logger_set_level(level);
+                log_message(LOG_LEVEL_INFO, "Log level set to %s via command interface.", name);
+            }
+            level = logger_get_level();
+            snprintf(response_buffer, sizeof(response_buffer), "Log level: %s (built in up to %s)\n",
+                     logger_level_name(level), logger_level_name((log_level_t)LOG_COMPILE_LEVEL));
+        }
+
+    } else if (strcmp(command, "logstats") == 0) {
+        /* Messages sent, dropped and delayed per level, and how often the log FIFO was full */
+        logger_stats_t log_stats;
+        logger_get_stats(&log_stats);
+        snprintf(response_buffer, sizeof(response_buffer),
+                "--- Logger ---\n"
+                "Level: %s\n"
+                "         %10s %10s %10s\n"
+                "fatal    %10lu %10lu %10lu\n"
+                "error    %10lu %10lu %10lu\n"
+                "warning  %10lu %10lu %10lu\n"
+                "info     %10lu %10lu %10lu\n"
+                "debug    %10lu %10lu %10lu\n"
+                "FIFO full: %lu times (%.3f s total)\n",
+                logger_level_name(logger_get_level()), "sent", "dropped", "delayed",
+                log_stats.sent[LOG_LEVEL_FATAL], log_stats.dropped[LOG_LEVEL_FATAL], log_stats.delayed[LOG_LEVEL_FATAL],
+                log_stats.sent[LOG_LEVEL_ERROR], log_stats.dropped[LOG_LEVEL_ERROR], log_stats.delayed[LOG_LEVEL_ERROR],
+                log_stats.sent[LOG_LEVEL_WARNING], log_stats.dropped[LOG_LEVEL_WARNING], log_stats.delayed[LOG_LEVEL_WARNING],
+                log_stats.sent[LOG_LEVEL_INFO], log_stats.dropped[LOG_LEVEL_INFO], log_stats.delayed[LOG_LEVEL_INFO],
+                log_stats.sent[LOG_LEVEL_DEBUG], log_stats.dropped[LOG_LEVEL_DEBUG], log_stats.delayed[LOG_LEVEL_DEBUG],
+                log_stats.fifo_stalls, log_stats.fifo_stall_us / 1e6);
+
+    } else if (strcmp(command, "latency") == 0) {
+        /* Quantiles of the time readings take from receipt to each pipeline stage */
+        static const struct { const char *stage; metric_histogram_t histogram; } stages[] = {
+            { "dequeue", METRIC_LATENCY_DEQUEUE_US },
+            { "processed", METRIC_LATENCY_PROCESSED_US },
+            { "committed", METRIC_LATENCY_COMMITTED_US },
+        };
+        size_t len = (size_t)snprintf(response_buffer, sizeof(response_buffer),
+                                      "--- End-to-end Latency (us, from receipt) ---\n"
+                                      "%-10s %12s %10s %10s %10s\n", "stage", "readings", "p50", "p99", "p999");
+        for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]) && len < sizeof(response_buffer); ++i) {
+            uint64_t count = 0;
+            uint64_t p50 = metrics_quantile(stages[i].histogram, 0.5, &count);
+            uint64_t p99 = metrics_quantile(stages[i].histogram, 0.99, NULL);
+            uint64_t p999 = metrics_quantile(stages[i].histogram, 0.999, NULL);
+            len += (size_t)snprintf(response_buffer + len, sizeof(response_buffer) - len,
+                                    "%-10s %12llu %10llu %10llu %10llu\n", stages[i].stage,
+                                    (unsigned long long)count, (unsigned long long)p50,
+                                    (unsigned long long)p99, (unsigned long long)p999);
+        }
+
+    } else if (strcmp(command, "metrics") == 0) {
+        /* Queued line by line, the histograms alone exceed response_buffer */
+        metrics_export(metric_line, session);
+
+    } else if (strcmp(command, "memory") == 0) {
+        /* Memory reserved by the object pools */
+        pool_stats_t pools[POOL_MAX_POOLS];
+        int count = pool_get_stats(pools, POOL_MAX_POOLS);
+        int offset = snprintf(response_buffer, sizeof(response_buffer),
+                              "--- Memory Pools ---\n%-22s %7s %9s %9s %9s %8s %11s\n",
+                              "Pool", "Object", "Capacity", "In use", "Peak", "Failed", "Reserved");
+        size_t reserved_total = 0;
+        for (int i = 0; i < count && offset < (int)sizeof(response_buffer); ++i) {
+            size_t reserved = pools[i].object_size * pools[i].capacity;
+            reserved_total += reserved;
+            offset += snprintf(response_buffer + offset, sizeof(response_buffer) - offset,
+                               "%-22s %7zu %9zu %9zu %9zu %8lu %7.1f MiB\n", pools[i].name, pools[i].object_size,
+                               pools[i].capacity, pools[i].in_use, pools[i].peak, pools[i].failures,
+                               (double)reserved / (1024.0 * 1024.0));
+        }
+        if (offset < (int)sizeof(response_buffer)) {
+            snprintf(response_buffer + offset, sizeof(response_buffer) - offset,
+                     "Total reserved: %.1f MiB\nReadings dropped without a sensor stats entry: %llu\n",
+                     (double)reserved_total / (1024.0 * 1024.0),
+                     (unsigned long long)metrics_counter_total(METRIC_DATAMGT_UNTRACKED));
+        }
+
+    } else if (strcmp(command, "config") == 0) {
+        /* Every setting, its value and when a change applies */
+        size_t len = (size_t)snprintf(response_buffer, sizeof(response_buffer), "--- Settings ---\n%-28s %-12s %s\n",
+                                      "Setting", "Value", "Applies");
+        settings_format(response_buffer + len, sizeof(response_buffer) - len);
+
+    } else if (strncmp(command, "set ", 4) == 0) {
+        /* Change a runtime or reload setting: set <name> <value> */
+        char name[64], value[SETTINGS_TEXT_MAX], error[256];
+        if (sscanf(command + 4, "%63s %255s", name, value) != 2) {
+            snprintf(response_buffer, sizeof(response_buffer), "ERROR: Usage: set <name> <value>. See 'config' for the settings.\n");
+        } else if (settings_set(name, value, true, error, sizeof(error)) != GATEWAY_SUCCESS) {
+            snprintf(response_buffer, sizeof(response_buffer), "ERROR: %s.\n", error);
+        } else {
+            bool on_reload = strcmp(settings_applies(name), "reload") == 0;
+            log_message(LOG_LEVEL_INFO, "Setting %s set to %s via command interface.", name, value);
+            snprintf(response_buffer, sizeof(response_buffer), "%s set to %s%s.\n", name, value,
+                     on_reload ? ", applies at the next 'reload'" : "");
+        }
+
+    } else if (strcmp(command, "subscribe") == 0 || strncmp(command, "subscribe ", 10) == 0) {
+        /* Streams until the session sends another line, and has no end marker until then */
+        handle_subscribe(session, command + 9);
+        return;
+
+    } else if (strcmp(command, "unsubscribe") == 0) {
+        snprintf(response_buffer, sizeof(response_buffer), "No active subscription.\n");
+
+    } else if (strncmp(command, "query ", 6) == 0) {
+        /* Queues its own response, which may be far larger than response_buffer */
+        handle_query(session, command + 6);
+
+    } else {
+        /* Handle unknown commands */
+        snprintf(response_buffer, sizeof(response_buffer), "ERROR: Unknown command '%s'. Use 'stats', 'status', 'buffer', 'reload', 'loglevel', 'logstats', 'latency', 'metrics', 'memory', 'config', 'set', 'subscribe' or 'query'.\n", command);
+    }
+
+
+    session_write(session, response_buffer, strlen(response_buffer));
+    session_write(session, "\n", 1); /* End of the response */
+}
+
+/* 
+ * Function: session_flush
+ * -----------------------
+ * Sends as much pending output as the socket takes without blocking.
+ * Returns false if the client is gone.
+ */
+static bool session_flush(cmd_session_t *session) {
+    while (session->out_sent < session->out_len) {
+        ssize_t n = send(session->sd, session->out + session->out_sent,
+                         session->out_len - session->out_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!session->has_stall) {
+                clock_gettime(CLOCK_MONOTONIC, &session->stall_start);
+                session->has_stall = true;
+            }
+            return true;
+        }
+        if (n < 0) {
+            if (errno != EPIPE && errno != ECONNRESET) {
+                perror("ERROR: cmdif send() failed");
+            }
+            return false;
+        }
+        session->out_sent += (size_t)n;
+        session->has_stall = false;
+        session->last_active = time(NULL);
+    }
+    session->out_len = 0;
+    session->out_sent = 0;
+    if (session->out_capacity > CMD_SESSION_KEEP_BYTES) {
+        /* Give back the memory of a large query once it is sent */
+        free(session->out);
+        session->out = NULL;
+        session->out_capacity = 0;
+    }
+    return true;
+}
+
+/* 
+ * Function: session_run_commands
+ * ------------------------------
+ * Runs the complete lines received so far, pausing while more than CMD_SESSION_PENDING_MAX
+ * bytes wait to be sent so that a client that doesn't read can't make the output grow.
+ * After EOF, a final line without a newline is run too.
+ */
+static void session_run_commands(cmd_session_t *session) {
+    while (session_pending(session) <= CMD_SESSION_PENDING_MAX) {
+        char *newline = memchr(session->in, '\n', session->in_len);
+        size_t line_len;
+        if (newline != NULL) {
+            line_len = (size_t)(newline - session->in);
+        } else if (session->peer_closed && session->in_len > 0) {
+            line_len = session->in_len;
+        } else {
+            return;
+        }
+
+        bool skip = session->in_overflow; /* The tail of an overlong line */
+        session->in_overflow = false;
+        session->in[line_len] = '\0'; /* The newline, or the spare byte of in */
+        char *command = session->in;
+        command[strcspn(command, "\r")] = '\0';
+        if (session->subscription != NULL) {
+            end_subscription(session); /* Any line ends a live feed */
+            skip = skip || strcmp(command, "unsubscribe") == 0;
+        }
+        if (!skip && command[0] != '\0') {
+            execute_command(session, command);
+        }
+
+        size_t consumed = (newline != NULL) ? line_len + 1 : line_len;
+        memmove(session->in, session->in + consumed, session->in_len - consumed);
+        session->in_len -= consumed;
+        session->last_active = time(NULL);
+    }
+}
+
+/* 
+ * Function: session_update_events
+ * -------------------------------
+ * Watches for writability only while output is pending, and for input only while
+ * commands may run and the client has not shut its side down.
+ */
+static void session_update_events(int epoll_fd, cmd_session_t *session) {
+    uint32_t wanted = session_pending(session) > 0 ? EPOLLOUT : (session->peer_closed ? 0 : EPOLLIN);
+    if (wanted == session->events) {
+        return;
+    }
+    struct epoll_event event = { .events = wanted, .data.ptr = session };
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, session->sd, &event);
+    session->events = wanted;
+}
+
+/* 
+ * Function: session_close
+ * -----------------------
+ * Unlinks, closes and frees a session.
+ */
+static void session_close(cmd_session_t *session) {
+    for (cmd_session_t **link = &sessions; *link != NULL; link = &(*link)->next) {
+        if (*link == session) {
+            *link = session->next;
+            break;
+        }
+    }
+    if (session->subscription != NULL) {
+        datamgt_unsubscribe(session->subscription);
+        subscribed_count--;
+    }
+    close(session->sd); /* Also removes it from the epoll set */
+    free(session->out);
+    free(session);
+    session_count--;
+    printf("INFO: cmdif closed connection\n");
+}
+
+/* 
+ * Function: session_open
+ * ----------------------
+ * Accepts every pending connection, up to CMD_MAX_SESSIONS open at once.
+ */
+static void session_open(int epoll_fd) {
+    for (;;) {
+        int client_sd = accept4(listen_sd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_sd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && !cmdif_terminate_flag) {
+                perror("ERROR: cmdif accept() failed");
+            }
+            return;
+        }
+        if (session_count >= CMD_MAX_SESSIONS) {
+            static const char busy[] = "ERROR: Too many command sessions\n\n";
+            if (send(client_sd, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+                /* The client is dropped either way */
+            }
+            close(client_sd);
+            continue;
+        }
+        cmd_session_t *session = calloc(1, sizeof(cmd_session_t));
+        if (session == NULL) {
+            close(client_sd);
+            continue;
+        }
+        session->sd = client_sd;
+        session->last_active = time(NULL);
+        session->events = EPOLLIN;
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = session };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_sd, &event) < 0) {
+            perror("ERROR: cmdif epoll_ctl() failed");
+            close(client_sd);
+            free(session);
+            continue;
+        }
+        session->next = sessions;
+        sessions = session;
+        session_count++;
+        printf("INFO: cmdif received connection\n");
+    }
+}
+
+/* 
+ * Function: session_handle
+ * ------------------------
+ * Reads and runs commands, or sends pending output, depending on the events.
+ * Returns false once the session should be closed.
+ */
+static bool session_handle(cmd_session_t *session, uint32_t events) {
+    if (events & (EPOLLHUP | EPOLLERR)) {
+        return false; /* Both directions are gone, nothing more can be sent */
+    }
+    if (events & EPOLLOUT) {
+        if (!session_flush(session)) {
+            return false;
+        }
+    }
+    if ((events & EPOLLIN) && session_pending(session) == 0) {
+        for (;;) {
+            size_t room = sizeof(session->in) - 1 - session->in_len;
+            if (room == 0) {
+                /* No newline in a full line buffer: run nothing until the next one */
+                if (!session->in_overflow) {
+                    session_printf(session, "ERROR: Command longer than %d bytes\n\n", CMD_BUFFER_SIZE - 2);
+                }
+                session->in_overflow = true;
+                session->in_len = 0;
+                room = sizeof(session->in) - 1;
+            }
+            ssize_t n = read(session->sd, session->in + session->in_len, room);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (n < 0) {
+                perror("ERROR: cmdif read() failed");
+                return false;
+            }
+            if (n == 0) {
+                session->peer_closed = true;
+                break;
+            }
+            session->in_len += (size_t)n;
+            if (memchr(session->in + session->in_len - (size_t)n, '\n', (size_t)n) != NULL) {
+                break; /* Run what arrived before reading on */
+            }
+        }
+    }
+    session_run_commands(session);
+    if (!session_flush(session)) {
+        return false;
+    }
+    /* Done once the client hung up and everything it asked for was sent; a live feed goes on
+     * until the client goes away (cmd_client shuts its side down after sending the command) */
+    return !(session->peer_closed && session_pending(session) == 0 && session->subscription == NULL);
+}
+
+/* 
+ * Function: sessions_expire
+ * -------------------------
+ * Closes sessions whose client stopped reading for CMD_SEND_TIMEOUT_MS, or went idle for
+ * CMD_SESSION_IDLE_SEC.
+ */
+static void sessions_expire(void) {
+    struct timespec now;
+    time_t wall = time(NULL);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    cmd_session_t *session = sessions;
+    while (session != NULL) {
+        cmd_session_t *next = session->next;
+        long stalled_ms = session->has_stall ? (now.tv_sec - session->stall_start.tv_sec) * 1000L +
+                                               (now.tv_nsec - session->stall_start.tv_nsec) / 1000000L : 0;
+        if (stalled_ms >= CMD_SEND_TIMEOUT_MS) {
+            printf("INFO: cmdif dropping a client that stopped reading its response\n");
+            session_close(session);
+        } else if (session->subscription == NULL && wall - session->last_active >= CMD_SESSION_IDLE_SEC) {
+            session_close(session);
+        }
+        session = next;
+    }
+}
+
 /* 
  * Function: cmdif_stop
  * --------------------
- * Stops the command interface by signaling the termination flag, 
- * closing the listening socket, and cleaning up the socket file.
+ * Stops the command interface by signaling the termination flag and waking its
+ * event loop, which closes the sockets and removes the socket file.
  */
 void cmdif_stop(void) {
     /* Set the flag to signal the loop to exit */
     cmdif_terminate_flag = 1;
 
-    /* Forcefully close the listening socket to unblock accept() */
-    if (listen_sd != -1) {
-        /* Shutdown the socket for both read and write operations */
-        shutdown(listen_sd, SHUT_RDWR);
-        close(listen_sd);
-        listen_sd = -1;
-
-        /* Remove the socket file to clean up */
-        unlink(CMD_SOCKET_PATH);
+    if (wake_fd != -1) {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0) {
+            perror("ERROR: cmdif wake-up failed");
+        }
     }
 
     /* Log the stop request */
@@ -53,8 +820,8 @@ void cmdif_stop(void) {
 /* 
  * Function: cmdif_run
  * -------------------
- * Runs the command interface in a separate thread. It listens for incoming 
- * client connections, processes commands, and sends appropriate responses.
+ * Runs the command interface in a separate thread: one epoll loop over the listening
+ * socket and every client session, so a slow or stuck client never holds up the others.
  * 
  * Parameters:
  *   arg - Pointer to cmdif_args_t structure containing configuration arguments.
@@ -63,18 +830,19 @@ void cmdif_stop(void) {
  *   NULL - Always returns NULL when the thread exits.
  */
 void *cmdif_run(void *arg) {
-    int client_sd;
-    struct sockaddr_un server_addr, client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    char command_buffer[CMD_BUFFER_SIZE]; /* Buffer to store incoming commands */
-    char response_buffer[RESPONSE_BUFFER_SIZE]; /* Buffer to store responses */
+    struct sockaddr_un server_addr;
+    struct epoll_event events[CMD_EPOLL_EVENTS];
+    int epoll_fd = -1;
+
+    pthread_setname_np(pthread_self(), "cmdif");
 
     /* Parse arguments for socket path */
     cmdif_args_t *args = (cmdif_args_t *)arg;
     const char *socket_path = (args && args->socket_path) ? args->socket_path : CMD_SOCKET_PATH;
+    shared_buffer = args ? args->buffer : NULL;
 
     /* Create a UNIX domain socket */
-    listen_sd = socket(AF_UNIX, SOCK_STREAM, 0);
+    listen_sd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (listen_sd < 0) {
         perror("ERROR: cmdif socket() failed");
         return NULL;
@@ -98,7 +866,7 @@ void *cmdif_run(void *arg) {
     }
 
     /* Start listening for incoming connections */
-    if (listen(listen_sd, 5) < 0) { /* Backlog of 5 */
+    if (listen(listen_sd, CMD_MAX_SESSIONS) < 0) {
         perror("ERROR: cmdif listen() failed");
         close(listen_sd);
         listen_sd = -1;
@@ -106,91 +874,70 @@ void *cmdif_run(void *arg) {
         return NULL;
     }
 
-    /* Log that the command interface is ready */
-    printf("INFO: Command interface listening on %s\n", socket_path);
+    /* Watch the listening socket and the stop event */
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event listen_event = { .events = EPOLLIN, .data.ptr = NULL };
+    struct epoll_event wake_event = { .events = EPOLLIN, .data.ptr = &wake_fd };
+    if (epoll_fd < 0 || wake_fd < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_sd, &listen_event) < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &wake_event) < 0) {
+        perror("ERROR: cmdif epoll setup failed");
+        cmdif_terminate_flag = 1;
+    } else {
+        /* Log that the command interface is ready */
+        printf("INFO: Command interface listening on %s\n", socket_path);
+    }
 
-    /* Main loop to accept and process client connections */
+    /* Main loop: a timeout of a second is enough to expire sessions, live feeds are polled more often */
     while (!cmdif_terminate_flag) {
-        /* Accept a new client connection */
-        client_sd = accept(listen_sd, (struct sockaddr *)&client_addr, &client_len);
-        if (client_sd < 0) {
-            if (cmdif_terminate_flag) {
-                /* Log if the accept call was interrupted by shutdown */
-                printf("INFO: cmdif accept() interrupted by shutdown.\n");
-            } else {
-                perror("ERROR: cmdif accept() failed");
+        int ready = epoll_wait(epoll_fd, events, CMD_EPOLL_EVENTS, subscribed_count > 0 ? CMD_SUBSCRIBE_POLL_MS : 1000);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-            break; /* Exit loop on error or shutdown */
+            perror("ERROR: cmdif epoll_wait() failed");
+            break;
         }
-
-        /* Log that a connection was received */
-        printf("INFO: cmdif received connection\n");
-
-        /* Read the command from the client */
-        memset(command_buffer, 0, sizeof(command_buffer));
-        ssize_t bytes_read = read(client_sd, command_buffer, sizeof(command_buffer) - 1);
-
-        if (bytes_read > 0) {
-            /* Remove trailing newline/whitespace from the command */
-            command_buffer[strcspn(command_buffer, "\r\n")] = 0;
-            printf("DEBUG: Received command: '%s'\n", command_buffer);
-
-            /* Process the received command */
-            memset(response_buffer, 0, sizeof(response_buffer));
-            if (strcmp(command_buffer, "stats") == 0) {
-                /* Retrieve connection stats */
-                int count = conmgt_get_connection_stats(response_buffer, sizeof(response_buffer));
-                if (count < 0) {
-                    snprintf(response_buffer, sizeof(response_buffer), "ERROR: Failed to get stats or buffer too small\n");
-                } else if (count == 0) {
-                    snprintf(response_buffer, sizeof(response_buffer), "No active connections.\n");
+        for (int i = 0; i < ready && !cmdif_terminate_flag; ++i) {
+            if (events[i].data.ptr == NULL) {
+                session_open(epoll_fd);
+            } else if (events[i].data.ptr != &wake_fd) {
+                cmd_session_t *session = events[i].data.ptr;
+                if (session_handle(session, events[i].events)) {
+                    session_update_events(epoll_fd, session);
+                } else {
+                    session_close(session);
                 }
-
-            } else if (strcmp(command_buffer, "status") == 0) {
-                /* Retrieve system and connection status */
-                int active_conn = conmgt_get_active_connections();
-                system_stats_t sys_stats;
-                int sysmon_ret = sysmon_get_stats(&sys_stats);
-
-                snprintf(response_buffer, sizeof(response_buffer),
-                        "--- System Status ---\n"
-                        "Active Connections: %d\n"
-                        "CPU Usage: %.2f %%\n"
-                        "RAM Usage: %.2f %% (%ld / %ld KB used)\n"
-                        "%s",
-                        active_conn,
-                        sysmon_ret == 0 ? sys_stats.cpu_usage_percent : -1.0,
-                        sysmon_ret == 0 ? sys_stats.ram_usage_percent : -1.0,
-                        sysmon_ret == 0 ? sys_stats.ram_used_kb : -1L,
-                        sysmon_ret == 0 ? sys_stats.ram_total_kb : -1L,
-                        sysmon_ret != 0 ? "ERROR: Could not retrieve system stats \n" : ""
-                        );
-
-            } else {
-                /* Handle unknown commands */
-                snprintf(response_buffer, sizeof(response_buffer), "ERROR: Unknown command '%s'. Use 'stats' or 'status'.\n", command_buffer);
             }
-
-            /* Send the response back to the client */
-            if (write(client_sd, response_buffer, strlen(response_buffer)) < 0) {
-                perror("ERROR: cmdif write() failed");
+        }
+        for (cmd_session_t *session = sessions, *next; session != NULL; session = next) {
+            next = session->next;
+            if (session->subscription == NULL) {
+                continue;
+            }
+            session_pump(session);
+            if (session_flush(session)) {
+                session_update_events(epoll_fd, session);
+            } else {
+                session_close(session);
             }
-
-        } else if (bytes_read == 0) {
-            /* Log if the client disconnected without sending a command */
-            printf("INFO: cmdif client disconnected without sending command.\n");
-        } else {
-            /* Log any read errors */
-            perror("ERROR: cmdif read() failed");
         }
-
-        /* Close the client connection */
-        close(client_sd);
-        printf("INFO: cmdif closed connection\n");
+        sessions_expire();
     }
 
     /* Cleanup on shutdown */
     printf("INFO: Command interface thread shutting down.\n");
+    while (sessions != NULL) {
+        session_close(sessions);
+    }
+    if (epoll_fd != -1) {
+        close(epoll_fd);
+    }
+    if (wake_fd != -1) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
     if (listen_sd != -1) {
         close(listen_sd);
         listen_sd = -1;
@@ -198,4 +945,4 @@ void *cmdif_run(void *arg) {
     }
 
     return NULL;
-}
\ No newline at end of file
+}
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE     /* For accept4() */
+
 /* --- Include Standard Libraries --- */
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,12 +8,16 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/resource.h>
 #include <sys/time.h>
 #include <time.h>
 #include <errno.h>
 #include <stdbool.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <endian.h>     /* For htobe64() */
 
 /* --- Include Project-Specific Headers --- */
 #include "config.h"
@@ -19,558 +25,1727 @@
 #include "sbuffer.h"    /* Shared buffer for sensor data */
 #include "logger.h"     /* Logging utility */
 #include "conmgt.h"     /* Header for connection manager */
+#include "protocol.h"   /* Sensor frame decoder */
+#include "uring.h"      /* io_uring system call wrapper */
+#include "metrics.h"    /* Ingest counters and stamps */
+#include "pool.h"       /* Client state and per-IP entries */
+#include "capture.h"    /* Capture of decoded readings (-c) */
+#include "settings.h"   /* Backlog, sensor timeout and per-IP limit */
 
 /* --- Local Macros --- */
-#define MAX_CONNECTIONS 100       /* Maximum number of simultaneous client connections */
-#define SELECT_TIMEOUT_SEC 1      /* Timeout for select() in seconds */
-#define EXPECTED_PACKET_SIZE (sizeof(uint16_t) + sizeof(double)) /* Expected size of a data packet */
+#define MAX_EPOLL_EVENTS 256      /* Maximum number of events returned by one epoll_wait() */
+#define TIMER_WHEEL_SLOTS 64      /* One-second slots of the inactivity timer wheel */
+#define UDP_BATCH_SIZE 64         /* Datagrams drained per recvmmsg() call */
+#define UDP_DATAGRAM_MAX 2048     /* Largest datagram accepted, may hold several frames */
+#define UDP_RCVBUF_SIZE (4 * 1024 * 1024) /* Requested kernel receive buffer, absorbs bursts while the reactor is busy */
+#define URING_SQ_ENTRIES 256      /* io_uring backend: submission queue size */
+#define URING_CQ_ENTRIES 4096     /* io_uring backend: completion queue size, multishot requests post many CQEs */
+#define URING_BUF_COUNT 256       /* io_uring backend: provided receive buffers per reactor, a power of two */
+#define URING_BUF_SIZE 4096       /* io_uring backend: size of each provided buffer */
+#define URING_BUF_GROUP 0         /* io_uring backend: buffer group id of the reactor's buffer ring */
+#define URING_DRAIN_ROUNDS 10     /* io_uring backend: 100 ms waits for cancelled requests during cleanup */
+#define IP_KEY_SIZE 16            /* Bytes of a per-IP table key (an IPv6 address) */
+#define IP_TABLE_INITIAL_BUCKETS 256 /* Initial bucket count of the per-IP table, a power of two */
+
+#if SENSOR_TIMEOUT_MAX_SEC + 2 > TIMER_WHEEL_SLOTS
+#error "TIMER_WHEEL_SLOTS must cover SENSOR_TIMEOUT_MAX_SEC"
+#endif
+_Static_assert(URING_BUF_SIZE + PROTOCOL_MAX_FRAME_SIZE <= CONMGT_RX_BUFFER_SIZE,
+               "CONMGT_RX_BUFFER_SIZE must hold a partial frame followed by one provided buffer");
+
+/* Event data pointers (epoll data.ptr, io_uring user_data) for a reactor's non-client descriptors;
+ * clients use their client_info_t */
+#define EVENT_TAG_SERVER(r) ((void *)&(r)->server_sd)
+#define EVENT_TAG_SHUTDOWN(r) ((void *)&(r)->shutdown_pipe_fd[0])
+#define EVENT_TAG_UDP(r) ((void *)&(r)->udp_sd)
+#define EVENT_TAG_CANCEL(r) ((void *)&(r)->uring) /* Completions of cancel requests, ignored */
+
+/* --- Local Types --- */
+
+/* One event loop: owns a listening socket, an event backend instance and the clients accepted on it */
+typedef struct {
+    int index;                    /* Reactor number, used in log messages */
+    int server_sd;                /* SO_REUSEPORT listening socket */
+    int epoll_fd;                 /* epoll backend: instance driving this reactor */
+    uring_t uring;                /* io_uring backend: submission and completion queues */
+    uring_buf_ring_t uring_bufs;  /* io_uring backend: buffers the kernel fills for multishot receives */
+    unsigned uring_inflight;      /* io_uring backend: armed requests whose final completion is outstanding */
+    client_info_t *closing_list;  /* io_uring backend: removed clients whose receive is still being cancelled */
+    char uring_pipe_byte;         /* io_uring backend: target of the shutdown pipe read */
+    int shutdown_pipe_fd[2];      /* Pipe for shutdown signal: [0]=read, [1]=write */
+    int reserve_fd;               /* Spare descriptor released to shed connections when out of fds */
+    client_info_t *client_list;   /* Clients owned by this reactor */
+    int num_clients;              /* Number of clients, read lock-free by conmgt_get_active_connections */
+    pthread_mutex_t mutex;        /* Protects client_list for the stats readers; uncontended on the hot path */
+    pthread_t thread;             /* Thread running the reactor (reactor 0 runs in conmgt_run's thread) */
+    bool thread_started;          /* Whether thread must be joined */
+    sbuffer_t *buffer;            /* Shared buffer readings are inserted into */
+    uint8_t *rx_buffer;           /* Read scratch space shared by the reactor's clients */
+    sensor_data_t *rx_readings;   /* Readings decoded from one rx_buffer */
+    size_t rx_readings_capacity;  /* Number of elements in rx_readings */
+    int udp_sd;                   /* Datagram ingest socket, -1 if UDP ingest is disabled */
+    struct mmsghdr *udp_msgs;     /* recvmmsg() headers, one per datagram slot */
+    struct iovec *udp_iovs;       /* One iovec per datagram slot, pointing into udp_buffers */
+    uint8_t *udp_buffers;         /* UDP_BATCH_SIZE datagram buffers */
+    sensor_data_t *udp_readings;  /* Readings decoded from one recvmmsg() batch */
+    size_t udp_readings_capacity; /* Number of elements in udp_readings */
+    unsigned long udp_malformed;  /* Datagrams dropped because they held a malformed or partial frame */
+    client_info_t *timer_wheel[TIMER_WHEEL_SLOTS]; /* Clients by inactivity deadline (deadline % slots) */
+    time_t timer_now;             /* Last second whose wheel slot has been expired */
+} conmgt_reactor_t;
+
+/* Event loop implementation shared by all reactors */
+typedef struct {
+    const char *name;
+    gateway_error_t (*init)(conmgt_reactor_t *reactor); /* Creates the instance, watches listener, pipe and UDP socket */
+    void (*run)(conmgt_reactor_t *reactor);            /* Dispatches events until the shutdown pipe is readable */
+    gateway_error_t (*watch_client)(conmgt_reactor_t *reactor, client_info_t *client); /* Starts reading a new client */
+    bool (*unwatch_client)(conmgt_reactor_t *reactor, client_info_t *client); /* Stops reading a closed client, false if the backend frees it later */
+    void (*cleanup)(conmgt_reactor_t *reactor);        /* Releases what init created, after the clients are gone */
+} conmgt_backend_t;
+
+/* Per-IP connection counter; keys are IPv6 addresses, IPv4 is stored IPv4-mapped */
+typedef struct ip_count_entry {
+    uint8_t addr[IP_KEY_SIZE];
+    int count;
+    struct ip_count_entry *next;
+} ip_count_entry_t;
 
 /* --- Static Variables (Module State) --- */
-static client_info_t client_sockets[MAX_CONNECTIONS]; /* Array to store client information */
-static int num_clients = 0;                           /* Number of active client connections */
-static int server_sd = -1;                            /* Server socket descriptor */
-static int shutdown_pipe_fd[2] = {-1, -1};            /* Pipe for shutdown signal: [0]=read, [1]=write */
+static conmgt_reactor_t reactors[CONMGT_MAX_REACTORS]; /* Reactor state, only the first num_reactors are used */
+static int num_reactors = 0;                          /* Number of configured reactors */
 static volatile bool stop_requested = false;          /* Flag to prevent multiple stop actions */
-pthread_mutex_t conmgt_mutex;                         /* Mutex for thread safety in connection manager */
+static ip_count_entry_t **ip_table = NULL;            /* Per-IP connection counts, shared by all reactors */
+static size_t ip_table_buckets = 0;                   /* Number of buckets in ip_table */
+static size_t ip_table_entries = 0;                   /* Number of addresses in ip_table */
+static pthread_mutex_t ip_table_mutex = PTHREAD_MUTEX_INITIALIZER; /* Protects ip_table, taken on accept and close only */
+static pool_t *client_pool = NULL;                    /* client_info_t of every reactor, CONMGT_MAX_CLIENTS */
+static pool_t *ip_entry_pool = NULL;                  /* ip_count_entry_t, one per address with a client */
+static const conmgt_backend_t *backend = NULL;        /* Event loop implementation of every reactor */
 
 /* --- Forward Declarations (Internal Helper Functions) --- */
-static gateway_error_t setup_server_socket(int port); /* Sets up the server socket */
-static void handle_new_connection(int *max_sd);       /* Handles new incoming connections */
-static void handle_client_data(int client_index, fd_set *read_fds, sbuffer_t *buffer); /* Processes data from clients */
-static void check_sensor_timeouts(fd_set *read_fds);  /* Checks for inactive clients and removes them */
-static void add_client(int client_sd, struct sockaddr_in *client_addr); /* Adds a new client to the list */
-static void remove_client(int client_index, fd_set *read_fds); /* Removes a client from the list */
+static gateway_error_t setup_server_socket(conmgt_reactor_t *reactor, int port, bool reuse_port); /* Sets up a reactor's server socket */
+static gateway_error_t setup_udp_socket(conmgt_reactor_t *reactor, int port, bool reuse_port); /* Sets up a reactor's datagram socket */
+static gateway_error_t reactor_init(conmgt_reactor_t *reactor, int index, const conmgt_args_t *args, bool reuse_port); /* Creates a reactor's descriptors */
+static void reactor_cleanup(conmgt_reactor_t *reactor); /* Closes a reactor's clients and descriptors */
+static void *reactor_run(void *arg);                  /* Event loop of one reactor */
+static gateway_error_t epoll_backend_init(conmgt_reactor_t *reactor); /* Creates and fills the epoll set */
+static void epoll_backend_run(conmgt_reactor_t *reactor); /* epoll_wait() loop */
+static gateway_error_t epoll_watch_client(conmgt_reactor_t *reactor, client_info_t *client); /* Adds a client to the epoll set */
+static bool epoll_unwatch_client(conmgt_reactor_t *reactor, client_info_t *client); /* Closing removes it from the set */
+static void epoll_backend_cleanup(conmgt_reactor_t *reactor); /* Closes the epoll instance */
+static gateway_error_t iouring_backend_init(conmgt_reactor_t *reactor); /* Creates the ring and arms the listener, pipe and UDP socket */
+static void iouring_backend_run(conmgt_reactor_t *reactor); /* Completion loop */
+static gateway_error_t iouring_watch_client(conmgt_reactor_t *reactor, client_info_t *client); /* Arms a client's multishot receive */
+static bool iouring_unwatch_client(conmgt_reactor_t *reactor, client_info_t *client); /* Cancels a client's receive */
+static void iouring_backend_cleanup(conmgt_reactor_t *reactor); /* Cancels everything and frees the ring */
+static bool iouring_process_completions(conmgt_reactor_t *reactor); /* Handles every available CQE */
+static bool iouring_arm(conmgt_reactor_t *reactor, uint8_t opcode, int fd, void *tag); /* Queues a listener, pipe or UDP request */
+static void iouring_handle_accept(conmgt_reactor_t *reactor, int res, bool more); /* Multishot accept completion */
+static void iouring_handle_recv(conmgt_reactor_t *reactor, client_info_t *client, int res, unsigned flags); /* Multishot receive completion */
+static void raise_fd_limit(void);                     /* Lifts the open file soft limit to the hard limit */
+static void handle_new_connection(conmgt_reactor_t *reactor); /* Handles new incoming connections */
+static void shed_connection(conmgt_reactor_t *reactor); /* Rejects a connection while out of descriptors */
+static void accept_client(conmgt_reactor_t *reactor, int client_sd, struct sockaddr_in *client_addr); /* Limits and adds one connection */
+static void ip_key_from_ipv4(const struct in_addr *addr, uint8_t key[IP_KEY_SIZE]); /* Builds a per-IP table key */
+static size_t ip_key_hash(const uint8_t key[IP_KEY_SIZE]); /* Hashes a per-IP table key */
+static bool ip_table_grow(void);                      /* Doubles the per-IP table */
+static bool ip_table_acquire(const uint8_t key[IP_KEY_SIZE], int limit, int *previous); /* Counts a connection */
+static void ip_table_release(const uint8_t key[IP_KEY_SIZE]); /* Uncounts a connection */
+static void handle_client_data(conmgt_reactor_t *reactor, client_info_t *client); /* Processes data from clients */
+static bool consume_client_data(conmgt_reactor_t *reactor, client_info_t *client, const uint8_t *data, size_t len); /* Decodes received bytes */
+static void stamp_readings(sensor_data_t *readings, size_t count); /* Sets the ingest time of decoded readings */
+static bool send_ack(client_info_t *client); /* Acknowledges the readings accepted from a client */
+static void close_client_eof(conmgt_reactor_t *reactor, client_info_t *client); /* Closes a client that hung up */
+static void handle_udp_data(conmgt_reactor_t *reactor); /* Drains and decodes pending datagrams */
+static void drop_client(conmgt_reactor_t *reactor, client_info_t *client, const char *reason); /* Closes a client after an error */
+static void check_sensor_timeouts(conmgt_reactor_t *reactor, time_t now); /* Removes clients whose deadline passed */
+static void timer_schedule(conmgt_reactor_t *reactor, client_info_t *client, time_t deadline); /* (Re)arms a client's deadline */
+static void timer_cancel(conmgt_reactor_t *reactor, client_info_t *client); /* Unlinks a client from the wheel */
+static int timer_next_timeout_ms(conmgt_reactor_t *reactor); /* Time until the earliest deadline */
+static void add_client(conmgt_reactor_t *reactor, int client_sd, struct sockaddr_in *client_addr, const uint8_t ip_key[IP_KEY_SIZE]); /* Adds a new client to the list */
+static void remove_client(conmgt_reactor_t *reactor, client_info_t *client); /* Removes a client from the list */
+
+/* --- Event Backends --- */
+static const conmgt_backend_t epoll_backend = {
+    "epoll", epoll_backend_init, epoll_backend_run, epoll_watch_client, epoll_unwatch_client, epoll_backend_cleanup
+};
+static const conmgt_backend_t iouring_backend = {
+    "io_uring", iouring_backend_init, iouring_backend_run, iouring_watch_client, iouring_unwatch_client, iouring_backend_cleanup
+};
 
 /* --- Main Thread Function Implementation --- */
 
 /**
  * @brief Main function for the connection manager thread.
- * Handles incoming connections, data processing, and client management.
+ * Creates the reactors, starts a thread for every reactor but the first,
+ * runs the first reactor itself and joins the others once it returns.
  * @param arg Pointer to the arguments for the connection manager.
  * @return NULL when the thread exits.
  */
 void *conmgt_run(void *arg) {
     conmgt_args_t *args = (conmgt_args_t *)arg;
-    sbuffer_t *buffer = args->buffer;
-    int max_sd = -1;
-    fd_set read_fds;
-    struct timeval select_timeout;
-    gateway_error_t ret;
-    int activity;
-    bool running = true; /* Loop control flag */
+    int requested = args->num_reactors;
+    gateway_error_t ret = GATEWAY_SUCCESS;
 
-    stop_requested = false; /* Reset flag on start */
+    pthread_setname_np(pthread_self(), "conmgt"); /* Thread names show up in 'status' */
 
-    /* Initialize client socket array */
-    for (int i = 0; i < MAX_CONNECTIONS; ++i) {
-        client_sockets[i].socket_fd = -1;
-        client_sockets[i].id_received = false;
+    if (requested < 1) {
+        requested = 1;
+    } else if (requested > CONMGT_MAX_REACTORS) {
+        log_message(LOG_LEVEL_WARNING, "Requested %d reactors, limiting to %d.", requested, CONMGT_MAX_REACTORS);
+        requested = CONMGT_MAX_REACTORS;
     }
 
-    /* 1. Create Shutdown Pipe */
-    if (pipe(shutdown_pipe_fd) == -1) {
-        log_message(LOG_LEVEL_FATAL, "Connection manager failed to create shutdown pipe: %s. Exiting thread.", strerror(errno)); 
+    stop_requested = false; /* Reset flag on start */
+    raise_fd_limit();
+    if (pool_create(&client_pool, "conmgt clients", sizeof(client_info_t), CONMGT_MAX_CLIENTS) != GATEWAY_SUCCESS ||
+        pool_create(&ip_entry_pool, "conmgt addresses", sizeof(ip_count_entry_t), CONMGT_MAX_CLIENTS) != GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_FATAL, "Connection manager failed to reserve state for %d clients. Exiting thread.", CONMGT_MAX_CLIENTS);
+        pool_destroy(&client_pool);
         return NULL;
     }
-    fcntl(shutdown_pipe_fd[0], F_SETFL, O_NONBLOCK);
-
-    /* 2. Setup the server socket (uses static server_sd) */
-    ret = setup_server_socket(args->server_port); // setup_server_socket logs internally
+    backend = args->backend == CONMGT_BACKEND_IO_URING ? &iouring_backend : &epoll_backend;
+
+    /* 1. Set up every reactor before any of them runs, so a bind failure stops the whole manager */
+    for (int i = 0; i < CONMGT_MAX_REACTORS; ++i) {
+        reactors[i].server_sd = -1;
+        reactors[i].epoll_fd = -1;
+        reactors[i].uring.ring_fd = -1;
+        reactors[i].reserve_fd = -1;
+        reactors[i].udp_sd = -1;
+        reactors[i].shutdown_pipe_fd[0] = reactors[i].shutdown_pipe_fd[1] = -1;
+    }
+    for (int i = 0; i < requested && ret == GATEWAY_SUCCESS; ++i) {
+        ret = reactor_init(&reactors[i], i, args, requested > 1);
+        if (ret == CONNMGR_URING_ERR && i == 0) {
+            /* io_uring is missing or too old (or disabled by policy), every reactor uses epoll instead */
+            log_message(LOG_LEVEL_WARNING, "io_uring backend unavailable, falling back to epoll.");
+            backend = &epoll_backend;
+            ret = reactor_init(&reactors[i], i, args, requested > 1);
+        }
+        if (ret == GATEWAY_SUCCESS) {
+            num_reactors = i + 1;
+        }
+    }
     if (ret != GATEWAY_SUCCESS) {
-        log_message(LOG_LEVEL_FATAL, "Connection manager failed to set up server socket (Error code: %d). Exiting thread.", ret); 
-        close(shutdown_pipe_fd[0]); /* Close pipe fds on error */
-        close(shutdown_pipe_fd[1]);
+        log_message(LOG_LEVEL_FATAL, "Connection manager failed to set up reactors (Error code: %d). Exiting thread.", ret);
+        for (int i = 0; i < num_reactors; ++i) {
+            reactor_cleanup(&reactors[i]);
+        }
+        num_reactors = 0;
+        pool_destroy(&ip_entry_pool);
+        pool_destroy(&client_pool);
         return NULL;
     }
-    /* Initialize max_sd considering server and pipe */
-    // Calculate max_sd based on server_sd and shutdown_pipe_fd initially
-    if (server_sd != -1 && shutdown_pipe_fd[0] != -1) {
-         max_sd = (server_sd > shutdown_pipe_fd[0]) ? server_sd : shutdown_pipe_fd[0];
-    } else if (server_sd != -1) {
-        max_sd = server_sd;
-    } else if (shutdown_pipe_fd[0] != -1) {
-        max_sd = shutdown_pipe_fd[0];
-    } else {
-         log_message(LOG_LEVEL_FATAL, "Neither server socket nor shutdown pipe is valid after setup. Exiting thread.");
-         return NULL; /* Should not happen if setup succeeded */
-    }
 
-    log_message(LOG_LEVEL_INFO, "Server socket listening on port %d", args->server_port); 
+    /* A capture that cannot be opened is reported, the gateway runs on without it */
+    if (args->capture_file != NULL && capture_open(args->capture_file) != GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_ERROR, "Cannot capture to '%s': %s", args->capture_file, strerror(errno));
+    }
 
-    /* 3. Main select() loop */
-    while (running) {
-        FD_ZERO(&read_fds);
-        /* Add server socket if it's still open */
-        if (server_sd != -1) {
-            FD_SET(server_sd, &read_fds);
-        }
-        /* Add shutdown pipe read end */
-        if (shutdown_pipe_fd[0] != -1) {
-            FD_SET(shutdown_pipe_fd[0], &read_fds);
-        }
-
-        /* Reset max_sd for this iteration */
-        // Recalculate max_sd based on current valid FDs
-        if (server_sd != -1 && shutdown_pipe_fd[0] != -1) {
-             max_sd = (server_sd > shutdown_pipe_fd[0]) ? server_sd : shutdown_pipe_fd[0];
-        } else if (server_sd != -1) {
-            max_sd = server_sd;
-        } else if (shutdown_pipe_fd[0] != -1) {
-            max_sd = shutdown_pipe_fd[0];
+    log_message(LOG_LEVEL_INFO, "Server socket listening on port %d (%d %s reactor%s%s)",
+                args->server_port, num_reactors, backend->name, num_reactors == 1 ? "" : "s",
+                args->udp_enabled ? ", UDP ingest enabled" : "");
+
+    /* 2. Start the extra reactor threads; a reactor that fails to start is shut down */
+    for (int i = 1; i < num_reactors; ++i) {
+        if (pthread_create(&reactors[i].thread, NULL, reactor_run, &reactors[i]) == 0) {
+            char name[24]; /* Room for any number; the names used stay within the kernel's 15 characters */
+            snprintf(name, sizeof(name), "conmgt-r%d", i);
+            pthread_setname_np(reactors[i].thread, name);
+            reactors[i].thread_started = true;
         } else {
-             log_message(LOG_LEVEL_DEBUG, "No active listeners (server socket or pipe closed). Exiting conmgt loop.");
-             break;
+            log_message(LOG_LEVEL_ERROR, "Failed to create thread for reactor %d. Closing its listener.", i);
+            close(reactors[i].server_sd);
+            reactors[i].server_sd = -1;
+        }
+    }
+
+    /* 3. Run the first reactor in this thread */
+    reactor_run(&reactors[0]);
+
+    /* 4. Join the others (conmgt_stop signals all reactors at once) */
+    for (int i = 1; i < num_reactors; ++i) {
+        if (reactors[i].thread_started) {
+            pthread_join(reactors[i].thread, NULL);
+            reactors[i].thread_started = false;
         }
+    }
 
-        /* Add active client sockets and update max_sd */
-        for (int i = 0; i < num_clients; ++i) {
-            if (client_sockets[i].socket_fd != -1) {
-                FD_SET(client_sockets[i].socket_fd, &read_fds);
-                if (client_sockets[i].socket_fd > max_sd) {
-                    max_sd = client_sockets[i].socket_fd;
+    log_message(LOG_LEVEL_INFO, "Connection manager shutting down...");
+    for (int i = 0; i < num_reactors; ++i) {
+        reactor_cleanup(&reactors[i]);
+    }
+    capture_close();
+
+    /* Every address entry went away with its last client, only the buckets remain */
+    pthread_mutex_lock(&ip_table_mutex);
+    free(ip_table);
+    ip_table = NULL;
+    ip_table_buckets = ip_table_entries = 0;
+    pthread_mutex_unlock(&ip_table_mutex);
+    pool_destroy(&ip_entry_pool);
+    pool_destroy(&client_pool);
+
+    log_message(LOG_LEVEL_INFO, "Connection manager finished cleanup.");
+    return NULL;
+}
+
+/**
+ * @brief Event loop of one reactor.
+ * @param arg Pointer to the conmgt_reactor_t to run.
+ * @return NULL when the loop exits.
+ */
+static void *reactor_run(void *arg) {
+    conmgt_reactor_t *reactor = (conmgt_reactor_t *)arg;
+
+    backend->run(reactor);
+    return NULL;
+}
+
+/**
+ * @brief Signals the Connection Manager thread to stop gracefully.
+ * Closes the server socket and writes to a shutdown pipe, which both backends watch. Thread-safe check.
+ */
+void conmgt_stop(void) {
+    char dummy = 's';
+    bool already_stopping = __sync_bool_compare_and_swap(&stop_requested, false, true);
+
+    if (already_stopping) {
+        log_message(LOG_LEVEL_INFO, "Initiating Connection Manager shutdown sequence...");
+
+        if (num_reactors == 0) {
+            log_message(LOG_LEVEL_INFO, "Server socket already closed or not initialized.");
+        }
+
+        for (int i = 0; i < num_reactors; ++i) {
+            conmgt_reactor_t *reactor = &reactors[i];
+
+            /* Close server socket immediately */
+            if (reactor->server_sd != -1) {
+                log_message(LOG_LEVEL_INFO, "Closing server socket of reactor %d to stop new connections.", i);
+                if(close(reactor->server_sd) == -1){
+                     log_message(LOG_LEVEL_WARNING, "Error closing server socket: %s", strerror(errno));
                 }
+                reactor->server_sd = -1; /* Mark as closed */
+            }
+
+            /* Write to the shutdown pipe */
+            if (reactor->shutdown_pipe_fd[1] != -1) {
+                if (write(reactor->shutdown_pipe_fd[1], &dummy, 1) == -1) {
+                    if (errno != EPIPE) {
+                        log_message(LOG_LEVEL_ERROR, "Failed to write to shutdown pipe: %s", strerror(errno));
+                    } else {
+                        log_message(LOG_LEVEL_INFO, "Shutdown pipe read end already closed.");
+                    }
+                } else {
+                    log_message(LOG_LEVEL_INFO, "Shutdown signal sent to reactor %d via pipe.", i);
+                }
+            } else {
+                log_message(LOG_LEVEL_WARNING, "Shutdown pipe write end of reactor %d is invalid. Cannot signal it via pipe.", i);
             }
         }
+    } else {
+        log_message(LOG_LEVEL_INFO, "Connection Manager shutdown already in progress or completed.");
+    }
+}
+
+/* --- Implementation of Internal Helper Functions --- */
+
+/**
+ * @brief Creates a reactor's shutdown pipe, listening socket and optional UDP socket, then hands them to the backend.
+ * @param reactor The reactor to initialize.
+ * @param index The reactor number.
+ * @param args The connection manager arguments (port, shared buffer, UDP ingest).
+ * @param reuse_port Whether the sockets share the port with other reactors.
+ * @return GATEWAY_SUCCESS on success, error code otherwise (descriptors created so far are closed).
+ */
+static gateway_error_t reactor_init(conmgt_reactor_t *reactor, int index, const conmgt_args_t *args, bool reuse_port) {
+    gateway_error_t ret;
+    int port = args->server_port;
+
+    reactor->index = index;
+    reactor->client_list = NULL;
+    reactor->closing_list = NULL;
+    reactor->num_clients = 0;
+    reactor->thread_started = false;
+    reactor->buffer = args->buffer;
+    reactor->udp_malformed = 0;
+    reactor->uring_inflight = 0;
+    pthread_mutex_init(&reactor->mutex, NULL);
+    memset(reactor->timer_wheel, 0, sizeof(reactor->timer_wheel));
+    reactor->timer_now = time(NULL);
+
+    /* Every complete frame in one read fits in rx_readings */
+    reactor->rx_readings_capacity = CONMGT_RX_BUFFER_SIZE / PROTOCOL_MIN_READING_SIZE + 1;
+    reactor->rx_buffer = malloc(CONMGT_RX_BUFFER_SIZE);
+    reactor->rx_readings = malloc(reactor->rx_readings_capacity * sizeof(sensor_data_t));
+    if (reactor->rx_buffer == NULL || reactor->rx_readings == NULL) {
+        log_message(LOG_LEVEL_FATAL, "Reactor %d failed to allocate its receive buffers.", index);
+        ret = GATEWAY_ERROR_NOMEM;
+        goto fail;
+    }
+
+    reactor->reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    /* 1. Create Shutdown Pipe */
+    if (pipe(reactor->shutdown_pipe_fd) == -1) {
+        log_message(LOG_LEVEL_FATAL, "Reactor %d failed to create shutdown pipe: %s.", index, strerror(errno));
+        reactor->shutdown_pipe_fd[0] = reactor->shutdown_pipe_fd[1] = -1;
+        ret = CONNMGR_ERROR;
+        goto fail;
+    }
+    fcntl(reactor->shutdown_pipe_fd[0], F_SETFL, O_NONBLOCK);
+
+    /* 2. Setup the server socket */
+    ret = setup_server_socket(reactor, port, reuse_port); // setup_server_socket logs internally
+    if (ret != GATEWAY_SUCCESS) {
+        goto fail;
+    }
+
+    /* 3. Optional datagram ingest on the same port */
+    if (args->udp_enabled) {
+        ret = setup_udp_socket(reactor, port, reuse_port); // setup_udp_socket logs internally
+        if (ret != GATEWAY_SUCCESS) {
+            goto fail;
+        }
+    }
+
+    /* 4. Watch the listener, the shutdown pipe and the UDP socket */
+    ret = backend->init(reactor); // Backends log internally
+    if (ret != GATEWAY_SUCCESS) {
+        goto fail;
+    }
+
+    return GATEWAY_SUCCESS;
+
+fail:
+    reactor_cleanup(reactor);
+    return ret;
+}
+
+/**
+ * @brief Closes a reactor's remaining clients, listener, backend instance and shutdown pipe.
+ * @param reactor The reactor to clean up; its thread must no longer be running.
+ */
+static void reactor_cleanup(conmgt_reactor_t *reactor) {
+    /* Ensure server socket is closed */
+    if (reactor->server_sd != -1) {
+        close(reactor->server_sd);
+        reactor->server_sd = -1;
+        LOG_DEBUG("Server socket of reactor %d closed during cleanup.", reactor->index);
+    }
+
+    /* Close remaining client sockets */
+    if (reactor->client_list != NULL) {
+        log_message(LOG_LEVEL_INFO, "Closing remaining client connections of reactor %d...", reactor->index);
+    }
+    pthread_mutex_lock(&reactor->mutex);
+    while (reactor->client_list != NULL) {
+        client_info_t *client = reactor->client_list;
+        if (client->id_received) {
+            log_message(LOG_LEVEL_INFO, "Closing connection for sensor %d (socket %d) during shutdown.",
+                        client->sensor_id, client->socket_fd);
+        } else {
+            log_message(LOG_LEVEL_INFO, "Closing connection for unidentified client (socket %d) during shutdown.",
+                        client->socket_fd);
+        }
+        remove_client(reactor, client);
+    }
+    pthread_mutex_unlock(&reactor->mutex);
+
+    if (backend != NULL) {
+        backend->cleanup(reactor);
+    }
+    if (reactor->reserve_fd != -1) {
+        close(reactor->reserve_fd);
+        reactor->reserve_fd = -1;
+    }
+
+    /* Close pipe descriptors */
+    if (reactor->shutdown_pipe_fd[0] != -1) close(reactor->shutdown_pipe_fd[0]);
+    if (reactor->shutdown_pipe_fd[1] != -1) close(reactor->shutdown_pipe_fd[1]);
+    reactor->shutdown_pipe_fd[0] = reactor->shutdown_pipe_fd[1] = -1;
+    LOG_DEBUG("Shutdown pipe of reactor %d closed during cleanup.", reactor->index);
+
+    free(reactor->rx_buffer);
+    free(reactor->rx_readings);
+    reactor->rx_buffer = NULL;
+    reactor->rx_readings = NULL;
+
+    if (reactor->udp_sd != -1) {
+        close(reactor->udp_sd);
+        reactor->udp_sd = -1;
+        if (reactor->udp_malformed > 0) {
+            log_message(LOG_LEVEL_INFO, "Reactor %d dropped %lu malformed datagrams.", reactor->index, reactor->udp_malformed);
+        }
+    }
+    free(reactor->udp_msgs);
+    free(reactor->udp_iovs);
+    free(reactor->udp_buffers);
+    free(reactor->udp_readings);
+    reactor->udp_msgs = NULL;
+    reactor->udp_iovs = NULL;
+    reactor->udp_buffers = NULL;
+    reactor->udp_readings = NULL;
+}
+
+/* --- epoll Backend --- */
+
+/**
+ * @brief Creates the reactor's epoll instance and registers the listener (level-triggered), the shutdown pipe and the UDP socket.
+ * @param reactor The reactor whose descriptors are already open.
+ * @return GATEWAY_SUCCESS on success, CONNMGR_POLL_ERR otherwise.
+ */
+static gateway_error_t epoll_backend_init(conmgt_reactor_t *reactor) {
+    struct epoll_event ev;
+
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epoll_fd == -1) {
+        log_message(LOG_LEVEL_FATAL, "Reactor %d failed to create epoll instance: %s.", reactor->index, strerror(errno));
+        return CONNMGR_POLL_ERR;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = EVENT_TAG_SERVER(reactor);
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->server_sd, &ev) == -1) {
+        log_message(LOG_LEVEL_FATAL, "Failed to register server socket with epoll: %s.", strerror(errno));
+        return CONNMGR_POLL_ERR;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = EVENT_TAG_SHUTDOWN(reactor);
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->shutdown_pipe_fd[0], &ev) == -1) {
+        log_message(LOG_LEVEL_FATAL, "Failed to register shutdown pipe with epoll: %s.", strerror(errno));
+        return CONNMGR_POLL_ERR;
+    }
+    if (reactor->udp_sd != -1) {
+        ev.events = EPOLLIN;
+        ev.data.ptr = EVENT_TAG_UDP(reactor);
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->udp_sd, &ev) == -1) {
+            log_message(LOG_LEVEL_FATAL, "Failed to register UDP socket with epoll: %s.", strerror(errno));
+            return CONNMGR_POLL_ERR;
+        }
+    }
+    return GATEWAY_SUCCESS;
+}
 
-        select_timeout.tv_sec = SELECT_TIMEOUT_SEC;
-        select_timeout.tv_usec = 0;
+/**
+ * @brief epoll backend: waits for readiness and reads the ready descriptors itself.
+ * @param reactor The reactor to run.
+ */
+static void epoll_backend_run(conmgt_reactor_t *reactor) {
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int activity;
+    bool running = true; /* Loop control flag */
 
-        activity = select(max_sd + 1, &read_fds, NULL, NULL, &select_timeout);
+    /* Main epoll loop, work per wakeup is proportional to the ready descriptors,
+     * and the loop sleeps until the earliest inactivity deadline (or indefinitely if there is none) */
+    while (running) {
+        activity = epoll_wait(reactor->epoll_fd, events, MAX_EPOLL_EVENTS, timer_next_timeout_ms(reactor));
 
         if (activity < 0) {
             if (errno == EINTR) { /* Interrupted system call, possibly by our shutdown signal */
-                 log_message(LOG_LEVEL_DEBUG,"select() interrupted, likely by signal or timeout handling."); 
+                 LOG_DEBUG("epoll_wait() interrupted, likely by signal or timeout handling.");
                 continue; /* Re-check loop condition */
             } else {
-                 log_message(LOG_LEVEL_ERROR, "select() failed: %s", strerror(errno)); 
+                 log_message(LOG_LEVEL_ERROR, "epoll_wait() failed: %s", strerror(errno));
                 sleep(1); /* Avoid busy-looping */
                 continue;
             }
         }
 
-        /* Check if shutdown was requested via pipe */
-        if (shutdown_pipe_fd[0] != -1 && FD_ISSET(shutdown_pipe_fd[0], &read_fds)) {
-            char dummy_buffer[1];
-            read(shutdown_pipe_fd[0], dummy_buffer, 1); /* Read the byte */
-            log_message(LOG_LEVEL_INFO,"Shutdown signal received via pipe. Stopping connection manager loop."); 
-            running = false; /* Set flag to break loop */
-            continue; /* Go to top of loop to exit */
-        }
-
-        /* Check for new connections (only if server socket is still active) */
-        if (server_sd != -1 && FD_ISSET(server_sd, &read_fds)) {
-            handle_new_connection(&max_sd);
-        }
-
-        /* Check client activity - Iterate backwards for safe removal */
-        for (int i = num_clients - 1; i >= 0; --i) {
-            /* Check if socket still exists and has activity */
-            if (client_sockets[i].socket_fd != -1 && FD_ISSET(client_sockets[i].socket_fd, &read_fds)) {
-                handle_client_data(i, &read_fds, buffer);
+        for (int i = 0; i < activity && running; ++i) {
+            void *tag = events[i].data.ptr;
+
+            if (tag == EVENT_TAG_SHUTDOWN(reactor)) {
+                /* Shutdown was requested via pipe */
+                char dummy_buffer[1];
+                read(reactor->shutdown_pipe_fd[0], dummy_buffer, 1); /* Read the byte */
+                log_message(LOG_LEVEL_INFO,"Shutdown signal received via pipe. Stopping reactor %d loop.", reactor->index);
+                running = false; /* Set flag to break loop */
+            } else if (tag == EVENT_TAG_SERVER(reactor)) {
+                /* New connection (only if server socket is still active) */
+                handle_new_connection(reactor);
+            } else if (tag == EVENT_TAG_UDP(reactor)) {
+                handle_udp_data(reactor);
+            } else {
+                handle_client_data(reactor, (client_info_t *)tag);
             }
         }
 
-        /* Check timeouts (only if not shutting down) */
+        /* Expire the deadlines that have passed (only if not shutting down) */
         if (running) {
-            check_sensor_timeouts(&read_fds);
+            check_sensor_timeouts(reactor, time(NULL));
         }
 
     } /* End of main while loop */
+}
+
+/**
+ * @brief Registers a new client edge-triggered, with the client as the event data pointer.
+ * @param reactor The reactor owning the client.
+ * @param client The client to watch.
+ * @return GATEWAY_SUCCESS on success, CONNMGR_POLL_ERR otherwise.
+ */
+static gateway_error_t epoll_watch_client(conmgt_reactor_t *reactor, client_info_t *client) {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = client;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, client->socket_fd, &ev) == -1) {
+        log_message(LOG_LEVEL_ERROR, "Failed to register client socket %d with epoll: %s", client->socket_fd, strerror(errno));
+        return CONNMGR_POLL_ERR;
+    }
+    return GATEWAY_SUCCESS;
+}
 
-    /* --- Cleanup --- */
-    log_message(LOG_LEVEL_INFO, "Connection manager shutting down..."); 
+/**
+ * @brief Nothing to do: closing the socket already removed it from the epoll set.
+ * @param reactor The reactor owning the client.
+ * @param client The closed client.
+ * @return true, the client can be freed right away.
+ */
+static bool epoll_unwatch_client(conmgt_reactor_t *reactor, client_info_t *client) {
+    (void)reactor;
+    (void)client;
+    return true;
+}
 
-    /* Ensure server socket is closed */
-    if (server_sd != -1) {
-        close(server_sd);
-        server_sd = -1;
-        log_message(LOG_LEVEL_DEBUG, "Server socket closed during cleanup."); 
+/**
+ * @brief Closes the reactor's epoll instance.
+ * @param reactor The reactor to clean up.
+ */
+static void epoll_backend_cleanup(conmgt_reactor_t *reactor) {
+    if (reactor->epoll_fd != -1) {
+        close(reactor->epoll_fd);
+        reactor->epoll_fd = -1;
     }
+}
 
-    /* Close remaining client sockets */
-    log_message(LOG_LEVEL_INFO, "Closing remaining client connections..."); 
-    for (int i = 0; i < MAX_CONNECTIONS; ++i) {
-        if (client_sockets[i].socket_fd != -1) {
-             if (client_sockets[i].id_received) {
-                 log_message(LOG_LEVEL_INFO, "Closing connection for sensor %d (socket %d) during shutdown.", 
-                             client_sockets[i].sensor_id, client_sockets[i].socket_fd);
-             } else {
-                  log_message(LOG_LEVEL_INFO, "Closing connection for unidentified client (socket %d) during shutdown.", 
-                             client_sockets[i].socket_fd);
-             }
-            close(client_sockets[i].socket_fd);
-            client_sockets[i].socket_fd = -1;
-        }
-    }
-    num_clients = 0;
+/* --- io_uring Backend --- */
 
-    /* Close pipe descriptors */
-    if (shutdown_pipe_fd[0] != -1) close(shutdown_pipe_fd[0]);
-    if (shutdown_pipe_fd[1] != -1) close(shutdown_pipe_fd[1]);
-    shutdown_pipe_fd[0] = shutdown_pipe_fd[1] = -1;
-    log_message(LOG_LEVEL_DEBUG, "Shutdown pipe closed during cleanup."); 
+/**
+ * @brief Creates the reactor's ring and provided buffer ring, then arms a multishot accept on the listener,
+ * a read on the shutdown pipe and a multishot poll on the UDP socket.
+ * Nothing is submitted yet, the first uring_submit_and_wait() of the reactor thread does that.
+ * @param reactor The reactor whose descriptors are already open.
+ * @return GATEWAY_SUCCESS, CONNMGR_URING_ERR if the kernel lacks the needed io_uring features, or another error code.
+ */
+static gateway_error_t iouring_backend_init(conmgt_reactor_t *reactor) {
+    gateway_error_t ret;
 
-    log_message(LOG_LEVEL_INFO, "Connection manager finished cleanup."); 
-    return NULL;
+    ret = uring_init(&reactor->uring, URING_SQ_ENTRIES, URING_CQ_ENTRIES);
+    if (ret != GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_WARNING, "Reactor %d failed to create io_uring instance: %s.", reactor->index, strerror(errno));
+        return ret;
+    }
+    if (!(reactor->uring.features & IORING_FEAT_EXT_ARG)) {
+        log_message(LOG_LEVEL_WARNING, "Kernel io_uring lacks timed waits (IORING_FEAT_EXT_ARG).");
+        return CONNMGR_URING_ERR;
+    }
+    /* Provided buffer rings arrived in Linux 5.19, a kernel without them cannot run multishot receives either */
+    ret = uring_buf_ring_init(&reactor->uring, &reactor->uring_bufs, URING_BUF_GROUP, URING_BUF_COUNT, URING_BUF_SIZE);
+    if (ret != GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_WARNING, "Reactor %d failed to register io_uring receive buffers: %s.",
+                    reactor->index, ret == GATEWAY_ERROR_NOMEM ? "out of memory" : strerror(errno));
+        return ret;
+    }
+
+    if (!iouring_arm(reactor, IORING_OP_ACCEPT, reactor->server_sd, EVENT_TAG_SERVER(reactor)) ||
+        !iouring_arm(reactor, IORING_OP_READ, reactor->shutdown_pipe_fd[0], EVENT_TAG_SHUTDOWN(reactor)) ||
+        (reactor->udp_sd != -1 && !iouring_arm(reactor, IORING_OP_POLL_ADD, reactor->udp_sd, EVENT_TAG_UDP(reactor)))) {
+        log_message(LOG_LEVEL_FATAL, "Reactor %d failed to queue its io_uring requests.", reactor->index);
+        return CONNMGR_POLL_ERR;
+    }
+    return GATEWAY_SUCCESS;
 }
 
 /**
- * @brief Signals the Connection Manager thread to stop gracefully.
- * Closes the server socket and writes to a shutdown pipe. Thread-safe check.
+ * @brief Queues one of a reactor's own requests: multishot accept, shutdown pipe read or multishot UDP poll.
+ * @param reactor The reactor.
+ * @param opcode IORING_OP_ACCEPT, IORING_OP_READ or IORING_OP_POLL_ADD.
+ * @param fd The descriptor the request is for.
+ * @param tag The EVENT_TAG_* its completions carry.
+ * @return true if the request was queued, false if the submission queue is unusable.
  */
-void conmgt_stop(void) {
-    char dummy = 's';
-    bool already_stopping = __sync_bool_compare_and_swap(&stop_requested, false, true);
+static bool iouring_arm(conmgt_reactor_t *reactor, uint8_t opcode, int fd, void *tag) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&reactor->uring);
+    if (sqe == NULL) {
+        return false;
+    }
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = (uint64_t)(uintptr_t)tag;
+    switch (opcode) {
+        case IORING_OP_ACCEPT:
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT; /* Peer addresses come from getpeername() */
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            break;
+        case IORING_OP_READ:
+            sqe->addr = (uint64_t)(uintptr_t)&reactor->uring_pipe_byte;
+            sqe->len = 1;
+            sqe->off = (uint64_t)-1; /* Pipes have no file position */
+            break;
+        case IORING_OP_POLL_ADD:
+            sqe->len = IORING_POLL_ADD_MULTI;
+            sqe->poll32_events = POLLIN;
+            break;
+        default:
+            break;
+    }
+    reactor->uring_inflight++;
+    return true;
+}
 
-    if (already_stopping) {
-        log_message(LOG_LEVEL_INFO, "Initiating Connection Manager shutdown sequence..."); 
+/**
+ * @brief Arms a multishot receive for a new client. The kernel picks a provided buffer for every packet.
+ * @param reactor The reactor owning the client.
+ * @param client The client to watch.
+ * @return GATEWAY_SUCCESS on success, CONNMGR_POLL_ERR if the submission queue is unusable.
+ */
+static gateway_error_t iouring_watch_client(conmgt_reactor_t *reactor, client_info_t *client) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&reactor->uring);
+    if (sqe == NULL) {
+        log_message(LOG_LEVEL_ERROR, "Failed to queue a receive for client socket %d.", client->socket_fd);
+        return CONNMGR_POLL_ERR;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = client->socket_fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = reactor->uring_bufs.bgid;
+    sqe->user_data = (uint64_t)(uintptr_t)client;
+    client->recv_armed = true;
+    reactor->uring_inflight++;
+    return GATEWAY_SUCCESS;
+}
 
-        /* Close server socket immediately */
-        if (server_sd != -1) {
-            log_message(LOG_LEVEL_INFO, "Closing server socket to stop new connections."); 
-            if(close(server_sd) == -1){
-                 log_message(LOG_LEVEL_WARNING, "Error closing server socket: %s", strerror(errno)); 
+/**
+ * @brief Cancels the multishot receive of a removed client.
+ * The kernel may still post completions for it, so the client is parked on the closing list
+ * and freed by iouring_handle_recv() once its final completion arrives.
+ * @param reactor The reactor owning the client.
+ * @param client The closed client, already unlinked from the client list.
+ * @return true if no request references the client any more and it can be freed now.
+ */
+static bool iouring_unwatch_client(conmgt_reactor_t *reactor, client_info_t *client) {
+    if (!client->recv_armed) {
+        return true;
+    }
+    struct io_uring_sqe *sqe = uring_get_sqe(&reactor->uring);
+    if (sqe != NULL) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = (uint64_t)(uintptr_t)client;
+        sqe->user_data = (uint64_t)(uintptr_t)EVENT_TAG_CANCEL(reactor);
+    } /* Otherwise the request is cancelled when the reactor cleans up */
+
+    client->prev = NULL;
+    client->next = reactor->closing_list;
+    if (reactor->closing_list != NULL) {
+        reactor->closing_list->prev = client;
+    }
+    reactor->closing_list = client;
+    return false;
+}
+
+/**
+ * @brief io_uring backend: submits the queued requests and handles completions, one io_uring_enter() per batch.
+ * Received bytes are decoded straight out of the provided buffers, which are handed back to the
+ * kernel with a single buffer ring update per batch.
+ * @param reactor The reactor to run.
+ */
+static void iouring_backend_run(conmgt_reactor_t *reactor) {
+    bool running = true; /* Loop control flag */
+
+    while (running) {
+        int ret = uring_submit_and_wait(&reactor->uring, timer_next_timeout_ms(reactor));
+        if (ret < 0) {
+            log_message(LOG_LEVEL_ERROR, "io_uring_enter() failed: %s", strerror(-ret));
+            sleep(1); /* Avoid busy-looping */
+            continue;
+        }
+
+        running = iouring_process_completions(reactor);
+
+        /* Expire the deadlines that have passed (only if not shutting down) */
+        if (running) {
+            check_sensor_timeouts(reactor, time(NULL));
+        }
+    }
+}
+
+/**
+ * @brief Handles every completion currently in the completion queue.
+ * @param reactor The reactor.
+ * @return false if the shutdown pipe completed, true otherwise.
+ */
+static bool iouring_process_completions(conmgt_reactor_t *reactor) {
+    struct io_uring_cqe *cqe;
+    bool running = true;
+
+    while ((cqe = uring_peek_cqe(&reactor->uring)) != NULL) {
+        void *tag = (void *)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        bool more = (flags & IORING_CQE_F_MORE) != 0;
+        uring_cqe_seen(&reactor->uring);
+
+        if (tag == EVENT_TAG_CANCEL(reactor)) {
+            continue; /* The cancelled request posts its own final completion */
+        }
+        if (!more) {
+            reactor->uring_inflight--;
+        }
+
+        if (tag == EVENT_TAG_SHUTDOWN(reactor)) {
+            if (res != -ECANCELED) {
+                log_message(LOG_LEVEL_INFO, "Shutdown signal received via pipe. Stopping reactor %d loop.", reactor->index);
+            }
+            running = false;
+        } else if (tag == EVENT_TAG_SERVER(reactor)) {
+            iouring_handle_accept(reactor, res, more);
+        } else if (tag == EVENT_TAG_UDP(reactor)) {
+            if (res >= 0) {
+                handle_udp_data(reactor);
+            }
+            if (!more && res != -ECANCELED && reactor->udp_sd != -1) {
+                iouring_arm(reactor, IORING_OP_POLL_ADD, reactor->udp_sd, EVENT_TAG_UDP(reactor));
             }
-            server_sd = -1; /* Mark as closed */
         } else {
-            log_message(LOG_LEVEL_INFO, "Server socket already closed or not initialized."); 
+            iouring_handle_recv(reactor, (client_info_t *)tag, res, flags);
         }
+    }
 
-        /* Write to the shutdown pipe */
-        if (shutdown_pipe_fd[1] != -1) {
-            if (write(shutdown_pipe_fd[1], &dummy, 1) == -1) {
-                if (errno != EPIPE) {
-                    log_message(LOG_LEVEL_ERROR, "Failed to write to shutdown pipe: %s", strerror(errno)); 
-                } else {
-                    log_message(LOG_LEVEL_INFO, "Shutdown pipe read end already closed."); 
-                }
+    /* Hand every consumed buffer back at once */
+    if (reactor->uring_bufs.ring != NULL) {
+        uring_buf_ring_publish(&reactor->uring_bufs);
+    }
+    return running;
+}
+
+/**
+ * @brief Handles one completion of the multishot accept.
+ * @param reactor The reactor whose listener accepted.
+ * @param res The accepted descriptor, or a negative errno value.
+ * @param more Whether the accept request stays armed.
+ */
+static void iouring_handle_accept(conmgt_reactor_t *reactor, int res, bool more) {
+    if (res >= 0) {
+        struct sockaddr_in client_addr;
+        socklen_t client_addr_len = sizeof(client_addr);
+        if (getpeername(res, (struct sockaddr *)&client_addr, &client_addr_len) == -1) {
+            close(res); /* Peer already gone */
+        } else {
+            accept_client(reactor, res, &client_addr);
+        }
+    } else if (res == -EMFILE || res == -ENFILE) {
+        shed_connection(reactor);
+    } else if (res == -EINVAL) {
+        log_message(LOG_LEVEL_ERROR, "Multishot accept rejected by the kernel on reactor %d, no new connections.", reactor->index);
+        return;
+    } else if (res != -ECANCELED && res != -ECONNABORTED && res != -EINTR) {
+        log_message(LOG_LEVEL_ERROR, "accept() failed: %s", strerror(-res));
+    }
+
+    if (!more && res != -ECANCELED && reactor->server_sd != -1) {
+        iouring_arm(reactor, IORING_OP_ACCEPT, reactor->server_sd, EVENT_TAG_SERVER(reactor));
+    }
+}
+
+/**
+ * @brief Handles one completion of a client's multishot receive.
+ * @param reactor The reactor owning the client.
+ * @param client The client, possibly one on the closing list.
+ * @param res Number of bytes received, 0 on EOF, or a negative errno value.
+ * @param flags The CQE flags (buffer id, IORING_CQE_F_MORE).
+ */
+static void iouring_handle_recv(conmgt_reactor_t *reactor, client_info_t *client, int res, unsigned flags) {
+    bool has_buffer = (flags & IORING_CQE_F_BUFFER) != 0;
+    uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        client->recv_armed = false;
+    }
+
+    /* A removed client only waits for its final completion */
+    if (client->socket_fd == -1) {
+        if (has_buffer) {
+            uring_buf_ring_recycle(&reactor->uring_bufs, bid);
+        }
+        if (!client->recv_armed) {
+            if (client->prev != NULL) {
+                client->prev->next = client->next;
             } else {
-                log_message(LOG_LEVEL_INFO, "Shutdown signal sent to Connection Manager thread via pipe."); 
+                reactor->closing_list = client->next;
             }
-        } else {
-            log_message(LOG_LEVEL_WARNING, "Shutdown pipe write end is invalid. Cannot signal thread via pipe."); 
+            if (client->next != NULL) {
+                client->next->prev = client->prev;
+            }
+            pool_free(client_pool, client);
+        }
+        return;
+    }
+
+    if (res > 0 && has_buffer) {
+        const uint8_t *data = uring_buf_ring_buffer(&reactor->uring_bufs, bid);
+        size_t len = (size_t)res;
+        bool alive;
+
+        /* Decode in place unless a partial frame has to be prepended */
+        if (client->rx_partial_len > 0) {
+            memcpy(reactor->rx_buffer, client->rx_partial, client->rx_partial_len);
+            memcpy(reactor->rx_buffer + client->rx_partial_len, data, len);
+            len += client->rx_partial_len;
+            data = reactor->rx_buffer;
+        }
+        alive = consume_client_data(reactor, client, data, len);
+        uring_buf_ring_recycle(&reactor->uring_bufs, bid);
+        if (alive && !client->recv_armed && iouring_watch_client(reactor, client) != GATEWAY_SUCCESS) {
+            drop_client(reactor, client, "receive error");
+        }
+        return;
+    }
+    if (has_buffer) {
+        uring_buf_ring_recycle(&reactor->uring_bufs, bid);
+    }
+
+    if (res == 0) {
+        close_client_eof(reactor, client);
+    } else if (res == -ENOBUFS) {
+        /* Every buffer was in use; they are handed back at the end of this batch */
+        if (!client->recv_armed && iouring_watch_client(reactor, client) != GATEWAY_SUCCESS) {
+            drop_client(reactor, client, "receive error");
         }
     } else {
-        log_message(LOG_LEVEL_INFO, "Connection Manager shutdown already in progress or completed."); 
+        log_message(LOG_LEVEL_ERROR, "recv() failed for socket %d: %s", client->socket_fd, strerror(-res));
+        drop_client(reactor, client, "read error");
     }
 }
 
-/* --- Implementation of Internal Helper Functions --- */
+/**
+ * @brief Cancels every request of the reactor, waits briefly for their final completions and frees the ring.
+ * Requests of a reactor thread that already exited were cancelled by the kernel, their completions are reaped here.
+ * @param reactor The reactor to clean up; its clients have been removed.
+ */
+static void iouring_backend_cleanup(conmgt_reactor_t *reactor) {
+    if (reactor->uring.ring_fd != -1) {
+        struct io_uring_sqe *sqe = uring_get_sqe(&reactor->uring);
+        if (sqe != NULL) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+            sqe->user_data = (uint64_t)(uintptr_t)EVENT_TAG_CANCEL(reactor);
+        }
+        for (int round = 0; reactor->uring_inflight > 0 && round < URING_DRAIN_ROUNDS; ++round) {
+            uring_submit_and_wait(&reactor->uring, 100);
+            iouring_process_completions(reactor);
+        }
+        if (reactor->uring_inflight > 0) {
+            log_message(LOG_LEVEL_WARNING, "Reactor %d closed its ring with %u requests still in flight.",
+                        reactor->index, reactor->uring_inflight);
+        }
+    }
+
+    /* Closing the ring ends whatever is left, after which no completion can reference a client */
+    uring_buf_ring_free(&reactor->uring, &reactor->uring_bufs);
+    uring_free(&reactor->uring);
+    while (reactor->closing_list != NULL) {
+        client_info_t *client = reactor->closing_list;
+        reactor->closing_list = client->next;
+        pool_free(client_pool, client);
+    }
+    reactor->uring_inflight = 0;
+}
 
 /**
- * @brief Sets up the server listening socket.
+ * @brief Sets up a reactor's datagram ingest socket and its recvmmsg() buffers.
+ * @param reactor The reactor the socket belongs to.
+ * @param port The UDP port number to bind (the same number as the TCP listener).
+ * @param reuse_port Whether to set SO_REUSEPORT so every reactor can bind the port.
+ * @return GATEWAY_SUCCESS on success, error code otherwise.
+ */
+static gateway_error_t setup_udp_socket(conmgt_reactor_t *reactor, int port, bool reuse_port) {
+    struct sockaddr_in addr;
+    int opt = 1;
+    int udp_sd;
+
+    reactor->udp_msgs = calloc(UDP_BATCH_SIZE, sizeof(struct mmsghdr));
+    reactor->udp_iovs = calloc(UDP_BATCH_SIZE, sizeof(struct iovec));
+    reactor->udp_buffers = malloc((size_t)UDP_BATCH_SIZE * UDP_DATAGRAM_MAX);
+    /* Sized for plain frames; denser packed datagrams (meant for TCP streams) may be dropped */
+    reactor->udp_readings_capacity = (size_t)UDP_BATCH_SIZE * (UDP_DATAGRAM_MAX / PROTOCOL_LEGACY_FRAME_SIZE);
+    reactor->udp_readings = malloc(reactor->udp_readings_capacity * sizeof(sensor_data_t));
+    if (reactor->udp_msgs == NULL || reactor->udp_iovs == NULL || reactor->udp_buffers == NULL || reactor->udp_readings == NULL) {
+        log_message(LOG_LEVEL_ERROR, "Reactor %d failed to allocate its datagram buffers.", reactor->index);
+        return GATEWAY_ERROR_NOMEM;
+    }
+    for (int i = 0; i < UDP_BATCH_SIZE; ++i) {
+        reactor->udp_iovs[i].iov_base = reactor->udp_buffers + (size_t)i * UDP_DATAGRAM_MAX;
+        reactor->udp_iovs[i].iov_len = UDP_DATAGRAM_MAX;
+        reactor->udp_msgs[i].msg_hdr.msg_iov = &reactor->udp_iovs[i];
+        reactor->udp_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    if ((udp_sd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+        log_message(LOG_LEVEL_ERROR, "Failed to create UDP socket: %s", strerror(errno));
+        return CONNMGR_SOCKET_CREATE_ERR;
+    }
+
+    if (reuse_port && setsockopt(udp_sd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        log_message(LOG_LEVEL_ERROR, "setsockopt(SO_REUSEPORT) failed on UDP socket: %s", strerror(errno));
+        close(udp_sd);
+        return CONNMGR_ERROR;
+    }
+
+    /* Best effort: the kernel caps this at net.core.rmem_max */
+    int rcvbuf = UDP_RCVBUF_SIZE;
+    if (setsockopt(udp_sd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        log_message(LOG_LEVEL_WARNING, "setsockopt(SO_RCVBUF) failed on UDP socket: %s", strerror(errno));
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(udp_sd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        log_message(LOG_LEVEL_ERROR, "Failed to bind UDP socket to port %d: %s", port, strerror(errno));
+        close(udp_sd);
+        return CONNMGR_SOCKET_BIND_ERR;
+    }
+
+    reactor->udp_sd = udp_sd;
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Sets up a reactor's listening socket.
+ * With several reactors SO_REUSEPORT lets each of them bind the same port, the kernel then
+ * spreads new connections across them. A single reactor keeps exclusive ownership of the port.
+ * @param reactor The reactor the socket belongs to.
  * @param port The port number to listen on.
+ * @param reuse_port Whether to set SO_REUSEPORT.
  * @return GATEWAY_SUCCESS on success, error code otherwise.
  */
-static gateway_error_t setup_server_socket(int port) {
+static gateway_error_t setup_server_socket(conmgt_reactor_t *reactor, int port, bool reuse_port) {
     struct sockaddr_in server_addr;
     int opt = 1;
+    int server_sd;
 
-    if ((server_sd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
-        log_message(LOG_LEVEL_ERROR, "Failed to create server socket: %s", strerror(errno)); 
+    if ((server_sd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+        log_message(LOG_LEVEL_ERROR, "Failed to create server socket: %s", strerror(errno));
         return CONNMGR_SOCKET_CREATE_ERR;
     }
 
     if (setsockopt(server_sd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        log_message(LOG_LEVEL_ERROR, "setsockopt(SO_REUSEADDR) failed: %s", strerror(errno)); 
+        log_message(LOG_LEVEL_ERROR, "setsockopt(SO_REUSEADDR) failed: %s", strerror(errno));
         close(server_sd);
-        server_sd = -1;
         return CONNMGR_ERROR; // Generic error
     }
 
+    if (reuse_port && setsockopt(server_sd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        log_message(LOG_LEVEL_ERROR, "setsockopt(SO_REUSEPORT) failed: %s", strerror(errno));
+        close(server_sd);
+        return CONNMGR_ERROR;
+    }
+
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
     server_addr.sin_port = htons(port);
 
     if (bind(server_sd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        log_message(LOG_LEVEL_ERROR, "Failed to bind server socket to port %d: %s", port, strerror(errno)); 
+        log_message(LOG_LEVEL_ERROR, "Failed to bind server socket to port %d: %s", port, strerror(errno));
         close(server_sd);
-        server_sd = -1;
         return CONNMGR_SOCKET_BIND_ERR;
     }
 
-    if (listen(server_sd, TCP_BACKLOG) < 0) {
-        log_message(LOG_LEVEL_ERROR, "Failed to listen on server socket: %s", strerror(errno)); 
+    if (listen(server_sd, (int)gateway_settings.tcp_backlog) < 0) {
+        log_message(LOG_LEVEL_ERROR, "Failed to listen on server socket: %s", strerror(errno));
         close(server_sd);
-        server_sd = -1;
         return CONNMGR_SOCKET_LISTEN_ERR;
     }
 
+    reactor->server_sd = server_sd;
     return GATEWAY_SUCCESS;
 }
 
 /**
- * @brief Handles a new incoming connection request.
- * @param max_sd Pointer to the maximum socket descriptor value (will be updated).
+ * @brief Raises the RLIMIT_NOFILE soft limit to the hard limit.
+ * Without a fixed connection table the open file limit is what bounds the number of sensors.
  */
-static void handle_new_connection(int *max_sd) {
+static void raise_fd_limit(void) {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        rlim_t previous = limit.rlim_cur;
+        limit.rlim_cur = limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &limit) == 0) {
+            LOG_DEBUG("Raised open file limit from %lu to %lu.",
+                        (unsigned long)previous, (unsigned long)limit.rlim_cur);
+        }
+    }
+}
+
+/**
+ * @brief Accepts every pending connection on a reactor's listener.
+ * The listener is non-blocking, so one wakeup drains the whole backlog up to EAGAIN.
+ * @param reactor The reactor whose listener is readable.
+ */
+static void handle_new_connection(conmgt_reactor_t *reactor) {
     int client_sd;
     struct sockaddr_in client_addr;
-    socklen_t client_addr_len = sizeof(client_addr);
-    int current_connections_from_ip = 0; /* Counter for connections from this IP */
-    char client_ip_str[INET_ADDRSTRLEN]; /* Buffer to hold incoming IP string */
+    socklen_t client_addr_len;
+
+    while (reactor->server_sd != -1) {
+        client_addr_len = sizeof(client_addr);
+        /* Clients are non-blocking so the edge-triggered reads can drain them */
+        client_sd = accept4(reactor->server_sd, (struct sockaddr *)&client_addr, &client_addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_sd >= 0) {
+            accept_client(reactor, client_sd, &client_addr);
+            continue;
+        }
 
-    if (server_sd == -1) {
+        if (errno == EINTR || errno == ECONNABORTED) {
+            continue;
+        }
+        if ((errno == EMFILE || errno == ENFILE) && reactor->reserve_fd != -1) {
+            /* Otherwise the level-triggered listener would keep waking up */
+            shed_connection(reactor);
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EBADF && errno != EINVAL) { /* EBADF occurs if server_sd closed between epoll_wait() and accept() */
+            log_message(LOG_LEVEL_ERROR, "accept() failed: %s", strerror(errno));
+        }
         return;
     }
+}
 
-    client_sd = accept(server_sd, (struct sockaddr *)&client_addr, &client_addr_len);
-    if (client_sd < 0) {
-        if (errno != EBADF && errno != EINVAL) { /* EBADF occurs if server_sd closed between select() and accept() */
-            log_message(LOG_LEVEL_ERROR, "accept() failed: %s", strerror(errno)); 
-        }
+/**
+ * @brief Out of descriptors: uses the reserved one to accept and close a pending connection.
+ * @param reactor The reactor whose listener has a connection pending.
+ */
+static void shed_connection(conmgt_reactor_t *reactor) {
+    int client_sd;
+
+    if (reactor->reserve_fd == -1) {
         return;
     }
+    close(reactor->reserve_fd);
+    client_sd = accept(reactor->server_sd, NULL, NULL);
+    if (client_sd >= 0) {
+        close(client_sd);
+    }
+    reactor->reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    log_message(LOG_LEVEL_WARNING, "Out of file descriptors, rejected a new connection on reactor %d.", reactor->index);
+}
+
+/**
+ * @brief Applies the per-IP limit to an accepted connection and adds it to the reactor.
+ * @param reactor The reactor that accepted the connection.
+ * @param client_sd The accepted socket.
+ * @param client_addr The peer address.
+ */
+static void accept_client(conmgt_reactor_t *reactor, int client_sd, struct sockaddr_in *client_addr) {
+    int current_connections_from_ip = 0; /* Counter for connections from this IP */
+    char client_ip_str[INET_ADDRSTRLEN]; /* Buffer to hold incoming IP string */
+    uint8_t key[IP_KEY_SIZE];
 
-    inet_ntop(AF_INET, &(client_addr.sin_addr), client_ip_str, INET_ADDRSTRLEN);
+    inet_ntop(AF_INET, &(client_addr->sin_addr), client_ip_str, INET_ADDRSTRLEN);
+    ip_key_from_ipv4(&client_addr->sin_addr, key);
 
     /* --- BEGIN: Connection Limiting --- */
-    #ifdef MAX_CONNECTIONS_PER_IP
-    pthread_mutex_lock(&conmgt_mutex); // Assume mutex protects client_sockets
-    for (int i = 0; i < MAX_CONNECTIONS; ++i) {
-        if (client_sockets[i].socket_fd != -1 && client_sockets[i].client_ip[0] != '\0' &&
-            strcmp(client_sockets[i].client_ip, client_ip_str) == 0) {
-            current_connections_from_ip++;
+    int limit = (int)SETTING(max_connections_per_ip); /* 0 = no limit */
+    if (!ip_table_acquire(key, limit, &current_connections_from_ip)) {
+        if (limit > 0 && current_connections_from_ip >= limit) {
+            log_message(LOG_LEVEL_WARNING, "Connection limit (%d) reached for IP %s. Rejecting new connection (socket %d).",
+                        limit, client_ip_str, client_sd);
+        } else {
+            log_message(LOG_LEVEL_WARNING, "All %d address slots in use, rejecting connection from %s (socket %d).",
+                        CONMGT_MAX_CLIENTS, client_ip_str, client_sd);
         }
-    }
-    pthread_mutex_unlock(&conmgt_mutex);
-
-    if (current_connections_from_ip >= MAX_CONNECTIONS_PER_IP) {
-        log_message(LOG_LEVEL_WARNING, "Connection limit (%d) reached for IP %s. Rejecting new connection (socket %d).", 
-                    MAX_CONNECTIONS_PER_IP, client_ip_str, client_sd);
         close(client_sd); /* Close the rejected socket */
         return; /* Stop processing this new connection */
     }
-    #endif
     /* --- END: Connection Limiting --- */
+    metrics_inc(METRIC_CONN_ACCEPTS);
+
+    log_message(LOG_LEVEL_INFO, "New connection accepted from %s:%d (socket %d, reactor %d). Current connections from this IP: %d",
+                client_ip_str, ntohs(client_addr->sin_port), client_sd, reactor->index, current_connections_from_ip);
+
+    /* Add the client (add_client releases the IP slot if it fails) */
+    pthread_mutex_lock(&reactor->mutex); // Mutex protects add_client
+    add_client(reactor, client_sd, client_addr, key); // add_client logs internally
+    pthread_mutex_unlock(&reactor->mutex);
+}
+
+/**
+ * @brief Stores an IPv4 address as an IPv4-mapped IPv6 key, so both families share one table.
+ * @param addr The IPv4 address.
+ * @param key Output key of IP_KEY_SIZE bytes.
+ */
+static void ip_key_from_ipv4(const struct in_addr *addr, uint8_t key[IP_KEY_SIZE]) {
+    memset(key, 0, 10);
+    key[10] = 0xff;
+    key[11] = 0xff;
+    memcpy(key + 12, &addr->s_addr, 4);
+}
+
+/**
+ * @brief FNV-1a hash of an address key.
+ * @param key The address key.
+ * @return The hash value.
+ */
+static size_t ip_key_hash(const uint8_t key[IP_KEY_SIZE]) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < IP_KEY_SIZE; ++i) {
+        hash ^= key[i];
+        hash *= 1099511628211ULL;
+    }
+    return (size_t)hash;
+}
+
+/**
+ * @brief Doubles the bucket array of the per-IP table. Caller holds ip_table_mutex.
+ * @return true on success, false if the allocation failed (the table keeps working, just with longer chains).
+ */
+static bool ip_table_grow(void) {
+    size_t new_buckets = ip_table_buckets ? ip_table_buckets * 2 : IP_TABLE_INITIAL_BUCKETS;
+    ip_count_entry_t **new_table = calloc(new_buckets, sizeof(ip_count_entry_t *));
+    if (new_table == NULL) {
+        return false;
+    }
+    for (size_t b = 0; b < ip_table_buckets; ++b) {
+        ip_count_entry_t *entry = ip_table[b];
+        while (entry != NULL) {
+            ip_count_entry_t *next = entry->next;
+            size_t slot = ip_key_hash(entry->addr) & (new_buckets - 1);
+            entry->next = new_table[slot];
+            new_table[slot] = entry;
+            entry = next;
+        }
+    }
+    free(ip_table);
+    ip_table = new_table;
+    ip_table_buckets = new_buckets;
+    return true;
+}
+
+/**
+ * @brief Counts a new connection from an address unless the address is at its limit.
+ * @param key The address key.
+ * @param limit Maximum connections per address, 0 for no limit.
+ * @param previous Where the number of connections the address had before is stored.
+ * @return true if the connection was counted, false if it must be rejected.
+ */
+static bool ip_table_acquire(const uint8_t key[IP_KEY_SIZE], int limit, int *previous) {
+    bool accepted = false;
 
-    log_message(LOG_LEVEL_INFO, "New connection accepted from %s:%d (socket %d). Current connections from this IP: %d", 
-                client_ip_str, ntohs(client_addr.sin_port), client_sd, current_connections_from_ip);
+    pthread_mutex_lock(&ip_table_mutex);
+    if (ip_table_entries >= ip_table_buckets) {
+        ip_table_grow();
+    }
+    if (ip_table == NULL) {
+        pthread_mutex_unlock(&ip_table_mutex);
+        log_message(LOG_LEVEL_ERROR, "Failed to allocate the per-IP connection table.");
+        *previous = 0;
+        return false;
+    }
 
-    /* Add the client */
-    pthread_mutex_lock(&conmgt_mutex); // Assume mutex protects add_client
-    add_client(client_sd, &client_addr); // add_client logs internally
-    pthread_mutex_unlock(&conmgt_mutex);
+    size_t slot = ip_key_hash(key) & (ip_table_buckets - 1);
+    ip_count_entry_t *entry = ip_table[slot];
+    while (entry != NULL && memcmp(entry->addr, key, IP_KEY_SIZE) != 0) {
+        entry = entry->next;
+    }
 
-    if (client_sd > *max_sd) {
-        *max_sd = client_sd;
+    *previous = entry ? entry->count : 0;
+    if (limit > 0 && *previous >= limit) {
+        accepted = false;
+    } else if (entry != NULL) {
+        entry->count++;
+        accepted = true;
+    } else if ((entry = pool_alloc(ip_entry_pool)) != NULL) {
+        memcpy(entry->addr, key, IP_KEY_SIZE);
+        entry->count = 1;
+        entry->next = ip_table[slot];
+        ip_table[slot] = entry;
+        ip_table_entries++;
+        accepted = true;
     }
+    pthread_mutex_unlock(&ip_table_mutex);
+    return accepted;
 }
 
 /**
- * @brief Handles incoming data from a specific client.
- * Reads data, parses it, updates timestamp, inserts into buffer, and handles disconnections/errors.
- * @param client_index The index of the client in the client_sockets array.
- * @param read_fds The set of read descriptors (needed by remove_client).
- * @param buffer Pointer to the shared buffer.
+ * @brief Uncounts a closed connection, dropping the address once it has none left.
+ * @param key The address key.
  */
-static void handle_client_data(int client_index, fd_set *read_fds, sbuffer_t *buffer) {
-    /* Ensure client_index is valid */
-    if (client_index < 0 || client_index >= MAX_CONNECTIONS || client_sockets[client_index].socket_fd == -1) {
-        return; 
+static void ip_table_release(const uint8_t key[IP_KEY_SIZE]) {
+    pthread_mutex_lock(&ip_table_mutex);
+    if (ip_table != NULL) {
+        ip_count_entry_t **link = &ip_table[ip_key_hash(key) & (ip_table_buckets - 1)];
+        while (*link != NULL && memcmp((*link)->addr, key, IP_KEY_SIZE) != 0) {
+            link = &(*link)->next;
+        }
+        if (*link != NULL && --(*link)->count == 0) {
+            ip_count_entry_t *entry = *link;
+            *link = entry->next;
+            pool_free(ip_entry_pool, entry);
+            ip_table_entries--;
+        }
     }
+    pthread_mutex_unlock(&ip_table_mutex);
+}
 
-    int client_sd = client_sockets[client_index].socket_fd;
-    char recv_buffer[EXPECTED_PACKET_SIZE];
+/**
+ * @brief Closes a client after a read error or EOF, logging why.
+ * @param reactor The reactor owning the client.
+ * @param client The client to close.
+ * @param reason Short description used in the log message.
+ */
+static void drop_client(conmgt_reactor_t *reactor, client_info_t *client, const char *reason) {
+    if (client->id_received) {
+         log_message(LOG_LEVEL_INFO, "Closing connection due to %s for sensor %d (socket %d)",
+                     reason, client->sensor_id, client->socket_fd);
+    } else {
+         log_message(LOG_LEVEL_INFO, "Closing connection due to %s before ID received (socket %d)", reason, client->socket_fd);
+    }
+    pthread_mutex_lock(&reactor->mutex); // Protect remove_client
+    remove_client(reactor, client);
+    pthread_mutex_unlock(&reactor->mutex);
+}
+
+/**
+ * @brief Closes a client whose peer closed the connection.
+ * @param reactor The reactor owning the client.
+ * @param client The client that reached EOF.
+ */
+static void close_client_eof(conmgt_reactor_t *reactor, client_info_t *client) {
+    if (client->rx_partial_len > 0) {
+        log_message(LOG_LEVEL_WARNING, "Socket %d closed with %zu bytes of an incomplete frame pending.",
+                    client->socket_fd, client->rx_partial_len);
+    }
+    if (client->id_received) {
+        log_message(LOG_LEVEL_INFO, "Sensor node %d has closed the connection (socket %d)",
+                    client->sensor_id, client->socket_fd);
+    } else {
+        log_message(LOG_LEVEL_INFO, "Connection closed by client before sending ID (socket %d)", client->socket_fd);
+    }
+    pthread_mutex_lock(&reactor->mutex); // Protect remove_client
+    remove_client(reactor, client);
+    pthread_mutex_unlock(&reactor->mutex);
+}
+
+/**
+ * @brief Handles incoming data from a specific client (epoll backend).
+ * The socket is edge-triggered, so it is read in large blocks until it is drained.
+ * @param reactor The reactor owning the client.
+ * @param client The client the event was reported for.
+ */
+static void handle_client_data(conmgt_reactor_t *reactor, client_info_t *client) {
+    int client_sd = client->socket_fd;
+    uint8_t *rx = reactor->rx_buffer;
     ssize_t bytes_received;
-    sensor_data_t sensor_reading;
+
+    while (1) {
+        /* Resume with the partial frame left over by the previous read */
+        size_t pending = client->rx_partial_len;
+        size_t room = CONMGT_RX_BUFFER_SIZE - pending;
+        memcpy(rx, client->rx_partial, pending);
+
+        bytes_received = read(client_sd, rx + pending, room);
+
+        /* 1. Check for read errors */
+        if (bytes_received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return; /* Socket drained, wait for the next edge */
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            log_message(LOG_LEVEL_ERROR, "read() failed for socket %d: %s", client_sd, strerror(errno));
+            drop_client(reactor, client, "read error");
+            return;
+        }
+        /* 2. Check for connection closed by client (EOF) */
+        if (bytes_received == 0) {
+            close_client_eof(reactor, client);
+            return;
+        }
+
+        /* 3. Decode every complete frame, keep the remainder */
+        if (!consume_client_data(reactor, client, rx, pending + (size_t)bytes_received)) {
+            return;
+        }
+
+        /* A short read means the socket was drained when it was read */
+        if ((size_t)bytes_received < room) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Stamps decoded readings with their time of receipt, for the end-to-end latency histograms.
+ */
+static void stamp_readings(sensor_data_t *readings, size_t count) {
+    uint32_t stamp = metrics_ingest_stamp();
+    for (size_t i = 0; i < count; ++i) {
+        readings[i].ingest_us = stamp;
+    }
+}
+
+/**
+ * @brief Decodes a block of bytes received from a client.
+ * Every complete frame is decoded, a trailing partial frame is kept in the client for the next block.
+ * The readings of one block go into the shared buffer as a single batch.
+ * @param reactor The reactor owning the client.
+ * @param client The client the bytes came from.
+ * @param data The client's pending partial frame followed by the newly received bytes.
+ * @param len Number of bytes in data, at most CONMGT_RX_BUFFER_SIZE.
+ * @return true if the client is still open, false if it was dropped for a protocol error.
+ */
+static bool consume_client_data(conmgt_reactor_t *reactor, client_info_t *client, const uint8_t *data, size_t len) {
+    int client_sd = client->socket_fd;
+    size_t consumed = 0;
+    size_t decoded = 0;
+    time_t now = time(NULL);
+    uint8_t version = client->stream.version;
+    bool acked = client->stream.acked;
     gateway_error_t sbuf_ret;
+    gateway_error_t proto_ret = protocol_decode(&client->stream, data, len, now, reactor->rx_readings,
+                                                reactor->rx_readings_capacity, &consumed, &decoded);
+    if (version == 0 && client->stream.version == PROTOCOL_V2_VERSION) {
+        log_message(LOG_LEVEL_INFO, "Socket %d negotiated batched protocol v%d.", client_sd, PROTOCOL_V2_VERSION);
+    }
 
-    bytes_received = read(client_sd, recv_buffer, EXPECTED_PACKET_SIZE);
+    metrics_add(METRIC_CONN_BYTES, len - client->rx_partial_len); /* New bytes only, not the pending partial frame */
+    metrics_add(METRIC_CONN_FRAMES, decoded);
+    client->rx_partial_len = len - consumed;
+    if (proto_ret == GATEWAY_SUCCESS && client->rx_partial_len > PROTOCOL_MAX_FRAME_SIZE) {
+        proto_ret = CONNMGR_PROTOCOL_ERR; /* Cannot happen with rx_readings sized for a full block */
+    }
+    if (proto_ret == GATEWAY_SUCCESS) {
+        memmove(client->rx_partial, data + consumed, client->rx_partial_len);
+    }
+    client->last_active_ts = now;
+    timer_schedule(reactor, client, now + SETTING(sensor_timeout_sec) + 1);
+
+    if (decoded > 0) {
+        sensor_id_t last_id = reactor->rx_readings[decoded - 1].id;
+        stamp_readings(reactor->rx_readings, decoded);
+        capture_write(client_sd, reactor->rx_readings, decoded);
+
+        if (!client->id_received) {
+            client->sensor_id = reactor->rx_readings[0].id;
+            client->id_received = true;
+            log_message(LOG_LEVEL_INFO, "Sensor node %d has opened a new connection (socket %d)",
+                         client->sensor_id, client_sd);
+        }
+        /* A v2 stream relays many sensors, its id is only the first one seen */
+        if (client->stream.version != PROTOCOL_V2_VERSION && client->sensor_id != last_id) {
+            log_message(LOG_LEVEL_WARNING, "Sensor ID changed on socket %d from %d to %d",
+                         client_sd, client->sensor_id, last_id);
+            client->sensor_id = last_id; // Update ID
+        }
 
-    /* 1. Check for read errors */
-    if (bytes_received < 0) {
-        log_message(LOG_LEVEL_ERROR, "read() failed for socket %d: %s", client_sd, strerror(errno)); 
-        if (client_sockets[client_index].id_received) {
-             log_message(LOG_LEVEL_INFO, "Closing connection due to read error for sensor %d (socket %d)", 
-                         client_sockets[client_index].sensor_id, client_sd);
-        } else {
-             log_message(LOG_LEVEL_INFO, "Closing connection due to read error before ID received (socket %d)", client_sd); 
-        }
-        pthread_mutex_lock(&conmgt_mutex); // Protect remove_client
-        remove_client(client_index, read_fds);
-        pthread_mutex_unlock(&conmgt_mutex);
-    }
-    /* 2. Check for connection closed by client (EOF) */
-    else if (bytes_received == 0) {
-        if (client_sockets[client_index].id_received) {
-            log_message(LOG_LEVEL_INFO, "Sensor node %d has closed the connection (socket %d)", 
-                        client_sockets[client_index].sensor_id, client_sd);
-       } else {
-            log_message(LOG_LEVEL_INFO, "Connection closed by client before sending ID (socket %d)", client_sd); 
-       }
-        pthread_mutex_lock(&conmgt_mutex); // Protect remove_client
-        remove_client(client_index, read_fds);
-        pthread_mutex_unlock(&conmgt_mutex);
-    }
-    /* 3. Check if the expected number of bytes were received */
-    else if ((size_t)bytes_received == EXPECTED_PACKET_SIZE) {
-        /* Data received successfully */
-        uint16_t network_sensor_id;
-        double network_value;
-
-        memcpy(&network_sensor_id, recv_buffer, sizeof(uint16_t));
-        memcpy(&network_value, recv_buffer + sizeof(uint16_t), sizeof(double));
-
-        sensor_reading.id = ntohs(network_sensor_id);
-        sensor_reading.value = network_value;
-        sensor_reading.ts = time(NULL);
-
-        client_sockets[client_index].last_active_ts = sensor_reading.ts;
-
-        if (!client_sockets[client_index].id_received) {
-            client_sockets[client_index].sensor_id = sensor_reading.id;
-            client_sockets[client_index].id_received = true;
-            log_message(LOG_LEVEL_INFO, "Sensor node %d has opened a new connection (socket %d)", 
-                         sensor_reading.id, client_sd);
-        } else if (client_sockets[client_index].sensor_id != sensor_reading.id) {
-            log_message(LOG_LEVEL_WARNING, "Sensor ID changed on socket %d from %d to %d", 
-                         client_sd, client_sockets[client_index].sensor_id, sensor_reading.id);
-            client_sockets[client_index].sensor_id = sensor_reading.id; // Update ID
-        }
-
-        sbuf_ret = sbuffer_insert(buffer, &sensor_reading);
+        sbuf_ret = sbuffer_insert_batch(reactor->buffer, reactor->rx_readings, decoded);
         if (sbuf_ret != GATEWAY_SUCCESS) {
-            log_message(LOG_LEVEL_ERROR, "Failed to insert data from sensor %d into buffer (Error %d)", 
-                         sensor_reading.id, sbuf_ret);
+            log_message(LOG_LEVEL_ERROR, "Failed to insert %zu readings from sensor %d into buffer (Error %d)",
+                         decoded, client->sensor_id, sbuf_ret);
         } else {
-             log_message(LOG_LEVEL_DEBUG, "Sensor %d data inserted into buffer (socket %d)", 
-                           sensor_reading.id, client_sd);
-       }
-
-    }
-    /* 4. Handle partial or unexpected data size */
-    else {
-         log_message(LOG_LEVEL_WARNING, "Received partial/unexpected data size (%zd bytes, expected %zu) from socket %d. Closing connection.", 
-                     bytes_received, EXPECTED_PACKET_SIZE, client_sd);
-        if (client_sockets[client_index].id_received) {
-             log_message(LOG_LEVEL_INFO, "Closing connection due to partial read for sensor %d (socket %d)", 
-                         client_sockets[client_index].sensor_id, client_sd);
-        } else {
-             log_message(LOG_LEVEL_INFO, "Closing connection due to partial read before ID received (socket %d)", client_sd); 
+             client->readings_accepted += decoded;
+             LOG_DEBUG("Inserted %zu readings into buffer (socket %d)",
+                           decoded, client_sd);
         }
-        pthread_mutex_lock(&conmgt_mutex); // Protect remove_client
-        remove_client(client_index, read_fds);
-        pthread_mutex_unlock(&conmgt_mutex);
     }
+    if (!acked && client->stream.acked) {
+        log_message(LOG_LEVEL_INFO, "Socket %d asked for acknowledgements (forwarding gateway).", client_sd);
+    }
+
+    if (proto_ret != GATEWAY_SUCCESS) {
+        metrics_inc(METRIC_CONN_PARSE_ERRORS);
+        log_message(LOG_LEVEL_WARNING, "Malformed frame from socket %d.", client_sd);
+        drop_client(reactor, client, "protocol error");
+        return false;
+    }
+    if (client->stream.acked && consumed > 0 && !send_ack(client)) {
+        drop_client(reactor, client, "acknowledgement overflow");
+        return false;
+    }
+    return true;
 }
 
 /**
- * @brief Checks all active clients for inactivity timeouts.
- * Removes clients that have been inactive for too long.
- * @param read_fds The set of read descriptors (will be modified by remove_client).
+ * @brief Sends a client the number of its readings accepted so far. Acknowledgements are cumulative,
+ * so one that does not fit the socket's send buffer is skipped, the next one covers it.
+ * @param client A client whose stream asked for acknowledgements.
+ * @return false if only part of it was sent; the stream is out of step then and must be closed.
  */
-static void check_sensor_timeouts(fd_set *read_fds) {
-    time_t now = time(NULL);
+static bool send_ack(client_info_t *client) {
+    uint64_t ack = htobe64(client->readings_accepted);
+    ssize_t sent = send(client->socket_fd, &ack, sizeof(ack), MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (sent == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        LOG_DEBUG("Acknowledgement to socket %d failed: %s", client->socket_fd, strerror(errno));
+    }
+    return sent == -1 || sent == (ssize_t)sizeof(ack);
+}
+
+/**
+ * @brief Drains the reactor's datagram socket.
+ * Each recvmmsg() call takes up to UDP_BATCH_SIZE datagrams. Every datagram is decoded on its own
+ * (it must hold whole frames, legacy or v2) and the readings of the whole call go into the shared
+ * buffer as one batch.
+ * @param reactor The reactor whose UDP socket is readable.
+ */
+static void handle_udp_data(conmgt_reactor_t *reactor) {
+    while (1) {
+        int received = recvmmsg(reactor->udp_sd, reactor->udp_msgs, UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                log_message(LOG_LEVEL_ERROR, "recvmmsg() failed on reactor %d: %s", reactor->index, strerror(errno));
+            }
+            return;
+        }
+
+        time_t now = time(NULL);
+        size_t total = 0;
+        size_t bytes = 0;
+        for (int i = 0; i < received; ++i) {
+            protocol_stream_t stream = {0}; /* Datagrams are independent streams */
+            size_t consumed = 0;
+            size_t decoded = 0;
+            size_t len = reactor->udp_msgs[i].msg_len;
+            bytes += len;
+            gateway_error_t proto_ret = protocol_decode(&stream, reactor->udp_iovs[i].iov_base, len, now,
+                                                        reactor->udp_readings + total,
+                                                        reactor->udp_readings_capacity - total, &consumed, &decoded);
+            if (proto_ret != GATEWAY_SUCCESS || consumed != len ||
+                (reactor->udp_msgs[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+                reactor->udp_malformed++;
+                metrics_inc(METRIC_CONN_PARSE_ERRORS);
+                LOG_DEBUG("Dropping malformed datagram (%zu bytes) on reactor %d.", len, reactor->index);
+                continue; /* Whole datagram is dropped */
+            }
+            total += decoded;
+        }
+        metrics_add(METRIC_CONN_BYTES, bytes);
+        metrics_add(METRIC_CONN_FRAMES, total);
+
+        if (total > 0) {
+            stamp_readings(reactor->udp_readings, total);
+            capture_write(reactor->udp_sd, reactor->udp_readings, total);
+            gateway_error_t sbuf_ret = sbuffer_insert_batch(reactor->buffer, reactor->udp_readings, total);
+            if (sbuf_ret != GATEWAY_SUCCESS) {
+                log_message(LOG_LEVEL_ERROR, "Failed to insert %zu datagram readings into buffer (Error %d)", total, sbuf_ret);
+            } else {
+                LOG_DEBUG("Inserted %zu readings from %d datagrams into buffer (reactor %d)",
+                            total, received, reactor->index);
+            }
+        }
+
+        if (received < UDP_BATCH_SIZE) {
+            return; /* Socket drained */
+        }
+    }
+}
 
-    pthread_mutex_lock(&conmgt_mutex); // Protect access
-    /* Iterate backwards for safe removal */
-    for (int i = num_clients - 1; i >= 0; --i) { // Iterate based on actual client count
-        if (client_sockets[i].socket_fd != -1) { // Check if slot is active
-            if ((now - client_sockets[i].last_active_ts) > SENSOR_TIMEOUT_SEC) {
-                if (client_sockets[i].id_received) {
-                     log_message(LOG_LEVEL_INFO, "Sensor node %d timed out (socket %d). Closing connection.", 
-                                 client_sockets[i].sensor_id, client_sockets[i].socket_fd);
+/**
+ * @brief Expires the timer wheel slots of every second up to now.
+ * A client sits in the slot of its deadline, so only clients that actually time out are visited.
+ * @param reactor The reactor whose clients are checked.
+ * @param now The current time.
+ */
+static void check_sensor_timeouts(conmgt_reactor_t *reactor, time_t now) {
+    if (now <= reactor->timer_now) {
+        return;
+    }
+    /* After a long stall (or a clock jump) every slot is visited once */
+    time_t first = reactor->timer_now + 1;
+    if (now - first >= TIMER_WHEEL_SLOTS) {
+        first = now - TIMER_WHEEL_SLOTS + 1;
+    }
+
+    pthread_mutex_lock(&reactor->mutex); // Protect access
+    for (time_t tick = first; tick <= now; ++tick) {
+        client_info_t *client = reactor->timer_wheel[tick % TIMER_WHEEL_SLOTS];
+        while (client != NULL) {
+            client_info_t *next = client->timer_next; /* remove_client frees the node */
+            if (client->timer_deadline <= now) {
+                if (client->id_received) {
+                     log_message(LOG_LEVEL_INFO, "Sensor node %d timed out (socket %d). Closing connection.",
+                                 client->sensor_id, client->socket_fd);
                 } else {
-                     log_message(LOG_LEVEL_INFO, "Client timed out before sending ID (socket %d). Closing connection.", 
-                                 client_sockets[i].socket_fd);
+                     log_message(LOG_LEVEL_INFO, "Client timed out before sending ID (socket %d). Closing connection.",
+                                 client->socket_fd);
                 }
-                remove_client(i, read_fds); // remove_client logs the removal details
+                remove_client(reactor, client); // remove_client logs the removal details
             }
+            client = next;
         }
     }
-    pthread_mutex_unlock(&conmgt_mutex);
+    pthread_mutex_unlock(&reactor->mutex);
+    reactor->timer_now = now;
 }
 
 /**
- * @brief Adds a new client to the client_sockets array.
- * @param client_sd The socket descriptor of the new client.
- * @param client_addr The address structure of the new client.
+ * @brief Places a client in the wheel slot of its inactivity deadline.
+ * Called on every read, but only relinks when the deadline moved to another second.
+ * @param reactor The reactor owning the client.
+ * @param client The client to (re)schedule.
+ * @param deadline First second at which the client counts as timed out.
  */
-static void add_client(int client_sd, struct sockaddr_in *client_addr) {
-
-    if (num_clients >= MAX_CONNECTIONS) {
-        log_message(LOG_LEVEL_WARNING, "Maximum connection limit (%d) reached. Rejecting connection from %s:%d", 
-                     MAX_CONNECTIONS, inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port));
-        close(client_sd);
+static void timer_schedule(conmgt_reactor_t *reactor, client_info_t *client, time_t deadline) {
+    if (deadline <= reactor->timer_now) {
+        deadline = reactor->timer_now + 1; /* Clock went backwards, expire on the next tick */
+    }
+    if (client->timer_deadline == deadline) {
         return;
     }
+    timer_cancel(reactor, client);
+
+    client_info_t **slot = &reactor->timer_wheel[deadline % TIMER_WHEEL_SLOTS];
+    client->timer_deadline = deadline;
+    client->timer_prev = NULL;
+    client->timer_next = *slot;
+    if (*slot != NULL) {
+        (*slot)->timer_prev = client;
+    }
+    *slot = client;
+}
 
-    /* Find the first available slot */
-    int i;
-    for (i = 0; i < MAX_CONNECTIONS; ++i) {
-        if (client_sockets[i].socket_fd == -1) {
-            client_sockets[i].socket_fd = client_sd;
-            client_sockets[i].last_active_ts = time(NULL);
-            client_sockets[i].id_received = false;
-            client_sockets[i].sensor_id = 0;
-            client_sockets[i].connection_start_ts = client_sockets[i].last_active_ts;
-
-            inet_ntop(AF_INET, &(client_addr->sin_addr), client_sockets[i].client_ip, INET_ADDRSTRLEN);
-            client_sockets[i].client_port = ntohs(client_addr->sin_port);
+/**
+ * @brief Removes a client from the timer wheel, if it is scheduled.
+ * @param reactor The reactor owning the client.
+ * @param client The client to unlink.
+ */
+static void timer_cancel(conmgt_reactor_t *reactor, client_info_t *client) {
+    if (client->timer_deadline == 0) {
+        return;
+    }
+    if (client->timer_prev != NULL) {
+        client->timer_prev->timer_next = client->timer_next;
+    } else {
+        reactor->timer_wheel[client->timer_deadline % TIMER_WHEEL_SLOTS] = client->timer_next;
+    }
+    if (client->timer_next != NULL) {
+        client->timer_next->timer_prev = client->timer_prev;
+    }
+    client->timer_prev = client->timer_next = NULL;
+    client->timer_deadline = 0;
+}
 
-            num_clients++;
-            log_message(LOG_LEVEL_DEBUG, "Added client %s:%d (socket %d) at index %d. Total clients: %d", 
-                        client_sockets[i].client_ip, client_sockets[i].client_port, client_sd, i, num_clients);
-            return;
+/**
+ * @brief Computes the epoll_wait() timeout that wakes the reactor at its earliest deadline.
+ * @param reactor The reactor to inspect.
+ * @return Milliseconds until the earliest deadline, or -1 if no client is scheduled.
+ */
+static int timer_next_timeout_ms(conmgt_reactor_t *reactor) {
+    struct timespec now;
+
+    for (time_t tick = reactor->timer_now + 1; tick <= reactor->timer_now + TIMER_WHEEL_SLOTS; ++tick) {
+        if (reactor->timer_wheel[tick % TIMER_WHEEL_SLOTS] != NULL) {
+            clock_gettime(CLOCK_REALTIME, &now);
+            long long wait_ms = (long long)(tick - now.tv_sec) * 1000 - now.tv_nsec / 1000000;
+            return wait_ms > 0 ? (int)wait_ms : 0;
         }
     }
-    log_message(LOG_LEVEL_ERROR, "Internal Error: Could not find slot to add client socket %d.", client_sd); 
-    close(client_sd);
+    return -1;
 }
 
 /**
- * @brief Removes a client from the list and closes its socket.
- * Uses compaction by moving the last element.
- * @param client_index The index of the client to remove.
- * @param read_fds The set of read descriptors to potentially remove the fd from.
+ * @brief Adds a new client to a reactor's client list and starts watching it with the reactor's backend.
+ * @param reactor The reactor that accepted the client.
+ * @param client_sd The socket descriptor of the new client.
+ * @param client_addr The address structure of the new client.
+ * @param ip_key The per-IP table key already counted for the client, released again on failure.
  */
-static void remove_client(int client_index, fd_set *read_fds) {
+static void add_client(conmgt_reactor_t *reactor, int client_sd, struct sockaddr_in *client_addr, const uint8_t ip_key[IP_KEY_SIZE]) {
+    client_info_t *client = pool_alloc(client_pool);
 
-    if (client_index < 0 || client_index >= MAX_CONNECTIONS || client_sockets[client_index].socket_fd == -1) {
-        return; /* Invalid index or slot already processed */
+    if (client == NULL) {
+        log_message(LOG_LEVEL_ERROR, "All %d client slots in use, rejecting connection on socket %d.", CONMGT_MAX_CLIENTS, client_sd);
+        close(client_sd);
+        ip_table_release(ip_key);
+        return;
+    }
+    memset(client, 0, sizeof(*client));
+    memcpy(client->ip_key, ip_key, IP_KEY_SIZE);
+
+    client->socket_fd = client_sd;
+    client->last_active_ts = time(NULL);
+    client->id_received = false;
+    client->sensor_id = 0;
+    client->connection_start_ts = client->last_active_ts;
+    inet_ntop(AF_INET, &(client_addr->sin_addr), client->client_ip, INET_ADDRSTRLEN);
+    client->client_port = ntohs(client_addr->sin_port);
+
+    if (backend->watch_client(reactor, client) != GATEWAY_SUCCESS) { // Backends log internally
+        close(client_sd);
+        ip_table_release(ip_key);
+        pool_free(client_pool, client);
+        return;
     }
 
-    int client_sd = client_sockets[client_index].socket_fd;
-
-    /* Remove from select set (if fd is valid) */
-    if (client_sd >= 0) {
-         FD_CLR(client_sd, read_fds);
-         close(client_sd);
+    client->prev = NULL;
+    client->next = reactor->client_list;
+    if (reactor->client_list != NULL) {
+        reactor->client_list->prev = client;
     }
+    reactor->client_list = client;
 
-    log_message(LOG_LEVEL_DEBUG, "Removing client index %d (socket %d, ID: %u). Current count %d.", 
-                 client_index, client_sd, client_sockets[client_index].id_received ? client_sockets[client_index].sensor_id : 0, num_clients);
+    timer_schedule(reactor, client, client->last_active_ts + SETTING(sensor_timeout_sec) + 1);
 
-    if (client_sd >= 0) { FD_CLR(client_sd, read_fds); close(client_sd); }
+    __atomic_store_n(&reactor->num_clients, reactor->num_clients + 1, __ATOMIC_RELAXED);
+    LOG_DEBUG("Added client %s:%d (socket %d) to reactor %d. Reactor clients: %d",
+                client->client_ip, client->client_port, client_sd, reactor->index, reactor->num_clients);
+}
 
-    client_sockets[client_index].socket_fd = -1;
-    client_sockets[client_index].id_received = false;
-    client_sockets[client_index].client_ip[0] = '\0';
-    client_sockets[client_index].sensor_id = 0;
+/**
+ * @brief Removes a client from its reactor's list, closes its socket and frees its state.
+ * Closing the socket removes it from an epoll set; the io_uring backend frees the state itself
+ * once the cancelled receive has completed.
+ * @param reactor The reactor owning the client.
+ * @param client The client to remove.
+ */
+static void remove_client(conmgt_reactor_t *reactor, client_info_t *client) {
+    LOG_DEBUG("Removing client (socket %d, ID: %u). Current count %d.",
+                 client->socket_fd, client->id_received ? client->sensor_id : 0, reactor->num_clients);
 
-    /* Compaction */
-    int last_valid_index = -1;
-    for(int j = num_clients - 1; j >= 0; --j) { if(client_sockets[j].socket_fd != -1) { last_valid_index = j; break; } }
-    if (last_valid_index != -1 && client_index < last_valid_index) {
-        log_message(LOG_LEVEL_DEBUG, "Compacting: Moving client from index %d to %d.", last_valid_index, client_index); 
-        client_sockets[client_index] = client_sockets[last_valid_index];
-        client_sockets[last_valid_index].socket_fd = -1;
-        client_sockets[last_valid_index].id_received = false;
-        client_sockets[last_valid_index].client_ip[0] = '\0';
-        client_sockets[last_valid_index].sensor_id = 0;
-    } else if (last_valid_index == client_index) {
-        log_message(LOG_LEVEL_DEBUG, "Removed last active client index %d.", client_index); 
+    if (client->socket_fd >= 0) {
+        close(client->socket_fd);
+        client->socket_fd = -1; /* Marks the client as removed for late completions */
     }
+    timer_cancel(reactor, client);
+    ip_table_release(client->ip_key);
 
-    num_clients--;
-    log_message(LOG_LEVEL_DEBUG, "Client removed. New client count: %d.", num_clients); 
+    if (client->prev != NULL) {
+        client->prev->next = client->next;
+    } else {
+        reactor->client_list = client->next;
+    }
+    if (client->next != NULL) {
+        client->next->prev = client->prev;
+    }
+    if (backend->unwatch_client(reactor, client)) {
+        pool_free(client_pool, client);
+    }
+
+    __atomic_store_n(&reactor->num_clients, reactor->num_clients - 1, __ATOMIC_RELAXED);
+    LOG_DEBUG("Client removed. New client count: %d.", reactor->num_clients);
 }
 
 /**
  * @brief Gathers connection statistics for all active clients.
- * Formats the information into the provided buffer. Thread-safe.
+ * Formats the information into the provided buffer. Thread-safe, locks one reactor at a time.
  * @param buffer The output buffer to store the formatted statistics.
  * @param size The maximum size of the output buffer.
  * @return The number of active connections formatted, or -1 on error (e.g., buffer too small).
@@ -585,34 +1760,35 @@ int conmgt_get_connection_stats(char *output_buffer, size_t buffer_size) {
     int connections_found = 0;
     time_t now = time(NULL);
 
-    pthread_mutex_lock(&conmgt_mutex);
-
     current_len += snprintf(output_buffer + current_len, buffer_size - current_len,
-                            "--- Active Connections (%d) ---\n", num_clients);
+                            "--- Active Connections (%d) ---\n", conmgt_get_active_connections());
     if (current_len >= buffer_size) goto buffer_full;
 
-    for (int i = 0; i < MAX_CONNECTIONS; ++i) {
-        if (client_sockets[i].socket_fd != -1) {
+    for (int r = 0; r < num_reactors; ++r) {
+        pthread_mutex_lock(&reactors[r].mutex);
+        for (client_info_t *client = reactors[r].client_list; client != NULL; client = client->next) {
             connections_found++;
-            time_t connected_duration = now - client_sockets[i].connection_start_ts;
+            time_t connected_duration = now - client->connection_start_ts;
             int hours = connected_duration / 3600;
             int mins = (connected_duration % 3600) / 60;
             int secs = connected_duration % 60;
 
             int len = snprintf(line_buffer, sizeof(line_buffer),
                                  "  Sensor ID: %-5u | IP: %-15s | Port: %-5d | Socket: %-3d | Connected: %02d:%02d:%02d\n",
-                                 client_sockets[i].id_received ? client_sockets[i].sensor_id : 0,
-                                 client_sockets[i].client_ip,
-                                 client_sockets[i].client_port,
-                                 client_sockets[i].socket_fd,
+                                 client->id_received ? client->sensor_id : 0,
+                                 client->client_ip,
+                                 client->client_port,
+                                 client->socket_fd,
                                  hours, mins, secs);
 
             if (current_len + len >= buffer_size) {
+                pthread_mutex_unlock(&reactors[r].mutex);
                 goto buffer_full; /* Not enough space for this line */
             }
             memcpy(output_buffer + current_len, line_buffer, len);
             current_len += len;
         }
+        pthread_mutex_unlock(&reactors[r].mutex);
     }
 
     if (current_len < buffer_size) {
@@ -621,24 +1797,22 @@ int conmgt_get_connection_stats(char *output_buffer, size_t buffer_size) {
         goto buffer_full; /* No space even for null terminator */
     }
 
-    pthread_mutex_unlock(&conmgt_mutex);
     return connections_found;
 
 buffer_full:
-    pthread_mutex_unlock(&conmgt_mutex);
     if (buffer_size > 0) output_buffer[buffer_size - 1] = '\0';
-    log_message(LOG_LEVEL_ERROR,"Buffer too small (%zu bytes) for conmgt_get_connection_stats.", buffer_size); 
+    log_message(LOG_LEVEL_ERROR,"Buffer too small (%zu bytes) for conmgt_get_connection_stats.", buffer_size);
     return -1;
 }
 
 /**
- * @brief Gets the current number of active client connections. Thread-safe.
+ * @brief Gets the current number of active client connections. Thread-safe, sums the reactor counters without locking.
  * @return The number of active connections.
  */
 int conmgt_get_active_connections() {
-    int count;
-    pthread_mutex_lock(&conmgt_mutex);
-    count = num_clients;
-    pthread_mutex_unlock(&conmgt_mutex);
+    int count = 0;
+    for (int r = 0; r < num_reactors; ++r) {
+        count += __atomic_load_n(&reactors[r].num_clients, __ATOMIC_RELAXED);
+    }
     return count;
-}
\ No newline at end of file
+}
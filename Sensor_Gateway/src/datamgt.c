@@ -1,3 +1,4 @@
+#define _GNU_SOURCE     /* For pthread_setname_np() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>     /* For sleep() */
@@ -7,6 +8,11 @@
 #include <ctype.h>      /* For isspace() */
 #include <signal.h>     /* For sig_atomic_t */
 #include <errno.h>      /* For errno */
+#include <stdarg.h>     /* For the map loader messages to stderr */
+#include <math.h>       /* For INFINITY, sqrt() */
+#include <fcntl.h>      /* For open() of the snapshot files */
+#include <sys/mman.h>   /* For mapping them */
+#include <sys/stat.h>   /* For mkdir(), fstat() */
 
 /* Include project-specific headers */
 #include "config.h"
@@ -14,6 +20,14 @@
 #include "sbuffer.h"
 #include "logger.h"
 #include "datamgt.h"
+#include "storagemgt.h" /* For storagemgt_submit_rollups() */
+#include "metrics.h"    /* For the processed readings counter and latency histograms */
+#include "pool.h"       /* Sensor statistics chunks */
+#include "sensor_batch.h" /* Struct-of-arrays batches and their kernels */
+#include "alert_rules.h" /* Per-room and per-sensor alert checks */
+#include "settings.h"   /* Alert interval and rate limit */
+#include "dedup.h"      /* Duplicate readings */
+#include "db_handler.h" /* For checking restored rollup buckets against the stored rows */
 
 /* --- Local Macros --- */
 
@@ -25,11 +39,30 @@
 #define TEMP_TOO_COLD_THRESHOLD 15.0 /* Threshold for too cold temperature */
 #endif
 
-#define INITIAL_SENSOR_LIST_CAPACITY 10 /* Initial capacity for the sensor statistics list */
+#define SENSOR_ID_SPACE (UINT16_MAX + 1) /* Number of possible sensor IDs, the size of the direct index */
+#define SENSOR_STATS_CHUNK 256          /* Stats entries allocated at once; entries never move afterwards */
+
+#if DATAMGT_AVG_MODE == DATAMGT_AVG_WINDOW && DATAMGT_WINDOW_SIZE < 1
+#error "DATAMGT_WINDOW_SIZE must be at least 1"
+#endif
 #define INVALID_SENSOR_ID 0             /* Define an invalid sensor ID for validation */
 #define BUSY_WAIT_SLEEP_SEC 1           /* Sleep duration for unexpected errors in the loop */
 #define MAP_INITIAL_CAPACITY 10         /* Initial capacity for the room-sensor map */
 #define MAP_LINE_BUFFER_SIZE 100        /* Buffer size for reading lines from the map file */
+#define DATAMGT_BATCH_SIZE SENSOR_BATCH_CAPACITY /* Max readings taken from the sbuffer per remove call */
+#define MAP_RELEASE_POLL_NS 1000000L    /* Reload: interval between checks that workers left the old map */
+#define ROLLUP_TIERS 2                  /* Minute and hour buckets */
+#define ROLLUP_OUT_BATCH 256            /* Completed rollup rows handed to storage at once */
+#define SUBSCRIBER_RELEASE_POLL_NS 100000L /* Unsubscribe: interval between checks that the publisher left */
+#define ALERT_PENDING_WORDS (SENSOR_ID_SPACE / 64) /* Words of the bitfield of sensors awaiting a summary */
+#define ALERT_SWEEP_WAIT_MS 1000        /* Longest wait for readings while summaries are pending */
+#define SNAPSHOT_MAGIC 0x504e5344u      /* "DSNP" at the start of a snapshot file */
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_PATH_SIZE 256          /* Longest snapshot file path */
+
+#if (DATAMGT_SUBSCRIBER_RING & (DATAMGT_SUBSCRIBER_RING - 1)) != 0
+#error "DATAMGT_SUBSCRIBER_RING must be a power of two"
+#endif
 
 /* --- Local Structures --- */
 
@@ -40,25 +73,228 @@ typedef enum {
     TEMP_STATE_TOO_HOT    /* Temperature is above the hot threshold */
 } temp_state_t;
 
+/* Anomaly checks, as bits of sensor_stats_t.anomalies */
+enum {
+    ANOMALY_RATE = 1 << 0,    /* Changed faster than max_rate */
+    ANOMALY_ZSCORE = 1 << 1   /* Further from the mean than max_zscore standard deviations */
+};
+
+/* Running aggregate of one time bucket; empty while count is 0 */
+typedef struct {
+    sensor_ts_t start;           /* Bucket start, a multiple of its period */
+    uint32_t count;              /* Readings added */
+    double sum;                  /* Sum of their values */
+    double min;                  /* Smallest value */
+    double max;                  /* Largest value */
+} rollup_bucket_t;
+
+/* Rollup buckets of one room, kept per worker for the sensors of its shard */
+typedef struct {
+    int room_id;                 /* Room ID from the map */
+    rollup_bucket_t rollups[ROLLUP_TIERS]; /* Open bucket of each tier */
+} room_rollup_t;
+
 /* Structure to store statistics for each sensor */
 typedef struct {
     sensor_id_t id;              /* Unique identifier for the sensor */
     double total_value_sum;      /* Sum of all temperature readings */
     uint64_t reading_count;      /* Total number of readings received */
-    temp_state_t last_logged_state; /* Last logged temperature state */
+    double average;              /* Running average checked against the thresholds */
+#if DATAMGT_AVG_MODE == DATAMGT_AVG_WINDOW
+    double window_values[DATAMGT_WINDOW_SIZE]; /* Circular array of the readings in the window */
+#if DATAMGT_WINDOW_SEC > 0
+    sensor_ts_t window_ts[DATAMGT_WINDOW_SIZE]; /* Timestamps of window_values */
+#endif
+    double window_sum;           /* Sum of the readings in the window */
+    int window_start;            /* Index of the oldest reading */
+    int window_count;            /* Number of readings in the window */
+    int window_inserts;          /* Insertions since window_sum was last recomputed */
+#endif
+    temp_state_t temp_state;     /* Threshold state, updated whether or not its alert was logged */
+    alert_profile_t alert;       /* Checks of the sensor's rules, resolved with its room */
+    unsigned int rules_generation; /* Generation of the rules alert came from (0 = to resolve) */
+    sensor_value_t last_value;   /* Previous reading, for the rate check */
+    sensor_ts_t last_ts;         /* Its timestamp */
+    double value_mean;           /* Exponentially weighted mean of the readings, for the z-score check */
+    double value_var;            /* Exponentially weighted variance of the readings */
+    uint8_t anomalies;           /* ANOMALY_* checks the previous reading failed */
+    uint32_t alert_sec;          /* Worker alert clock when an alert line of the sensor was last logged, 0 = never */
+    uint32_t alerts_suppressed;  /* Alerts held back since then, logged by the next summary */
+    unsigned int room_generation; /* Generation of the map room_id was looked up in (0 = no map) */
+    int room_id;                 /* Room of the sensor, -1 if the map does not list it */
+#if DEDUP_WINDOW_READINGS > 0
+    dedup_window_t dedup;        /* Recent readings, a reading matching one is skipped */
+#endif
+#if DATAMGT_ROLLUPS
+    room_rollup_t *room;         /* Rollups of room_id in this worker, NULL without a room */
+    rollup_bucket_t rollups[ROLLUP_TIERS]; /* Open bucket of each tier */
+#endif
 } sensor_stats_t;
 
-/* Dynamic array structure to hold sensor statistics */
+/* Block of stats entries; blocks are chained and only freed at shutdown */
+typedef struct sensor_stats_chunk {
+    struct sensor_stats_chunk *next; /* Previously allocated chunk */
+    int used;                        /* Number of entries handed out from this chunk */
+    sensor_stats_t entries[SENSOR_STATS_CHUNK];
+} sensor_stats_chunk_t;
+
+/* Sensor statistics, direct-indexed by the 16-bit sensor ID */
+typedef struct {
+    sensor_stats_t **index;          /* SENSOR_ID_SPACE slots, NULL for a sensor not seen yet */
+    sensor_stats_chunk_t *chunks;    /* Chunk list, newest first; new entries come from the head */
+    int size;                        /* Number of sensors seen */
+} sensor_stats_table_t;
+
+/* Snapshot file of one worker: this header, then count sensor records and room_count room
+ * records. Files are only read by a gateway built with the same averaging settings, which the
+ * header records; rollup buckets only with the same bucket periods */
 typedef struct {
-    sensor_stats_t *data; /* Pointer to the array of sensor statistics */
-    int size;             /* Current number of sensors in the list */
-    int capacity;         /* Maximum capacity of the list */
-} sensor_stats_list_t;
+    uint32_t magic;              /* SNAPSHOT_MAGIC */
+    uint32_t version;            /* SNAPSHOT_VERSION */
+    uint32_t record_size;        /* sizeof(snapshot_sensor_t) when written */
+    uint32_t count;              /* Records following the header */
+    int32_t avg_mode;            /* DATAMGT_AVG_MODE */
+    int32_t window_size;         /* DATAMGT_WINDOW_SIZE */
+    int32_t window_sec;          /* DATAMGT_WINDOW_SEC */
+    uint32_t room_count;         /* Room records following the sensor records */
+    int64_t written;             /* Unix time of the snapshot */
+    int32_t rollup_periods[ROLLUP_TIERS]; /* Bucket period of each tier, 0 without rollups */
+} snapshot_header_t;
+
+/* What a sensor's statistics derive from its readings. Its room, rules and alert clock are
+ * not kept: they are resolved again from the map, the rules and the new worker's clock */
+typedef struct {
+    sensor_id_t id;
+    uint8_t temp_state;          /* temp_state_t */
+    uint8_t anomalies;           /* ANOMALY_* */
+    int32_t window_count;        /* Readings in window_values, oldest first */
+    uint64_t reading_count;
+    double total_value_sum;
+    double average;
+    sensor_value_t last_value;
+    sensor_ts_t last_ts;
+    double value_mean;
+    double value_var;
+#if DATAMGT_AVG_MODE == DATAMGT_AVG_WINDOW
+    double window_values[DATAMGT_WINDOW_SIZE];
+#if DATAMGT_WINDOW_SEC > 0
+    sensor_ts_t window_ts[DATAMGT_WINDOW_SIZE];
+#endif
+#endif
+    rollup_bucket_t rollups[ROLLUP_TIERS]; /* Open bucket of each tier, count 0 if none */
+} snapshot_sensor_t;
+
+/* The open rollup buckets of one room in the worker */
+typedef struct {
+    int32_t room_id;
+    uint32_t reserved;
+    rollup_bucket_t rollups[ROLLUP_TIERS];
+} snapshot_room_t;
+
+/* Inputs of the alert kernels for the batch being processed, one entry per reading */
+typedef struct {
+    sensor_stats_t *stats[SENSOR_BATCH_CAPACITY];   /* Entry of the reading, NULL if it was not processed */
+    temp_state_t from_state[SENSOR_BATCH_CAPACITY]; /* Threshold state lows and highs were derived from */
+    double averages[SENSOR_BATCH_CAPACITY] __attribute__((aligned(32))); /* Running average after the reading */
+    double lows[SENSOR_BATCH_CAPACITY] __attribute__((aligned(32)));     /* Too cold below this, hysteresis applied */
+    double highs[SENSOR_BATCH_CAPACITY] __attribute__((aligned(32)));    /* Too hot above this, hysteresis applied */
+    double previous[SENSOR_BATCH_CAPACITY] __attribute__((aligned(32))); /* Previous reading of the sensor */
+    double rate_limits[SENSOR_BATCH_CAPACITY] __attribute__((aligned(32))); /* Largest change allowed since then */
+    double means[SENSOR_BATCH_CAPACITY] __attribute__((aligned(32)));    /* Sensor mean before the reading */
+    double zscore_limits[SENSOR_BATCH_CAPACITY] __attribute__((aligned(32))); /* Largest distance allowed from it */
+} alert_inputs_t;
+
+/* One data manager worker and the shard of sensors it owns */
+typedef struct {
+    int shard;                   /* Owns the sensors with id % num_workers == shard */
+    sbuffer_t *queue;            /* Buffer the worker reads from */
+    int reader_id;               /* Its cursor on queue */
+    bool owns_queue;             /* queue is this worker's shard queue, not the shared buffer */
+    room_sensor_map_t *active_map; /* Map pinned for the batch being processed, NULL between batches */
+    alert_rules_t *active_rules; /* Rules pinned for the batch being processed, NULL between batches */
+    sensor_stats_table_t table;  /* Statistics of the shard, only touched by this worker */
+    sensor_batch_t batch;        /* Batch being processed, as arrays */
+    alert_inputs_t alerts;       /* Alert kernel inputs of batch */
+    sensor_data_t pending[DATAMGT_BATCH_SIZE]; /* Readings routed by the dispatcher, not queued yet */
+    size_t pending_count;        /* Number of valid readings in pending */
+    struct timespec alert_epoch; /* Worker start; the alert clock counts seconds since, from 1 */
+    uint32_t alert_clock;        /* Alert clock, read once per batch */
+    uint32_t alert_swept_sec;    /* Alert clock of the last summary sweep */
+    uint64_t alert_pending[ALERT_PENDING_WORDS]; /* Bit per sensor with suppressed alerts */
+    unsigned int alert_pending_count; /* Number of bits set in alert_pending */
+    int alert_sweep_word;        /* Word the next sweep starts at, so a limited sweep takes turns */
+    uint32_t alert_budget_sec;   /* Alert clock alert_budget belongs to */
+    int alert_budget;            /* Alert lines still allowed in that second */
+    uint64_t alerts_held;        /* Alerts held back by the rate limit since the last notice */
+    uint32_t alert_notice_sec;   /* Alert clock of the last rate limit notice */
+    uint32_t snapshot_sec;       /* Alert clock of the last statistics snapshot */
+    uint64_t untracked_logged[SENSOR_ID_SPACE / 64]; /* Bit per sensor already reported as having no stats entry */
+#if DATAMGT_ROLLUPS
+    room_rollup_t **rooms;       /* Rooms seen by this worker; entries never move */
+    int room_count;              /* Number of rooms */
+    int room_capacity;           /* Allocated slots in rooms */
+    sensor_ts_t rollup_clock;    /* Newest reading timestamp seen, buckets older than its tier are complete */
+    sensor_ts_t swept_minute;    /* Minute bucket of rollup_clock when completed buckets were last swept */
+    rollup_row_t rollup_out[ROLLUP_OUT_BATCH]; /* Completed rows not handed to storage yet */
+    size_t rollup_out_count;     /* Number of valid rows in rollup_out */
+#endif
+    pthread_t thread;            /* Worker thread */
+    bool thread_started;         /* Whether thread was created */
+} datamgt_worker_t;
+
+/* States of a subscription slot */
+typedef enum {
+    SUBSCRIPTION_FREE = 0,
+    SUBSCRIPTION_ACTIVE
+} subscription_state_t;
+
+/**
+ * @brief A live feed: the publishing thread (the dispatcher, or the single worker) writes each
+ * matching reading at head and never waits, overwriting the oldest when the ring is full. Each
+ * slot carries a sequence number (odd while being written, 2 * position + 2 once complete), so
+ * the subscriber detects readings overwritten under it and counts them as dropped (seqlock).
+ */
+struct datamgt_subscription {
+    int state;                   /* subscription_state_t (seq_cst, see publish_readings()) */
+    int room_id;                 /* Room fed, -1 for a sensor list */
+    uint8_t sensors[SENSOR_ID_SPACE / 8]; /* Bit per sensor fed, read by the publisher (relaxed bytes) */
+    struct {
+        uint64_t seq;
+        sensor_data_t data;
+    } slots[DATAMGT_SUBSCRIBER_RING];
+    uint64_t head;               /* Written by the publisher only (release) */
+    uint64_t tail;               /* Subscriber only */
+};
 
 /* --- Static Variables --- */
 
-/* Global list to store sensor statistics (access is single-threaded within this module) */
-static sensor_stats_list_t sensor_list = {NULL, 0, 0};
+static datamgt_worker_t workers[DATAMGT_MAX_WORKERS]; /* Worker state, only the first num_workers are used */
+
+#if DATAMGT_ROLLUPS
+static const int rollup_periods[ROLLUP_TIERS] = {DATAMGT_ROLLUP_MINUTE_SEC, DATAMGT_ROLLUP_HOUR_SEC};
+#endif
+static int num_workers = 0;                          /* Number of running workers */
+
+/* Published room-sensor map. Workers read it without locks; reloads swap it atomically
+ * and free the old map once no worker has it pinned in active_map (RCU style). */
+static room_sensor_map_t *current_map = NULL;
+static unsigned int map_generation = 0;              /* Generation given to the last published map */
+static bool map_published = false;                   /* Data manager is running and owns current_map */
+static const char *map_filename = NULL;              /* File reloads read */
+static alert_rules_t *current_rules = NULL;          /* Published alert rules, swapped like current_map */
+static unsigned int rules_generation = 0;            /* Generation given to the last published rules */
+static const char *rules_filename = NULL;            /* Rules file reloads read, NULL for the built-in rules */
+static pool_t *stats_chunk_pool = NULL;              /* Chunks of every worker's stats table, DATAMGT_STATS_CHUNKS */
+static pthread_mutex_t reload_mutex = PTHREAD_MUTEX_INITIALIZER; /* Serialises reloads and subscription changes,
+                                                                   never taken by workers */
+
+/* Live feeds. The publisher skips all work while subscriber_count is 0; publishing marks the
+ * pass in publish_busy and counts it in publish_passes, so an unsubscribe can tell when it may
+ * reuse a slot the publisher might still have been writing. */
+static datamgt_subscription_t subscriptions[DATAMGT_MAX_SUBSCRIBERS];
+static int subscriber_count = 0;
+static int publish_busy = 0;
+static unsigned long publish_passes = 0;
 
 /* --- External Variables --- */
 
@@ -67,45 +303,256 @@ extern volatile sig_atomic_t terminate_flag;
 
 /* --- Forward Declarations (Internal Helper Functions) --- */
 
-static gateway_error_t init_sensor_stats_list(int initial_capacity); /* Initialize the sensor statistics list */
-static void free_sensor_stats_list(void);                            /* Free memory allocated for the sensor list */
-static sensor_stats_t* find_or_create_sensor(sensor_id_t id);        /* Find or create a sensor entry */
-static void update_sensor_stats(sensor_stats_t *stats, double value); /* Update statistics for a sensor */
-static void check_temperature_alerts(sensor_stats_t *stats, const room_sensor_map_t *map); /* Check temperature thresholds */
+static gateway_error_t init_sensor_stats_table(sensor_stats_table_t *table); /* Initialize a sensor statistics table */
+static void free_sensor_stats_table(sensor_stats_table_t *table);   /* Free memory allocated for a sensor table */
+static sensor_stats_t* find_or_create_sensor(sensor_stats_table_t *table, sensor_id_t id); /* Find or create a sensor entry */
+static void update_sensor_stats(sensor_stats_t *stats, double value, sensor_ts_t ts); /* Update statistics for a sensor */
+static void report_temperature_state(datamgt_worker_t *worker, sensor_stats_t *stats, temp_state_t state,
+                                     double running_avg); /* Log a threshold crossing */
+static void threshold_bounds(const alert_profile_t *alert, temp_state_t state, double *low, double *high); /* Hysteresis */
+static void report_anomalies(datamgt_worker_t *worker, sensor_stats_t *stats, uint8_t raised,
+                             const alert_inputs_t *inputs, size_t i, sensor_value_t value); /* Log failed anomaly checks */
+static void resolve_room(datamgt_worker_t *worker, sensor_stats_t *stats, const room_sensor_map_t *map); /* Refresh the cached room */
+static void tick_alert_clock(datamgt_worker_t *worker);              /* Read the alert clock for a batch */
+static bool take_alert_budget(datamgt_worker_t *worker);            /* Count a line against alert_max_per_sec */
+static bool admit_alert(datamgt_worker_t *worker, sensor_stats_t *stats); /* Log an alert, or hold it back */
+static void alert_sweep(datamgt_worker_t *worker);                  /* Log the summaries that are due */
+static void alert_flush(datamgt_worker_t *worker);                  /* Report what is still held back at shutdown */
+#if DATAMGT_SNAPSHOT_INTERVAL_SEC > 0
+static void snapshot_path(char *path, size_t size, int shard, const char *suffix); /* File of a shard's snapshot */
+static void snapshot_save(datamgt_worker_t *worker);                /* Write the worker's statistics */
+static void snapshot_restore(int count);                           /* Load the statistics of the last run */
+#endif
 static int get_room_id(sensor_id_t sensor_id, const room_sensor_map_t *map); /* Get room ID for a sensor */
+static int compare_map_entries(const void *a, const void *b); /* qsort comparator, by sensor ID */
+static void index_room_sensor_map(room_sensor_map_t *map, const char *filename); /* Dedupes and sorts a loaded map */
+static sensor_stats_t *process_reading(datamgt_worker_t *worker, const sensor_batch_t *batch, size_t i,
+                                       const room_sensor_map_t *map, const alert_rules_t *rules); /* Fold one reading into its sensor's state */
+static void process_batch(datamgt_worker_t *worker, const sensor_batch_t *batch, const room_sensor_map_t *map,
+                          const alert_rules_t *rules); /* Handle a batch */
+static void *worker_run(void *arg);                                 /* Process a worker's input until shutdown */
+static void dispatch_readings(sbuffer_t *buffer, int reader_id);    /* Route shared buffer readings to the shard queues */
+static gateway_error_t start_shard_workers(int requested);          /* Create the shard queues and worker threads */
+static room_sensor_map_t *pin_current_map(datamgt_worker_t *worker); /* Take a reference to the published map */
+static alert_rules_t *pin_current_rules(datamgt_worker_t *worker);  /* Take a reference to the published rules */
+static void publish_readings(const sensor_data_t *batch, size_t count); /* Feed the live subscriptions */
+static void fill_room_sensors(datamgt_subscription_t *subscription, const room_sensor_map_t *map); /* Sensors of a room feed */
+#if DATAMGT_ROLLUPS
+static room_rollup_t *find_or_create_room(datamgt_worker_t *worker, int room_id); /* Rollups of a room */
+static void free_room_rollups(datamgt_worker_t *worker);            /* Free the worker's room rollups */
+static void rollup_add(datamgt_worker_t *worker, rollup_bucket_t *bucket, rollup_scope_t scope, int key,
+                       int period, sensor_ts_t ts, double value); /* Add a reading to a bucket */
+static void rollup_emit(datamgt_worker_t *worker, const rollup_bucket_t *bucket, rollup_scope_t scope,
+                        int key, int period);                       /* Queue a completed bucket */
+static void rollup_sweep(datamgt_worker_t *worker, bool all);       /* Emit every completed (or every open) bucket */
+static void rollup_flush(datamgt_worker_t *worker);                 /* Hand queued rows to storage */
+#endif
 
 /* --- Main Thread Function Implementation --- */
 
 /**
  * @brief Main function for the data management thread.
  *        Processes sensor data from the shared buffer and updates statistics.
+ *        With a single worker the readings are processed in this thread; otherwise this thread
+ *        routes them by sensor ID to one queue per worker, so no stats entry is shared between threads.
  */
 void *datamgt_run(void *arg) {
     datamgt_args_t *args = (datamgt_args_t *)arg;
-    sbuffer_t *buffer = args->buffer; /* Shared buffer for sensor data */
-    room_sensor_map_t *map = args->map; /* Room-sensor mapping */
-    sensor_data_t data; /* Structure to hold sensor data */
-    gateway_error_t sbuf_ret; /* Return status from sbuffer operations */
+    int requested = args->num_workers > 0 ? args->num_workers : DATAMGT_WORKERS;
 
-    /* Initialize the sensor statistics list */
-    if (init_sensor_stats_list(INITIAL_SENSOR_LIST_CAPACITY) != GATEWAY_SUCCESS) {
-        log_message(LOG_LEVEL_FATAL, "Data manager failed to initialize sensor list. Exiting thread."); 
+    pthread_setname_np(pthread_self(), "datamgt");
+
+    if (requested > DATAMGT_MAX_WORKERS) {
+        log_message(LOG_LEVEL_WARNING, "Requested %d data manager workers, limiting to %d.", requested, DATAMGT_MAX_WORKERS);
+        requested = DATAMGT_MAX_WORKERS;
+    }
+
+    /* Rules first: without them no reading could be checked */
+    alert_rules_t *startup_rules = NULL;
+    if (alert_rules_load(args->rules_filename, &startup_rules) != GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_FATAL, "Data manager failed to load the alert rules. Exiting thread.");
+        storagemgt_rollups_done();
+        return NULL;
+    }
+
+    /* Each worker owns a private stats table, filled from the shared chunk pool */
+    num_workers = 0;
+    if (pool_create(&stats_chunk_pool, "datamgt sensor stats", sizeof(sensor_stats_chunk_t), DATAMGT_STATS_CHUNKS) != GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_FATAL, "Data manager failed to reserve %d sensor stats chunks. Exiting thread.", DATAMGT_STATS_CHUNKS); 
+        alert_rules_free(&startup_rules);
+        storagemgt_rollups_done();
         return NULL;
     }
-    log_message(LOG_LEVEL_INFO, "Data manager thread started."); 
+    for (int i = 0; i < requested; ++i) {
+        memset(&workers[i], 0, sizeof(workers[i]));
+        workers[i].shard = i;
+        if (init_sensor_stats_table(&workers[i].table) != GATEWAY_SUCCESS) {
+            log_message(LOG_LEVEL_FATAL, "Data manager failed to initialize sensor table. Exiting thread."); 
+            for (int j = 0; j < i; ++j) {
+                free_sensor_stats_table(&workers[j].table);
+            }
+            pool_destroy(&stats_chunk_pool);
+            alert_rules_free(&startup_rules);
+            storagemgt_rollups_done();
+            return NULL;
+        }
+    }
+
+#if DATAMGT_SNAPSHOT_INTERVAL_SEC > 0
+    /* Before any worker runs, so the tables are still ours; sensors go to the shard they have now */
+    snapshot_restore(requested);
+#endif
+
+    /* Publish the startup map; from now on reloads replace it */
+    pthread_mutex_lock(&reload_mutex);
+    if (args->map != NULL) {
+        args->map->generation = ++map_generation;
+    }
+    __atomic_store_n(&current_map, args->map, __ATOMIC_SEQ_CST);
+    map_filename = args->map_filename;
+    startup_rules->generation = ++rules_generation;
+    __atomic_store_n(&current_rules, startup_rules, __ATOMIC_SEQ_CST);
+    rules_filename = args->rules_filename;
+    map_published = true;
+    pthread_mutex_unlock(&reload_mutex);
+
+    if (requested > 1 && start_shard_workers(requested) == GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_INFO, "Data manager thread started (%d workers sharded by sensor ID, %s batch kernels).",
+                    num_workers, sensor_batch_kernels()); 
+        dispatch_readings(args->buffer, args->reader_id);
+
+        /* Shard queues drain before reporting shutdown, so every routed reading is processed */
+        for (int i = 0; i < num_workers; ++i) {
+            sbuffer_signal_shutdown(workers[i].queue);
+        }
+        for (int i = 0; i < num_workers; ++i) {
+            pthread_join(workers[i].thread, NULL);
+            workers[i].thread_started = false;
+        }
+    } else {
+        /* Single worker: read the shared buffer directly, without an extra hop */
+        if (workers[0].owns_queue) {
+            sbuffer_free(&workers[0].queue); /* Shard queue of a worker that failed to start */
+        }
+        num_workers = 1;
+        workers[0].queue = args->buffer;
+        workers[0].reader_id = args->reader_id;
+        workers[0].owns_queue = false;
+        log_message(LOG_LEVEL_INFO, "Data manager thread started (%s batch kernels).", sensor_batch_kernels()); 
+        worker_run(&workers[0]);
+    }
+
+    /* Cleanup and shutdown */
+    log_message(LOG_LEVEL_INFO, "Data manager thread shutting down..."); 
+    for (int i = 0; i < requested; ++i) {
+        if (workers[i].owns_queue) {
+            sbuffer_free(&workers[i].queue);
+        }
+        free_sensor_stats_table(&workers[i].table); /* Free memory allocated for the sensor table */
+#if DATAMGT_ROLLUPS
+        free_room_rollups(&workers[i]);
+#endif
+    }
+    num_workers = 0;
+    pool_destroy(&stats_chunk_pool);
+    storagemgt_rollups_done(); /* Every worker flushed its open buckets */
+
+    /* Hand the live map back to the caller, reloads are refused from now on */
+    pthread_mutex_lock(&reload_mutex);
+    map_published = false;
+    args->map = __atomic_exchange_n(&current_map, NULL, __ATOMIC_SEQ_CST);
+    alert_rules_t *final_rules = __atomic_exchange_n(&current_rules, NULL, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&reload_mutex);
+    alert_rules_free(&final_rules); /* No worker runs any more */
+    log_message(LOG_LEVEL_INFO, "Data manager finished cleanup."); 
+
+    return NULL;
+}
+
+/* --- Shutdown Function Implementation --- */
+
+/**
+ * @brief Signals the Data Manager thread to stop gracefully.
+ *        Relies on the terminate_flag being checked in the run loop.
+ */
+void datamgt_stop(void) {
+    log_message(LOG_LEVEL_INFO, "Data Manager stop requested (flag will be checked in loop)."); 
+}
+
+/* --- Worker and Dispatcher Loops --- */
+
+/**
+ * @brief Creates one queue and one thread per shard.
+ *        If a thread cannot be created, the shards are cut over the workers already running
+ *        (the modulus shrinks); nothing has been routed yet, so no sensor changes owner afterwards.
+ * @return GATEWAY_SUCCESS if at least one worker thread runs, an error code otherwise.
+ */
+static gateway_error_t start_shard_workers(int requested) {
+    for (int i = 0; i < requested; ++i) {
+        datamgt_worker_t *worker = &workers[i];
+        if (sbuffer_init(&worker->queue, DATAMGT_SHARD_QUEUE_SIZE, 0) != GATEWAY_SUCCESS) {
+            log_message(LOG_LEVEL_ERROR, "Failed to create queue for data manager worker %d.", i); 
+            break;
+        }
+        worker->owns_queue = true;
+        if (sbuffer_register_reader(worker->queue, &worker->reader_id) != GATEWAY_SUCCESS ||
+            pthread_create(&worker->thread, NULL, worker_run, worker) != 0) {
+            log_message(LOG_LEVEL_ERROR, "Failed to start data manager worker %d.", i); 
+            break;
+        }
+        char name[24]; /* Room for any number; the names used stay within the kernel's 15 characters */
+        snprintf(name, sizeof(name), "datamgt-w%d", i);
+        pthread_setname_np(worker->thread, name);
+        worker->thread_started = true;
+        num_workers = i + 1;
+    }
+
+    if (num_workers > 0 && num_workers < requested) {
+        log_message(LOG_LEVEL_WARNING, "Running %d of %d data manager workers.", num_workers, requested); 
+    }
+    return num_workers > 0 ? GATEWAY_SUCCESS : THREAD_CREATE_ERR;
+}
+
+/**
+ * @brief Reads the worker's input buffer until shutdown and processes every reading.
+ *        Only the worker that reads the shared buffer itself honours terminate_flag; shard
+ *        workers stop when the dispatcher shuts their queue down, so it never blocks on a
+ *        queue nobody reads.
+ */
+static void *worker_run(void *arg) {
+    datamgt_worker_t *worker = (datamgt_worker_t *)arg;
+    sensor_data_t batch[DATAMGT_BATCH_SIZE]; /* Readings taken from the buffer in one call */
+    size_t batch_count = 0; /* Number of valid readings in batch */
+    gateway_error_t sbuf_ret; /* Return status from sbuffer operations */
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &worker->alert_epoch);
+    tick_alert_clock(worker);
+    worker->snapshot_sec = worker->alert_clock;
 
     while (1) {
         /* Check termination flag at the start of the loop */
-        if (terminate_flag) {
+        if (!worker->owns_queue && terminate_flag) {
             log_message(LOG_LEVEL_INFO, "Data manager received termination signal flag."); 
             break;
         }
 
-        /* 1. Read data from the shared buffer (blocking call) */
-        sbuf_ret = sbuffer_remove(buffer, &data);
+        /* 1. Read everything available from the input buffer (blocking call; with summaries
+         *    pending it returns at least once per second, so they are logged on time) */
+        bool sweep_due = worker->alert_pending_count > 0 || worker->alerts_held > 0;
+        if (sweep_due) {
+            sbuf_ret = sbuffer_remove_batch_timed(worker->queue, worker->reader_id, batch, DATAMGT_BATCH_SIZE,
+                                                  &batch_count, ALERT_SWEEP_WAIT_MS);
+        } else {
+            sbuf_ret = sbuffer_remove_batch(worker->queue, worker->reader_id, batch, DATAMGT_BATCH_SIZE, &batch_count);
+        }
 
+        if (sweep_due && sbuf_ret == SBUFFER_EMPTY) {
+            tick_alert_clock(worker); /* Timed out */
+            alert_sweep(worker);
+            continue;
+        }
         if (sbuf_ret == SBUFFER_SHUTDOWN) {
-            log_message(LOG_LEVEL_INFO, "Data manager received shutdown signal from sbuffer. Exiting loop."); 
+            log_message(LOG_LEVEL_INFO, "Data manager worker %d received shutdown signal from sbuffer. Exiting loop.", worker->shard); 
             break;
         }
         else if (sbuf_ret != GATEWAY_SUCCESS) {
@@ -119,159 +566,504 @@ void *datamgt_run(void *arg) {
             }
         }
 
-        /* Data Validation: Check for invalid sensor ID */
-        if (data.id == INVALID_SENSOR_ID) {
-            log_message(LOG_LEVEL_WARNING, "Received sensor data with invalid sensor node ID %d", data.id); 
-            continue;
+        /* 2. Process each reading of the batch against the map published when it started */
+        if (!worker->owns_queue) {
+            metrics_observe_latency(METRIC_LATENCY_DEQUEUE_US, batch, batch_count);
+            publish_readings(batch, batch_count);
+        }
+        sensor_batch_load(&worker->batch, batch, batch_count);
+        tick_alert_clock(worker);
+        room_sensor_map_t *map = pin_current_map(worker);
+        alert_rules_t *rules = pin_current_rules(worker);
+        process_batch(worker, &worker->batch, map, rules);
+        __atomic_store_n(&worker->active_map, NULL, __ATOMIC_RELEASE); /* Quiescent until the next batch */
+        __atomic_store_n(&worker->active_rules, NULL, __ATOMIC_RELEASE);
+        metrics_add(METRIC_DATAMGT_READINGS, batch_count);
+        metrics_observe_latency(METRIC_LATENCY_PROCESSED_US, batch, batch_count);
+        if ((worker->alert_pending_count > 0 || worker->alerts_held > 0) &&
+            worker->alert_clock != worker->alert_swept_sec) {
+            alert_sweep(worker);
         }
+#if DATAMGT_SNAPSHOT_INTERVAL_SEC > 0
+        if (worker->alert_clock - worker->snapshot_sec >= DATAMGT_SNAPSHOT_INTERVAL_SEC) {
+            snapshot_save(worker); /* An idle worker skips it, its statistics did not change */
+            worker->snapshot_sec = worker->alert_clock;
+        }
+#endif
 
-        /* 2. Find or create statistics entry for this sensor ID */
-        sensor_stats_t *stats = find_or_create_sensor(data.id);
-        if (stats == NULL) {
-            log_message(LOG_LEVEL_ERROR, "Failed to find or create stats for sensor ID %d (Memory issue?)", data.id); 
-            continue;
+#if DATAMGT_ROLLUPS
+        /* 3. Once the clock enters a new minute, emit the buckets it completed (also for idle sensors) */
+        sensor_ts_t minute = worker->rollup_clock - worker->rollup_clock % DATAMGT_ROLLUP_MINUTE_SEC;
+        if (minute > worker->swept_minute) {
+            rollup_sweep(worker, false);
+            worker->swept_minute = minute;
         }
+        rollup_flush(worker);
+#endif
+    }
 
-        /* 3. Update statistics */
-        update_sensor_stats(stats, data.value);
+    alert_flush(worker);
+#if DATAMGT_SNAPSHOT_INTERVAL_SEC > 0
+    snapshot_save(worker);
+#endif
+#if DATAMGT_ROLLUPS
+    /* Open buckets are emitted as partial rows; rows merge, so a later row for the same bucket adds up */
+    rollup_sweep(worker, true);
+    rollup_flush(worker);
+#endif
+    return NULL;
+}
 
-        /* 4. Calculate running average and check thresholds/log alerts */
-        check_temperature_alerts(stats, map);
+/**
+ * @brief Pins the published map for one batch (hazard pointer).
+ *        The pin is re-checked after it is visible, so a reload that swapped the map in between
+ *        either sees the pin and waits, or the worker retries with the new map.
+ */
+static room_sensor_map_t *pin_current_map(datamgt_worker_t *worker) {
+    room_sensor_map_t *map;
+    do {
+        map = __atomic_load_n(&current_map, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&worker->active_map, map, __ATOMIC_SEQ_CST);
+    } while (map != __atomic_load_n(&current_map, __ATOMIC_SEQ_CST));
+    return map;
+}
 
-        /* DEBUG Log */
-        log_message(LOG_LEVEL_DEBUG, "Processed Sensor ID: %d, Value: %.2f, Count: %lu, Avg: %.2f", 
-                    stats->id, data.value, stats->reading_count,
-                    stats->reading_count > 0 ? (stats->total_value_sum / stats->reading_count) : 0.0); /* Avoid division by zero */
-    }
+/**
+ * @brief Pins the published alert rules for one batch, as pin_current_map() does the map.
+ *        Rules are published for as long as the data manager runs, so the result is never NULL.
+ */
+static alert_rules_t *pin_current_rules(datamgt_worker_t *worker) {
+    alert_rules_t *rules;
+    do {
+        rules = __atomic_load_n(&current_rules, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&worker->active_rules, rules, __ATOMIC_SEQ_CST);
+    } while (rules != __atomic_load_n(&current_rules, __ATOMIC_SEQ_CST));
+    return rules;
+}
 
-    /* Cleanup and shutdown */
-    log_message(LOG_LEVEL_INFO, "Data manager thread shutting down..."); 
-    free_sensor_stats_list(); /* Free memory allocated for the sensor list */
-    log_message(LOG_LEVEL_INFO, "Data manager finished cleanup."); 
+/**
+ * @brief Routes each reading of the shared buffer to the queue of worker (id % num_workers).
+ *        Readings of one sensor keep their order; each batch taken from the shared buffer costs
+ *        at most one insert per worker.
+ */
+static void dispatch_readings(sbuffer_t *buffer, int reader_id) {
+    sensor_data_t batch[DATAMGT_BATCH_SIZE]; /* Readings taken from the buffer in one call */
+    size_t batch_count = 0; /* Number of valid readings in batch */
+    gateway_error_t sbuf_ret; /* Return status from sbuffer operations */
 
-    return NULL;
+    while (1) {
+        if (terminate_flag) {
+            log_message(LOG_LEVEL_INFO, "Data manager received termination signal flag."); 
+            break;
+        }
+
+        sbuf_ret = sbuffer_remove_batch(buffer, reader_id, batch, DATAMGT_BATCH_SIZE, &batch_count);
+        if (sbuf_ret == SBUFFER_SHUTDOWN) {
+            log_message(LOG_LEVEL_INFO, "Data manager received shutdown signal from sbuffer. Exiting loop."); 
+            break;
+        } else if (sbuf_ret != GATEWAY_SUCCESS) {
+            log_message(LOG_LEVEL_ERROR, "Data manager failed to remove data from buffer (Error %d)", sbuf_ret); 
+            sleep(BUSY_WAIT_SLEEP_SEC); /* Avoid busy loop on unexpected error */
+            continue;
+        }
+        metrics_observe_latency(METRIC_LATENCY_DEQUEUE_US, batch, batch_count);
+        publish_readings(batch, batch_count);
+
+        for (size_t i = 0; i < batch_count; ++i) {
+            datamgt_worker_t *worker = &workers[batch[i].id % num_workers];
+            worker->pending[worker->pending_count++] = batch[i];
+        }
+        for (int w = 0; w < num_workers; ++w) {
+            datamgt_worker_t *worker = &workers[w];
+            if (worker->pending_count == 0) {
+                continue;
+            }
+            /* Blocks while the worker is behind, which backs up into the shared buffer */
+            sbuf_ret = sbuffer_insert_batch(worker->queue, worker->pending, worker->pending_count);
+            if (sbuf_ret != GATEWAY_SUCCESS) {
+                log_message(LOG_LEVEL_ERROR, "Data manager failed to queue %zu readings for worker %d (Error %d)",
+                            worker->pending_count, w, sbuf_ret); 
+            }
+            worker->pending_count = 0;
+        }
+    }
 }
 
-/* --- Shutdown Function Implementation --- */
+/* --- Implementation of Internal Helper Functions --- */
 
 /**
- * @brief Signals the Data Manager thread to stop gracefully.
- *        Relies on the terminate_flag being checked in the run loop.
+ * @brief Processes a batch in three passes: the sensor state of each reading (scalar, as every
+ *        reading depends on the one before it of the same sensor, which also fills the alert
+ *        inputs), every alert check of the whole batch at once, then the alerts, in reading order.
  */
-void datamgt_stop(void) {
-    log_message(LOG_LEVEL_INFO, "Data Manager stop requested (flag will be checked in loop)."); 
+static void process_batch(datamgt_worker_t *worker, const sensor_batch_t *batch, const room_sensor_map_t *map,
+                          const alert_rules_t *rules) {
+    alert_inputs_t *inputs = &worker->alerts;
+    uint64_t too_cold, too_hot;
+
+    for (size_t i = 0; i < batch->count; ++i) {
+        inputs->stats[i] = process_reading(worker, batch, i, map, rules);
+    }
+
+    sensor_batch_classify(inputs->averages, inputs->lows, inputs->highs, batch->count, &too_cold, &too_hot);
+    uint64_t rate_failed = sensor_batch_deviates(batch->values, inputs->previous, inputs->rate_limits, batch->count);
+    uint64_t zscore_failed = sensor_batch_deviates(batch->values, inputs->means, inputs->zscore_limits, batch->count);
+
+    for (size_t i = 0; i < batch->count; ++i) {
+        sensor_stats_t *stats = inputs->stats[i];
+        if (stats == NULL) {
+            continue;
+        }
+        temp_state_t state;
+        if (stats->temp_state == inputs->from_state[i]) {
+            state = (too_cold >> i) & 1 ? TEMP_STATE_TOO_COLD
+                  : (too_hot >> i) & 1 ? TEMP_STATE_TOO_HOT : TEMP_STATE_NORMAL;
+        } else {
+            /* An earlier reading of this batch changed the state the bounds were derived from */
+            double low, high;
+            threshold_bounds(&stats->alert, stats->temp_state, &low, &high);
+            state = inputs->averages[i] < low ? TEMP_STATE_TOO_COLD
+                  : inputs->averages[i] > high ? TEMP_STATE_TOO_HOT : TEMP_STATE_NORMAL;
+        }
+        if (state != stats->temp_state) {
+            report_temperature_state(worker, stats, state, inputs->averages[i]);
+        }
+
+        uint8_t anomalies = (uint8_t)(((rate_failed >> i) & 1 ? ANOMALY_RATE : 0) |
+                                      ((zscore_failed >> i) & 1 ? ANOMALY_ZSCORE : 0));
+        if (anomalies & ~stats->anomalies) {
+            report_anomalies(worker, stats, anomalies & ~stats->anomalies, inputs, i, batch->values[i]);
+        }
+        stats->anomalies = anomalies; /* A check that passes again re-arms its alert */
+    }
+
+#if DATAMGT_ROLLUPS
+    worker->rollup_clock = sensor_batch_max_ts(batch->ts, batch->count, worker->rollup_clock);
+#endif
 }
 
-/* --- Implementation of Internal Helper Functions --- */
+/**
+ * @brief Validates reading i of a batch, updates its sensor statistics, room and rollups and
+ *        fills entry i of the worker's alert inputs.
+ * @return The sensor's stats entry, or NULL if the reading was not processed.
+ */
+static sensor_stats_t *process_reading(datamgt_worker_t *worker, const sensor_batch_t *batch, size_t i,
+                                       const room_sensor_map_t *map, const alert_rules_t *rules) {
+    alert_inputs_t *inputs = &worker->alerts;
+    sensor_id_t id = batch->ids[i];
+    sensor_value_t value = batch->values[i];
+    sensor_ts_t ts = batch->ts[i];
+
+    /* Neutral inputs, kept if the reading is not processed */
+    inputs->averages[i] = 0.0;
+    inputs->lows[i] = -INFINITY;
+    inputs->highs[i] = INFINITY;
+    inputs->previous[i] = value;
+    inputs->rate_limits[i] = INFINITY;
+    inputs->means[i] = value;
+    inputs->zscore_limits[i] = INFINITY;
+
+    /* Data Validation: Check for invalid sensor ID */
+    if (id == INVALID_SENSOR_ID) {
+        log_message(LOG_LEVEL_WARNING, "Received sensor data with invalid sensor node ID %d", id); 
+        return NULL;
+    }
+
+    /* Find or create statistics entry for this sensor ID */
+    sensor_stats_t *stats = find_or_create_sensor(&worker->table, id);
+    if (stats == NULL) {
+        /* Once per sensor: a few thousand extra sensors must not flood the log */
+        metrics_inc(METRIC_DATAMGT_UNTRACKED);
+        uint64_t bit = 1ull << (id % 64);
+        if ((worker->untracked_logged[id / 64] & bit) == 0) {
+            worker->untracked_logged[id / 64] |= bit;
+            log_message(LOG_LEVEL_ERROR, "No stats entry left for sensor ID %d (DATAMGT_STATS_CHUNKS in use), its readings are not processed.", id); 
+        }
+        return NULL;
+    }
+
+#if DEDUP_WINDOW_READINGS > 0
+    /* A reading relayed again must not count twice in the averages, checks and rollups */
+    if (dedup_window_seen(&stats->dedup, ts, value)) {
+        metrics_inc(METRIC_DATAMGT_DUPLICATES);
+        return NULL;
+    }
+#endif
+
+    /* The anomaly checks compare against the sensor's state before this reading */
+    const alert_profile_t *alert = &stats->alert;
+    uint64_t earlier_readings = stats->reading_count;
+
+    /* Update statistics and the running average */
+    update_sensor_stats(stats, value, ts);
+    resolve_room(worker, stats, map);
+    if (stats->rules_generation != rules->generation) {
+        alert_rules_resolve(rules, stats->id, stats->room_id, &stats->alert);
+        stats->rules_generation = rules->generation;
+    }
+
+    /* Alert inputs: the thresholds in the current state, the previous reading and the mean */
+    inputs->from_state[i] = stats->temp_state;
+    inputs->averages[i] = stats->average;
+    threshold_bounds(alert, stats->temp_state, &inputs->lows[i], &inputs->highs[i]);
+    if (earlier_readings > 0) {
+        sensor_ts_t elapsed = ts - stats->last_ts;
+        inputs->previous[i] = stats->last_value;
+        inputs->rate_limits[i] = alert->max_rate * (double)(elapsed > 1 ? elapsed : 1);
+    }
+    if (earlier_readings >= ALERT_ZSCORE_MIN_READINGS) {
+        inputs->means[i] = stats->value_mean;
+        inputs->zscore_limits[i] = alert->max_zscore * sqrt(stats->value_var); /* NaN if the check is off */
+    }
+    stats->last_value = value;
+    stats->last_ts = ts;
+    if (earlier_readings == 0) {
+        stats->value_mean = value;
+        stats->value_var = 0.0;
+    } else {
+        double delta = value - stats->value_mean;
+        stats->value_mean += ALERT_ZSCORE_ALPHA * delta;
+        stats->value_var = (1.0 - ALERT_ZSCORE_ALPHA) * (stats->value_var + ALERT_ZSCORE_ALPHA * delta * delta);
+    }
+
+#if DATAMGT_ROLLUPS
+    /* Fold the reading into the sensor's and its room's rollup buckets */
+    for (int tier = 0; tier < ROLLUP_TIERS; ++tier) {
+        rollup_add(worker, &stats->rollups[tier], ROLLUP_SCOPE_SENSOR, stats->id, rollup_periods[tier], ts, value);
+        if (stats->room != NULL) {
+            rollup_add(worker, &stats->room->rollups[tier], ROLLUP_SCOPE_ROOM, stats->room->room_id,
+                       rollup_periods[tier], ts, value);
+        }
+    }
+#endif
+
+    /* DEBUG Log */
+    LOG_DEBUG("Processed Sensor ID: %d, Value: %.2f, Count: %lu, Avg: %.2f, Lifetime avg: %.2f", 
+                stats->id, value, stats->reading_count, stats->average,
+                stats->reading_count > 0 ? (stats->total_value_sum / stats->reading_count) : 0.0); /* Avoid division by zero */
+    return stats;
+}
 
 /**
- * @brief Initializes the dynamic array for sensor statistics.
- *        Allocates memory and sets initial capacity.
+ * @brief Initializes a sensor statistics table.
+ *        Allocates the direct index; entries are allocated in chunks as sensors appear.
  */
-static gateway_error_t init_sensor_stats_list(int initial_capacity) {
-    if (initial_capacity <= 0) initial_capacity = INITIAL_SENSOR_LIST_CAPACITY;
-    sensor_list.data = malloc(initial_capacity * sizeof(sensor_stats_t));
-    if (sensor_list.data == NULL) {
-        log_message(LOG_LEVEL_ERROR, "Failed to allocate memory for initial sensor stats list: %s", strerror(errno)); 
+static gateway_error_t init_sensor_stats_table(sensor_stats_table_t *table) {
+    table->index = calloc(SENSOR_ID_SPACE, sizeof(sensor_stats_t *));
+    if (table->index == NULL) {
+        log_message(LOG_LEVEL_ERROR, "Failed to allocate memory for sensor stats index: %s", strerror(errno)); 
         return GATEWAY_ERROR_NOMEM;
     }
-    sensor_list.size = 0;
-    sensor_list.capacity = initial_capacity;
-    log_message(LOG_LEVEL_DEBUG, "Initialized sensor stats list with capacity %d", initial_capacity); 
+    table->chunks = NULL;
+    table->size = 0;
+    LOG_DEBUG("Initialized sensor stats table (%d index slots)", SENSOR_ID_SPACE); 
     return GATEWAY_SUCCESS;
 }
 
 /**
- * @brief Frees the memory allocated for the sensor statistics list.
- *        Resets the list to an empty state.
+ * @brief Frees a sensor statistics table and every chunk of entries.
+ *        Resets the table to an empty state.
  */
-static void free_sensor_stats_list(void) {
-    if (sensor_list.data != NULL) {
-        free(sensor_list.data);
-        sensor_list.data = NULL;
-        sensor_list.size = 0;
-        sensor_list.capacity = 0;
-        log_message(LOG_LEVEL_DEBUG, "Freed sensor stats list memory."); 
+static void free_sensor_stats_table(sensor_stats_table_t *table) {
+    while (table->chunks != NULL) {
+        sensor_stats_chunk_t *chunk = table->chunks;
+        table->chunks = chunk->next;
+        pool_free(stats_chunk_pool, chunk);
     }
+    if (table->index != NULL) {
+        free(table->index);
+        table->index = NULL;
+        LOG_DEBUG("Freed sensor stats table memory (%d sensors).", table->size); 
+    }
+    table->size = 0;
 }
 
 /**
  * @brief Finds an existing sensor_stats entry by ID or creates a new one if not found.
- *        Resizes the list if necessary.
+ *        O(1): the ID indexes the table directly. Entries are never moved, so returned pointers stay valid.
  */
-static sensor_stats_t* find_or_create_sensor(sensor_id_t id) {
-    /* Search for existing sensor */
-    for (int i = 0; i < sensor_list.size; ++i) {
-        if (sensor_list.data[i].id == id) {
-            return &sensor_list.data[i];
-        }
+static sensor_stats_t* find_or_create_sensor(sensor_stats_table_t *table, sensor_id_t id) {
+    sensor_stats_t *stats = table->index[id];
+    if (stats != NULL) {
+        return stats;
     }
 
-    /* If not found, check if resizing is needed */
-    if (sensor_list.size >= sensor_list.capacity) {
-        int new_capacity = sensor_list.capacity == 0 ? INITIAL_SENSOR_LIST_CAPACITY : sensor_list.capacity * 2;
-        log_message(LOG_LEVEL_DEBUG, "Resizing sensor stats list from %d to %d", sensor_list.capacity, new_capacity); 
-        sensor_stats_t *new_data = realloc(sensor_list.data, new_capacity * sizeof(sensor_stats_t));
-        if (new_data == NULL) {
-            log_message(LOG_LEVEL_ERROR, "Failed to reallocate memory for sensor stats: %s", strerror(errno)); 
-            return NULL;
+    /* Take the next entry of the newest chunk, allocating a chunk when it is used up */
+    sensor_stats_chunk_t *chunk = table->chunks;
+    if (chunk == NULL || chunk->used == SENSOR_STATS_CHUNK) {
+        chunk = pool_alloc(stats_chunk_pool);
+        if (chunk == NULL) {
+            return NULL; /* All DATAMGT_STATS_CHUNKS in use */
         }
-        sensor_list.data = new_data;
-        sensor_list.capacity = new_capacity;
+        chunk->next = table->chunks;
+        chunk->used = 0;
+        table->chunks = chunk;
+        LOG_DEBUG("Allocated sensor stats chunk (%d sensors so far)", table->size); 
     }
 
     /* Create new entry */
-    log_message(LOG_LEVEL_DEBUG, "Creating new stats entry for sensor ID %d at index %d", id, sensor_list.size); 
-    sensor_stats_t *new_sensor = &sensor_list.data[sensor_list.size];
-    new_sensor->id = id;
-    new_sensor->total_value_sum = 0.0;
-    new_sensor->reading_count = 0;
-    new_sensor->last_logged_state = TEMP_STATE_NORMAL; /* Initial state */
+    LOG_DEBUG("Creating new stats entry for sensor ID %d", id); 
+    stats = &chunk->entries[chunk->used++];
+    stats->id = id;
+    stats->total_value_sum = 0.0;
+    stats->reading_count = 0;
+    stats->average = 0.0;
+#if DATAMGT_AVG_MODE == DATAMGT_AVG_WINDOW
+    stats->window_sum = 0.0;
+    stats->window_start = 0;
+    stats->window_count = 0;
+    stats->window_inserts = 0;
+#endif
+    stats->temp_state = TEMP_STATE_NORMAL; /* Initial state */
+    stats->rules_generation = 0; /* Resolved at the first reading */
+    stats->last_value = 0.0;
+    stats->last_ts = 0;
+    stats->value_mean = 0.0;
+    stats->value_var = 0.0;
+    stats->anomalies = 0;
+    stats->alert_sec = 0;
+    stats->alerts_suppressed = 0;
+    stats->room_generation = 0; /* room_id = -1 is right while there is no map */
+    stats->room_id = -1;
+#if DEDUP_WINDOW_READINGS > 0
+    stats->dedup.count = 0;
+    stats->dedup.next = 0;
+#endif
+#if DATAMGT_ROLLUPS
+    stats->room = NULL;
+    for (int tier = 0; tier < ROLLUP_TIERS; ++tier) {
+        stats->rollups[tier].count = 0;
+    }
+#endif
 
-    sensor_list.size++;
-    return new_sensor;
+    table->index[id] = stats;
+    table->size++;
+    return stats;
 }
 
 /**
  * @brief Updates the statistics for a given sensor with a new reading.
- *        Adds the value to the total and increments the count.
+ *        Adds the value to the lifetime totals and updates the running average in O(1):
+ *        the window replaces its oldest reading (and readings older than DATAMGT_WINDOW_SEC),
+ *        the EWMA blends the new value in.
  */
-static void update_sensor_stats(sensor_stats_t *stats, double value) {
+static void update_sensor_stats(sensor_stats_t *stats, double value, sensor_ts_t ts) {
     stats->total_value_sum += value;
     stats->reading_count++;
-    /* No logging here, happens in check_temperature_alerts or main loop DEBUG log */
+
+#if DATAMGT_AVG_MODE == DATAMGT_AVG_EWMA
+    (void)ts;
+    if (stats->reading_count == 1) {
+        stats->average = value;
+    } else {
+        stats->average += DATAMGT_EWMA_ALPHA * (value - stats->average);
+    }
+#else
+    /* Make room: the window is full, or its oldest readings fell out of the time span */
+    if (stats->window_count == DATAMGT_WINDOW_SIZE) {
+        stats->window_sum -= stats->window_values[stats->window_start];
+        stats->window_start = (stats->window_start + 1) % DATAMGT_WINDOW_SIZE;
+        stats->window_count--;
+    }
+#if DATAMGT_WINDOW_SEC > 0
+    while (stats->window_count > 0 && stats->window_ts[stats->window_start] <= ts - DATAMGT_WINDOW_SEC) {
+        stats->window_sum -= stats->window_values[stats->window_start];
+        stats->window_start = (stats->window_start + 1) % DATAMGT_WINDOW_SIZE;
+        stats->window_count--;
+    }
+#else
+    (void)ts;
+#endif
+
+    int slot = (stats->window_start + stats->window_count) % DATAMGT_WINDOW_SIZE;
+    stats->window_values[slot] = value;
+#if DATAMGT_WINDOW_SEC > 0
+    stats->window_ts[slot] = ts;
+#endif
+    stats->window_count++;
+    stats->window_sum += value;
+
+    /* Resum once per window length so rounding errors of the subtractions cannot accumulate */
+    if (++stats->window_inserts == DATAMGT_WINDOW_SIZE) {
+        double sum = 0.0;
+        for (int i = 0; i < stats->window_count; ++i) {
+            sum += stats->window_values[(stats->window_start + i) % DATAMGT_WINDOW_SIZE];
+        }
+        stats->window_sum = sum;
+        stats->window_inserts = 0;
+    }
+    stats->average = stats->window_sum / stats->window_count;
+#endif
+    /* No logging here, happens in report_temperature_state or the DEBUG log of process_reading */
 }
 
 /**
- * @brief Calculates running average, checks thresholds, and logs alerts if state changes.
- *        Uses the room-sensor map to include room information in logs.
+ * @brief Looks up the sensor's room once per map generation, then the cached value is used.
+ *        Generations never repeat, so a new map at a freed map's address is still a miss.
  */
-static void check_temperature_alerts(sensor_stats_t *stats, const room_sensor_map_t *map) {
-
-    if (stats->reading_count == 0) {
-        return; /* Cannot calculate average yet */
+static void resolve_room(datamgt_worker_t *worker, sensor_stats_t *stats, const room_sensor_map_t *map) {
+    unsigned int generation = (map != NULL) ? map->generation : 0;
+    if (stats->room_generation == generation) {
+        return;
     }
+    stats->room_id = get_room_id(stats->id, map);
+    stats->room_generation = generation;
+    stats->rules_generation = 0; /* Room rules may differ */
+#if DATAMGT_ROLLUPS
+    stats->room = (stats->room_id != -1) ? find_or_create_room(worker, stats->room_id) : NULL;
+#else
+    (void)worker;
+#endif
+}
+
+/**
+ * @brief Computes the thresholds that apply in a state: a crossed threshold moves back inside
+ *        by the hysteresis, so the alert clears only once the average is clearly back.
+ */
+static void threshold_bounds(const alert_profile_t *alert, temp_state_t state, double *low, double *high) {
+    *low = state == TEMP_STATE_TOO_COLD ? alert->low + alert->hysteresis : alert->low;
+    *high = state == TEMP_STATE_TOO_HOT ? alert->high - alert->hysteresis : alert->high;
+}
 
-    double running_avg = stats->total_value_sum / stats->reading_count;
-    temp_state_t current_state = TEMP_STATE_NORMAL;
-    int room_id = -1; /* Default room ID if not found */
+/**
+ * @brief Logs the anomaly checks a reading failed that its sensor's previous reading passed,
+ *        each one as an alert admit_alert() may hold back.
+ */
+static void report_anomalies(datamgt_worker_t *worker, sensor_stats_t *stats, uint8_t raised,
+                             const alert_inputs_t *inputs, size_t i, sensor_value_t value) {
+    const char *room_info_str = (stats->room_id != -1) ? "in room" : "for sensor";
+    int id_to_log = (stats->room_id != -1) ? stats->room_id : stats->id;
 
-    /* Find room ID from map if map exists */
-    if (map != NULL) {
-        room_id = get_room_id(stats->id, map);
+    if ((raised & ANOMALY_RATE) && admit_alert(worker, stats)) {
+        log_message(LOG_LEVEL_WARNING,
+                    "Sensor node %d (%s %d) changed from %.2f to %.2f, faster than %.2f per second",
+                    stats->id, room_info_str, id_to_log, inputs->previous[i], value, stats->alert.max_rate);
     }
-
-    if (running_avg < TEMP_TOO_COLD_THRESHOLD) {
-        current_state = TEMP_STATE_TOO_COLD;
-    } else if (running_avg > TEMP_TOO_HOT_THRESHOLD) {
-        current_state = TEMP_STATE_TOO_HOT;
+    if ((raised & ANOMALY_ZSCORE) && admit_alert(worker, stats)) {
+        log_message(LOG_LEVEL_WARNING,
+                    "Sensor node %d (%s %d) reports %.2f, more than %.1f standard deviations from its mean %.2f",
+                    stats->id, room_info_str, id_to_log, value, stats->alert.max_zscore, inputs->means[i]);
     }
+}
+
+/**
+ * @brief Moves a sensor to a new temperature state (process_batch() classifies it) and logs the
+ *        change unless admit_alert() holds it back; a later summary then reports the state.
+ *        Uses the cached room of the sensor to include room information in logs.
+ */
+static void report_temperature_state(datamgt_worker_t *worker, sensor_stats_t *stats, temp_state_t current_state,
+                                     double running_avg) {
+    int room_id = stats->room_id; /* -1 if the map does not list the sensor */
 
     /* Log only if the state has changed */
-    if (current_state != stats->last_logged_state) {
+    if (current_state != stats->temp_state) {
         const char* room_info_str = (room_id != -1) ? "in room" : "for sensor";
         int id_to_log = (room_id != -1) ? room_id : stats->id;
 
+        stats->temp_state = current_state; /* The state machine moves on even if the line is held back */
+        if (!admit_alert(worker, stats)) {
+            return;
+        }
         switch (current_state) {
             case TEMP_STATE_TOO_COLD:
                 log_message(LOG_LEVEL_WARNING, /* Changed from ALERT to WARNING, ALERT is not a defined level */
@@ -290,28 +1082,851 @@ static void check_temperature_alerts(sensor_stats_t *stats, const room_sensor_ma
                             stats->id, room_info_str, id_to_log, running_avg); 
                 break;
         }
-        stats->last_logged_state = current_state; /* Update the last logged state */
     }
 }
 
+/* --- Alert Limits --- */
+
+/**
+ * @brief Reads the worker's alert clock, whole seconds of CLOCK_MONOTONIC since the worker
+ *        started. Sensor timestamps are not used: a sensor must not be able to move the clock
+ *        its own alerts are limited by.
+ */
+static void tick_alert_clock(datamgt_worker_t *worker) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    worker->alert_clock = (uint32_t)(now.tv_sec - worker->alert_epoch.tv_sec) + 1;
+}
+
+/**
+ * @brief Counts one line against the worker's share of the alert_max_per_sec setting.
+ * @return true if the line may be logged in this second.
+ */
+static bool take_alert_budget(datamgt_worker_t *worker) {
+    long max_per_sec = SETTING(alert_max_per_sec);
+    if (max_per_sec <= 0) {
+        return true;
+    }
+    if (worker->alert_budget_sec != worker->alert_clock) {
+        long share = max_per_sec / num_workers;
+        worker->alert_budget = share > 0 ? (int)share : 1;
+        worker->alert_budget_sec = worker->alert_clock;
+    }
+    if (worker->alert_budget == 0) {
+        return false;
+    }
+    worker->alert_budget--;
+    return true;
+}
+
+/**
+ * @brief Decides whether an alert of a sensor is logged. It is held back (counted for the
+ *        sensor's next summary) while the sensor's last alert line is younger than the
+ *        alert_min_interval_sec setting, while a summary is still due, or over the rate limit.
+ * @return true if the caller logs the alert.
+ */
+static bool admit_alert(datamgt_worker_t *worker, sensor_stats_t *stats) {
+    bool interval_over = stats->alert_sec == 0 ||
+                         worker->alert_clock - stats->alert_sec >= (uint32_t)SETTING(alert_min_interval_sec);
+
+    if (interval_over && stats->alerts_suppressed == 0) {
+        if (take_alert_budget(worker)) {
+            stats->alert_sec = worker->alert_clock;
+            metrics_inc(METRIC_ALERTS_LOGGED);
+            return true;
+        }
+        worker->alerts_held++;
+    }
+    if (stats->alerts_suppressed == 0) {
+        worker->alert_pending[stats->id / 64] |= UINT64_C(1) << (stats->id % 64);
+        worker->alert_pending_count++;
+    }
+    if (stats->alerts_suppressed < UINT32_MAX) {
+        stats->alerts_suppressed++;
+    }
+    metrics_inc(METRIC_ALERTS_SUPPRESSED);
+    return false;
+}
+
+/**
+ * @brief Logs one summary per sensor whose interval is over, as far as the rate limit allows,
+ *        and a notice when the limit held alerts back. Walks the pending bitfield (a word per
+ *        64 sensors), so it runs at most once per second of the alert clock.
+ */
+static void alert_sweep(datamgt_worker_t *worker) {
+    static const char *const state_names[] = {"normal", "too cold", "too hot"};
+    uint32_t now = worker->alert_clock;
+    uint32_t interval = (uint32_t)SETTING(alert_min_interval_sec);
+    bool limited = false;
+
+    worker->alert_swept_sec = now;
+    for (int n = 0; n < ALERT_PENDING_WORDS && worker->alert_pending_count > 0 && !limited; ++n) {
+        int word = (worker->alert_sweep_word + n) % ALERT_PENDING_WORDS;
+        uint64_t bits = worker->alert_pending[word];
+        while (bits != 0) {
+            int bit = __builtin_ctzll(bits);
+            bits &= bits - 1;
+            sensor_stats_t *stats = worker->table.index[word * 64 + bit];
+            uint32_t since = stats->alert_sec != 0 ? now - stats->alert_sec : now;
+            if (stats->alert_sec != 0 && since < interval) {
+                continue;
+            }
+            if (!take_alert_budget(worker)) {
+                worker->alert_sweep_word = word; /* Resume here next second */
+                limited = true;
+                break;
+            }
+            const char *room_info_str = (stats->room_id != -1) ? "in room" : "for sensor";
+            int id_to_log = (stats->room_id != -1) ? stats->room_id : stats->id;
+            log_message(LOG_LEVEL_WARNING,
+                        "Sensor node %d (%s %d): %u alert%s suppressed in the last %u s, now %s (running avg temperature = %.2f)",
+                        stats->id, room_info_str, id_to_log, stats->alerts_suppressed,
+                        stats->alerts_suppressed == 1 ? "" : "s", since,
+                        state_names[stats->temp_state], stats->average);
+            metrics_inc(METRIC_ALERTS_LOGGED);
+            stats->alert_sec = now;
+            stats->alerts_suppressed = 0;
+            worker->alert_pending[word] &= ~(UINT64_C(1) << bit);
+            worker->alert_pending_count--;
+        }
+    }
+
+    /* The notice repeats at most once per interval (once per second without one) */
+    if (worker->alerts_held > 0 &&
+        (worker->alert_notice_sec == 0 || now - worker->alert_notice_sec >= (interval > 0 ? interval : 1))) {
+        log_message(LOG_LEVEL_WARNING, "Alert rate limit of %ld per second reached, %lu alert%s held back for summaries.",
+                    SETTING(alert_max_per_sec), (unsigned long)worker->alerts_held, worker->alerts_held == 1 ? "" : "s");
+        worker->alerts_held = 0;
+        worker->alert_notice_sec = now;
+    }
+}
+
+/**
+ * @brief Reports the alerts still held back when the worker stops, in one line.
+ */
+static void alert_flush(datamgt_worker_t *worker) {
+    uint64_t alerts = 0;
+
+    if (worker->alert_pending_count == 0) {
+        return;
+    }
+    for (int word = 0; word < ALERT_PENDING_WORDS; ++word) {
+        for (uint64_t bits = worker->alert_pending[word]; bits != 0; bits &= bits - 1) {
+            alerts += worker->table.index[word * 64 + __builtin_ctzll(bits)]->alerts_suppressed;
+        }
+    }
+    log_message(LOG_LEVEL_INFO, "Data manager worker %d stopped with %lu suppressed alerts not summarised (%u sensors).",
+                worker->shard, (unsigned long)alerts, worker->alert_pending_count);
+}
+
+/* --- Statistics Snapshots --- */
+
+#if DATAMGT_SNAPSHOT_INTERVAL_SEC > 0
+/**
+ * @brief Builds the path of a shard's snapshot file, with suffix appended (may be "").
+ */
+static void snapshot_path(char *path, size_t size, int shard, const char *suffix) {
+    snprintf(path, size, "%s/shard-%02d.snap%s", DATAMGT_SNAPSHOT_DIR, shard, suffix);
+}
+
+/**
+ * @brief Writes the worker's statistics to its snapshot file. The file is built under a
+ *        temporary name and renamed over the old one, so a crash leaves the old snapshot.
+ *        Runs in the worker and costs one copy of its table.
+ */
+static void snapshot_save(datamgt_worker_t *worker) {
+    char path[SNAPSHOT_PATH_SIZE], temporary[SNAPSHOT_PATH_SIZE];
+    size_t room_count = 0;
+#if DATAMGT_ROLLUPS
+    room_count = (size_t)worker->room_count;
+#endif
+    size_t size = sizeof(snapshot_header_t) + (size_t)worker->table.size * sizeof(snapshot_sensor_t) +
+                  room_count * sizeof(snapshot_room_t);
+
+    snapshot_path(path, sizeof(path), worker->shard, "");
+    snapshot_path(temporary, sizeof(temporary), worker->shard, ".tmp");
+    int fd = open(temporary, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        log_message(LOG_LEVEL_WARNING, "Cannot write statistics snapshot %s: %s", temporary, strerror(errno)); 
+        return;
+    }
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        log_message(LOG_LEVEL_WARNING, "Cannot write statistics snapshot %s: %s", temporary, strerror(errno)); 
+        close(fd);
+        unlink(temporary);
+        return;
+    }
+
+    snapshot_header_t *header = map;
+    snapshot_sensor_t *records = (snapshot_sensor_t *)(header + 1);
+    size_t count = 0;
+    for (sensor_stats_chunk_t *chunk = worker->table.chunks; chunk != NULL; chunk = chunk->next) {
+        for (int i = 0; i < chunk->used; ++i) {
+            const sensor_stats_t *stats = &chunk->entries[i];
+            snapshot_sensor_t *record = &records[count++]; /* Zero-filled by ftruncate(), padding included */
+            record->id = stats->id;
+            record->temp_state = (uint8_t)stats->temp_state;
+            record->anomalies = stats->anomalies;
+            record->reading_count = stats->reading_count;
+            record->total_value_sum = stats->total_value_sum;
+            record->average = stats->average;
+            record->last_value = stats->last_value;
+            record->last_ts = stats->last_ts;
+            record->value_mean = stats->value_mean;
+            record->value_var = stats->value_var;
+#if DATAMGT_AVG_MODE == DATAMGT_AVG_WINDOW
+            record->window_count = stats->window_count;
+            for (int w = 0; w < stats->window_count; ++w) {
+                int slot = (stats->window_start + w) % DATAMGT_WINDOW_SIZE;
+                record->window_values[w] = stats->window_values[slot];
+#if DATAMGT_WINDOW_SEC > 0
+                record->window_ts[w] = stats->window_ts[slot];
+#endif
+            }
+#endif
+#if DATAMGT_ROLLUPS
+            memcpy(record->rollups, stats->rollups, sizeof(record->rollups));
+#endif
+        }
+    }
+#if DATAMGT_ROLLUPS
+    snapshot_room_t *rooms = (snapshot_room_t *)(records + count);
+    for (size_t r = 0; r < room_count; ++r) {
+        rooms[r].room_id = worker->rooms[r]->room_id;
+        memcpy(rooms[r].rollups, worker->rooms[r]->rollups, sizeof(rooms[r].rollups));
+    }
+    for (int tier = 0; tier < ROLLUP_TIERS; ++tier) {
+        header->rollup_periods[tier] = rollup_periods[tier];
+    }
+#endif
+    header->magic = SNAPSHOT_MAGIC;
+    header->version = SNAPSHOT_VERSION;
+    header->record_size = sizeof(snapshot_sensor_t);
+    header->count = (uint32_t)count;
+    header->avg_mode = DATAMGT_AVG_MODE;
+    header->window_size = DATAMGT_WINDOW_SIZE;
+    header->window_sec = DATAMGT_WINDOW_SEC;
+    header->room_count = (uint32_t)room_count;
+    header->written = (int64_t)time(NULL);
+    munmap(map, size);
+    close(fd);
+
+    if (rename(temporary, path) == -1) {
+        log_message(LOG_LEVEL_WARNING, "Cannot replace statistics snapshot %s: %s", path, strerror(errno)); 
+        unlink(temporary);
+        return;
+    }
+    LOG_DEBUG("Data manager worker %d saved the statistics of %zu sensors.", worker->shard, count);
+}
+
+#if DATAMGT_ROLLUPS
+/**
+ * @brief Lists the open rollup buckets of a snapshot file as rows. A bucket that started more
+ *        than its period before the snapshot should have been written before it, and is left out.
+ * @param stale Incremented per bucket left out.
+ * @return The number of rows; rows has room for every bucket of the file.
+ */
+static size_t snapshot_bucket_rows(const snapshot_header_t *header, const snapshot_sensor_t *records,
+                                   rollup_row_t *rows, size_t *stale) {
+    const snapshot_room_t *rooms = (const snapshot_room_t *)(records + header->count);
+    size_t n = 0;
+
+    for (uint32_t r = 0; r < header->count + header->room_count; ++r) {
+        bool room = r >= header->count;
+        const rollup_bucket_t *buckets = room ? rooms[r - header->count].rollups : records[r].rollups;
+        for (int tier = 0; tier < ROLLUP_TIERS; ++tier) {
+            const rollup_bucket_t *bucket = &buckets[tier];
+            if (bucket->count == 0 || bucket->start % rollup_periods[tier] != 0) {
+                continue;
+            }
+            if (bucket->start < (sensor_ts_t)header->written - rollup_periods[tier]) {
+                (*stale)++;
+                continue;
+            }
+            rollup_row_t *row = &rows[n++];
+            row->scope = room ? ROLLUP_SCOPE_ROOM : ROLLUP_SCOPE_SENSOR;
+            row->key = room ? rooms[r - header->count].room_id : records[r].id;
+            row->period = rollup_periods[tier];
+            row->start = bucket->start;
+            row->count = bucket->count;
+            row->sum = bucket->sum;
+            row->min = bucket->min;
+            row->max = bucket->max;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Puts a bucket of a snapshot back into an open bucket. Two files can hold the same room;
+ *        its buckets of one period merge, of different periods the older one is emitted.
+ */
+static void snapshot_reopen_bucket(datamgt_worker_t *worker, rollup_bucket_t *bucket, const rollup_row_t *row) {
+    rollup_bucket_t restored = {row->start, row->count, row->sum, row->min, row->max};
+
+    if (bucket->count > 0 && bucket->start == restored.start) {
+        bucket->count += restored.count;
+        bucket->sum += restored.sum;
+        if (restored.min < bucket->min) bucket->min = restored.min;
+        if (restored.max > bucket->max) bucket->max = restored.max;
+    } else if (bucket->count > 0 && bucket->start > restored.start) {
+        rollup_emit(worker, &restored, row->scope, row->key, row->period);
+    } else {
+        if (bucket->count > 0) {
+            rollup_emit(worker, bucket, row->scope, row->key, row->period);
+        }
+        *bucket = restored;
+    }
+}
+
+/**
+ * @brief Reopens the rollup buckets of one snapshot file that the rollup table has no row of.
+ *        The table is looked up on a read-only connection, opened on the first file that needs it;
+ *        without it the buckets are restored unchecked.
+ */
+static void snapshot_restore_buckets(const snapshot_header_t *header, const snapshot_sensor_t *records,
+                                     int shard, int count, db_handle_t **db, bool *db_tried,
+                                     size_t *restored, size_t *skipped) {
+    for (int tier = 0; tier < ROLLUP_TIERS; ++tier) {
+        if (header->rollup_periods[tier] != rollup_periods[tier]) {
+            return; /* Other bucket periods: the buckets would not line up */
+        }
+    }
+    size_t capacity = ((size_t)header->count + header->room_count) * ROLLUP_TIERS;
+    if (capacity == 0) {
+        return;
+    }
+    rollup_row_t *rows = malloc(capacity * sizeof(rollup_row_t));
+    bool *exists = calloc(capacity, sizeof(bool));
+    if (rows == NULL || exists == NULL) {
+        log_message(LOG_LEVEL_WARNING, "No memory to restore the rollup buckets of snapshot shard %d.", shard);
+        free(rows);
+        free(exists);
+        return;
+    }
+    size_t n = snapshot_bucket_rows(header, records, rows, skipped);
+
+    if (n > 0 && !*db_tried) {
+        *db_tried = true;
+        if (db_connect_readonly(DB_NAME, db) != GATEWAY_SUCCESS) {
+            log_message(LOG_LEVEL_WARNING, "Restoring open rollup buckets without checking %s for rows already written.",
+                        DB_ROLLUP_TABLE_NAME);
+        }
+    }
+    if (n > 0 && *db != NULL && db_rollup_rows_exist(*db, rows, n, exists) != GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_WARNING, "Could not check %s for the rollup buckets of snapshot shard %d, restoring them unchecked.",
+                    DB_ROLLUP_TABLE_NAME, shard);
+        memset(exists, 0, capacity * sizeof(bool));
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        const rollup_row_t *row = &rows[i];
+        int tier = 0;
+        while (rollup_periods[tier] != row->period) {
+            tier++; /* Rows were made from rollup_periods */
+        }
+        rollup_bucket_t *bucket = NULL;
+        datamgt_worker_t *worker;
+
+        if (exists[i]) {
+            (*skipped)++;
+            continue;
+        }
+        if (row->scope == ROLLUP_SCOPE_SENSOR) {
+            worker = &workers[row->key % count];
+            sensor_stats_t *stats = worker->table.index[row->key];
+            bucket = stats != NULL ? &stats->rollups[tier] : NULL;
+        } else {
+            worker = &workers[shard % count]; /* Room rows of several workers merge, any worker will do */
+            room_rollup_t *room = find_or_create_room(worker, row->key);
+            bucket = room != NULL ? &room->rollups[tier] : NULL;
+        }
+        if (bucket != NULL) {
+            snapshot_reopen_bucket(worker, bucket, row);
+            (*restored)++;
+        }
+    }
+    free(rows);
+    free(exists);
+}
+#endif
+
+/**
+ * @brief Loads the statistics of every snapshot file into the workers' tables. A sensor goes
+ *        to the worker that owns it now, whatever worker saved it; files of shards beyond count
+ *        are removed afterwards, their sensors are saved by their new workers from now on.
+ *        Files that are older than DATAMGT_SNAPSHOT_MAX_AGE_SEC, or were written with other
+ *        averaging settings, are skipped. Must run before the workers start.
+ *        The open rollup buckets come back too, except those the rollup table already has a row
+ *        of: they were written after the snapshot, or as partial rows when the gateway stopped.
+ */
+static void snapshot_restore(int count) {
+    size_t restored = 0;
+    int files = 0;
+    time_t now = time(NULL);
+#if DATAMGT_ROLLUPS
+    size_t buckets_restored = 0, buckets_skipped = 0;
+    db_handle_t *db = NULL;
+    bool db_tried = false;
+#endif
+
+    if (mkdir(DATAMGT_SNAPSHOT_DIR, 0755) == -1 && errno != EEXIST) {
+        log_message(LOG_LEVEL_WARNING, "Cannot create snapshot directory %s: %s", DATAMGT_SNAPSHOT_DIR, strerror(errno)); 
+        return;
+    }
+    for (int shard = 0; shard < DATAMGT_MAX_WORKERS; ++shard) {
+        char path[SNAPSHOT_PATH_SIZE];
+        struct stat st;
+
+        snapshot_path(path, sizeof(path), shard, "");
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            continue;
+        }
+        void *map = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(snapshot_header_t)) {
+            map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (map == MAP_FAILED) {
+            log_message(LOG_LEVEL_WARNING, "Ignoring unreadable statistics snapshot %s.", path); 
+            continue;
+        }
+
+        const snapshot_header_t *header = map;
+        const snapshot_sensor_t *records = (const snapshot_sensor_t *)(header + 1);
+        if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION ||
+            header->record_size != sizeof(snapshot_sensor_t) || header->avg_mode != DATAMGT_AVG_MODE ||
+            header->window_size != DATAMGT_WINDOW_SIZE || header->window_sec != DATAMGT_WINDOW_SEC ||
+            (size_t)st.st_size != sizeof(snapshot_header_t) + (size_t)header->count * sizeof(snapshot_sensor_t) +
+                                  (size_t)header->room_count * sizeof(snapshot_room_t)) {
+            log_message(LOG_LEVEL_WARNING, "Ignoring statistics snapshot %s: written by another build or incomplete.", path); 
+        } else if (DATAMGT_SNAPSHOT_MAX_AGE_SEC > 0 && now - (time_t)header->written > DATAMGT_SNAPSHOT_MAX_AGE_SEC) {
+            log_message(LOG_LEVEL_INFO, "Ignoring statistics snapshot %s: %ld s old.", path, (long)(now - (time_t)header->written)); 
+        } else {
+            files++;
+            for (uint32_t r = 0; r < header->count; ++r) {
+                const snapshot_sensor_t *record = &records[r];
+                sensor_stats_t *stats = find_or_create_sensor(&workers[record->id % count].table, record->id);
+                if (stats == NULL) {
+                    log_message(LOG_LEVEL_WARNING, "Sensor stats pool exhausted, snapshot %s restored in part.", path); 
+                    break;
+                }
+                stats->temp_state = record->temp_state <= TEMP_STATE_TOO_HOT ? (temp_state_t)record->temp_state : TEMP_STATE_NORMAL;
+                stats->anomalies = record->anomalies;
+                stats->reading_count = record->reading_count;
+                stats->total_value_sum = record->total_value_sum;
+                stats->average = record->average;
+                stats->last_value = record->last_value;
+                stats->last_ts = record->last_ts;
+                stats->value_mean = record->value_mean;
+                stats->value_var = record->value_var;
+#if DATAMGT_AVG_MODE == DATAMGT_AVG_WINDOW
+                int window_count = record->window_count;
+                if (window_count < 0 || window_count > DATAMGT_WINDOW_SIZE) {
+                    window_count = 0;
+                }
+                stats->window_start = 0;
+                stats->window_count = window_count;
+                stats->window_inserts = 0;
+                stats->window_sum = 0.0;
+                for (int w = 0; w < window_count; ++w) {
+                    stats->window_values[w] = record->window_values[w];
+#if DATAMGT_WINDOW_SEC > 0
+                    stats->window_ts[w] = record->window_ts[w];
+#endif
+                    stats->window_sum += record->window_values[w];
+                }
+#endif
+                restored++;
+            }
+#if DATAMGT_ROLLUPS
+            snapshot_restore_buckets(header, records, shard, count, &db, &db_tried,
+                                     &buckets_restored, &buckets_skipped);
+#endif
+        }
+        munmap(map, (size_t)st.st_size);
+        if (shard >= count) {
+            unlink(path);
+        }
+    }
+#if DATAMGT_ROLLUPS
+    db_disconnect(db);
+    if (files > 0) {
+        log_message(LOG_LEVEL_INFO, "Restored %zu open rollup buckets, skipped %zu already written.",
+                    buckets_restored, buckets_skipped);
+    }
+#endif
+    if (files > 0) {
+        log_message(LOG_LEVEL_INFO, "Restored the statistics of %zu sensors from %d snapshot files in %s.",
+                    restored, files, DATAMGT_SNAPSHOT_DIR);
+    }
+}
+
+#endif /* DATAMGT_SNAPSHOT_INTERVAL_SEC > 0 */
+
+#if DATAMGT_ROLLUPS
+/* --- Rollups --- */
+
+/**
+ * @brief Finds the worker's rollups of a room, creating them on first use.
+ *        Linear search, but it only runs when a sensor's room is resolved (once per map generation).
+ */
+static room_rollup_t *find_or_create_room(datamgt_worker_t *worker, int room_id) {
+    for (int i = 0; i < worker->room_count; ++i) {
+        if (worker->rooms[i]->room_id == room_id) {
+            return worker->rooms[i];
+        }
+    }
+    if (worker->room_count == worker->room_capacity) {
+        int new_capacity = worker->room_capacity > 0 ? worker->room_capacity * 2 : MAP_INITIAL_CAPACITY;
+        room_rollup_t **new_rooms = realloc(worker->rooms, new_capacity * sizeof(room_rollup_t *));
+        if (new_rooms == NULL) {
+            log_message(LOG_LEVEL_ERROR, "Failed to allocate memory for room rollups: %s", strerror(errno)); 
+            return NULL;
+        }
+        worker->rooms = new_rooms;
+        worker->room_capacity = new_capacity;
+    }
+    room_rollup_t *room = calloc(1, sizeof(room_rollup_t)); /* Every bucket starts empty */
+    if (room == NULL) {
+        log_message(LOG_LEVEL_ERROR, "Failed to allocate memory for room rollups: %s", strerror(errno)); 
+        return NULL;
+    }
+    room->room_id = room_id;
+    worker->rooms[worker->room_count++] = room;
+    return room;
+}
+
+/**
+ * @brief Frees the worker's room rollups.
+ */
+static void free_room_rollups(datamgt_worker_t *worker) {
+    for (int i = 0; i < worker->room_count; ++i) {
+        free(worker->rooms[i]);
+    }
+    free(worker->rooms);
+    worker->rooms = NULL;
+    worker->room_count = worker->room_capacity = 0;
+}
+
+/**
+ * @brief Adds a reading to an open bucket.
+ *        A reading of a later bucket first emits the open one. A late reading of an earlier
+ *        bucket is emitted as a one-reading row of its own, which merges with the row already written.
+ */
+static void rollup_add(datamgt_worker_t *worker, rollup_bucket_t *bucket, rollup_scope_t scope, int key,
+                       int period, sensor_ts_t ts, double value) {
+    sensor_ts_t start = ts - ts % period;
+
+    if (bucket->count > 0 && start != bucket->start) {
+        if (start < bucket->start) {
+            rollup_bucket_t late = {start, 1, value, value, value};
+            rollup_emit(worker, &late, scope, key, period);
+            return;
+        }
+        rollup_emit(worker, bucket, scope, key, period);
+        bucket->count = 0;
+    }
+    if (bucket->count == 0) {
+        bucket->start = start;
+        bucket->sum = 0.0;
+        bucket->min = value;
+        bucket->max = value;
+    }
+    bucket->count++;
+    bucket->sum += value;
+    if (value < bucket->min) bucket->min = value;
+    if (value > bucket->max) bucket->max = value;
+}
+
+/**
+ * @brief Appends a completed bucket to the worker's outgoing rows, handing them to storage when full.
+ */
+static void rollup_emit(datamgt_worker_t *worker, const rollup_bucket_t *bucket, rollup_scope_t scope,
+                        int key, int period) {
+    if (worker->rollup_out_count == ROLLUP_OUT_BATCH) {
+        rollup_flush(worker);
+    }
+    rollup_row_t *row = &worker->rollup_out[worker->rollup_out_count++];
+    row->scope = scope;
+    row->key = key;
+    row->period = period;
+    row->start = bucket->start;
+    row->count = bucket->count;
+    row->sum = bucket->sum;
+    row->min = bucket->min;
+    row->max = bucket->max;
+}
+
+/**
+ * @brief Emits the buckets that ended before the worker's clock, or with all set every open bucket.
+ *        Walks every sensor and room of the worker, so it runs once per minute of the clock.
+ */
+static void rollup_sweep(datamgt_worker_t *worker, bool all) {
+    sensor_ts_t current[ROLLUP_TIERS]; /* Start of the bucket the clock is in, per tier */
+    for (int tier = 0; tier < ROLLUP_TIERS; ++tier) {
+        current[tier] = worker->rollup_clock - worker->rollup_clock % rollup_periods[tier];
+    }
+
+    for (sensor_stats_chunk_t *chunk = worker->table.chunks; chunk != NULL; chunk = chunk->next) {
+        for (int i = 0; i < chunk->used; ++i) {
+            sensor_stats_t *stats = &chunk->entries[i];
+            for (int tier = 0; tier < ROLLUP_TIERS; ++tier) {
+                rollup_bucket_t *bucket = &stats->rollups[tier];
+                if (bucket->count > 0 && (all || bucket->start < current[tier])) {
+                    rollup_emit(worker, bucket, ROLLUP_SCOPE_SENSOR, stats->id, rollup_periods[tier]);
+                    bucket->count = 0;
+                }
+            }
+        }
+    }
+    for (int r = 0; r < worker->room_count; ++r) {
+        room_rollup_t *room = worker->rooms[r];
+        for (int tier = 0; tier < ROLLUP_TIERS; ++tier) {
+            rollup_bucket_t *bucket = &room->rollups[tier];
+            if (bucket->count > 0 && (all || bucket->start < current[tier])) {
+                rollup_emit(worker, bucket, ROLLUP_SCOPE_ROOM, room->room_id, rollup_periods[tier]);
+                bucket->count = 0;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Hands the worker's completed rows to the storage manager.
+ */
+static void rollup_flush(datamgt_worker_t *worker) {
+    if (worker->rollup_out_count == 0) {
+        return;
+    }
+    if (storagemgt_submit_rollups(worker->rollup_out, worker->rollup_out_count) != GATEWAY_SUCCESS) {
+        LOG_DEBUG("Storage manager refused some of %zu rollup rows.", worker->rollup_out_count); 
+    }
+    worker->rollup_out_count = 0;
+}
+#endif
+
+/* --- Live Subscriptions --- */
+
+/**
+ * @brief Copies the matching readings of a batch into every active subscription.
+ *        Called by the one thread that takes readings from the shared buffer.
+ */
+static void publish_readings(const sensor_data_t *batch, size_t count) {
+    if (__atomic_load_n(&subscriber_count, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+    /* Announce the pass before looking at the states; datamgt_unsubscribe() stores the state
+     * before looking at publish_busy, so one of the two sees the other (both seq_cst) */
+    __atomic_store_n(&publish_busy, 1, __ATOMIC_SEQ_CST);
+    for (int s = 0; s < DATAMGT_MAX_SUBSCRIBERS; ++s) {
+        datamgt_subscription_t *subscription = &subscriptions[s];
+        if (__atomic_load_n(&subscription->state, __ATOMIC_SEQ_CST) != SUBSCRIPTION_ACTIVE) {
+            continue;
+        }
+        uint64_t head = subscription->head;
+        for (size_t i = 0; i < count; ++i) {
+            sensor_id_t id = batch[i].id;
+            if ((__atomic_load_n(&subscription->sensors[id >> 3], __ATOMIC_RELAXED) & (1u << (id & 7))) == 0) {
+                continue;
+            }
+            size_t slot = (size_t)(head & (DATAMGT_SUBSCRIBER_RING - 1));
+            __atomic_store_n(&subscription->slots[slot].seq, 2 * head + 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            subscription->slots[slot].data = batch[i];
+            __atomic_store_n(&subscription->slots[slot].seq, 2 * head + 2, __ATOMIC_RELEASE);
+            head++;
+        }
+        __atomic_store_n(&subscription->head, head, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&publish_passes, publish_passes + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&publish_busy, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Sets the sensor bits of a room feed from a map. Must hold reload_mutex (the map
+ *        stays valid). Bytes are stored one at a time, so the publisher never sees the
+ *        bitmap cleared while the new one is built.
+ */
+static void fill_room_sensors(datamgt_subscription_t *subscription, const room_sensor_map_t *map) {
+    static uint8_t bits[SENSOR_ID_SPACE / 8]; /* Only used under reload_mutex */
+
+    memset(bits, 0, sizeof(bits));
+    for (int i = 0; map != NULL && i < map->count; ++i) {
+        if (map->entries[i].room_id == subscription->room_id) {
+            sensor_id_t id = map->entries[i].sensor_id;
+            bits[id >> 3] |= (uint8_t)(1u << (id & 7));
+        }
+    }
+    for (size_t i = 0; i < sizeof(bits); ++i) {
+        __atomic_store_n(&subscription->sensors[i], bits[i], __ATOMIC_RELAXED);
+    }
+}
+
+gateway_error_t datamgt_subscribe(int room_id, const sensor_id_t *sensor_ids, size_t count,
+                                  datamgt_subscription_t **subscription) {
+    datamgt_subscription_t *slot = NULL;
+
+    pthread_mutex_lock(&reload_mutex);
+    for (int i = 0; i < DATAMGT_MAX_SUBSCRIBERS && slot == NULL; ++i) {
+        if (subscriptions[i].state == SUBSCRIPTION_FREE) {
+            slot = &subscriptions[i];
+        }
+    }
+    if (slot == NULL) {
+        pthread_mutex_unlock(&reload_mutex);
+        return GATEWAY_ERROR;
+    }
+
+    /* A free slot is not touched by the publisher, and the ring starts over */
+    memset(slot->slots, 0, sizeof(slot->slots));
+    slot->head = 0;
+    slot->tail = 0;
+    slot->room_id = room_id;
+    if (room_id >= 0) {
+        fill_room_sensors(slot, __atomic_load_n(&current_map, __ATOMIC_SEQ_CST));
+    } else {
+        memset(slot->sensors, count == 0 ? 0xff : 0, sizeof(slot->sensors));
+        for (size_t i = 0; i < count; ++i) {
+            slot->sensors[sensor_ids[i] >> 3] |= (uint8_t)(1u << (sensor_ids[i] & 7));
+        }
+    }
+    __atomic_store_n(&slot->state, SUBSCRIPTION_ACTIVE, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&subscriber_count, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&reload_mutex);
+
+    *subscription = slot;
+    return GATEWAY_SUCCESS;
+}
+
+size_t datamgt_subscription_read(datamgt_subscription_t *subscription, sensor_data_t *readings,
+                                 size_t max_count, unsigned long *dropped) {
+    uint64_t head = __atomic_load_n(&subscription->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = subscription->tail;
+    size_t n = 0;
+
+    if (head - tail > DATAMGT_SUBSCRIBER_RING) {
+        *dropped += (unsigned long)(head - DATAMGT_SUBSCRIBER_RING - tail); /* Overwritten while we were away */
+        tail = head - DATAMGT_SUBSCRIBER_RING;
+    }
+    while (tail != head && n < max_count) {
+        size_t slot = (size_t)(tail & (DATAMGT_SUBSCRIBER_RING - 1));
+        uint64_t seq = __atomic_load_n(&subscription->slots[slot].seq, __ATOMIC_ACQUIRE);
+        sensor_data_t copy = subscription->slots[slot].data;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (seq != 2 * tail + 2 || __atomic_load_n(&subscription->slots[slot].seq, __ATOMIC_RELAXED) != seq) {
+            (*dropped)++; /* The publisher lapped us on this slot */
+        } else {
+            readings[n++] = copy;
+        }
+        tail++;
+    }
+    subscription->tail = tail;
+    return n;
+}
+
+void datamgt_unsubscribe(datamgt_subscription_t *subscription) {
+    struct timespec poll_ts = {0, SUBSCRIBER_RELEASE_POLL_NS};
+
+    pthread_mutex_lock(&reload_mutex);
+    __atomic_sub_fetch(&subscriber_count, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&subscription->state, SUBSCRIPTION_FREE, __ATOMIC_SEQ_CST);
+    /* A pass running now may have seen the slot active; it ends within one batch, and later passes skip it */
+    unsigned long passes = __atomic_load_n(&publish_passes, __ATOMIC_ACQUIRE);
+    while (__atomic_load_n(&publish_busy, __ATOMIC_SEQ_CST) &&
+           __atomic_load_n(&publish_passes, __ATOMIC_ACQUIRE) == passes) {
+        nanosleep(&poll_ts, NULL);
+    }
+    pthread_mutex_unlock(&reload_mutex);
+}
+
 /* --- Implementation of Room-Sensor Map Functions --- */
 
 /**
  * @brief Helper function to find room ID for a given sensor ID.
- *        Searches the room-sensor map for the corresponding room ID.
+ *        Binary search over the map entries, which the loader sorted by sensor ID.
  */
 static int get_room_id(sensor_id_t sensor_id, const room_sensor_map_t *map) {
     if (map == NULL || map->entries == NULL) {
         return -1;
     }
-    for (int i = 0; i < map->count; ++i) {
-        if (map->entries[i].sensor_id == sensor_id) {
-            return map->entries[i].room_id;
+    int low = 0;
+    int high = map->count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        sensor_id_t mid_id = map->entries[mid].sensor_id;
+        if (mid_id == sensor_id) {
+            return map->entries[mid].room_id;
+        }
+        if (mid_id < sensor_id) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
         }
     }
     return -1; /* Not found */
 }
 
+/**
+ * @brief Writes one map loader message to stderr, for the load at startup before the log process runs.
+ */
+static void map_log_stderr(const char *tag, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fputs(tag, stderr);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+/* The map is loaded once before logger_open_write_fifo() and again on every reload: log messages
+ * go through the logger once it is open, to stderr (with the tag) before */
+#define MAP_LOG(level, tag, ...) \
+    do { \
+        if (logger_is_open()) { \
+            LOG_AT((level), __VA_ARGS__); \
+        } else { \
+            map_log_stderr((tag), __VA_ARGS__); \
+        } \
+    } while (0)
+
+/**
+ * @brief Orders two map entries by sensor ID.
+ */
+static int compare_map_entries(const void *a, const void *b) {
+    const room_sensor_entry_t *ea = a;
+    const room_sensor_entry_t *eb = b;
+    return (int)ea->sensor_id - (int)eb->sensor_id;
+}
+
+/**
+ * @brief Builds the lookup order of a freshly loaded map.
+ *        Drops repeated sensors (the first line in the file wins), then sorts by sensor ID.
+ */
+static void index_room_sensor_map(room_sensor_map_t *map, const char *filename) {
+    uint8_t seen[SENSOR_ID_SPACE / 8]; /* One bit per sensor ID */
+    int kept = 0;
+
+    memset(seen, 0, sizeof(seen));
+    for (int i = 0; i < map->count; ++i) {
+        sensor_id_t id = map->entries[i].sensor_id;
+        if (seen[id / 8] & (1u << (id % 8))) {
+            MAP_LOG(LOG_LEVEL_WARNING, "WARN: ", "Sensor %d is mapped more than once in '%s'. Ignoring its entry for room %d.",
+                    id, filename, map->entries[i].room_id);
+            continue;
+        }
+        seen[id / 8] |= (uint8_t)(1u << (id % 8));
+        map->entries[kept++] = map->entries[i];
+    }
+    map->count = kept;
+    qsort(map->entries, (size_t)map->count, sizeof(room_sensor_entry_t), compare_map_entries);
+}
+
 /**
  * @brief Loads the room-to-sensor mapping from a file.
  *        Allocates memory and parses the file to populate the map.
@@ -330,19 +1945,18 @@ gateway_error_t datamgt_load_room_sensor_map(const char* filename, room_sensor_m
     /* Allocate map structure */
     loaded_map = malloc(sizeof(room_sensor_map_t));
     if (loaded_map == NULL) {
-        /* Use fprintf instead of log_message */
-        fprintf(stderr, "ERROR: Failed to allocate memory for room sensor map struct: %s\n", strerror(errno));
+        MAP_LOG(LOG_LEVEL_ERROR, "ERROR: ", "Failed to allocate memory for room sensor map struct: %s", strerror(errno));
         return GATEWAY_ERROR_NOMEM;
     }
     loaded_map->entries = NULL;
     loaded_map->count = 0;
     loaded_map->capacity = 0;
+    loaded_map->generation = 0;
 
     /* Allocate initial entries */
     loaded_map->entries = malloc(MAP_INITIAL_CAPACITY * sizeof(room_sensor_entry_t));
     if (loaded_map->entries == NULL) {
-        /* Use fprintf instead of log_message */
-        fprintf(stderr, "ERROR: Failed to allocate memory for initial map entries: %s\n", strerror(errno));
+        MAP_LOG(LOG_LEVEL_ERROR, "ERROR: ", "Failed to allocate memory for initial map entries: %s", strerror(errno));
         free(loaded_map);
         return GATEWAY_ERROR_NOMEM;
     }
@@ -351,8 +1965,7 @@ gateway_error_t datamgt_load_room_sensor_map(const char* filename, room_sensor_m
     /* Open file */
     fp = fopen(filename, "r");
     if (fp == NULL) {
-        /* Use fprintf instead of log_message */
-        fprintf(stderr, "ERROR: Cannot open room_sensor map file '%s': %s\n", filename, strerror(errno));
+        MAP_LOG(LOG_LEVEL_ERROR, "ERROR: ", "Cannot open room_sensor map file '%s': %s", filename, strerror(errno));
         free(loaded_map->entries);
         free(loaded_map);
         return GATEWAY_ERROR; /* Or specific file error */
@@ -369,25 +1982,22 @@ gateway_error_t datamgt_load_room_sensor_map(const char* filename, room_sensor_m
         if (*line_ptr == '\0' || *line_ptr == '#') continue; /* Skip empty lines and comments */
 
         if (sscanf(line_ptr, "%d , %d", &room_id_val, &sensor_id_val) != 2) {
-            /* Use fprintf instead of log_message */
-            fprintf(stderr, "WARN: Invalid format in map file '%s' at line %d: %s", filename, line_num, line_ptr); /* Keep newline from fgets */
+            MAP_LOG(LOG_LEVEL_WARNING, "WARN: ", "Invalid format in map file '%s' at line %d: %.*s",
+                    filename, line_num, (int)strcspn(line_ptr, "\r\n"), line_ptr); /* Without the newline from fgets */
             continue;
         }
         if (sensor_id_val < 0 || sensor_id_val > UINT16_MAX) {
-            /* Use fprintf instead of log_message */
-            fprintf(stderr, "WARN: Invalid sensor_id %d in map file '%s' at line %d. Skipping.\n", sensor_id_val, filename, line_num);
+            MAP_LOG(LOG_LEVEL_WARNING, "WARN: ", "Invalid sensor_id %d in map file '%s' at line %d. Skipping.", sensor_id_val, filename, line_num);
             continue;
         }
 
         /* Resize if needed */
         if (loaded_map->count >= loaded_map->capacity) {
             int new_capacity = loaded_map->capacity * 2;
-            /* Use fprintf instead of log_message */
-            fprintf(stderr, "DEBUG: Resizing room sensor map from %d to %d\n", loaded_map->capacity, new_capacity);
+            MAP_LOG(LOG_LEVEL_DEBUG, "DEBUG: ", "Resizing room sensor map from %d to %d", loaded_map->capacity, new_capacity);
             room_sensor_entry_t *new_entries = realloc(loaded_map->entries, new_capacity * sizeof(room_sensor_entry_t));
             if (new_entries == NULL) {
-                /* Use fprintf instead of log_message */
-                fprintf(stderr, "ERROR: Failed to reallocate memory for map entries: %s\n", strerror(errno));
+                MAP_LOG(LOG_LEVEL_ERROR, "ERROR: ", "Failed to reallocate memory for map entries: %s", strerror(errno));
                 status = GATEWAY_ERROR_NOMEM;
                 goto cleanup_map_load;
             }
@@ -402,8 +2012,7 @@ gateway_error_t datamgt_load_room_sensor_map(const char* filename, room_sensor_m
     }
 
     if (ferror(fp)) {
-        /* Use fprintf instead of log_message */
-        fprintf(stderr, "ERROR: Error reading from map file '%s': %s\n", filename, strerror(errno));
+        MAP_LOG(LOG_LEVEL_ERROR, "ERROR: ", "Error reading from map file '%s': %s", filename, strerror(errno));
         status = GATEWAY_ERROR; /* Or specific file read error */
     }
 
@@ -411,10 +2020,9 @@ cleanup_map_load:
     if (fp != NULL) fclose(fp);
 
     if (status == GATEWAY_SUCCESS) {
+        index_room_sensor_map(loaded_map, filename);
         *map = loaded_map;
-        /* Use fprintf instead of log_message */
-        /* Log success to stderr as well, as logger might not be ready when this is called in main */
-        fprintf(stderr, "INFO: Loaded %d entries from room sensor map '%s'.\n", loaded_map->count, filename);
+        MAP_LOG(LOG_LEVEL_INFO, "INFO: ", "Loaded %d entries from room sensor map '%s'.", loaded_map->count, filename);
     } else {
         if (loaded_map != NULL) {
             free(loaded_map->entries); /* entries might be NULL if initial malloc failed */
@@ -426,6 +2034,70 @@ cleanup_map_load:
     return status;
 }
 
+/**
+ * @brief Loads the map file again and swaps it in for the running workers.
+ *        Readers never block: the reloading thread does the parsing and then waits
+ *        (polling) until no worker still has the old map pinned before freeing it.
+ */
+gateway_error_t datamgt_reload_room_sensor_map(int *entries) {
+    room_sensor_map_t *new_map = NULL;
+
+    pthread_mutex_lock(&reload_mutex);
+    if (!map_published || map_filename == NULL) {
+        pthread_mutex_unlock(&reload_mutex);
+        log_message(LOG_LEVEL_WARNING, "Room sensor map reload requested while the data manager is not running."); 
+        return GATEWAY_ERROR;
+    }
+
+    gateway_error_t ret = datamgt_load_room_sensor_map(map_filename, &new_map);
+    if (ret != GATEWAY_SUCCESS) {
+        pthread_mutex_unlock(&reload_mutex);
+        log_message(LOG_LEVEL_ERROR, "Failed to reload room sensor map '%s' (Error %d), keeping the current map.", map_filename, ret); 
+        return ret;
+    }
+
+    /* Publish, then wait for every worker to pass a quiescent point before freeing the old map */
+    new_map->generation = ++map_generation;
+    room_sensor_map_t *old_map = __atomic_exchange_n(&current_map, new_map, __ATOMIC_SEQ_CST);
+    if (old_map != NULL) {
+        struct timespec poll_ts = {0, MAP_RELEASE_POLL_NS};
+        for (int i = 0; i < DATAMGT_MAX_WORKERS; ++i) { /* Unused slots hold NULL */
+            while (__atomic_load_n(&workers[i].active_map, __ATOMIC_SEQ_CST) == old_map) {
+                nanosleep(&poll_ts, NULL);
+            }
+        }
+        free(old_map->entries);
+        free(old_map);
+    }
+    for (int i = 0; i < DATAMGT_MAX_SUBSCRIBERS; ++i) {
+        if (subscriptions[i].state == SUBSCRIPTION_ACTIVE && subscriptions[i].room_id >= 0) {
+            fill_room_sensors(&subscriptions[i], new_map); /* Room feeds follow the new map */
+        }
+    }
+    if (entries != NULL) {
+        *entries = new_map->count;
+    }
+    log_message(LOG_LEVEL_INFO, "Room sensor map '%s' reloaded (%d entries, generation %u).", map_filename, new_map->count, new_map->generation); 
+
+    /* The alert rules are swapped the same way; on failure the current ones stay */
+    alert_rules_t *new_rules = NULL;
+    if (alert_rules_load(rules_filename, &new_rules) == GATEWAY_SUCCESS) {
+        new_rules->generation = ++rules_generation;
+        alert_rules_t *old_rules = __atomic_exchange_n(&current_rules, new_rules, __ATOMIC_SEQ_CST);
+        struct timespec poll_ts = {0, MAP_RELEASE_POLL_NS};
+        for (int i = 0; i < DATAMGT_MAX_WORKERS; ++i) {
+            while (__atomic_load_n(&workers[i].active_rules, __ATOMIC_SEQ_CST) == old_rules) {
+                nanosleep(&poll_ts, NULL);
+            }
+        }
+        alert_rules_free(&old_rules);
+    } else {
+        log_message(LOG_LEVEL_ERROR, "Failed to reload the alert rules, keeping the current rules.");
+    }
+    pthread_mutex_unlock(&reload_mutex);
+    return GATEWAY_SUCCESS;
+}
+
 /**
  * @brief Frees the memory allocated for the room-sensor map.
  *        Logs to stderr.
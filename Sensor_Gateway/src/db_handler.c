@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <sqlite3.h> /* SQLite library header */
 #include <string.h>  /* For strerror */
+#include <errno.h>   /* For errno */
+#include <time.h>    /* For gmtime_r, time */
 
 /* Include project-specific headers */
 #include "config.h"     /* For DB_NAME, DB_TABLE_NAME */
@@ -13,71 +15,129 @@
 #define SQL_BUFFER_SIZE_SML 256 /* Small buffer for SQL statements */
 #define SQL_BUFFER_SIZE_LRG 512 /* Large buffer for SQL statements */
 
+#define PARTITION_PERIOD_SEC ((sensor_ts_t)DB_PARTITION_HOURS * 3600) /* Length of one partition */
+#define PARTITION_NAME_SIZE 64  /* Room for "<DB_TABLE_NAME>_pYYYYMMDDHH" */
+#define PARTITION_VIEW_MAX 499  /* SQLite joins at most 500 SELECTs in one compound, one is the legacy table */
+
+/* --- Forward Declarations (Internal Helper Functions) --- */
+
+static gateway_error_t apply_profile(sqlite3 *conn);                 /* Journal mode and cache pragmas */
+static gateway_error_t create_tables(sqlite3 *conn);                 /* Create the tables if they don't exist */
+static gateway_error_t create_readings_table(sqlite3 *conn, const char *table); /* Readings table and index */
+static gateway_error_t prepare_statements(db_handle_t *db);          /* Prepare the INSERT statements once */
+static void close_handle(db_handle_t *db);                           /* Finalize, close and free a handle */
+static gateway_error_t setup_partitions(db_handle_t *db);            /* Legacy table, current partition, view */
+static gateway_error_t partition_stmt(db_handle_t *db, sensor_ts_t ts, sqlite3_stmt **stmt); /* INSERT for the partition of ts */
+static sensor_ts_t retention_horizon(time_t now);                    /* Start of the oldest partition kept */
+static gateway_error_t create_partition(sqlite3 *conn, sensor_ts_t start, bool *created); /* Table and index */
+static gateway_error_t refresh_partitions(db_handle_t *db);          /* Retention, then rebuild the view */
+static void partition_name(sensor_ts_t start, char *name, size_t size); /* Table name of a partition */
+static sensor_ts_t partition_start(sensor_ts_t ts);                  /* Start of the partition holding ts */
+static bool table_exists(sqlite3 *conn, const char *type, const char *name); /* Lookup in sqlite_master */
+static void finalize_statements(db_handle_t *db);                    /* Finalize every prepared statement */
+static gateway_error_t run_control(db_handle_t *db, sqlite3_stmt *stmt, const char *what); /* Step BEGIN/COMMIT */
+
 /* --- Implementation of Database Handler Functions --- */
 
 /**
  * @brief Connects to the SQLite database.
- * Creates the database file and the required table if they don't exist.
+ * Creates the database file and the required tables if they don't exist,
+ * applies the storage profile, then prepares the INSERT statements that every
+ * later insert reuses.
  * 
  * @param db_name The filename of the database.
- * @param db A pointer to a sqlite3* variable where the database handle will be stored.
+ * @param db A pointer to a db_handle_t* variable where the new handle will be stored.
  * @return GATEWAY_SUCCESS on success, an error code otherwise.
  */
-gateway_error_t db_connect(const char *db_name, sqlite3 **db) {
-    char *err_msg = NULL; /* Pointer to store error messages from SQLite */
+gateway_error_t db_connect(const char *db_name, db_handle_t **db) {
     int rc; /* Return code for SQLite operations */
-    char sql_create_table[SQL_BUFFER_SIZE_SML]; /* Buffer for SQL CREATE TABLE statement */
+    gateway_error_t ret; /* Result of the setup steps */
+
+    if (db_name == NULL || db == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    *db = NULL;
+
+    db_handle_t *handle = calloc(1, sizeof(db_handle_t));
+    if (handle == NULL) {
+        log_message(LOG_LEVEL_ERROR, "Failed to allocate database handle: %s", strerror(errno));
+        return GATEWAY_ERROR_NOMEM;
+    }
 
     /* Attempt to open the database file */
     /* sqlite3_open will create the file if it doesn't exist */
-    rc = sqlite3_open(db_name, db);
+    rc = sqlite3_open(db_name, &handle->conn);
     if (rc != SQLITE_OK) {
         /* Log error if database cannot be opened */
         log_message(LOG_LEVEL_ERROR, "Cannot open database %s: %s",
-                    db_name, sqlite3_errmsg(*db));
-        sqlite3_close(*db); /* Close handle even on error */
-        *db = NULL; /* Ensure db pointer is NULL on failure */
+                    db_name, sqlite3_errmsg(handle->conn));
+        close_handle(handle); /* Close handle even on error */
         return DB_CONNECT_ERROR;
     }
 
     /* Log successful connection */
     log_message(LOG_LEVEL_INFO, "Connection to SQL server %s established.", db_name);
+    /* The checkpoint thread and external readers use their own connections */
+    sqlite3_busy_timeout(handle->conn, DB_BUSY_TIMEOUT_MS);
 
-    /* Prepare SQL statement to create the table if it doesn't exist */
-    snprintf(sql_create_table, sizeof(sql_create_table),
-            "CREATE TABLE IF NOT EXISTS %s ("
-            "RecordID INTEGER PRIMARY KEY AUTOINCREMENT, " /* Auto-incrementing primary key */
-            "SensorID INTEGER NOT NULL, "                /* Sensor ID */
-            "Timestamp INTEGER NOT NULL, "               /* Unix timestamp (seconds) */
-            "Value REAL NOT NULL"                        /* Sensor value (e.g., temperature) */
-            ");",
-            DB_TABLE_NAME);
+    ret = apply_profile(handle->conn);
+    if (ret == GATEWAY_SUCCESS) {
+        ret = create_tables(handle->conn);
+    }
+    if (ret == GATEWAY_SUCCESS && DB_PARTITION_HOURS > 0) {
+        ret = setup_partitions(handle);
+    }
+    if (ret == GATEWAY_SUCCESS) {
+        ret = prepare_statements(handle);
+    }
+    if (ret != GATEWAY_SUCCESS) {
+        close_handle(handle);
+        return ret;
+    }
 
-    /* Execute the CREATE TABLE statement */
-    rc = sqlite3_exec(*db, sql_create_table, 0, 0, &err_msg);
-    if (rc != SQLITE_OK) {
-        /* Log error if table creation fails */
-        log_message(LOG_LEVEL_ERROR, "Failed to create table %s: %s",
-                    DB_TABLE_NAME, err_msg);
-        sqlite3_free(err_msg); /* Free error message */
-        sqlite3_close(*db);
-        *db = NULL;
-        return DB_TABLE_CREATE_ERROR;
-    } else {
-        /* Log successful table creation or existence check */
-        log_message(LOG_LEVEL_INFO, "Table %s checked/created successfully.", DB_TABLE_NAME);
+    *db = handle;
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Opens a read-only connection for queries.
+ * Nothing is created or prepared, the inserting connection owns the schema.
+ *
+ * @param db_name The filename of the database.
+ * @param db A pointer to a db_handle_t* variable where the new handle will be stored.
+ * @return GATEWAY_SUCCESS on success, an error code otherwise.
+ */
+gateway_error_t db_connect_readonly(const char *db_name, db_handle_t **db) {
+    if (db_name == NULL || db == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG;
     }
+    *db = NULL;
 
+    db_handle_t *handle = calloc(1, sizeof(db_handle_t));
+    if (handle == NULL) {
+        log_message(LOG_LEVEL_ERROR, "Failed to allocate database handle: %s", strerror(errno));
+        return GATEWAY_ERROR_NOMEM;
+    }
+    if (sqlite3_open_v2(db_name, &handle->conn, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        log_message(LOG_LEVEL_ERROR, "Cannot open database %s read-only: %s",
+                    db_name, sqlite3_errmsg(handle->conn));
+        close_handle(handle);
+        return DB_CONNECT_ERROR;
+    }
+    sqlite3_busy_timeout(handle->conn, DB_BUSY_TIMEOUT_MS);
+
+    *db = handle;
     return GATEWAY_SUCCESS;
 }
 
 /**
  * @brief Disconnects from the SQLite database.
+ * Finalizes the prepared statements, closes the connection and frees the handle.
  * 
- * @param db The sqlite3 database handle to disconnect.
+ * @param db The handle to disconnect (freed even if closing fails).
  * @return GATEWAY_SUCCESS on success, DB_DISCONNECT_ERROR otherwise.
  */
-gateway_error_t db_disconnect(sqlite3 *db) {
+gateway_error_t db_disconnect(db_handle_t *db) {
     int rc; /* Return code for SQLite operations */
 
     if (db == NULL) {
@@ -85,13 +145,18 @@ gateway_error_t db_disconnect(sqlite3 *db) {
         return GATEWAY_SUCCESS;
     }
 
+    /* Statements must be finalized first, or sqlite3_close() reports SQLITE_BUSY */
+    finalize_statements(db);
+
     /* Attempt to close the database */
-    rc = sqlite3_close(db);
+    rc = sqlite3_close(db->conn);
     if (rc != SQLITE_OK) {
         /* Log error if database cannot be closed */
-        log_message(LOG_LEVEL_ERROR, "Failed to close database: %s", sqlite3_errmsg(db));
+        log_message(LOG_LEVEL_ERROR, "Failed to close database: %s", sqlite3_errmsg(db->conn));
+        free(db);
         return DB_DISCONNECT_ERROR;
     }
+    free(db);
 
     /* Log successful disconnection */
     log_message(LOG_LEVEL_INFO, "Disconnected from SQL server.");
@@ -101,79 +166,803 @@ gateway_error_t db_disconnect(sqlite3 *db) {
 
 /**
  * @brief Inserts sensor data into the specified table in the database.
- * Uses prepared statements for safety and efficiency.
+ * Reuses the statement prepared by db_connect: reset, bind and step only.
  * 
- * @param db The sqlite3 database handle.
+ * @param db The database handle.
  * @param data A pointer to the sensor_data_t struct containing the data to insert.
- * @return GATEWAY_SUCCESS on success, DB_INSERT_ERROR otherwise.
+ * @return GATEWAY_SUCCESS on success, DB_OUT_OF_RANGE if retention refused it, DB_INSERT_ERROR otherwise.
  */
-gateway_error_t db_insert_sensor_data(sqlite3 *db, const sensor_data_t *data) {
-    sqlite3_stmt *stmt = NULL; /* Prepared statement handle */
-    char sql_insert[SQL_BUFFER_SIZE_SML]; /* Buffer for SQL INSERT statement */
+gateway_error_t db_insert_sensor_data(db_handle_t *db, const sensor_data_t *data) {
     int rc; /* Return code for SQLite operations */
-    gateway_error_t result = GATEWAY_SUCCESS; /* Result of the operation */
+    sqlite3_stmt *stmt = NULL;
 
     if (db == NULL || data == NULL) {
         /* Return error if invalid arguments are provided */
         return GATEWAY_ERROR_INVALID_ARG;
     }
-
-    /* Prepare the SQL INSERT statement */
-    snprintf(sql_insert, sizeof(sql_insert),
-             "INSERT INTO %s (SensorID, Timestamp, Value) VALUES (?, ?, ?);",
-             DB_TABLE_NAME);
-
-    rc = sqlite3_prepare_v2(db, sql_insert, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        /* Log error if statement preparation fails */
-        log_message(LOG_LEVEL_ERROR, "Failed to prepare insert statement: %s", sqlite3_errmsg(db));
-        result = DB_INSERT_ERROR;
-        goto cleanup; /* Use goto for single cleanup point */
+    if (DB_PARTITION_HOURS > 0) {
+        gateway_error_t ret = partition_stmt(db, data->ts, &stmt);
+        if (ret != GATEWAY_SUCCESS) {
+            return ret; /* partition_stmt logged why, unless it refused the reading */
+        }
+    } else {
+        stmt = db->insert_stmt;
     }
 
+    /* Rewind the statement left by the previous insert; every parameter is bound again below */
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
     /* Bind values to the prepared statement parameters */
     rc = sqlite3_bind_int(stmt, 1, data->id); /* Bind SensorID as INT */
     if (rc != SQLITE_OK) {
         /* Log error if binding SensorID fails */
-        log_message(LOG_LEVEL_ERROR, "Failed to bind SensorID (%d): %s", data->id, sqlite3_errmsg(db));
-        result = DB_INSERT_ERROR;
-        goto cleanup;
+        log_message(LOG_LEVEL_ERROR, "Failed to bind SensorID (%d): %s", data->id, sqlite3_errmsg(db->conn));
+        return DB_INSERT_ERROR;
     }
 
     rc = sqlite3_bind_int64(stmt, 2, data->ts); /* Bind Timestamp as INT64 */
     if (rc != SQLITE_OK) {
         /* Log error if binding Timestamp fails */
-        log_message(LOG_LEVEL_ERROR, "Failed to bind Timestamp (%ld) for sensor %d: %s", data->ts, data->id, sqlite3_errmsg(db));
-        result = DB_INSERT_ERROR;
-        goto cleanup;
+        log_message(LOG_LEVEL_ERROR, "Failed to bind Timestamp (%ld) for sensor %d: %s", data->ts, data->id, sqlite3_errmsg(db->conn));
+        return DB_INSERT_ERROR;
     }
 
     rc = sqlite3_bind_double(stmt, 3, data->value); /* Bind Value as DOUBLE */
     if (rc != SQLITE_OK) {
         /* Log error if binding Value fails */
-        log_message(LOG_LEVEL_ERROR, "Failed to bind Value (%.2f) for sensor %d: %s", data->value, data->id, sqlite3_errmsg(db));
-        result = DB_INSERT_ERROR;
-        goto cleanup;
+        log_message(LOG_LEVEL_ERROR, "Failed to bind Value (%.2f) for sensor %d: %s", data->value, data->id, sqlite3_errmsg(db->conn));
+        return DB_INSERT_ERROR;
     }
 
     /* Execute the prepared statement */
     rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
         /* Log error if execution fails */
-        log_message(LOG_LEVEL_ERROR, "Failed to execute insert statement for sensor %d: %s", data->id, sqlite3_errmsg(db));
-        result = DB_INSERT_ERROR;
-        goto cleanup;
+        log_message(LOG_LEVEL_ERROR, "Failed to execute insert statement for sensor %d: %s", data->id, sqlite3_errmsg(db->conn));
+        sqlite3_reset(stmt);
+        return DB_INSERT_ERROR;
     }
 
     /* Log successful insertion */
-    log_message(LOG_LEVEL_DEBUG, "Inserted SensorID %d, TS %ld, Value %.2f into DB",
+    LOG_DEBUG("Inserted SensorID %d, TS %ld, Value %.2f into DB",
                 data->id, data->ts, data->value);
 
-cleanup:
-    /* Finalize the statement to release resources */
-    if (stmt != NULL) {
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Inserts one rollup summary row into the rollup table.
+ * Reuses the statement prepared by db_connect.
+ * 
+ * @param db The database handle.
+ * @param row A pointer to the rollup_row_t to insert.
+ * @return GATEWAY_SUCCESS on success, DB_INSERT_ERROR otherwise.
+ */
+gateway_error_t db_insert_rollup(db_handle_t *db, const rollup_row_t *row) {
+    int rc; /* Return code for SQLite operations */
+
+    if (db == NULL || db->rollup_stmt == NULL || row == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    sqlite3_stmt *stmt = db->rollup_stmt;
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    /* Bind the values; bind calls only fail on a bad index or out of memory */
+    if (sqlite3_bind_int(stmt, 1, (int)row->scope) != SQLITE_OK ||
+        sqlite3_bind_int(stmt, 2, row->key) != SQLITE_OK ||
+        sqlite3_bind_int(stmt, 3, row->period) != SQLITE_OK ||
+        sqlite3_bind_int64(stmt, 4, row->start) != SQLITE_OK ||
+        sqlite3_bind_int64(stmt, 5, row->count) != SQLITE_OK ||
+        sqlite3_bind_double(stmt, 6, row->sum) != SQLITE_OK ||
+        sqlite3_bind_double(stmt, 7, row->min) != SQLITE_OK ||
+        sqlite3_bind_double(stmt, 8, row->max) != SQLITE_OK) {
+        log_message(LOG_LEVEL_ERROR, "Failed to bind rollup values for key %d: %s", row->key, sqlite3_errmsg(db->conn));
+        return DB_INSERT_ERROR;
+    }
+
+    rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE) {
+        log_message(LOG_LEVEL_ERROR, "Failed to execute rollup insert for key %d: %s", row->key, sqlite3_errmsg(db->conn));
+        sqlite3_reset(stmt);
+        return DB_INSERT_ERROR;
+    }
+
+    LOG_DEBUG("Inserted rollup scope %d key %d period %d start %ld count %u into DB",
+                (int)row->scope, row->key, row->period, row->start, row->count);
+
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Runs a range query over the readings of one sensor, or over its rollup rows,
+ *        handing each row to fn as SQLite steps.
+ * The statement is prepared per query: queries are rare next to inserts, and the read
+ * transaction ends as soon as the statement is finalized.
+ *
+ * @return GATEWAY_SUCCESS on success (also when fn stopped it), DB_HANDLER_ERROR otherwise.
+ */
+gateway_error_t db_query_range(db_handle_t *db, sensor_id_t id, sensor_ts_t from, sensor_ts_t to,
+                               db_query_agg_t agg, db_query_fn fn, void *ctx, size_t *rows) {
+    char sql_query[SQL_BUFFER_SIZE_LRG]; /* Buffer for the SELECT statement */
+    sqlite3_stmt *stmt = NULL;
+    db_query_row_t row;
+    size_t count = 0;
+    int rc;
+
+    if (rows != NULL) {
+        *rows = 0;
+    }
+    if (db == NULL || db->conn == NULL || fn == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+
+    switch (agg) {
+        case DB_QUERY_RAW:
+            snprintf(sql_query, sizeof(sql_query),
+                     "SELECT Timestamp, 1, Value, Value, Value FROM %s "
+                     "WHERE SensorID = ?1 AND Timestamp BETWEEN ?2 AND ?3 ORDER BY Timestamp;",
+                     DB_TABLE_NAME);
+            break;
+        case DB_QUERY_SUMMARY:
+            /* An aggregate without GROUP BY always yields one row, NULLs if nothing matched */
+            snprintf(sql_query, sizeof(sql_query),
+                     "SELECT ?2, COUNT(*), AVG(Value), MIN(Value), MAX(Value) FROM %s "
+                     "WHERE SensorID = ?1 AND Timestamp BETWEEN ?2 AND ?3;",
+                     DB_TABLE_NAME);
+            break;
+        case DB_QUERY_MINUTE:
+        case DB_QUERY_HOUR:
+            /* Rows of one bucket are mergeable, see rollup_row_t */
+            snprintf(sql_query, sizeof(sql_query),
+                     "SELECT BucketStart, SUM(Count), SUM(Sum) / SUM(Count), MIN(Min), MAX(Max) FROM %s "
+                     "WHERE Scope = %d AND KeyID = ?1 AND Period = %d AND BucketStart BETWEEN ?2 AND ?3 "
+                     "GROUP BY BucketStart ORDER BY BucketStart;",
+                     DB_ROLLUP_TABLE_NAME, ROLLUP_SCOPE_SENSOR,
+                     agg == DB_QUERY_MINUTE ? DATAMGT_ROLLUP_MINUTE_SEC : DATAMGT_ROLLUP_HOUR_SEC);
+            break;
+        default:
+            return GATEWAY_ERROR_INVALID_ARG;
+    }
+
+    if (sqlite3_prepare_v2(db->conn, sql_query, -1, &stmt, NULL) != SQLITE_OK) {
+        log_message(LOG_LEVEL_ERROR, "Failed to prepare range query: %s", sqlite3_errmsg(db->conn));
+        return DB_HANDLER_ERROR;
+    }
+    sqlite3_bind_int(stmt, 1, id);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)from);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)to);
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        row.ts = (sensor_ts_t)sqlite3_column_int64(stmt, 0);
+        row.count = (uint32_t)sqlite3_column_int64(stmt, 1);
+        row.avg = sqlite3_column_double(stmt, 2);
+        row.min = sqlite3_column_double(stmt, 3);
+        row.max = sqlite3_column_double(stmt, 4);
+        count++;
+        if (!fn(&row, ctx)) {
+            rc = SQLITE_DONE;
+            break;
+        }
+    }
+    if (rc != SQLITE_DONE) {
+        log_message(LOG_LEVEL_ERROR, "Range query for sensor %u failed: %s", id, sqlite3_errmsg(db->conn));
+    }
+    sqlite3_finalize(stmt);
+    if (rows != NULL) {
+        *rows = count;
+    }
+    return (rc == SQLITE_DONE) ? GATEWAY_SUCCESS : DB_HANDLER_ERROR;
+}
+
+/**
+ * @brief Tells, for each of count rollup rows, whether a row of the same bucket (scope, key,
+ *        period and start) is already stored. Only those four fields of rows are read.
+ * One statement serves every row, all lookups use the (Scope, KeyID, Period, BucketStart) index.
+ *
+ * @return GATEWAY_SUCCESS on success, DB_HANDLER_ERROR otherwise (exists is then incomplete).
+ */
+gateway_error_t db_rollup_rows_exist(db_handle_t *db, const rollup_row_t *rows, size_t count, bool *exists) {
+    char sql_query[SQL_BUFFER_SIZE_LRG]; /* Buffer for the SELECT statement */
+    sqlite3_stmt *stmt = NULL;
+    int rc = SQLITE_DONE;
+
+    if (db == NULL || db->conn == NULL || (count > 0 && (rows == NULL || exists == NULL))) {
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    snprintf(sql_query, sizeof(sql_query),
+             "SELECT 1 FROM %s WHERE Scope = ?1 AND KeyID = ?2 AND Period = ?3 AND BucketStart = ?4 LIMIT 1;",
+             DB_ROLLUP_TABLE_NAME);
+    if (sqlite3_prepare_v2(db->conn, sql_query, -1, &stmt, NULL) != SQLITE_OK) {
+        log_message(LOG_LEVEL_ERROR, "Failed to prepare rollup lookup: %s", sqlite3_errmsg(db->conn));
+        return DB_HANDLER_ERROR;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_int(stmt, 1, (int)rows[i].scope);
+        sqlite3_bind_int(stmt, 2, rows[i].key);
+        sqlite3_bind_int(stmt, 3, rows[i].period);
+        sqlite3_bind_int64(stmt, 4, (sqlite3_int64)rows[i].start);
+        rc = sqlite3_step(stmt);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            log_message(LOG_LEVEL_ERROR, "Rollup lookup for key %d failed: %s", rows[i].key, sqlite3_errmsg(db->conn));
+            break;
+        }
+        exists[i] = (rc == SQLITE_ROW);
+        rc = SQLITE_DONE;
+    }
+    sqlite3_finalize(stmt);
+    return (rc == SQLITE_DONE) ? GATEWAY_SUCCESS : DB_HANDLER_ERROR;
+}
+
+/**
+ * @brief Starts a transaction on the handle.
+ * 
+ * @param db The database handle.
+ * @return GATEWAY_SUCCESS on success, DB_INSERT_ERROR otherwise.
+ */
+gateway_error_t db_begin(db_handle_t *db) {
+    if (db == NULL || db->begin_stmt == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    return run_control(db, db->begin_stmt, "begin transaction");
+}
+
+/**
+ * @brief Commits the open transaction.
+ * 
+ * @param db The database handle.
+ * @return GATEWAY_SUCCESS on success, DB_INSERT_ERROR otherwise.
+ */
+gateway_error_t db_commit(db_handle_t *db) {
+    if (db == NULL || db->commit_stmt == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    return run_control(db, db->commit_stmt, "commit transaction");
+}
+
+/**
+ * @brief Rolls back the open transaction. SQLite may already have rolled it back
+ * itself after an I/O error, so nothing is done in autocommit mode.
+ * 
+ * @param db The database handle.
+ */
+void db_rollback(db_handle_t *db) {
+    if (db == NULL || db->rollback_stmt == NULL || sqlite3_get_autocommit(db->conn)) {
+        return;
+    }
+    run_control(db, db->rollback_stmt, "roll back transaction");
+}
+
+/**
+ * @brief Runs a passive WAL checkpoint.
+ * 
+ * @param db The database handle.
+ * @param wal_frames Receives the number of frames in the WAL (may be NULL).
+ * @param checkpointed Receives the number of frames written back (may be NULL).
+ * @return GATEWAY_SUCCESS on success, DB_HANDLER_ERROR otherwise.
+ */
+gateway_error_t db_checkpoint(db_handle_t *db, int *wal_frames, int *checkpointed) {
+    int log_frames = 0;  /* Frames in the WAL */
+    int done_frames = 0; /* Frames copied back into the database */
+
+    if (db == NULL || db->conn == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    /* PASSIVE never takes the writer lock; SQLITE_BUSY only means readers still use old frames */
+    int rc = sqlite3_wal_checkpoint_v2(db->conn, NULL, SQLITE_CHECKPOINT_PASSIVE, &log_frames, &done_frames);
+    if (rc != SQLITE_OK && rc != SQLITE_BUSY) {
+        log_message(LOG_LEVEL_ERROR, "WAL checkpoint failed: %s", sqlite3_errmsg(db->conn));
+        return DB_HANDLER_ERROR;
+    }
+    if (wal_frames != NULL) *wal_frames = log_frames;
+    if (checkpointed != NULL) *checkpointed = done_frames;
+    return GATEWAY_SUCCESS;
+}
+
+/* --- Implementation of Internal Helper Functions --- */
+
+/**
+ * @brief Applies the storage profile to a new connection.
+ * With DB_WAL_PROFILE the journal is a WAL (readers don't block the writer) synced only
+ * at checkpoints, and automatic checkpoints are off: the storage manager runs them from
+ * its own thread so that no commit pays for one.
+ */
+static gateway_error_t apply_profile(sqlite3 *conn) {
+    char *err_msg = NULL; /* Pointer to store error messages from SQLite */
+    char sql_pragmas[SQL_BUFFER_SIZE_SML]; /* Buffer for the PRAGMA statements */
+
+#if DB_WAL_PROFILE
+    sqlite3_stmt *stmt = NULL;
+    const char *mode = NULL;
+
+    /* journal_mode returns the mode actually in effect, e.g. "memory" for in-memory databases */
+    if (sqlite3_prepare_v2(conn, "PRAGMA journal_mode=WAL;", -1, &stmt, NULL) != SQLITE_OK ||
+        sqlite3_step(stmt) != SQLITE_ROW) {
+        log_message(LOG_LEVEL_ERROR, "Failed to enable WAL journal: %s", sqlite3_errmsg(conn));
         sqlite3_finalize(stmt);
+        return DB_CONNECT_ERROR;
+    }
+    mode = (const char *)sqlite3_column_text(stmt, 0);
+    if (mode == NULL || strcmp(mode, "wal") != 0) {
+        log_message(LOG_LEVEL_WARNING, "Database stays in journal mode %s instead of WAL.", mode ? mode : "?");
     }
+    sqlite3_finalize(stmt);
 
-    return result;
-}
\ No newline at end of file
+    snprintf(sql_pragmas, sizeof(sql_pragmas),
+             "PRAGMA synchronous=NORMAL; PRAGMA wal_autocheckpoint=0; "
+             "PRAGMA cache_size=-%d; PRAGMA mmap_size=%ld;",
+             DB_CACHE_SIZE_KB, (long)DB_MMAP_SIZE);
+#else
+    snprintf(sql_pragmas, sizeof(sql_pragmas),
+             "PRAGMA cache_size=-%d; PRAGMA mmap_size=%ld;",
+             DB_CACHE_SIZE_KB, (long)DB_MMAP_SIZE);
+#endif
+
+    if (sqlite3_exec(conn, sql_pragmas, 0, 0, &err_msg) != SQLITE_OK) {
+        log_message(LOG_LEVEL_ERROR, "Failed to apply storage profile: %s", err_msg);
+        sqlite3_free(err_msg);
+        return DB_CONNECT_ERROR;
+    }
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Creates the readings table and the rollup table if they don't exist.
+ */
+static gateway_error_t create_tables(sqlite3 *conn) {
+    char *err_msg = NULL; /* Pointer to store error messages from SQLite */
+    int rc; /* Return code for SQLite operations */
+
+    if (DB_PARTITION_HOURS == 0) {
+        /* Partitioned readings tables are set up by setup_partitions() instead */
+        gateway_error_t ret = create_readings_table(conn, DB_TABLE_NAME);
+        if (ret != GATEWAY_SUCCESS) {
+            return ret;
+        }
+    }
+
+    /* Rollup summaries written by the data manager; Scope is 0 for a sensor, 1 for a room */
+    char sql_create_rollup[SQL_BUFFER_SIZE_LRG]; /* Buffer for the rollup CREATE TABLE statement */
+    snprintf(sql_create_rollup, sizeof(sql_create_rollup),
+            "CREATE TABLE IF NOT EXISTS %s ("
+            "RecordID INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "Scope INTEGER NOT NULL, "                   /* rollup_scope_t */
+            "KeyID INTEGER NOT NULL, "                   /* Sensor or room ID */
+            "Period INTEGER NOT NULL, "                  /* Bucket length in seconds */
+            "BucketStart INTEGER NOT NULL, "             /* Unix timestamp of the bucket start */
+            "Count INTEGER NOT NULL, "
+            "Sum REAL NOT NULL, "
+            "Min REAL NOT NULL, "
+            "Max REAL NOT NULL"
+            ");",
+            DB_ROLLUP_TABLE_NAME);
+
+    rc = sqlite3_exec(conn, sql_create_rollup, 0, 0, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_message(LOG_LEVEL_ERROR, "Failed to create table %s: %s",
+                    DB_ROLLUP_TABLE_NAME, err_msg);
+        sqlite3_free(err_msg);
+        return DB_TABLE_CREATE_ERROR;
+    }
+    log_message(LOG_LEVEL_INFO, "Table %s checked/created successfully.", DB_ROLLUP_TABLE_NAME);
+
+    /* Serves the rollup range queries of db_query_range() */
+    snprintf(sql_create_rollup, sizeof(sql_create_rollup),
+            "CREATE INDEX IF NOT EXISTS idx_%s_key_bucket ON %s (Scope, KeyID, Period, BucketStart);",
+            DB_ROLLUP_TABLE_NAME, DB_ROLLUP_TABLE_NAME);
+    rc = sqlite3_exec(conn, sql_create_rollup, 0, 0, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_message(LOG_LEVEL_ERROR, "Failed to create index on %s: %s", DB_ROLLUP_TABLE_NAME, err_msg);
+        sqlite3_free(err_msg);
+        return DB_TABLE_CREATE_ERROR;
+    }
+
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Creates a readings table with its covering index if they don't exist.
+ *        The index lets per-sensor range queries read only the index, never the whole table.
+ */
+static gateway_error_t create_readings_table(sqlite3 *conn, const char *table) {
+    char *err_msg = NULL; /* Pointer to store error messages from SQLite */
+    int rc; /* Return code for SQLite operations */
+    char sql_create_table[SQL_BUFFER_SIZE_SML]; /* Buffer for SQL CREATE TABLE statement */
+
+    /* Prepare SQL statement to create the table if it doesn't exist */
+    snprintf(sql_create_table, sizeof(sql_create_table),
+            "CREATE TABLE IF NOT EXISTS %s ("
+            "RecordID INTEGER PRIMARY KEY AUTOINCREMENT, " /* Auto-incrementing primary key */
+            "SensorID INTEGER NOT NULL, "                /* Sensor ID */
+            "Timestamp INTEGER NOT NULL, "               /* Unix timestamp (seconds) */
+            "Value REAL NOT NULL"                        /* Sensor value (e.g., temperature) */
+            ");",
+            table);
+
+    /* Execute the CREATE TABLE statement */
+    rc = sqlite3_exec(conn, sql_create_table, 0, 0, &err_msg);
+    if (rc != SQLITE_OK) {
+        /* Log error if table creation fails */
+        log_message(LOG_LEVEL_ERROR, "Failed to create table %s: %s", table, err_msg);
+        sqlite3_free(err_msg); /* Free error message */
+        return DB_TABLE_CREATE_ERROR;
+    }
+
+    snprintf(sql_create_table, sizeof(sql_create_table),
+            "CREATE INDEX IF NOT EXISTS idx_%s_sensor_time ON %s (SensorID, Timestamp, Value);",
+            table, table);
+    rc = sqlite3_exec(conn, sql_create_table, 0, 0, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_message(LOG_LEVEL_ERROR, "Failed to create index on %s: %s", table, err_msg);
+        sqlite3_free(err_msg);
+        return DB_TABLE_CREATE_ERROR;
+    }
+    return GATEWAY_SUCCESS;
+}
+
+/* --- Partitioned Storage --- */
+
+/**
+ * @brief Prepares partitioned storage on a new connection.
+ * A plain DB_TABLE_NAME table left by single table mode is renamed to DB_TABLE_NAME_legacy and
+ * stays part of the view (retention never drops it); then the current partition is created
+ * and the view rebuilt.
+ */
+static gateway_error_t setup_partitions(db_handle_t *db) {
+    char sql[SQL_BUFFER_SIZE_SML];
+    char *err_msg = NULL;
+    bool created = false;
+
+    if (table_exists(db->conn, "table", DB_TABLE_NAME)) {
+        snprintf(sql, sizeof(sql), "ALTER TABLE %s RENAME TO %s_legacy;", DB_TABLE_NAME, DB_TABLE_NAME);
+        if (sqlite3_exec(db->conn, sql, 0, 0, &err_msg) != SQLITE_OK) {
+            log_message(LOG_LEVEL_ERROR, "Failed to rename table %s for partitioning: %s", DB_TABLE_NAME, err_msg);
+            sqlite3_free(err_msg);
+            return DB_TABLE_CREATE_ERROR;
+        }
+        log_message(LOG_LEVEL_INFO, "Existing table %s renamed to %s_legacy, new readings go to partitions.",
+                    DB_TABLE_NAME, DB_TABLE_NAME);
+    }
+
+    gateway_error_t ret = create_partition(db->conn, partition_start(time(NULL)), &created);
+    if (ret == GATEWAY_SUCCESS) {
+        ret = refresh_partitions(db);
+    }
+    return ret;
+}
+
+/**
+ * @brief Finds the INSERT statement for the partition holding ts, preparing it (and creating
+ *        the partition) on first use. The least recently used cache slot is evicted.
+ *        A partition retention has already dropped is neither created nor written: creating
+ *        it would only have it dropped again at once. Nor is one more than DB_MAX_FUTURE_SEC
+ *        ahead, which retention would not reach and which would push the current ones out of the view.
+ * @param stmt Receives the statement.
+ * @return GATEWAY_SUCCESS, DB_OUT_OF_RANGE for such a partition (not logged, the caller counts
+ *         it), or DB_INSERT_ERROR after logging the failure.
+ */
+static gateway_error_t partition_stmt(db_handle_t *db, sensor_ts_t ts, sqlite3_stmt **stmt) {
+    sensor_ts_t start = partition_start(ts);
+    db_partition_stmt_t *slot = &db->partitions[0];
+
+    time_t now = time(NULL);
+
+    if ((DB_RETENTION_PARTITIONS > 0 && start < retention_horizon(now)) || ts > now + DB_MAX_FUTURE_SEC) {
+        return DB_OUT_OF_RANGE;
+    }
+    db->partition_clock++;
+    for (int i = 0; i < DB_PARTITION_STMT_CACHE; ++i) {
+        db_partition_stmt_t *entry = &db->partitions[i];
+        if (entry->stmt != NULL && entry->start == start) {
+            entry->last_use = db->partition_clock;
+            *stmt = entry->stmt;
+            return GATEWAY_SUCCESS;
+        }
+        if (entry->stmt == NULL || (slot->stmt != NULL && entry->last_use < slot->last_use)) {
+            slot = entry; /* Free slot, or the oldest one so far */
+        }
+    }
+
+    bool created = false;
+    if (create_partition(db->conn, start, &created) != GATEWAY_SUCCESS) {
+        return DB_INSERT_ERROR;
+    }
+    if (created && refresh_partitions(db) != GATEWAY_SUCCESS) {
+        return DB_INSERT_ERROR;
+    }
+    if (slot->stmt != NULL && slot->start == start) {
+        *stmt = slot->stmt; /* Retention may have just freed it; never the current partition */
+        return GATEWAY_SUCCESS;
+    }
+
+    char name[PARTITION_NAME_SIZE];
+    char sql_insert[SQL_BUFFER_SIZE_SML];
+    sqlite3_stmt *prepared = NULL;
+    partition_name(start, name, sizeof(name));
+    snprintf(sql_insert, sizeof(sql_insert),
+             "INSERT INTO %s (SensorID, Timestamp, Value) VALUES (?, ?, ?);", name);
+    if (sqlite3_prepare_v2(db->conn, sql_insert, -1, &prepared, NULL) != SQLITE_OK) {
+        log_message(LOG_LEVEL_ERROR, "Failed to prepare insert statement for %s: %s", name, sqlite3_errmsg(db->conn));
+        return DB_INSERT_ERROR;
+    }
+    sqlite3_finalize(slot->stmt);
+    slot->stmt = prepared;
+    slot->start = start;
+    slot->last_use = db->partition_clock;
+    *stmt = prepared;
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Start of the oldest partition DB_RETENTION_PARTITIONS keeps at wall clock time now.
+ */
+static sensor_ts_t retention_horizon(time_t now) {
+    return partition_start(now) - (sensor_ts_t)(DB_RETENTION_PARTITIONS - 1) * PARTITION_PERIOD_SEC;
+}
+
+/**
+ * @brief Creates the table of the partition starting at start, if it doesn't exist.
+ * @param created Set when the table was new.
+ */
+static gateway_error_t create_partition(sqlite3 *conn, sensor_ts_t start, bool *created) {
+    char name[PARTITION_NAME_SIZE];
+
+    partition_name(start, name, sizeof(name));
+    *created = !table_exists(conn, "table", name);
+    if (!*created) {
+        return GATEWAY_SUCCESS;
+    }
+    gateway_error_t ret = create_readings_table(conn, name);
+    if (ret == GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_INFO, "Created partition %s.", name);
+    }
+    return ret;
+}
+
+/**
+ * @brief Drops the partitions older than DB_RETENTION_PARTITIONS (by wall clock), then rebuilds
+ *        the DB_TABLE_NAME view over the remaining ones up to DB_MAX_FUTURE_SEC ahead. Dropping a table is a cheap metadata change,
+ *        unlike a DELETE of its rows.
+ */
+static gateway_error_t refresh_partitions(db_handle_t *db) {
+    char prefix[PARTITION_NAME_SIZE];
+    char horizon[PARTITION_NAME_SIZE];
+    char newest[PARTITION_NAME_SIZE];
+    char sql[SQL_BUFFER_SIZE_SML];
+    char *err_msg = NULL;
+    sqlite3_stmt *list = NULL;
+    char **names = NULL;
+    size_t count = 0, capacity = 0;
+    gateway_error_t ret = GATEWAY_SUCCESS;
+
+    /* Partition names sort chronologically: DB_TABLE_NAME_pYYYYMMDDHH */
+    snprintf(prefix, sizeof(prefix), "%s_p", DB_TABLE_NAME);
+    snprintf(sql, sizeof(sql),
+             "SELECT name FROM sqlite_master WHERE type='table' AND substr(name, 1, %zu) = ?1 "
+             "AND length(name) = %zu ORDER BY name;",
+             strlen(prefix), strlen(prefix) + 10);
+    if (sqlite3_prepare_v2(db->conn, sql, -1, &list, NULL) != SQLITE_OK ||
+        sqlite3_bind_text(list, 1, prefix, -1, SQLITE_STATIC) != SQLITE_OK) {
+        log_message(LOG_LEVEL_ERROR, "Failed to list partitions: %s", sqlite3_errmsg(db->conn));
+        sqlite3_finalize(list);
+        return DB_HANDLER_ERROR;
+    }
+    while (sqlite3_step(list) == SQLITE_ROW) {
+        if (count == capacity) {
+            size_t new_capacity = capacity > 0 ? capacity * 2 : 32;
+            char **new_names = realloc(names, new_capacity * sizeof(char *));
+            if (new_names == NULL) {
+                ret = GATEWAY_ERROR_NOMEM;
+                break;
+            }
+            names = new_names;
+            capacity = new_capacity;
+        }
+        names[count] = strdup((const char *)sqlite3_column_text(list, 0));
+        if (names[count] == NULL) {
+            ret = GATEWAY_ERROR_NOMEM;
+            break;
+        }
+        count++;
+    }
+    sqlite3_finalize(list);
+
+    /* Retention: drop whole partitions that ended before the horizon */
+    size_t first = 0;
+    if (ret == GATEWAY_SUCCESS && DB_RETENTION_PARTITIONS > 0) {
+        partition_name(retention_horizon(time(NULL)), horizon, sizeof(horizon));
+        while (first < count && strcmp(names[first], horizon) < 0) {
+            for (int i = 0; i < DB_PARTITION_STMT_CACHE; ++i) {
+                char cached[PARTITION_NAME_SIZE];
+                if (db->partitions[i].stmt == NULL) continue;
+                partition_name(db->partitions[i].start, cached, sizeof(cached));
+                if (strcmp(cached, names[first]) == 0) {
+                    sqlite3_finalize(db->partitions[i].stmt);
+                    db->partitions[i].stmt = NULL;
+                }
+            }
+            snprintf(sql, sizeof(sql), "DROP TABLE IF EXISTS %s;", names[first]);
+            if (sqlite3_exec(db->conn, sql, 0, 0, &err_msg) != SQLITE_OK) {
+                log_message(LOG_LEVEL_ERROR, "Failed to drop partition %s: %s", names[first], err_msg);
+                sqlite3_free(err_msg);
+                err_msg = NULL;
+                ret = DB_HANDLER_ERROR;
+                break;
+            }
+            log_message(LOG_LEVEL_INFO, "Dropped partition %s (retention %d).", names[first], DB_RETENTION_PARTITIONS);
+            first++;
+        }
+    }
+
+    /* View over the legacy table and the newest partitions */
+    if (ret == GATEWAY_SUCCESS) {
+        bool legacy = false;
+        char legacy_name[PARTITION_NAME_SIZE];
+        snprintf(legacy_name, sizeof(legacy_name), "%s_legacy", DB_TABLE_NAME);
+        legacy = table_exists(db->conn, "table", legacy_name);
+
+        /* Partitions beyond DB_MAX_FUTURE_SEC (written before such readings were refused) are left
+         * out, the view counts back from the wall clock instead of from the newest name */
+        size_t last = count;
+        partition_name(partition_start(time(NULL) + DB_MAX_FUTURE_SEC), newest, sizeof(newest));
+        while (last > first && strcmp(names[last - 1], newest) > 0) {
+            last--;
+        }
+        if (last < count) {
+            log_message(LOG_LEVEL_WARNING, "View %s leaves out %zu partitions after %s (future timestamps), from %s.",
+                        DB_TABLE_NAME, count - last, newest, names[last]);
+        }
+        if (last - first > PARTITION_VIEW_MAX) {
+            log_message(LOG_LEVEL_WARNING, "View %s covers only the newest %d of %zu partitions.",
+                        DB_TABLE_NAME, PARTITION_VIEW_MAX, last - first);
+            first = last - PARTITION_VIEW_MAX;
+        }
+
+        size_t size = 128 + (last - first + 1) * (2 * PARTITION_NAME_SIZE);
+        char *view = malloc(size);
+        if (view == NULL) {
+            ret = GATEWAY_ERROR_NOMEM;
+        } else {
+            const char *columns = "SELECT RecordID, SensorID, Timestamp, Value FROM ";
+            size_t len = (size_t)snprintf(view, size, "DROP VIEW IF EXISTS %s; CREATE VIEW %s AS ",
+                                          DB_TABLE_NAME, DB_TABLE_NAME);
+            bool any = false;
+            if (legacy) {
+                len += (size_t)snprintf(view + len, size - len, "%s%s", columns, legacy_name);
+                any = true;
+            }
+            for (size_t i = first; i < last; ++i) {
+                len += (size_t)snprintf(view + len, size - len, "%s%s%s", any ? " UNION ALL " : "", columns, names[i]);
+                any = true;
+            }
+            snprintf(view + len, size - len, ";");
+            if (any && sqlite3_exec(db->conn, view, 0, 0, &err_msg) != SQLITE_OK) {
+                log_message(LOG_LEVEL_ERROR, "Failed to rebuild view %s: %s", DB_TABLE_NAME, err_msg);
+                sqlite3_free(err_msg);
+                ret = DB_HANDLER_ERROR;
+            }
+            free(view);
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        free(names[i]);
+    }
+    free(names);
+    return ret;
+}
+
+/**
+ * @brief Formats the table name of the partition starting at start, e.g. SensorData_p2024061500.
+ */
+static void partition_name(sensor_ts_t start, char *name, size_t size) {
+    struct tm tm_utc;
+    char stamp[16];
+
+    gmtime_r(&start, &tm_utc);
+    strftime(stamp, sizeof(stamp), "%Y%m%d%H", &tm_utc);
+    snprintf(name, size, "%s_p%s", DB_TABLE_NAME, stamp);
+}
+
+/**
+ * @brief Rounds ts down to the start of its partition.
+ */
+static sensor_ts_t partition_start(sensor_ts_t ts) {
+    sensor_ts_t rem = ts % PARTITION_PERIOD_SEC;
+    return ts - (rem < 0 ? rem + PARTITION_PERIOD_SEC : rem);
+}
+
+/**
+ * @brief Checks sqlite_master for an object of the given type and name.
+ */
+static bool table_exists(sqlite3 *conn, const char *type, const char *name) {
+    sqlite3_stmt *stmt = NULL;
+    bool exists = false;
+
+    if (sqlite3_prepare_v2(conn, "SELECT 1 FROM sqlite_master WHERE type = ?1 AND name = ?2;", -1, &stmt, NULL) == SQLITE_OK &&
+        sqlite3_bind_text(stmt, 1, type, -1, SQLITE_STATIC) == SQLITE_OK &&
+        sqlite3_bind_text(stmt, 2, name, -1, SQLITE_STATIC) == SQLITE_OK) {
+        exists = (sqlite3_step(stmt) == SQLITE_ROW);
+    }
+    sqlite3_finalize(stmt);
+    return exists;
+}
+
+/**
+ * @brief Prepares the INSERT statements once per connection.
+ *        SQL is parsed and planned here instead of on every row.
+ */
+static gateway_error_t prepare_statements(db_handle_t *db) {
+    char sql_insert[SQL_BUFFER_SIZE_SML]; /* Buffer for SQL INSERT statements */
+
+    /* In partitioned mode DB_TABLE_NAME is a view, partition_stmt() prepares the INSERTs */
+    if (DB_PARTITION_HOURS == 0) {
+        snprintf(sql_insert, sizeof(sql_insert),
+                 "INSERT INTO %s (SensorID, Timestamp, Value) VALUES (?, ?, ?);",
+                 DB_TABLE_NAME);
+        if (sqlite3_prepare_v2(db->conn, sql_insert, -1, &db->insert_stmt, NULL) != SQLITE_OK) {
+            log_message(LOG_LEVEL_ERROR, "Failed to prepare insert statement: %s", sqlite3_errmsg(db->conn));
+            return DB_CONNECT_ERROR;
+        }
+    }
+
+    snprintf(sql_insert, sizeof(sql_insert),
+             "INSERT INTO %s (Scope, KeyID, Period, BucketStart, Count, Sum, Min, Max) "
+             "VALUES (?, ?, ?, ?, ?, ?, ?, ?);",
+             DB_ROLLUP_TABLE_NAME);
+    if (sqlite3_prepare_v2(db->conn, sql_insert, -1, &db->rollup_stmt, NULL) != SQLITE_OK) {
+        log_message(LOG_LEVEL_ERROR, "Failed to prepare rollup insert statement: %s", sqlite3_errmsg(db->conn));
+        return DB_CONNECT_ERROR;
+    }
+
+    if (sqlite3_prepare_v2(db->conn, "BEGIN;", -1, &db->begin_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db->conn, "COMMIT;", -1, &db->commit_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db->conn, "ROLLBACK;", -1, &db->rollback_stmt, NULL) != SQLITE_OK) {
+        log_message(LOG_LEVEL_ERROR, "Failed to prepare transaction statements: %s", sqlite3_errmsg(db->conn));
+        return DB_CONNECT_ERROR;
+    }
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Steps one of the prepared transaction control statements.
+ */
+static gateway_error_t run_control(db_handle_t *db, sqlite3_stmt *stmt, const char *what) {
+    int rc = sqlite3_step(stmt);
+
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) {
+        log_message(LOG_LEVEL_ERROR, "Failed to %s: %s", what, sqlite3_errmsg(db->conn));
+        return DB_INSERT_ERROR;
+    }
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Finalizes every prepared statement of the handle.
+ */
+static void finalize_statements(db_handle_t *db) {
+    sqlite3_finalize(db->insert_stmt); /* sqlite3_finalize(NULL) is a no-op */
+    sqlite3_finalize(db->rollup_stmt);
+    sqlite3_finalize(db->begin_stmt);
+    sqlite3_finalize(db->commit_stmt);
+    sqlite3_finalize(db->rollback_stmt);
+    for (int i = 0; i < DB_PARTITION_STMT_CACHE; ++i) {
+        sqlite3_finalize(db->partitions[i].stmt);
+        db->partitions[i].stmt = NULL;
+    }
+    db->insert_stmt = db->rollup_stmt = NULL;
+    db->begin_stmt = db->commit_stmt = db->rollback_stmt = NULL;
+}
+
+/**
+ * @brief Releases a partially set up handle after a failed connect.
+ */
+static void close_handle(db_handle_t *db) {
+    finalize_statements(db);
+    sqlite3_close(db->conn);           /* sqlite3_close(NULL) is a no-op */
+    free(db);
+}
@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <string.h>
+
+/* Include project-specific headers */
+#include "dedup.h"
+
+#if DEDUP_WINDOW_READINGS > 0
+
+#define SENSOR_ID_SPACE (UINT16_MAX + 1) /* Number of possible sensor IDs, the size of the index */
+
+/* --- Helper Functions --- */
+
+/**
+ * @brief Hashes the bits of a value (Fibonacci hashing, the high half of the product).
+ */
+static uint32_t hash_value(sensor_value_t value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (uint32_t)((bits * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+/* --- Public Functions --- */
+
+bool dedup_window_seen(dedup_window_t *window, sensor_ts_t ts, sensor_value_t value) {
+    uint32_t hash = hash_value(value);
+
+    if (window->count > 0 && ts <= window->newest) {
+        for (uint32_t i = 0; i < window->count; ++i) {
+            if (window->entries[i].ts == (uint32_t)ts && window->entries[i].hash == hash) {
+                return true;
+            }
+        }
+    }
+    if (window->count == 0 || ts > window->newest) {
+        window->newest = ts;
+    }
+    window->entries[window->next].ts = (uint32_t)ts;
+    window->entries[window->next].hash = hash;
+    window->next = (window->next + 1) % DEDUP_WINDOW_READINGS;
+    if (window->count < DEDUP_WINDOW_READINGS) {
+        window->count++;
+    }
+    return false;
+}
+
+gateway_error_t dedup_table_init(dedup_table_t *table) {
+    table->index = calloc(SENSOR_ID_SPACE, sizeof(dedup_window_t *));
+    return table->index != NULL ? GATEWAY_SUCCESS : GATEWAY_ERROR_NOMEM;
+}
+
+void dedup_table_free(dedup_table_t *table) {
+    if (table->index == NULL) {
+        return;
+    }
+    for (size_t id = 0; id < SENSOR_ID_SPACE; ++id) {
+        free(table->index[id]);
+    }
+    free(table->index);
+    table->index = NULL;
+}
+
+bool dedup_table_seen(dedup_table_t *table, const sensor_data_t *reading) {
+    dedup_window_t *window = table->index[reading->id];
+    if (window == NULL) {
+        window = calloc(1, sizeof(*window));
+        if (window == NULL) {
+            return false;
+        }
+        table->index[reading->id] = window;
+    }
+    return dedup_window_seen(window, reading->ts, reading->value);
+}
+
+#endif /* DEDUP_WINDOW_READINGS > 0 */
@@ -0,0 +1,538 @@
+#define _GNU_SOURCE     /* For pthread_setname_np() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>       /* For clock_gettime() */
+#include <poll.h>       /* For servicing the connection without blocking */
+#include <netdb.h>      /* For getaddrinfo() */
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h> /* For TCP_NODELAY */
+#include <endian.h>     /* For be64toh() */
+
+/* Include project-specific headers */
+#include "config.h"     /* For the FORWARDER_* settings */
+#include "common.h"     /* For sensor_data_t, gateway_error_t */
+#include "sbuffer.h"    /* For sbuffer functions */
+#include "logger.h"     /* For log_message */
+#include "forwarder.h"  /* For function declarations */
+#include "protocol.h"   /* For the packed frames and acknowledgements */
+#include "spill.h"      /* For the readings waiting on disk */
+#include "metrics.h"    /* For the forwarding counters and backlog */
+
+/* --- Local Macros --- */
+
+/* Longest wait for readings before the connection is serviced again (ms) */
+#define READ_WAIT_MS 100
+/* The same while a send waits for room in the socket (ms) */
+#define BUSY_WAIT_MS 10
+
+/* Output buffer: the packed frames of one FORWARDER_SEND_BATCH */
+#define FRAMES_PER_SEND ((FORWARDER_SEND_BATCH + PROTOCOL_V2_MAX_RECORDS - 1) / PROTOCOL_V2_MAX_RECORDS)
+#define OUTPUT_SIZE (FRAMES_PER_SEND * PROTOCOL_V2_PACKED_MAX_SIZE)
+
+#if FORWARDER_WINDOW_READINGS < FORWARDER_SEND_BATCH
+#error "FORWARDER_WINDOW_READINGS must hold at least one FORWARDER_SEND_BATCH"
+#endif
+
+/* --- Local Types --- */
+
+typedef enum {
+    LINK_DOWN,                   /* No connection, next_connect_ms says when to try again */
+    LINK_CONNECTING,             /* Non-blocking connect() in progress */
+    LINK_UP                      /* Connected and acknowledged */
+} link_state_t;
+
+/* --- Static Variables --- */
+
+static bool stop_requested = false;             /* Accessed atomically */
+
+/* Readings taken for forwarding, oldest first, in a ring of FORWARDER_WINDOW_READINGS.
+ * The first window_sent were sent on the current connection and wait for their
+ * acknowledgement, the rest wait to be sent. The spill log only holds readings newer than
+ * these, so the window is refilled from it before new readings are taken. */
+static sensor_data_t *window = NULL;
+static size_t window_head = 0;
+static size_t window_count = 0;
+static size_t window_sent = 0;
+
+static spill_log_t spill_log;
+static bool spill_ready = false;
+static unsigned long readings_dropped = 0;      /* Readings the spill log could not take */
+
+/* Connection to the upstream gateway; all of it is only used by the forwarder thread */
+static link_state_t link_state = LINK_DOWN;
+static int link_fd = -1;
+static struct sockaddr_storage upstream_addr;   /* Resolved on the first attempt that finds it */
+static socklen_t upstream_addr_len = 0;         /* 0 until resolved */
+static uint64_t link_sent = 0;                  /* Readings sent on the connection */
+static uint64_t link_acked = 0;                 /* Of them, acknowledged so far */
+static uint8_t ack_bytes[PROTOCOL_ACK_SIZE];    /* Acknowledgement being received */
+static size_t ack_len = 0;
+static uint8_t output[OUTPUT_SIZE];             /* Encoded frames being sent */
+static size_t output_len = 0;
+static size_t output_sent = 0;
+static long long link_heard_ms = 0;             /* Start of the connect, then the last acknowledgement */
+static long long last_send_ms = 0;              /* Last frames queued on the connection */
+static long long next_connect_ms = 0;
+static long reconnect_delay_ms = FORWARDER_RECONNECT_MIN_MS;
+static bool outage_logged = false;              /* A failed attempt was logged since the last connection */
+
+static sensor_data_t chunk[FORWARDER_SEND_BATCH]; /* Readings moved at once, forwarder thread only */
+
+/* --- Forward Declarations (Internal Helper Functions) --- */
+
+static long long now_ms(void);                                      /* CLOCK_MONOTONIC in ms */
+static bool resolve_upstream(const char *upstream);                 /* Looks up "host:port" */
+static void start_connect(const char *upstream, long long now);     /* Begins a non-blocking connect */
+static void finish_connect(const char *upstream, long long now);    /* Completes it and asks for acknowledgements */
+static void link_down(const char *upstream, const char *reason, long long now); /* Closes the connection */
+static void service_link(const char *upstream, long long now);      /* Connect, acknowledgements, output, timeouts */
+static bool read_acks(const char *upstream, long long now);         /* Releases acknowledged readings */
+static bool flush_output(const char *upstream, long long now);      /* Sends what the socket takes */
+static void fill_output(long long now);                             /* Encodes the next unsent readings */
+static void refill_from_spill(void);                                /* Moves spilled readings into the window */
+static void window_push(const sensor_data_t *data, size_t count);   /* Appends to the window */
+static void accept_readings(const sensor_data_t *data, size_t count); /* Window if it has room, spill log otherwise */
+static void spill_readings(const sensor_data_t *data, size_t count); /* Appends to the spill log */
+static size_t backlog(void);                                        /* Readings not acknowledged yet */
+
+/* --- Main Thread Function --- */
+
+void *forwarder_run(void *arg) {
+    forwarder_args_t *args = (forwarder_args_t *)arg;
+    gateway_error_t ret;
+    size_t count;
+
+    pthread_setname_np(pthread_self(), "forwarder");
+    log_message(LOG_LEVEL_INFO, "Forwarder thread started, upstream %s.", args->upstream);
+
+    window = malloc(FORWARDER_WINDOW_READINGS * sizeof(*window));
+    if (window == NULL) {
+        log_message(LOG_LEVEL_FATAL, "Forwarder failed to allocate its window. Readings are not forwarded.");
+    }
+    spill_ready = (spill_open(&spill_log, FORWARDER_SPILL_DIR) == GATEWAY_SUCCESS);
+    if (!spill_ready) {
+        log_message(LOG_LEVEL_WARNING, "Forwarder could not open spill log %s: %s. Readings beyond the window are dropped.",
+                    FORWARDER_SPILL_DIR, strerror(errno));
+    } else if (spill_count(&spill_log) > 0) {
+        log_message(LOG_LEVEL_INFO, "Forwarder resumes %zu readings left in %s by a previous run.",
+                    spill_count(&spill_log), FORWARDER_SPILL_DIR);
+    }
+
+    /* Without a window the thread still reads its cursor, so the shared buffer does not stall */
+    while (!__atomic_load_n(&stop_requested, __ATOMIC_SEQ_CST)) {
+        long long now = now_ms();
+        unsigned int wait_ms = READ_WAIT_MS;
+
+        if (window != NULL) {
+            service_link(args->upstream, now);
+            if (link_state == LINK_UP && output_len == 0 &&
+                (window_count > window_sent || (spill_ready && spill_count(&spill_log) > 0 &&
+                                                window_count < FORWARDER_WINDOW_READINGS))) {
+                wait_ms = 0; /* More to send right away */
+            } else if (output_len > 0) {
+                wait_ms = BUSY_WAIT_MS;
+            }
+            metrics_gauge_set(METRIC_FORWARD_BACKLOG, (long)backlog());
+        }
+
+        ret = sbuffer_remove_batch_timed(args->buffer, args->reader_id, chunk, FORWARDER_SEND_BATCH, &count, wait_ms);
+        if (ret == SBUFFER_SHUTDOWN) {
+            break;
+        }
+        if (ret == GATEWAY_SUCCESS && window != NULL) {
+            accept_readings(chunk, count);
+        } else if (ret != GATEWAY_SUCCESS && ret != SBUFFER_EMPTY) {
+            log_message(LOG_LEVEL_ERROR, "Forwarder failed to read the shared buffer (Error %d).", ret);
+        }
+    }
+
+    /* Stop: the acknowledgements that arrived still count, then nothing more goes out */
+    if (link_state == LINK_UP) {
+        read_acks(args->upstream, now_ms());
+    }
+    if (link_fd != -1) {
+        close(link_fd);
+        link_fd = -1;
+    }
+    size_t unacked = window_count;
+    if (window != NULL && window_count > 0) {
+        /* Oldest first; the spill log is newer, so these arrive out of order after the restart */
+        size_t first = FORWARDER_WINDOW_READINGS - window_head;
+        if (first > window_count) {
+            first = window_count;
+        }
+        spill_readings(window + window_head, first);
+        spill_readings(window, window_count - first);
+        window_count = 0;
+    }
+    size_t drained = 0;
+    while ((ret = sbuffer_remove_batch_timed(args->buffer, args->reader_id, chunk, FORWARDER_SEND_BATCH,
+                                             &count, READ_WAIT_MS)) != SBUFFER_SHUTDOWN) {
+        if (ret == GATEWAY_SUCCESS && window != NULL) {
+            spill_readings(chunk, count);
+            drained += count;
+        } else if (ret != GATEWAY_SUCCESS && ret != SBUFFER_EMPTY) {
+            break;
+        }
+    }
+
+    if (spill_ready) {
+        log_message(LOG_LEVEL_INFO, "Forwarder stopped: %zu unacknowledged and %zu unsent readings kept, %zu wait in %s.",
+                    unacked, drained, spill_count(&spill_log), FORWARDER_SPILL_DIR);
+        if (spill_log.dropped > 0 || readings_dropped > 0) {
+            log_message(LOG_LEVEL_WARNING, "Forwarder lost %lu readings: the spill log was full or failed.",
+                        spill_log.dropped + readings_dropped);
+        }
+        spill_close(&spill_log);
+        spill_ready = false;
+    } else if (unacked + drained + readings_dropped > 0) {
+        log_message(LOG_LEVEL_WARNING, "Forwarder stopped without a spill log, %lu readings were not forwarded.",
+                    (unsigned long)(unacked + drained) + readings_dropped);
+    }
+    free(window);
+    window = NULL;
+    log_message(LOG_LEVEL_INFO, "Forwarder thread finished.");
+    return NULL;
+}
+
+void forwarder_stop(void) {
+    log_message(LOG_LEVEL_INFO, "Forwarder stop requested.");
+    __atomic_store_n(&stop_requested, true, __ATOMIC_SEQ_CST);
+}
+
+/* --- Connection --- */
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Resolves "host:port" (an IPv6 host in brackets) into upstream_addr.
+ * @return false if it is malformed or the host is unknown (for now).
+ */
+static bool resolve_upstream(const char *upstream) {
+    char host[256];
+    const char *colon = strrchr(upstream, ':');
+    struct addrinfo hints, *result;
+
+    if (colon == NULL || colon == upstream || colon[1] == '\0' || (size_t)(colon - upstream) >= sizeof(host)) {
+        return false;
+    }
+    memcpy(host, upstream, (size_t)(colon - upstream));
+    host[colon - upstream] = '\0';
+    char *name = host;
+    if (name[0] == '[' && name[strlen(name) - 1] == ']') {
+        name[strlen(name) - 1] = '\0';
+        name++;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(name, colon + 1, &hints, &result) != 0) {
+        return false;
+    }
+    memcpy(&upstream_addr, result->ai_addr, result->ai_addrlen);
+    upstream_addr_len = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+/**
+ * @brief Starts a non-blocking connection attempt; service_link() completes it.
+ */
+static void start_connect(const char *upstream, long long now) {
+    int one = 1;
+
+    if (upstream_addr_len == 0 && !resolve_upstream(upstream)) {
+        link_down(upstream, "cannot resolve the address", now);
+        return;
+    }
+    link_fd = socket(upstream_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (link_fd == -1) {
+        link_down(upstream, strerror(errno), now);
+        return;
+    }
+    setsockopt(link_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); /* Acknowledgement requests are small */
+    link_heard_ms = now;
+    if (connect(link_fd, (struct sockaddr *)&upstream_addr, upstream_addr_len) == 0) {
+        finish_connect(upstream, now);
+    } else if (errno == EINPROGRESS) {
+        link_state = LINK_CONNECTING;
+    } else {
+        link_down(upstream, strerror(errno), now);
+    }
+}
+
+/**
+ * @brief Asks the new connection for acknowledgements and queues the whole window again:
+ *        whatever was sent on the previous connection and not acknowledged is resent.
+ */
+static void finish_connect(const char *upstream, long long now) {
+    link_state = LINK_UP;
+    link_sent = 0;
+    link_acked = 0;
+    ack_len = 0;
+    window_sent = 0;
+    output[0] = PROTOCOL_V2_MAGIC; /* Empty v2 frame: acknowledgement request */
+    output[1] = PROTOCOL_V2_VERSION;
+    output[2] = 0;
+    output[3] = 0;
+    output_len = PROTOCOL_V2_HEADER_SIZE;
+    output_sent = 0;
+    link_heard_ms = now;
+    last_send_ms = now;
+    log_message(LOG_LEVEL_INFO, "Forwarder connected to %s, %zu readings waiting in memory and %zu in the spill log.",
+                upstream, window_count, spill_ready ? spill_count(&spill_log) : (size_t)0);
+    outage_logged = false;
+}
+
+/**
+ * @brief Closes the connection (if any) and schedules the next attempt with a doubling delay.
+ *        Readings keep arriving in the window and the spill log meanwhile.
+ */
+static void link_down(const char *upstream, const char *reason, long long now) {
+    if (link_state == LINK_UP) {
+        log_message(LOG_LEVEL_WARNING, "Forwarder lost %s (%s), %zu readings unacknowledged.",
+                    upstream, reason, window_sent);
+    } else if (!outage_logged) {
+        log_message(LOG_LEVEL_WARNING, "Forwarder cannot connect to %s (%s), retrying for as long as it takes.",
+                    upstream, reason);
+        outage_logged = true;
+    } else {
+        LOG_DEBUG("Forwarder cannot connect to %s (%s).", upstream, reason);
+    }
+    if (link_fd != -1) {
+        close(link_fd);
+        link_fd = -1;
+    }
+    link_state = LINK_DOWN;
+    window_sent = 0;
+    output_len = 0;
+    output_sent = 0;
+    ack_len = 0;
+    next_connect_ms = now + reconnect_delay_ms;
+    reconnect_delay_ms = reconnect_delay_ms * 2 > FORWARDER_RECONNECT_MAX_MS ? FORWARDER_RECONNECT_MAX_MS
+                                                                             : reconnect_delay_ms * 2;
+}
+
+/**
+ * @brief Advances the connection as far as it goes without blocking.
+ */
+static void service_link(const char *upstream, long long now) {
+    if (link_state == LINK_DOWN) {
+        if (now < next_connect_ms) {
+            return;
+        }
+        start_connect(upstream, now);
+        if (link_state == LINK_DOWN) {
+            return;
+        }
+    }
+
+    struct pollfd pfd = { .fd = link_fd, .events = link_state == LINK_CONNECTING ? POLLOUT : POLLIN };
+    if (poll(&pfd, 1, 0) > 0 && link_state == LINK_CONNECTING) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(link_fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1 || error != 0) {
+            link_down(upstream, strerror(error != 0 ? error : errno), now);
+            return;
+        }
+        finish_connect(upstream, now);
+    } else if (link_state == LINK_CONNECTING) {
+        if (now - link_heard_ms > FORWARDER_IO_TIMEOUT_MS) {
+            link_down(upstream, "connect timed out", now);
+        }
+        return;
+    } else if ((pfd.revents & (POLLIN | POLLHUP | POLLERR)) && !read_acks(upstream, now)) {
+        return;
+    }
+
+    refill_from_spill();
+    fill_output(now);
+    if (!flush_output(upstream, now)) {
+        return;
+    }
+    /* No acknowledgement of data or keepalives for this long: the upstream, or the path, is gone */
+    if (now - link_heard_ms > FORWARDER_ACK_TIMEOUT_MS) {
+        link_down(upstream, "no acknowledgement", now);
+    }
+}
+
+/**
+ * @brief Reads the acknowledgements that arrived and releases the readings they cover.
+ * @return false if the connection was closed.
+ */
+static bool read_acks(const char *upstream, long long now) {
+    while (1) {
+        ssize_t n = recv(link_fd, ack_bytes + ack_len, sizeof(ack_bytes) - ack_len, MSG_DONTWAIT);
+        if (n == 0) {
+            link_down(upstream, "closed by the upstream", now);
+            return false;
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            link_down(upstream, strerror(errno), now);
+            return false;
+        }
+        ack_len += (size_t)n;
+        if (ack_len < sizeof(ack_bytes)) {
+            continue;
+        }
+        ack_len = 0;
+
+        uint64_t acked;
+        memcpy(&acked, ack_bytes, sizeof(acked));
+        acked = be64toh(acked);
+        if (acked < link_acked || acked > link_sent) {
+            link_down(upstream, "acknowledged readings it was not sent", now);
+            return false;
+        }
+        size_t released = (size_t)(acked - link_acked);
+        window_head = (window_head + released) % FORWARDER_WINDOW_READINGS;
+        window_count -= released;
+        window_sent -= released;
+        link_acked = acked;
+        link_heard_ms = now;
+        reconnect_delay_ms = FORWARDER_RECONNECT_MIN_MS; /* The upstream works again */
+        metrics_add(METRIC_FORWARD_ACKED, released);
+    }
+}
+
+/**
+ * @brief Sends as much of the output buffer as the socket takes.
+ * @return false if the connection was closed.
+ */
+static bool flush_output(const char *upstream, long long now) {
+    while (output_sent < output_len) {
+        ssize_t n = send(link_fd, output + output_sent, output_len - output_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            link_down(upstream, strerror(errno), now);
+            return false;
+        }
+        output_sent += (size_t)n;
+    }
+    output_len = 0;
+    output_sent = 0;
+    return true;
+}
+
+/**
+ * @brief Once the output buffer is empty, encodes up to FORWARDER_SEND_BATCH unsent readings
+ *        of the window, or an acknowledgement request if the connection was idle for
+ *        FORWARDER_KEEPALIVE_MS.
+ */
+static void fill_output(long long now) {
+    if (link_state != LINK_UP || output_len > 0) {
+        return;
+    }
+    size_t pending = window_count - window_sent;
+    if (pending > FORWARDER_SEND_BATCH) {
+        pending = FORWARDER_SEND_BATCH;
+    }
+    if (pending == 0) {
+        if (now - last_send_ms >= FORWARDER_KEEPALIVE_MS) {
+            memcpy(output, (const uint8_t[]){ PROTOCOL_V2_MAGIC, PROTOCOL_V2_VERSION, 0, 0 }, PROTOCOL_V2_HEADER_SIZE);
+            output_len = PROTOCOL_V2_HEADER_SIZE;
+            last_send_ms = now;
+        }
+        return;
+    }
+
+    /* Frames never wrap around the ring, so they are encoded from the window in place */
+    size_t position = (window_head + window_sent) % FORWARDER_WINDOW_READINGS;
+    size_t left = pending;
+    while (left > 0) {
+        size_t records = left < PROTOCOL_V2_MAX_RECORDS ? left : PROTOCOL_V2_MAX_RECORDS;
+        if (records > FORWARDER_WINDOW_READINGS - position) {
+            records = FORWARDER_WINDOW_READINGS - position;
+        }
+        output_len += protocol_encode_packed(window + position, records, output + output_len);
+        position = (position + records) % FORWARDER_WINDOW_READINGS;
+        left -= records;
+    }
+    window_sent += pending;
+    link_sent += pending;
+    last_send_ms = now;
+    metrics_add(METRIC_FORWARD_SENT, pending);
+}
+
+/* --- Window and Spill Log --- */
+
+/**
+ * @brief While connected, moves the oldest spilled readings into the free part of the window.
+ *        They are consumed from the log once they are in memory.
+ */
+static void refill_from_spill(void) {
+    if (!spill_ready || link_state != LINK_UP) {
+        return;
+    }
+    size_t room = FORWARDER_WINDOW_READINGS - window_count;
+    if (room > FORWARDER_SEND_BATCH) {
+        room = FORWARDER_SEND_BATCH;
+    }
+    if (room == 0 || spill_count(&spill_log) == 0) {
+        return;
+    }
+    size_t count = spill_peek(&spill_log, chunk, room);
+    window_push(chunk, count);
+    spill_consume(&spill_log, count);
+}
+
+static void window_push(const sensor_data_t *data, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        window[(window_head + window_count + i) % FORWARDER_WINDOW_READINGS] = data[i];
+    }
+    window_count += count;
+}
+
+/**
+ * @brief Takes new readings: into the window while it has room and nothing older waits in
+ *        the spill log, into the spill log otherwise.
+ */
+static void accept_readings(const sensor_data_t *data, size_t count) {
+    size_t to_window = 0;
+
+    if (!spill_ready || spill_count(&spill_log) == 0) {
+        to_window = FORWARDER_WINDOW_READINGS - window_count;
+        if (to_window > count) {
+            to_window = count;
+        }
+        window_push(data, to_window);
+    }
+    spill_readings(data + to_window, count - to_window);
+}
+
+static void spill_readings(const sensor_data_t *data, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (!spill_ready || spill_append(&spill_log, data, count) != GATEWAY_SUCCESS) {
+        if (readings_dropped == 0) {
+            log_message(LOG_LEVEL_WARNING, "Forwarder window full and the spill log unavailable, dropping readings.");
+        }
+        readings_dropped += count;
+    }
+}
+
+static size_t backlog(void) {
+    return window_count + (spill_ready ? spill_count(&spill_log) : 0);
+}
@@ -8,41 +8,433 @@
 #include <errno.h>      /* For errno to handle error codes */
 #include <stdbool.h>    /* For boolean type (true/false) */
 #include <signal.h>     /* For signal handling (e.g., sig_atomic_t) */
+#include <poll.h>       /* For poll() with the flush deadline */
+#include <dirent.h>     /* For listing rotated log files */
+#include <sys/wait.h>   /* For waitpid() on compressor children */
 
 /* Include project-specific headers */
 #include "config.h"     /* Contains definitions like LOG_FIFO_NAME, LOG_FILE_NAME */
 #include "common.h"     /* Contains common definitions like gateway_error_t */
 #include "logger.h"     /* Contains the declaration for run_log_process */
+#include "log_record.h" /* For binary records (LOG_BINARY) */
+#include "log_shm.h"    /* For the shared memory ring */
 
 /* --- Local Macros --- */
-#define FIFO_READ_BUFFER_SIZE 512 /* Size of the buffer for each read() call */
-#define ASSEMBLY_BUFFER_SIZE (FIFO_READ_BUFFER_SIZE * 4) /* Buffer to assemble potentially partial lines */
+#define ASSEMBLY_BUFFER_SIZE (64 * 1024) /* Lines are assembled in place, each read() fills what is free */
 #define TIMESTAMP_BUFFER_SIZE 100 /* Buffer size for formatted timestamp */
-#define LOG_LINE_BUFFER_SIZE (ASSEMBLY_BUFFER_SIZE + TIMESTAMP_BUFFER_SIZE + 50) /* Max size for final log line */
 #define TIMESTAMP_FORMAT "%Y-%m-%d %H:%M:%S" /* Format for timestamps */
+#define TIMESTAMP_LENGTH 19 /* Length of a TIMESTAMP_FORMAT timestamp */
 #define INITIAL_SEQUENCE_NUMBER 1 /* Initial sequence number for log entries */
+#define RECORD_BUFFER_SIZE (64 * 1024) /* Read buffer for binary records (LOG_BINARY) */
+
+/* A file the log process appends to, rotated by size and age */
+typedef struct {
+    FILE *file;
+    const char *path;
+    bool binary;             /* Starts with LOG_RECORD_FILE_MAGIC */
+    size_t size;             /* Bytes in the file */
+    time_t opened;           /* When the log process started writing the file */
+} log_output_t;
+
+/* Output written since the last flush, see batch_wrote() */
+static FILE *batch_file = NULL;       /* File holding the unflushed output */
+static size_t batch_bytes = 0;        /* Bytes written to it since the last flush */
+static struct timespec batch_started; /* Monotonic time of the first of them */
+
+/* Messages come from the shared memory ring instead of the FIFO (set by run_log_process()) */
+static bool shm_input = false;
+
+/* --- Local Helper Functions --- */
+
+/** @brief Writes out the pending output of the log process. */
+static void batch_flush(void) {
+    if (batch_file != NULL && fflush(batch_file) != 0) {
+        perror("Log Process ERROR: Failed to write to log file");
+    }
+    batch_file = NULL;
+    batch_bytes = 0;
+}
+
+/**
+ * @brief Accounts output written to a stdio stream, flushing it once LOG_PROCESS_FLUSH_BYTES
+ *        are pending or at once if urgent (a FATAL message). LOG_PROCESS_FLUSH_MS is enforced
+ *        by wait_for_input().
+ * @param file The stream written to.
+ * @param bytes Bytes written.
+ * @param urgent Flush now.
+ */
+static void batch_wrote(FILE *file, size_t bytes, bool urgent) {
+    if (batch_file != file) {
+        batch_flush();
+        batch_file = file;
+        clock_gettime(CLOCK_MONOTONIC, &batch_started);
+    }
+    batch_bytes += bytes;
+    if (urgent || batch_bytes >= LOG_PROCESS_FLUSH_BYTES) {
+        batch_flush();
+    }
+}
+
+/**
+ * @brief Waits until the FIFO (or the shared memory ring) can be read, flushing pending
+ *        output when its LOG_PROCESS_FLUSH_MS deadline passes first.
+ */
+static void wait_for_input(int fifo_fd) {
+    struct pollfd pfd = { .fd = fifo_fd, .events = POLLIN };
+    for (;;) {
+        int timeout_ms = -1;
+        if (batch_file != NULL) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long elapsed_ms = (now.tv_sec - batch_started.tv_sec) * 1000L +
+                              (now.tv_nsec - batch_started.tv_nsec) / 1000000L;
+            if (elapsed_ms >= LOG_PROCESS_FLUSH_MS) {
+                batch_flush();
+                continue;
+            }
+            timeout_ms = (int)(LOG_PROCESS_FLUSH_MS - elapsed_ms);
+        }
+        int ready = shm_input ? log_shm_wait(timeout_ms) : poll(&pfd, 1, timeout_ms);
+        if (ready != 0 && !(ready < 0 && errno == EINTR)) {
+            return; /* Readable, closed or failed: read() reports which */
+        }
+    }
+}
+
+/**
+ * @brief Reads what arrived from the FIFO or the shared memory ring, like read(): the ring
+ *        returns whole messages, 0 once the gateway closed it, and fails with EAGAIN when empty.
+ */
+static ssize_t read_input(int fifo_fd, void *buffer, size_t size) {
+    return shm_input ? log_shm_read(buffer, size) : read(fifo_fd, buffer, size);
+}
+
+/** @brief Formats the current local time with TIMESTAMP_FORMAT. */
+static void format_timestamp(char *buffer, size_t size) {
+    time_t current_time = time(NULL);
+    struct tm local_time;
+    localtime_r(&current_time, &local_time);
+    strftime(buffer, size, TIMESTAMP_FORMAT, &local_time);
+}
+
+/**
+ * @brief Opens (creating it if needed) a file of the log process for appending.
+ * @return true on success; errno is kept otherwise.
+ */
+static bool output_open(log_output_t *out, const char *path, bool binary) {
+    /* Close on exec, so compressor children don't hold the file */
+    out->file = fopen(path, binary ? "abe" : "ae");
+    if (out->file == NULL) {
+        return false;
+    }
+    /* Lines are written in batches of up to LOG_PROCESS_FLUSH_BYTES, see batch_wrote() */
+    setvbuf(out->file, NULL, _IOFBF, LOG_PROCESS_FLUSH_BYTES);
+    out->path = path;
+    out->binary = binary;
+    out->opened = time(NULL);
+    fseek(out->file, 0, SEEK_END);
+    long size = ftell(out->file);
+    out->size = (size > 0) ? (size_t)size : 0;
+    if (binary && out->size == 0) {
+        fwrite(LOG_RECORD_FILE_MAGIC, 1, strlen(LOG_RECORD_FILE_MAGIC), out->file);
+        out->size = strlen(LOG_RECORD_FILE_MAGIC);
+    }
+    return true;
+}
+
+/**
+ * @brief Accounts output written to a file, see batch_wrote().
+ */
+static void output_wrote(log_output_t *out, size_t bytes, bool urgent) {
+    out->size += bytes;
+    batch_wrote(out->file, bytes, urgent);
+}
+
+/**
+ * @brief Collects the compressor children that have finished.
+ * @param wait Block until all of them are done (at shutdown).
+ */
+static void reap_compressors(bool wait) {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, wait ? 0 : WNOHANG)) > 0) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Log Process WARN: Compressing a rotated log failed (child %d), it is kept uncompressed.\n", (int)pid);
+        }
+    }
+}
+
+/**
+ * @brief Compresses a rotated file with gzip in a child process.
+ */
+static void compress_in_background(const char *path) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execlp("gzip", "gzip", "-f", "-q", path, (char *)NULL);
+        _exit(127);
+    }
+    if (pid < 0) {
+        perror("Log Process WARN: Failed to start log compression");
+    }
+}
+
+/** @brief Orders rotated file names by their rotation time, ignoring a ".gz" suffix. */
+static int compare_rotated(const void *a, const void *b) {
+    const char *name_a = *(const char *const *)a;
+    const char *name_b = *(const char *const *)b;
+    size_t len_a = strcspn(name_a + 1, ".") + 1;  /* The names differ after the shared prefix only */
+    size_t len_b = strcspn(name_b + 1, ".") + 1;
+    int cmp = strncmp(name_a, name_b, len_a < len_b ? len_a : len_b);
+    return cmp != 0 ? cmp : (int)len_a - (int)len_b;
+}
+
+/**
+ * @brief Deletes the oldest rotated files of an output beyond LOG_ROTATE_KEEP.
+ *        A file being compressed (both "x" and "x.gz" exist) counts once.
+ */
+static void prune_rotated(const char *path) {
+    char dir[256] = ".";
+    const char *base = strrchr(path, '/');
+    if (base != NULL) {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(base - path), path);
+        base++;
+    } else {
+        base = path;
+    }
+    size_t base_len = strlen(base);
+
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        return;
+    }
+    char **names = NULL;
+    size_t count = 0, capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        /* Rotated files are <base>.<YYYYMMDD-HHMMSS>[-n][.gz] */
+        if (strncmp(entry->d_name, base, base_len) != 0 || entry->d_name[base_len] != '.' ||
+            entry->d_name[base_len + 1] < '0' || entry->d_name[base_len + 1] > '9') {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            char **grown = realloc(names, capacity * sizeof(*names));
+            if (grown == NULL) break;
+            names = grown;
+        }
+        names[count] = strdup(entry->d_name + base_len);
+        if (names[count] != NULL) count++;
+    }
+    closedir(d);
+
+    qsort(names, count, sizeof(*names), compare_rotated);
+    size_t kept = 0;
+    for (size_t i = count; i-- > 0; ) {
+        bool same_as_newer = (i + 1 < count && compare_rotated(&names[i], &names[i + 1]) == 0);
+        if (!same_as_newer) kept++;
+        if (kept > LOG_ROTATE_KEEP) {
+            char victim[512];
+            snprintf(victim, sizeof(victim), "%s%s", path, names[i]);
+            if (unlink(victim) == -1 && errno != ENOENT) {
+                perror("Log Process WARN: Failed to delete an old rotated log");
+            }
+        }
+    }
+    for (size_t i = 0; i < count; ++i) free(names[i]);
+    free(names);
+}
+
+/**
+ * @brief Tells whether a file has reached LOG_ROTATE_BYTES or LOG_ROTATE_AGE_SEC.
+ */
+static bool output_due(const log_output_t *out) {
+    size_t empty = out->binary ? strlen(LOG_RECORD_FILE_MAGIC) : 0;
+    if (out->size >= LOG_ROTATE_BYTES) {
+        return true;
+    }
+    return LOG_ROTATE_AGE_SEC > 0 && out->size > empty && time(NULL) - out->opened >= LOG_ROTATE_AGE_SEC;
+}
+
+/** @brief Tells whether a rotated file name is taken, compressed or not. */
+static bool rotated_exists(const char *rotated) {
+    char compressed[520];
+    snprintf(compressed, sizeof(compressed), "%s.gz", rotated);
+    return access(rotated, F_OK) == 0 || access(compressed, F_OK) == 0;
+}
+
+/**
+ * @brief Renames a file to <path>.<YYYYMMDD-HHMMSS>, starts a new one under its name and
+ *        hands the old one to a compressor child (LOG_ROTATE_COMPRESS). The caller's
+ *        sequence numbering just continues in the new file.
+ * @return false if the output could not be reopened (out->file is NULL).
+ */
+static bool output_rotate(log_output_t *out) {
+    char rotated[512];
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm local_time;
+
+    localtime_r(&now, &local_time);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local_time);
+    snprintf(rotated, sizeof(rotated), "%s.%s", out->path, stamp);
+    for (int n = 2; rotated_exists(rotated) && n < 100; ++n) {
+        snprintf(rotated, sizeof(rotated), "%s.%s-%d", out->path, stamp, n); /* Rotated twice in a second */
+    }
+
+    batch_flush();
+    fclose(out->file);
+    bool renamed = (rename(out->path, rotated) == 0);
+    if (!renamed) {
+        perror("Log Process ERROR: Failed to rotate log file, appending to it");
+    }
+    if (!output_open(out, out->path, out->binary)) {
+        perror("Log Process CRITICAL: Failed to reopen log file after rotation");
+        out->file = NULL;
+        return false;
+    }
+    if (!renamed) {
+        out->opened = now; /* Don't retry at once */
+        return true;
+    }
+
+    if (LOG_ROTATE_COMPRESS) {
+        compress_in_background(rotated);
+    }
+    prune_rotated(out->path);
+    return true;
+}
+
+/**
+ * @brief Reads binary records from the FIFO until its write end closes, and either formats
+ *        them into the log file or, with LOG_BINARY_STORE, appends them to LOG_BINARY_FILE_NAME.
+ * @param fifo_fd The FIFO read end.
+ * @param log_out The log file.
+ * @param sequence_number The sequence number of the next line, advanced per line written.
+ */
+static void process_binary_records(int fifo_fd, log_output_t *log_out, uint64_t *sequence_number) {
+    uint8_t *buffer = malloc(RECORD_BUFFER_SIZE);
+    size_t length = 0;
+    bool corrupt_reported = false;
+    log_output_t store_out;
+    log_output_t *store = NULL;  /* &store_out when storing records */
+    log_dict_t dict;
+    char timestamp_buffer[TIMESTAMP_BUFFER_SIZE];
+    char line[LOG_RECORD_MAX_SIZE + TIMESTAMP_BUFFER_SIZE];
+
+    if (buffer == NULL) {
+        perror("Log Process CRITICAL: Failed to allocate record buffer");
+        return;
+    }
+    log_dict_init(&dict);
+
+    if (LOG_BINARY_STORE) {
+        if (output_open(&store_out, LOG_BINARY_FILE_NAME, true)) {
+            store = &store_out;
+        } else {
+            perror("Log Process ERROR: Failed to open binary log, formatting records instead");
+        }
+    }
+
+    for (;;) {
+        wait_for_input(fifo_fd);
+        ssize_t bytes_read = read_input(fifo_fd, buffer + length, RECORD_BUFFER_SIZE - length);
+        if (bytes_read < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            perror("Log Process ERROR: Failed to read from FIFO");
+            format_timestamp(timestamp_buffer, sizeof(timestamp_buffer));
+            fprintf(log_out->file, "%lu %s Log process exiting due to FIFO read error: %s.\n",
+                    *sequence_number, timestamp_buffer, strerror(errno));
+            break;
+        }
+        if (bytes_read == 0) {
+            fprintf(stderr, "Log Process: %s write end closed.\n", shm_input ? "Log ring" : "FIFO"); /* Info output */
+            break;
+        }
+        length += (size_t)bytes_read;
+
+        /* The records of one read share a timestamp */
+        format_timestamp(timestamp_buffer, sizeof(timestamp_buffer));
+
+        size_t pos = 0;
+        log_record_header_t header;
+        int status;
+        while ((status = log_record_peek(buffer + pos, length - pos, &header)) == 1) {
+            const uint8_t *record = buffer + pos;
+            pos += header.size;
+            if (store != NULL) {
+                if (fwrite(record, header.size, 1, store->file) != 1) {
+                    perror("Log Process ERROR: Failed to write to binary log");
+                }
+                output_wrote(store, header.size, header.type != LOG_RECORD_FORMAT && header.level == LOG_LEVEL_FATAL);
+            } else if (header.type == LOG_RECORD_FORMAT) {
+                if (log_dict_add(&dict, record, &header) != GATEWAY_SUCCESS) {
+                    fprintf(stderr, "Log Process ERROR: Out of memory for log formats.\n");
+                }
+            } else {
+                log_record_render(record, &header, &dict, line, sizeof(line));
+                int written = fprintf(log_out->file, "%lu %s %s\n", *sequence_number, timestamp_buffer, line);
+                if (written < 0) {
+                    perror("Log Process ERROR: Failed to write to log file");
+                } else {
+                    output_wrote(log_out, (size_t)written, header.level == LOG_LEVEL_FATAL);
+                }
+                (*sequence_number)++;
+            }
+        }
+        if (status < 0) {
+            /* There is a single writer, so this is a bug rather than interleaving; skip what was read */
+            if (!corrupt_reported) {
+                fprintf(log_out->file, "%lu %s Log Process ERROR: Corrupt binary log record, records lost.\n",
+                        (*sequence_number)++, timestamp_buffer);
+                corrupt_reported = true;
+            }
+            pos = length;
+        }
+        length -= pos;
+        memmove(buffer, buffer + pos, length);
+
+        /* Rotate between reads, so a file never ends inside a record */
+        reap_compressors(false);
+        if (store != NULL && output_due(store) && !output_rotate(store)) {
+            store = NULL; /* Format the records from here on */
+        }
+        if (output_due(log_out) && !output_rotate(log_out)) {
+            break;
+        }
+    }
+
+    if (length > 0) {
+        fprintf(stderr, "Log Process WARN: Discarding %zu bytes of a partial record after FIFO closed.\n", length);
+    }
+    batch_flush();
+    if (store != NULL) {
+        fclose(store->file);
+    }
+    log_dict_free(&dict);
+    free(buffer);
+}
 
 /* --- Main Function for Log Process --- */
 
 /**
  * @brief Main function for the dedicated log process.
  * 
- * This function reads log messages from a FIFO, handles partial reads by assembling lines,
- * and writes them to a log file with a sequence number and timestamp prepended.
- * It runs indefinitely until the FIFO's write end is closed or an unrecoverable error occurs.
+ * This function reads log messages from the shared memory ring mapped by logger_init(), or
+ * else from a FIFO, handles partial reads by assembling lines, and writes them to a log file
+ * with a sequence number and timestamp prepended. It runs indefinitely until the write end
+ * is closed (logger_cleanup() in the gateway) or an unrecoverable error occurs.
  */
 void run_log_process(void) {
     int fifo_fd = -1; /* File descriptor for the FIFO */
-    FILE *log_file = NULL; /* File pointer for the log file */
-    char read_buffer[FIFO_READ_BUFFER_SIZE]; /* Temporary buffer for read() */
+    log_output_t log_out = { 0 }; /* The log file */
     char *assembly_buffer = NULL; /* Dynamically allocated buffer to assemble lines */
     int assembly_buffer_len = 0; /* Current length of data in the assembly buffer */
     char timestamp_buffer[TIMESTAMP_BUFFER_SIZE]; /* Buffer for formatted timestamps */
-    char log_line_buffer[LOG_LINE_BUFFER_SIZE]; /* Buffer for the final log line */
     ssize_t bytes_read; /* Number of bytes read from the FIFO */
     uint64_t sequence_number = INITIAL_SEQUENCE_NUMBER; /* Sequence number for log entries */
-    time_t current_time; /* Current time */
-    struct tm *local_time; /* Local time structure */
+    const char *fatal_tag = log_record_level_tag(LOG_LEVEL_FATAL); /* Level tag of lines flushed at once */
     bool fifo_closed = false; /* Flag to indicate if the FIFO's write end is closed */
 
     /* Allocate memory for the assembly buffer */
@@ -53,106 +445,85 @@ void run_log_process(void) {
     }
     assembly_buffer[0] = '\0'; /* Ensure the buffer is initially empty */
 
-    /* 1. Open the FIFO for reading */
-    fifo_fd = open(LOG_FIFO_NAME, O_RDONLY);
-    if (fifo_fd == -1) {
+    /* 1. Open the FIFO for reading, unless the gateway mapped the shared memory ring */
+    shm_input = log_shm_available();
+    if (!shm_input) {
+        fifo_fd = open(LOG_FIFO_NAME, O_RDONLY | O_CLOEXEC); /* Not inherited by compressor children */
+    }
+    if (!shm_input && fifo_fd == -1) {
         perror("Log Process CRITICAL: Failed to open FIFO for reading");
         free(assembly_buffer);
         exit(EXIT_FAILURE);
     }
 
     /* 2. Open the log file for appending */
-    log_file = fopen(LOG_FILE_NAME, "a");
-    if (log_file == NULL) {
+    if (!output_open(&log_out, LOG_FILE_NAME, false)) {
         perror("Log Process CRITICAL: Failed to open log file for appending");
-        close(fifo_fd);
+        if (fifo_fd != -1) {
+            close(fifo_fd);
+        }
         free(assembly_buffer);
         exit(EXIT_FAILURE);
     }
 
     /* Log a startup message */
-    time(&current_time);
-    local_time = localtime(&current_time);
-    strftime(timestamp_buffer, sizeof(timestamp_buffer), TIMESTAMP_FORMAT, local_time);
-    fprintf(log_file, "0 %s Log process started.\n", timestamp_buffer);
-    fflush(log_file);
+    format_timestamp(timestamp_buffer, sizeof(timestamp_buffer));
+    fprintf(log_out.file, "0 %s Log process started.\n", timestamp_buffer);
+    fflush(log_out.file);
+
+    fprintf(stderr, "Log process started. Reading from %s, writing to %s\n",
+            shm_input ? "shared memory" : LOG_FIFO_NAME, LOG_FILE_NAME); /* Info output */
 
-    fprintf(stderr, "Log process started. Reading from %s, writing to %s\n", LOG_FIFO_NAME, LOG_FILE_NAME); /* Info output */
+    if (LOG_BINARY) {
+        /* Records instead of lines; the loop below is skipped */
+        process_binary_records(fifo_fd, &log_out, &sequence_number);
+        fifo_closed = true;
+    }
 
     /* 3. Main loop: Read, assemble, and process lines */
     while (!fifo_closed) {
-        /* Read data from the FIFO */
-        bytes_read = read(fifo_fd, read_buffer, sizeof(read_buffer));
+        /* Read into the free end of the assembly buffer; one byte is kept for a terminator */
+        wait_for_input(fifo_fd);
+        bytes_read = read_input(fifo_fd, assembly_buffer + assembly_buffer_len, ASSEMBLY_BUFFER_SIZE - 1 - assembly_buffer_len);
 
         if (bytes_read > 0) {
-            /* Append read data to the assembly buffer, checking for overflow */
-            if (assembly_buffer_len + bytes_read >= ASSEMBLY_BUFFER_SIZE) {
-                /* Handle overflow: log error and reset the buffer */
-                fprintf(stderr, "Log Process ERROR: Assembly buffer overflow. Log messages might be lost/corrupted.\n");
-                fprintf(log_file, "0 %s Log Process ERROR: Assembly buffer overflow.\n", timestamp_buffer); /* Use last known timestamp */
-                fflush(log_file);
-                assembly_buffer_len = 0; /* Reset buffer */
-                continue; /* Skip processing this chunk */
-            }
-            memcpy(assembly_buffer + assembly_buffer_len, read_buffer, bytes_read);
             assembly_buffer_len += bytes_read;
 
         } else if (bytes_read == 0) {
             /* End of File - FIFO write end closed */
-            fprintf(stderr, "Log Process: FIFO write end closed.\n"); /* Info output */
+            fprintf(stderr, "Log Process: %s write end closed.\n", shm_input ? "Log ring" : "FIFO"); /* Info output */
             fifo_closed = true; /* Set flag to process remaining buffer and exit */
 
         } else { /* bytes_read < 0 */
-            if (errno == EINTR) {
-                continue; /* Interrupted system call, retry read */
+            if (errno == EINTR || errno == EAGAIN) {
+                continue; /* Interrupted system call or empty ring, retry read */
             } else {
                 perror("Log Process ERROR: Failed to read from FIFO");
                 /* Log error to file before exiting */
-                time(&current_time);
-                local_time = localtime(&current_time);
-                strftime(timestamp_buffer, sizeof(timestamp_buffer), TIMESTAMP_FORMAT, local_time);
-                fprintf(log_file, "%lu %s Log process exiting due to FIFO read error: %s.\n", sequence_number, timestamp_buffer, strerror(errno));
-                fflush(log_file);
+                format_timestamp(timestamp_buffer, sizeof(timestamp_buffer));
+                fprintf(log_out.file, "%lu %s Log process exiting due to FIFO read error: %s.\n", sequence_number, timestamp_buffer, strerror(errno));
                 fifo_closed = true; /* Treat as EOF for cleanup */
                 break; /* Exit loop on error */
             }
         }
 
-        /* Process complete lines (ending with '\n') from the assembly buffer */
+        /* Process complete lines (ending with '\n') from the assembly buffer; the lines of one read share a timestamp */
         char *current_pos = assembly_buffer;
         char *newline_pos;
         int processed_len = 0;
+        format_timestamp(timestamp_buffer, sizeof(timestamp_buffer));
 
         while ((newline_pos = memchr(current_pos, '\n', assembly_buffer_len - processed_len)) != NULL) {
             int line_len = newline_pos - current_pos; /* Length excluding newline */
 
-            /* Ensure the line fits in the log_line_buffer */
-            if (line_len >= LOG_LINE_BUFFER_SIZE - TIMESTAMP_BUFFER_SIZE - 50) {
-                fprintf(stderr, "Log Process WARN: Assembled line too long, potential truncation.\n");
-                line_len = LOG_LINE_BUFFER_SIZE - TIMESTAMP_BUFFER_SIZE - 50 - 1; /* Truncate */
-            }
-
-            /* Format and write the complete line */
-            time(&current_time);
-            local_time = localtime(&current_time);
-            strftime(timestamp_buffer, sizeof(timestamp_buffer), TIMESTAMP_FORMAT, local_time);
-
-            /* Copy the message part and null-terminate it */
-            char message_part[line_len + 1];
-            memcpy(message_part, current_pos, line_len);
-            message_part[line_len] = '\0';
-
-            snprintf(log_line_buffer, sizeof(log_line_buffer),
-                    "%lu %s %s", /* Format: SeqNum Timestamp Message */
-                    sequence_number,
-                    timestamp_buffer,
-                    message_part);
-
-            if (fprintf(log_file, "%s\n", log_line_buffer) < 0) {
+            /* Format: SeqNum Timestamp Message; FATAL messages are written out at once */
+            int written = fprintf(log_out.file, "%lu %s %.*s\n", sequence_number, timestamp_buffer, line_len, current_pos);
+            if (written < 0) {
                 perror("Log Process ERROR: Failed to write to log file");
-                fprintf(stderr, "Log Process ERROR: Failed to write: %s\n", log_line_buffer);
             } else {
-                fflush(log_file);
+                bool fatal = (size_t)line_len > TIMESTAMP_LENGTH + 1 + strlen(fatal_tag) &&
+                             memcmp(current_pos + TIMESTAMP_LENGTH + 1, fatal_tag, strlen(fatal_tag)) == 0;
+                output_wrote(&log_out, (size_t)written, fatal);
             }
 
             sequence_number++;
@@ -164,26 +535,32 @@ void run_log_process(void) {
         if (processed_len > 0) {
             assembly_buffer_len -= processed_len;
             memmove(assembly_buffer, current_pos, assembly_buffer_len); /* Use memmove for overlapping regions */
+        } else if (assembly_buffer_len == ASSEMBLY_BUFFER_SIZE - 1) {
+            /* No newline in a full buffer: should not happen, lines are at most PIPE_BUF long */
+            fprintf(stderr, "Log Process ERROR: Assembly buffer overflow. Log messages might be lost/corrupted.\n");
+            fprintf(log_out.file, "0 %s Log Process ERROR: Assembly buffer overflow.\n", timestamp_buffer);
+            assembly_buffer_len = 0; /* Reset buffer */
+        }
+
+        /* Rotate between reads; the sequence numbers go on in the new file */
+        reap_compressors(false);
+        if (output_due(&log_out) && !output_rotate(&log_out)) {
+            break;
         }
     } /* End of main while loop */
+    batch_flush();
 
     /* Process any remaining data in the assembly buffer after EOF */
-    if (assembly_buffer_len > 0) {
+    if (assembly_buffer_len > 0 && log_out.file != NULL) {
         fprintf(stderr, "Log Process WARN: Processing remaining partial message after FIFO closed.\n"); /* Info */
         assembly_buffer[assembly_buffer_len] = '\0'; /* Null-terminate */
 
-        time(&current_time);
-        local_time = localtime(&current_time);
-        strftime(timestamp_buffer, sizeof(timestamp_buffer), TIMESTAMP_FORMAT, local_time);
-
-        snprintf(log_line_buffer, sizeof(log_line_buffer),
-                "%lu %s %s [PARTIAL/EOF]", /* Mark as partial */
+        format_timestamp(timestamp_buffer, sizeof(timestamp_buffer));
+        fprintf(log_out.file, "%lu %s %s [PARTIAL/EOF]\n", /* Mark as partial */
                 sequence_number,
                 timestamp_buffer,
                 assembly_buffer);
-
-        fprintf(log_file, "%s\n", log_line_buffer);
-        fflush(log_file);
+        fflush(log_out.file);
         sequence_number++;
     }
 
@@ -192,10 +569,12 @@ void run_log_process(void) {
     if (fifo_fd != -1) {
         close(fifo_fd);
     }
-    if (log_file != NULL) {
-        fprintf(log_file, "%lu %s Log process finished.\n", sequence_number, timestamp_buffer); /* Final log message */
-        fclose(log_file);
+    log_shm_destroy();
+    if (log_out.file != NULL) {
+        fprintf(log_out.file, "%lu %s Log process finished.\n", sequence_number, timestamp_buffer); /* Final log message */
+        fclose(log_out.file);
     }
+    reap_compressors(true); /* Let the last rotated file finish compressing */
     if (assembly_buffer != NULL) {
         free(assembly_buffer);
     }
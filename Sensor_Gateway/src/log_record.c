@@ -0,0 +1,433 @@
+/* --- Include Standard Libraries --- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>     /* For ptrdiff_t */
+#include <time.h>
+#include <ctype.h>
+
+/* --- Include Project-Specific Headers --- */
+#include "log_record.h"
+
+/* --- Local Macros and Types --- */
+
+#define LOG_STRING_NULL 0xffffu      /* String length standing for a NULL pointer */
+#define LOG_SPEC_MAX 32              /* Longest conversion specification rendered */
+
+/* One conversion specification of a format, as found by scan_spec() */
+typedef struct {
+    char type;                       /* Signature character, 0 for "%%", '?' if unsupported */
+    int stars;                       /* '*' width and precision arguments before the value */
+} log_spec_t;
+
+/* A dictionary slot; text is NULL when free */
+struct log_format_entry {
+    uint64_t id;
+    char *text;
+};
+
+/* Level tags in log_level_t order */
+static const char *level_tags[] = {
+    "[FATAL]  ",
+    "[ERROR]  ",
+    "[WARNING]",
+    "[INFO]   ",
+    "[DEBUG]  "
+};
+
+/* --- Local Helper Functions --- */
+
+/**
+ * @brief Scans the conversion specification following a '%'.
+ * @param p The character after the '%'.
+ * @param spec Receives the argument type and the '*' count.
+ * @return The character after the specification.
+ */
+static const char *scan_spec(const char *p, log_spec_t *spec) {
+    char length = 0;  /* 'H' for hh, 'h', 'l', 'q' for ll, 'L', 'j', 'z' or 't' */
+
+    spec->stars = 0;
+    while (*p != '\0' && strchr("-+ #0'", *p) != NULL) p++;
+    if (*p == '*') {
+        spec->stars++;
+        p++;
+    } else {
+        while (isdigit((unsigned char)*p)) p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->stars++;
+            p++;
+        } else {
+            while (isdigit((unsigned char)*p)) p++;
+        }
+    }
+    switch (*p) {
+        case 'h': length = (p[1] == 'h') ? 'H' : 'h'; p += (length == 'H') ? 2 : 1; break;
+        case 'l': length = (p[1] == 'l') ? 'q' : 'l'; p += (length == 'q') ? 2 : 1; break;
+        case 'q': case 'L': case 'j': case 'z': case 't': length = *p++; break;
+        default: break;
+    }
+
+    switch (*p) {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            spec->type = (length == 0 || length == 'h' || length == 'H') ? 'i' : (length == 'L' ? 'q' : length);
+            break;
+        case 'c':
+            spec->type = (length == 'l') ? '?' : 'i';
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            spec->type = (length == 'L') ? 'D' : 'd';
+            break;
+        case 's':
+            spec->type = (length == 'l') ? '?' : 's';
+            break;
+        case 'p':
+            spec->type = 'p';
+            break;
+        case '%':
+            spec->type = (spec->stars == 0) ? 0 : '?';
+            break;
+        default:
+            spec->type = '?'; /* %n, %m, wide and unknown conversions */
+            return (*p == '\0') ? p : p + 1;
+    }
+    return p + 1;
+}
+
+/** @brief Encoded size of an argument, a string counting its length field only. */
+static size_t arg_size(char type) {
+    switch (type) {
+        case 'i': return 4;
+        case 's': return 2;
+        default: return 8;
+    }
+}
+
+static void put_header(uint8_t *buffer, uint16_t size, uint8_t type, uint8_t level,
+                       uint64_t format_id, int64_t time_us) {
+    memcpy(buffer, &size, 2);
+    buffer[2] = type;
+    buffer[3] = level;
+    memcpy(buffer + 4, &format_id, 8);
+    memcpy(buffer + 12, &time_us, 8);
+}
+
+/* --- Public Functions --- */
+
+bool log_signature_parse(const char *format, log_signature_t *signature) {
+    signature->supported = true;
+    signature->count = 0;
+
+    for (const char *p = format; *p != '\0'; ) {
+        if (*p++ != '%') continue;
+        log_spec_t spec;
+        p = scan_spec(p, &spec);
+        if (spec.type == '?' || signature->count + spec.stars + (spec.type != 0) > LOG_RECORD_MAX_ARGS) {
+            signature->supported = false;
+            return false;
+        }
+        for (int i = 0; i < spec.stars; ++i) {
+            signature->types[signature->count++] = 'i';
+        }
+        if (spec.type != 0) {
+            signature->types[signature->count++] = spec.type;
+        }
+    }
+    return true;
+}
+
+size_t log_record_encode(uint8_t *buffer, int level, int64_t time_us, uint64_t format_id,
+                         const log_signature_t *signature, va_list args) {
+    size_t pos = LOG_RECORD_HEADER_SIZE;
+    size_t reserved = 0; /* Room kept for the arguments not yet encoded */
+
+    for (int i = 0; i < signature->count; ++i) {
+        reserved += arg_size(signature->types[i]);
+    }
+
+    for (int i = 0; i < signature->count; ++i) {
+        char type = signature->types[i];
+        int64_t value = 0;
+        reserved -= arg_size(type);
+
+        switch (type) {
+            case 'i': {
+                int32_t v = va_arg(args, int);
+                memcpy(buffer + pos, &v, 4);
+                pos += 4;
+                continue;
+            }
+            case 'l': value = va_arg(args, long); break;
+            case 'q': value = va_arg(args, long long); break;
+            case 'j': value = va_arg(args, intmax_t); break;
+            case 'z': value = (int64_t)va_arg(args, size_t); break;
+            case 't': value = va_arg(args, ptrdiff_t); break;
+            case 'p': value = (int64_t)(uintptr_t)va_arg(args, void *); break;
+            case 'd': case 'D': {
+                double v = (type == 'D') ? (double)va_arg(args, long double) : va_arg(args, double);
+                memcpy(buffer + pos, &v, 8);
+                pos += 8;
+                continue;
+            }
+            case 's': {
+                const char *s = va_arg(args, const char *);
+                uint16_t length = LOG_STRING_NULL;
+                if (s != NULL) {
+                    length = (uint16_t)strnlen(s, LOG_RECORD_MAX_SIZE - pos - 2 - reserved);
+                }
+                memcpy(buffer + pos, &length, 2);
+                pos += 2;
+                if (s != NULL) {
+                    memcpy(buffer + pos, s, length);
+                    pos += length;
+                }
+                continue;
+            }
+            default: break;
+        }
+        memcpy(buffer + pos, &value, 8);
+        pos += 8;
+    }
+
+    put_header(buffer, (uint16_t)pos, LOG_RECORD_MESSAGE, (uint8_t)level, format_id, time_us);
+    return pos;
+}
+
+size_t log_record_encode_format(uint8_t *buffer, uint64_t format_id, const char *format) {
+    size_t length = strlen(format);
+    if (length > LOG_RECORD_MAX_SIZE - LOG_RECORD_HEADER_SIZE) {
+        return 0;
+    }
+    memcpy(buffer + LOG_RECORD_HEADER_SIZE, format, length);
+    put_header(buffer, (uint16_t)(LOG_RECORD_HEADER_SIZE + length), LOG_RECORD_FORMAT, 0, format_id, 0);
+    return LOG_RECORD_HEADER_SIZE + length;
+}
+
+size_t log_record_encode_text(uint8_t *buffer, int level, int64_t time_us, const char *text, size_t length) {
+    if (length > LOG_RECORD_MAX_SIZE - LOG_RECORD_HEADER_SIZE) {
+        length = LOG_RECORD_MAX_SIZE - LOG_RECORD_HEADER_SIZE;
+    }
+    memcpy(buffer + LOG_RECORD_HEADER_SIZE, text, length);
+    put_header(buffer, (uint16_t)(LOG_RECORD_HEADER_SIZE + length), LOG_RECORD_TEXT, (uint8_t)level, 0, time_us);
+    return LOG_RECORD_HEADER_SIZE + length;
+}
+
+int log_record_peek(const uint8_t *buffer, size_t available, log_record_header_t *header) {
+    if (available < LOG_RECORD_HEADER_SIZE) {
+        return 0;
+    }
+    memcpy(&header->size, buffer, 2);
+    header->type = buffer[2];
+    header->level = buffer[3];
+    memcpy(&header->format_id, buffer + 4, 8);
+    memcpy(&header->time_us, buffer + 12, 8);
+
+    if (header->size < LOG_RECORD_HEADER_SIZE || header->size > LOG_RECORD_MAX_SIZE ||
+        header->type < LOG_RECORD_MESSAGE || header->type > LOG_RECORD_TEXT) {
+        return -1;
+    }
+    return (available >= header->size) ? 1 : 0;
+}
+
+const char *log_record_level_tag(int level) {
+    if (level < 0 || level >= (int)(sizeof(level_tags) / sizeof(level_tags[0]))) {
+        return "[UNKNOWN]";
+    }
+    return level_tags[level];
+}
+
+/**
+ * @brief Looks up the format text of an ID.
+ * @return The text, or NULL if the ID is unknown.
+ */
+static const char *dict_find(const log_dict_t *dict, uint64_t id) {
+    if (dict->capacity == 0) {
+        return NULL;
+    }
+    size_t mask = dict->capacity - 1;
+    for (size_t i = (size_t)(id * 0x9e3779b97f4a7c15ull >> 32) & mask; ; i = (i + 1) & mask) {
+        if (dict->entries[i].text == NULL) return NULL;
+        if (dict->entries[i].id == id) return dict->entries[i].text;
+    }
+}
+
+size_t log_record_render(const uint8_t *record, const log_record_header_t *header,
+                         const log_dict_t *dict, char *line, size_t size) {
+    time_t seconds = (time_t)(header->time_us / 1000000);
+    struct tm local_time;
+    size_t pos;
+
+    localtime_r(&seconds, &local_time);
+    pos = strftime(line, size, "%Y-%m-%d %H:%M:%S ", &local_time);
+    pos += (size_t)snprintf(line + pos, size - pos, "%s", log_record_level_tag(header->level));
+    if (pos >= size) {
+        return size - 1;
+    }
+
+    const uint8_t *arg = record + LOG_RECORD_HEADER_SIZE;
+    const uint8_t *end = record + header->size;
+
+    if (header->type == LOG_RECORD_TEXT) {
+        size_t length = (size_t)(end - arg);
+        if (length > size - pos - 1) length = size - pos - 1;
+        memcpy(line + pos, arg, length);
+        line[pos + length] = '\0';
+        return pos + length;
+    }
+
+    const char *format = dict_find(dict, header->format_id);
+    if (format == NULL) {
+        pos += (size_t)snprintf(line + pos, size - pos, "<unknown format 0x%llx>",
+                                (unsigned long long)header->format_id);
+        return (pos >= size) ? size - 1 : pos;
+    }
+
+    for (const char *p = format; *p != '\0' && pos < size - 1; ) {
+        if (*p != '%') {
+            line[pos++] = *p++;
+            continue;
+        }
+        const char *start = p++;
+        log_spec_t spec;
+        p = scan_spec(p, &spec);
+        if (spec.type == 0) {
+            line[pos++] = '%';
+            continue;
+        }
+
+        char conversion[LOG_SPEC_MAX];
+        size_t spec_length = (size_t)(p - start);
+        size_t needed = (size_t)spec.stars * 4 + ((spec.type == 's') ? 2 : arg_size(spec.type));
+        if (spec.type == '?' || spec_length >= sizeof(conversion) || (size_t)(end - arg) < needed) {
+            pos += (size_t)snprintf(line + pos, size - pos, "<bad argument>");
+            break;
+        }
+        memcpy(conversion, start, spec_length);
+        conversion[spec_length] = '\0';
+
+        int stars[2] = { 0, 0 };
+        for (int i = 0; i < spec.stars; ++i) {
+            int32_t v;
+            memcpy(&v, arg, 4);
+            arg += 4;
+            stars[i] = v;
+        }
+
+        char *dst = line + pos;
+        size_t room = size - pos;
+        int written;
+#define RENDER(value) \
+        (spec.stars == 0 ? snprintf(dst, room, conversion, value) : \
+         spec.stars == 1 ? snprintf(dst, room, conversion, stars[0], value) : \
+                           snprintf(dst, room, conversion, stars[0], stars[1], value))
+        switch (spec.type) {
+            case 'i': { int32_t v; memcpy(&v, arg, 4); arg += 4; written = RENDER((int)v); break; }
+            case 'd': case 'D': {
+                double v;
+                memcpy(&v, arg, 8);
+                arg += 8;
+                written = (spec.type == 'D') ? RENDER((long double)v) : RENDER(v);
+                break;
+            }
+            case 's': {
+                uint16_t length;
+                memcpy(&length, arg, 2);
+                arg += 2;
+                if (length == LOG_STRING_NULL) {
+                    written = RENDER((const char *)NULL);
+                    break;
+                }
+                if (length > (size_t)(end - arg)) length = (uint16_t)(end - arg);
+                char text[LOG_RECORD_MAX_SIZE];
+                memcpy(text, arg, length);
+                text[length] = '\0';
+                arg += length;
+                written = RENDER(text);
+                break;
+            }
+            default: {
+                int64_t v;
+                memcpy(&v, arg, 8);
+                arg += 8;
+                switch (spec.type) {
+                    case 'l': written = RENDER((long)v); break;
+                    case 'q': written = RENDER((long long)v); break;
+                    case 'j': written = RENDER((intmax_t)v); break;
+                    case 'z': written = RENDER((size_t)v); break;
+                    case 't': written = RENDER((ptrdiff_t)v); break;
+                    default:  written = RENDER((void *)(uintptr_t)v); break;
+                }
+                break;
+            }
+        }
+#undef RENDER
+        if (written > 0) {
+            pos += (size_t)written;
+        }
+    }
+
+    if (pos >= size) {
+        pos = size - 1;
+    }
+    line[pos] = '\0';
+    return pos;
+}
+
+void log_dict_init(log_dict_t *dict) {
+    dict->entries = NULL;
+    dict->count = 0;
+    dict->capacity = 0;
+}
+
+gateway_error_t log_dict_add(log_dict_t *dict, const uint8_t *record, const log_record_header_t *header) {
+    size_t length = header->size - LOG_RECORD_HEADER_SIZE;
+    char *text = malloc(length + 1);
+    if (text == NULL) {
+        return GATEWAY_ERROR_NOMEM;
+    }
+    memcpy(text, record + LOG_RECORD_HEADER_SIZE, length);
+    text[length] = '\0';
+
+    /* Keep at most half the slots in use */
+    if ((dict->count + 1) * 2 > dict->capacity) {
+        size_t capacity = dict->capacity ? dict->capacity * 2 : 256;
+        struct log_format_entry *entries = calloc(capacity, sizeof(*entries));
+        if (entries == NULL) {
+            free(text);
+            return GATEWAY_ERROR_NOMEM;
+        }
+        for (size_t i = 0; i < dict->capacity; ++i) {
+            if (dict->entries[i].text == NULL) continue;
+            size_t j = (size_t)(dict->entries[i].id * 0x9e3779b97f4a7c15ull >> 32) & (capacity - 1);
+            while (entries[j].text != NULL) j = (j + 1) & (capacity - 1);
+            entries[j] = dict->entries[i];
+        }
+        free(dict->entries);
+        dict->entries = entries;
+        dict->capacity = capacity;
+    }
+
+    size_t mask = dict->capacity - 1;
+    size_t i = (size_t)(header->format_id * 0x9e3779b97f4a7c15ull >> 32) & mask;
+    while (dict->entries[i].text != NULL && dict->entries[i].id != header->format_id) {
+        i = (i + 1) & mask;
+    }
+    if (dict->entries[i].text != NULL) {
+        free(dict->entries[i].text); /* A restarted gateway may reuse an ID */
+    } else {
+        dict->count++;
+    }
+    dict->entries[i].id = header->format_id;
+    dict->entries[i].text = text;
+    return GATEWAY_SUCCESS;
+}
+
+void log_dict_free(log_dict_t *dict) {
+    for (size_t i = 0; i < dict->capacity; ++i) {
+        free(dict->entries[i].text);
+    }
+    free(dict->entries);
+    log_dict_init(dict);
+}
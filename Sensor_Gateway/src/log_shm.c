@@ -0,0 +1,243 @@
+/* --- Include Standard Libraries --- */
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>   /* For the ring positions and slot sequences */
+#include <unistd.h>      /* For read(), write(), close(), getpid(), getppid() */
+#include <poll.h>        /* For waiting on the doorbell */
+#include <sys/mman.h>    /* For mmap() */
+#include <sys/eventfd.h> /* For the doorbell */
+
+/* --- Include Project-Specific Headers --- */
+#include "config.h"     /* For LOG_SHM_* */
+#include "log_shm.h"
+
+/* --- Local Macros and Types --- */
+
+#define LOG_SHM_CACHE_LINE 64
+#define LOG_SHM_MASK ((uint32_t)LOG_SHM_SLOTS - 1)
+#define LOG_SHM_SLOT_DATA (LOG_SHM_SLOT_BYTES - 2 * sizeof(uint32_t))     /* Message bytes per slot */
+#define LOG_SHM_SLOTS_FOR(len) ((len) == 0 ? 1 : ((len) + LOG_SHM_SLOT_DATA - 1) / LOG_SHM_SLOT_DATA)
+
+#if (LOG_SHM_SLOTS & (LOG_SHM_SLOTS - 1)) != 0 || LOG_SHM_SLOTS < 4 * (LOG_SHM_MAX_MESSAGE / (LOG_SHM_SLOT_BYTES - 8) + 1)
+#error "LOG_SHM_SLOTS must be a power of two holding a few of the longest messages"
+#endif
+
+/* One slot. Its sequence is its position while free for that position, position + 1 once the
+ * writer published it, and position + LOG_SHM_SLOTS once the log process read it. */
+typedef struct {
+    atomic_uint sequence;
+    uint32_t length;                    /* Message length, in the first slot of a message */
+    char data[LOG_SHM_SLOT_DATA];
+} log_shm_slot_t;
+
+/* The shared region; positions are running counts that wrap with the sequences */
+typedef struct {
+    _Alignas(LOG_SHM_CACHE_LINE) atomic_uint enqueue_pos; /* Next position a writer claims */
+    _Alignas(LOG_SHM_CACHE_LINE) unsigned int dequeue_pos; /* Next position read, log process only */
+    atomic_uint reader_waiting;         /* The log process is about to sleep on the doorbell */
+    _Alignas(LOG_SHM_CACHE_LINE) atomic_bool closed; /* The gateway sends no more messages */
+    pid_t writer_pid;                   /* The gateway, the parent of the log process */
+    _Alignas(LOG_SHM_CACHE_LINE) log_shm_slot_t slots[LOG_SHM_SLOTS];
+} log_shm_region_t;
+
+/* Static variables of the module, inherited by the log process across fork() */
+static log_shm_region_t *region = NULL;
+static int doorbell_fd = -1;
+static bool writer_gone = false;        /* Log process only: the gateway died without closing */
+
+/* --- Local Helper Functions --- */
+
+/** @brief Wakes the log process. */
+static void ring_doorbell(void) {
+    uint64_t one = 1;
+    ssize_t n = write(doorbell_fd, &one, sizeof(one)); /* Only fails if the counter is saturated */
+    (void)n;
+}
+
+/** @brief Tells whether the oldest unread message is published (log process only). */
+static bool message_ready(void) {
+    log_shm_slot_t *slot = &region->slots[region->dequeue_pos & LOG_SHM_MASK];
+    return atomic_load_explicit(&slot->sequence, memory_order_acquire) == region->dequeue_pos + 1;
+}
+
+/* --- Public Functions --- */
+
+gateway_error_t log_shm_create(void) {
+    if (region != NULL) {
+        return GATEWAY_SUCCESS;
+    }
+    log_shm_region_t *mapped = mmap(NULL, sizeof(log_shm_region_t), PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        return LOGGER_ERROR;
+    }
+    /* Not inherited by what the log process executes (gzip); non-blocking, see ring_doorbell() */
+    doorbell_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (doorbell_fd == -1) {
+        int saved = errno;
+        munmap(mapped, sizeof(log_shm_region_t));
+        errno = saved;
+        return LOGGER_ERROR;
+    }
+    /* The mapping starts zeroed: positions, flags */
+    for (uint32_t i = 0; i < LOG_SHM_SLOTS; ++i) {
+        atomic_init(&mapped->slots[i].sequence, i);
+    }
+    mapped->writer_pid = getpid();
+    region = mapped;
+    return GATEWAY_SUCCESS;
+}
+
+bool log_shm_available(void) {
+    return region != NULL;
+}
+
+bool log_shm_send(const void *message, size_t len) {
+    if (region == NULL || len > LOG_SHM_MAX_MESSAGE) {
+        return false;
+    }
+    uint32_t count = (uint32_t)LOG_SHM_SLOTS_FOR(len);
+    unsigned int pos = atomic_load_explicit(&region->enqueue_pos, memory_order_relaxed);
+
+    /* Claim count slots. The log process frees slots in order, so once the last of them is
+     * free for this lap all are. */
+    for (;;) {
+        unsigned int last = pos + count - 1;
+        unsigned int sequence = atomic_load_explicit(&region->slots[last & LOG_SHM_MASK].sequence,
+                                                     memory_order_acquire);
+        int diff = (int)(sequence - last);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&region->enqueue_pos, &pos, pos + count,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false; /* Still holds a message of the previous lap: full */
+        } else {
+            pos = atomic_load_explicit(&region->enqueue_pos, memory_order_relaxed); /* Claimed meanwhile */
+        }
+    }
+
+    const char *src = message;
+    region->slots[pos & LOG_SHM_MASK].length = (uint32_t)len;
+    for (uint32_t i = 0; i < count; ++i) {
+        log_shm_slot_t *slot = &region->slots[(pos + i) & LOG_SHM_MASK];
+        size_t chunk = len > LOG_SHM_SLOT_DATA ? LOG_SHM_SLOT_DATA : len;
+        memcpy(slot->data, src, chunk);
+        src += chunk;
+        len -= chunk;
+        atomic_store_explicit(&slot->sequence, pos + i + 1, memory_order_release);
+    }
+
+    /* Ring only if the log process announced a sleep; the fence orders the publish before
+     * that check, as log_shm_wait() orders the announcement before its check of the ring */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&region->reader_waiting, memory_order_relaxed) &&
+        atomic_exchange_explicit(&region->reader_waiting, 0, memory_order_relaxed)) {
+        ring_doorbell();
+    }
+    return true;
+}
+
+void log_shm_close_writer(void) {
+    if (region == NULL) {
+        return;
+    }
+    atomic_store_explicit(&region->closed, true, memory_order_release);
+    ring_doorbell();
+}
+
+int log_shm_wait(int timeout_ms) {
+    if (region == NULL) {
+        return 1;
+    }
+    for (;;) {
+        atomic_store_explicit(&region->reader_waiting, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (message_ready() || atomic_load_explicit(&region->closed, memory_order_acquire)) {
+            break;
+        }
+        struct pollfd pfd = { .fd = doorbell_fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, timeout_ms < 0 ? LOG_SHM_IDLE_CHECK_MS : timeout_ms);
+        if (ready > 0) {
+            uint64_t rings;
+            ssize_t n = read(doorbell_fd, &rings, sizeof(rings)); /* Reset the doorbell */
+            (void)n;
+            break;
+        }
+        if (ready < 0 && errno != EINTR) {
+            break; /* Let log_shm_read() look at the ring */
+        }
+        if (ready == 0 && timeout_ms >= 0) {
+            atomic_store_explicit(&region->reader_waiting, 0, memory_order_relaxed);
+            return 0;
+        }
+        if (ready == 0 && getppid() != region->writer_pid) {
+            writer_gone = true; /* Reparented: the gateway will never close the ring */
+            break;
+        }
+    }
+    atomic_store_explicit(&region->reader_waiting, 0, memory_order_relaxed);
+    return 1;
+}
+
+ssize_t log_shm_read(void *buffer, size_t size) {
+    char *dest = buffer;
+    size_t copied = 0;
+    unsigned int pos = region->dequeue_pos;
+
+    for (;;) {
+        log_shm_slot_t *first = &region->slots[pos & LOG_SHM_MASK];
+        if (atomic_load_explicit(&first->sequence, memory_order_acquire) != pos + 1) {
+            break;
+        }
+        size_t len = first->length;
+        if (len > LOG_SHM_MAX_MESSAGE) {
+            len = LOG_SHM_MAX_MESSAGE; /* Never trust the length with our buffer */
+        }
+        uint32_t count = (uint32_t)LOG_SHM_SLOTS_FOR(len);
+        if (copied + len > size) {
+            break;
+        }
+        /* The writer may still be copying the rest of the message */
+        bool complete = true;
+        for (uint32_t i = 1; i < count && complete; ++i) {
+            log_shm_slot_t *slot = &region->slots[(pos + i) & LOG_SHM_MASK];
+            complete = atomic_load_explicit(&slot->sequence, memory_order_acquire) == pos + i + 1;
+        }
+        if (!complete) {
+            break;
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            log_shm_slot_t *slot = &region->slots[(pos + i) & LOG_SHM_MASK];
+            size_t chunk = len > LOG_SHM_SLOT_DATA ? LOG_SHM_SLOT_DATA : len;
+            memcpy(dest + copied, slot->data, chunk);
+            copied += chunk;
+            len -= chunk;
+            atomic_store_explicit(&slot->sequence, pos + i + LOG_SHM_SLOTS, memory_order_release);
+        }
+        pos += count;
+    }
+    region->dequeue_pos = pos;
+
+    if (copied > 0) {
+        return (ssize_t)copied;
+    }
+    if (writer_gone || atomic_load_explicit(&region->closed, memory_order_acquire)) {
+        return 0;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+void log_shm_destroy(void) {
+    if (region != NULL) {
+        munmap(region, sizeof(log_shm_region_t));
+        region = NULL;
+    }
+    if (doorbell_fd != -1) {
+        close(doorbell_fd);
+        doorbell_fd = -1;
+    }
+}
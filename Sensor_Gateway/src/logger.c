@@ -1,3 +1,4 @@
+#define _GNU_SOURCE     /* For pthread_setname_np() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,35 +10,500 @@
 #include <pthread.h>    /* For mutex */
 #include <limits.h>     /* For PIPE_BUF */
 #include <stdbool.h>    /* For bool */
+#include <stdint.h>     /* For uint32_t */
+#include <time.h>       /* For clock_gettime, nanosleep */
+#include <sys/uio.h>    /* For writev */
+#include <poll.h>       /* For waiting on a full FIFO */
 
 /* Include project-specific headers */
 #include "config.h"     /* For LOG_FIFO_NAME */
 #include "common.h"     /* For gateway_error_t */
 #include "logger.h"     /* For function declarations */
+#include "log_record.h" /* For binary records (LOG_BINARY) */
+#include "log_shm.h"    /* For the shared memory ring (LOG_SHM) */
+
+/* Define permissions for the FIFO (owner read/write, group read/write) */
+#define FIFO_PERMISSIONS 0660
+
+#define LOG_RING_MASK ((size_t)LOG_RING_BYTES - 1)
+#define LOG_RING_WRAP 0xffffffffu     /* Record length marking the rest of the ring as unused */
+#define LOG_RECORD_SIZE(len) (((size_t)(len) + sizeof(uint32_t) + 3) & ~(size_t)3) /* Length word + text, 4 aligned */
+#define LOG_FLUSH_IOV 256             /* Messages per writev() */
+#define LOG_BLOCK_WAIT_NS 200000L     /* Pause of a blocked writer between attempts (0.2 ms) */
+#define LOG_FORMAT_SLOTS 512          /* Formats a thread remembers having announced (LOG_BINARY) */
+#define LOG_LEVELS (LOG_LEVEL_DEBUG + 1)
+
+/* Outcome of ring_push() */
+typedef enum {
+    LOG_PUSH_DONE,              /* Copied at once */
+    LOG_PUSH_DELAYED,           /* Copied after waiting for the flusher */
+    LOG_PUSH_DROPPED            /* Not copied, the ring stayed full */
+} log_push_t;
+
+#if (LOG_RING_BYTES & (LOG_RING_BYTES - 1)) != 0 || LOG_RING_BYTES < 4 * PIPE_BUF
+#error "LOG_RING_BYTES must be a power of two holding a few messages"
+#endif
+
+/* A format string a thread has sent a format record for, with its argument types */
+typedef struct {
+    const char *format;         /* NULL if the slot is free */
+    log_signature_t signature;
+} log_format_slot_t;
+
+/**
+ * @brief Single producer, single consumer ring of log lines owned by one thread.
+ * The owning thread appends records (a length word, then the text) and advances head;
+ * the flusher thread reads them and advances tail. Both are running byte counts.
+ */
+typedef struct log_ring {
+    char data[LOG_RING_BYTES];
+    size_t head;                /* Written by the owner only (release) */
+    size_t tail;                /* Written by the flusher only (release) */
+    /* Per level message counts, written by the owner (relaxed), summed by logger_get_stats() */
+    unsigned long sent[LOG_LEVELS];    /* Copied into the ring */
+    unsigned long dropped[LOG_LEVELS]; /* Lost because the ring stayed full */
+    unsigned long delayed[LOG_LEVELS]; /* Copied after the thread waited for room */
+    struct log_ring *next;      /* Registration list */
+#if LOG_BINARY
+    log_format_slot_t formats[LOG_FORMAT_SLOTS]; /* Owner only */
+    size_t format_count;
+#endif
+} log_ring_t;
 
 /* Static variables for the logger module */
 static int fifo_fd = -1;            /* File descriptor for writing to the FIFO */
-static pthread_mutex_t log_mutex;   /* Mutex to ensure thread-safe writes to FIFO */
+static pthread_mutex_t log_mutex;   /* Guards the ring list and the flusher wake-up */
 static bool mutex_initialized = false; /* Tracks whether the mutex has been initialized */
 static bool fifo_created = false;     /* Tracks whether the FIFO has been created */
+static bool shm_writing = false;      /* Messages go to the shared memory ring instead of the rings and FIFO */
 
-/* Define permissions for the FIFO (owner read/write, group read/write) */
-#define FIFO_PERMISSIONS 0660
+int logger_level = LOG_RUNTIME_LEVEL; /* Read by LOG_AT() without a lock */
+
+static log_ring_t *rings = NULL;      /* Every thread's ring, newest first */
+static __thread log_ring_t *thread_ring = NULL; /* The calling thread's ring */
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER; /* Wakes the flusher early */
+static pthread_t flusher_thread;
+static bool flusher_started = false;
+static bool flusher_stop = false;     /* Written under log_mutex, read atomically by the flusher */
+
+/* Written by the flusher only, read by logger_get_stats() */
+static unsigned long fifo_stalls = 0;   /* Writes that found the FIFO full */
+static unsigned long fifo_stall_us = 0; /* Time spent waiting for it to drain */
+
+/* Level names of logger_parse_level(), in log_level_t order */
+static const char *log_level_names[] = { "fatal", "error", "warning", "info", "debug" };
+
+/* --- Local Helper Functions --- */
+
+/**
+ * @brief Returns the calling thread's ring, registering a new one on its first message.
+ */
+static log_ring_t *get_thread_ring(void) {
+    if (thread_ring != NULL) {
+        return thread_ring;
+    }
+    log_ring_t *ring = calloc(1, sizeof(log_ring_t));
+    if (ring == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&log_mutex);
+    ring->next = rings;
+    __atomic_store_n(&rings, ring, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&log_mutex);
+    thread_ring = ring;
+    return ring;
+}
+
+static void wake_flusher(void) {
+    /* Signalling without the mutex may miss a wait in progress; LOG_FLUSH_INTERVAL_MS bounds that */
+    pthread_cond_signal(&flush_cond);
+}
+
+/** @brief Returns the microseconds from start to now (CLOCK_MONOTONIC). */
+static unsigned long elapsed_us(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)((now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000L);
+}
+
+/**
+ * @brief Decides what a thread does when there is no room for its message: gives up at once,
+ *        or, with LOG_RING_BLOCK_WHEN_FULL or must_keep, pauses briefly until it has waited
+ *        LOG_RING_MAX_WAIT_MS in all.
+ * @param result LOG_PUSH_DONE before the first wait, set to LOG_PUSH_DELAYED by it.
+ * @param wait_start Set by the first wait.
+ * @return true to try again, false to drop the message.
+ */
+static bool wait_for_room(bool must_keep, log_push_t *result, struct timespec *wait_start) {
+    if (!LOG_RING_BLOCK_WHEN_FULL && !must_keep) {
+        return false;
+    }
+    if (*result == LOG_PUSH_DONE) {
+        *result = LOG_PUSH_DELAYED;
+        clock_gettime(CLOCK_MONOTONIC, wait_start);
+    } else if (elapsed_us(wait_start) >= LOG_RING_MAX_WAIT_MS * 1000UL) {
+        return false;
+    }
+    struct timespec pause = { 0, LOG_BLOCK_WAIT_NS };
+    nanosleep(&pause, NULL);
+    return true;
+}
 
-/* Map log levels to their corresponding string representations */
-static const char* log_level_strings[] = {
-    "[FATAL]  ",
-    "[ERROR]  ",
-    "[WARNING]",
-    "[INFO]   ",
-    "[DEBUG]  "
-};
+/**
+ * @brief Appends one line to a ring. Only the owning thread calls this.
+ * A full ring drops the line at once, or, with LOG_RING_BLOCK_WHEN_FULL or must_keep,
+ * after waiting up to LOG_RING_MAX_WAIT_MS for the flusher, so logging never stalls a thread for long.
+ * @param must_keep Wait for room even when LOG_RING_BLOCK_WHEN_FULL is 0.
+ * @return Whether the line was copied, and if the thread had to wait for it.
+ */
+static log_push_t ring_push(log_ring_t *ring, const char *line, size_t len, bool must_keep) {
+    size_t record = LOG_RECORD_SIZE(len);
+    size_t head = ring->head;
+    size_t offset, contiguous, needed;
+    log_push_t result = LOG_PUSH_DONE;
+    struct timespec wait_start;
+
+    for (;;) {
+        size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        offset = head & LOG_RING_MASK;
+        contiguous = LOG_RING_BYTES - offset;
+        needed = (contiguous < record) ? contiguous + record : record; /* A record never wraps */
+        if (LOG_RING_BYTES - (head - tail) >= needed) {
+            break;
+        }
+        wake_flusher();
+        if (!__atomic_load_n(&flusher_started, __ATOMIC_ACQUIRE) || !wait_for_room(must_keep, &result, &wait_start)) {
+            return LOG_PUSH_DROPPED;
+        }
+    }
+
+    if (contiguous < record) {
+        *(uint32_t *)(ring->data + offset) = LOG_RING_WRAP;
+        head += contiguous;
+        offset = 0;
+    }
+    *(uint32_t *)(ring->data + offset) = (uint32_t)len;
+    memcpy(ring->data + offset + sizeof(uint32_t), line, len);
+    __atomic_store_n(&ring->head, head + record, __ATOMIC_RELEASE);
+
+    if ((head + record) - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) > LOG_RING_BYTES / 2) {
+        wake_flusher(); /* Don't wait for the interval once the ring is half full */
+    }
+    return result;
+}
+
+/**
+ * @brief Hands one message to the log process: straight into the shared memory ring when it is
+ *        in use, with the full-ring policy of ring_push(), otherwise into the thread's ring.
+ */
+static log_push_t push_message(log_ring_t *ring, const char *line, size_t len, bool must_keep) {
+    if (!shm_writing) {
+        return ring_push(ring, line, len, must_keep);
+    }
+    log_push_t result = LOG_PUSH_DONE;
+    struct timespec wait_start;
+    while (!log_shm_send(line, len)) {
+        if (!wait_for_room(must_keep, &result, &wait_start)) {
+            return LOG_PUSH_DROPPED;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Counts one message of the owning thread in its ring by how ring_push() went.
+ */
+static void ring_count(log_ring_t *ring, log_level_t level, log_push_t result) {
+    unsigned long *counter = (result == LOG_PUSH_DROPPED) ? &ring->dropped[level] : &ring->sent[level];
+    __atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+    if (result == LOG_PUSH_DELAYED) {
+        __atomic_store_n(&ring->delayed[level], ring->delayed[level] + 1, __ATOMIC_RELAXED);
+    }
+}
+
+#if LOG_BINARY
+/** @brief Returns the wall clock in microseconds, the timestamp of binary records. */
+static int64_t now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * @brief Returns the signature of a format, announcing the format with a format record the
+ *        first time the calling thread uses it. Formats are told apart by address, which is
+ *        also their ID, so they must be string literals (as every call site passes).
+ * @param scratch Holds the signature when the thread's format table is full.
+ * @param result Set to how pushing the format record went (LOG_PUSH_DONE if none was needed).
+ * @return The signature, or NULL if the format record was dropped (so is the message).
+ */
+static const log_signature_t *lookup_format(log_ring_t *ring, const char *format, log_signature_t *scratch,
+                                            bool must_keep, log_push_t *result) {
+    size_t mask = LOG_FORMAT_SLOTS - 1;
+    *result = LOG_PUSH_DONE;
+    size_t i = (size_t)(((uintptr_t)format * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+    while (ring->formats[i].format != NULL) {
+        if (ring->formats[i].format == format) {
+            return &ring->formats[i].signature;
+        }
+        i = (i + 1) & mask;
+    }
+
+    log_signature_t *signature = scratch;
+    if (ring->format_count < LOG_FORMAT_SLOTS * 3 / 4) {
+        signature = &ring->formats[i].signature;
+    }
+    uint8_t record[LOG_RECORD_MAX_SIZE];
+    size_t size = 0;
+    if (log_signature_parse(format, signature)) {
+        size = log_record_encode_format(record, (uint64_t)(uintptr_t)format, format);
+        signature->supported = (size > 0);
+    }
+    if (size > 0 && (*result = push_message(ring, (const char *)record, size, must_keep)) == LOG_PUSH_DROPPED) {
+        return NULL; /* Not remembered, so the next message retries */
+    }
+    if (signature != scratch) {
+        ring->formats[i].format = format;
+        ring->format_count++;
+    }
+    return signature;
+}
+#else
+/**
+ * @brief Formats a complete log line with the timestamp and level prefix.
+ * @return The line length (at most size - 1), or -1 on a formatting error.
+ */
+static int format_line(char *buffer, size_t size, log_level_t level, const char *message) {
+    time_t now = time(NULL);
+    struct tm local_time;
+    char time_str[30]; /* Buffer for "YYYY-MM-DD HH:MM:SS" */
+
+    localtime_r(&now, &local_time);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &local_time);
+    int len = snprintf(buffer, size, "%s %s%s\n", time_str, log_record_level_tag(level), message);
+    if (len >= 0 && (size_t)len >= size) {
+        fprintf(stderr, "Logger WARN: Final log message truncated before writing to FIFO.\n");
+        buffer[size - 1] = '\n';
+        buffer[size - 2] = '.';
+        buffer[size - 3] = '.';
+        buffer[size - 4] = '.';
+        len = (int)size - 1;
+    }
+    return len;
+}
+#endif
+
+/**
+ * @brief Builds a warning of the logger itself in the encoding of the FIFO stream.
+ * @return The length (at most size), or -1 on an error.
+ */
+static int format_report(char *buffer, size_t size, const char *message) {
+#if LOG_BINARY
+    uint8_t record[LOG_RECORD_MAX_SIZE];
+    size_t len = log_record_encode_text(record, LOG_LEVEL_WARNING, now_us(), message, strlen(message));
+    if (len > size) {
+        return -1;
+    }
+    memcpy(buffer, record, len);
+    return (int)len;
+#else
+    return format_line(buffer, size, LOG_LEVEL_WARNING, message);
+#endif
+}
+
+/**
+ * @brief Writes all iovecs to the non-blocking FIFO, resuming after partial writes.
+ * While the FIFO is full the flusher waits for it (counted in fifo_stalls); only the rings
+ * fill up meanwhile. Once stopping, it gives up after LOG_SHUTDOWN_WAIT_MS.
+ * @return false if the FIFO failed (it is closed on EPIPE) or stayed full at shutdown.
+ */
+static bool write_all(struct iovec *iov, int count) {
+    bool stalled = false;
+    struct timespec stall_start;
+
+    while (count > 0) {
+        ssize_t written = writev(fifo_fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                if (!stalled) {
+                    stalled = true;
+                    clock_gettime(CLOCK_MONOTONIC, &stall_start);
+                    __atomic_store_n(&fifo_stalls, fifo_stalls + 1, __ATOMIC_RELAXED);
+                } else if (__atomic_load_n(&flusher_stop, __ATOMIC_RELAXED) &&
+                           elapsed_us(&stall_start) >= LOG_SHUTDOWN_WAIT_MS * 1000UL) {
+                    fprintf(stderr, "Logger ERROR: Log process stopped reading, discarding the remaining messages.\n");
+                    break;
+                }
+                struct pollfd pfd = { .fd = fifo_fd, .events = POLLOUT };
+                poll(&pfd, 1, LOG_FLUSH_INTERVAL_MS);
+                continue;
+            }
+            if (errno == EPIPE) {
+                fprintf(stderr, "Logger ERROR: FIFO write failed (Broken pipe - log process likely dead).\n");
+                close(fifo_fd);
+                fifo_fd = -1;
+            } else {
+                perror("Logger ERROR: Failed to write to FIFO");
+            }
+            break;
+        }
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+    if (stalled) {
+        __atomic_store_n(&fifo_stall_us, fifo_stall_us + elapsed_us(&stall_start), __ATOMIC_RELAXED);
+    }
+    return count == 0;
+}
+
+/**
+ * @brief Drains every ring into the FIFO with batched writev() calls.
+ * Lines of one thread keep their order; lines of different threads are interleaved per batch.
+ * @return true if anything was written.
+ */
+static bool flush_rings(void) {
+    struct iovec iov[LOG_FLUSH_IOV];
+    bool any = false;
+    bool more = true;
+
+    while (more && fifo_fd >= 0) {
+        more = false;
+
+        for (log_ring_t *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+            int count = 0;
+            size_t tail = ring->tail;
+            size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+            while (tail != head && count < LOG_FLUSH_IOV) {
+                size_t offset = tail & LOG_RING_MASK;
+                uint32_t len = *(uint32_t *)(ring->data + offset);
+                if (len == LOG_RING_WRAP) {
+                    tail += LOG_RING_BYTES - offset;
+                    continue;
+                }
+                iov[count].iov_base = ring->data + offset + sizeof(uint32_t);
+                iov[count++].iov_len = len;
+                tail += LOG_RECORD_SIZE(len);
+            }
+            /* The lines stay in the ring until written; the writer may reuse the space after that */
+            if (tail != ring->tail) {
+                if (count == LOG_FLUSH_IOV) {
+                    more = true;
+                }
+                if (!write_all(iov, count)) {
+                    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE); /* The FIFO is gone, discard */
+                    return any;
+                }
+                __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+                any = true;
+            }
+        }
+    }
+    return any;
+}
+
+/**
+ * @brief Logs what the rings and the FIFO lost or delayed since the previous report, if anything.
+ * Called by the flusher every LOG_STATS_INTERVAL_SEC and when it stops.
+ */
+static void report_backpressure(void) {
+    static logger_stats_t reported; /* Flusher only */
+    logger_stats_t now;
+    unsigned long dropped[LOG_LEVELS], delayed[LOG_LEVELS];
+    unsigned long total_dropped = 0, total_delayed = 0;
+
+    logger_get_stats(&now);
+    for (int i = 0; i < LOG_LEVELS; ++i) {
+        dropped[i] = now.dropped[i] - reported.dropped[i];
+        delayed[i] = now.delayed[i] - reported.delayed[i];
+        total_dropped += dropped[i];
+        total_delayed += delayed[i];
+    }
+    unsigned long stalls = now.fifo_stalls - reported.fifo_stalls;
+    if (total_dropped == 0 && total_delayed == 0 && stalls == 0) {
+        return;
+    }
+
+    char message[256];
+    char line[LOG_RECORD_MAX_SIZE];
+    snprintf(message, sizeof(message),
+             "Logger backpressure: %lu dropped (fatal %lu, error %lu, warning %lu, info %lu, debug %lu), "
+             "%lu delayed (fatal %lu, error %lu, warning %lu, info %lu, debug %lu), FIFO full %lu times (%.1f ms).",
+             total_dropped, dropped[0], dropped[1], dropped[2], dropped[3], dropped[4],
+             total_delayed, delayed[0], delayed[1], delayed[2], delayed[3], delayed[4],
+             stalls, (now.fifo_stall_us - reported.fifo_stall_us) / 1000.0);
+    int len = format_report(line, sizeof(line), message);
+    if (len > 0 && shm_writing) {
+        log_shm_send(line, (size_t)len);
+    } else if (len > 0 && fifo_fd >= 0) {
+        struct iovec iov = { line, (size_t)len };
+        write_all(&iov, 1);
+    }
+    reported = now;
+}
+
+/**
+ * @brief Flusher thread: drains the rings every LOG_FLUSH_INTERVAL_MS, or sooner when woken,
+ *        and once more after logger_cleanup() asked it to stop.
+ */
+static void *flusher_run(void *arg) {
+    struct timespec last_report;
+    (void)arg;
+    clock_gettime(CLOCK_MONOTONIC, &last_report);
+    pthread_mutex_lock(&log_mutex);
+    while (!flusher_stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)LOG_FLUSH_INTERVAL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+        }
+        pthread_cond_timedwait(&flush_cond, &log_mutex, &deadline);
+        pthread_mutex_unlock(&log_mutex);
+        flush_rings();
+        if (elapsed_us(&last_report) >= LOG_STATS_INTERVAL_SEC * 1000000UL) {
+            report_backpressure();
+            clock_gettime(CLOCK_MONOTONIC, &last_report);
+        }
+        pthread_mutex_lock(&log_mutex);
+    }
+    pthread_mutex_unlock(&log_mutex);
+    flush_rings();
+    report_backpressure();
+    return NULL;
+}
+
+/**
+ * @brief Starts the flusher thread.
+ * @return GATEWAY_SUCCESS, or THREAD_CREATE_ERR.
+ */
+static gateway_error_t start_flusher(void) {
+    flusher_stop = false;
+    if (pthread_create(&flusher_thread, NULL, flusher_run, NULL) != 0) {
+        perror("Logger ERROR: Failed to start log flusher thread");
+        return THREAD_CREATE_ERR;
+    }
+    pthread_setname_np(flusher_thread, "log-flusher");
+    __atomic_store_n(&flusher_started, true, __ATOMIC_RELEASE);
+    return GATEWAY_SUCCESS;
+}
 
 /**
  * @brief Initializes the logger module.
  * 
- * This function initializes the mutex and creates the FIFO if it does not already exist.
- * It does NOT open the FIFO for writing.
+ * This function initializes the mutex and maps the shared memory ring (LOG_SHM), or, if that
+ * is off or fails, creates the FIFO if it does not already exist. It does NOT open the FIFO
+ * for writing. Either is inherited by the log process, so this must run before fork().
  * 
  * @return GATEWAY_SUCCESS on success, or an appropriate error code on failure.
  */
@@ -49,6 +515,16 @@ gateway_error_t logger_init(void) {
     }
     mutex_initialized = true;
 
+    /* Prefer the shared memory ring; the FIFO stays as the fallback */
+    if (LOG_SHM) {
+        if (log_shm_create() == GATEWAY_SUCCESS) {
+            fprintf(stderr, "Logger INFO: Shared memory log ring created (%d slots of %d bytes).\n",
+                    LOG_SHM_SLOTS, LOG_SHM_SLOT_BYTES);
+            return GATEWAY_SUCCESS;
+        }
+        perror("Logger WARN: Failed to create the shared memory log ring, using the FIFO");
+    }
+
     /* Create the FIFO */
     if (mkfifo(LOG_FIFO_NAME, FIFO_PERMISSIONS) == -1) {
         if (errno != EEXIST) {
@@ -68,15 +544,22 @@ gateway_error_t logger_init(void) {
  * @brief Opens the FIFO for writing.
  * 
  * This function should be called by the main process after a fork operation.
+ * With the shared memory ring there is no FIFO to open; logging starts at once, and the
+ * flusher thread only reports the message counters.
  * 
  * @return GATEWAY_SUCCESS on success, or LOGGER_FIFO_OPEN_ERR on failure.
  */
 gateway_error_t logger_open_write_fifo(void) {
     /* Check if the FIFO is already open */
-    if (fifo_fd >= 0) {
+    if (fifo_fd >= 0 || shm_writing) {
         return GATEWAY_SUCCESS;
     }
 
+    if (log_shm_available()) {
+        shm_writing = true;
+        return start_flusher();
+    }
+
     /* Ensure the FIFO has been created */
     if (!fifo_created) {
         fprintf(stderr, "Logger ERROR: Cannot open FIFO write end before FIFO is created (call logger_init first).\n");
@@ -93,20 +576,57 @@ gateway_error_t logger_open_write_fifo(void) {
     }
 
     fprintf(stderr, "Logger INFO: FIFO '%s' opened successfully for writing.\n", LOG_FIFO_NAME);
-    return GATEWAY_SUCCESS;
+
+    /* A full FIFO must not block the flusher indefinitely, see write_all() */
+    int flags = fcntl(fifo_fd, F_GETFL);
+    if (flags == -1 || fcntl(fifo_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("Logger WARN: Failed to make the FIFO non-blocking");
+    }
+
+    /* Only the flusher writes to the FIFO, log_message() just fills the caller's ring */
+    gateway_error_t ret = start_flusher();
+    if (ret != GATEWAY_SUCCESS) {
+        close(fifo_fd);
+        fifo_fd = -1;
+    }
+    return ret;
+}
+
+/**
+ * @brief Returns how log messages reach the log process: "shared memory" or "FIFO".
+ */
+const char *logger_transport_name(void) {
+    return log_shm_available() ? "shared memory" : "FIFO";
+}
+
+/**
+ * @brief Tells whether log_message() reaches the log process, i.e. logger_open_write_fifo() succeeded.
+ */
+bool logger_is_open(void) {
+    return fifo_fd >= 0 || shm_writing;
 }
 
 /**
  * @brief Logs a formatted message with a specific log level to the FIFO.
  * 
- * This function is thread-safe and ensures that log messages are written atomically.
+ * This function is thread-safe without locking: the line is copied into the calling thread's
+ * ring, which the flusher thread writes to the FIFO, or straight into the shared memory ring
+ * the log process reads. Lines of one thread keep their order.
+ * When the ring is full the message is dropped or the caller waits (LOG_RING_BLOCK_WHEN_FULL);
+ * errors and fatal messages always wait, but never longer than LOG_RING_MAX_WAIT_MS.
+ * Every message is counted by level as sent, delayed or dropped (logger_get_stats()).
  * 
  * @param level The log level (e.g., LOG_LEVEL_FATAL, LOG_LEVEL_ERROR).
  * @param format The format string for the log message (similar to printf).
  */
 void log_message(log_level_t level, const char *format, ...) {
+    /* Filter before any formatting; an invalid level is logged as INFO below */
+    if ((int)level > __atomic_load_n(&logger_level, __ATOMIC_RELAXED) && level <= LOG_LEVEL_DEBUG) {
+        return;
+    }
+
     /* Validate input parameters */
-    if (fifo_fd < 0 || format == NULL) {
+    if ((fifo_fd < 0 && !shm_writing) || format == NULL) {
         fprintf(stderr, "Logger ERROR: FIFO not open or invalid format. Log attempt ignored.\n");
         return;
     }
@@ -119,10 +639,51 @@ void log_message(log_level_t level, const char *format, ...) {
         fprintf(stderr, "Logger WARN: Invalid log level provided, defaulting to INFO.\n");
     }
 
+    log_ring_t *ring = get_thread_ring();
+    bool must_keep = (level <= LOG_LEVEL_ERROR);
+    va_list args;
+
+#if LOG_BINARY
+    /* Only the arguments are copied; the log process formats the text */
+    uint8_t record[LOG_RECORD_MAX_SIZE];
+    log_signature_t scratch;
+    const log_signature_t *signature;
+    log_push_t result;
+    size_t record_size;
+
+    if (ring == NULL) {
+        fprintf(stderr, "Logger CRITICAL: No log ring for this thread, dropped a message.\n");
+        return;
+    }
+    signature = lookup_format(ring, format, &scratch, must_keep, &result);
+    if (signature == NULL) {
+        ring_count(ring, level, LOG_PUSH_DROPPED);
+        return;
+    }
+    va_start(args, format);
+    if (signature->supported) {
+        record_size = log_record_encode(record, level, now_us(), (uint64_t)(uintptr_t)format, signature, args);
+    } else {
+        /* Conversions that can't be encoded (or too many) are formatted here as before */
+        char user_message[LOG_RECORD_MAX_SIZE];
+        int user_msg_len = vsnprintf(user_message, sizeof(user_message), format, args);
+        if (user_msg_len < 0) {
+            va_end(args);
+            fprintf(stderr, "Logger ERROR: vsnprintf formatting failed. Log attempt ignored.\n");
+            return;
+        }
+        if ((size_t)user_msg_len >= sizeof(user_message)) {
+            user_msg_len = (int)sizeof(user_message) - 1;
+        }
+        record_size = log_record_encode_text(record, level, now_us(), user_message, (size_t)user_msg_len);
+    }
+    va_end(args);
+    log_push_t pushed = push_message(ring, (const char *)record, record_size, must_keep);
+    ring_count(ring, level, pushed > result ? pushed : result); /* The worse of the two pushes */
+#else
     /* Buffers for the log message */
     char user_message[PIPE_BUF / 2]; /* Buffer for the user's formatted message */
     char final_buffer[PIPE_BUF];    /* Final buffer including timestamp, level, and message */
-    va_list args;
 
     /* Format the user message */
     va_start(args, format);
@@ -134,58 +695,72 @@ void log_message(log_level_t level, const char *format, ...) {
         return;
     }
 
-    /* Get the current time for the timestamp */
-    time_t now = time(NULL);
-    struct tm *local_time = localtime(&now);
-    char time_str[30]; /* Buffer for "YYYY-MM-DD HH:MM:SS" */
-    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", local_time);
-
     /* Construct the final log entry */
-    int final_len = snprintf(final_buffer, sizeof(final_buffer), "%s %s%s\n",
-                             time_str,
-                             log_level_strings[level],
-                             user_message);
-
+    int final_len = format_line(final_buffer, sizeof(final_buffer), level, user_message);
     if (final_len < 0) {
         fprintf(stderr, "Logger ERROR: snprintf failed constructing final log entry. Log attempt ignored.\n");
         return;
     }
-    if ((size_t)final_len >= sizeof(final_buffer)) {
-        fprintf(stderr, "Logger WARN: Final log message truncated before writing to FIFO.\n");
-        final_buffer[sizeof(final_buffer) - 1] = '\n';
-        final_buffer[sizeof(final_buffer) - 2] = '.';
-        final_buffer[sizeof(final_buffer) - 3] = '.';
-        final_buffer[sizeof(final_buffer) - 4] = '.';
-        final_len = sizeof(final_buffer) - 1;
-    }
 
-    /* Lock the mutex */
-    if (pthread_mutex_lock(&log_mutex) != 0) {
-        perror("Logger CRITICAL: Failed to lock log mutex");
-        fprintf(stderr, "Logger CRITICAL: Dropped log message due to mutex lock failure: %s", final_buffer);
+    if (ring == NULL) {
+        fprintf(stderr, "Logger CRITICAL: No log ring for this thread, dropped: %s", final_buffer);
         return;
     }
+    ring_count(ring, level, push_message(ring, final_buffer, (size_t)final_len, must_keep));
+#endif
+    if (must_keep && !shm_writing) {
+        wake_flusher(); /* Errors reach the log file without waiting for the interval */
+    }
+}
 
-    /* Write the log message to the FIFO */
-    ssize_t bytes_written = write(fifo_fd, final_buffer, final_len);
-
-    /* Unlock the mutex */
-    if (pthread_mutex_unlock(&log_mutex) != 0) {
-        perror("Logger CRITICAL: Failed to unlock log mutex");
+/**
+ * @brief Sums the message counters of every thread's ring.
+ * 
+ * @param stats Receives the counters since logger_open_write_fifo().
+ */
+void logger_get_stats(logger_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (log_ring_t *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        for (int i = 0; i < LOG_LEVELS; ++i) {
+            stats->sent[i] += __atomic_load_n(&ring->sent[i], __ATOMIC_RELAXED);
+            stats->dropped[i] += __atomic_load_n(&ring->dropped[i], __ATOMIC_RELAXED);
+            stats->delayed[i] += __atomic_load_n(&ring->delayed[i], __ATOMIC_RELAXED);
+        }
     }
+    stats->fifo_stalls = __atomic_load_n(&fifo_stalls, __ATOMIC_RELAXED);
+    stats->fifo_stall_us = __atomic_load_n(&fifo_stall_us, __ATOMIC_RELAXED);
+}
 
-    /* Check the result of the write operation */
-    if (bytes_written == -1) {
-        if (errno == EPIPE) {
-            fprintf(stderr, "Logger ERROR: FIFO write failed (Broken pipe - log process likely dead).\n");
-            close(fifo_fd);
-            fifo_fd = -1;
-        } else {
-            perror("Logger ERROR: Failed to write to FIFO");
+/**
+ * @brief Sets the most verbose level logged from now on.
+ * 
+ * @param level The new level, clamped to the valid range.
+ */
+void logger_set_level(log_level_t level) {
+    if (level < LOG_LEVEL_FATAL) level = LOG_LEVEL_FATAL;
+    if (level > LOG_LEVEL_DEBUG) level = LOG_LEVEL_DEBUG;
+    __atomic_store_n(&logger_level, (int)level, __ATOMIC_RELAXED);
+}
+
+log_level_t logger_get_level(void) {
+    return (log_level_t)__atomic_load_n(&logger_level, __ATOMIC_RELAXED);
+}
+
+bool logger_parse_level(const char *name, log_level_t *level) {
+    for (int i = LOG_LEVEL_FATAL; i <= LOG_LEVEL_DEBUG; ++i) {
+        if (strcmp(name, log_level_names[i]) == 0) {
+            *level = (log_level_t)i;
+            return true;
         }
-    } else if (bytes_written < final_len) {
-        fprintf(stderr, "Logger WARN: Partial write to FIFO (%zd/%d bytes).\n", bytes_written, final_len);
     }
+    return false;
+}
+
+const char *logger_level_name(log_level_t level) {
+    if (level < LOG_LEVEL_FATAL || level > LOG_LEVEL_DEBUG) {
+        return "unknown";
+    }
+    return log_level_names[level];
 }
 
 /**
@@ -196,16 +771,41 @@ void log_message(log_level_t level, const char *format, ...) {
 void logger_cleanup(void) {
     fprintf(stderr, "Logger INFO: Cleaning up logger resources...\n");
 
+    /* Stop the flusher; it drains the rings one last time */
+    if (flusher_started) {
+        pthread_mutex_lock(&log_mutex);
+        __atomic_store_n(&flusher_stop, true, __ATOMIC_RELAXED);
+        pthread_cond_signal(&flush_cond);
+        pthread_mutex_unlock(&log_mutex);
+        pthread_join(flusher_thread, NULL);
+        __atomic_store_n(&flusher_started, false, __ATOMIC_RELEASE);
+    }
+
+    /* Let the log process finish reading the shared memory ring, then drop our mapping */
+    if (log_shm_available()) {
+        log_shm_close_writer();
+        shm_writing = false;
+        log_shm_destroy();
+    }
+
     /* Close the FIFO write end if it is open */
     if (fifo_fd >= 0) {
         if (close(fifo_fd) == -1) {
             perror("Logger WARN: Failed to close FIFO write end");
         }
         fifo_fd = -1;
-    } else {
+    } else if (fifo_created) {
         fprintf(stderr, "Logger INFO: FIFO write end already closed or not opened.\n");
     }
 
+    /* Free the rings; logging after cleanup is refused since the FIFO is closed */
+    while (rings != NULL) {
+        log_ring_t *next = rings->next;
+        free(rings);
+        rings = next;
+    }
+    thread_ring = NULL;
+
     /* Destroy the mutex if it has been initialized */
     if (mutex_initialized) {
         if (pthread_mutex_destroy(&log_mutex) != 0) {
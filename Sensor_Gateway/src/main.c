@@ -10,6 +10,9 @@
 #include <limits.h>         /* For LONG_MAX, LONG_MIN */
 #include <time.h>           /* For clock_gettime */
 #include <stdbool.h>        /* For bool type */
+#include <getopt.h>         /* For getopt */
+#include <sched.h>          /* For CPU affinity and SCHED_FIFO */
+#include <sys/resource.h>   /* For setpriority */
 
 /* Include project headers */
 #include "config.h"         /* Configuration definitions */
@@ -19,11 +22,41 @@
 #include "conmgt.h"         /* Connection Manager module */
 #include "datamgt.h"        /* Data Manager module */
 #include "storagemgt.h"     /* Storage Manager module */
+#include "forwarder.h"      /* Upstream forwarder */
 #include "cmdif.h"          /* Command Interface module */
+#include "metrics.h"        /* Metrics registry and HTTP endpoint */
+#include "sysmon.h"         /* System monitor sampler */
+#include "settings.h"       /* Runtime settings */
 
 /* --- Local Macros --- */
 #define MIN_PORT 1           /* Minimum valid port number */
 #define MAX_PORT 65535       /* Maximum valid port number */
+#define GATEWAY_OPTSTRING "b:B:r:w:ue:c:f:o:" /* getopt() options */
+#define SETTINGS_ERROR_SIZE 512 /* Longest settings error message */
+
+/* --- Local Types --- */
+
+/* Where and how a manager thread (or the log process) runs, see config.h */
+typedef struct {
+    const char *name;        /* For messages */
+    const char *cpus;        /* CPU list, "" = any */
+    int sched_priority;      /* 1-99 = SCHED_FIFO, 0 = SCHED_OTHER */
+    int nice;                /* Nice value under SCHED_OTHER */
+} thread_placement_t;
+
+/* Start routine and nice value of a thread, for placed_thread_start() */
+typedef struct {
+    void *(*start)(void *);
+    void *arg;
+    int nice;
+} placed_start_t;
+
+static const thread_placement_t conmgt_placement = { "conmgt", CONMGT_CPUS, CONMGT_SCHED_PRIORITY, CONMGT_NICE };
+static const thread_placement_t datamgt_placement = { "datamgt", DATAMGT_CPUS, DATAMGT_SCHED_PRIORITY, DATAMGT_NICE };
+static const thread_placement_t storagemgt_placement = { "storagemgt", STORAGEMGT_CPUS, STORAGEMGT_SCHED_PRIORITY, STORAGEMGT_NICE };
+static const thread_placement_t forwarder_placement = { "forwarder", FORWARDER_CPUS, FORWARDER_SCHED_PRIORITY, FORWARDER_NICE };
+static const thread_placement_t cmdif_placement = { "cmdif", CMDIF_CPUS, CMDIF_SCHED_PRIORITY, CMDIF_NICE };
+static const thread_placement_t logger_placement = { "log process", LOGGER_CPUS, LOGGER_SCHED_PRIORITY, LOGGER_NICE };
 
 /* --- Global Variables --- */
 
@@ -38,12 +71,61 @@ volatile sig_atomic_t terminate_flag = 0;
  */
 static void print_usage(const char *prog_name);
 
+/**
+ * @brief Parses a decimal command line value within [min, max].
+ * @param str The string to parse.
+ * @param min Minimum accepted value.
+ * @param max Maximum accepted value.
+ * @param out Where the parsed value is stored on success.
+ * @return true on success, false if the string is not a valid number in range.
+ */
+static bool parse_long_arg(const char *str, long min, long max, long *out);
+
+/**
+ * @brief Applies a command line option that sets a setting; prints the problem if it fails.
+ * @param name The setting, or NULL if value is a "name=value" assignment (-o).
+ * @param value The option argument.
+ * @return true on success.
+ */
+static bool apply_setting_option(const char *name, const char *value);
+
 /**
  * @brief Signal handler for termination signals.
  * @param sig Signal number received.
  */
 static void signal_handler(int sig);
 
+/**
+ * @brief Creates a manager thread with the CPU affinity, scheduling and stack size of its
+ *        placement. If the kernel refuses the placement, a warning is logged and the thread
+ *        is created without it.
+ * @param thread Receives the thread ID.
+ * @param placement Where and how the thread runs.
+ * @param start Start routine.
+ * @param arg Argument of start.
+ * @param start_info Storage for the start routine, must outlive the thread's start.
+ * @return 0 on success, an error number as pthread_create() (errno is set as well).
+ */
+static int create_placed_thread(pthread_t *thread, const thread_placement_t *placement,
+                                void *(*start)(void *), void *arg, placed_start_t *start_info);
+
+/**
+ * @brief Applies a placement to the calling process, for the log process after fork().
+ *        Failures are reported on stderr; the process runs on unplaced.
+ */
+static void place_process(const thread_placement_t *placement);
+
+/**
+ * @brief Gauge source returning the readings queued in the shared buffer.
+ * @param ctx The shared buffer.
+ */
+static long shared_buffer_depth(void *ctx);
+
+/**
+ * @brief Gauge source returning the open TCP connections.
+ */
+static long active_connections(void *ctx);
+
 /* --- Main Function --- */
 
 int main(int argc, char *argv[]) {
@@ -51,23 +133,37 @@ int main(int argc, char *argv[]) {
 
     /* Configuration & Arguments */
     int server_port;                        /* Port number from command line argument */
-    const char *map_filename = MAP_FILE_NAME; /* Default filename for room-sensor map */
+    const char *settings_file = GATEWAY_CONFIG_FILE_NAME; /* Settings file (-f) */
+    bool settings_file_given = false;       /* -f was given, so the file must exist */
+    char settings_error[SETTINGS_ERROR_SIZE]; /* Why the settings file was refused */
+    bool udp_enabled = false;               /* Also accept datagram readings on the port (-u) */
+    const char *capture_file = NULL;        /* Capture of the decoded readings (-c) */
+    conmgt_backend_id_t conmgt_backend = CONMGT_BACKEND_EPOLL; /* Connection manager event loop (-e) */
+    const char *map_filename = gateway_settings.map_file; /* Room-sensor map, final once the options are parsed */
 
     /* Process & Thread Management */
     pid_t log_pid = -1;                     /* Process ID of the logger child process */
     pthread_t conmgt_thread_id = 0;         /* Thread ID for Connection Manager */
     pthread_t datamgt_thread_id = 0;        /* Thread ID for Data Manager */
     pthread_t storagemgt_thread_id = 0;     /* Thread ID for Storage Manager */
+    pthread_t forwarder_thread_id = 0;      /* Thread ID for the upstream forwarder */
     pthread_t cmdif_thread_id = 0;          /* Thread ID for Command Interface */
     bool conmgt_created = false;            /* Flag: Connection Manager thread created */
     bool datamgt_created = false;           /* Flag: Data Manager thread created */
     bool storagemgt_created = false;        /* Flag: Storage Manager thread created */
+    bool forwarder_created = false;         /* Flag: forwarder thread created (forward_upstream set) */
     bool cmdif_created = false;             /* Flag: Command Interface thread created */
+    pthread_t metrics_thread_id = 0;        /* Thread ID for the metrics HTTP endpoint */
+    bool metrics_created = false;           /* Flag: metrics HTTP thread created */
+    pthread_t sysmon_thread_id = 0;         /* Thread ID for the system monitor sampler */
+    bool sysmon_created = false;            /* Flag: system monitor thread created */
 
     /* Thread Argument Structures */
+    placed_start_t conmgt_start, datamgt_start, storagemgt_start, forwarder_start, cmdif_start; /* Start routines with their nice values */
     conmgt_args_t conmgt_args;              /* Arguments for Connection Manager thread */
     datamgt_args_t datamgt_args;            /* Arguments for Data Manager thread */
     storagemgt_args_t storagemgt_args;      /* Arguments for Storage Manager thread */
+    forwarder_args_t forwarder_args;        /* Arguments for the forwarder thread */
     cmdif_args_t cmdif_args;                /* Arguments for Command Interface thread */
 
     /* Shared Resources */
@@ -77,11 +173,13 @@ int main(int argc, char *argv[]) {
     /* Control Flow & Status */
     gateway_error_t ret;                    /* Return value from gateway functions */
     void *thread_result = NULL;             /* Placeholder for pthread_join result (not currently used) */
+    struct timespec shutdown_start, shutdown_end; /* How long stopping and joining the threads took */
     sigset_t wait_mask;                     /* Signal set for sigwaitinfo */
     int signum_received = 0;                /* Signal number received by sigwaitinfo */
 
     /* Initialization specific to cmdif_args */
     cmdif_args.socket_path = CMD_SOCKET_PATH; /* Set command socket path */
+    cmdif_args.buffer = NULL;                 /* Set once the shared buffer exists */
 
     /* --- End of Variable Declarations --- */
 
@@ -89,33 +187,89 @@ int main(int argc, char *argv[]) {
     sigemptyset(&wait_mask);
     sigaddset(&wait_mask, SIGINT);
     sigaddset(&wait_mask, SIGTERM);
+    sigaddset(&wait_mask, SIGHUP); /* Reloads the room-sensor map */
     if (pthread_sigmask(SIG_BLOCK, &wait_mask, NULL) != 0) {
         perror("CRITICAL: Failed to set signal mask");
         return EXIT_FAILURE;
     }
 
-    /* 2. Parse Command Line Arguments */
-    if (argc != 2) {
+    /* 2. Parse Command Line Arguments: the settings file first, so the options override it */
+    int opt;
+    opterr = 0; /* Reported by the second pass */
+    while ((opt = getopt(argc, argv, GATEWAY_OPTSTRING)) != -1) {
+        if (opt == 'f') {
+            settings_file = optarg;
+            settings_file_given = true;
+        }
+    }
+    if (settings_load_file(settings_file, settings_file_given, settings_error, sizeof(settings_error)) != GATEWAY_SUCCESS) {
+        fprintf(stderr, "Error: %s\n", settings_error);
+        return EXIT_FAILURE;
+    }
+    bool settings_file_found = settings_file_given || access(settings_file, F_OK) == 0;
+
+    optind = 1;
+    opterr = 1;
+    while ((opt = getopt(argc, argv, GATEWAY_OPTSTRING)) != -1) {
+        bool applied = true;
+        switch (opt) {
+            case 'b':
+                applied = apply_setting_option("sbuffer_size", optarg);
+                break;
+            case 'B':
+                applied = apply_setting_option("sbuffer_max_size", optarg);
+                break;
+            case 'r':
+                applied = apply_setting_option("conmgt_reactors", optarg);
+                break;
+            case 'w':
+                applied = apply_setting_option("datamgt_workers", optarg);
+                break;
+            case 'o':
+                applied = apply_setting_option(NULL, optarg);
+                break;
+            case 'f':
+                break; /* Loaded above */
+            case 'u':
+                udp_enabled = true;
+                break;
+            case 'c':
+                capture_file = optarg;
+                break;
+            case 'e':
+                if (strcmp(optarg, "epoll") == 0) {
+                    conmgt_backend = CONMGT_BACKEND_EPOLL;
+                } else if (strcmp(optarg, "io_uring") == 0) {
+                    conmgt_backend = CONMGT_BACKEND_IO_URING;
+                } else {
+                    fprintf(stderr, "Error: Invalid event backend '%s'. Must be 'epoll' or 'io_uring'.\n", optarg);
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+        if (!applied) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 1) {
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
-    char *endptr;
-    errno = 0;
-    long port_long = strtol(argv[1], &endptr, 10);
-    if ((errno == ERANGE && (port_long == LONG_MAX || port_long == LONG_MIN)) || 
-        (errno != 0 && port_long == 0) || 
-        endptr == argv[1] || 
-        *endptr != '\0' || 
-        port_long < MIN_PORT || 
-        port_long > MAX_PORT) {
-        fprintf(stderr, "Error: Invalid port number '%s'. Must be between %d and %d.\n", argv[1], MIN_PORT, MAX_PORT);
+    long port_long;
+    if (!parse_long_arg(argv[optind], MIN_PORT, MAX_PORT, &port_long)) {
+        fprintf(stderr, "Error: Invalid port number '%s'. Must be between %d and %d.\n", argv[optind], MIN_PORT, MAX_PORT);
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
     server_port = (int)port_long;
     printf("INFO: Server starting on port %d\n", server_port);
 
-    /* 3. Initialize Logger (Create FIFO & Init Mutex) - Must be BEFORE fork */
+    /* 3. Initialize Logger (Map the shared log ring or create the FIFO & Init Mutex) - Must be BEFORE fork */
     ret = logger_init();
     if (ret != GATEWAY_SUCCESS) {
         fprintf(stderr, "CRITICAL: Failed to initialize logger base (Error %d). Exiting.\n", ret);
@@ -146,6 +300,7 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     } else if (log_pid == 0) {
         /* --- Child Process (Log Process) --- */
+        place_process(&logger_placement);
         run_log_process();
         fprintf(stderr,"CRITICAL: Log process function returned unexpectedly!\n");
         exit(EXIT_FAILURE);
@@ -154,7 +309,7 @@ int main(int argc, char *argv[]) {
     /* --- Parent Process (Main Gateway Process) --- */
     printf("INFO: Main process (PID: %d) started, Log process PID: %d\n", getpid(), log_pid);
 
-    /* 6. Open FIFO Write End (AFTER fork) */
+    /* 6. Open FIFO Write End or start writing to the shared log ring (AFTER fork) */
     ret = logger_open_write_fifo();
     if (ret != GATEWAY_SUCCESS) {
         fprintf(stderr,"CRITICAL: Main process failed to open FIFO write end (Error %d). Terminating child and exiting.\n", ret);
@@ -167,8 +322,13 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
     /* Now logging via log_message is safe */
-    log_message(LOG_LEVEL_INFO, "Main process logger FIFO opened successfully."); 
+    log_message(LOG_LEVEL_INFO, "Main process logger opened successfully (%s).", logger_transport_name()); 
     log_message(LOG_LEVEL_INFO, "Main process PID: %d, Log process PID: %d", getpid(), log_pid); 
+    if (settings_file_found) {
+        log_message(LOG_LEVEL_INFO, "Settings read from '%s'.", settings_file);
+    } else {
+        log_message(LOG_LEVEL_INFO, "No settings file '%s', using the built-in defaults.", settings_file);
+    }
 
     #ifdef DATAMGT_H
     if (room_map != NULL) {
@@ -179,7 +339,7 @@ int main(int argc, char *argv[]) {
     #endif
 
     /* 7. Initialize Shared Buffer */
-    ret = sbuffer_init(&buffer);
+    ret = sbuffer_init(&buffer, (size_t)gateway_settings.sbuffer_size, (size_t)gateway_settings.sbuffer_max_size);
     if (ret != GATEWAY_SUCCESS || buffer == NULL) {
         log_message(LOG_LEVEL_FATAL, "Failed to initialize shared buffer (Error %d). Terminating.", ret); 
         kill(log_pid, SIGTERM);
@@ -190,7 +350,8 @@ int main(int argc, char *argv[]) {
         logger_cleanup();
         return EXIT_FAILURE;
     }
-    log_message(LOG_LEVEL_INFO, "Shared buffer initialized."); 
+    log_message(LOG_LEVEL_INFO, "Shared buffer initialized (capacity %ld, max %ld).",
+                gateway_settings.sbuffer_size, gateway_settings.sbuffer_max_size); 
 
     /* 8. Set up Signal Handler */
     struct sigaction sa;
@@ -209,22 +370,51 @@ int main(int argc, char *argv[]) {
     memset(&conmgt_args, 0, sizeof(conmgt_args));
     conmgt_args.server_port = server_port;
     conmgt_args.buffer = buffer;
+    conmgt_args.num_reactors = (int)gateway_settings.conmgt_reactors;
+    conmgt_args.udp_enabled = udp_enabled;
+    conmgt_args.capture_file = capture_file;
+    conmgt_args.backend = conmgt_backend;
     #endif
     #ifdef DATAMGT_H
     memset(&datamgt_args, 0, sizeof(datamgt_args));
     datamgt_args.buffer = buffer;
     datamgt_args.map = room_map;
+    datamgt_args.num_workers = (int)gateway_settings.datamgt_workers;
+    datamgt_args.map_filename = map_filename;
+    datamgt_args.rules_filename = gateway_settings.rules_file;
+    /* Each consumer gets its own cursor so it sees every reading */
+    if (sbuffer_register_reader(buffer, &datamgt_args.reader_id) != GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_FATAL, "Failed to register Data Manager as sbuffer reader."); 
+        goto immediate_cleanup_on_create_fail;
+    }
+    #endif
+    #ifdef CMDIF_H
+    cmdif_args.buffer = buffer;
     #endif
+    metrics_gauge_source(METRIC_SBUFFER_DEPTH, shared_buffer_depth, buffer);
+    metrics_gauge_source(METRIC_CONN_ACTIVE, active_connections, NULL);
     #ifdef STORAGEMGT_H
     memset(&storagemgt_args, 0, sizeof(storagemgt_args));
     storagemgt_args.buffer = buffer;
+    if (sbuffer_register_reader(buffer, &storagemgt_args.reader_id) != GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_FATAL, "Failed to register Storage Manager as sbuffer reader."); 
+        goto immediate_cleanup_on_create_fail;
+    }
     #endif
+    memset(&forwarder_args, 0, sizeof(forwarder_args));
+    forwarder_args.buffer = buffer;
+    forwarder_args.upstream = gateway_settings.forward_upstream;
+    if (forwarder_args.upstream[0] != '\0' &&
+        sbuffer_register_reader(buffer, &forwarder_args.reader_id) != GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_FATAL, "Failed to register the forwarder as sbuffer reader."); 
+        goto immediate_cleanup_on_create_fail;
+    }
 
     /* 10. Create Manager Threads */
     log_message(LOG_LEVEL_INFO, "Creating manager threads..."); 
     #ifdef CONMGT_H
-    if (pthread_create(&conmgt_thread_id, NULL, conmgt_run, &conmgt_args) == 0) {
-        conmgt_created = true; log_message(LOG_LEVEL_DEBUG, "Connection Manager thread created (ID: %lu).", (unsigned long)conmgt_thread_id); 
+    if (create_placed_thread(&conmgt_thread_id, &conmgt_placement, conmgt_run, &conmgt_args, &conmgt_start) == 0) {
+        conmgt_created = true; LOG_DEBUG("Connection Manager thread created (ID: %lu).", (unsigned long)conmgt_thread_id); 
     } else {
         log_message(LOG_LEVEL_FATAL, "Failed to create Connection thread: %s", strerror(errno)); 
         goto immediate_cleanup_on_create_fail;
@@ -232,8 +422,8 @@ int main(int argc, char *argv[]) {
     #endif
 
     #ifdef DATAMGT_H
-    if (pthread_create(&datamgt_thread_id, NULL, datamgt_run, &datamgt_args) == 0) {
-        datamgt_created = true; log_message(LOG_LEVEL_DEBUG, "Data Manager thread created (ID: %lu).", (unsigned long)datamgt_thread_id); 
+    if (create_placed_thread(&datamgt_thread_id, &datamgt_placement, datamgt_run, &datamgt_args, &datamgt_start) == 0) {
+        datamgt_created = true; LOG_DEBUG("Data Manager thread created (ID: %lu).", (unsigned long)datamgt_thread_id); 
     } else {
         log_message(LOG_LEVEL_FATAL, "Failed to create Data thread: %s", strerror(errno)); 
         goto immediate_cleanup_on_create_fail;
@@ -241,18 +431,26 @@ int main(int argc, char *argv[]) {
     #endif
 
     #ifdef STORAGEMGT_H
-    if (pthread_create(&storagemgt_thread_id, NULL, storagemgt_run, &storagemgt_args) == 0) {
-        storagemgt_created = true; log_message(LOG_LEVEL_DEBUG, "Storage Manager thread created (ID: %lu).", (unsigned long)storagemgt_thread_id); 
+    if (create_placed_thread(&storagemgt_thread_id, &storagemgt_placement, storagemgt_run, &storagemgt_args, &storagemgt_start) == 0) {
+        storagemgt_created = true; LOG_DEBUG("Storage Manager thread created (ID: %lu).", (unsigned long)storagemgt_thread_id); 
     } else {
         log_message(LOG_LEVEL_FATAL, "Failed to create Storage thread: %s", strerror(errno)); 
         goto immediate_cleanup_on_create_fail;
     }
     #endif
+    if (forwarder_args.upstream[0] != '\0') {
+        if (create_placed_thread(&forwarder_thread_id, &forwarder_placement, forwarder_run, &forwarder_args, &forwarder_start) == 0) {
+            forwarder_created = true; LOG_DEBUG("Forwarder thread created (ID: %lu).", (unsigned long)forwarder_thread_id); 
+        } else {
+            log_message(LOG_LEVEL_FATAL, "Failed to create forwarder thread: %s", strerror(errno)); 
+            goto immediate_cleanup_on_create_fail;
+        }
+    }
     log_message(LOG_LEVEL_INFO, "All manager threads created successfully."); 
 
     #ifdef CMDIF_H
     log_message(LOG_LEVEL_INFO, "Creating command interface thread..."); 
-    if (pthread_create(&cmdif_thread_id, NULL, cmdif_run, &cmdif_args) == 0) {
+    if (create_placed_thread(&cmdif_thread_id, &cmdif_placement, cmdif_run, &cmdif_args, &cmdif_start) == 0) {
         cmdif_created = true;
         log_message(LOG_LEVEL_INFO, "Command interface thread created (ID: %lu).", (unsigned long)cmdif_thread_id); 
     } else {
@@ -261,12 +459,34 @@ int main(int argc, char *argv[]) {
     }
     #endif
 
+    #if METRICS_HTTP_PORT > 0
+    /* The 'metrics' command works without it, so a failure is not fatal */
+    if (pthread_create(&metrics_thread_id, NULL, metrics_http_run, NULL) == 0) {
+        metrics_created = true;
+    } else {
+        log_message(LOG_LEVEL_ERROR, "Failed to create metrics HTTP thread: %s", strerror(errno)); 
+    }
+    #endif
+
+    /* Without it 'status' reports no CPU and RAM figures, which is not fatal either */
+    if (pthread_create(&sysmon_thread_id, NULL, sysmon_run, NULL) == 0) {
+        sysmon_created = true;
+    } else {
+        log_message(LOG_LEVEL_ERROR, "Failed to create system monitor thread: %s", strerror(errno)); 
+    }
+
     /* 11. Wait for Termination Signal (Blocking Call) */
     log_message(LOG_LEVEL_INFO, "Main thread waiting for termination signal (SIGINT/SIGTERM)..."); 
     printf("INFO: Gateway running. Press Ctrl+C to stop.\n"); 
 
     errno = 0;
-    signum_received = sigwaitinfo(&wait_mask, NULL);
+    while ((signum_received = sigwaitinfo(&wait_mask, NULL)) == SIGHUP) {
+        #ifdef DATAMGT_H
+        log_message(LOG_LEVEL_INFO, "Main thread received SIGHUP, reloading room sensor map '%s'.", map_filename); 
+        datamgt_reload_room_sensor_map(NULL); /* Logs the outcome */
+        #endif
+        errno = 0;
+    }
 
     if (signum_received == -1) {
         log_message(LOG_LEVEL_ERROR, "sigwaitinfo failed: %s. Initiating cleanup anyway.", strerror(errno)); 
@@ -279,10 +499,11 @@ int main(int argc, char *argv[]) {
 
 /* Cleanup section - reached after signal or thread creation failure */
 immediate_cleanup_on_create_fail:
+    clock_gettime(CLOCK_MONOTONIC, &shutdown_start);
     log_message(LOG_LEVEL_INFO, "Main process initiating cleanup sequence..."); 
     fprintf(stderr, "INFO: Main process initiating cleanup sequence...\n"); 
 
-    /* 12. Initiate Graceful Shutdown Sequence */
+    /* 12. Initiate Graceful Shutdown Sequence: stop accepting first, the storage manager drains what is left */
     #ifdef CONMGT_H
     if (conmgt_created) { 
         conmgt_stop(); 
@@ -295,6 +516,12 @@ immediate_cleanup_on_create_fail:
         fprintf(stderr, "INFO: Command Interface stop signaled.\n"); 
     }
     #endif
+    if (metrics_created) {
+        metrics_http_stop();
+    }
+    if (sysmon_created) {
+        sysmon_stop();
+    }
     #ifdef DATAMGT_H
     if (datamgt_created) { 
         datamgt_stop(); 
@@ -307,6 +534,9 @@ immediate_cleanup_on_create_fail:
         fprintf(stderr, "INFO: Storage Manager stop requested.\n"); 
     }
     #endif
+    if (forwarder_created) {
+        forwarder_stop();
+    }
 
     if (buffer != NULL) {
         log_message(LOG_LEVEL_INFO, "Signaling shared buffer shutdown..."); 
@@ -328,6 +558,20 @@ immediate_cleanup_on_create_fail:
         } 
     }
     #endif
+    if (metrics_created) {
+        if (pthread_join(metrics_thread_id, &thread_result) != 0) {
+            log_message(LOG_LEVEL_WARNING, "Failed to join metrics HTTP thread: %s", strerror(errno)); 
+        } else {
+            log_message(LOG_LEVEL_INFO, "Metrics HTTP thread joined."); 
+        }
+    }
+    if (sysmon_created) {
+        if (pthread_join(sysmon_thread_id, &thread_result) != 0) {
+            log_message(LOG_LEVEL_WARNING, "Failed to join system monitor thread: %s", strerror(errno)); 
+        } else {
+            log_message(LOG_LEVEL_INFO, "System monitor thread joined."); 
+        }
+    }
     #ifdef STORAGEMGT_H
     if (storagemgt_created) { 
         if (pthread_join(storagemgt_thread_id, &thread_result) != 0) { 
@@ -338,6 +582,13 @@ immediate_cleanup_on_create_fail:
         } 
     }
     #endif
+    if (forwarder_created) {
+        if (pthread_join(forwarder_thread_id, &thread_result) != 0) {
+            log_message(LOG_LEVEL_WARNING, "Failed to join forwarder thread: %s", strerror(errno)); 
+        } else {
+            log_message(LOG_LEVEL_INFO, "Forwarder thread joined."); 
+        }
+    }
     #ifdef DATAMGT_H
     if (datamgt_created) { 
         if (pthread_join(datamgt_thread_id, &thread_result) != 0) { 
@@ -346,6 +597,7 @@ immediate_cleanup_on_create_fail:
             log_message(LOG_LEVEL_INFO, "Data Manager thread joined."); 
             fprintf(stderr, "INFO: Data Manager thread joined.\n"); 
         } 
+        room_map = datamgt_args.map; /* The map in use at exit, the startup one may have been replaced by a reload */
     }
     #endif
     #ifdef CONMGT_H
@@ -358,7 +610,10 @@ immediate_cleanup_on_create_fail:
         } 
     }
     #endif
-    log_message(LOG_LEVEL_INFO, "Finished joining manager threads."); 
+    clock_gettime(CLOCK_MONOTONIC, &shutdown_end);
+    log_message(LOG_LEVEL_INFO, "Finished joining manager threads in %ld ms.",
+                (shutdown_end.tv_sec - shutdown_start.tv_sec) * 1000L +
+                (shutdown_end.tv_nsec - shutdown_start.tv_nsec) / 1000000L); 
 
 
     /* 14. Cleanup Shared Resources */
@@ -366,6 +621,7 @@ immediate_cleanup_on_create_fail:
     #ifdef DATAMGT_H
     datamgt_free_room_sensor_map(&room_map); // Logs internally
     #endif
+    metrics_gauge_source(METRIC_SBUFFER_DEPTH, NULL, NULL); /* No export may sample the freed buffer */
     if (buffer != NULL) {
         ret = sbuffer_free(&buffer);
         if (ret != GATEWAY_SUCCESS) { log_message(LOG_LEVEL_WARNING, "Error during sbuffer free (Code: %d).", ret); fprintf(stderr, "WARN: Error during sbuffer free.\n"); }
@@ -413,8 +669,51 @@ immediate_cleanup_on_create_fail:
  * @brief Prints command line usage instructions.
  */
 static void print_usage(const char *prog_name) {
-    fprintf(stderr, "Usage: %s <port>\n", prog_name);
+    fprintf(stderr, "Usage: %s [-f settings_file] [-o name=value]... [-b buffer_size] [-B max_buffer_size] [-r reactors] [-w workers] [-u] [-e epoll|io_uring] [-c capture_file] <port>\n", prog_name);
     fprintf(stderr, "  <port>: The TCP port number to listen on (%d-%d)\n", MIN_PORT, MAX_PORT);
+    fprintf(stderr, "  -b    : Initial shared buffer capacity in readings (default %d)\n", SBUFFER_SIZE);
+    fprintf(stderr, "  -B    : Let the shared buffer grow up to this many readings under backpressure (default %d, 0 = fixed)\n", SBUFFER_MAX_SIZE);
+    fprintf(stderr, "  -r    : Number of connection manager reactor threads sharing the port (default %d, max %d)\n", CONMGT_REACTORS, CONMGT_MAX_REACTORS);
+    fprintf(stderr, "  -w    : Number of data manager worker threads, each owning the sensors with id %% workers == its index (default %d, max %d)\n", DATAMGT_WORKERS, DATAMGT_MAX_WORKERS);
+    fprintf(stderr, "  -u    : Also accept fire-and-forget sensor datagrams on the same UDP port number\n");
+    fprintf(stderr, "  -e    : Connection manager event loop, 'epoll' (default) or 'io_uring' (falls back to epoll if unsupported)\n");
+    fprintf(stderr, "  -c    : Append every decoded reading with its arrival time to this file, for sensor_replay\n");
+    fprintf(stderr, "  -f    : Read the settings from this file (default '%s' if it exists)\n", GATEWAY_CONFIG_FILE_NAME);
+    fprintf(stderr, "  -o    : Override one setting of the file, e.g. -o sensor_timeout_sec=10 (see settings.h)\n");
+    fprintf(stderr, "  -b, -B, -r and -w override the settings sbuffer_size, sbuffer_max_size, conmgt_reactors and datamgt_workers\n");
+}
+
+/**
+ * @brief Parses a decimal command line value within [min, max].
+ */
+static bool parse_long_arg(const char *str, long min, long max, long *out) {
+    char *endptr;
+    errno = 0;
+    long value = strtol(str, &endptr, 10);
+    if ((errno == ERANGE && (value == LONG_MAX || value == LONG_MIN)) || 
+        (errno != 0 && value == 0) || 
+        endptr == str || 
+        *endptr != '\0' || 
+        value < min || 
+        value > max) {
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+/**
+ * @brief Applies a command line option that sets a setting.
+ */
+static bool apply_setting_option(const char *name, const char *value) {
+    char error[SETTINGS_ERROR_SIZE];
+    gateway_error_t ret = name != NULL ? settings_set(name, value, false, error, sizeof(error))
+                                       : settings_set_assignment(value, error, sizeof(error));
+    if (ret != GATEWAY_SUCCESS) {
+        fprintf(stderr, "Error: %s.\n", error);
+        return false;
+    }
+    return true;
 }
 
 /**
@@ -424,4 +723,150 @@ static void print_usage(const char *prog_name) {
 static void signal_handler(int sig) {
     /* User Signal handler */
     (void)sig; /* Suppress unused parameter warning */
-}
\ No newline at end of file
+}
+/**
+ * @brief Gauge source returning the readings queued in the shared buffer.
+ */
+static long shared_buffer_depth(void *ctx) {
+    sbuffer_stats_t stats;
+    sbuffer_get_stats((sbuffer_t *)ctx, &stats);
+    return (long)stats.count;
+}
+
+/**
+ * @brief Gauge source returning the open TCP connections.
+ */
+static long active_connections(void *ctx) {
+    (void)ctx;
+    return conmgt_get_active_connections();
+}
+
+/**
+ * @brief Parses a CPU list such as "0-1,3".
+ * @return true on success, false if the list is malformed.
+ */
+static bool parse_cpu_list(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    while (*list != '\0') {
+        char *end;
+        long first = strtol(list, &end, 10);
+        long last = first;
+        if (end == list || first < 0) {
+            return false;
+        }
+        if (*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list || last < first) {
+                return false;
+            }
+        }
+        if (last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            CPU_SET((int)cpu, set);
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return false;
+        }
+        list = end;
+    }
+    return true;
+}
+
+/**
+ * @brief Initializes thread attributes with the THREAD_STACK_KB stack size.
+ */
+static void init_thread_attr(pthread_attr_t *attr) {
+    pthread_attr_init(attr);
+    if (THREAD_STACK_KB > 0) {
+        size_t stack = (size_t)THREAD_STACK_KB * 1024;
+        size_t stack_min = (size_t)PTHREAD_STACK_MIN;
+        pthread_attr_setstacksize(attr, stack < stack_min ? stack_min : stack);
+    }
+}
+
+/**
+ * @brief Start routine of threads with a nice value: under SCHED_OTHER, nice is a property of
+ *        the thread on Linux and not part of pthread_attr_t, so the thread sets it itself.
+ */
+static void *placed_thread_start(void *arg) {
+    placed_start_t *start_info = (placed_start_t *)arg;
+    if (setpriority(PRIO_PROCESS, 0, start_info->nice) != 0) {
+        log_message(LOG_LEVEL_WARNING, "Failed to set nice value %d: %s", start_info->nice, strerror(errno));
+    }
+    return start_info->start(start_info->arg);
+}
+
+static int create_placed_thread(pthread_t *thread, const thread_placement_t *placement,
+                                void *(*start)(void *), void *arg, placed_start_t *start_info) {
+    pthread_attr_t attr;
+    cpu_set_t cpus;
+    bool placed = false;
+    int rc;
+
+    init_thread_attr(&attr);
+    if (placement->cpus[0] != '\0') {
+        if (parse_cpu_list(placement->cpus, &cpus)) {
+            pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+            placed = true;
+        } else {
+            log_message(LOG_LEVEL_WARNING, "Ignoring malformed CPU list '%s' of the %s thread.", placement->cpus, placement->name);
+        }
+    }
+    if (placement->sched_priority > 0) {
+        struct sched_param param = { .sched_priority = placement->sched_priority };
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+        placed = true;
+    }
+
+    start_info->start = start;
+    start_info->arg = arg;
+    start_info->nice = placement->nice;
+    if (placement->sched_priority == 0 && placement->nice != 0) {
+        start = placed_thread_start;
+        arg = start_info;
+    }
+
+    rc = pthread_create(thread, &attr, start, arg);
+    if ((rc == EPERM || rc == EINVAL) && placed) {
+        log_message(LOG_LEVEL_WARNING, "Placement of the %s thread (CPUs '%s', priority %d) refused: %s. Starting it unplaced.",
+                    placement->name, placement->cpus, placement->sched_priority, strerror(rc));
+        pthread_attr_destroy(&attr);
+        init_thread_attr(&attr);
+        rc = pthread_create(thread, &attr, start, arg);
+    } else if (rc == 0 && placed) {
+        log_message(LOG_LEVEL_INFO, "%s thread placed on CPUs '%s', %s priority %d.", placement->name,
+                    placement->cpus[0] != '\0' ? placement->cpus : "any", placement->sched_priority > 0 ? "SCHED_FIFO" : "SCHED_OTHER", placement->sched_priority);
+    }
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        errno = rc; /* The callers report strerror(errno) */
+    }
+    return rc;
+}
+
+static void place_process(const thread_placement_t *placement) {
+    cpu_set_t cpus;
+
+    if (placement->cpus[0] != '\0') {
+        if (!parse_cpu_list(placement->cpus, &cpus)) {
+            fprintf(stderr, "WARN: Ignoring malformed CPU list '%s' of the %s.\n", placement->cpus, placement->name);
+        } else if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+            fprintf(stderr, "WARN: Failed to place the %s on CPUs '%s': %s\n", placement->name, placement->cpus, strerror(errno));
+        }
+    }
+    if (placement->sched_priority > 0) {
+        struct sched_param param = { .sched_priority = placement->sched_priority };
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+            fprintf(stderr, "WARN: Failed to run the %s SCHED_FIFO: %s\n", placement->name, strerror(errno));
+        }
+    } else if (placement->nice != 0 && setpriority(PRIO_PROCESS, 0, placement->nice) != 0) {
+        fprintf(stderr, "WARN: Failed to set nice value %d of the %s: %s\n", placement->nice, placement->name, strerror(errno));
+    }
+}
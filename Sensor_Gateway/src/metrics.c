@@ -0,0 +1,457 @@
+#define _GNU_SOURCE     /* For accept4() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>   /* For the timeouts of HTTP clients */
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* Include project-specific headers */
+#include "config.h"     /* For METRICS_HTTP_PORT */
+#include "logger.h"
+#include "metrics.h"
+
+#define METRICS_CACHE_LINE 64
+#define METRICS_LINE_SIZE 256       /* Longest exported line */
+#define METRICS_HTTP_CHUNK 4096     /* HTTP response bytes sent per write() */
+
+/**
+ * @brief Counters and histograms of one thread. Only the owner writes them (relaxed loads
+ * and stores, no read-modify-write), any thread may read them. Shards are cache line aligned,
+ * so two threads never write the same line.
+ */
+typedef struct metrics_shard {
+    uint64_t counters[METRIC_COUNTERS];
+    struct {
+        uint64_t buckets[METRIC_HIST_BUCKETS];
+        uint64_t sum;
+    } histograms[METRIC_HISTOGRAMS];
+    struct metrics_shard *next;     /* Registration list, immutable once published */
+} __attribute__((aligned(METRICS_CACHE_LINE))) metrics_shard_t;
+
+/* Name and help text of a metric */
+typedef struct {
+    const char *name;
+    const char *help;
+} metric_info_t;
+
+static const metric_info_t counter_info[METRIC_COUNTERS] = {
+    [METRIC_CONN_ACCEPTS] = { "gateway_connections_accepted_total", "TCP connections accepted." },
+    [METRIC_CONN_BYTES] = { "gateway_received_bytes_total", "Bytes received from sensors." },
+    [METRIC_CONN_FRAMES] = { "gateway_received_readings_total", "Readings decoded from sensor frames." },
+    [METRIC_CONN_PARSE_ERRORS] = { "gateway_parse_errors_total", "Malformed frames and datagrams." },
+    [METRIC_DATAMGT_READINGS] = { "gateway_datamgt_readings_total", "Readings processed by the data manager." },
+    [METRIC_DATAMGT_DUPLICATES] = { "gateway_datamgt_duplicates_total", "Duplicate readings skipped by the data manager." },
+    [METRIC_DATAMGT_UNTRACKED] = { "gateway_datamgt_untracked_total", "Readings dropped for lack of a sensor stats entry." },
+    [METRIC_ALERTS_LOGGED] = { "gateway_alerts_logged_total", "Alert and alert summary lines logged." },
+    [METRIC_ALERTS_SUPPRESSED] = { "gateway_alerts_suppressed_total", "Alerts held back for a summary." },
+    [METRIC_STORAGE_READINGS] = { "gateway_storage_readings_total", "Readings committed to the database." },
+    [METRIC_STORAGE_DUPLICATES] = { "gateway_storage_duplicates_total", "Duplicate readings dropped by the storage manager." },
+    [METRIC_STORAGE_LATE] = { "gateway_storage_late_total", "Readings committed after newer ones, later than the reorder bound." },
+    [METRIC_STORAGE_REFUSED] = { "gateway_storage_refused_total", "Readings refused for a timestamp outside the partitions kept." },
+    [METRIC_FORWARD_SENT] = { "gateway_forward_sent_total", "Readings sent to the upstream gateway." },
+    [METRIC_FORWARD_ACKED] = { "gateway_forward_acked_total", "Readings acknowledged by the upstream gateway." },
+};
+
+static const metric_info_t gauge_info[METRIC_GAUGES] = {
+    [METRIC_CONN_ACTIVE] = { "gateway_connections_active", "Open TCP connections." },
+    [METRIC_SBUFFER_DEPTH] = { "gateway_sbuffer_depth", "Readings queued in the shared buffer." },
+    [METRIC_STORAGE_RETRY_DEPTH] = { "gateway_storage_retry_depth", "Readings waiting for a database retry." },
+    [METRIC_FORWARD_BACKLOG] = { "gateway_forward_backlog", "Readings waiting for the upstream gateway." },
+};
+
+static const metric_info_t histogram_info[METRIC_HISTOGRAMS] = {
+    [METRIC_SBUFFER_WAIT_US] = { "gateway_sbuffer_insert_wait_microseconds", "Time an insert waited for buffer space." },
+    [METRIC_STORAGE_COMMIT_US] = { "gateway_storage_commit_microseconds", "Duration of a database transaction." },
+    [METRIC_STORAGE_BATCH_SIZE] = { "gateway_storage_batch_readings", "Readings per database transaction." },
+    [METRIC_LATENCY_DEQUEUE_US] = { "gateway_latency_dequeue_microseconds", "Time from receipt to removal from the shared buffer." },
+    [METRIC_LATENCY_PROCESSED_US] = { "gateway_latency_processed_microseconds", "Time from receipt to processing by the data manager." },
+    [METRIC_LATENCY_COMMITTED_US] = { "gateway_latency_committed_microseconds", "Time from receipt to database commit." },
+};
+
+static metrics_shard_t *shards = NULL;              /* Every thread's shard, newest first */
+static __thread metrics_shard_t *thread_shard = NULL; /* The calling thread's shard */
+static pthread_mutex_t shards_mutex = PTHREAD_MUTEX_INITIALIZER; /* Serializes registrations */
+static metrics_shard_t fallback_shard;              /* Shared, atomically updated, if a shard can't be allocated */
+
+static long gauges[METRIC_GAUGES];
+static struct {
+    metrics_gauge_fn fn;
+    void *ctx;
+} gauge_sources[METRIC_GAUGES];
+static pthread_mutex_t sources_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile int http_terminate_flag = 0;
+static int http_listen_sd = -1;
+
+/* --- Local Helper Functions --- */
+
+/**
+ * @brief Returns the calling thread's shard, registering a new one on first use.
+ * @return The shard, NULL if it can't be allocated.
+ */
+static metrics_shard_t *get_thread_shard(void) {
+    if (thread_shard != NULL) {
+        return thread_shard;
+    }
+    metrics_shard_t *shard = aligned_alloc(METRICS_CACHE_LINE, sizeof(metrics_shard_t));
+    if (shard == NULL) {
+        return NULL;
+    }
+    memset(shard, 0, sizeof(*shard));
+    pthread_mutex_lock(&shards_mutex);
+    shard->next = shards;
+    __atomic_store_n(&shards, shard, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&shards_mutex);
+    thread_shard = shard;
+    return shard;
+}
+
+/** @brief Adds to a value of the calling thread's shard, or of the fallback shard. */
+static void shard_add(metrics_shard_t *shard, uint64_t *value, uint64_t amount) {
+    if (shard != NULL) {
+        __atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(value, amount, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Maps a value to its histogram bucket.
+ */
+static size_t bucket_index(uint64_t value) {
+    if (value < METRIC_HIST_SUB_BUCKETS) {
+        return (size_t)value;
+    }
+    if (value >> METRIC_HIST_MAX_BITS) {
+        return METRIC_HIST_BUCKETS - 1;
+    }
+    int bits = 63 - __builtin_clzll(value); /* At least 3 */
+    size_t sub = (size_t)(value >> (bits - 3)) & (METRIC_HIST_SUB_BUCKETS - 1);
+    return (size_t)(bits - 2) * METRIC_HIST_SUB_BUCKETS + sub;
+}
+
+/**
+ * @brief Returns the largest value a histogram bucket holds.
+ */
+static uint64_t bucket_upper_bound(size_t bucket) {
+    if (bucket < METRIC_HIST_SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = (int)(bucket / METRIC_HIST_SUB_BUCKETS) - 1; /* bits - 3 */
+    uint64_t lower = (uint64_t)(METRIC_HIST_SUB_BUCKETS + bucket % METRIC_HIST_SUB_BUCKETS) << shift;
+    return lower + ((uint64_t)1 << shift) - 1;
+}
+
+/**
+ * @brief Sums one bucket of a histogram over all shards.
+ */
+static uint64_t bucket_total(metrics_shard_t *head, metric_histogram_t histogram, size_t bucket) {
+    uint64_t total = __atomic_load_n(&fallback_shard.histograms[histogram].buckets[bucket], __ATOMIC_RELAXED);
+    for (metrics_shard_t *shard = head; shard != NULL; shard = shard->next) {
+        total += __atomic_load_n(&shard->histograms[histogram].buckets[bucket], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+/**
+ * @brief Sends one formatted line to a writer.
+ */
+static void emit(metrics_write_fn writer, void *ctx, const char *format, ...) __attribute__((format(printf, 3, 4)));
+static void emit(metrics_write_fn writer, void *ctx, const char *format, ...) {
+    char line[METRICS_LINE_SIZE];
+    va_list args;
+
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (n > 0) {
+        writer(line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1, ctx);
+    }
+}
+
+/** @brief Writes the HELP and TYPE lines of a metric. */
+static void emit_header(metrics_write_fn writer, void *ctx, const metric_info_t *info, const char *type) {
+    emit(writer, ctx, "# HELP %s %s\n", info->name, info->help);
+    emit(writer, ctx, "# TYPE %s %s\n", info->name, type);
+}
+
+/* --- Public Functions --- */
+
+void metrics_add(metric_counter_t counter, uint64_t value) {
+    metrics_shard_t *shard = get_thread_shard();
+    shard_add(shard, &(shard ? shard : &fallback_shard)->counters[counter], value);
+}
+
+uint64_t metrics_counter_total(metric_counter_t counter) {
+    uint64_t total = __atomic_load_n(&fallback_shard.counters[counter], __ATOMIC_RELAXED);
+    for (metrics_shard_t *shard = __atomic_load_n(&shards, __ATOMIC_ACQUIRE); shard != NULL; shard = shard->next) {
+        total += __atomic_load_n(&shard->counters[counter], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+void metrics_gauge_set(metric_gauge_t gauge, long value) {
+    __atomic_store_n(&gauges[gauge], value, __ATOMIC_RELAXED);
+}
+
+void metrics_gauge_source(metric_gauge_t gauge, metrics_gauge_fn fn, void *ctx) {
+    pthread_mutex_lock(&sources_mutex);
+    gauge_sources[gauge].fn = fn;
+    gauge_sources[gauge].ctx = ctx;
+    pthread_mutex_unlock(&sources_mutex);
+}
+
+void metrics_observe(metric_histogram_t histogram, uint64_t value) {
+    metrics_shard_t *shard = get_thread_shard();
+    metrics_shard_t *target = shard ? shard : &fallback_shard;
+
+    shard_add(shard, &target->histograms[histogram].buckets[bucket_index(value)], 1);
+    shard_add(shard, &target->histograms[histogram].sum, value);
+}
+
+void metrics_observe_latency(metric_histogram_t histogram, const sensor_data_t *readings, size_t count) {
+    metrics_shard_t *shard = get_thread_shard();
+    metrics_shard_t *target = shard ? shard : &fallback_shard;
+    uint32_t now = metrics_ingest_stamp();
+
+    for (size_t i = 0; i < count; ++i) {
+        if (readings[i].ingest_us == 0) {
+            continue; /* E.g. replayed from the spill log */
+        }
+        uint32_t age = now - readings[i].ingest_us;
+        shard_add(shard, &target->histograms[histogram].buckets[bucket_index(age)], 1);
+        shard_add(shard, &target->histograms[histogram].sum, age);
+    }
+}
+
+uint64_t metrics_quantile(metric_histogram_t histogram, double quantile, uint64_t *count) {
+    metrics_shard_t *head = __atomic_load_n(&shards, __ATOMIC_ACQUIRE);
+    uint64_t buckets[METRIC_HIST_BUCKETS];
+    uint64_t total = 0;
+
+    for (size_t b = 0; b < METRIC_HIST_BUCKETS; ++b) {
+        buckets[b] = bucket_total(head, histogram, b);
+        total += buckets[b];
+    }
+    if (count != NULL) {
+        *count = total;
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    /* Rank of the quantile, 1-based: the value below which quantile * total values lie */
+    uint64_t rank = (uint64_t)(quantile * (double)total + 0.5);
+    rank = rank < 1 ? 1 : (rank > total ? total : rank);
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b < METRIC_HIST_BUCKETS; ++b) {
+        cumulative += buckets[b];
+        if (cumulative >= rank) {
+            return bucket_upper_bound(b);
+        }
+    }
+    return bucket_upper_bound(METRIC_HIST_BUCKETS - 1);
+}
+
+/*
+ * Function: metrics_export
+ * ------------------------
+ * Sums the shards and writes every metric. Histograms are exported with one cumulative
+ * bucket per power of two (le = 2^k - 1); _count is the sum of the buckets read, so it
+ * always equals the +Inf bucket even while threads keep recording.
+ */
+void metrics_export(metrics_write_fn writer, void *ctx) {
+    metrics_shard_t *head = __atomic_load_n(&shards, __ATOMIC_ACQUIRE);
+
+    for (int c = 0; c < METRIC_COUNTERS; ++c) {
+        uint64_t total = metrics_counter_total((metric_counter_t)c);
+        emit_header(writer, ctx, &counter_info[c], "counter");
+        emit(writer, ctx, "%s %llu\n", counter_info[c].name, (unsigned long long)total);
+    }
+
+    for (int g = 0; g < METRIC_GAUGES; ++g) {
+        long value;
+        pthread_mutex_lock(&sources_mutex);
+        if (gauge_sources[g].fn != NULL) {
+            value = gauge_sources[g].fn(gauge_sources[g].ctx);
+        } else {
+            value = __atomic_load_n(&gauges[g], __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&sources_mutex);
+        emit_header(writer, ctx, &gauge_info[g], "gauge");
+        emit(writer, ctx, "%s %ld\n", gauge_info[g].name, value);
+    }
+
+    for (int h = 0; h < METRIC_HISTOGRAMS; ++h) {
+        uint64_t cumulative = 0;
+        uint64_t sum = __atomic_load_n(&fallback_shard.histograms[h].sum, __ATOMIC_RELAXED);
+        for (metrics_shard_t *shard = head; shard != NULL; shard = shard->next) {
+            sum += __atomic_load_n(&shard->histograms[h].sum, __ATOMIC_RELAXED);
+        }
+        emit_header(writer, ctx, &histogram_info[h], "histogram");
+        for (size_t b = 0; b < METRIC_HIST_BUCKETS; ++b) {
+            cumulative += bucket_total(head, (metric_histogram_t)h, b);
+            /* Bucket b ends a power of two when the next one starts the following power */
+            if (b % METRIC_HIST_SUB_BUCKETS == METRIC_HIST_SUB_BUCKETS - 1 && b != METRIC_HIST_BUCKETS - 1) {
+                emit(writer, ctx, "%s_bucket{le=\"%llu\"} %llu\n", histogram_info[h].name,
+                     (unsigned long long)bucket_upper_bound(b), (unsigned long long)cumulative);
+            }
+        }
+        emit(writer, ctx, "%s_bucket{le=\"+Inf\"} %llu\n", histogram_info[h].name, (unsigned long long)cumulative);
+        emit(writer, ctx, "%s_sum %llu\n", histogram_info[h].name, (unsigned long long)sum);
+        emit(writer, ctx, "%s_count %llu\n", histogram_info[h].name, (unsigned long long)cumulative);
+    }
+}
+
+/* --- HTTP endpoint --- */
+
+/* Response of the HTTP endpoint, sent in chunks of METRICS_HTTP_CHUNK */
+typedef struct {
+    int sd;
+    char buffer[METRICS_HTTP_CHUNK];
+    size_t len;
+    bool failed;
+} http_response_t;
+
+static void http_flush(http_response_t *response) {
+    size_t sent = 0;
+
+    while (!response->failed && sent < response->len) {
+        ssize_t n = write(response->sd, response->buffer + sent, response->len - sent);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            response->failed = true; /* Also on the send timeout */
+            break;
+        }
+        sent += (size_t)n;
+    }
+    response->len = 0;
+}
+
+/** @brief metrics_write_fn appending to an HTTP response. */
+static void http_write(const char *text, size_t len, void *ctx) {
+    http_response_t *response = ctx;
+
+    if (sizeof(response->buffer) - response->len < len) {
+        http_flush(response);
+    }
+    memcpy(response->buffer + response->len, text, len);
+    response->len += len;
+}
+
+/**
+ * @brief Reads the request headers (up to the blank line, METRICS_HTTP_REQUEST_MAX bytes
+ *        or the receive timeout) and answers with the metrics, whatever was asked.
+ */
+static void http_serve(int client_sd) {
+    static http_response_t response; /* Only the HTTP thread serves requests */
+    char request[METRICS_HTTP_REQUEST_MAX + 1];
+    size_t received = 0;
+    struct timeval timeout = { CMD_SEND_TIMEOUT_MS / 1000, (CMD_SEND_TIMEOUT_MS % 1000) * 1000 };
+
+    setsockopt(client_sd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_sd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    while (received < METRICS_HTTP_REQUEST_MAX) {
+        ssize_t n = read(client_sd, request + received, METRICS_HTTP_REQUEST_MAX - received);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        received += (size_t)n;
+        request[received] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL) {
+            break;
+        }
+    }
+    if (received == 0) {
+        return;
+    }
+
+    memset(&response, 0, sizeof(response));
+    response.sd = client_sd;
+    const char *status_line = "HTTP/1.0 200 OK\r\n"
+                              "Content-Type: text/plain; version=0.0.4\r\n"
+                              "Connection: close\r\n\r\n";
+    http_write(status_line, strlen(status_line), &response);
+    metrics_export(http_write, &response);
+    http_flush(&response);
+}
+
+/*
+ * Function: metrics_http_run
+ * --------------------------
+ * Serves one HTTP client at a time on METRICS_HTTP_BIND_ADDR:METRICS_HTTP_PORT. The body
+ * ends when the connection closes, so no Content-Length is needed.
+ */
+void *metrics_http_run(void *arg) {
+    (void)arg;
+    struct sockaddr_in addr;
+    int reuse = 1;
+
+    pthread_setname_np(pthread_self(), "metrics-http");
+
+    http_listen_sd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (http_listen_sd < 0) {
+        log_message(LOG_LEVEL_ERROR, "Metrics endpoint socket() failed: %s", strerror(errno));
+        return NULL;
+    }
+    setsockopt(http_listen_sd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(METRICS_HTTP_PORT);
+    inet_pton(AF_INET, METRICS_HTTP_BIND_ADDR, &addr.sin_addr);
+    if (bind(http_listen_sd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(http_listen_sd, 5) < 0) {
+        log_message(LOG_LEVEL_ERROR, "Metrics endpoint can't listen on %s:%d: %s",
+                    METRICS_HTTP_BIND_ADDR, METRICS_HTTP_PORT, strerror(errno));
+        close(http_listen_sd);
+        http_listen_sd = -1;
+        return NULL;
+    }
+    log_message(LOG_LEVEL_INFO, "Metrics endpoint listening on http://%s:%d/metrics", METRICS_HTTP_BIND_ADDR, METRICS_HTTP_PORT);
+
+    while (!http_terminate_flag) {
+        int client_sd = accept4(http_listen_sd, NULL, NULL, SOCK_CLOEXEC);
+        if (client_sd < 0) {
+            if (errno == EINTR && !http_terminate_flag) {
+                continue;
+            }
+            if (!http_terminate_flag) {
+                log_message(LOG_LEVEL_ERROR, "Metrics endpoint accept() failed: %s", strerror(errno));
+            }
+            break; /* Exit loop on error or shutdown */
+        }
+        http_serve(client_sd);
+        close(client_sd);
+    }
+
+    if (http_listen_sd != -1) {
+        close(http_listen_sd);
+        http_listen_sd = -1;
+    }
+    return NULL;
+}
+
+/*
+ * Function: metrics_http_stop
+ * ---------------------------
+ * Sets the termination flag and shuts the listening socket down to unblock accept();
+ * the thread closes it.
+ */
+void metrics_http_stop(void) {
+    http_terminate_flag = 1;
+    if (http_listen_sd != -1) {
+        shutdown(http_listen_sd, SHUT_RDWR);
+    }
+}
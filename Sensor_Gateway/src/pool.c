@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* Include project-specific headers */
+#include "config.h"     /* For POOL_THREAD_CACHE */
+#include "pool.h"
+
+#define POOL_ALIGN 16   /* Objects are aligned like malloc() results */
+#define POOL_SLAB_ALIGN 64
+
+/**
+ * @brief A pool: one slab holding every object, and a free list threaded through the
+ *        first word of the free objects that are not in a thread's cache.
+ */
+struct pool {
+    char name[24];
+    size_t object_size;
+    size_t capacity;
+    unsigned char *slab;
+    int id;                      /* Index in pools[] and in each thread's caches */
+    unsigned int generation;     /* Tells a thread cache of an earlier pool with the same id apart */
+    pthread_mutex_t mutex;       /* Guards free_list */
+    void *free_list;
+    size_t in_use;               /* Relaxed atomics, for pool_get_stats() */
+    size_t peak;
+    unsigned long failures;
+};
+
+/**
+ * @brief Free objects of one pool held by one thread.
+ */
+typedef struct {
+    unsigned int generation;     /* Pool the objects belong to; 0 = none */
+    int count;
+    void *objects[POOL_THREAD_CACHE];
+} pool_cache_t;
+
+static pool_t *pools[POOL_MAX_POOLS];                /* Pools alive, by id */
+static unsigned int last_generation = 0;
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER; /* Guards pools[] and last_generation */
+static __thread pool_cache_t thread_caches[POOL_MAX_POOLS];
+
+/**
+ * @brief Returns the calling thread's cache for a pool, emptied if it belonged to a pool
+ *        destroyed since (its objects went with that pool's slab).
+ */
+static pool_cache_t *thread_cache(pool_t *pool) {
+    pool_cache_t *cache = &thread_caches[pool->id];
+    if (cache->generation != pool->generation) {
+        cache->generation = pool->generation;
+        cache->count = 0;
+    }
+    return cache;
+}
+
+gateway_error_t pool_create(pool_t **pool, const char *name, size_t object_size, size_t capacity) {
+    pool_t *created;
+    size_t size = (object_size < sizeof(void *) ? sizeof(void *) : object_size);
+    size = (size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+
+    if (pool == NULL || capacity == 0) {
+        return GATEWAY_ERROR;
+    }
+    created = calloc(1, sizeof(pool_t));
+    if (created == NULL) {
+        return GATEWAY_ERROR_NOMEM;
+    }
+    /* aligned_alloc() wants a multiple of the alignment */
+    created->slab = aligned_alloc(POOL_SLAB_ALIGN, (size * capacity + POOL_SLAB_ALIGN - 1) & ~(size_t)(POOL_SLAB_ALIGN - 1));
+    if (created->slab == NULL) {
+        free(created);
+        return GATEWAY_ERROR_NOMEM;
+    }
+    snprintf(created->name, sizeof(created->name), "%s", name);
+    created->object_size = size;
+    created->capacity = capacity;
+    pthread_mutex_init(&created->mutex, NULL);
+
+    /* Thread the free list in address order, so the first objects handed out are adjacent */
+    for (size_t i = capacity; i-- > 0;) {
+        void *object = created->slab + i * size;
+        *(void **)object = created->free_list;
+        created->free_list = object;
+    }
+
+    pthread_mutex_lock(&registry_mutex);
+    created->id = -1;
+    for (int i = 0; i < POOL_MAX_POOLS; ++i) {
+        if (pools[i] == NULL) {
+            created->id = i;
+            break;
+        }
+    }
+    if (created->id < 0) {
+        pthread_mutex_unlock(&registry_mutex);
+        pthread_mutex_destroy(&created->mutex);
+        free(created->slab);
+        free(created);
+        return GATEWAY_ERROR;
+    }
+    created->generation = ++last_generation;
+    pools[created->id] = created;
+    pthread_mutex_unlock(&registry_mutex);
+
+    *pool = created;
+    return GATEWAY_SUCCESS;
+}
+
+void pool_destroy(pool_t **pool) {
+    if (pool == NULL || *pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&registry_mutex);
+    pools[(*pool)->id] = NULL;
+    pthread_mutex_unlock(&registry_mutex);
+
+    pthread_mutex_destroy(&(*pool)->mutex);
+    free((*pool)->slab);
+    free(*pool);
+    *pool = NULL;
+}
+
+void *pool_alloc(pool_t *pool) {
+    pool_cache_t *cache = thread_cache(pool);
+
+    if (cache->count == 0) {
+        /* Refill half the cache, so alternating alloc and free does not bounce on the lock */
+        pthread_mutex_lock(&pool->mutex);
+        while (cache->count < POOL_THREAD_CACHE / 2 && pool->free_list != NULL) {
+            void *object = pool->free_list;
+            pool->free_list = *(void **)object;
+            cache->objects[cache->count++] = object;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+        if (cache->count == 0) {
+            __atomic_add_fetch(&pool->failures, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+    }
+
+    size_t in_use = __atomic_add_fetch(&pool->in_use, 1, __ATOMIC_RELAXED);
+    if (in_use > __atomic_load_n(&pool->peak, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&pool->peak, in_use, __ATOMIC_RELAXED); /* Racy, the peak is only reported */
+    }
+    return cache->objects[--cache->count];
+}
+
+void pool_free(pool_t *pool, void *object) {
+    if (object == NULL) {
+        return;
+    }
+    pool_cache_t *cache = thread_cache(pool);
+
+    if (cache->count == POOL_THREAD_CACHE) {
+        /* Hand half back, objects freed by a thread that never allocates do not pile up here */
+        pthread_mutex_lock(&pool->mutex);
+        while (cache->count > POOL_THREAD_CACHE / 2) {
+            void *returned = cache->objects[--cache->count];
+            *(void **)returned = pool->free_list;
+            pool->free_list = returned;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    cache->objects[cache->count++] = object;
+    __atomic_sub_fetch(&pool->in_use, 1, __ATOMIC_RELAXED);
+}
+
+int pool_get_stats(pool_stats_t *stats, int max_count) {
+    int count = 0;
+
+    pthread_mutex_lock(&registry_mutex);
+    for (int i = 0; i < POOL_MAX_POOLS && count < max_count; ++i) {
+        pool_t *pool = pools[i];
+        if (pool == NULL) {
+            continue;
+        }
+        pool_stats_t *out = &stats[count++];
+        snprintf(out->name, sizeof(out->name), "%s", pool->name);
+        out->object_size = pool->object_size;
+        out->capacity = pool->capacity;
+        out->in_use = __atomic_load_n(&pool->in_use, __ATOMIC_RELAXED);
+        out->peak = __atomic_load_n(&pool->peak, __ATOMIC_RELAXED);
+        out->failures = __atomic_load_n(&pool->failures, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&registry_mutex);
+    return count;
+}
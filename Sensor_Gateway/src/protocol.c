@@ -0,0 +1,267 @@
+#include <string.h>
+#include <endian.h>     /* For be16toh(), be64toh(), htobe16() */
+#include <arpa/inet.h>  /* For ntohs() */
+
+/* Include project-specific headers */
+#include "common.h"
+#include "protocol.h"
+
+/* --- Forward Declarations (Internal Helper Functions) --- */
+static size_t decode_legacy(const uint8_t *data, size_t len, sensor_ts_t now,
+                            sensor_data_t *out, size_t max_out, size_t *decoded);
+static gateway_error_t decode_v2(protocol_stream_t *stream, const uint8_t *data, size_t len, sensor_ts_t now,
+                                 sensor_data_t *out, size_t max_out, size_t *consumed, size_t *decoded);
+static bool decode_packed_records(const uint8_t *payload, size_t size, size_t records, sensor_ts_t now,
+                                  sensor_data_t *out);
+static bool read_varint(const uint8_t **cursor, const uint8_t *end, uint64_t *value);
+static uint8_t *write_varint(uint8_t *out, uint64_t value);
+
+_Static_assert(PROTOCOL_V2_PACKED_MAX_SIZE >= PROTOCOL_V2_HEADER_SIZE + PROTOCOL_V2_MAX_RECORDS * PROTOCOL_V2_RECORD_SIZE,
+               "PROTOCOL_MAX_FRAME_SIZE must cover both v2 frame kinds");
+_Static_assert(PROTOCOL_V2_PACKED_MAX_SIZE <= UINT16_MAX, "the payload size of a packed frame is 16 bits");
+
+/**
+ * @brief Decodes every complete frame at the start of a block of received bytes.
+ */
+gateway_error_t protocol_decode(protocol_stream_t *stream, const uint8_t *data, size_t len, sensor_ts_t now,
+                                sensor_data_t *out, size_t max_out, size_t *consumed, size_t *decoded) {
+    *consumed = 0;
+    *decoded = 0;
+    if (len == 0) {
+        return GATEWAY_SUCCESS;
+    }
+
+    /* Negotiate on the first byte of the stream */
+    if (stream->version == 0) {
+        stream->version = (data[0] == PROTOCOL_V2_MAGIC) ? PROTOCOL_V2_VERSION : 1;
+    }
+
+    if (stream->version == PROTOCOL_V2_VERSION) {
+        return decode_v2(stream, data, len, now, out, max_out, consumed, decoded);
+    }
+    *consumed = decode_legacy(data, len, now, out, max_out, decoded);
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Decodes consecutive legacy 10-byte frames.
+ * @return The number of bytes consumed.
+ */
+static size_t decode_legacy(const uint8_t *data, size_t len, sensor_ts_t now,
+                            sensor_data_t *out, size_t max_out, size_t *decoded) {
+    size_t offset = 0;
+    size_t count = 0;
+
+    while (len - offset >= PROTOCOL_LEGACY_FRAME_SIZE && count < max_out) {
+        uint16_t network_sensor_id;
+        double network_value;
+
+        memcpy(&network_sensor_id, data + offset, sizeof(uint16_t));
+        memcpy(&network_value, data + offset + sizeof(uint16_t), sizeof(double));
+
+        out[count].id = ntohs(network_sensor_id);
+        out[count].value = network_value;
+        out[count].ts = now;
+        count++;
+        offset += PROTOCOL_LEGACY_FRAME_SIZE;
+    }
+
+    *decoded = count;
+    return offset;
+}
+
+/**
+ * @brief Decodes consecutive v2 batch frames, plain or packed.
+ * @return GATEWAY_SUCCESS, or CONNMGR_PROTOCOL_ERR on a bad header or packed payload.
+ */
+static gateway_error_t decode_v2(protocol_stream_t *stream, const uint8_t *data, size_t len, sensor_ts_t now,
+                                 sensor_data_t *out, size_t max_out, size_t *consumed, size_t *decoded) {
+    size_t offset = 0;
+    size_t count = 0;
+
+    while (len - offset >= PROTOCOL_V2_HEADER_SIZE) {
+        const uint8_t *frame = data + offset;
+        uint16_t records;
+
+        memcpy(&records, frame + 2, sizeof(uint16_t));
+        records = be16toh(records);
+
+        if (frame[0] == PROTOCOL_V2_MAGIC && frame[1] == PROTOCOL_V2_VERSION && records == 0) {
+            stream->acked = true; /* Acknowledgement request */
+            offset += PROTOCOL_V2_HEADER_SIZE;
+            continue;
+        }
+        if (frame[0] != PROTOCOL_V2_MAGIC ||
+            (frame[1] != PROTOCOL_V2_VERSION && frame[1] != PROTOCOL_V2_PACKED_VERSION) ||
+            records == 0 || records > PROTOCOL_V2_MAX_RECORDS) {
+            *consumed = offset;
+            *decoded = count;
+            return CONNMGR_PROTOCOL_ERR;
+        }
+
+        if (frame[1] == PROTOCOL_V2_PACKED_VERSION) {
+            uint16_t payload;
+            if (len - offset < PROTOCOL_V2_PACKED_HEADER_SIZE) {
+                break;
+            }
+            memcpy(&payload, frame + 4, sizeof(uint16_t));
+            payload = be16toh(payload);
+            if (payload > PROTOCOL_V2_MAX_RECORDS * PROTOCOL_V2_PACKED_MAX_RECORD_SIZE) {
+                *consumed = offset;
+                *decoded = count;
+                return CONNMGR_PROTOCOL_ERR;
+            }
+            size_t frame_size = PROTOCOL_V2_PACKED_HEADER_SIZE + payload;
+            if (len - offset < frame_size || max_out - count < records) {
+                break;
+            }
+            if (!decode_packed_records(frame + PROTOCOL_V2_PACKED_HEADER_SIZE, payload, records, now, out + count)) {
+                *consumed = offset;
+                *decoded = count;
+                return CONNMGR_PROTOCOL_ERR;
+            }
+            count += records;
+            offset += frame_size;
+            continue;
+        }
+
+        size_t frame_size = PROTOCOL_V2_HEADER_SIZE + (size_t)records * PROTOCOL_V2_RECORD_SIZE;
+        if (len - offset < frame_size || max_out - count < records) {
+            break; /* Incomplete, or its readings do not fit this time */
+        }
+
+        const uint8_t *record = frame + PROTOCOL_V2_HEADER_SIZE;
+        for (uint16_t i = 0; i < records; ++i, record += PROTOCOL_V2_RECORD_SIZE) {
+            uint16_t id;
+            int64_t ts;
+            uint64_t bits;
+
+            memcpy(&id, record, sizeof(id));
+            memcpy(&ts, record + sizeof(id), sizeof(ts));
+            memcpy(&bits, record + sizeof(id) + sizeof(ts), sizeof(bits));
+            ts = (int64_t)be64toh((uint64_t)ts);
+            bits = be64toh(bits);
+
+            out[count].id = be16toh(id);
+            memcpy(&out[count].value, &bits, sizeof(double));
+            out[count].ts = ts != 0 ? (sensor_ts_t)ts : now;
+            count++;
+        }
+        offset += frame_size;
+    }
+
+    *consumed = offset;
+    *decoded = count;
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Decodes the records of a packed frame, which must fill its payload exactly.
+ * @return false if the payload is malformed.
+ */
+static bool decode_packed_records(const uint8_t *payload, size_t size, size_t records, sensor_ts_t now,
+                                  sensor_data_t *out) {
+    const uint8_t *cursor = payload;
+    const uint8_t *end = payload + size;
+    uint64_t id = 0, ts = 0, bits = 0;
+
+    for (size_t i = 0; i < records; ++i) {
+        uint64_t id_delta, ts_delta;
+        if (!read_varint(&cursor, end, &id_delta) || !read_varint(&cursor, end, &ts_delta) || cursor == end) {
+            return false;
+        }
+        id += (id_delta >> 1) ^ -(id_delta & 1); /* Zigzag: 0, -1, 1, -2, ... */
+        ts += (ts_delta >> 1) ^ -(ts_delta & 1);
+        if (id > UINT16_MAX) {
+            return false;
+        }
+
+        int leading = *cursor >> 4, trailing = *cursor & 0x0f;
+        cursor++;
+        if (leading + trailing > 8 || (leading + trailing == 8 && leading != 8)) {
+            return false;
+        }
+        int middle = 8 - leading - trailing;
+        if (end - cursor < middle) {
+            return false;
+        }
+        uint64_t x = 0;
+        for (int b = 0; b < middle; ++b) {
+            x = (x << 8) | *cursor++;
+        }
+        bits ^= middle > 0 ? x << (8 * trailing) : 0;
+
+        out[i].id = (sensor_id_t)id;
+        memcpy(&out[i].value, &bits, sizeof(double));
+        out[i].ts = ts != 0 ? (sensor_ts_t)(int64_t)ts : now;
+    }
+    return cursor == end;
+}
+
+/**
+ * @brief Reads a little-endian base 128 varint of up to 64 bits.
+ * @return false if it runs past end or is too long.
+ */
+static bool read_varint(const uint8_t **cursor, const uint8_t *end, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *cursor < end; shift += 7) {
+        uint8_t byte = *(*cursor)++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint8_t *write_varint(uint8_t *out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+/**
+ * @brief Encodes readings as one packed v2 frame.
+ */
+size_t protocol_encode_packed(const sensor_data_t *readings, size_t count, uint8_t *out) {
+    uint8_t *cursor = out + PROTOCOL_V2_PACKED_HEADER_SIZE;
+    uint64_t id = 0, ts = 0, bits = 0;
+
+    if (count > PROTOCOL_V2_MAX_RECORDS) {
+        count = PROTOCOL_V2_MAX_RECORDS;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t next_id = readings[i].id, next_ts = (uint64_t)(int64_t)readings[i].ts, next_bits;
+        memcpy(&next_bits, &readings[i].value, sizeof(next_bits));
+
+        int64_t id_delta = (int64_t)(next_id - id), ts_delta = (int64_t)(next_ts - ts);
+        cursor = write_varint(cursor, ((uint64_t)id_delta << 1) ^ (uint64_t)(id_delta >> 63));
+        cursor = write_varint(cursor, ((uint64_t)ts_delta << 1) ^ (uint64_t)(ts_delta >> 63));
+
+        uint64_t x = next_bits ^ bits;
+        if (x == 0) {
+            *cursor++ = 8 << 4;
+        } else {
+            int leading = __builtin_clzll(x) / 8, trailing = __builtin_ctzll(x) / 8;
+            *cursor++ = (uint8_t)(leading << 4 | trailing);
+            for (int b = 7 - leading; b >= trailing; --b) {
+                *cursor++ = (uint8_t)(x >> (8 * b));
+            }
+        }
+        id = next_id;
+        ts = next_ts;
+        bits = next_bits;
+    }
+
+    uint16_t records = htobe16((uint16_t)count);
+    uint16_t payload = htobe16((uint16_t)(cursor - out - PROTOCOL_V2_PACKED_HEADER_SIZE));
+    out[0] = PROTOCOL_V2_MAGIC;
+    out[1] = PROTOCOL_V2_PACKED_VERSION;
+    memcpy(out + 2, &records, sizeof(records));
+    memcpy(out + 4, &payload, sizeof(payload));
+    return (size_t)(cursor - out);
+}
@@ -3,11 +3,13 @@
 #include <pthread.h>    /* For mutex and condition variables */
 #include <errno.h>      /* For error codes */
 #include <string.h>     /* For memcpy */
+#include <time.h>       /* For clock_gettime */
 
 /* Include project-specific headers */
 #include "config.h"     /* For SBUFFER_SIZE */
 #include "common.h"     /* For sensor_data_t, gateway_error_t */
 #include "sbuffer.h"    /* For sbuffer_t and function declarations */
+#include "metrics.h"    /* For the insert wait histogram */
 
 /* --- Implementation of Shared Buffer Functions --- */
 
@@ -19,12 +21,20 @@
  * use by producer and consumer threads.
  * 
  * @param buffer A pointer to the pointer of the buffer struct to be initialized.
+ * @param capacity Initial number of slots (0 selects SBUFFER_SIZE).
+ * @param max_capacity Growth limit, growth is disabled if not above capacity.
  * @return GATEWAY_SUCCESS on success, an error code otherwise.
  */
-gateway_error_t sbuffer_init(sbuffer_t **buffer) {
+gateway_error_t sbuffer_init(sbuffer_t **buffer, size_t capacity, size_t max_capacity) {
     if (buffer == NULL) {
         return GATEWAY_ERROR_INVALID_ARG; /* Invalid argument error */
     }
+    if (capacity == 0) {
+        capacity = SBUFFER_SIZE; /* Compile-time default */
+    }
+    if (max_capacity < capacity) {
+        max_capacity = capacity; /* Growth disabled */
+    }
 
     /* Allocate memory for the buffer structure */
     *buffer = malloc(sizeof(sbuffer_t));
@@ -32,16 +42,34 @@ gateway_error_t sbuffer_init(sbuffer_t **buffer) {
         return GATEWAY_ERROR_NOMEM; /* Memory allocation error */
     }
 
+    /* Allocate the element storage */
+    (*buffer)->buffer = malloc(capacity * sizeof(sensor_data_t));
+    if ((*buffer)->buffer == NULL) {
+        free(*buffer);
+        *buffer = NULL;
+        return GATEWAY_ERROR_NOMEM; /* Memory allocation error */
+    }
+    (*buffer)->capacity = capacity;
+    (*buffer)->max_capacity = max_capacity;
+
     /* Initialize buffer fields */
-    (*buffer)->head = 0; /* Initialize head index */
-    (*buffer)->tail = 0; /* Initialize tail index */
-    (*buffer)->count = 0; /* Initialize count of elements */
+    (*buffer)->head = 0; /* Initialize head sequence */
+    (*buffer)->tail = 0; /* Initialize tail sequence */
+    (*buffer)->num_readers = 0; /* No readers registered yet */
+    for (int i = 0; i < SBUFFER_MAX_READERS; ++i) {
+        (*buffer)->read_pos[i] = 0;
+    }
+    (*buffer)->high_watermark = 0;
+    (*buffer)->blocked_inserts = 0;
+    (*buffer)->blocked_time_us = 0;
+    (*buffer)->grow_events = 0;
     (*buffer)->shutdown_flag = false; /* Initialize shutdown flag */
 
     /* Initialize mutex */
     if (pthread_mutex_init(&((*buffer)->mutex), NULL) != 0) {
         perror("SBuffer ERROR: Mutex initialization failed");
-        free(*buffer); /* Clean up allocated memory */
+        free((*buffer)->buffer); /* Clean up allocated memory */
+        free(*buffer);
         *buffer = NULL;
         return THREAD_MUTEX_INIT_ERR; /* Mutex initialization error */
     }
@@ -50,6 +78,7 @@ gateway_error_t sbuffer_init(sbuffer_t **buffer) {
     if (pthread_cond_init(&((*buffer)->not_full), NULL) != 0) {
         perror("SBuffer ERROR: 'not_full' condition variable initialization failed");
         pthread_mutex_destroy(&((*buffer)->mutex)); /* Clean up mutex */
+        free((*buffer)->buffer);
         free(*buffer);
         *buffer = NULL;
         return THREAD_COND_INIT_ERR; /* Condition variable initialization error */
@@ -58,6 +87,7 @@ gateway_error_t sbuffer_init(sbuffer_t **buffer) {
         perror("SBuffer ERROR: 'not_empty' condition variable initialization failed");
         pthread_cond_destroy(&((*buffer)->not_full)); /* Clean up previous condition variable */
         pthread_mutex_destroy(&((*buffer)->mutex));
+        free((*buffer)->buffer);
         free(*buffer);
         *buffer = NULL;
         return THREAD_COND_INIT_ERR; /* Condition variable initialization error */
@@ -98,18 +128,173 @@ gateway_error_t sbuffer_free(sbuffer_t **buffer) {
         result = SBUFFER_FREE_ERR; /* Report error but continue cleanup */
     }
 
-    /* Free the buffer structure itself */
+    /* Free the element storage and the buffer structure itself */
+    free((*buffer)->buffer);
     free(*buffer);
     *buffer = NULL; /* Set user's pointer to NULL */
 
     return result; /* Return the result of cleanup */
 }
 
+/* --- Internal Helper Functions --- */
+
+/**
+ * @brief Recomputes the tail as the cursor of the slowest reader.
+ * Must be called with the buffer mutex held.
+ * With no registered readers every element is considered consumed.
+ * 
+ * @param buffer A pointer to the initialized shared buffer.
+ */
+static void update_tail(sbuffer_t *buffer) {
+    unsigned long min_pos = buffer->head;
+
+    for (int i = 0; i < buffer->num_readers; ++i) {
+        if (buffer->read_pos[i] < min_pos) {
+            min_pos = buffer->read_pos[i];
+        }
+    }
+    buffer->tail = min_pos;
+}
+
+/**
+ * @brief Returns a monotonic timestamp in microseconds.
+ */
+static unsigned long long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + (unsigned long long)ts.tv_nsec / 1000ULL;
+}
+
+/**
+ * @brief Doubles the storage (bounded by max_capacity) keeping every unread element.
+ * Must be called with the buffer mutex held.
+ * 
+ * @param buffer A pointer to the initialized shared buffer.
+ * @return true if the buffer was enlarged, false if at the limit or out of memory.
+ */
+static bool try_grow(sbuffer_t *buffer) {
+    if (buffer->capacity >= buffer->max_capacity) {
+        return false; /* Growth disabled or limit reached */
+    }
+
+    size_t new_capacity = buffer->capacity * 2;
+    if (new_capacity > buffer->max_capacity) {
+        new_capacity = buffer->max_capacity;
+    }
+
+    sensor_data_t *new_storage = malloc(new_capacity * sizeof(sensor_data_t));
+    if (new_storage == NULL) {
+        perror("SBuffer WARN: Failed to grow buffer");
+        return false;
+    }
+
+    /* Re-place every element any reader still needs at its new index */
+    for (unsigned long seq = buffer->tail; seq != buffer->head; ++seq) {
+        new_storage[seq % new_capacity] = buffer->buffer[seq % buffer->capacity];
+    }
+
+    free(buffer->buffer);
+    buffer->buffer = new_storage;
+    buffer->capacity = new_capacity;
+    buffer->grow_events++;
+    return true;
+}
+
+/**
+ * @brief Waits until at least one slot is free, growing the buffer first if allowed.
+ * Must be called with the buffer mutex held. Time spent blocked is accounted.
+ * 
+ * @param buffer A pointer to the initialized shared buffer.
+ * @return GATEWAY_SUCCESS when a slot is free, an error code otherwise (mutex is still held).
+ */
+static gateway_error_t wait_for_space(sbuffer_t *buffer) {
+    unsigned long long wait_start = 0;
+    gateway_error_t result = GATEWAY_SUCCESS;
+
+    while (buffer->head - buffer->tail >= buffer->capacity) {
+        if (buffer->shutdown_flag) {
+            result = SBUFFER_SHUTDOWN; /* Shutdown while waiting for space */
+            break;
+        }
+        if (try_grow(buffer)) {
+            break; /* Backpressure absorbed by growing */
+        }
+        if (wait_start == 0) {
+            wait_start = monotonic_us();
+            buffer->blocked_inserts++;
+        }
+        if (pthread_cond_wait(&(buffer->not_full), &(buffer->mutex)) != 0) {
+            perror("SBuffer CRITICAL: Failed to wait on 'not_full' condition");
+            result = THREAD_COND_WAIT_ERR; /* Condition wait error */
+            break;
+        }
+    }
+    if (result == GATEWAY_SUCCESS && buffer->shutdown_flag) {
+        result = SBUFFER_SHUTDOWN; /* Shutdown in progress */
+    }
+
+    if (wait_start != 0) {
+        unsigned long long waited = monotonic_us() - wait_start;
+        buffer->blocked_time_us += waited;
+        metrics_observe(METRIC_SBUFFER_WAIT_US, waited);
+    }
+    return result;
+}
+
+/**
+ * @brief Updates the high watermark after an insert.
+ * Must be called with the buffer mutex held.
+ */
+static void update_high_watermark(sbuffer_t *buffer) {
+    size_t count = buffer->head - buffer->tail;
+    if (count > buffer->high_watermark) {
+        buffer->high_watermark = count;
+    }
+}
+
+/**
+ * @brief Registers a new reader with its own read cursor.
+ * 
+ * The cursor starts at the current head so the reader only sees data
+ * inserted after registration.
+ * 
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id A pointer where the id of the new reader will be stored.
+ * @return GATEWAY_SUCCESS on success, an error code otherwise.
+ */
+gateway_error_t sbuffer_register_reader(sbuffer_t *buffer, int *reader_id) {
+    if (buffer == NULL || reader_id == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG; /* Invalid argument error */
+    }
+
+    if (pthread_mutex_lock(&(buffer->mutex)) != 0) {
+        perror("SBuffer CRITICAL: Failed to lock mutex in register_reader");
+        return THREAD_MUTEX_LOCK_ERR; /* Mutex lock error */
+    }
+
+    if (buffer->num_readers >= SBUFFER_MAX_READERS) {
+        pthread_mutex_unlock(&(buffer->mutex));
+        return SBUFFER_ERROR; /* No free reader slot */
+    }
+
+    *reader_id = buffer->num_readers;
+    buffer->read_pos[*reader_id] = buffer->head; /* Start at the newest element */
+    buffer->num_readers++;
+
+    if (pthread_mutex_unlock(&(buffer->mutex)) != 0) {
+        perror("SBuffer CRITICAL: Failed to unlock mutex in register_reader");
+        return THREAD_MUTEX_UNLOCK_ERR; /* Mutex unlock error */
+    }
+
+    return GATEWAY_SUCCESS; /* Reader registered */
+}
+
 /**
  * @brief Inserts sensor data into the shared buffer (Producer).
  * 
  * This function allows a producer thread to insert data into the shared buffer.
- * It blocks if the buffer is full until space becomes available. The function
+ * If the buffer is full (the slowest reader is a whole capacity behind) it first
+ * tries to grow up to max_capacity, otherwise it blocks until space becomes available. The function
  * is thread-safe and ensures proper synchronization.
  * 
  * @param buffer A pointer to the initialized shared buffer.
@@ -127,30 +312,25 @@ gateway_error_t sbuffer_insert(sbuffer_t *buffer, const sensor_data_t *data) {
         return THREAD_MUTEX_LOCK_ERR; /* Mutex lock error */
     }
 
-    /* Check shutdown BEFORE waiting */
-    if (buffer->shutdown_flag) {
+    /* Wait while the buffer is full (also checks shutdown) */
+    gateway_error_t wait_ret = wait_for_space(buffer);
+    if (wait_ret != GATEWAY_SUCCESS) {
         pthread_mutex_unlock(&(buffer->mutex));
-        return SBUFFER_SHUTDOWN; /* Shutdown in progress */
-    }
-
-    /* Wait while the buffer is full */
-    while (buffer->count >= SBUFFER_SIZE) {
-        if (pthread_cond_wait(&(buffer->not_full), &(buffer->mutex)) != 0) {
-            perror("SBuffer CRITICAL: Failed to wait on 'not_full' condition");
-            pthread_mutex_unlock(&(buffer->mutex));
-            return THREAD_COND_WAIT_ERR; /* Condition wait error */
-        }
+        return wait_ret;
     }
 
     /* --- Critical Section --- */
-    buffer->buffer[buffer->head] = *data; /* Copy data into buffer */
-    buffer->head = (buffer->head + 1) % SBUFFER_SIZE; /* Move head circularly */
-    buffer->count++; /* Increment count */
+    buffer->buffer[buffer->head % buffer->capacity] = *data; /* Copy data into buffer (stored once for all readers) */
+    buffer->head++; /* Advance head sequence */
+    if (buffer->num_readers == 0) {
+        buffer->tail = buffer->head; /* Nobody to read it, release immediately */
+    }
+    update_high_watermark(buffer);
     /* --- End Critical Section --- */
 
-    /* Signal that the buffer is no longer empty */
-    if (pthread_cond_signal(&(buffer->not_empty)) != 0) {
-        perror("SBuffer WARN: Failed to signal 'not_empty' condition");
+    /* Signal every reader that new data is available */
+    if (pthread_cond_broadcast(&(buffer->not_empty)) != 0) {
+        perror("SBuffer WARN: Failed to broadcast 'not_empty' condition");
     }
 
     /* Unlock the mutex */
@@ -163,18 +343,20 @@ gateway_error_t sbuffer_insert(sbuffer_t *buffer, const sensor_data_t *data) {
 }
 
 /**
- * @brief Removes sensor data from the shared buffer (Consumer).
+ * @brief Reads the next element for one reader (Consumer).
  * 
- * This function allows a consumer thread to remove data from the shared buffer.
- * It blocks if the buffer is empty until data becomes available. The function
- * is thread-safe and ensures proper synchronization.
+ * This function allows a consumer thread to read data from the shared buffer
+ * through its own cursor. It blocks if the reader has no unread data until data
+ * becomes available. The slot is released once the slowest reader has passed it.
+ * The function is thread-safe and ensures proper synchronization.
  * 
  * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id The id returned by sbuffer_register_reader().
  * @param data A pointer to a sensor_data_t struct where the removed data will be copied.
  * @return GATEWAY_SUCCESS on success, an error code otherwise.
  */
-gateway_error_t sbuffer_remove(sbuffer_t *buffer, sensor_data_t *data) {
-    if (buffer == NULL || data == NULL) {
+gateway_error_t sbuffer_remove(sbuffer_t *buffer, int reader_id, sensor_data_t *data) {
+    if (buffer == NULL || data == NULL || reader_id < 0 || reader_id >= SBUFFER_MAX_READERS) {
         return GATEWAY_ERROR_INVALID_ARG; /* Invalid argument error */
     }
 
@@ -184,34 +366,46 @@ gateway_error_t sbuffer_remove(sbuffer_t *buffer, sensor_data_t *data) {
         return THREAD_MUTEX_LOCK_ERR; /* Mutex lock error */
     }
 
+    if (reader_id >= buffer->num_readers) {
+        pthread_mutex_unlock(&(buffer->mutex));
+        return GATEWAY_ERROR_INVALID_ARG; /* Reader was never registered */
+    }
+
     /* Check shutdown BEFORE waiting */
-    if (buffer->shutdown_flag && buffer->count <= 0) {
+    if (buffer->shutdown_flag && buffer->read_pos[reader_id] == buffer->head) {
         pthread_mutex_unlock(&(buffer->mutex));
         return SBUFFER_SHUTDOWN; /* Shutdown in progress */
     }
 
-    /* Wait while the buffer is empty */
-    while (buffer->count <= 0) {
+    /* Wait while this reader has nothing left to read */
+    while (buffer->read_pos[reader_id] == buffer->head) {
         if (pthread_cond_wait(&(buffer->not_empty), &(buffer->mutex)) != 0) {
             perror("SBuffer CRITICAL: Failed to wait on 'not_empty' condition");
             pthread_mutex_unlock(&(buffer->mutex));
             return THREAD_COND_WAIT_ERR; /* Condition wait error */
         }
-        if (buffer->shutdown_flag && buffer->count <= 0) {
+        if (buffer->shutdown_flag && buffer->read_pos[reader_id] == buffer->head) {
             pthread_mutex_unlock(&(buffer->mutex));
             return SBUFFER_SHUTDOWN; /* Shutdown in progress */
         }
     }
 
     /* --- Critical Section --- */
-    *data = buffer->buffer[buffer->tail]; /* Copy data out of buffer */
-    buffer->tail = (buffer->tail + 1) % SBUFFER_SIZE; /* Move tail circularly */
-    buffer->count--; /* Decrement count */
+    unsigned long pos = buffer->read_pos[reader_id];
+    *data = buffer->buffer[pos % buffer->capacity]; /* Copy data out of buffer */
+    buffer->read_pos[reader_id] = pos + 1; /* Advance this reader's cursor */
+
+    /* Only the slowest reader can free a slot */
+    bool freed = false;
+    if (pos == buffer->tail) {
+        update_tail(buffer);
+        freed = (buffer->tail != pos);
+    }
     /* --- End Critical Section --- */
 
     /* Signal that the buffer is no longer full */
-    if (pthread_cond_signal(&(buffer->not_full)) != 0) {
-        perror("SBuffer WARN: Failed to signal 'not_full' condition");
+    if (freed && pthread_cond_broadcast(&(buffer->not_full)) != 0) {
+        perror("SBuffer WARN: Failed to broadcast 'not_full' condition");
     }
 
     /* Unlock the mutex */
@@ -223,6 +417,221 @@ gateway_error_t sbuffer_remove(sbuffer_t *buffer, sensor_data_t *data) {
     return GATEWAY_SUCCESS; /* Successful removal */
 }
 
+/**
+ * @brief Inserts an array of sensor data into the shared buffer (Producer).
+ * 
+ * Copies as many elements as currently fit under one lock acquisition and wakes
+ * the readers once per chunk. Only waits on 'not_full' when the buffer is full.
+ * 
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param data A pointer to an array of count sensor data elements.
+ * @param count Number of elements to insert.
+ * @return GATEWAY_SUCCESS on success, an error code otherwise.
+ */
+gateway_error_t sbuffer_insert_batch(sbuffer_t *buffer, const sensor_data_t *data, size_t count) {
+    if (buffer == NULL || (data == NULL && count > 0)) {
+        return GATEWAY_ERROR_INVALID_ARG; /* Invalid argument error */
+    }
+    if (count == 0) {
+        return GATEWAY_SUCCESS; /* Nothing to do */
+    }
+
+    /* Lock the mutex */
+    if (pthread_mutex_lock(&(buffer->mutex)) != 0) {
+        perror("SBuffer CRITICAL: Failed to lock mutex in insert_batch");
+        return THREAD_MUTEX_LOCK_ERR; /* Mutex lock error */
+    }
+
+    size_t done = 0;
+    while (done < count) {
+        /* Wait while the buffer is full (also checks shutdown) */
+        gateway_error_t wait_ret = wait_for_space(buffer);
+        if (wait_ret != GATEWAY_SUCCESS) {
+            pthread_mutex_unlock(&(buffer->mutex));
+            return wait_ret;
+        }
+
+        /* --- Critical Section: copy the chunk that fits --- */
+        size_t space = buffer->capacity - (buffer->head - buffer->tail);
+        size_t chunk = (count - done < space) ? count - done : space;
+        for (size_t i = 0; i < chunk; ++i) {
+            buffer->buffer[buffer->head % buffer->capacity] = data[done + i];
+            buffer->head++;
+        }
+        if (buffer->num_readers == 0) {
+            buffer->tail = buffer->head; /* Nobody to read it, release immediately */
+        }
+        update_high_watermark(buffer);
+        done += chunk;
+        /* --- End Critical Section --- */
+
+        /* One wakeup per chunk */
+        if (pthread_cond_broadcast(&(buffer->not_empty)) != 0) {
+            perror("SBuffer WARN: Failed to broadcast 'not_empty' condition");
+        }
+    }
+
+    /* Unlock the mutex */
+    if (pthread_mutex_unlock(&(buffer->mutex)) != 0) {
+        perror("SBuffer CRITICAL: Failed to unlock mutex in insert_batch");
+        return THREAD_MUTEX_UNLOCK_ERR; /* Mutex unlock error */
+    }
+
+    return GATEWAY_SUCCESS; /* Successful insertion */
+}
+
+/**
+ * @brief Reads all available elements (up to max_count) for one reader, waiting until a deadline.
+ * 
+ * Blocks until at least one element is unread by this reader or the deadline
+ * passes, then copies everything available under a single lock acquisition.
+ * 
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id The id returned by sbuffer_register_reader().
+ * @param data A pointer to an array of at least max_count elements.
+ * @param max_count Capacity of the data array.
+ * @param removed A pointer where the number of copied elements will be stored.
+ * @param deadline Absolute CLOCK_REALTIME deadline, or NULL to wait indefinitely.
+ * @return GATEWAY_SUCCESS on success, SBUFFER_EMPTY on timeout, an error code otherwise.
+ */
+static gateway_error_t remove_batch_until(sbuffer_t *buffer, int reader_id, sensor_data_t *data,
+                                          size_t max_count, size_t *removed,
+                                          const struct timespec *deadline) {
+    if (buffer == NULL || data == NULL || removed == NULL || max_count == 0 ||
+        reader_id < 0 || reader_id >= SBUFFER_MAX_READERS) {
+        return GATEWAY_ERROR_INVALID_ARG; /* Invalid argument error */
+    }
+    *removed = 0;
+
+    /* Lock the mutex */
+    if (pthread_mutex_lock(&(buffer->mutex)) != 0) {
+        perror("SBuffer CRITICAL: Failed to lock mutex in remove_batch");
+        return THREAD_MUTEX_LOCK_ERR; /* Mutex lock error */
+    }
+
+    if (reader_id >= buffer->num_readers) {
+        pthread_mutex_unlock(&(buffer->mutex));
+        return GATEWAY_ERROR_INVALID_ARG; /* Reader was never registered */
+    }
+
+    /* Wait while this reader has nothing left to read */
+    while (buffer->read_pos[reader_id] == buffer->head) {
+        if (buffer->shutdown_flag) {
+            pthread_mutex_unlock(&(buffer->mutex));
+            return SBUFFER_SHUTDOWN; /* Shutdown in progress */
+        }
+        int rc = (deadline == NULL)
+                     ? pthread_cond_wait(&(buffer->not_empty), &(buffer->mutex))
+                     : pthread_cond_timedwait(&(buffer->not_empty), &(buffer->mutex), deadline);
+        if (rc == ETIMEDOUT) {
+            pthread_mutex_unlock(&(buffer->mutex));
+            return SBUFFER_EMPTY; /* Nothing arrived in time */
+        }
+        if (rc != 0) {
+            perror("SBuffer CRITICAL: Failed to wait on 'not_empty' condition");
+            pthread_mutex_unlock(&(buffer->mutex));
+            return THREAD_COND_WAIT_ERR; /* Condition wait error */
+        }
+    }
+
+    /* --- Critical Section --- */
+    unsigned long pos = buffer->read_pos[reader_id];
+    size_t available = buffer->head - pos;
+    size_t n = (available < max_count) ? available : max_count;
+    for (size_t i = 0; i < n; ++i) {
+        data[i] = buffer->buffer[(pos + i) % buffer->capacity];
+    }
+    buffer->read_pos[reader_id] = pos + n;
+
+    /* Only the slowest reader can free slots */
+    bool freed = false;
+    if (pos == buffer->tail) {
+        update_tail(buffer);
+        freed = (buffer->tail != pos);
+    }
+    /* --- End Critical Section --- */
+
+    if (freed && pthread_cond_broadcast(&(buffer->not_full)) != 0) {
+        perror("SBuffer WARN: Failed to broadcast 'not_full' condition");
+    }
+
+    if (pthread_mutex_unlock(&(buffer->mutex)) != 0) {
+        perror("SBuffer CRITICAL: Failed to unlock mutex in remove_batch");
+        return THREAD_MUTEX_UNLOCK_ERR; /* Mutex unlock error */
+    }
+
+    *removed = n;
+    return GATEWAY_SUCCESS; /* Successful removal */
+}
+
+/**
+ * @brief Reads all available elements (up to max_count) for one reader (Consumer).
+ * 
+ * Blocks until at least one element is unread by this reader, then copies
+ * everything available under a single lock acquisition.
+ * 
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id The id returned by sbuffer_register_reader().
+ * @param data A pointer to an array of at least max_count elements.
+ * @param max_count Capacity of the data array.
+ * @param removed A pointer where the number of copied elements will be stored.
+ * @return GATEWAY_SUCCESS on success, an error code otherwise.
+ */
+gateway_error_t sbuffer_remove_batch(sbuffer_t *buffer, int reader_id, sensor_data_t *data,
+                                     size_t max_count, size_t *removed) {
+    return remove_batch_until(buffer, reader_id, data, max_count, removed, NULL);
+}
+
+/**
+ * @brief Like sbuffer_remove_batch(), but gives up after timeout_ms milliseconds.
+ * 
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id The id returned by sbuffer_register_reader().
+ * @param data A pointer to an array of at least max_count elements.
+ * @param max_count Capacity of the data array.
+ * @param removed A pointer where the number of copied elements will be stored.
+ * @param timeout_ms Maximum wait in milliseconds, 0 only takes what is already there.
+ * @return GATEWAY_SUCCESS on success, SBUFFER_EMPTY on timeout, an error code otherwise.
+ */
+gateway_error_t sbuffer_remove_batch_timed(sbuffer_t *buffer, int reader_id, sensor_data_t *data,
+                                           size_t max_count, size_t *removed, unsigned int timeout_ms) {
+    struct timespec deadline;
+
+    /* not_empty uses the default clock, so the deadline is on CLOCK_REALTIME */
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return remove_batch_until(buffer, reader_id, data, max_count, removed, &deadline);
+}
+
+/**
+ * @brief Copies the current sizing counters of the buffer.
+ * 
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param stats A pointer to the struct receiving the snapshot.
+ */
+void sbuffer_get_stats(sbuffer_t *buffer, sbuffer_stats_t *stats) {
+    if (buffer == NULL || stats == NULL) return;
+
+    memset(stats, 0, sizeof(*stats));
+    if (pthread_mutex_lock(&(buffer->mutex)) != 0) {
+        perror("SBuffer CRITICAL: Failed to lock mutex in get_stats");
+        return;
+    }
+    stats->capacity = buffer->capacity;
+    stats->max_capacity = buffer->max_capacity;
+    stats->count = buffer->head - buffer->tail;
+    stats->high_watermark = buffer->high_watermark;
+    stats->blocked_inserts = buffer->blocked_inserts;
+    stats->blocked_time_us = buffer->blocked_time_us;
+    stats->grow_events = buffer->grow_events;
+    pthread_mutex_unlock(&(buffer->mutex));
+}
+
 /**
  * @brief Signals all threads waiting on the buffer to wake up for shutdown.
  * 
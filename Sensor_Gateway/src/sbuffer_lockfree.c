@@ -0,0 +1,538 @@
+#define _GNU_SOURCE     /* For syscall() */
+#include <stdlib.h>     /* For malloc, free */
+#include <stdio.h>      /* For perror */
+#include <errno.h>      /* For error codes */
+#include <limits.h>     /* For INT_MAX */
+#include <stdatomic.h>  /* For atomic cursors */
+#include <string.h>     /* For memset */
+#include <time.h>       /* For clock_gettime */
+#include <unistd.h>     /* For syscall() */
+#include <sys/syscall.h> /* For SYS_futex */
+#include <linux/futex.h> /* For FUTEX_WAIT_PRIVATE, FUTEX_WAKE_PRIVATE */
+
+/* Include project-specific headers */
+#include "config.h"     /* For SBUFFER_SIZE */
+#include "common.h"     /* For sensor_data_t, gateway_error_t */
+#include "sbuffer.h"    /* For sbuffer_t and function declarations */
+#include "metrics.h"    /* For the insert wait histogram */
+
+/*
+ * Lock-free backend for the shared buffer, built instead of sbuffer.c when
+ * SBUFFER_BACKEND=lockfree is given to make. The API is identical.
+ *
+ * Producers claim a position with an atomic fetch_add on head, wait (rarely)
+ * until the slowest reader is less than one lap behind, write the slot and
+ * publish it by storing (position + 1) into the slot's sequence number.
+ * Each reader owns a cursor; it consumes a slot once its sequence matches.
+ * Sleeping uses futex "event counts": a thread announces itself as a waiter,
+ * re-checks the condition, then waits on a counter the other side bumps only
+ * when it sees waiters, so the common path costs no syscall at all.
+ */
+
+/* --- Internal Helper Functions --- */
+
+/**
+ * @brief Blocks on a futex word while it still holds the expected value.
+ * @param addr The futex word.
+ * @param expected The value observed before deciding to sleep.
+ * @param timeout Relative timeout, or NULL to wait indefinitely.
+ */
+static void futex_wait(atomic_uint *addr, unsigned int expected, const struct timespec *timeout) {
+    syscall(SYS_futex, (unsigned int *)addr, FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0);
+}
+
+/**
+ * @brief Wakes every thread sleeping on a futex word.
+ * @param addr The futex word.
+ */
+static void futex_wake_all(atomic_uint *addr) {
+    syscall(SYS_futex, (unsigned int *)addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * @brief Bumps an event count and wakes its sleepers, only if somebody sleeps.
+ * @param seq The futex word.
+ * @param waiters The number of threads announced as sleeping on seq.
+ */
+static void notify_waiters(atomic_uint *seq, atomic_uint *waiters) {
+    atomic_thread_fence(memory_order_seq_cst); /* Order our publish before reading waiters */
+    if (atomic_load_explicit(waiters, memory_order_relaxed) > 0) {
+        atomic_fetch_add_explicit(seq, 1, memory_order_release);
+        futex_wake_all(seq);
+    }
+}
+
+/**
+ * @brief Returns the cursor of the slowest registered reader.
+ * With no registered readers every claimed position counts as consumed.
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param upto The value to return when no reader is registered.
+ */
+static unsigned long slowest_reader(sbuffer_t *buffer, unsigned long upto) {
+    int readers = atomic_load_explicit(&buffer->num_readers, memory_order_acquire);
+    unsigned long min_pos = upto;
+
+    for (int i = 0; i < readers; ++i) {
+        unsigned long pos = atomic_load_explicit(&buffer->read_pos[i].pos, memory_order_acquire);
+        if (pos < min_pos) {
+            min_pos = pos;
+        }
+    }
+    return min_pos;
+}
+
+/**
+ * @brief Returns a monotonic timestamp in microseconds.
+ */
+static unsigned long long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + (unsigned long long)ts.tv_nsec / 1000ULL;
+}
+
+/**
+ * @brief Raises the high watermark to occupancy if it is higher (relaxed, rarely contended).
+ */
+static void update_high_watermark(sbuffer_t *buffer, unsigned long occupancy) {
+    unsigned long seen = atomic_load_explicit(&buffer->high_watermark, memory_order_relaxed);
+    while (occupancy > seen &&
+           !atomic_compare_exchange_weak_explicit(&buffer->high_watermark, &seen, occupancy,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+        /* seen was reloaded by the failed CAS */
+    }
+}
+
+/**
+ * @brief Waits until every position up to last_pos can be written.
+ * Time spent sleeping is added to the blocked-producer counters.
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param last_pos The highest position the caller has claimed.
+ * @return GATEWAY_SUCCESS when the slots are free, SBUFFER_SHUTDOWN on shutdown.
+ */
+static gateway_error_t wait_for_space(sbuffer_t *buffer, unsigned long last_pos) {
+    unsigned long long wait_start = 0;
+    unsigned long slowest = slowest_reader(buffer, last_pos);
+
+    update_high_watermark(buffer, last_pos + 1 - slowest);
+    while (last_pos - slowest_reader(buffer, last_pos) >= buffer->capacity) {
+        if (wait_start == 0) {
+            wait_start = monotonic_us();
+            atomic_fetch_add_explicit(&buffer->blocked_inserts, 1, memory_order_relaxed);
+        }
+        unsigned int key = atomic_load_explicit(&buffer->space_seq, memory_order_acquire);
+        atomic_fetch_add_explicit(&buffer->space_waiters, 1, memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (last_pos - slowest_reader(buffer, last_pos) >= buffer->capacity &&
+            !atomic_load_explicit(&buffer->shutdown_flag, memory_order_acquire)) {
+            futex_wait(&buffer->space_seq, key, NULL);
+        }
+        atomic_fetch_sub_explicit(&buffer->space_waiters, 1, memory_order_relaxed);
+        if (atomic_load_explicit(&buffer->shutdown_flag, memory_order_acquire)) {
+            break; /* Shutdown while waiting for space */
+        }
+    }
+    if (wait_start != 0) {
+        unsigned long long waited = monotonic_us() - wait_start;
+        atomic_fetch_add_explicit(&buffer->blocked_time_us, waited, memory_order_relaxed);
+        metrics_observe(METRIC_SBUFFER_WAIT_US, waited);
+    }
+    if (atomic_load_explicit(&buffer->shutdown_flag, memory_order_acquire)) {
+        return SBUFFER_SHUTDOWN; /* Shutdown while waiting for space */
+    }
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Waits until the slot for pos has been published by its producer.
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param pos The position the reader wants to consume next.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, or NULL to wait indefinitely.
+ * @return GATEWAY_SUCCESS when the slot is readable, SBUFFER_SHUTDOWN on shutdown,
+ *         SBUFFER_EMPTY when the deadline passed.
+ */
+static gateway_error_t wait_for_data(sbuffer_t *buffer, unsigned long pos, const struct timespec *deadline) {
+    sbuffer_slot_t *slot = &buffer->slots[pos & buffer->mask];
+
+    while (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1) {
+        if (atomic_load_explicit(&buffer->shutdown_flag, memory_order_acquire)) {
+            return SBUFFER_SHUTDOWN; /* Shutdown and nothing left to read */
+        }
+        struct timespec remaining;
+        if (deadline != NULL) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining.tv_sec = deadline->tv_sec - now.tv_sec;
+            remaining.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+            if (remaining.tv_nsec < 0) {
+                remaining.tv_sec--;
+                remaining.tv_nsec += 1000000000L;
+            }
+            if (remaining.tv_sec < 0) {
+                return SBUFFER_EMPTY; /* Nothing arrived in time */
+            }
+        }
+        unsigned int key = atomic_load_explicit(&buffer->data_seq, memory_order_acquire);
+        atomic_fetch_add_explicit(&buffer->data_waiters, 1, memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1 &&
+            !atomic_load_explicit(&buffer->shutdown_flag, memory_order_acquire)) {
+            futex_wait(&buffer->data_seq, key, deadline != NULL ? &remaining : NULL);
+        }
+        atomic_fetch_sub_explicit(&buffer->data_waiters, 1, memory_order_relaxed);
+    }
+    return GATEWAY_SUCCESS;
+}
+
+/* --- Implementation of Shared Buffer Functions --- */
+
+/**
+ * @brief Allocates and initializes a lock-free shared buffer.
+ *
+ * The ring capacity is the requested capacity rounded up to the next power of two.
+ * The ring cannot be resized while producers hold claimed positions, so
+ * max_capacity is ignored by this backend.
+ *
+ * @param buffer A pointer to the pointer of the buffer struct to be initialized.
+ * @param requested Initial number of slots (0 selects SBUFFER_SIZE).
+ * @param max_capacity Unused, the lock-free ring does not grow.
+ * @return GATEWAY_SUCCESS on success, an error code otherwise.
+ */
+gateway_error_t sbuffer_init(sbuffer_t **buffer, size_t requested, size_t max_capacity) {
+    unsigned long capacity = 1;
+
+    (void)max_capacity; /* Fixed-size ring */
+    if (requested == 0) {
+        requested = SBUFFER_SIZE; /* Compile-time default */
+    }
+
+    if (buffer == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG; /* Invalid argument error */
+    }
+
+    /* aligned_alloc keeps the padded cursors on their own cache lines */
+    *buffer = aligned_alloc(SBUFFER_CACHE_LINE, sizeof(sbuffer_t));
+    if (*buffer == NULL) {
+        return GATEWAY_ERROR_NOMEM; /* Memory allocation error */
+    }
+
+    while (capacity < requested) {
+        capacity <<= 1; /* Round up to a power of two */
+    }
+
+    (*buffer)->slots = calloc(capacity, sizeof(sbuffer_slot_t));
+    if ((*buffer)->slots == NULL) {
+        free(*buffer);
+        *buffer = NULL;
+        return GATEWAY_ERROR_NOMEM; /* Memory allocation error */
+    }
+    for (unsigned long i = 0; i < capacity; ++i) {
+        atomic_init(&(*buffer)->slots[i].seq, 0);
+    }
+
+    (*buffer)->capacity = capacity;
+    (*buffer)->mask = capacity - 1;
+    atomic_init(&(*buffer)->head, 0);
+    for (int i = 0; i < SBUFFER_MAX_READERS; ++i) {
+        atomic_init(&(*buffer)->read_pos[i].pos, 0);
+    }
+    atomic_init(&(*buffer)->num_readers, 0);
+    atomic_init(&(*buffer)->high_watermark, 0);
+    atomic_init(&(*buffer)->blocked_inserts, 0);
+    atomic_init(&(*buffer)->blocked_time_us, 0);
+    atomic_init(&(*buffer)->data_seq, 0);
+    atomic_init(&(*buffer)->data_waiters, 0);
+    atomic_init(&(*buffer)->space_seq, 0);
+    atomic_init(&(*buffer)->space_waiters, 0);
+    atomic_init(&(*buffer)->shutdown_flag, false);
+
+    return GATEWAY_SUCCESS; /* Successful initialization */
+}
+
+/**
+ * @brief Deallocates the lock-free shared buffer.
+ *
+ * @param buffer A pointer to the pointer of the buffer struct to be freed.
+ * @return GATEWAY_SUCCESS on success, an error code otherwise.
+ */
+gateway_error_t sbuffer_free(sbuffer_t **buffer) {
+    if (buffer == NULL || *buffer == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG; /* Invalid argument error */
+    }
+
+    free((*buffer)->slots);
+    free(*buffer);
+    *buffer = NULL; /* Set user's pointer to NULL */
+
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Registers a new reader with its own read cursor.
+ *
+ * Must be called before producers start; the cursor starts at the current head.
+ *
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id A pointer where the id of the new reader will be stored.
+ * @return GATEWAY_SUCCESS on success, an error code otherwise.
+ */
+gateway_error_t sbuffer_register_reader(sbuffer_t *buffer, int *reader_id) {
+    if (buffer == NULL || reader_id == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG; /* Invalid argument error */
+    }
+
+    int id = atomic_load_explicit(&buffer->num_readers, memory_order_relaxed);
+    do {
+        if (id >= SBUFFER_MAX_READERS) {
+            return SBUFFER_ERROR; /* No free reader slot */
+        }
+        /* Publish the cursor before the reader becomes visible to producers */
+        atomic_store_explicit(&buffer->read_pos[id].pos,
+                              atomic_load_explicit(&buffer->head, memory_order_acquire),
+                              memory_order_release);
+    } while (!atomic_compare_exchange_weak_explicit(&buffer->num_readers, &id, id + 1,
+                                                    memory_order_acq_rel, memory_order_relaxed));
+
+    *reader_id = id;
+    return GATEWAY_SUCCESS; /* Reader registered */
+}
+
+/**
+ * @brief Inserts sensor data into the ring (Producer).
+ *
+ * Lock-free unless the slowest reader is a full lap behind, in which case the
+ * producer sleeps on the space futex until a reader frees a slot.
+ *
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param data A pointer to the sensor_data_t element to insert.
+ * @return GATEWAY_SUCCESS on success, an error code otherwise.
+ */
+gateway_error_t sbuffer_insert(sbuffer_t *buffer, const sensor_data_t *data) {
+    if (buffer == NULL || data == NULL) {
+        return GATEWAY_ERROR_INVALID_ARG; /* Invalid argument error */
+    }
+
+    if (atomic_load_explicit(&buffer->shutdown_flag, memory_order_acquire)) {
+        return SBUFFER_SHUTDOWN; /* Shutdown in progress */
+    }
+
+    /* Claim a position */
+    unsigned long pos = atomic_fetch_add_explicit(&buffer->head, 1, memory_order_relaxed);
+
+    /* Wait until the slot is no longer needed by any reader */
+    if (wait_for_space(buffer, pos) != GATEWAY_SUCCESS) {
+        return SBUFFER_SHUTDOWN; /* Shutdown while waiting for space */
+    }
+
+    /* Write and publish the slot */
+    sbuffer_slot_t *slot = &buffer->slots[pos & buffer->mask];
+    slot->data = *data;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    notify_waiters(&buffer->data_seq, &buffer->data_waiters);
+    return GATEWAY_SUCCESS; /* Successful insertion */
+}
+
+/**
+ * @brief Reads the next element for one reader (Consumer).
+ *
+ * Spins only on the reader's own cursor; sleeps on the data futex when empty.
+ *
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id The id returned by sbuffer_register_reader().
+ * @param data A pointer to a sensor_data_t struct where the removed data will be copied.
+ * @return GATEWAY_SUCCESS on success, an error code otherwise.
+ */
+gateway_error_t sbuffer_remove(sbuffer_t *buffer, int reader_id, sensor_data_t *data) {
+    if (buffer == NULL || data == NULL || reader_id < 0 ||
+        reader_id >= atomic_load_explicit(&buffer->num_readers, memory_order_acquire)) {
+        return GATEWAY_ERROR_INVALID_ARG; /* Invalid argument error */
+    }
+
+    atomic_ulong *cursor = &buffer->read_pos[reader_id].pos;
+    unsigned long pos = atomic_load_explicit(cursor, memory_order_relaxed);
+
+    /* Wait until the producer has published this position */
+    if (wait_for_data(buffer, pos, NULL) != GATEWAY_SUCCESS) {
+        return SBUFFER_SHUTDOWN; /* Shutdown and nothing left to read */
+    }
+
+    *data = buffer->slots[pos & buffer->mask].data; /* Copy data out of the ring */
+    atomic_store_explicit(cursor, pos + 1, memory_order_release); /* Release the slot for this reader */
+
+    notify_waiters(&buffer->space_seq, &buffer->space_waiters);
+    return GATEWAY_SUCCESS; /* Successful removal */
+}
+
+/**
+ * @brief Inserts an array of sensor data into the ring (Producer).
+ *
+ * Claims up to one ring capacity of positions with a single fetch_add, writes
+ * them and wakes sleeping readers once per chunk.
+ *
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param data A pointer to an array of count sensor data elements.
+ * @param count Number of elements to insert.
+ * @return GATEWAY_SUCCESS on success, an error code otherwise.
+ */
+gateway_error_t sbuffer_insert_batch(sbuffer_t *buffer, const sensor_data_t *data, size_t count) {
+    if (buffer == NULL || (data == NULL && count > 0)) {
+        return GATEWAY_ERROR_INVALID_ARG; /* Invalid argument error */
+    }
+
+    size_t done = 0;
+    while (done < count) {
+        if (atomic_load_explicit(&buffer->shutdown_flag, memory_order_acquire)) {
+            return SBUFFER_SHUTDOWN; /* Shutdown in progress */
+        }
+
+        /* Never claim more than one lap, or we would wait on ourselves */
+        size_t chunk = (count - done < buffer->capacity) ? count - done : buffer->capacity;
+        unsigned long pos = atomic_fetch_add_explicit(&buffer->head, chunk, memory_order_relaxed);
+
+        if (wait_for_space(buffer, pos + chunk - 1) != GATEWAY_SUCCESS) {
+            return SBUFFER_SHUTDOWN; /* Shutdown while waiting for space */
+        }
+
+        for (size_t i = 0; i < chunk; ++i) {
+            sbuffer_slot_t *slot = &buffer->slots[(pos + i) & buffer->mask];
+            slot->data = data[done + i];
+            atomic_store_explicit(&slot->seq, pos + i + 1, memory_order_release);
+        }
+        done += chunk;
+
+        notify_waiters(&buffer->data_seq, &buffer->data_waiters);
+    }
+
+    return GATEWAY_SUCCESS; /* Successful insertion */
+}
+
+/**
+ * @brief Reads all published elements (up to max_count) for one reader (Consumer).
+ *
+ * Blocks until the next position is published, then copies every consecutive
+ * published slot and advances the cursor once.
+ *
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id The id returned by sbuffer_register_reader().
+ * @param data A pointer to an array of at least max_count elements.
+ * @param max_count Capacity of the data array.
+ * @param removed A pointer where the number of copied elements will be stored.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, or NULL to wait indefinitely.
+ * @return GATEWAY_SUCCESS on success, SBUFFER_EMPTY on timeout, an error code otherwise.
+ */
+static gateway_error_t remove_batch_until(sbuffer_t *buffer, int reader_id, sensor_data_t *data,
+                                          size_t max_count, size_t *removed,
+                                          const struct timespec *deadline) {
+    if (buffer == NULL || data == NULL || removed == NULL || max_count == 0 || reader_id < 0 ||
+        reader_id >= atomic_load_explicit(&buffer->num_readers, memory_order_acquire)) {
+        return GATEWAY_ERROR_INVALID_ARG; /* Invalid argument error */
+    }
+    *removed = 0;
+
+    atomic_ulong *cursor = &buffer->read_pos[reader_id].pos;
+    unsigned long pos = atomic_load_explicit(cursor, memory_order_relaxed);
+
+    gateway_error_t ret = wait_for_data(buffer, pos, deadline);
+    if (ret != GATEWAY_SUCCESS) {
+        return ret; /* Shutdown with nothing left to read, or timeout */
+    }
+
+    /* Copy the run of consecutive published slots */
+    size_t n = 0;
+    while (n < max_count) {
+        sbuffer_slot_t *slot = &buffer->slots[(pos + n) & buffer->mask];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + n + 1) {
+            break; /* Not published yet */
+        }
+        data[n] = slot->data;
+        n++;
+    }
+
+    atomic_store_explicit(cursor, pos + n, memory_order_release); /* Release all slots at once */
+    notify_waiters(&buffer->space_seq, &buffer->space_waiters);
+
+    *removed = n;
+    return GATEWAY_SUCCESS; /* Successful removal */
+}
+
+/**
+ * @brief Reads all published elements (up to max_count) for one reader (Consumer).
+ *
+ * Blocks until the next position is published, then copies every consecutive
+ * published slot and advances the cursor once.
+ *
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id The id returned by sbuffer_register_reader().
+ * @param data A pointer to an array of at least max_count elements.
+ * @param max_count Capacity of the data array.
+ * @param removed A pointer where the number of copied elements will be stored.
+ * @return GATEWAY_SUCCESS on success, an error code otherwise.
+ */
+gateway_error_t sbuffer_remove_batch(sbuffer_t *buffer, int reader_id, sensor_data_t *data,
+                                     size_t max_count, size_t *removed) {
+    return remove_batch_until(buffer, reader_id, data, max_count, removed, NULL);
+}
+
+/**
+ * @brief Like sbuffer_remove_batch(), but gives up after timeout_ms milliseconds.
+ *
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param reader_id The id returned by sbuffer_register_reader().
+ * @param data A pointer to an array of at least max_count elements.
+ * @param max_count Capacity of the data array.
+ * @param removed A pointer where the number of copied elements will be stored.
+ * @param timeout_ms Maximum wait in milliseconds, 0 only takes what is already there.
+ * @return GATEWAY_SUCCESS on success, SBUFFER_EMPTY on timeout, an error code otherwise.
+ */
+gateway_error_t sbuffer_remove_batch_timed(sbuffer_t *buffer, int reader_id, sensor_data_t *data,
+                                           size_t max_count, size_t *removed, unsigned int timeout_ms) {
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return remove_batch_until(buffer, reader_id, data, max_count, removed, &deadline);
+}
+
+/**
+ * @brief Copies the current sizing counters of the ring.
+ *
+ * @param buffer A pointer to the initialized shared buffer.
+ * @param stats A pointer to the struct receiving the snapshot.
+ */
+void sbuffer_get_stats(sbuffer_t *buffer, sbuffer_stats_t *stats) {
+    if (buffer == NULL || stats == NULL) return;
+
+    memset(stats, 0, sizeof(*stats));
+    unsigned long head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+    unsigned long slowest = slowest_reader(buffer, head);
+
+    stats->capacity = buffer->capacity;
+    stats->max_capacity = buffer->capacity; /* Never grows */
+    stats->count = (head > slowest) ? head - slowest : 0;
+    stats->high_watermark = atomic_load_explicit(&buffer->high_watermark, memory_order_relaxed);
+    stats->blocked_inserts = atomic_load_explicit(&buffer->blocked_inserts, memory_order_relaxed);
+    stats->blocked_time_us = atomic_load_explicit(&buffer->blocked_time_us, memory_order_relaxed);
+    stats->grow_events = 0;
+}
+
+/**
+ * @brief Signals all threads waiting on the buffer to wake up for shutdown.
+ *
+ * @param buffer A pointer to the initialized shared buffer.
+ */
+void sbuffer_signal_shutdown(sbuffer_t *buffer) {
+    if (buffer == NULL) return; /* Do nothing if buffer is NULL */
+
+    atomic_store_explicit(&buffer->shutdown_flag, true, memory_order_seq_cst);
+
+    /* Wake up everybody regardless of the waiter counts */
+    atomic_fetch_add_explicit(&buffer->data_seq, 1, memory_order_release);
+    futex_wake_all(&buffer->data_seq);
+    atomic_fetch_add_explicit(&buffer->space_seq, 1, memory_order_release);
+    futex_wake_all(&buffer->space_seq);
+}
@@ -0,0 +1,229 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>       /* For fabs() */
+
+/* Include project-specific headers */
+#include "config.h"     /* For SENSOR_BATCH_SIMD */
+#include "sensor_batch.h"
+
+#if SENSOR_BATCH_SIMD && defined(__x86_64__) && defined(__GNUC__)
+#define SENSOR_BATCH_AVX2 1  /* Built with the AVX2 kernels, used if the CPU has AVX2 */
+#include <immintrin.h>
+#elif SENSOR_BATCH_SIMD && defined(__aarch64__)
+#define SENSOR_BATCH_NEON 1  /* NEON is part of every 64-bit ARM CPU */
+#include <arm_neon.h>
+#endif
+
+_Static_assert(SENSOR_BATCH_CAPACITY <= 64, "classification masks are 64 bits");
+_Static_assert(sizeof(sensor_ts_t) == sizeof(int64_t), "the vector kernels take timestamps as 64-bit integers");
+
+/* --- Scalar Kernels --- */
+
+static void classify_scalar(const double *values, const double *lows, const double *highs, size_t from,
+                            size_t count, uint64_t *below, uint64_t *above) {
+    for (size_t i = from; i < count; ++i) {
+        *below |= (uint64_t)(values[i] < lows[i]) << i;
+        *above |= (uint64_t)(values[i] > highs[i]) << i;
+    }
+}
+
+static uint64_t deviates_scalar(const double *values, const double *centers, const double *limits,
+                                size_t from, size_t count) {
+    uint64_t mask = 0;
+    for (size_t i = from; i < count; ++i) {
+        mask |= (uint64_t)(fabs(values[i] - centers[i]) > limits[i]) << i;
+    }
+    return mask;
+}
+
+static sensor_ts_t max_ts_scalar(const sensor_ts_t *ts, size_t from, size_t count, sensor_ts_t max) {
+    for (size_t i = from; i < count; ++i) {
+        if (ts[i] > max) {
+            max = ts[i];
+        }
+    }
+    return max;
+}
+
+/* --- AVX2 Kernels --- */
+
+#ifdef SENSOR_BATCH_AVX2
+__attribute__((target("avx2")))
+static void classify_avx2(const double *values, const double *lows, const double *highs, size_t count,
+                          uint64_t *below, uint64_t *above) {
+    uint64_t below_mask = 0, above_mask = 0;
+    size_t i = 0;
+
+    /* Ordered comparisons: a NaN lane is false in both */
+    for (; i + 4 <= count; i += 4) {
+        __m256d v = _mm256_loadu_pd(values + i);
+        below_mask |= (uint64_t)_mm256_movemask_pd(_mm256_cmp_pd(v, _mm256_loadu_pd(lows + i), _CMP_LT_OQ)) << i;
+        above_mask |= (uint64_t)_mm256_movemask_pd(_mm256_cmp_pd(v, _mm256_loadu_pd(highs + i), _CMP_GT_OQ)) << i;
+    }
+    classify_scalar(values, lows, highs, i, count, &below_mask, &above_mask);
+    *below = below_mask;
+    *above = above_mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t deviates_avx2(const double *values, const double *centers, const double *limits, size_t count) {
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    uint64_t mask = 0;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256d distance = _mm256_andnot_pd(sign, _mm256_sub_pd(_mm256_loadu_pd(values + i),
+                                                                _mm256_loadu_pd(centers + i)));
+        mask |= (uint64_t)_mm256_movemask_pd(_mm256_cmp_pd(distance, _mm256_loadu_pd(limits + i), _CMP_GT_OQ)) << i;
+    }
+    return mask | deviates_scalar(values, centers, limits, i, count);
+}
+
+__attribute__((target("avx2")))
+static sensor_ts_t max_ts_avx2(const sensor_ts_t *ts, size_t count, sensor_ts_t floor) {
+    __m256i max_v = _mm256_set1_epi64x((long long)floor);
+    int64_t lanes[4];
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(ts + i));
+        max_v = _mm256_blendv_epi8(max_v, v, _mm256_cmpgt_epi64(v, max_v));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, max_v);
+    sensor_ts_t max = floor;
+    for (int lane = 0; lane < 4; ++lane) {
+        if (lanes[lane] > max) {
+            max = (sensor_ts_t)lanes[lane];
+        }
+    }
+    return max_ts_scalar(ts, i, count, max);
+}
+
+/* Whether the CPU runs AVX2: -1 not checked yet, then 0 or 1 (checking twice is harmless) */
+static int avx2_usable = -1;
+
+static int have_avx2(void) {
+    int usable = __atomic_load_n(&avx2_usable, __ATOMIC_RELAXED);
+    if (usable < 0) {
+        __builtin_cpu_init();
+        usable = __builtin_cpu_supports("avx2") ? 1 : 0;
+        __atomic_store_n(&avx2_usable, usable, __ATOMIC_RELAXED);
+    }
+    return usable;
+}
+#endif
+
+/* --- NEON Kernels --- */
+
+#ifdef SENSOR_BATCH_NEON
+/* Two lanes of all-ones or all-zeros as two mask bits */
+static inline uint64_t lane_bits(uint64x2_t lanes) {
+    return (vgetq_lane_u64(lanes, 0) & 1) | (vgetq_lane_u64(lanes, 1) & 2);
+}
+
+static void classify_neon(const double *values, const double *lows, const double *highs, size_t count,
+                          uint64_t *below, uint64_t *above) {
+    uint64_t below_mask = 0, above_mask = 0;
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        float64x2_t v = vld1q_f64(values + i);
+        below_mask |= lane_bits(vcltq_f64(v, vld1q_f64(lows + i))) << i;
+        above_mask |= lane_bits(vcgtq_f64(v, vld1q_f64(highs + i))) << i;
+    }
+    classify_scalar(values, lows, highs, i, count, &below_mask, &above_mask);
+    *below = below_mask;
+    *above = above_mask;
+}
+
+static uint64_t deviates_neon(const double *values, const double *centers, const double *limits, size_t count) {
+    uint64_t mask = 0;
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        float64x2_t distance = vabdq_f64(vld1q_f64(values + i), vld1q_f64(centers + i));
+        mask |= lane_bits(vcgtq_f64(distance, vld1q_f64(limits + i))) << i;
+    }
+    return mask | deviates_scalar(values, centers, limits, i, count);
+}
+
+static sensor_ts_t max_ts_neon(const sensor_ts_t *ts, size_t count, sensor_ts_t floor) {
+    int64x2_t max_v = vdupq_n_s64((int64_t)floor);
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        int64x2_t v = vld1q_s64((const int64_t *)(ts + i));
+        max_v = vbslq_s64(vcgtq_s64(v, max_v), v, max_v);
+    }
+    int64_t a = vgetq_lane_s64(max_v, 0), b = vgetq_lane_s64(max_v, 1);
+    return max_ts_scalar(ts, i, count, (sensor_ts_t)(a > b ? a : b));
+}
+#endif
+
+/* --- Public Functions --- */
+
+void sensor_batch_load(sensor_batch_t *batch, const sensor_data_t *readings, size_t count) {
+    if (count > SENSOR_BATCH_CAPACITY) {
+        count = SENSOR_BATCH_CAPACITY;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        batch->ids[i] = readings[i].id;
+        batch->values[i] = readings[i].value;
+        batch->ts[i] = readings[i].ts;
+    }
+    batch->count = count;
+}
+
+void sensor_batch_classify(const double *values, const double *lows, const double *highs, size_t count,
+                           uint64_t *below, uint64_t *above) {
+    if (count > SENSOR_BATCH_CAPACITY) {
+        count = SENSOR_BATCH_CAPACITY;
+    }
+#if defined(SENSOR_BATCH_AVX2)
+    if (have_avx2()) {
+        classify_avx2(values, lows, highs, count, below, above);
+        return;
+    }
+#elif defined(SENSOR_BATCH_NEON)
+    classify_neon(values, lows, highs, count, below, above);
+    return;
+#endif
+    *below = 0;
+    *above = 0;
+    classify_scalar(values, lows, highs, 0, count, below, above);
+}
+
+uint64_t sensor_batch_deviates(const double *values, const double *centers, const double *limits, size_t count) {
+    if (count > SENSOR_BATCH_CAPACITY) {
+        count = SENSOR_BATCH_CAPACITY;
+    }
+#if defined(SENSOR_BATCH_AVX2)
+    if (have_avx2()) {
+        return deviates_avx2(values, centers, limits, count);
+    }
+#elif defined(SENSOR_BATCH_NEON)
+    return deviates_neon(values, centers, limits, count);
+#endif
+    return deviates_scalar(values, centers, limits, 0, count);
+}
+
+sensor_ts_t sensor_batch_max_ts(const sensor_ts_t *ts, size_t count, sensor_ts_t floor) {
+#if defined(SENSOR_BATCH_AVX2)
+    if (have_avx2()) {
+        return max_ts_avx2(ts, count, floor);
+    }
+#elif defined(SENSOR_BATCH_NEON)
+    return max_ts_neon(ts, count, floor);
+#endif
+    return max_ts_scalar(ts, 0, count, floor);
+}
+
+const char *sensor_batch_kernels(void) {
+#if defined(SENSOR_BATCH_AVX2)
+    return have_avx2() ? "avx2" : "scalar";
+#elif defined(SENSOR_BATCH_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>       /* For isfinite() */
+#include <ctype.h>      /* For isspace() */
+
+/* Include project-specific headers */
+#include "config.h"     /* For the defaults */
+#include "settings.h"
+
+/* --- Local Macros --- */
+
+#define SETTINGS_LINE_BUFFER_SIZE 512   /* Longest line read from a settings file */
+#define SETTINGS_MAX_SBUFFER_SIZE 10000000L /* Upper bound of the shared buffer sizes */
+
+#ifndef MAX_CONNECTIONS_PER_IP
+#define MAX_CONNECTIONS_PER_IP 0        /* No limit */
+#endif
+
+_Static_assert(SENSOR_TIMEOUT_SEC >= 1 && SENSOR_TIMEOUT_SEC <= SENSOR_TIMEOUT_MAX_SEC,
+               "SENSOR_TIMEOUT_SEC must be between 1 and SENSOR_TIMEOUT_MAX_SEC");
+
+/* --- Local Types --- */
+
+typedef enum { SETTING_LONG, SETTING_DOUBLE, SETTING_TEXT } setting_type_t;
+
+typedef enum { APPLIES_STARTUP, APPLIES_RUNTIME, APPLIES_RELOAD } setting_applies_t;
+
+/* Where a setting lives in gateway_settings_t and which values it accepts */
+typedef struct {
+    const char *name;
+    setting_type_t type;
+    setting_applies_t applies;
+    size_t offset;
+    double min;                  /* Numbers: accepted range */
+    double max;
+} setting_desc_t;
+
+#define FIELD(f) offsetof(gateway_settings_t, f)
+
+/* --- Static Variables --- */
+
+static const setting_desc_t settings_table[] = {
+    { "sbuffer_size",               SETTING_LONG,   APPLIES_STARTUP, FIELD(sbuffer_size), 1, SETTINGS_MAX_SBUFFER_SIZE },
+    { "sbuffer_max_size",           SETTING_LONG,   APPLIES_STARTUP, FIELD(sbuffer_max_size), 0, SETTINGS_MAX_SBUFFER_SIZE },
+    { "conmgt_reactors",            SETTING_LONG,   APPLIES_STARTUP, FIELD(conmgt_reactors), 1, CONMGT_MAX_REACTORS },
+    { "datamgt_workers",            SETTING_LONG,   APPLIES_STARTUP, FIELD(datamgt_workers), 1, DATAMGT_MAX_WORKERS },
+    { "tcp_backlog",                SETTING_LONG,   APPLIES_STARTUP, FIELD(tcp_backlog), 1, 65535 },
+    { "map_file",                   SETTING_TEXT,   APPLIES_STARTUP, FIELD(map_file), 0, 0 },
+    { "alert_rules_file",           SETTING_TEXT,   APPLIES_STARTUP, FIELD(rules_file), 0, 0 },
+    { "forward_upstream",           SETTING_TEXT,   APPLIES_STARTUP, FIELD(forward_upstream), 0, 0 },
+    { "sensor_timeout_sec",         SETTING_LONG,   APPLIES_RUNTIME, FIELD(sensor_timeout_sec), 1, SENSOR_TIMEOUT_MAX_SEC },
+    { "max_connections_per_ip",     SETTING_LONG,   APPLIES_RUNTIME, FIELD(max_connections_per_ip), 0, CONMGT_MAX_CLIENTS },
+    { "db_connect_retry_attempts",  SETTING_LONG,   APPLIES_RUNTIME, FIELD(db_connect_retry_attempts), 1, 1000 },
+    { "db_connect_retry_delay_sec", SETTING_LONG,   APPLIES_RUNTIME, FIELD(db_connect_retry_delay_sec), 0, 3600 },
+    { "storagemgt_batch_linger_ms", SETTING_LONG,   APPLIES_RUNTIME, FIELD(storagemgt_batch_linger_ms), 0, 10000 },
+    { "storagemgt_lateness_sec",    SETTING_LONG,   APPLIES_RUNTIME, FIELD(storagemgt_lateness_sec), 0, 3600 },
+    { "alert_min_interval_sec",     SETTING_LONG,   APPLIES_RUNTIME, FIELD(alert_min_interval_sec), 0, 86400 },
+    { "alert_max_per_sec",          SETTING_LONG,   APPLIES_RUNTIME, FIELD(alert_max_per_sec), 0, 1000000 },
+    { "temp_too_cold_threshold",    SETTING_DOUBLE, APPLIES_RELOAD,  FIELD(temp_too_cold_threshold), -1e6, 1e6 },
+    { "temp_too_hot_threshold",     SETTING_DOUBLE, APPLIES_RELOAD,  FIELD(temp_too_hot_threshold), -1e6, 1e6 },
+};
+
+#define SETTINGS_COUNT (sizeof(settings_table) / sizeof(settings_table[0]))
+
+static const char *const applies_names[] = {"startup", "runtime", "reload"};
+
+/* --- Global Variables --- */
+
+gateway_settings_t gateway_settings = {
+    .sbuffer_size = SBUFFER_SIZE,
+    .sbuffer_max_size = SBUFFER_MAX_SIZE,
+    .conmgt_reactors = CONMGT_REACTORS,
+    .datamgt_workers = DATAMGT_WORKERS,
+    .tcp_backlog = TCP_BACKLOG,
+    .map_file = MAP_FILE_NAME,
+    .rules_file = ALERT_RULES_FILE_NAME,
+    .forward_upstream = FORWARDER_UPSTREAM,
+    .sensor_timeout_sec = SENSOR_TIMEOUT_SEC,
+    .max_connections_per_ip = MAX_CONNECTIONS_PER_IP,
+    .db_connect_retry_attempts = DB_CONNECT_RETRY_ATTEMPTS,
+    .db_connect_retry_delay_sec = DB_CONNECT_RETRY_DELAY_SEC,
+    .storagemgt_batch_linger_ms = STORAGEMGT_BATCH_LINGER_MS,
+    .storagemgt_lateness_sec = STORAGEMGT_REORDER_LATENESS_SEC,
+    .alert_min_interval_sec = ALERT_MIN_INTERVAL_SEC,
+    .alert_max_per_sec = ALERT_MAX_PER_SEC,
+    .temp_too_cold_threshold = TEMP_TOO_COLD_THRESHOLD,
+    .temp_too_hot_threshold = TEMP_TOO_HOT_THRESHOLD,
+};
+
+/* --- Helper Functions --- */
+
+/**
+ * @brief Trims text in place.
+ */
+static char *trim(char *text) {
+    while (isspace((unsigned char)*text)) text++;
+    char *end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return text;
+}
+
+static const setting_desc_t *find_setting(const char *name) {
+    for (size_t i = 0; i < SETTINGS_COUNT; ++i) {
+        if (strcmp(settings_table[i].name, name) == 0) {
+            return &settings_table[i];
+        }
+    }
+    return NULL;
+}
+
+/* --- Public Functions --- */
+
+gateway_error_t settings_set(const char *name, const char *value, bool running, char *error, size_t error_size) {
+    char scratch[1];
+    const setting_desc_t *desc = find_setting(name);
+    char *field;
+
+    if (error == NULL) {
+        error = scratch;
+        error_size = sizeof(scratch);
+    }
+    if (desc == NULL) {
+        snprintf(error, error_size, "Unknown setting '%s'", name);
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    if (running && desc->applies == APPLIES_STARTUP) {
+        snprintf(error, error_size, "Setting '%s' applies at startup only, change it in the settings file", name);
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    field = (char *)&gateway_settings + desc->offset;
+
+    if (desc->type == SETTING_TEXT) {
+        size_t len = strlen(value);
+        if (len == 0 || len >= SETTINGS_TEXT_MAX) {
+            snprintf(error, error_size, "Invalid value for %s: must be 1 to %d characters", name, SETTINGS_TEXT_MAX - 1);
+            return GATEWAY_ERROR_INVALID_ARG;
+        }
+        memcpy(field, value, len + 1); /* Startup only: no reader runs yet */
+        return GATEWAY_SUCCESS;
+    }
+
+    char *end;
+    errno = 0;
+    double number = desc->type == SETTING_LONG ? (double)strtol(value, &end, 10) : strtod(value, &end);
+    if (end == value || *end != '\0' || errno != 0 || !isfinite(number) || number < desc->min || number > desc->max) {
+        if (desc->type == SETTING_LONG) {
+            snprintf(error, error_size, "Invalid value '%s' for %s: must be a whole number between %ld and %ld",
+                     value, name, (long)desc->min, (long)desc->max);
+        } else {
+            snprintf(error, error_size, "Invalid value '%s' for %s: must be a number between %g and %g",
+                     value, name, desc->min, desc->max);
+        }
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    if (desc->type == SETTING_LONG) {
+        __atomic_store_n((long *)field, (long)number, __ATOMIC_RELAXED);
+    } else {
+        __atomic_store((double *)field, &number, __ATOMIC_RELAXED);
+    }
+    return GATEWAY_SUCCESS;
+}
+
+gateway_error_t settings_set_assignment(const char *assignment, char *error, size_t error_size) {
+    char copy[SETTINGS_LINE_BUFFER_SIZE];
+    char *equals;
+
+    if (strlen(assignment) >= sizeof(copy) || (equals = strchr(strcpy(copy, assignment), '=')) == NULL) {
+        snprintf(error, error_size, "Invalid setting '%s', expected name=value", assignment);
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    *equals = '\0';
+    return settings_set(trim(copy), trim(equals + 1), false, error, error_size);
+}
+
+gateway_error_t settings_load_file(const char *filename, bool required, char *error, size_t error_size) {
+    char line_buffer[SETTINGS_LINE_BUFFER_SIZE];
+    char message[128];
+    int line_num = 0;
+
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL) {
+        if (!required && errno == ENOENT) {
+            return GATEWAY_SUCCESS;
+        }
+        snprintf(error, error_size, "Cannot open settings file '%s': %s", filename, strerror(errno));
+        return SETTINGS_IO_ERR;
+    }
+
+    while (fgets(line_buffer, sizeof(line_buffer), fp) != NULL) {
+        line_num++;
+        char *line = trim(line_buffer);
+        if (*line == '\0' || *line == '#') continue; /* Skip empty lines and comments */
+
+        char *equals = strchr(line, '=');
+        if (equals == NULL) {
+            snprintf(error, error_size, "%s:%d: expected name = value", filename, line_num);
+            fclose(fp);
+            return GATEWAY_ERROR_INVALID_ARG;
+        }
+        *equals = '\0';
+        if (settings_set(trim(line), trim(equals + 1), false, message, sizeof(message)) != GATEWAY_SUCCESS) {
+            snprintf(error, error_size, "%s:%d: %s", filename, line_num, message);
+            fclose(fp);
+            return GATEWAY_ERROR_INVALID_ARG;
+        }
+    }
+    fclose(fp);
+    return GATEWAY_SUCCESS;
+}
+
+const char *settings_applies(const char *name) {
+    const setting_desc_t *desc = find_setting(name);
+    return desc != NULL ? applies_names[desc->applies] : NULL;
+}
+
+size_t settings_format(char *buf, size_t size) {
+    size_t len = 0;
+
+    buf[0] = '\0';
+    for (size_t i = 0; i < SETTINGS_COUNT; ++i) {
+        const setting_desc_t *desc = &settings_table[i];
+        const char *field = (const char *)&gateway_settings + desc->offset;
+        size_t room = len < size ? size - len : 0;
+        char *out = len < size ? buf + len : NULL;
+        int n;
+
+        if (desc->type == SETTING_LONG) {
+            n = snprintf(out, room, "%-28s %-12ld %s\n", desc->name, __atomic_load_n((const long *)field, __ATOMIC_RELAXED),
+                         applies_names[desc->applies]);
+        } else if (desc->type == SETTING_DOUBLE) {
+            double value;
+            __atomic_load((const double *)field, &value, __ATOMIC_RELAXED);
+            n = snprintf(out, room, "%-28s %-12g %s\n", desc->name, value, applies_names[desc->applies]);
+        } else {
+            n = snprintf(out, room, "%-28s %-12s %s\n", desc->name, field, applies_names[desc->applies]);
+        }
+        len += (size_t)n;
+    }
+    return len;
+}
@@ -0,0 +1,357 @@
+/* --- Include Standard Libraries --- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* --- Include Project-Specific Headers --- */
+#include "config.h"     /* For STORAGEMGT_SPILL_* */
+#include "logger.h"     /* For log_message */
+#include "spill.h"
+
+/* --- Local Macros and Types --- */
+
+#define SPILL_SEGMENT_MAGIC 0x4c50534eu /* "NSPL" in the segment header */
+#define SPILL_RECORD_MAGIC 0x31434552u  /* "REC1", written last to mark a complete record */
+
+/* Segment header, followed by the records; consumed is updated in place */
+typedef struct {
+    uint32_t magic;              /* SPILL_SEGMENT_MAGIC */
+    uint32_t record_size;        /* sizeof(spill_record_t) when written */
+    uint64_t consumed;           /* Records already replayed */
+    uint8_t reserved[48];        /* Pads the header to 64 bytes */
+} spill_header_t;
+
+/* One reading on disk, independent of the padding of sensor_data_t */
+typedef struct {
+    uint32_t magic;              /* SPILL_RECORD_MAGIC once the fields below are valid */
+    uint16_t id;
+    uint16_t reserved;
+    int64_t ts;
+    double value;
+} spill_record_t;
+
+#define SPILL_RECORDS_PER_SEGMENT \
+    ((STORAGEMGT_SPILL_SEGMENT_BYTES - sizeof(spill_header_t)) / sizeof(spill_record_t))
+
+/* --- Local Helper Functions --- */
+
+static spill_header_t *segment_header(uint8_t *map) {
+    return (spill_header_t *)map;
+}
+
+static spill_record_t *segment_records(uint8_t *map) {
+    return (spill_record_t *)(map + sizeof(spill_header_t));
+}
+
+static void segment_path(const spill_log_t *log, unsigned int seq, char *path, size_t size) {
+    snprintf(path, size, "%s/spill-%010u.seg", log->dir, seq);
+}
+
+/**
+ * @brief Maps a segment file, creating and initialising it when create is set.
+ * @return The mapping, or NULL on failure (errno is kept, EINVAL for a foreign or truncated file).
+ */
+static uint8_t *map_segment(const spill_log_t *log, unsigned int seq, bool create) {
+    char path[sizeof(log->dir) + 32];
+    struct stat st;
+
+    segment_path(log, seq, path, sizeof(path));
+    int fd = open(path, O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (create && ftruncate(fd, STORAGEMGT_SPILL_SEGMENT_BYTES) == -1) {
+        int saved_errno = errno;
+        close(fd);
+        unlink(path);
+        errno = saved_errno;
+        return NULL;
+    }
+    if (!create && (fstat(fd, &st) == -1 || st.st_size != STORAGEMGT_SPILL_SEGMENT_BYTES)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    void *map = mmap(NULL, STORAGEMGT_SPILL_SEGMENT_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int saved_errno = errno;
+    close(fd); /* The mapping keeps the file referenced */
+    if (map == MAP_FAILED) {
+        if (create) {
+            unlink(path);
+        }
+        errno = saved_errno;
+        return NULL;
+    }
+
+    spill_header_t *header = segment_header(map);
+    if (create) {
+        /* ftruncate() zero-filled the file, so no record carries the record magic yet */
+        header->record_size = sizeof(spill_record_t);
+        header->consumed = 0;
+        header->magic = SPILL_SEGMENT_MAGIC;
+    } else if (header->magic != SPILL_SEGMENT_MAGIC || header->record_size != sizeof(spill_record_t) ||
+               header->consumed > SPILL_RECORDS_PER_SEGMENT) {
+        munmap(map, STORAGEMGT_SPILL_SEGMENT_BYTES);
+        errno = EINVAL;
+        return NULL;
+    }
+    return map;
+}
+
+static void unmap_segment(uint8_t *map) {
+    if (map != NULL) {
+        munmap(map, STORAGEMGT_SPILL_SEGMENT_BYTES);
+    }
+}
+
+static void remove_segment(const spill_log_t *log, unsigned int seq) {
+    char path[sizeof(log->dir) + 32];
+
+    segment_path(log, seq, path, sizeof(path));
+    if (unlink(path) == -1 && errno != ENOENT) {
+        log_message(LOG_LEVEL_WARNING, "Failed to remove spill segment %s: %s", path, strerror(errno));
+    }
+}
+
+/**
+ * @brief Number of unconsumed records in the head segment.
+ */
+static size_t head_remaining(const spill_log_t *log) {
+    size_t written = (log->head_seq == log->tail_seq) ? log->tail_written : SPILL_RECORDS_PER_SEGMENT;
+    return written - (size_t)segment_header(log->head_map)->consumed;
+}
+
+/**
+ * @brief Deletes the head segment and maps the next one. Segments that cannot be mapped are
+ *        deleted as well, their records are counted as dropped.
+ */
+static void remove_head(spill_log_t *log) {
+    log->count -= head_remaining(log);
+    if (log->head_seq == log->tail_seq) {
+        unmap_segment(log->tail_map);
+        remove_segment(log, log->tail_seq);
+        log->head_map = log->tail_map = NULL;
+        log->tail_written = 0;
+        log->count = 0;
+        log->empty = true;
+        return;
+    }
+
+    unmap_segment(log->head_map);
+    remove_segment(log, log->head_seq);
+    log->head_map = NULL;
+    while (++log->head_seq != log->tail_seq) {
+        log->head_map = map_segment(log, log->head_seq, false);
+        if (log->head_map != NULL) {
+            return;
+        }
+        log_message(LOG_LEVEL_WARNING, "Discarding unreadable spill segment %u: %s", log->head_seq, strerror(errno));
+        remove_segment(log, log->head_seq);
+        log->count -= SPILL_RECORDS_PER_SEGMENT; /* Middle segments are always full */
+        log->dropped += SPILL_RECORDS_PER_SEGMENT;
+    }
+    log->head_map = log->tail_map;
+}
+
+/**
+ * @brief Starts a new tail segment, dropping the oldest segment first when the limit is reached.
+ */
+static gateway_error_t start_segment(spill_log_t *log) {
+    unsigned int seq = log->tail_seq + 1; /* Numbering goes on after the log ran empty */
+
+    if (!log->empty && log->tail_seq - log->head_seq + 1 >= STORAGEMGT_SPILL_MAX_SEGMENTS) {
+        size_t lost = head_remaining(log);
+        log_message(LOG_LEVEL_WARNING, "Spill log reached %d segments, dropping %zu oldest readings.",
+                    STORAGEMGT_SPILL_MAX_SEGMENTS, lost);
+        log->dropped += lost;
+        remove_head(log);
+    }
+
+    uint8_t *map = map_segment(log, seq, true);
+    if (map == NULL) {
+        return SPILL_IO_ERR;
+    }
+    if (log->empty) {
+        log->head_seq = seq;
+        log->head_map = map;
+        log->empty = false;
+    } else if (log->tail_map != log->head_map) {
+        msync(log->tail_map, STORAGEMGT_SPILL_SEGMENT_BYTES, MS_ASYNC); /* Full: start its write-back */
+        unmap_segment(log->tail_map);
+    } else {
+        msync(log->tail_map, STORAGEMGT_SPILL_SEGMENT_BYTES, MS_ASYNC);
+    }
+    log->tail_seq = seq;
+    log->tail_map = map;
+    log->tail_written = 0;
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Finds the segments of a previous run and maps the oldest and newest one.
+ *        Unreadable segments at either end are deleted.
+ */
+static void recover_segments(spill_log_t *log) {
+    DIR *dir = opendir(log->dir);
+    struct dirent *entry;
+    unsigned int min_seq = 0, max_seq = 0;
+    bool found = false;
+
+    if (dir == NULL) {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        unsigned int seq;
+        char tail;
+        if (sscanf(entry->d_name, "spill-%10u.se%c", &seq, &tail) == 2 && tail == 'g') {
+            if (!found || seq < min_seq) min_seq = seq;
+            if (!found || seq > max_seq) max_seq = seq;
+            found = true;
+        }
+    }
+    closedir(dir);
+    if (!found) {
+        return;
+    }
+    log->tail_seq = max_seq; /* New segments continue the numbering even if all of these are discarded */
+
+    /* Newest segment: count the complete records */
+    for (;;) {
+        log->tail_map = map_segment(log, max_seq, false);
+        if (log->tail_map != NULL) {
+            break;
+        }
+        log_message(LOG_LEVEL_WARNING, "Discarding unreadable spill segment %u: %s", max_seq, strerror(errno));
+        remove_segment(log, max_seq);
+        if (max_seq == min_seq) {
+            return;
+        }
+        max_seq--;
+    }
+    spill_record_t *records = segment_records(log->tail_map);
+    while (log->tail_written < SPILL_RECORDS_PER_SEGMENT && records[log->tail_written].magic == SPILL_RECORD_MAGIC) {
+        log->tail_written++;
+    }
+    log->tail_seq = max_seq;
+    log->empty = false;
+
+    /* Oldest segment: resume after what was consumed */
+    log->head_seq = min_seq;
+    while (log->head_seq != log->tail_seq) {
+        log->head_map = map_segment(log, log->head_seq, false);
+        if (log->head_map != NULL) {
+            break;
+        }
+        log_message(LOG_LEVEL_WARNING, "Discarding unreadable spill segment %u: %s", log->head_seq, strerror(errno));
+        remove_segment(log, log->head_seq);
+        log->head_seq++;
+    }
+    if (log->head_seq == log->tail_seq) {
+        log->head_map = log->tail_map;
+    }
+    if (segment_header(log->head_map)->consumed > (uint64_t)(log->head_seq == log->tail_seq ? log->tail_written
+                                                                                           : SPILL_RECORDS_PER_SEGMENT)) {
+        segment_header(log->head_map)->consumed = 0; /* Never more than was written */
+    }
+
+    log->count = head_remaining(log);
+    if (log->head_seq != log->tail_seq) {
+        log->count += (size_t)(log->tail_seq - log->head_seq - 1) * SPILL_RECORDS_PER_SEGMENT + log->tail_written;
+    }
+    if (log->count == 0) {
+        remove_head(log); /* Everything was replayed already */
+    }
+}
+
+/* --- Spill Log Functions --- */
+
+gateway_error_t spill_open(spill_log_t *log, const char *dir) {
+    memset(log, 0, sizeof(*log));
+    log->empty = true;
+    if (dir == NULL || strlen(dir) >= sizeof(log->dir)) {
+        errno = ENAMETOOLONG;
+        return GATEWAY_ERROR_INVALID_ARG;
+    }
+    strcpy(log->dir, dir);
+
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+        return SPILL_IO_ERR;
+    }
+    recover_segments(log);
+    if (log->count > 0) {
+        log_message(LOG_LEVEL_INFO, "Spill log %s holds %zu readings from a previous run.", dir, log->count);
+    }
+    return GATEWAY_SUCCESS;
+}
+
+void spill_close(spill_log_t *log) {
+    if (log->tail_map != NULL && log->tail_map != log->head_map) {
+        unmap_segment(log->tail_map);
+    }
+    unmap_segment(log->head_map);
+    log->head_map = log->tail_map = NULL;
+    log->empty = true;
+}
+
+gateway_error_t spill_append(spill_log_t *log, const sensor_data_t *data, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (log->empty || log->tail_written == SPILL_RECORDS_PER_SEGMENT) {
+            if (start_segment(log) != GATEWAY_SUCCESS) {
+                return SPILL_IO_ERR;
+            }
+        }
+        spill_record_t *record = &segment_records(log->tail_map)[log->tail_written];
+        record->id = data[i].id;
+        record->reserved = 0;
+        record->ts = (int64_t)data[i].ts;
+        record->value = data[i].value;
+        /* The magic goes last: a record cut short by a crash is not recovered */
+        __atomic_store_n(&record->magic, SPILL_RECORD_MAGIC, __ATOMIC_RELEASE);
+        log->tail_written++;
+        log->count++;
+    }
+    return GATEWAY_SUCCESS;
+}
+
+size_t spill_peek(spill_log_t *log, sensor_data_t *data, size_t max_count) {
+    if (log->empty || log->count == 0) {
+        return 0;
+    }
+
+    size_t consumed = (size_t)segment_header(log->head_map)->consumed;
+    size_t available = head_remaining(log);
+    size_t n = available < max_count ? available : max_count;
+    const spill_record_t *records = segment_records(log->head_map);
+    for (size_t i = 0; i < n; ++i) {
+        const spill_record_t *record = &records[consumed + i];
+        data[i].id = record->id;
+        data[i].ts = (sensor_ts_t)record->ts;
+        data[i].value = record->value;
+        data[i].ingest_us = 0; /* Not kept on disk */
+    }
+    return n;
+}
+
+void spill_consume(spill_log_t *log, size_t count) {
+    while (count > 0 && !log->empty) {
+        size_t available = head_remaining(log);
+        size_t n = available < count ? available : count;
+        segment_header(log->head_map)->consumed += n;
+        log->count -= n;
+        count -= n;
+        if (head_remaining(log) == 0) {
+            remove_head(log); /* Deletes the file, or the whole log if this was the tail */
+        }
+    }
+}
+
+size_t spill_count(const spill_log_t *log) {
+    return log->count;
+}
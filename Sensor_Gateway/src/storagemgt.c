@@ -1,13 +1,16 @@
+#define _GNU_SOURCE     /* For pthread_setname_np() */
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>     /* For sleep() replacement using nanosleep */
+#include <unistd.h>     /* For write() */
 #include <sqlite3.h>    /* Needed for sqlite3* type */
 #include <pthread.h>    /* Potentially for thread types if used */
 #include <stdbool.h>    /* For bool type */
 #include <string.h>     /* For strerror, memcpy */
-#include <time.h>       /* For time_t, nanosleep, time() */
+#include <time.h>       /* For clock_gettime() */
 #include <signal.h>     /* For sig_atomic_t */
 #include <errno.h>      /* For errno */
+#include <poll.h>       /* For waiting on wake_fd */
+#include <sys/eventfd.h> /* For wake_fd */
 
 /* Include project-specific headers */
 #include "config.h"     /* For DB config constants like DB_NAME, etc. */
@@ -16,15 +19,30 @@
 #include "logger.h"     /* For log_message */
 #include "db_handler.h" /* For DB interaction functions */
 #include "storagemgt.h" /* For function declarations */
+#include "spill.h"      /* For the on-disk retry queue overflow */
+#include "archive.h"    /* For the compressed archive of committed readings */
+#include "metrics.h"    /* For the commit latency, batch size and retry depth metrics */
+#include "settings.h"   /* For the connection retries, the batch linger and the reorder bound */
+#include "dedup.h"      /* For dropping duplicate readings */
 
 /* --- Local Macros --- */
 
-/* Sleep interval in milliseconds for interruptible sleep */
+/* How long the drain thread waits for the first reading of a batch before checking for a stop (ms) */
 #define SHORT_SLEEP_MS 100
 
 /* Initial capacity for the local retry queue */
 #define RETRY_QUEUE_INITIAL_CAPACITY 20
 
+/* How long the writer waits for a batch before committing pending rollup rows on their own */
+#define WRITER_IDLE_MS 1000
+
+#if STORAGEMGT_RETRY_MEM_ITEMS < STORAGEMGT_BATCH_SIZE
+#error "STORAGEMGT_RETRY_MEM_ITEMS must hold at least one batch"
+#endif
+#if STORAGEMGT_REORDER_MAX_READINGS < 2 * STORAGEMGT_BATCH_SIZE || STORAGEMGT_REORDER_MAX_READINGS < STORAGEMGT_DRAIN_BATCH_SIZE
+#error "STORAGEMGT_REORDER_MAX_READINGS must hold two batches and one drain batch"
+#endif
+
 /* --- Local Structures --- */
 
 /**
@@ -39,6 +57,31 @@ typedef struct {
     int tail;               /* Index to write to (newest item) */
 } local_retry_queue_t;
 
+/**
+ * @brief A batch of readings handed from the drain thread to the writer.
+ */
+typedef struct {
+    sensor_data_t items[STORAGEMGT_BATCH_SIZE]; /* Readings, oldest first */
+    size_t count;           /* Number of readings in items */
+} storage_batch_t;
+
+/**
+ * @brief A reading in the reorder buffer; seq keeps readings with the same timestamp in arrival order.
+ */
+typedef struct {
+    sensor_data_t reading;
+    uint64_t seq;
+} reorder_entry_t;
+
+/**
+ * @brief Growable array of rollup rows.
+ */
+typedef struct {
+    rollup_row_t *rows;     /* Dynamically allocated array of rows */
+    size_t count;           /* Number of rows in use */
+    size_t capacity;        /* Allocated capacity of rows */
+} rollup_list_t;
+
 /* --- Static Variables --- */
 
 /* The local retry queue instance */
@@ -47,6 +90,74 @@ static local_retry_queue_t retry_queue;
 /* Flag indicating if the retry queue has been initialized */
 static bool queue_initialized = false;
 
+/* Overflow of the retry queue on disk; items go there once the memory part is full, or
+ * while it holds anything, so that the memory part always holds the oldest items */
+static spill_log_t spill_log;
+static bool spill_ready = false;
+
+/* Compressed archive fed with every committed reading (STORAGEMGT_ARCHIVE) */
+static archive_writer_t archive_writer;
+static bool archive_ready = false;
+
+/* Rollup rows submitted by the data manager, guarded by rollup_mutex */
+static rollup_list_t rollup_queue = {NULL, 0, 0};
+static bool rollup_producers_done = false;      /* storagemgt_rollups_done() was called */
+static unsigned long rollups_dropped = 0;       /* Rows refused because the queue was full */
+static pthread_mutex_t rollup_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rollup_cond = PTHREAD_COND_INITIALIZER; /* Signalled by storagemgt_rollups_done() */
+
+/* Readings the database refused for their timestamp (DB_OUT_OF_RANGE), storage thread only */
+static unsigned long readings_refused = 0;
+
+/* Rows taken from rollup_queue but not inserted yet (storage thread only) */
+static rollup_list_t rollup_pending = {NULL, 0, 0};
+
+/* Batch pipeline: the drain thread fills free batches from the sbuffer and queues them,
+ * the storage (writer) thread commits them. One batch fills while others wait or commit.
+ * All fields are guarded by batch_mutex. */
+#define BATCH_SLOTS (STORAGEMGT_BATCH_QUEUE_DEPTH + 2) /* Queued, plus one filling and one committing */
+static storage_batch_t batch_slots[BATCH_SLOTS];
+static storage_batch_t *free_batches[BATCH_SLOTS];   /* Stack of empty batches */
+static size_t free_batch_count = 0;
+static storage_batch_t *full_batches[BATCH_SLOTS];   /* FIFO of filled batches */
+static size_t full_batch_head = 0;
+static size_t full_batch_count = 0;
+static bool drain_done = false;                      /* Drain thread saw the sbuffer shut down, or stopped */
+static bool drain_stop = false;                      /* Writer asks the drain thread to exit */
+static pthread_mutex_t batch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batch_free_cond = PTHREAD_COND_INITIALIZER;  /* A batch was released */
+static pthread_cond_t batch_full_cond = PTHREAD_COND_INITIALIZER;  /* A batch was queued, or drain_done */
+static pthread_t drain_thread;
+static bool drain_started = false;
+
+/* WAL checkpoint thread, running off the insert path while the storage thread is connected */
+static pthread_t checkpoint_thread;
+static bool checkpoint_started = false;
+static bool checkpoint_stop = false;            /* Guarded by checkpoint_mutex */
+static pthread_mutex_t checkpoint_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t checkpoint_cond = PTHREAD_COND_INITIALIZER;
+
+/* Drain mode, entered by storagemgt_stop(): the writer commits what is left in
+ * STORAGEMGT_DRAIN_BATCH_SIZE transactions and spills what it cannot commit in time */
+static bool draining = false;                     /* Accessed atomically */
+static int wake_fd = -1;                          /* eventfd, readable once drain mode began */
+static sensor_data_t drain_chunk[STORAGEMGT_DRAIN_BATCH_SIZE]; /* Storage thread only */
+
+/* Reorder buffer: a binary min-heap by (ts, seq) of the readings read from the sbuffer but not
+ * batched yet, so batches are committed in timestamp order. Used by the drain thread, and by the
+ * writer once the drain thread stopped. Holds at most STORAGEMGT_REORDER_MAX_READINGS - STORAGEMGT_BATCH_SIZE
+ * readings between batches, so the next read always fits. */
+static reorder_entry_t reorder_heap[STORAGEMGT_REORDER_MAX_READINGS];
+static size_t reorder_count = 0;
+static uint64_t reorder_seq = 0;                /* seq of the next reading admitted */
+static sensor_ts_t reorder_newest = 0;          /* Newest timestamp admitted */
+static sensor_ts_t reorder_released = 0;        /* Newest timestamp batched: older readings are late */
+static struct timespec reorder_admitted;        /* When readings were last admitted (CLOCK_MONOTONIC) */
+static sensor_data_t incoming[STORAGEMGT_BATCH_SIZE]; /* Readings read by the drain thread, not admitted yet */
+#if DEDUP_WINDOW_READINGS > 0
+static dedup_table_t dedup_table = {NULL};      /* Recent readings of every sensor, same users as the heap */
+#endif
+
 /* --- External Variables --- */
 
 /* Global flag from main.c to signal termination */
@@ -54,8 +165,14 @@ extern volatile sig_atomic_t terminate_flag;
 
 /* --- Forward Declarations (Internal Helper Functions) --- */
 
-/* Sleep function that checks terminate_flag periodically */
+/* True once storagemgt_stop() was called */
+static bool is_draining(void);
+/* True once terminate_flag is set or storagemgt_stop() was called */
+static bool stopping(void);
+/* Sleeps until the time passed or storagemgt_stop() was called */
 static void interruptible_sleep(unsigned int seconds);
+/* Same, but moves arriving batches to the retry queue meanwhile */
+static void absorb_while_waiting(unsigned int seconds);
 
 /* Retry queue management functions */
 static gateway_error_t init_retry_queue(int initial_capacity);
@@ -63,40 +180,111 @@ static void free_retry_queue(void);
 static bool is_retry_queue_empty(void);
 static bool is_retry_queue_full(void);
 static gateway_error_t enqueue_retry_item(const sensor_data_t *data);
-static gateway_error_t dequeue_retry_item(sensor_data_t *data);
-static gateway_error_t peek_retry_item(sensor_data_t *data);
+static void enqueue_retry_items(const sensor_data_t *data, size_t count);
+static gateway_error_t dequeue_retry_item_memory(sensor_data_t *data);
+static size_t peek_retry_items(sensor_data_t *data, size_t max_count);
+static void drop_retry_items(size_t count);
+
+/* Batch handling */
+static gateway_error_t collect_batch(sbuffer_t *buffer, int reader_id, sensor_data_t *batch, size_t *count);
+static gateway_error_t write_batch(db_handle_t *db, const sensor_data_t *batch, size_t count);
+static void archive_committed(const sensor_data_t *batch, size_t count);
+
+/* Batch pipeline between the drain thread and the writer */
+static gateway_error_t start_drain_thread(storagemgt_args_t *args);
+static void stop_drain_thread(void);
+static void *drain_run(void *arg);
+static storage_batch_t *pop_full_batch(unsigned int timeout_ms, bool *finished);
+static void release_batch(storage_batch_t *batch);
+static void absorb_pending_batches(void);
+
+/* Reorder buffer */
+static void reorder_admit(const sensor_data_t *readings, size_t count);
+static size_t reorder_release(sensor_data_t *out, size_t max_count, bool all);
+static bool reorder_before(const reorder_entry_t *a, const reorder_entry_t *b);
+
+/* Drain mode */
+static gateway_error_t read_drain_chunk(sbuffer_t *buffer, int reader_id, size_t *count);
+static void drain_remaining(db_handle_t *db, storagemgt_args_t *args);
+
+/* Rollup row handling */
+static gateway_error_t rollup_list_append(rollup_list_t *list, const rollup_row_t *rows, size_t count);
+static void take_submitted_rollups(void);
+static void wait_for_final_rollups(void);
+
+/* WAL checkpoints */
+static void start_checkpoint_thread(void);
+static void stop_checkpoint_thread(void);
+static void *checkpoint_run(void *arg);
 
 /* --- Main Thread Function Implementation --- */
 
 /**
- * @brief Main function for the Storage Manager thread.
- * Reads sensor data (prioritizing a local retry queue) and inserts it into the SQLite database.
- * Handles database connection errors with retries and uses the local queue to avoid data loss on temporary failures.
- * Checks the global terminate_flag for graceful shutdown requests.
+ * @brief Main function for the Storage Manager thread (the writer).
+ * A drain thread started here fills batches from the sbuffer; this thread commits each batch
+ * (prioritizing a local retry queue) to the SQLite database in one transaction, so ingest
+ * never waits for a commit or a reconnect.
+ * Handles database connection errors with retries and uses the local queue to avoid data loss on temporary failures;
+ * while the database is down, arriving readings go to the queue, which overflows into an on-disk spill log.
+ * After storagemgt_stop() (or once the sbuffer is shut down and empty) it drains: see drain_remaining().
  *
  * @param arg Pointer to storagemgt_args_t containing thread arguments (e.g., pointer to sbuffer).
  * @return Always returns NULL. The thread exits internally on critical errors or termination signals.
  */
 void *storagemgt_run(void *arg) {
-    sbuffer_t *buffer = ((storagemgt_args_t *)arg)->buffer; /* Get buffer from args */
-    sqlite3 *db = NULL;             /* Database connection handle */
+    db_handle_t *db = NULL;         /* Database connection handle */
     gateway_error_t db_ret;         /* Return value from DB operations */
     int retry_count = 0;            /* Counter for DB connection retries */
+    int retry_attempts, retry_delay_sec; /* Retry settings, read when a connect sequence starts */
     bool db_connected = false;      /* Flag indicating current DB connection status */
-    sensor_data_t current_data;     /* Holds data currently being processed */
-    bool processing_retry_item = false; /* True if current_data is from the retry queue */
+    sensor_data_t retry_batch[STORAGEMGT_BATCH_SIZE]; /* Readings peeked from the retry queue */
+    storage_batch_t *current = NULL; /* Batch taken from the drain thread */
+    const sensor_data_t *batch;     /* Readings of the current transaction */
+    size_t batch_count = 0;         /* Number of readings in batch */
+    bool processing_retry_item = false; /* True if batch is from the retry queue */
 
+    pthread_setname_np(pthread_self(), "storagemgt");
     log_message(LOG_LEVEL_INFO, "Storage manager thread started."); 
 
-    /* Initialize local retry queue */
-    if (init_retry_queue(RETRY_QUEUE_INITIAL_CAPACITY) != GATEWAY_SUCCESS) {
+    /* Without it the sleeps below still end at their deadline, just not at once on a stop */
+    int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd < 0) {
+        log_message(LOG_LEVEL_WARNING, "Storage manager cannot create its wake-up eventfd: %s", strerror(errno)); 
+    }
+    __atomic_store_n(&wake_fd, fd, __ATOMIC_SEQ_CST);
+
+    /* Initialize local retry queue; readings spilled by a previous run are replayed first */
+    if (init_retry_queue(STORAGEMGT_RETRY_MEM_ITEMS) != GATEWAY_SUCCESS) {
         log_message(LOG_LEVEL_FATAL, "Storage manager failed to initialize retry queue. Exiting."); 
-        return NULL;
+        goto close_wake_fd;
+    }
+
+    if (STORAGEMGT_ARCHIVE) {
+        archive_ready = (archive_open(&archive_writer, STORAGEMGT_ARCHIVE_DIR) == GATEWAY_SUCCESS);
+        if (!archive_ready) {
+            log_message(LOG_LEVEL_WARNING, "Storage manager could not open archive %s: %s. Archiving disabled.",
+                        STORAGEMGT_ARCHIVE_DIR, strerror(errno));
+        }
+    }
+
+#if DEDUP_WINDOW_READINGS > 0
+    if (dedup_table_init(&dedup_table) != GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_WARNING, "Storage manager cannot allocate its duplicate index, keeping duplicates."); 
+    }
+#endif
+
+    /* Start draining the sbuffer right away, also while the database connects */
+    if (start_drain_thread((storagemgt_args_t *)arg) != GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_FATAL, "Storage manager failed to start its drain thread. Exiting."); 
+        free_retry_queue();
+        goto close_wake_fd;
     }
 
     /* 1. Initial Database Connection Attempt */
-    while (retry_count < DB_CONNECT_RETRY_ATTEMPTS && !db_connected) {
-        if (terminate_flag) {
+    retry_attempts = (int)SETTING(db_connect_retry_attempts);
+    retry_delay_sec = (int)SETTING(db_connect_retry_delay_sec);
+    while (retry_count < retry_attempts && !db_connected) {
+        if (stopping()) {
             log_message(LOG_LEVEL_INFO, "Storage manager terminated during initial DB connect."); 
             goto cleanup_exit_storagemgt; /* Go directly to cleanup */
         }
@@ -109,9 +297,9 @@ void *storagemgt_run(void *arg) {
              
             log_message(LOG_LEVEL_WARNING,
                          "Failed to connect to SQL server (Attempt %d/%d). Retrying in %d seconds...",
-                         retry_count, DB_CONNECT_RETRY_ATTEMPTS, DB_CONNECT_RETRY_DELAY_SEC);
-            if (retry_count < DB_CONNECT_RETRY_ATTEMPTS) {
-                interruptible_sleep(DB_CONNECT_RETRY_DELAY_SEC); /* Use interruptible sleep */
+                         retry_count, retry_attempts, retry_delay_sec);
+            if (retry_count < retry_attempts) {
+                absorb_while_waiting(retry_delay_sec); /* Use interruptible sleep */
             }
         }
     }
@@ -120,7 +308,7 @@ void *storagemgt_run(void *arg) {
         
         log_message(LOG_LEVEL_FATAL,
                     "Unable to connect to SQL server %s after %d attempts. Signaling main process to exit.",
-                    DB_NAME, DB_CONNECT_RETRY_ATTEMPTS);
+                    DB_NAME, retry_attempts);
 
         /* === Inform to Parent process === */
         pid_t parent_pid = getppid();
@@ -137,17 +325,24 @@ void *storagemgt_run(void *arg) {
         goto cleanup_exit_storagemgt; // Jump to cleanup before returning NULL
     }
 
+    start_checkpoint_thread();
+
     /* 2. Main Loop */
     while (true) {
-        gateway_error_t sbuf_ret;
         gateway_error_t insert_ret;
 
+        if (is_draining()) {
+            break; /* drain_remaining() takes over */
+        }
+
         /* Handle DB connection loss: Try to reconnect */
         if (!db_connected) {
             log_message(LOG_LEVEL_INFO, "Database connection lost previously. Attempting to reconnect..."); 
             retry_count = 0;
-            while (retry_count < DB_CONNECT_RETRY_ATTEMPTS && !db_connected) {
-                if (terminate_flag) {
+            retry_attempts = (int)SETTING(db_connect_retry_attempts);
+            retry_delay_sec = (int)SETTING(db_connect_retry_delay_sec);
+            while (retry_count < retry_attempts && !db_connected) {
+                if (stopping()) {
                     log_message(LOG_LEVEL_INFO, "Storage manager terminated during DB reconnect attempt."); 
                     goto cleanup_exit_storagemgt;
                 }
@@ -163,16 +358,16 @@ void *storagemgt_run(void *arg) {
                     retry_count++;                   
                     log_message(LOG_LEVEL_WARNING,
                                  "Failed to reconnect to SQL server (Attempt %d/%d). Retrying in %d seconds...",
-                                 retry_count, DB_CONNECT_RETRY_ATTEMPTS, DB_CONNECT_RETRY_DELAY_SEC);
-                    if (retry_count < DB_CONNECT_RETRY_ATTEMPTS) {
-                        interruptible_sleep(DB_CONNECT_RETRY_DELAY_SEC);
+                                 retry_count, retry_attempts, retry_delay_sec);
+                    if (retry_count < retry_attempts) {
+                        absorb_while_waiting(retry_delay_sec);
                     }
                 }
             }
             if (!db_connected) {       
                 log_message(LOG_LEVEL_FATAL,
                              "Failed to re-establish connection to SQL server %s after %d attempts. Signaling main process to exit.",
-                             DB_NAME, DB_CONNECT_RETRY_ATTEMPTS);
+                             DB_NAME, retry_attempts);
 
                 /* === Inform to Parent === */
                 pid_t parent_pid = getppid();
@@ -193,144 +388,892 @@ void *storagemgt_run(void *arg) {
         /* Now DB should be connected */
         processing_retry_item = false; /* Reset flag for this iteration */
 
-        /* Prioritize processing items from the local retry queue */
+        /* Prioritize retrying the batch that failed last time */
         if (!is_retry_queue_empty()) {
-            if (peek_retry_item(&current_data) == GATEWAY_SUCCESS) {
-                processing_retry_item = true; /* Mark data as coming from retry queue */ 
-                log_message(LOG_LEVEL_DEBUG, "Attempting to insert item from retry queue (Sensor %d)", current_data.id);
-            } else {
-                log_message(LOG_LEVEL_ERROR, "Could not peek item from non-empty retry queue! Skipping retry this iteration."); 
-                 /* Continue to try reading from sbuffer */
-            }
-        }
-
-        /* If retry queue was empty or peek failed, read from the main shared buffer */
-        if (!processing_retry_item) {
-            sbuf_ret = sbuffer_remove(buffer, &current_data); /* Read from sbuffer */
+            absorb_pending_batches(); /* Newer than the retry items, so they queue up behind them */
+            batch_count = peek_retry_items(retry_batch, STORAGEMGT_BATCH_SIZE);
+            batch = retry_batch;
+            processing_retry_item = true; /* Mark batch as coming from retry queue */
+            LOG_DEBUG("Attempting to insert %zu items from retry queue", batch_count);
+        } else {
+            bool finished = false;
+            current = pop_full_batch(WRITER_IDLE_MS, &finished);
 
-            if (sbuf_ret == SBUFFER_SHUTDOWN) {
+            if (current == NULL && finished) {
                 log_message(LOG_LEVEL_INFO, "Storage manager received shutdown signal from sbuffer. Exiting loop."); 
                 break;
             }
-            else if (sbuf_ret != GATEWAY_SUCCESS) {
-                if (sbuf_ret == SBUFFER_EMPTY) { /* Assuming buffer signals empty on free/shutdown */
-                    log_message(LOG_LEVEL_INFO, "Storage manager sbuffer remove returned empty/error, likely shutting down."); 
-                    break; /* Exit loop */
-                } else {
-                    log_message(LOG_LEVEL_ERROR, "Storage manager failed to remove data from sbuffer (Error %d)", sbuf_ret); 
-                    interruptible_sleep(1); /* Short wait before trying again */
-                    continue; /* Try reading sbuffer again */
-                }
+            if (current == NULL) {
+                batch = NULL; /* Idle: commit the rollup rows that arrived meanwhile, if any */
+                batch_count = 0;
+            } else {
+                batch = current->items;
+                batch_count = current->count;
+                LOG_DEBUG("Took batch of %zu new items from the drain thread", batch_count);
             }
-             
-            log_message(LOG_LEVEL_DEBUG, "Read new item from sbuffer (Sensor %d)", current_data.id);
         }
 
-        /* Attempt to insert the current data item (from retry queue or sbuffer) */
-        insert_ret = db_insert_sensor_data(db, &current_data); // db_insert logs internally on success/failure
+        /* Insert the batch and the rollup rows completed meanwhile in one transaction */
+        insert_ret = write_batch(db, batch, batch_count);
 
         if (insert_ret == GATEWAY_SUCCESS) {
-            /* If the successfully inserted item was from the retry queue, remove it now */
+            /* If the committed batch was from the retry queue, remove it now */
             if (processing_retry_item) {
-                sensor_data_t removed_item; // Need a variable to pass to dequeue
-                if (dequeue_retry_item(&removed_item) != GATEWAY_SUCCESS) {
-                    /* This indicates an inconsistency */
-                    log_message(LOG_LEVEL_ERROR, "Failed to dequeue item from retry queue after successful insert!"); 
-                } else {
-                     
-                    log_message(LOG_LEVEL_DEBUG, "Dequeued Sensor ID: %d from retry queue.", removed_item.id);
-                }
+                drop_retry_items(batch_count);
             }
-            /* If item was from sbuffer, we are done with it */
+            /* If the batch was from sbuffer, we are done with it */
+            archive_committed(batch, batch_count);
 
-        } else { /* Insert failed */
-            // db_insert_sensor_data already logged the failure details at ERROR level
+        } else { /* Transaction failed and was rolled back */
+            // write_batch already logged the failure details at ERROR level
 
             /* Assume connection is lost on any insert error */
             log_message(LOG_LEVEL_WARNING, "Assuming database connection lost due to insert error."); 
             db_connected = false;
 
-            /* If the failed item was NEW data from sbuffer, add it to retry queue */
+            /* If the failed batch was NEW data from sbuffer, add all of it to the retry queue */
             if (!processing_retry_item) {
-                if (enqueue_retry_item(&current_data) != GATEWAY_SUCCESS) {
-                    // enqueue logs internally on failure
-                } else {
-                    // enqueue logs internally on success
-                }
+                enqueue_retry_items(batch, batch_count);
             } else {
-                /* Item was already from retry queue and failed again */
+                /* Batch was already from retry queue and failed again */
                 /* It remains at the head of the queue */                 
-                log_message(LOG_LEVEL_WARNING, "Retry insert failed for Sensor ID: %d. Item remains in queue.", current_data.id);
-                /* Consider adding a max retry count per item here */
+                log_message(LOG_LEVEL_WARNING, "Retry insert of %zu items failed. Items remain in queue.", batch_count);
             }
+            if (current != NULL) {
+                release_batch(current);
+                current = NULL;
+            }
+            /* Reconnecting may succeed at once while inserts still fail (e.g. the database is locked):
+             * back off before the retry, queueing what arrives meanwhile */
+            absorb_while_waiting(1);
             /* Loop will continue and attempt to reconnect */
         }
+        if (current != NULL) {
+            release_batch(current); /* Back to the drain thread */
+            current = NULL;
+        }
+        metrics_gauge_set(METRIC_STORAGE_RETRY_DEPTH, (long)retry_queue.count + (spill_ready ? (long)spill_count(&spill_log) : 0));
 
     } /* End of main while loop */
 
 cleanup_exit_storagemgt: /* Label for cleanup and exit */
-    /* 3. Cleanup */
+    /* 3. Drain: commit what is left, or keep it in the spill log if the database is gone */
+    drain_remaining(db_connected ? db : NULL, (storagemgt_args_t *)arg);
+
+    /* The data manager flushes its open buckets when it stops, write those as well */
+    if (db_connected) {
+        wait_for_final_rollups();
+        if (write_batch(db, NULL, 0) != GATEWAY_SUCCESS) {
+            log_message(LOG_LEVEL_ERROR, "Storage manager lost %zu rollup rows at shutdown.", rollup_pending.count); 
+        }
+    }
+
+    /* 4. Cleanup */
     log_message(LOG_LEVEL_INFO, "Storage manager thread shutting down..."); 
+    stop_checkpoint_thread(); /* Before the last close, which then checkpoints the whole WAL */
     if (db != NULL) {
         db_disconnect(db); // db_disconnect logs internally
         db = NULL;
     }
     free_retry_queue(); /* Free the local retry queue */
+    if (archive_ready) {
+        archive_close(&archive_writer); /* Writes out the open blocks */
+        log_message(LOG_LEVEL_INFO, "Storage manager archived %lu readings in %lu blocks (%lu dropped).",
+                    archive_writer.readings_written, archive_writer.blocks_written, archive_writer.dropped);
+        archive_ready = false;
+    }
+    if (readings_refused > 0) {
+        log_message(LOG_LEVEL_WARNING, "Storage manager refused %lu readings outside the partitions kept.", readings_refused);
+    }
+    free(rollup_pending.rows);
+    rollup_pending.rows = NULL;
+    rollup_pending.count = rollup_pending.capacity = 0;
+    pthread_mutex_lock(&rollup_mutex);
+    free(rollup_queue.rows);
+    rollup_queue.rows = NULL;
+    rollup_queue.count = rollup_queue.capacity = 0;
+    if (rollups_dropped > 0) {
+        log_message(LOG_LEVEL_WARNING, "Storage manager dropped %lu rollup rows (queue full).", rollups_dropped); 
+    }
+    pthread_mutex_unlock(&rollup_mutex);
     log_message(LOG_LEVEL_INFO, "Storage manager finished cleanup."); 
 
+close_wake_fd:
+#if DEDUP_WINDOW_READINGS > 0
+    dedup_table_free(&dedup_table);
+#endif
+    fd = __atomic_exchange_n(&wake_fd, -1, __ATOMIC_SEQ_CST);
+    if (fd >= 0) {
+        close(fd);
+    }
     return NULL;
 }
 
 /* --- Shutdown Function Implementation --- */
 
 /**
- * @brief Signals the Storage Manager thread to stop gracefully.
- * (Currently relies on terminate_flag being checked in the run loop).
+ * @brief Puts the Storage Manager into drain mode and wakes it wherever it waits.
  */
 void storagemgt_stop(void) {
-    log_message(LOG_LEVEL_INFO, "Storage Manager stop requested."); 
-    // Actual stop happens when terminate_flag is checked in the run loop
+    log_message(LOG_LEVEL_INFO, "Storage Manager stop requested, draining."); 
+    __atomic_store_n(&draining, true, __ATOMIC_SEQ_CST);
+
+    /* A writer waiting for a batch */
+    pthread_mutex_lock(&batch_mutex);
+    pthread_cond_broadcast(&batch_full_cond);
+    pthread_mutex_unlock(&batch_mutex);
+
+    /* A writer sleeping between connection attempts. Never read, so later sleeps end at once too */
+    int fd = __atomic_load_n(&wake_fd, __ATOMIC_SEQ_CST);
+    if (fd >= 0) {
+        uint64_t one = 1;
+        if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            log_message(LOG_LEVEL_WARNING, "Cannot wake the storage manager: %s", strerror(errno)); 
+        }
+    }
+}
+
+/* --- Rollup Row Submission --- */
+
+/**
+ * @brief Queues rollup rows for insertion by the storage thread.
+ */
+gateway_error_t storagemgt_submit_rollups(const rollup_row_t *rows, size_t count) {
+    gateway_error_t ret = GATEWAY_SUCCESS;
+
+    if (rows == NULL || count == 0) {
+        return GATEWAY_SUCCESS;
+    }
+    pthread_mutex_lock(&rollup_mutex);
+    size_t room = STORAGEMGT_ROLLUP_QUEUE_MAX > rollup_queue.count ? STORAGEMGT_ROLLUP_QUEUE_MAX - rollup_queue.count : 0;
+    size_t accepted = count < room ? count : room;
+    if (accepted > 0) {
+        ret = rollup_list_append(&rollup_queue, rows, accepted);
+        if (ret != GATEWAY_SUCCESS) {
+            accepted = 0;
+        }
+    }
+    if (accepted < count) {
+        /* Only the first drop is logged, the total is reported at shutdown */
+        if (rollups_dropped == 0) {
+            log_message(LOG_LEVEL_WARNING, "Rollup queue full (%zu rows), dropping rollup rows.", rollup_queue.count); 
+        }
+        rollups_dropped += count - accepted;
+        if (ret == GATEWAY_SUCCESS) {
+            ret = SBUFFER_FULL;
+        }
+    }
+    pthread_mutex_unlock(&rollup_mutex);
+    return ret;
+}
+
+/**
+ * @brief Marks the end of rollup submissions and wakes a storage thread waiting for them.
+ */
+void storagemgt_rollups_done(void) {
+    pthread_mutex_lock(&rollup_mutex);
+    rollup_producers_done = true;
+    pthread_cond_broadcast(&rollup_cond);
+    pthread_mutex_unlock(&rollup_mutex);
 }
 
 /* --- Implementation of Internal Helper Functions --- */
 
 /**
- * @brief Sleeps for a specified duration, checking the termination flag periodically.
- * Uses nanosleep for better interruptibility.
- * 
- * @param seconds Total seconds to sleep.
+ * @brief Appends rows to a rollup list, doubling its capacity as needed.
+ *
+ * @return GATEWAY_SUCCESS or GATEWAY_ERROR_NOMEM (the list is unchanged).
  */
-static void interruptible_sleep(unsigned int seconds) {
-    struct timespec sleep_ts; /* Time to sleep in each nanosleep call */
-    struct timespec rem_ts;   /* Remaining time if nanosleep is interrupted */
-    time_t end_time = time(NULL) + seconds; /* When the total sleep should end */
+static gateway_error_t rollup_list_append(rollup_list_t *list, const rollup_row_t *rows, size_t count) {
+    if (list->count + count > list->capacity) {
+        size_t new_capacity = list->capacity > 0 ? list->capacity : 64;
+        while (new_capacity < list->count + count) {
+            new_capacity *= 2;
+        }
+        rollup_row_t *new_rows = realloc(list->rows, new_capacity * sizeof(rollup_row_t));
+        if (new_rows == NULL) {
+            log_message(LOG_LEVEL_ERROR, "Failed to grow rollup list to %zu rows: %s", new_capacity, strerror(errno)); 
+            return GATEWAY_ERROR_NOMEM;
+        }
+        list->rows = new_rows;
+        list->capacity = new_capacity;
+    }
+    memcpy(&list->rows[list->count], rows, count * sizeof(rollup_row_t));
+    list->count += count;
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Moves the submitted rollup rows to the pending list.
+ *        The lock is held only for the move; when nothing is pending the arrays are swapped.
+ */
+static void take_submitted_rollups(void) {
+    pthread_mutex_lock(&rollup_mutex);
+    if (rollup_queue.count > 0) {
+        if (rollup_pending.count == 0) {
+            rollup_list_t swap = rollup_pending;
+            rollup_pending = rollup_queue;
+            rollup_queue = swap;
+        } else if (rollup_list_append(&rollup_pending, rollup_queue.rows, rollup_queue.count) == GATEWAY_SUCCESS) {
+            rollup_queue.count = 0;
+        }
+        /* On allocation failure the rows stay queued for the next batch */
+    }
+    pthread_mutex_unlock(&rollup_mutex);
+}
+
+/**
+ * @brief Collects the next batch from the shared buffer: waits up to SHORT_SLEEP_MS for the
+ *        first readings, then keeps adding whatever arrives within the storagemgt_batch_linger_ms setting.
+ *
+ * @param buffer The shared buffer.
+ * @param reader_id Our read cursor on the shared buffer.
+ * @param batch Array of STORAGEMGT_BATCH_SIZE readings receiving the batch.
+ * @param count Receives the number of readings collected.
+ * @return GATEWAY_SUCCESS with at least one reading, SBUFFER_EMPTY if none arrived in time,
+ *         SBUFFER_SHUTDOWN when the buffer is drained and shut down, another error code if the first read failed.
+ */
+static gateway_error_t collect_batch(sbuffer_t *buffer, int reader_id, sensor_data_t *batch, size_t *count) {
+    struct timespec start, now;
+    size_t removed = 0;
+
+    *count = 0;
+    gateway_error_t ret = sbuffer_remove_batch_timed(buffer, reader_id, batch, STORAGEMGT_BATCH_SIZE,
+                                                     &removed, SHORT_SLEEP_MS);
+    if (ret != GATEWAY_SUCCESS) {
+        return ret; /* SBUFFER_EMPTY lets the drain thread check for a stop request */
+    }
+    *count = removed;
+
+    long linger_ms = SETTING(storagemgt_batch_linger_ms);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (*count < STORAGEMGT_BATCH_SIZE) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed_ms = (now.tv_sec - start.tv_sec) * 1000L + (now.tv_nsec - start.tv_nsec) / 1000000L;
+        if (elapsed_ms >= linger_ms) {
+            break;
+        }
+        ret = sbuffer_remove_batch_timed(buffer, reader_id, &batch[*count], STORAGEMGT_BATCH_SIZE - *count,
+                                         &removed, (unsigned int)(linger_ms - elapsed_ms));
+        if (ret != GATEWAY_SUCCESS) {
+            break; /* Timeout or shutdown: commit what we have, shutdown is seen on the next call */
+        }
+        *count += removed;
+    }
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Inserts a batch of readings and every pending rollup row in one transaction.
+ *        Pending rollup rows are released only once the transaction committed.
+ *
+ * @param db The database handle.
+ * @param batch The readings (may be NULL when count is 0).
+ * @param count Number of readings in batch.
+ * @return GATEWAY_SUCCESS once committed, an error code after rolling back.
+ */
+static gateway_error_t write_batch(db_handle_t *db, const sensor_data_t *batch, size_t count) {
+    gateway_error_t ret;
+    size_t refused = 0;
+    const sensor_data_t *first_refused = NULL;
+
+    take_submitted_rollups();
+    if (count == 0 && rollup_pending.count == 0) {
+        return GATEWAY_SUCCESS;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = db_begin(db);
+    for (size_t i = 0; ret == GATEWAY_SUCCESS && i < rollup_pending.count; ++i) {
+        ret = db_insert_rollup(db, &rollup_pending.rows[i]); // db_insert_rollup logs internally
+    }
+    for (size_t i = 0; ret == GATEWAY_SUCCESS && i < count; ++i) {
+        ret = db_insert_sensor_data(db, &batch[i]); // db_insert logs internally on success/failure
+        if (ret == DB_OUT_OF_RANGE) {
+            /* Retrying would fail the same way and hold up every reading behind it: skip it */
+            if (first_refused == NULL) {
+                first_refused = &batch[i];
+            }
+            refused++;
+            ret = GATEWAY_SUCCESS;
+        }
+    }
+    if (ret == GATEWAY_SUCCESS) {
+        ret = db_commit(db);
+    }
+    if (ret != GATEWAY_SUCCESS) {
+        db_rollback(db);
+        log_message(LOG_LEVEL_ERROR, "Batch of %zu readings and %zu rollup rows rolled back.", count, rollup_pending.count); 
+        return ret;
+    }
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    metrics_observe(METRIC_STORAGE_COMMIT_US, (uint64_t)((end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000L));
+    metrics_observe(METRIC_STORAGE_BATCH_SIZE, count);
+    metrics_add(METRIC_STORAGE_READINGS, count - refused);
+    if (refused > 0) {
+        /* Counted once committed, a batch rolled back is refused again on its retry. Only the
+         * first refusal is logged, the total is reported at shutdown */
+        if (readings_refused == 0) {
+            log_message(LOG_LEVEL_WARNING, "Refused reading of sensor %u at %ld: outside the partitions kept (retention %d, at most %d s ahead). Further ones are only counted.",
+                        first_refused->id, (long)first_refused->ts, DB_RETENTION_PARTITIONS, DB_MAX_FUTURE_SEC);
+        }
+        readings_refused += refused;
+        metrics_add(METRIC_STORAGE_REFUSED, refused);
+    }
+    metrics_observe_latency(METRIC_LATENCY_COMMITTED_US, batch, count);
+    LOG_DEBUG("Committed %zu readings and %zu rollup rows.", count, rollup_pending.count);
+    rollup_pending.count = 0;
+    return GATEWAY_SUCCESS;
+}
 
-    /* Set the sleep interval (e.g., 100ms) */
-    sleep_ts.tv_sec = 0;
-    sleep_ts.tv_nsec = (long)SHORT_SLEEP_MS * 1000000L;
-    /* Handle potential overflow if SHORT_SLEEP_MS is large */
-    if (sleep_ts.tv_nsec >= 1000000000L) {
-        sleep_ts.tv_sec = sleep_ts.tv_nsec / 1000000000L;
-        sleep_ts.tv_nsec %= 1000000000L;
+/**
+ * @brief Hands committed readings to the archive and writes out the blocks that have been
+ *        open for STORAGEMGT_ARCHIVE_SEAL_SEC. Archive errors are logged, never retried:
+ *        the readings are safe in the database.
+ */
+static void archive_committed(const sensor_data_t *batch, size_t count) {
+    if (!archive_ready) {
+        return;
+    }
+    if (count > 0 && archive_append(&archive_writer, batch, count) != GATEWAY_SUCCESS) {
+        log_message(LOG_LEVEL_WARNING, "Storage manager failed to archive some of %zu readings.", count);
+    }
+    archive_flush(&archive_writer, STORAGEMGT_ARCHIVE_SEAL_SEC);
+}
+
+/**
+ * @brief Waits until the data manager submitted its last rollup rows, or STORAGEMGT_ROLLUP_DRAIN_SEC passed.
+ */
+static void wait_for_final_rollups(void) {
+    struct timespec deadline;
+    int rc = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += STORAGEMGT_ROLLUP_DRAIN_SEC;
+    pthread_mutex_lock(&rollup_mutex);
+    while (!rollup_producers_done && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&rollup_cond, &rollup_mutex, &deadline);
+    }
+    if (!rollup_producers_done) {
+        log_message(LOG_LEVEL_WARNING, "Data manager did not finish its rollups within %d s.", STORAGEMGT_ROLLUP_DRAIN_SEC); 
+    }
+    pthread_mutex_unlock(&rollup_mutex);
+}
+
+/**
+ * @brief Starts the checkpoint thread (WAL profile only). Without it the WAL keeps growing,
+ *        since automatic checkpoints are off; a failure is logged and inserts continue.
+ */
+static void start_checkpoint_thread(void) {
+#if DB_WAL_PROFILE
+    checkpoint_stop = false;
+    if (pthread_create(&checkpoint_thread, NULL, checkpoint_run, NULL) != 0) {
+        log_message(LOG_LEVEL_ERROR, "Failed to start WAL checkpoint thread: %s", strerror(errno)); 
+        return;
     }
+    pthread_setname_np(checkpoint_thread, "storage-ckpt");
+    checkpoint_started = true;
+#endif
+}
 
-    /* Loop until the target end time is reached or termination is flagged */
-    while (time(NULL) < end_time && !terminate_flag) {
-        int ret = nanosleep(&sleep_ts, &rem_ts);
+/**
+ * @brief Stops and joins the checkpoint thread, if it runs.
+ */
+static void stop_checkpoint_thread(void) {
+    if (!checkpoint_started) {
+        return;
+    }
+    pthread_mutex_lock(&checkpoint_mutex);
+    checkpoint_stop = true;
+    pthread_cond_signal(&checkpoint_cond);
+    pthread_mutex_unlock(&checkpoint_mutex);
+    pthread_join(checkpoint_thread, NULL);
+    checkpoint_started = false;
+}
 
-        if (ret == -1 && errno == EINTR) {
-            /* Interrupted by signal, check flag and continue loop */
-            log_message(LOG_LEVEL_DEBUG, "nanosleep interrupted by signal."); 
-            if (terminate_flag) break; /* Exit sleep early */
-            /* If not terminating, loop continues and time check handles duration */
-        } else if (ret == -1) {
-            /* Other nanosleep error */
-            log_message(LOG_LEVEL_WARNING, "nanosleep error during interruptible sleep: %s", strerror(errno)); 
-            break; /* Exit sleep loop on other errors */
+/**
+ * @brief Checkpoint thread: every DB_CHECKPOINT_INTERVAL_MS it copies the committed WAL frames
+ *        back into the database on its own connection, so commits never wait for that work.
+ */
+static void *checkpoint_run(void *arg) {
+    (void)arg;
+    db_handle_t *db = NULL;
+    struct timespec deadline;
+    bool stop = false;
+
+    while (!stop) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += DB_CHECKPOINT_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (long)(DB_CHECKPOINT_INTERVAL_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&checkpoint_mutex);
+        while (!checkpoint_stop &&
+               pthread_cond_timedwait(&checkpoint_cond, &checkpoint_mutex, &deadline) != ETIMEDOUT) {
+        }
+        stop = checkpoint_stop;
+        pthread_mutex_unlock(&checkpoint_mutex);
+        if (stop) {
+            break;
+        }
+
+        if (db == NULL && db_connect(DB_NAME, &db) != GATEWAY_SUCCESS) {
+            continue; /* db_connect logged it, try again next interval */
+        }
+        int wal_frames = 0, checkpointed = 0;
+        if (db_checkpoint(db, &wal_frames, &checkpointed) != GATEWAY_SUCCESS) {
+            db_disconnect(db); /* Reopen next interval */
+            db = NULL;
+            continue;
+        }
+        if (checkpointed > 0) {
+            LOG_DEBUG("WAL checkpoint: %d of %d frames written back.", checkpointed, wal_frames);
+        }
+    }
+
+    db_disconnect(db); // db_disconnect logs internally
+    return NULL;
+}
+
+/**
+ * @brief Waits like interruptible_sleep(), but keeps taking the drain thread's batches meanwhile
+ *        and queues them for retry, so ingest doesn't stall while the database is down.
+ *
+ * @param seconds Total seconds to wait.
+ */
+static void absorb_while_waiting(unsigned int seconds) {
+    time_t end_time = time(NULL) + seconds;
+
+    while (time(NULL) < end_time && !stopping()) {
+        bool finished = false;
+        storage_batch_t *batch = pop_full_batch(SHORT_SLEEP_MS, &finished);
+        if (batch != NULL) {
+            enqueue_retry_items(batch->items, batch->count);
+            release_batch(batch);
+        } else if (finished) {
+            /* Nothing more will arrive, just wait out the delay */
+            interruptible_sleep((unsigned int)(end_time > time(NULL) ? end_time - time(NULL) : 0));
+            break;
+        }
+    }
+}
+
+/* --- Batch Pipeline Implementation --- */
+
+/**
+ * @brief Sets up the batch slots and starts the drain thread.
+ *
+ * @param args The storage manager arguments (sbuffer and reader id), kept by the caller.
+ * @return GATEWAY_SUCCESS or THREAD_CREATE_ERR.
+ */
+static gateway_error_t start_drain_thread(storagemgt_args_t *args) {
+    pthread_mutex_lock(&batch_mutex);
+    for (size_t i = 0; i < BATCH_SLOTS; ++i) {
+        free_batches[i] = &batch_slots[i];
+    }
+    free_batch_count = BATCH_SLOTS;
+    full_batch_head = full_batch_count = 0;
+    drain_done = drain_stop = false;
+    pthread_mutex_unlock(&batch_mutex);
+    reorder_count = 0;
+    reorder_newest = reorder_released = 0;
+    clock_gettime(CLOCK_MONOTONIC, &reorder_admitted);
+
+    if (pthread_create(&drain_thread, NULL, drain_run, args) != 0) {
+        log_message(LOG_LEVEL_ERROR, "Failed to create storage drain thread: %s", strerror(errno)); 
+        return THREAD_CREATE_ERR;
+    }
+    pthread_setname_np(drain_thread, "storage-drain");
+    drain_started = true;
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Asks the drain thread to exit and joins it. Batches it queued stay queued.
+ */
+static void stop_drain_thread(void) {
+    if (!drain_started) {
+        return;
+    }
+    pthread_mutex_lock(&batch_mutex);
+    drain_stop = true;
+    pthread_cond_broadcast(&batch_free_cond);
+    pthread_mutex_unlock(&batch_mutex);
+    pthread_join(drain_thread, NULL);
+    drain_started = false;
+}
+
+/**
+ * @brief Drain thread: fills free batches from the sbuffer, through the reorder buffer, and
+ *        queues them for the writer. Readings that are due are batched before more are read.
+ *        Waits for a free batch when the writer is STORAGEMGT_BATCH_QUEUE_DEPTH batches behind.
+ */
+static void *drain_run(void *arg) {
+    storagemgt_args_t *args = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&batch_mutex);
+        while (free_batch_count == 0 && !drain_stop) {
+            pthread_cond_wait(&batch_free_cond, &batch_mutex);
+        }
+        if (drain_stop) {
+            pthread_mutex_unlock(&batch_mutex);
+            break;
+        }
+        storage_batch_t *batch = free_batches[--free_batch_count];
+        pthread_mutex_unlock(&batch_mutex);
+
+        gateway_error_t ret = GATEWAY_SUCCESS;
+        batch->count = reorder_release(batch->items, STORAGEMGT_BATCH_SIZE, false);
+        if (batch->count == 0) {
+            size_t count = 0;
+            ret = collect_batch(args->buffer, args->reader_id, incoming, &count);
+            if (ret == GATEWAY_SUCCESS) {
+                reorder_admit(incoming, count);
+                batch->count = reorder_release(batch->items, STORAGEMGT_BATCH_SIZE, false);
+            }
+        }
+
+        pthread_mutex_lock(&batch_mutex);
+        if (batch->count > 0) {
+            full_batches[(full_batch_head + full_batch_count) % BATCH_SLOTS] = batch;
+            full_batch_count++;
+            pthread_cond_signal(&batch_full_cond);
+        } else {
+            free_batches[free_batch_count++] = batch;
+        }
+        bool stop = drain_stop;
+        pthread_mutex_unlock(&batch_mutex);
+
+        if (ret == SBUFFER_SHUTDOWN || stop) {
+            break;
+        }
+        if (ret != GATEWAY_SUCCESS && ret != SBUFFER_EMPTY) {
+            log_message(LOG_LEVEL_ERROR, "Storage manager failed to remove data from sbuffer (Error %d)", ret); 
+            interruptible_sleep(1); /* Short wait before trying again */
+        }
+    }
+
+    pthread_mutex_lock(&batch_mutex);
+    drain_done = true;
+    pthread_cond_broadcast(&batch_full_cond);
+    pthread_mutex_unlock(&batch_mutex);
+    return NULL;
+}
+
+/**
+ * @brief Takes the oldest filled batch, waiting up to timeout_ms for one.
+ *
+ * @param timeout_ms Maximum wait in milliseconds, 0 to only take one that is ready. Drain mode ends the wait.
+ * @param finished Set when no batch is left and the drain thread has exited.
+ * @return The batch (give it back with release_batch()), or NULL.
+ */
+static storage_batch_t *pop_full_batch(unsigned int timeout_ms, bool *finished) {
+    struct timespec deadline;
+    storage_batch_t *batch = NULL;
+    int rc = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&batch_mutex);
+    while (full_batch_count == 0 && !drain_done && !is_draining() && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&batch_full_cond, &batch_mutex, &deadline);
+    }
+    if (full_batch_count > 0) {
+        batch = full_batches[full_batch_head];
+        full_batch_head = (full_batch_head + 1) % BATCH_SLOTS;
+        full_batch_count--;
+    }
+    *finished = (batch == NULL && drain_done);
+    pthread_mutex_unlock(&batch_mutex);
+    return batch;
+}
+
+/**
+ * @brief Gives a committed (or requeued) batch back to the drain thread.
+ */
+static void release_batch(storage_batch_t *batch) {
+    pthread_mutex_lock(&batch_mutex);
+    free_batches[free_batch_count++] = batch;
+    pthread_cond_signal(&batch_free_cond);
+    pthread_mutex_unlock(&batch_mutex);
+}
+
+/**
+ * @brief Moves every batch already queued by the drain thread into the retry queue.
+ */
+static void absorb_pending_batches(void) {
+    bool finished = false;
+    storage_batch_t *batch;
+
+    while ((batch = pop_full_batch(0, &finished)) != NULL) {
+        enqueue_retry_items(batch->items, batch->count);
+        release_batch(batch);
+    }
+}
+
+/* --- Reorder Buffer Implementation --- */
+
+/**
+ * @brief Heap order: older timestamp first, then arrival order.
+ */
+static bool reorder_before(const reorder_entry_t *a, const reorder_entry_t *b) {
+    return a->reading.ts < b->reading.ts || (a->reading.ts == b->reading.ts && a->seq < b->seq);
+}
+
+/**
+ * @brief Adds readings read from the sbuffer to the reorder buffer, dropping duplicates.
+ *        The buffer must have room for count readings (see reorder_release()).
+ */
+static void reorder_admit(const sensor_data_t *readings, size_t count) {
+    uint64_t duplicates = 0, late = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+#if DEDUP_WINDOW_READINGS > 0
+        if (dedup_table.index != NULL && dedup_table_seen(&dedup_table, &readings[i])) {
+            duplicates++;
+            continue;
+        }
+#endif
+        if (readings[i].ts < reorder_released) {
+            late++; /* Newer readings are batched already */
+        }
+        if (readings[i].ts > reorder_newest) {
+            reorder_newest = readings[i].ts;
+        }
+
+        /* Sift up */
+        reorder_entry_t entry = { readings[i], reorder_seq++ };
+        size_t slot = reorder_count++;
+        while (slot > 0 && reorder_before(&entry, &reorder_heap[(slot - 1) / 2])) {
+            reorder_heap[slot] = reorder_heap[(slot - 1) / 2];
+            slot = (slot - 1) / 2;
+        }
+        reorder_heap[slot] = entry;
+    }
+    if (count > duplicates) {
+        clock_gettime(CLOCK_MONOTONIC, &reorder_admitted);
+    }
+    if (duplicates > 0) {
+        metrics_add(METRIC_STORAGE_DUPLICATES, duplicates);
+    }
+    if (late > 0) {
+        metrics_add(METRIC_STORAGE_LATE, late);
+    }
+}
+
+/**
+ * @brief Takes the oldest readings that are due out of the reorder buffer, in timestamp order.
+ *        A reading is due once the newest timestamp admitted, or the clock, is storagemgt_lateness_sec
+ *        past its own, and every reading is once nothing was admitted for that long. Beyond
+ *        STORAGEMGT_REORDER_MAX_READINGS - STORAGEMGT_BATCH_SIZE readings the oldest are taken
+ *        whether due or not, which leaves room for the next batch read.
+ *
+ * @param out Receives the readings.
+ * @param max_count Capacity of out.
+ * @param all true to take readings whether due or not.
+ * @return The number of readings stored in out.
+ */
+static size_t reorder_release(sensor_data_t *out, size_t max_count, bool all) {
+    sensor_ts_t due = 0;
+    size_t n = 0;
+
+    if (reorder_count == 0) {
+        return 0;
+    }
+    if (!all) {
+        long lateness = SETTING(storagemgt_lateness_sec);
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long idle_ms = (now.tv_sec - reorder_admitted.tv_sec) * 1000L +
+                       (now.tv_nsec - reorder_admitted.tv_nsec) / 1000000L;
+        sensor_ts_t clock = time(NULL);
+        due = (reorder_newest > clock ? reorder_newest : clock) - (sensor_ts_t)lateness;
+        all = (idle_ms >= lateness * 1000L);
+    }
+
+    while (n < max_count && reorder_count > 0) {
+        if (!all && reorder_heap[0].reading.ts > due &&
+            reorder_count <= STORAGEMGT_REORDER_MAX_READINGS - STORAGEMGT_BATCH_SIZE) {
+            break;
+        }
+        out[n++] = reorder_heap[0].reading;
+        if (reorder_heap[0].reading.ts > reorder_released) {
+            reorder_released = reorder_heap[0].reading.ts;
+        }
+
+        /* Sift the last entry down from the root */
+        reorder_entry_t last = reorder_heap[--reorder_count];
+        size_t slot = 0;
+        for (;;) {
+            size_t child = 2 * slot + 1;
+            if (child >= reorder_count) {
+                break;
+            }
+            if (child + 1 < reorder_count && reorder_before(&reorder_heap[child + 1], &reorder_heap[child])) {
+                child++;
+            }
+            if (!reorder_before(&reorder_heap[child], &last)) {
+                break;
+            }
+            reorder_heap[slot] = reorder_heap[child];
+            slot = child;
+        }
+        reorder_heap[slot] = last;
+    }
+    return n;
+}
+
+/* --- Drain Mode Implementation --- */
+
+/**
+ * @brief Fills drain_chunk from the shared buffer without lingering: returns as soon as the
+ *        buffer has nothing more right now.
+ *
+ * @param buffer The shared buffer.
+ * @param reader_id Our read cursor on the shared buffer.
+ * @param count Receives the number of readings in drain_chunk.
+ * @return GATEWAY_SUCCESS with at least one reading, SBUFFER_SHUTDOWN when the buffer is
+ *         drained and shut down, another error code if reading failed.
+ */
+static gateway_error_t read_drain_chunk(sbuffer_t *buffer, int reader_id, size_t *count) {
+    *count = 0;
+    while (*count < STORAGEMGT_DRAIN_BATCH_SIZE) {
+        size_t removed = 0;
+        gateway_error_t ret = sbuffer_remove_batch_timed(buffer, reader_id, &drain_chunk[*count],
+                                                         STORAGEMGT_DRAIN_BATCH_SIZE - *count, &removed, SHORT_SLEEP_MS);
+        if (ret == GATEWAY_SUCCESS) {
+            *count += removed;
+        } else if (ret == SBUFFER_EMPTY && *count == 0) {
+            continue; /* Not shut down yet: the producers are still stopping */
+        } else {
+            return *count > 0 ? GATEWAY_SUCCESS : ret;
+        }
+    }
+    return GATEWAY_SUCCESS;
+}
+
+/**
+ * @brief Empties the pipeline at shutdown. The drain thread is stopped and the writer reads
+ *        the shared buffer itself until it is shut down and empty, committing the retry queue
+ *        first and then the rest in transactions of up to STORAGEMGT_DRAIN_BATCH_SIZE readings.
+ *        Once a commit fails or STORAGEMGT_DRAIN_TIMEOUT_MS passed, everything left goes to the
+ *        retry queue, which is kept in the spill log for the next run.
+ *
+ * @param db The connected database, or NULL to only spill.
+ * @param args The storage manager arguments (sbuffer and reader id).
+ */
+static void drain_remaining(db_handle_t *db, storagemgt_args_t *args) {
+    struct timespec start, now;
+    size_t committed = 0, transactions = 0, spilled = 0;
+    bool commit = (db != NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    stop_drain_thread();
+    absorb_pending_batches(); /* Older than anything still in the sbuffer */
+
+    for (;;) {
+        size_t count = 0;
+        bool from_retry = false;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed_ms = (now.tv_sec - start.tv_sec) * 1000L + (now.tv_nsec - start.tv_nsec) / 1000000L;
+        if (commit && elapsed_ms >= STORAGEMGT_DRAIN_TIMEOUT_MS) {
+            log_message(LOG_LEVEL_WARNING, "Storage drain took over %d ms, keeping the rest for the next run.",
+                        STORAGEMGT_DRAIN_TIMEOUT_MS); 
+            commit = false;
+        }
+
+        if (commit && !is_retry_queue_empty()) {
+            count = peek_retry_items(drain_chunk, STORAGEMGT_DRAIN_BATCH_SIZE);
+            from_retry = true;
+        } else if (reorder_count > 0) {
+            count = reorder_release(drain_chunk, STORAGEMGT_DRAIN_BATCH_SIZE, true); /* Read before the rest */
+        } else {
+            gateway_error_t ret = read_drain_chunk(args->buffer, args->reader_id, &count);
+            if (ret != GATEWAY_SUCCESS) {
+                if (ret != SBUFFER_SHUTDOWN) {
+                    log_message(LOG_LEVEL_ERROR, "Storage manager failed to drain the sbuffer (Error %d)", ret); 
+                }
+                break;
+            }
+            reorder_admit(drain_chunk, count); /* Drops the duplicates and orders the chunk */
+            count = reorder_release(drain_chunk, STORAGEMGT_DRAIN_BATCH_SIZE, true);
+            if (count == 0) {
+                continue;
+            }
+        }
+
+        if (commit) {
+            if (write_batch(db, drain_chunk, count) == GATEWAY_SUCCESS) {
+                if (from_retry) {
+                    drop_retry_items(count);
+                }
+                archive_committed(drain_chunk, count);
+                committed += count;
+                transactions++;
+                continue;
+            }
+            log_message(LOG_LEVEL_WARNING, "Storage drain commit failed, keeping the rest for the next run."); 
+            commit = false;
+            if (from_retry) {
+                continue; /* Still queued */
+            }
+        }
+        enqueue_retry_items(drain_chunk, count);
+        spilled += count;
+    }
+
+    if (committed > 0 || spilled > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        log_message(LOG_LEVEL_INFO, "Storage drain committed %zu readings in %zu transactions and queued %zu for retry in %ld ms.",
+                    committed, transactions, spilled,
+                    (now.tv_sec - start.tv_sec) * 1000L + (now.tv_nsec - start.tv_nsec) / 1000000L); 
+    }
+}
+
+static bool is_draining(void) {
+    return __atomic_load_n(&draining, __ATOMIC_SEQ_CST);
+}
+
+static bool stopping(void) {
+    return terminate_flag || is_draining();
+}
+
+/**
+ * @brief Sleeps for a specified duration, or until storagemgt_stop() writes wake_fd.
+ * 
+ * @param seconds Total seconds to sleep.
+ */
+static void interruptible_sleep(unsigned int seconds) {
+    struct timespec end, now;
+    struct pollfd wake = { .fd = __atomic_load_n(&wake_fd, __ATOMIC_SEQ_CST), .events = POLLIN };
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    end.tv_sec += seconds;
+    while (!stopping()) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long remaining_ms = (end.tv_sec - now.tv_sec) * 1000L + (end.tv_nsec - now.tv_nsec) / 1000000L;
+        if (remaining_ms <= 0) {
+            break;
+        }
+        /* A negative fd is ignored, the poll then only times out */
+        if (poll(&wake, 1, (int)remaining_ms) < 0 && errno != EINTR) {
+            log_message(LOG_LEVEL_WARNING, "poll error during interruptible sleep: %s", strerror(errno)); 
+            break;
         }
-        /* Nanosleep completed the interval successfully */
     }
-    if(terminate_flag) log_message(LOG_LEVEL_DEBUG, "Sleep interrupted by termination flag."); 
 }
 
 /* --- Local Retry Queue Implementation (Simple Circular Array) --- */
@@ -354,6 +1297,13 @@ static gateway_error_t init_retry_queue(int initial_capacity) {
     retry_queue.tail = 0;
     queue_initialized = true;
     log_message(LOG_LEVEL_INFO, "Local retry queue initialized with capacity %d.", initial_capacity); 
+
+    if (spill_open(&spill_log, STORAGEMGT_SPILL_DIR) == GATEWAY_SUCCESS) {
+        spill_ready = true;
+    } else {
+        log_message(LOG_LEVEL_WARNING, "Cannot open spill log %s (%s), the retry queue stays in memory only.",
+                    STORAGEMGT_SPILL_DIR, strerror(errno)); 
+    }
     return GATEWAY_SUCCESS;
 }
 
@@ -361,6 +1311,27 @@ static gateway_error_t init_retry_queue(int initial_capacity) {
  * @brief Frees the memory used by the retry queue.
  */
 static void free_retry_queue(void) {
+    if (spill_ready) {
+        /* Keep what is still in memory for the next run; it is replayed after the spilled items.
+         * The ring is appended as (at most) two runs, not item by item */
+        size_t kept = 0;
+        while (retry_queue.count > 0) {
+            size_t run = (size_t)(retry_queue.capacity - retry_queue.head);
+            if (run > (size_t)retry_queue.count) run = (size_t)retry_queue.count;
+            if (spill_append(&spill_log, &retry_queue.items[retry_queue.head], run) == GATEWAY_SUCCESS) kept += run;
+            retry_queue.head = (int)((retry_queue.head + run) % retry_queue.capacity);
+            retry_queue.count -= (int)run;
+        }
+        if (spill_count(&spill_log) > 0) {
+            log_message(LOG_LEVEL_WARNING, "%zu unwritten readings kept in spill log %s for the next run (%zu moved from memory).",
+                        spill_count(&spill_log), STORAGEMGT_SPILL_DIR, kept); 
+        }
+        if (spill_log.dropped > 0) {
+            log_message(LOG_LEVEL_WARNING, "Spill log dropped %lu readings (segment limit).", spill_log.dropped); 
+        }
+        spill_close(&spill_log);
+        spill_ready = false;
+    }
     if (queue_initialized && retry_queue.items != NULL) {
         free(retry_queue.items);
         retry_queue.items = NULL;
@@ -375,7 +1346,7 @@ static void free_retry_queue(void) {
  * @return True if the queue is empty, false otherwise.
  */
 static bool is_retry_queue_empty(void) {
-    return (!queue_initialized || retry_queue.count == 0);
+    return (!queue_initialized || (retry_queue.count == 0 && (!spill_ready || spill_count(&spill_log) == 0)));
 }
 
 /**
@@ -389,7 +1360,8 @@ static bool is_retry_queue_full(void) {
 
 /**
  * @brief Adds an item to the tail of the retry queue.
- * If the queue is full, it currently drops the oldest item.
+ * Once the memory part is full the item goes to the spill log; only without a usable
+ * spill log does a full queue drop its oldest item.
  * 
  * @param data Pointer to the sensor data item to add.
  * @return GATEWAY_SUCCESS, or GATEWAY_ERROR if not initialized or enqueue fails.
@@ -398,11 +1370,18 @@ static gateway_error_t enqueue_retry_item(const sensor_data_t *data) {
     if (!queue_initialized) return GATEWAY_ERROR;
     if (data == NULL) return GATEWAY_ERROR_INVALID_ARG;
 
+    if (spill_ready && (is_retry_queue_full() || spill_count(&spill_log) > 0)) {
+        if (spill_append(&spill_log, data, 1) == GATEWAY_SUCCESS) {
+            return GATEWAY_SUCCESS;
+        }
+        log_message(LOG_LEVEL_ERROR, "Failed to append to spill log %s: %s", STORAGEMGT_SPILL_DIR, strerror(errno)); 
+    }
+
     if (is_retry_queue_full()) {
         /* Strategy when full: Drop the oldest item */
         log_message(LOG_LEVEL_WARNING, "Retry queue full (capacity %d). Dropping oldest item to make space.", retry_queue.capacity); 
         sensor_data_t dummy;
-        if (dequeue_retry_item(&dummy) != GATEWAY_SUCCESS) {
+        if (dequeue_retry_item_memory(&dummy) != GATEWAY_SUCCESS) {
             log_message(LOG_LEVEL_ERROR, "Failed to drop oldest item from full retry queue."); 
             return GATEWAY_ERROR; /* Could not make space */
         } else {
@@ -414,18 +1393,44 @@ static gateway_error_t enqueue_retry_item(const sensor_data_t *data) {
     retry_queue.items[retry_queue.tail] = *data; /* Copy data */
     retry_queue.tail = (retry_queue.tail + 1) % retry_queue.capacity;
     retry_queue.count++;
-    log_message(LOG_LEVEL_DEBUG, "Enqueued Sensor ID: %d to retry queue (count: %d)", data->id, retry_queue.count); 
+    LOG_DEBUG("Enqueued Sensor ID: %d to retry queue (count: %d)", data->id, retry_queue.count); 
     return GATEWAY_SUCCESS;
 }
 
 /**
- * @brief Removes the oldest item (at head) from the retry queue.
+ * @brief Adds items to the tail of the retry queue, like enqueue_retry_item() but handing
+ * the part that goes to the spill log over in one append.
+ * 
+ * @param data The items, oldest first.
+ * @param count Number of items.
+ */
+static void enqueue_retry_items(const sensor_data_t *data, size_t count) {
+    if (!queue_initialized || count == 0) return;
+
+    if (spill_ready) {
+        /* The memory part takes items only while nothing is spilled, so it keeps the oldest */
+        size_t room = spill_count(&spill_log) == 0 ? (size_t)(retry_queue.capacity - retry_queue.count) : 0;
+        for (; room > 0 && count > 0; --room, --count) {
+            enqueue_retry_item(data++);
+        }
+        if (count == 0 || spill_append(&spill_log, data, count) == GATEWAY_SUCCESS) {
+            return;
+        }
+        log_message(LOG_LEVEL_ERROR, "Failed to append %zu readings to spill log %s: %s", count, STORAGEMGT_SPILL_DIR, strerror(errno)); 
+    }
+    for (size_t i = 0; i < count; ++i) {
+        enqueue_retry_item(&data[i]); // enqueue logs internally
+    }
+}
+
+/**
+ * @brief Removes the oldest item (at head) from the memory part of the retry queue.
  * 
  * @param data Pointer to store the removed item's data.
- * @return GATEWAY_SUCCESS, or GATEWAY_ERROR_INVALID_ARG if queue is empty or not initialized.
+ * @return GATEWAY_SUCCESS, or GATEWAY_ERROR_INVALID_ARG if it is empty or not initialized.
  */
-static gateway_error_t dequeue_retry_item(sensor_data_t *data) {
-    if (!queue_initialized || is_retry_queue_empty()) {
+static gateway_error_t dequeue_retry_item_memory(sensor_data_t *data) {
+    if (!queue_initialized || retry_queue.count == 0) {
         return GATEWAY_ERROR_INVALID_ARG; // Return error, don't log here, caller should log if needed
     }
     if (data == NULL) return GATEWAY_ERROR_INVALID_ARG;
@@ -435,24 +1440,53 @@ static gateway_error_t dequeue_retry_item(sensor_data_t *data) {
     /* Move head */
     retry_queue.head = (retry_queue.head + 1) % retry_queue.capacity;
     retry_queue.count--;
-    log_message(LOG_LEVEL_DEBUG, "Dequeued Sensor ID: %d from retry queue (count: %d)", data->id, retry_queue.count);
+    LOG_DEBUG("Dequeued Sensor ID: %d from retry queue (count: %d)", data->id, retry_queue.count);
     return GATEWAY_SUCCESS;
 }
 
 /**
- * @brief Gets a copy of the oldest item (at head) without removing it.
+ * @brief Copies up to max_count of the oldest items without removing them.
+ * Items come from memory while it holds any, then from the spill log.
  * 
- * @param data Pointer to store the peeked item's data.
- * @return GATEWAY_SUCCESS, or GATEWAY_ERROR_INVALID_ARG if queue is empty or not initialized.
+ * @param data Array of at least max_count elements receiving the items, oldest first.
+ * @param max_count Capacity of data.
+ * @return The number of items copied (0 if the queue is empty or not initialized).
  */
-static gateway_error_t peek_retry_item(sensor_data_t *data) {
-    if (!queue_initialized || is_retry_queue_empty()) {
-        return GATEWAY_ERROR_INVALID_ARG; // Return error, don't log here
+static size_t peek_retry_items(sensor_data_t *data, size_t max_count) {
+    if (!queue_initialized || is_retry_queue_empty() || data == NULL) {
+        return 0;
+    }
+    if (retry_queue.count == 0) {
+        size_t spilled = spill_peek(&spill_log, data, max_count);
+        LOG_DEBUG("Peeked %zu items from spill log (%zu left)", spilled, spill_count(&spill_log));
+        return spilled;
     }
-    if (data == NULL) return GATEWAY_ERROR_INVALID_ARG;
 
-    /* Copy data out from head */
-    *data = retry_queue.items[retry_queue.head];
-    log_message(LOG_LEVEL_DEBUG, "Peeked Sensor ID: %d from retry queue", data->id);
-    return GATEWAY_SUCCESS;
-}
\ No newline at end of file
+    size_t n = (size_t)retry_queue.count < max_count ? (size_t)retry_queue.count : max_count;
+    for (size_t i = 0; i < n; ++i) {
+        data[i] = retry_queue.items[(retry_queue.head + i) % retry_queue.capacity];
+    }
+    LOG_DEBUG("Peeked %zu items from retry queue", n);
+    return n;
+}
+
+/**
+ * @brief Removes up to count of the oldest items once they were committed,
+ * from the same part the last peek_retry_items() read.
+ * 
+ * @param count Number of items to remove.
+ */
+static void drop_retry_items(size_t count) {
+    if (!queue_initialized) return;
+    if (retry_queue.count == 0) {
+        if (spill_ready) {
+            spill_consume(&spill_log, count);
+        }
+        return;
+    }
+
+    size_t n = (size_t)retry_queue.count < count ? (size_t)retry_queue.count : count;
+    retry_queue.head = (int)((retry_queue.head + n) % retry_queue.capacity);
+    retry_queue.count -= (int)n;
+    LOG_DEBUG("Dropped %zu committed items from retry queue (count: %d)", n, retry_queue.count);
+}
@@ -1,145 +1,190 @@
+#define _GNU_SOURCE     /* For pthread_setname_np() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>     /* For string manipulation functions like strncmp, strerror */
-#include <unistd.h>     /* For POSIX API functions */
+#include <unistd.h>     /* For pread(), sysconf() */
 #include <errno.h>      /* For error handling using errno */
 #include <stdbool.h>    /* For boolean type */
+#include <fcntl.h>      /* For open() */
+#include <dirent.h>     /* For the thread list in /proc/self/task */
+#include <pthread.h>
+#include <time.h>
 
 /* Include project-specific headers */
+#include "config.h"     /* For SYSMON_INTERVAL_MS */
 #include "sysmon.h"     /* Header file for system monitoring functions */
 #include "logger.h"     /* Header file for logging functionality */
 
-/* --- Static variables to store previous CPU state --- */
-/* These variables are used to calculate CPU usage between successive calls */
-static unsigned long long prev_total_time = 0;      /* Sum of all previous CPU times */
-static unsigned long long prev_total_idle_time = 0; /* Sum of previous idle and iowait times */
-static bool first_call_cpu = true;                  /* Flag to indicate the first call to get CPU usage */
+#define SYSMON_STAT_BYTES 16384      /* Start of /proc/stat read per sample; the cpu lines come first */
+#define SYSMON_MEMINFO_BYTES 4096    /* Start of /proc/meminfo read per sample */
+#define SYSMON_TASK_STAT_BYTES 512   /* A thread's stat line */
+#define SYSMON_TASK_DIR "/proc/self/task"
+
+/* Cumulative times of one cpu line of /proc/stat, in clock ticks */
+typedef struct {
+    unsigned long long total;    /* Sum of all components */
+    unsigned long long idle;     /* idle + iowait */
+} cpu_times_t;
+
+/* A gateway thread whose stat file is kept open */
+typedef struct {
+    int tid;
+    int fd;                      /* /proc/self/task/<tid>/stat */
+    unsigned long long ticks;    /* utime + stime at the previous sample */
+    bool seen;                   /* Listed in the current sample */
+} task_entry_t;
+
+/* --- Sampler state, only touched by the sampler thread --- */
+static int stat_fd = -1;                              /* /proc/stat */
+static int meminfo_fd = -1;                           /* /proc/meminfo */
+static DIR *task_dir = NULL;                          /* /proc/self/task, rewound per sample */
+static task_entry_t tasks[SYSMON_MAX_THREADS];
+static int task_count = 0;
+static cpu_times_t prev_total;                        /* Previous sample of the "cpu" line */
+static cpu_times_t prev_cores[SYSMON_MAX_CPUS];       /* Previous sample of the "cpuN" lines */
+static int prev_core_count = 0;
+static struct timespec prev_sample_time;
+static bool have_prev_sample = false;
+static system_stats_t next_snapshot;                  /* Built here, then published */
+
+/* --- Published snapshot --- */
+static system_stats_t snapshot;
+static bool snapshot_valid = false;
+static pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* --- Stop request --- */
+static bool stop_requested = false;
+static pthread_mutex_t stop_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stop_cond = PTHREAD_COND_INITIALIZER;
 
 /*
- * @brief Reads CPU time statistics from the first line of /proc/stat.
- *        This function extracts user, nice, system, idle, iowait, irq, and softirq times.
- *        It also calculates the total time based on these components.
- * @param user_time Pointer to store user time.
- * @param nice_time Pointer to store nice time.
- * @param system_time Pointer to store system time.
- * @param idle_time Pointer to store idle time.
- * @param iowait_time Pointer to store iowait time.
- * @param irq_time Pointer to store irq time.
- * @param softirq_time Pointer to store softirq time.
- * @param total_time Pointer to store the calculated total time.
- * @return 0 on success, -1 on error.
+ * @brief Reads a /proc file from its start into a NUL-terminated buffer.
+ * @return The number of bytes read, or -1 on error.
  */
-static int read_cpu_times(unsigned long long *user_time, unsigned long long *nice_time,
-                          unsigned long long *system_time, unsigned long long *idle_time,
-                          unsigned long long *iowait_time, unsigned long long *irq_time,
-                          unsigned long long *softirq_time, unsigned long long *total_time) {
-    /* Open the /proc/stat file to read CPU statistics */
-    FILE *fp = fopen("/proc/stat", "r");
-    if (fp == NULL) {
-        /* Log an error message if the file cannot be opened */
-        log_message(LOG_LEVEL_ERROR, "Failed to open /proc/stat: %s", strerror(errno));
+static ssize_t read_proc(int fd, char *buffer, size_t size) {
+    ssize_t len = pread(fd, buffer, size - 1, 0);
+    if (len < 0) {
         return -1;
     }
+    buffer[len] = '\0';
+    return len;
+}
 
-    /* Read the first line containing CPU times */
-    int items_read = fscanf(fp, "cpu %llu %llu %llu %llu %llu %llu %llu",
-                            user_time, nice_time, system_time, idle_time,
-                            iowait_time, irq_time, softirq_time);
-
-    /* Close the file after reading */
-    fclose(fp);
+/*
+ * @brief Parses the user, nice, system, idle, iowait, irq and softirq times of a cpu line.
+ * @return 0 on success, -1 if the line has fewer fields.
+ */
+static int parse_cpu_line(const char *line, cpu_times_t *times) {
+    unsigned long long user_time, nice_time, system_time, idle_time, iowait_time, irq_time, softirq_time;
 
-    /* Check if all required fields were successfully read */
-    if (items_read < 7) {
-        /* Log an error if the required fields are missing */
-        log_message(LOG_LEVEL_ERROR, "Failed to parse required CPU times from /proc/stat (read %d items, expected at least 7)", items_read);
-        /* Reset all output parameters to zero */
-        *user_time = *nice_time = *system_time = *idle_time = *iowait_time = *irq_time = *softirq_time = 0;
-        *total_time = 0;
+    if (sscanf(line, "%*s %llu %llu %llu %llu %llu %llu %llu",
+               &user_time, &nice_time, &system_time, &idle_time,
+               &iowait_time, &irq_time, &softirq_time) < 7) {
         return -1;
     }
+    times->total = user_time + nice_time + system_time + idle_time + iowait_time + irq_time + softirq_time;
+    times->idle = idle_time + iowait_time;
+    return 0;
+}
 
-    /* Calculate the total time as the sum of all CPU time components */
-    *total_time = *user_time + *nice_time + *system_time + *idle_time +
-                  *iowait_time + *irq_time + *softirq_time;
-
-    return 0; /* Return success */
+/*
+ * @brief Computes the busy share between two samples of a cpu line.
+ * @return The usage in percent, or -1.0 if the counters went backwards.
+ */
+static double busy_percent(const cpu_times_t *prev, const cpu_times_t *current) {
+    if (current->total < prev->total || current->idle < prev->idle) {
+        return -1.0;
+    }
+    unsigned long long total_diff = current->total - prev->total;
+    unsigned long long idle_diff = current->idle - prev->idle;
+    if (total_diff == 0) {
+        return 0.0; /* No change implies 0% usage */
+    }
+    unsigned long long busy_diff = total_diff - idle_diff;
+    if (busy_diff > total_diff) busy_diff = total_diff; /* Clamp values */
+    return ((double)busy_diff / (double)total_diff) * 100.0;
 }
 
 /*
- * @brief Helper function to parse a specific key's value from /proc/meminfo.
- *        This function searches for a key (e.g., "MemTotal") and retrieves its value in kB.
- * @param key The key to search for in /proc/meminfo.
- * @return The value associated with the key in kB, or -1 on error.
+ * @brief Samples /proc/stat: the whole system and each core, each against the previous sample.
+ * @return 0 on success, -1 on error.
  */
-static long get_mem_value(const char *key) {
-    /* Open the /proc/meminfo file to read memory statistics */
-    FILE *fp = fopen("/proc/meminfo", "r");
-    char line[256];
-    long value = -1;
+static int sample_cpus(system_stats_t *stats) {
+    static char buffer[SYSMON_STAT_BYTES];
+    cpu_times_t total;
+    int cores = 0;
 
-    if (!fp) {
-        /* Log an error message if the file cannot be opened */
-        log_message(LOG_LEVEL_ERROR, "Failed to open /proc/meminfo: %s", strerror(errno));
+    if (read_proc(stat_fd, buffer, sizeof(buffer)) < 0 || parse_cpu_line(buffer, &total) != 0) {
         return -1;
     }
+    stats->cpu_usage_percent = have_prev_sample ? busy_percent(&prev_total, &total) : 0.0;
+    prev_total = total;
 
-    /* Read the file line by line to find the specified key */
-    while (fgets(line, sizeof(line), fp)) {
-        char key_from_file[64];
-        long val_kb;
-
-        /* Parse the key-value pair from the line */
-        if (sscanf(line, "%63[^:]:%ld kB", key_from_file, &val_kb) == 2) {
-            /* Check if the key matches the requested key */
-            if (strncmp(key_from_file, key, strlen(key)) == 0 && key_from_file[strlen(key)] == '\0') {
-                value = val_kb;
-                break;
-            }
+    /* The "cpuN" lines follow the "cpu" line */
+    for (char *line = strchr(buffer, '\n'); line != NULL && strncmp(line + 1, "cpu", 3) == 0 &&
+                                            cores < SYSMON_MAX_CPUS; line = strchr(line + 1, '\n')) {
+        cpu_times_t core;
+        if (parse_cpu_line(line + 1, &core) != 0) {
+            break;
         }
+        bool known = have_prev_sample && cores < prev_core_count;
+        stats->core_usage_percent[cores] = known ? busy_percent(&prev_cores[cores], &core) : 0.0;
+        prev_cores[cores++] = core;
     }
+    stats->cpu_count = cores;
+    prev_core_count = cores;
+    return 0;
+}
 
-    /* Close the file after reading */
-    fclose(fp);
+/*
+ * @brief Helper function to parse a specific key's value from the text of /proc/meminfo.
+ *        This function searches for a key (e.g., "MemTotal") and retrieves its value in kB.
+ * @param text The contents of /proc/meminfo.
+ * @param key The key to search for.
+ * @return The value associated with the key in kB, or -1 if it is missing.
+ */
+static long get_mem_value(const char *text, const char *key) {
+    size_t key_len = strlen(key);
+    long value = -1;
 
-    /* Log a warning if the key was not found */
-    if (value == -1) {
-        if (strcmp(key, "MemAvailable") != 0) {
-            log_message(LOG_LEVEL_WARNING, "Key '%s' not found or could not be parsed in /proc/meminfo", key);
-        } else {
-            log_message(LOG_LEVEL_DEBUG, "Key 'MemAvailable' not found in /proc/meminfo (using fallback calculation).");
+    /* Read the text line by line to find the specified key */
+    const char *line = text;
+    while (line != NULL && *line != '\0') {
+        if (strncmp(line, key, key_len) == 0 && line[key_len] == ':') {
+            if (sscanf(line + key_len + 1, "%ld", &value) != 1) {
+                value = -1;
+            }
+            break;
         }
+        line = strchr(line, '\n');
+        if (line != NULL) line++;
     }
-
-    return value; /* Return the value or -1 on error */
+    return value;
 }
 
 /*
- * @brief Retrieves system statistics, including RAM and CPU usage.
- *        This function calculates RAM usage and CPU usage based on the current system state.
- * @param stats Pointer to a system_stats_t structure to store the retrieved statistics.
- * @return 0 on success, -1 on error.
+ * @brief Samples /proc/meminfo into the RAM fields.
  */
-int sysmon_get_stats(system_stats_t *stats) {
-    if (!stats) return -1; /* Return error if the stats pointer is NULL */
+static void sample_memory(system_stats_t *stats) {
+    static char buffer[SYSMON_MEMINFO_BYTES];
+    static bool warned = false;
 
-    /* --- RAM Usage Calculation --- */
-    /* Retrieve memory statistics from /proc/meminfo */
-    stats->ram_total_kb = get_mem_value("MemTotal");
-    long mem_free = get_mem_value("MemFree");
-    long buffers = get_mem_value("Buffers");
-    long cached = get_mem_value("Cached");
-    long mem_available = get_mem_value("MemAvailable");
+    if (read_proc(meminfo_fd, buffer, sizeof(buffer)) < 0) {
+        buffer[0] = '\0';
+    }
+    stats->ram_total_kb = get_mem_value(buffer, "MemTotal");
+    long mem_available = get_mem_value(buffer, "MemAvailable");
+    long mem_free = get_mem_value(buffer, "MemFree");
+    long buffers = get_mem_value(buffer, "Buffers");
+    long cached = get_mem_value(buffer, "Cached");
 
     /* Calculate free and used memory */
     if (mem_available != -1) {
         stats->ram_free_kb = mem_available;
+    } else if (mem_free != -1 && buffers != -1 && cached != -1) {
+        stats->ram_free_kb = mem_free + buffers + cached;
     } else {
-        if (mem_free != -1 && buffers != -1 && cached != -1) {
-            stats->ram_free_kb = mem_free + buffers + cached;
-        } else {
-            stats->ram_free_kb = -1;
-        }
+        stats->ram_free_kb = -1;
     }
 
     /* Calculate RAM usage percentage */
@@ -149,61 +194,219 @@ int sysmon_get_stats(system_stats_t *stats) {
     } else {
         stats->ram_used_kb = -1;
         stats->ram_usage_percent = -1.0;
-        log_message(LOG_LEVEL_WARNING, "Could not calculate RAM usage (Total: %ld kB, Free: %ld kB)", stats->ram_total_kb, stats->ram_free_kb);
-    }
-
-    /* --- CPU Usage Calculation --- */
-    /* Local variables to store current CPU times */
-    unsigned long long current_user_time, current_nice_time, current_system_time, current_idle_time;
-    unsigned long long current_iowait_time, current_irq_time, current_softirq_time, current_total_time;
-    unsigned long long total_diff, idle_diff, busy_diff;
-    double cpu_usage = -1.0; /* Default to error/unavailable */
-
-    /* Read current CPU times */
-    if (read_cpu_times(&current_user_time, &current_nice_time, &current_system_time, &current_idle_time,
-                       &current_iowait_time, &current_irq_time, &current_softirq_time, &current_total_time) != 0) {
-        log_message(LOG_LEVEL_ERROR, "Failed to read current CPU times for usage calculation.");
-        stats->cpu_usage_percent = -1.0;
-        return 0; /* Return 0 as RAM info might still be valid */
-    }
-
-    /* Calculate total idle time (idle + iowait) */
-    unsigned long long current_total_idle_time = current_idle_time + current_iowait_time;
-
-    /* Handle the first call to establish baseline values */
-    if (first_call_cpu) {
-        log_message(LOG_LEVEL_DEBUG, "CPU usage monitor: First call, storing initial values.");
-        prev_total_time = current_total_time;
-        prev_total_idle_time = current_total_idle_time;
-        first_call_cpu = false;
-        stats->cpu_usage_percent = 0.0; /* Report 0% usage for the first interval */
-    } else {
-        /* Calculate differences since the last call */
-        if (current_total_time < prev_total_time || current_total_idle_time < prev_total_idle_time) {
-            log_message(LOG_LEVEL_WARNING, "CPU time counter wrap-around detected or invalid previous data (PrevTotal: %llu, CurrTotal: %llu, PrevIdle: %llu, CurrIdle: %llu). Resetting state.",
-                         prev_total_time, current_total_time, prev_total_idle_time, current_total_idle_time);
-            first_call_cpu = true; /* Reset state */
-            stats->cpu_usage_percent = -1.0; /* Error for this call */
+        if (!warned) {
+            log_message(LOG_LEVEL_WARNING, "Could not calculate RAM usage (Total: %ld kB, Free: %ld kB)", stats->ram_total_kb, stats->ram_free_kb);
+            warned = true;
+        }
+    }
+}
+
+/*
+ * @brief Reads the name and utime + stime of a thread from its stat line.
+ * @return 0 on success, -1 if the thread is gone.
+ */
+static int read_task(int fd, char *name, size_t name_size, unsigned long long *ticks) {
+    char buffer[SYSMON_TASK_STAT_BYTES];
+    unsigned long long utime, stime;
+
+    if (read_proc(fd, buffer, sizeof(buffer)) <= 0) {
+        return -1;
+    }
+    /* "<tid> (<comm>) <state> ...": comm may hold spaces and parentheses, so take the last ')' */
+    char *open_paren = strchr(buffer, '(');
+    char *close_paren = strrchr(buffer, ')');
+    if (open_paren == NULL || close_paren == NULL || close_paren < open_paren) {
+        return -1;
+    }
+    size_t len = (size_t)(close_paren - open_paren - 1);
+    if (len >= name_size) len = name_size - 1;
+    memcpy(name, open_paren + 1, len);
+    name[len] = '\0';
+    /* Fields 3 to 13 (state .. cmajflt) come before utime and stime */
+    if (sscanf(close_paren + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2) {
+        return -1;
+    }
+    *ticks = utime + stime;
+    return 0;
+}
+
+/*
+ * @brief Samples every gateway thread. Stat files of new threads are opened, those of
+ *        threads that exited are closed.
+ * @param interval_ticks Clock ticks since the previous sample (0 on the first).
+ */
+static void sample_tasks(system_stats_t *stats, double interval_ticks) {
+    struct dirent *entry;
+    double process_percent = 0.0;
+
+    for (int i = 0; i < task_count; ++i) {
+        tasks[i].seen = false;
+    }
+    stats->thread_count = 0;
+
+    rewinddir(task_dir);
+    while ((entry = readdir(task_dir)) != NULL) {
+        char *end;
+        long tid = strtol(entry->d_name, &end, 10);
+        if (end == entry->d_name || *end != '\0') {
+            continue; /* "." and ".." */
+        }
+
+        task_entry_t *task = NULL;
+        for (int i = 0; i < task_count && task == NULL; ++i) {
+            if (tasks[i].tid == tid) task = &tasks[i];
+        }
+        if (task == NULL) {
+            char path[64];
+            if (task_count == SYSMON_MAX_THREADS) {
+                continue;
+            }
+            snprintf(path, sizeof(path), SYSMON_TASK_DIR "/%ld/stat", tid);
+            int fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                continue; /* Exited meanwhile */
+            }
+            /* All of its ticks fall after the previous sample */
+            task = &tasks[task_count++];
+            task->tid = (int)tid;
+            task->fd = fd;
+            task->ticks = 0;
+        }
+
+        sysmon_thread_t *out = &stats->threads[stats->thread_count];
+        unsigned long long ticks;
+        if (read_task(task->fd, out->name, sizeof(out->name), &ticks) != 0) {
+            continue; /* Exited meanwhile, closed below */
+        }
+        task->seen = true;
+        out->tid = task->tid;
+        out->cpu_percent = interval_ticks > 0 && ticks >= task->ticks ? (double)(ticks - task->ticks) / interval_ticks * 100.0 : 0.0;
+        task->ticks = ticks;
+        process_percent += out->cpu_percent;
+        stats->thread_count++;
+    }
+
+    /* Forget the threads that exited */
+    int kept = 0;
+    for (int i = 0; i < task_count; ++i) {
+        if (tasks[i].seen) {
+            tasks[kept++] = tasks[i];
         } else {
-            total_diff = current_total_time - prev_total_time;
-            idle_diff = current_total_idle_time - prev_total_idle_time;
-
-            if (total_diff > 0) {
-                busy_diff = total_diff - idle_diff;
-                if (busy_diff > total_diff) busy_diff = total_diff; /* Clamp values */
-
-                cpu_usage = ((double)busy_diff / (double)total_diff) * 100.0;
-                stats->cpu_usage_percent = cpu_usage; /* Store calculated usage */
-            } else {
-                stats->cpu_usage_percent = 0.0; /* No change implies 0% usage */
-                log_message(LOG_LEVEL_DEBUG, "CPU Usage: No difference in total CPU time between samples.");
+            close(tasks[i].fd);
+        }
+    }
+    task_count = kept;
+    stats->process_cpu_percent = process_percent;
+}
+
+/*
+ * @brief Takes one sample and publishes it.
+ */
+static void take_sample(void) {
+    static long ticks_per_sec = 0;
+    struct timespec now;
+    double interval_sec = 0.0;
+
+    if (ticks_per_sec == 0) {
+        ticks_per_sec = sysconf(_SC_CLK_TCK);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (have_prev_sample) {
+        interval_sec = (double)(now.tv_sec - prev_sample_time.tv_sec) + (double)(now.tv_nsec - prev_sample_time.tv_nsec) / 1e9;
+    }
+
+    sample_memory(&next_snapshot);
+    if (sample_cpus(&next_snapshot) != 0) {
+        next_snapshot.cpu_usage_percent = -1.0;
+        next_snapshot.cpu_count = 0;
+    }
+    sample_tasks(&next_snapshot, interval_sec * (double)ticks_per_sec);
+    next_snapshot.interval_sec = interval_sec;
+    prev_sample_time = now;
+    have_prev_sample = true;
+
+    pthread_mutex_lock(&snapshot_mutex);
+    snapshot = next_snapshot;
+    snapshot_valid = true;
+    pthread_mutex_unlock(&snapshot_mutex);
+}
+
+/*
+ * @brief Main function of the sampler thread.
+ */
+void *sysmon_run(void *arg) {
+    (void)arg;
+    struct timespec deadline;
+    int rc;
+
+    pthread_setname_np(pthread_self(), "sysmon");
+    stat_fd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    meminfo_fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    task_dir = opendir(SYSMON_TASK_DIR);
+    if (stat_fd < 0 || meminfo_fd < 0 || task_dir == NULL) {
+        log_message(LOG_LEVEL_ERROR, "System monitor failed to open /proc files: %s", strerror(errno));
+    } else {
+        log_message(LOG_LEVEL_INFO, "System monitor sampling every %d ms.", SYSMON_INTERVAL_MS);
+        pthread_mutex_lock(&stop_mutex);
+        while (!stop_requested) {
+            pthread_mutex_unlock(&stop_mutex);
+            take_sample();
+            pthread_mutex_lock(&stop_mutex);
+
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += SYSMON_INTERVAL_MS / 1000;
+            deadline.tv_nsec += (SYSMON_INTERVAL_MS % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            rc = 0;
+            while (!stop_requested && rc != ETIMEDOUT) {
+                rc = pthread_cond_timedwait(&stop_cond, &stop_mutex, &deadline);
             }
         }
+        pthread_mutex_unlock(&stop_mutex);
+    }
 
-        /* Update previous values for the next call */
-        prev_total_time = current_total_time;
-        prev_total_idle_time = current_total_idle_time;
+    pthread_mutex_lock(&snapshot_mutex);
+    snapshot_valid = false;
+    pthread_mutex_unlock(&snapshot_mutex);
+    for (int i = 0; i < task_count; ++i) {
+        close(tasks[i].fd);
     }
+    task_count = 0;
+    if (task_dir != NULL) closedir(task_dir);
+    if (meminfo_fd >= 0) close(meminfo_fd);
+    if (stat_fd >= 0) close(stat_fd);
+    task_dir = NULL;
+    meminfo_fd = stat_fd = -1;
+    log_message(LOG_LEVEL_INFO, "System monitor stopped.");
+    return NULL;
+}
+
+/*
+ * @brief Signals the sampler thread to stop.
+ */
+void sysmon_stop(void) {
+    pthread_mutex_lock(&stop_mutex);
+    stop_requested = true;
+    pthread_cond_signal(&stop_cond);
+    pthread_mutex_unlock(&stop_mutex);
+}
+
+/*
+ * @brief Copies the latest snapshot of the sampler thread.
+ * @param stats Pointer to a system_stats_t structure to store the statistics.
+ * @return 0 on success, -1 if no snapshot is available.
+ */
+int sysmon_get_stats(system_stats_t *stats) {
+    if (!stats) return -1; /* Return error if the stats pointer is NULL */
 
-    return 0; /* Return success */
-}
\ No newline at end of file
+    pthread_mutex_lock(&snapshot_mutex);
+    bool valid = snapshot_valid;
+    if (valid) {
+        *stats = snapshot;
+    }
+    pthread_mutex_unlock(&snapshot_mutex);
+    return valid ? 0 : -1;
+}
@@ -0,0 +1,278 @@
+/* --- Include Standard Libraries --- */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* --- Include Project-Specific Headers --- */
+#include "uring.h"
+
+/* --- Local Helper Functions --- */
+
+/* The raw system calls, glibc has no wrappers for them */
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief Publishes the queued SQEs to the kernel and enters the ring.
+ * @param ring The ring.
+ * @param min_complete Completions to wait for (only with IORING_ENTER_GETEVENTS).
+ * @param flags IORING_ENTER_* flags.
+ * @param arg Extended argument, or NULL.
+ * @param argsz Size of arg.
+ * @return The io_uring_enter() result, -1 with errno set on failure.
+ */
+static int uring_enter(uring_t *ring, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+    /* Without SQPOLL the kernel head only moves inside io_uring_enter(), so this is the unsubmitted count */
+    unsigned to_submit = ring->sqe_tail - *ring->sq_khead;
+
+    __atomic_store_n(ring->sq_ktail, ring->sqe_tail, __ATOMIC_RELEASE);
+    return sys_io_uring_enter(ring->ring_fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+/* --- Ring Setup --- */
+
+gateway_error_t uring_init(uring_t *ring, unsigned sq_entries, unsigned cq_entries) {
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->ring_fd = -1;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = cq_entries;
+    int fd = sys_io_uring_setup(sq_entries, &params);
+    if (fd < 0 && errno == EINVAL) {
+        /* Kernels before 5.19 lack COOP_TASKRUN, it only saves interrupts */
+        params.flags &= ~IORING_SETUP_COOP_TASKRUN;
+        fd = sys_io_uring_setup(sq_entries, &params);
+    }
+    if (fd < 0) {
+        return CONNMGR_URING_ERR;
+    }
+    ring->ring_fd = fd;
+    ring->features = params.features;
+
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (ring->features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size) {
+            ring->sq_size = ring->cq_size;
+        }
+        ring->cq_size = ring->sq_size;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        goto fail;
+    }
+    if (ring->features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring->cq_ptr = NULL;
+            goto fail;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        goto fail;
+    }
+
+    uint8_t *sq = ring->sq_ptr;
+    uint8_t *cq = ring->cq_ptr;
+    ring->sq_khead = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_ktail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sqe_tail = *ring->sq_ktail;
+    ring->cq_khead = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_ktail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    /* SQE slots are used in order, so the indirection array is the identity */
+    unsigned *array = (unsigned *)(sq + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; ++i) {
+        array[i] = i;
+    }
+    return GATEWAY_SUCCESS;
+
+fail:
+    {
+        int saved_errno = errno;
+        uring_free(ring);
+        errno = saved_errno;
+    }
+    return CONNMGR_URING_ERR;
+}
+
+void uring_free(uring_t *ring) {
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ptr != NULL && ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+    if (ring->sq_ptr != NULL) {
+        munmap(ring->sq_ptr, ring->sq_size);
+    }
+    if (ring->ring_fd != -1) {
+        close(ring->ring_fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->ring_fd = -1;
+}
+
+/* --- Submission and Completion --- */
+
+struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+    unsigned head = __atomic_load_n(ring->sq_khead, __ATOMIC_ACQUIRE);
+
+    if (ring->sqe_tail - head >= ring->sq_entries) {
+        /* Queue full: submit what is queued without waiting */
+        if (uring_enter(ring, 0, 0, NULL, 0) < 0) {
+            return NULL;
+        }
+        head = __atomic_load_n(ring->sq_khead, __ATOMIC_ACQUIRE);
+        if (ring->sqe_tail - head >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+    ring->sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int uring_submit_and_wait(uring_t *ring, int timeout_ms) {
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    void *argp = NULL;
+    size_t argsz = 0;
+
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argsz = sizeof(arg);
+    }
+
+    if (uring_enter(ring, 1, flags, argp, argsz) < 0) {
+        /* A timeout or signal is not an error, EBUSY means completions must be reaped first */
+        if (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN) {
+            return 0;
+        }
+        return -errno;
+    }
+    return 0;
+}
+
+struct io_uring_cqe *uring_peek_cqe(uring_t *ring) {
+    unsigned head = *ring->cq_khead; /* Only this thread moves the head */
+    unsigned tail = __atomic_load_n(ring->cq_ktail, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void uring_cqe_seen(uring_t *ring) {
+    __atomic_store_n(ring->cq_khead, *ring->cq_khead + 1, __ATOMIC_RELEASE);
+}
+
+/* --- Provided Buffer Rings --- */
+
+gateway_error_t uring_buf_ring_init(uring_t *ring, uring_buf_ring_t *bufs, uint16_t bgid, unsigned entries, size_t buf_size) {
+    struct io_uring_buf_reg reg;
+    void *ring_mem = NULL;
+
+    memset(bufs, 0, sizeof(*bufs));
+    /* The kernel pins the descriptor ring, it must be page aligned */
+    if (posix_memalign(&ring_mem, (size_t)sysconf(_SC_PAGESIZE), entries * sizeof(struct io_uring_buf)) != 0) {
+        return GATEWAY_ERROR_NOMEM;
+    }
+    memset(ring_mem, 0, entries * sizeof(struct io_uring_buf));
+    bufs->ring = ring_mem;
+    bufs->base = malloc(entries * buf_size);
+    if (bufs->base == NULL) {
+        free(bufs->ring);
+        bufs->ring = NULL;
+        return GATEWAY_ERROR_NOMEM;
+    }
+    bufs->buf_size = buf_size;
+    bufs->entries = entries;
+    bufs->bgid = bgid;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)bufs->ring;
+    reg.ring_entries = entries;
+    reg.bgid = bgid;
+    if (sys_io_uring_register(ring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int saved_errno = errno;
+        free(bufs->ring);
+        free(bufs->base);
+        memset(bufs, 0, sizeof(*bufs));
+        errno = saved_errno;
+        return CONNMGR_URING_ERR;
+    }
+
+    for (unsigned i = 0; i < entries; ++i) {
+        uring_buf_ring_recycle(bufs, (uint16_t)i);
+    }
+    uring_buf_ring_publish(bufs);
+    return GATEWAY_SUCCESS;
+}
+
+void uring_buf_ring_free(uring_t *ring, uring_buf_ring_t *bufs) {
+    if (bufs->ring == NULL) {
+        return;
+    }
+    if (ring->ring_fd != -1) {
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.bgid = bufs->bgid;
+        sys_io_uring_register(ring->ring_fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    free(bufs->ring);
+    free(bufs->base);
+    memset(bufs, 0, sizeof(*bufs));
+}
+
+uint8_t *uring_buf_ring_buffer(uring_buf_ring_t *bufs, uint16_t bid) {
+    return bufs->base + (size_t)bid * bufs->buf_size;
+}
+
+void uring_buf_ring_recycle(uring_buf_ring_t *bufs, uint16_t bid) {
+    /* Fields are set one by one: the resv field of the first slot overlays the shared tail */
+    struct io_uring_buf *buf = &bufs->ring->bufs[bufs->tail & (bufs->entries - 1)];
+    buf->addr = (uint64_t)(uintptr_t)uring_buf_ring_buffer(bufs, bid);
+    buf->len = (uint32_t)bufs->buf_size;
+    buf->bid = bid;
+    bufs->tail++;
+}
+
+void uring_buf_ring_publish(uring_buf_ring_t *bufs) {
+    __atomic_store_n(&bufs->ring->tail, bufs->tail, __ATOMIC_RELEASE);
+}
@@ -2,12 +2,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <errno.h>
 
-#define SOCKET_PATH "/command/sensor_gateway_cmd.sock" // Must match config.h
+#include "config.h"     /* For CMD_SOCKET_PATH */
+
 #define BUFFER_SIZE 4096
 
 int main(int argc, char *argv[]) {
@@ -15,12 +17,33 @@ int main(int argc, char *argv[]) {
     struct sockaddr_un server_addr;
     char buffer[BUFFER_SIZE];
 
+    char command[256];
+
     /* Check arguments */
-    if (argc != 2 || (strcmp(argv[1], "status") != 0 && strcmp(argv[1], "stats") != 0)) {
-        fprintf(stderr, "Usage: %s <status|stats>\n", argv[0]);
+    bool is_query = (argc == 5 || argc == 6) && strcmp(argv[1], "query") == 0;
+    bool is_loglevel = (argc == 2 || argc == 3) && strcmp(argv[1], "loglevel") == 0;
+    bool is_subscribe = argc >= 2 && strcmp(argv[1], "subscribe") == 0;
+    bool is_set = argc == 4 && strcmp(argv[1], "set") == 0;
+    if (!is_query && !is_loglevel && !is_subscribe && !is_set &&
+        (argc != 2 || (strcmp(argv[1], "status") != 0 && strcmp(argv[1], "stats") != 0 &&
+                       strcmp(argv[1], "buffer") != 0 && strcmp(argv[1], "reload") != 0 &&
+                       strcmp(argv[1], "logstats") != 0 && strcmp(argv[1], "latency") != 0 &&
+                       strcmp(argv[1], "metrics") != 0 && strcmp(argv[1], "memory") != 0 &&
+                       strcmp(argv[1], "config") != 0))) {
+        fprintf(stderr, "Usage: %s <status|stats|buffer|reload|logstats|latency|metrics|memory|config>\n"
+                        "       %s loglevel [fatal|error|warning|info|debug]\n"
+                        "       %s set <setting> <value>\n"
+                        "       %s query <sensor> <from> <to> [raw|summary|minute|hour]\n"
+                        "       %s subscribe [room <id> | <sensor>[,<sensor>...]]   (until Ctrl-C)\n",
+                argv[0], argv[0], argv[0], argv[0], argv[0]);
         return EXIT_FAILURE;
     }
-    const char *command = argv[1];
+    /* The gateway reads the command as one line */
+    snprintf(command, sizeof(command), "%s", argv[1]);
+    for (int i = 2; i < argc; ++i) {
+        size_t len = strlen(command);
+        snprintf(command + len, sizeof(command) - len, " %s", argv[i]);
+    }
 
     /* Create socket */
     sd = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -32,7 +55,7 @@ int main(int argc, char *argv[]) {
     /* Set server address */
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sun_family = AF_UNIX;
-    strncpy(server_addr.sun_path, SOCKET_PATH, sizeof(server_addr.sun_path) - 1);
+    strncpy(server_addr.sun_path, CMD_SOCKET_PATH, sizeof(server_addr.sun_path) - 1);
 
     /* Connect to server */
     if (connect(sd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
@@ -58,6 +81,9 @@ int main(int argc, char *argv[]) {
     while ((bytes_read = read(sd, buffer, sizeof(buffer) - 1)) > 0) {
         buffer[bytes_read] = '\0'; /* Null-terminate */
         printf("%s", buffer);      /* Print response chunk */
+        if (is_subscribe) {
+            fflush(stdout);        /* Live feed, show readings as they come */
+        }
     }
 
     if (bytes_read < 0) {
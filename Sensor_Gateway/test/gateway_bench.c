@@ -0,0 +1,890 @@
+/* gateway_bench.c - Microbenchmarks of the gateway pipeline and an end-to-end load run.
+ * Links the gateway modules (everything but main.c) and prints one JSON object per result,
+ * so runs of two releases can be compared with -b. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <endian.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "config.h"
+#include "sbuffer.h"
+#include "db_handler.h"
+#include "logger.h"
+#include "protocol.h"
+#include "sensor_batch.h"
+
+/* --- Configuration --- */
+#define BENCH_SBUFFER_CAPACITY 1024   /* Slots of the benchmarked shared buffer */
+#define BENCH_SBUFFER_BATCH 64        /* Readings per call in the batched shared buffer runs */
+#define BENCH_SBUFFER_ITEMS 400000    /* Readings inserted per producer */
+#define BENCH_DB_SINGLE_ROWS 2000     /* Rows inserted one transaction each */
+#define BENCH_DB_BATCH_ROWS 200000    /* Rows inserted in batched transactions */
+#define BENCH_LOG_MESSAGES 200000     /* Messages logged per thread */
+#define BENCH_PARSE_READINGS 4000000  /* Readings decoded per protocol */
+#define BENCH_KERNEL_READINGS 100000000 /* Readings run through each data manager batch kernel */
+#define BENCH_KERNEL_BATCHES 64       /* Distinct batches cycled through, so no branch pattern repeats each call */
+#define BENCH_QUICK_DIVISOR 10        /* -q divides every count by this */
+#define BENCH_NAME_MAX 64
+#define BENCH_MAX_RESULTS 128
+#define BENCH_TOLERANCE_PCT 10.0      /* Default regression threshold of -b */
+
+/* End-to-end run: the gateway and sensor_sim --load as separate processes */
+#define BENCH_E2E_PORT 5999
+#define BENCH_E2E_SENSORS 1000
+#define BENCH_E2E_THREADS 2
+#define BENCH_E2E_RATE 20000
+#define BENCH_E2E_SECONDS 10
+#define BENCH_E2E_SOURCE "127.0.1.1"  /* First source address of the simulated sensors */
+#define BENCH_E2E_PER_SOURCE 4        /* Connections per source, below MAX_CONNECTIONS_PER_IP */
+#define BENCH_E2E_STARTUP_MS 5000     /* Time the gateway gets to open its command socket */
+#define BENCH_E2E_DRAIN_MS 2000       /* Time the pipeline gets to commit after the load stops */
+
+/* Referenced by the data manager; main.c defines it in the gateway */
+volatile sig_atomic_t terminate_flag = 0;
+
+typedef struct {
+    char name[BENCH_NAME_MAX];
+    double value;
+    const char *unit;
+    bool higher_is_better;
+} bench_result_t;
+
+static bench_result_t results[BENCH_MAX_RESULTS];
+static int result_count = 0;
+static long scale = 1; /* BENCH_QUICK_DIVISOR with -q */
+
+/* --- Function Prototypes --- */
+static void print_usage(const char *prog_name);
+static double now_sec(void);
+static void report(const char *name, double value, const char *unit, bool higher_is_better);
+static void bench_sbuffer(void);
+static void bench_db(void);
+static int check_db_refused(void);
+static void bench_log(void);
+static void bench_parse(void);
+static void bench_kernels(void);
+static int bench_e2e(const char *gateway_path, const char *sim_path, int port);
+static int compare_baseline(const char *path, double tolerance_pct);
+
+/* --- Main Function --- */
+
+int main(int argc, char *argv[]) {
+    const char *gateway_path = NULL, *sim_path = NULL, *baseline = NULL;
+    double tolerance = BENCH_TOLERANCE_PCT;
+    int port = BENCH_E2E_PORT;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "qg:s:p:b:t:")) != -1) {
+        switch (opt) {
+        case 'q': scale = BENCH_QUICK_DIVISOR; break;
+        case 'g': gateway_path = optarg; break;
+        case 's': sim_path = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'b': baseline = optarg; break;
+        case 't': tolerance = atof(optarg); break;
+        default:
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc || port < 1 || port > 65535 || tolerance <= 0.0 || (gateway_path == NULL) != (sim_path == NULL)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* The modules log through the log process, as in the gateway (files go to the working directory) */
+    if (logger_init() != GATEWAY_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    pid_t log_pid = fork();
+    if (log_pid == -1) {
+        perror("fork() failed");
+        logger_cleanup();
+        return EXIT_FAILURE;
+    } else if (log_pid == 0) {
+        run_log_process();
+        exit(EXIT_FAILURE);
+    }
+    if (logger_open_write_fifo() != GATEWAY_SUCCESS) {
+        kill(log_pid, SIGTERM);
+        waitpid(log_pid, NULL, 0);
+        logger_cleanup();
+        return EXIT_FAILURE;
+    }
+    logger_set_level(LOG_LEVEL_WARNING); /* Only bench_log() measures logging */
+
+    int status = EXIT_SUCCESS;
+    bench_sbuffer();
+    bench_db();
+    if (check_db_refused() < 0) {
+        status = EXIT_FAILURE;
+    }
+    bench_log();
+    bench_parse();
+    bench_kernels();
+    if (gateway_path != NULL && bench_e2e(gateway_path, sim_path, port) < 0) {
+        status = EXIT_FAILURE;
+    }
+
+    logger_cleanup();
+    waitpid(log_pid, NULL, 0);
+
+    if (baseline != NULL && compare_baseline(baseline, tolerance) != 0) {
+        status = EXIT_FAILURE;
+    }
+    return status;
+}
+
+/**
+ * @brief Prints command line usage instructions.
+ * @param prog_name The name of the executable (argv[0]).
+ */
+static void print_usage(const char *prog_name) {
+    fprintf(stderr, "Usage: %s [-q] [-g <sensor_gateway> -s <sensor_sim> [-p port]] [-b baseline.jsonl [-t pct]]\n", prog_name);
+    fprintf(stderr, "  -q : Quick run, every count divided by %d\n", BENCH_QUICK_DIVISOR);
+    fprintf(stderr, "  -g : Gateway executable for the end-to-end run (skipped without -g and -s)\n");
+    fprintf(stderr, "  -s : Simulator executable driving the end-to-end load\n");
+    fprintf(stderr, "  -p : Port of the gateway in the end-to-end run (default %d)\n", BENCH_E2E_PORT);
+    fprintf(stderr, "  -b : Results of an earlier run to compare against; exits with 1 on a regression\n");
+    fprintf(stderr, "  -t : Regression threshold in percent (default %.0f)\n", BENCH_TOLERANCE_PCT);
+    fprintf(stderr, "Results are printed as JSON lines on stdout, progress on stderr.\n");
+}
+
+/**
+ * @brief Returns CLOCK_MONOTONIC in seconds.
+ */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Prints a result as one JSON line and keeps it for compare_baseline().
+ * @param name Unique name of the result, the key runs are compared by.
+ * @param value The measured value.
+ * @param unit Unit of the value.
+ * @param higher_is_better Direction of an improvement.
+ */
+static void report(const char *name, double value, const char *unit, bool higher_is_better) {
+    printf("{\"name\": \"%s\", \"value\": %.6g, \"unit\": \"%s\", \"higher_is_better\": %s}\n",
+           name, value, unit, higher_is_better ? "true" : "false");
+    fflush(stdout);
+    if (result_count < BENCH_MAX_RESULTS) {
+        bench_result_t *result = &results[result_count++];
+        snprintf(result->name, sizeof(result->name), "%s", name);
+        result->value = value;
+        result->unit = unit;
+        result->higher_is_better = higher_is_better;
+    }
+}
+
+/* --- Shared Buffer --- */
+
+typedef struct {
+    sbuffer_t *buffer;
+    int reader_id;      /* Consumers only */
+    long items;         /* Readings to insert (producers) or read (consumers) */
+    int id;
+    bool batched;
+} sbuffer_job_t;
+
+/**
+ * @brief Inserts job->items readings, one by one or in batches.
+ */
+static void *sbuffer_producer(void *arg) {
+    sbuffer_job_t *job = (sbuffer_job_t *)arg;
+    sensor_data_t batch[BENCH_SBUFFER_BATCH];
+
+    for (int i = 0; i < BENCH_SBUFFER_BATCH; ++i) {
+        batch[i] = (sensor_data_t){ .id = (sensor_id_t)(job->id + 1), .value = 20.0 + i, .ts = (sensor_ts_t)time(NULL) };
+    }
+    for (long done = 0; done < job->items;) {
+        long n = job->batched ? job->items - done : 1;
+        if (n > BENCH_SBUFFER_BATCH) {
+            n = BENCH_SBUFFER_BATCH;
+        }
+        gateway_error_t ret = job->batched ? sbuffer_insert_batch(job->buffer, batch, (size_t)n)
+                                           : sbuffer_insert(job->buffer, &batch[0]);
+        if (ret != GATEWAY_SUCCESS) {
+            fprintf(stderr, "bench: sbuffer insert failed (%d)\n", ret);
+            break;
+        }
+        done += n;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Reads job->items readings with its own cursor, one by one or in batches.
+ */
+static void *sbuffer_consumer(void *arg) {
+    sbuffer_job_t *job = (sbuffer_job_t *)arg;
+    sensor_data_t batch[BENCH_SBUFFER_BATCH];
+
+    for (long done = 0; done < job->items;) {
+        size_t n = 1;
+        gateway_error_t ret = job->batched ? sbuffer_remove_batch(job->buffer, job->reader_id, batch, BENCH_SBUFFER_BATCH, &n)
+                                           : sbuffer_remove(job->buffer, job->reader_id, &batch[0]);
+        if (ret != GATEWAY_SUCCESS) {
+            fprintf(stderr, "bench: sbuffer remove failed (%d)\n", ret);
+            break;
+        }
+        done += (long)n;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs producers x consumers over one shared buffer. Every consumer is a reader
+ *        of its own, so each reads every reading, as the data and storage managers do.
+ * @return Readings inserted per second.
+ */
+static double sbuffer_run(int producers, int consumers, bool batched) {
+    sbuffer_t *buffer = NULL;
+    pthread_t threads[SBUFFER_MAX_READERS * 2];
+    sbuffer_job_t jobs[SBUFFER_MAX_READERS * 2];
+    long per_producer = BENCH_SBUFFER_ITEMS / scale;
+    int started = 0;
+
+    if (sbuffer_init(&buffer, BENCH_SBUFFER_CAPACITY, 0) != GATEWAY_SUCCESS) {
+        return 0.0;
+    }
+    /* Readers register before any insert, or they would miss the first readings */
+    for (int i = 0; i < consumers; ++i) {
+        jobs[i] = (sbuffer_job_t){ .buffer = buffer, .items = per_producer * producers, .id = i, .batched = batched };
+        if (sbuffer_register_reader(buffer, &jobs[i].reader_id) != GATEWAY_SUCCESS) {
+            sbuffer_free(&buffer);
+            return 0.0;
+        }
+    }
+    double start = now_sec();
+    for (int i = 0; i < consumers + producers; ++i) {
+        if (i >= consumers) {
+            jobs[i] = (sbuffer_job_t){ .buffer = buffer, .items = per_producer, .id = i - consumers, .batched = batched };
+        }
+        if (pthread_create(&threads[i], NULL, i < consumers ? sbuffer_consumer : sbuffer_producer, &jobs[i]) != 0) {
+            sbuffer_signal_shutdown(buffer);
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = now_sec() - start;
+    sbuffer_free(&buffer);
+    return started == consumers + producers ? (double)(per_producer * producers) / elapsed : 0.0;
+}
+
+/**
+ * @brief sbuffer_insert/sbuffer_remove and their batch variants under 1..4 producers and consumers.
+ */
+static void bench_sbuffer(void) {
+    static const int counts[] = { 1, 2, 4 };
+    char name[BENCH_NAME_MAX];
+
+    fprintf(stderr, "bench: shared buffer\n");
+    for (int batched = 0; batched <= 1; ++batched) {
+        for (size_t p = 0; p < sizeof(counts) / sizeof(counts[0]); ++p) {
+            for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]) && counts[c] <= SBUFFER_MAX_READERS; ++c) {
+                snprintf(name, sizeof(name), "sbuffer/%s/p%d_c%d", batched ? "batch" : "single", counts[p], counts[c]);
+                report(name, sbuffer_run(counts[p], counts[c], batched), "readings/s", true);
+            }
+        }
+    }
+}
+
+/* --- Database --- */
+
+/**
+ * @brief Removes a database file and its WAL and shared memory files.
+ */
+static void remove_db(const char *path) {
+    char name[256];
+    unlink(path);
+    snprintf(name, sizeof(name), "%s-wal", path);
+    unlink(name);
+    snprintf(name, sizeof(name), "%s-shm", path);
+    unlink(name);
+}
+
+/**
+ * @brief Inserts rows into a fresh database, batch rows per transaction (0 = autocommit).
+ * @return Rows inserted per second, 0 on error.
+ */
+static double db_run(long rows, int batch) {
+    const char *path = "bench.db";
+    db_handle_t *db = NULL;
+    sensor_ts_t now = (sensor_ts_t)time(NULL);
+    bool ok = true;
+
+    remove_db(path);
+    if (db_connect(path, &db) != GATEWAY_SUCCESS) {
+        return 0.0;
+    }
+    double start = now_sec();
+    for (long i = 0; i < rows && ok;) {
+        long n = batch > 0 ? batch : 1;
+        if (batch > 0) {
+            ok = db_begin(db) == GATEWAY_SUCCESS;
+        }
+        for (long j = 0; j < n && i < rows && ok; ++j, ++i) {
+            sensor_data_t data = { .id = (sensor_id_t)(i % 1000 + 1), .value = 20.0 + (double)(i % 10), .ts = now + i / 1000 };
+            ok = db_insert_sensor_data(db, &data) == GATEWAY_SUCCESS;
+        }
+        if (batch > 0 && ok) {
+            ok = db_commit(db) == GATEWAY_SUCCESS;
+        }
+    }
+    double elapsed = now_sec() - start;
+    db_disconnect(db);
+    remove_db(path);
+    return ok ? (double)rows / elapsed : 0.0;
+}
+
+/**
+ * @brief db_insert_sensor_data in its own transaction per row versus batched transactions.
+ */
+static void bench_db(void) {
+    static const int batches[] = { 16, 256, 1024 };
+    char name[BENCH_NAME_MAX];
+
+    fprintf(stderr, "bench: database inserts\n");
+    report("db/insert/single", db_run(BENCH_DB_SINGLE_ROWS / scale, 0), "rows/s", true);
+    for (size_t i = 0; i < sizeof(batches) / sizeof(batches[0]); ++i) {
+        snprintf(name, sizeof(name), "db/insert/batch%d", batches[i]);
+        report(name, db_run(BENCH_DB_BATCH_ROWS / scale, batches[i]), "rows/s", true);
+    }
+}
+
+/**
+ * @brief Counts the partition tables of a database.
+ * @return The count, -1 on error.
+ */
+static int db_partition_count(db_handle_t *db) {
+    sqlite3_stmt *stmt = NULL;
+    int count = -1;
+
+    if (sqlite3_prepare_v2(db->conn, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name GLOB '"
+                           DB_TABLE_NAME "_p*';", -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        count = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+/**
+ * @brief Returns whether the DB_TABLE_NAME view reads from the named table.
+ */
+static bool db_view_has(db_handle_t *db, const char *table) {
+    sqlite3_stmt *stmt = NULL;
+    bool found = false;
+
+    if (sqlite3_prepare_v2(db->conn, "SELECT sql FROM sqlite_master WHERE type = 'view' AND name = '" DB_TABLE_NAME "';",
+                           -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *sql = (const char *)sqlite3_column_text(stmt, 0);
+        found = sql != NULL && strstr(sql, table) != NULL;
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+/**
+ * @brief Checks that readings outside the partitions kept are refused with DB_OUT_OF_RANGE before
+ * any table is created: one of a partition retention already dropped (DB_RETENTION_PARTITIONS > 0)
+ * and one stamped more than DB_MAX_FUTURE_SEC ahead. The transaction must still commit the readings
+ * after them, and a future partition left by an older release must stay out of the view.
+ * Only runs in partitioned builds.
+ * @return 0 on success (or when not applicable), -1 on failure.
+ */
+static int check_db_refused(void) {
+    const char *path = "check.db";
+    const char *future_table = DB_TABLE_NAME "_p2999010100";
+    db_handle_t *db = NULL;
+    sensor_ts_t now = (sensor_ts_t)time(NULL);
+    sensor_ts_t period = (sensor_ts_t)DB_PARTITION_HOURS * 3600;
+    sensor_data_t refused[2];
+    size_t refused_count = 0;
+    sensor_data_t current = { .id = 1, .value = 21.0, .ts = now };
+    char sql[256];
+    gateway_error_t ret = GATEWAY_SUCCESS;
+    int status = -1, partitions;
+
+    if (DB_PARTITION_HOURS <= 0) {
+        return 0;
+    }
+    if (DB_RETENTION_PARTITIONS > 0) {
+        refused[refused_count++] = (sensor_data_t){ .id = 1, .value = 20.0, .ts = now - (DB_RETENTION_PARTITIONS + 1) * period };
+    }
+    refused[refused_count++] = (sensor_data_t){ .id = 1, .value = 22.0, .ts = now + DB_MAX_FUTURE_SEC + 2 * period };
+
+    fprintf(stderr, "check: readings outside the partitions kept\n");
+    remove_db(path);
+    if (db_connect(path, &db) != GATEWAY_SUCCESS) {
+        fprintf(stderr, "check: cannot open %s\n", path);
+        return -1;
+    }
+    partitions = db_partition_count(db); /* db_connect() creates the current one */
+    if (partitions < 0 || db_begin(db) != GATEWAY_SUCCESS) {
+        fprintf(stderr, "check: BEGIN failed\n");
+        goto out;
+    }
+    for (size_t i = 0; i < refused_count; ++i) {
+        if ((ret = db_insert_sensor_data(db, &refused[i])) != DB_OUT_OF_RANGE) {
+            fprintf(stderr, "check: reading at %ld returned %d instead of DB_OUT_OF_RANGE\n", (long)refused[i].ts, ret);
+            goto out;
+        }
+        if (db_partition_count(db) != partitions) {
+            fprintf(stderr, "check: the reading at %ld created a partition\n", (long)refused[i].ts);
+            goto out;
+        }
+    }
+    if (db_insert_sensor_data(db, &current) != GATEWAY_SUCCESS || db_commit(db) != GATEWAY_SUCCESS) {
+        fprintf(stderr, "check: current reading not committed after the refused ones\n");
+        goto out;
+    }
+
+    /* A future partition from before readings were refused: the view is rebuilt on connect */
+    snprintf(sql, sizeof(sql), "CREATE TABLE %s (RecordID INTEGER PRIMARY KEY, SensorID INTEGER, Timestamp INTEGER, Value REAL);",
+             future_table);
+    if (sqlite3_exec(db->conn, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "check: cannot create %s\n", future_table);
+        goto out;
+    }
+    db_disconnect(db);
+    db = NULL;
+    if (db_connect(path, &db) != GATEWAY_SUCCESS) {
+        fprintf(stderr, "check: cannot reopen %s\n", path);
+        goto out;
+    }
+    if (db_view_has(db, future_table)) {
+        fprintf(stderr, "check: view %s reads from the future partition %s\n", DB_TABLE_NAME, future_table);
+        goto out;
+    }
+    status = 0;
+out:
+    db_rollback(db);
+    db_disconnect(db);
+    remove_db(path);
+    return status;
+}
+
+/* --- Logger --- */
+
+/**
+ * @brief Logs BENCH_LOG_MESSAGES formatted messages.
+ */
+static void *log_worker(void *arg) {
+    int id = (int)(intptr_t)arg;
+    long messages = BENCH_LOG_MESSAGES / scale;
+    for (long i = 0; i < messages; ++i) {
+        log_message(LOG_LEVEL_INFO, "bench thread %d message %ld value %.2f", id, i, 20.0 + (double)(i % 100) / 10.0);
+    }
+    return NULL;
+}
+
+/**
+ * @brief log_message throughput of 1..4 threads, and the messages lost on the way.
+ */
+static void bench_log(void) {
+    static const int counts[] = { 1, 2, 4 };
+    char name[BENCH_NAME_MAX];
+
+    fprintf(stderr, "bench: log_message\n");
+    logger_set_level(LOG_LEVEL_INFO);
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        pthread_t threads[4];
+        logger_stats_t before, after;
+        int started = 0;
+
+        logger_get_stats(&before);
+        double start = now_sec();
+        for (int i = 0; i < counts[c]; ++i) {
+            if (pthread_create(&threads[i], NULL, log_worker, (void *)(intptr_t)i) != 0) {
+                break;
+            }
+            started++;
+        }
+        for (int i = 0; i < started; ++i) {
+            pthread_join(threads[i], NULL);
+        }
+        double elapsed = now_sec() - start;
+        logger_get_stats(&after);
+
+        long total = BENCH_LOG_MESSAGES / scale * started;
+        unsigned long dropped = after.dropped[LOG_LEVEL_INFO] - before.dropped[LOG_LEVEL_INFO];
+        snprintf(name, sizeof(name), "log/message/t%d", counts[c]);
+        report(name, (double)total / elapsed, "messages/s", true);
+        snprintf(name, sizeof(name), "log/dropped_pct/t%d", counts[c]);
+        report(name, total > 0 ? 100.0 * (double)dropped / (double)total : 0.0, "%", false);
+        sleep(1); /* Let the flusher and the log process catch up before the next run */
+    }
+    logger_set_level(LOG_LEVEL_WARNING);
+}
+
+/* --- Frame Parsing --- */
+
+/**
+ * @brief Fills a stream with frames: legacy frames, or v2 frames of records readings (packed
+ *        frames with varying values, as a forwarding gateway sends them, if packed).
+ * @return The bytes written, a whole number of frames.
+ */
+static size_t build_stream(uint8_t *stream, size_t size, int records, bool packed) {
+    size_t len = 0;
+    double value = 21.5;
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    if (packed) {
+        sensor_data_t readings[PROTOCOL_V2_MAX_RECORDS];
+        for (int i = 0; i < records; ++i) {
+            readings[i].id = (sensor_id_t)(i + 1);
+            readings[i].ts = (sensor_ts_t)time(NULL);
+            readings[i].value = value + (i % 7) * 0.25;
+        }
+        while (len + PROTOCOL_V2_PACKED_MAX_SIZE <= size) {
+            len += protocol_encode_packed(readings, (size_t)records, stream + len);
+        }
+        return len;
+    }
+
+    if (records == 0) {
+        for (uint16_t id = 1; len + PROTOCOL_LEGACY_FRAME_SIZE <= size; ++id) {
+            uint16_t be_id = htobe16((uint16_t)(id % 1000 + 1));
+            memcpy(stream + len, &be_id, sizeof(be_id));
+            memcpy(stream + len + sizeof(be_id), &value, sizeof(value));
+            len += PROTOCOL_LEGACY_FRAME_SIZE;
+        }
+        return len;
+    }
+    size_t frame_size = PROTOCOL_V2_HEADER_SIZE + (size_t)records * PROTOCOL_V2_RECORD_SIZE;
+    uint16_t count = htobe16((uint16_t)records);
+    uint64_t ts = htobe64((uint64_t)time(NULL));
+    uint64_t be_bits = htobe64(bits);
+    while (len + frame_size <= size) {
+        stream[len] = PROTOCOL_V2_MAGIC;
+        stream[len + 1] = PROTOCOL_V2_VERSION;
+        memcpy(stream + len + 2, &count, sizeof(count));
+        uint8_t *record = stream + len + PROTOCOL_V2_HEADER_SIZE;
+        for (int i = 0; i < records; ++i, record += PROTOCOL_V2_RECORD_SIZE) {
+            uint16_t be_id = htobe16((uint16_t)(i + 1));
+            memcpy(record, &be_id, sizeof(be_id));
+            memcpy(record + sizeof(be_id), &ts, sizeof(ts));
+            memcpy(record + sizeof(be_id) + sizeof(ts), &be_bits, sizeof(be_bits));
+        }
+        len += frame_size;
+    }
+    return len;
+}
+
+/**
+ * @brief Decodes a stream the way handle_client_data() does: reads of CONMGT_RX_BUFFER_SIZE
+ *        bytes, the partial frame left by a read copied in front of the next one.
+ * @return Readings decoded per second.
+ */
+static double parse_run(int records, bool packed) {
+    /* Reads end mid-frame: the stream is not a multiple of the read size */
+    size_t stream_size = CONMGT_RX_BUFFER_SIZE * 64 + 7;
+    uint8_t *stream = malloc(stream_size);
+    uint8_t rx[CONMGT_RX_BUFFER_SIZE];
+    size_t readings_capacity = CONMGT_RX_BUFFER_SIZE / PROTOCOL_MIN_READING_SIZE + 1;
+    sensor_data_t *readings = malloc(readings_capacity * sizeof(*readings));
+    long target = BENCH_PARSE_READINGS / scale, decoded_total = 0;
+
+    if (stream == NULL || readings == NULL) {
+        free(stream);
+        free(readings);
+        return 0.0;
+    }
+    size_t stream_len = build_stream(stream, stream_size, records, packed);
+
+    double start = now_sec();
+    while (decoded_total < target) {
+        protocol_stream_t state = { 0 };
+        size_t offset = 0, partial = 0;
+        while (offset < stream_len) {
+            size_t room = CONMGT_RX_BUFFER_SIZE - partial;
+            size_t n = stream_len - offset < room ? stream_len - offset : room;
+            memcpy(rx + partial, stream + offset, n);
+            offset += n;
+
+            size_t consumed = 0, decoded = 0;
+            if (protocol_decode(&state, rx, partial + n, (sensor_ts_t)time(NULL), readings, readings_capacity,
+                                &consumed, &decoded) != GATEWAY_SUCCESS) {
+                fprintf(stderr, "bench: protocol_decode failed\n");
+                free(stream);
+                free(readings);
+                return 0.0;
+            }
+            decoded_total += (long)decoded;
+            partial = partial + n - consumed;
+            memmove(rx, rx + consumed, partial);
+        }
+    }
+    double elapsed = now_sec() - start;
+    free(stream);
+    free(readings);
+    return (double)decoded_total / elapsed;
+}
+
+/**
+ * @brief protocol_decode over legacy frames, v2 frames of 1 and 64 readings and packed frames of 64.
+ */
+static void bench_parse(void) {
+    fprintf(stderr, "bench: frame parsing\n");
+    report("parse/legacy", parse_run(0, false), "readings/s", true);
+    report("parse/v2_1", parse_run(1, false), "readings/s", true);
+    report("parse/v2_64", parse_run(PROTOCOL_V2_MAX_RECORDS, false), "readings/s", true);
+    report("parse/packed_64", parse_run(PROTOCOL_V2_MAX_RECORDS, true), "readings/s", true);
+}
+
+/* --- Data Manager Kernels --- */
+
+/**
+ * @brief The threshold, deviation and rollup clock kernels over full batches, with whichever
+ *        of the AVX2, NEON or scalar versions this build and CPU use (compare SENSOR_BATCH_SIMD
+ *        builds with -b).
+ */
+static void bench_kernels(void) {
+    sensor_batch_t *batches = malloc(BENCH_KERNEL_BATCHES * sizeof(*batches));
+    long calls = BENCH_KERNEL_READINGS / scale / SENSOR_BATCH_CAPACITY;
+    double lows[SENSOR_BATCH_CAPACITY], highs[SENSOR_BATCH_CAPACITY], limits[SENSOR_BATCH_CAPACITY];
+    uint64_t flagged = 0;
+    sensor_ts_t clock = 0;
+
+    if (batches == NULL) {
+        return;
+    }
+    for (int i = 0; i < SENSOR_BATCH_CAPACITY; ++i) {
+        lows[i] = TEMP_TOO_COLD_THRESHOLD + (i % 3) * 0.5; /* As if sensors had different rules */
+        highs[i] = TEMP_TOO_HOT_THRESHOLD - (i % 3) * 0.5;
+        limits[i] = 2.0 + (i % 4);
+    }
+    fprintf(stderr, "bench: data manager kernels (%s)\n", sensor_batch_kernels());
+    srand(1);
+    for (int b = 0; b < BENCH_KERNEL_BATCHES; ++b) {
+        batches[b].count = SENSOR_BATCH_CAPACITY;
+        for (int i = 0; i < SENSOR_BATCH_CAPACITY; ++i) {
+            batches[b].ids[i] = (sensor_id_t)(1 + rand() % 1000);
+            batches[b].values[i] = 10.0 + (rand() % 2300) / 100.0; /* Mostly between the thresholds */
+            batches[b].ts[i] = (sensor_ts_t)(1700000000 + rand() % 3600);
+        }
+    }
+
+    double start = now_sec();
+    for (long c = 0; c < calls; ++c) {
+        uint64_t below, above;
+        const sensor_batch_t *batch = &batches[c % BENCH_KERNEL_BATCHES];
+        sensor_batch_classify(batch->values, lows, highs, batch->count, &below, &above);
+        flagged += below ^ above;
+    }
+    report("kernel/classify", (double)calls * SENSOR_BATCH_CAPACITY / (now_sec() - start), "readings/s", true);
+
+    start = now_sec();
+    for (long c = 0; c < calls; ++c) {
+        const sensor_batch_t *batch = &batches[c % BENCH_KERNEL_BATCHES];
+        const sensor_batch_t *previous = &batches[(c + 1) % BENCH_KERNEL_BATCHES];
+        flagged += sensor_batch_deviates(batch->values, previous->values, limits, batch->count);
+    }
+    report("kernel/deviates", (double)calls * SENSOR_BATCH_CAPACITY / (now_sec() - start), "readings/s", true);
+
+    start = now_sec();
+    for (long c = 0; c < calls; ++c) {
+        const sensor_batch_t *batch = &batches[c % BENCH_KERNEL_BATCHES];
+        clock = sensor_batch_max_ts(batch->ts, batch->count, clock - 1);
+    }
+    report("kernel/max_ts", (double)calls * SENSOR_BATCH_CAPACITY / (now_sec() - start), "readings/s", true);
+
+    if (flagged == 1 && clock == 0) {
+        fprintf(stderr, "bench: unlikely kernel result\n"); /* Keeps the results alive */
+    }
+    free(batches);
+}
+
+/* --- End-to-end --- */
+
+/**
+ * @brief Sends one command to the gateway's command interface and reads the whole reply.
+ * @return 0 on success, -1 if the gateway could not be reached.
+ */
+static int gateway_command(const char *command, char *reply, size_t size) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int sd = socket(AF_UNIX, SOCK_STREAM, 0);
+    size_t len = 0;
+
+    if (sd < 0) {
+        return -1;
+    }
+    strncpy(addr.sun_path, CMD_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    if (connect(sd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || write(sd, command, strlen(command)) < 0) {
+        close(sd);
+        return -1;
+    }
+    shutdown(sd, SHUT_WR);
+    ssize_t n;
+    while (len + 1 < size && (n = read(sd, reply + len, size - len - 1)) > 0) {
+        len += (size_t)n;
+    }
+    reply[len] = '\0';
+    close(sd);
+    return 0;
+}
+
+/**
+ * @brief Reads the row of one stage from the reply of the 'latency' command.
+ * @return 0 if found, -1 otherwise.
+ */
+static int parse_latency(const char *reply, const char *stage, unsigned long long values[4]) {
+    char key[32];
+    snprintf(key, sizeof(key), "\n%s ", stage);
+    const char *row = strstr(reply, key);
+    if (row == NULL || sscanf(row + 1, "%*s %llu %llu %llu %llu", &values[0], &values[1], &values[2], &values[3]) != 4) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Starts the gateway in the e2e directory, drives it with sensor_sim --load and
+ *        reports the achieved send rate, the committed rate and the commit latency.
+ * @return 0 on success, -1 if the run could not be carried out.
+ */
+static int bench_e2e(const char *gateway_path, const char *sim_path, int port) {
+    char port_text[16], command[512], line[512], reply[4096];
+    unsigned long long before[4] = { 0 }, after[4] = { 0 };
+    double sim_rate = 0.0;
+
+    fprintf(stderr, "bench: end-to-end (%d sensors, %d readings/s for %d s)\n",
+            BENCH_E2E_SENSORS, BENCH_E2E_RATE / (int)scale, BENCH_E2E_SECONDS);
+    if (mkdir("e2e", 0755) < 0 && errno != EEXIST) {
+        perror("bench: mkdir e2e");
+        return -1;
+    }
+    remove_db("e2e/" DB_NAME);
+    snprintf(port_text, sizeof(port_text), "%d", port);
+
+    pid_t gateway = fork();
+    if (gateway < 0) {
+        perror("bench: fork");
+        return -1;
+    }
+    if (gateway == 0) {
+        if (chdir("e2e") < 0 || freopen("gateway.out", "w", stdout) == NULL || dup2(fileno(stdout), STDERR_FILENO) < 0) {
+            _exit(127);
+        }
+        execl(gateway_path, gateway_path, port_text, (char *)NULL);
+        _exit(127);
+    }
+
+    int result = -1;
+    double deadline = now_sec() + BENCH_E2E_STARTUP_MS / 1000.0;
+    while (gateway_command("latency", reply, sizeof(reply)) < 0) {
+        if (now_sec() > deadline || waitpid(gateway, NULL, WNOHANG) == gateway) {
+            fprintf(stderr, "bench: gateway did not start, see e2e/gateway.out\n");
+            goto stop;
+        }
+        usleep(50000);
+    }
+    parse_latency(reply, "committed", before);
+
+    snprintf(command, sizeof(command), "'%s' --load -n %d -t %d -r %d -s %s -p %d -d %d 127.0.0.1 %d",
+             sim_path, BENCH_E2E_SENSORS, BENCH_E2E_THREADS, BENCH_E2E_RATE / (int)scale, BENCH_E2E_SOURCE,
+             BENCH_E2E_PER_SOURCE, BENCH_E2E_SECONDS, port);
+    FILE *sim = popen(command, "r");
+    if (sim == NULL) {
+        perror("bench: popen sensor_sim");
+        goto stop;
+    }
+    double start = now_sec();
+    while (fgets(line, sizeof(line), sim) != NULL) {
+        const char *summary = strstr(line, " readings/s, ");
+        if (strncmp(line, "INFO: Sent ", 11) == 0 && summary != NULL) {
+            /* "INFO: Sent N readings (B bytes) in S s: R readings/s, ..." */
+            const char *rate = summary;
+            while (rate > line && rate[-1] != ' ') {
+                rate--;
+            }
+            sim_rate = atof(rate);
+        }
+    }
+    double seconds = now_sec() - start;
+    if (pclose(sim) != 0 || sim_rate <= 0.0) {
+        fprintf(stderr, "bench: sensor_sim --load failed\n");
+        goto stop;
+    }
+    usleep(BENCH_E2E_DRAIN_MS * 1000);
+    if (gateway_command("latency", reply, sizeof(reply)) < 0 || parse_latency(reply, "committed", after) < 0) {
+        fprintf(stderr, "bench: no latency reply from the gateway\n");
+        goto stop;
+    }
+
+    unsigned long long committed = after[0] - before[0];
+    report("e2e/sent", sim_rate, "readings/s", true);
+    report("e2e/committed", (double)committed / seconds, "readings/s", true);
+    report("e2e/committed_pct", 100.0 * (double)committed / (sim_rate * seconds), "%", true);
+    /* Quantiles cover the gateway's lifetime, which is this run */
+    report("e2e/commit_latency_p50", (double)after[1], "us", false);
+    report("e2e/commit_latency_p99", (double)after[2], "us", false);
+    report("e2e/commit_latency_p999", (double)after[3], "us", false);
+    result = 0;
+
+stop:
+    kill(gateway, SIGTERM);
+    waitpid(gateway, NULL, 0);
+    return result;
+}
+
+/* --- Baseline Comparison --- */
+
+/**
+ * @brief Compares the results of this run with an earlier one and lists the changes.
+ * @param path JSON lines written by an earlier run.
+ * @param tolerance_pct A result worse by more than this is a regression.
+ * @return 0 if nothing regressed, 1 if something did, -1 if the baseline could not be read.
+ */
+static int compare_baseline(const char *path, double tolerance_pct) {
+    FILE *file = fopen(path, "r");
+    char line[256], name[BENCH_NAME_MAX];
+    double value;
+    int regressions = 0, compared = 0;
+
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    fprintf(stderr, "%-32s %14s %14s %9s\n", "benchmark", "baseline", "now", "change");
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "{\"name\": \"%63[^\"]\", \"value\": %lf", name, &value) != 2) {
+            continue;
+        }
+        for (int i = 0; i < result_count; ++i) {
+            if (strcmp(results[i].name, name) != 0) {
+                continue;
+            }
+            double change = value != 0.0 ? 100.0 * (results[i].value - value) / value : 0.0;
+            double loss = results[i].higher_is_better ? -change : change;
+            bool regressed = loss > tolerance_pct;
+            fprintf(stderr, "%-32s %14.6g %14.6g %+8.1f%%%s\n", name, value, results[i].value, change,
+                    regressed ? "  REGRESSION" : "");
+            regressions += regressed;
+            compared++;
+            break;
+        }
+    }
+    fclose(file);
+    fprintf(stderr, "bench: %d results compared, %d regressed by more than %.0f%%\n", compared, regressions, tolerance_pct);
+    return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+/* log_decode.c - Prints a binary log stored by the log process (LOG_BINARY_STORE) as text */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "config.h"     /* For LOG_BINARY_FILE_NAME */
+#include "log_record.h"
+
+#define READ_BUFFER_SIZE (64 * 1024)
+
+int main(int argc, char *argv[]) {
+    const char *path = (argc > 1) ? argv[1] : LOG_BINARY_FILE_NAME;
+    static uint8_t buffer[READ_BUFFER_SIZE];
+    char line[LOG_RECORD_MAX_SIZE + 64];
+    size_t length = 0;
+    unsigned long sequence_number = 1;
+    log_dict_t dict;
+
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "-h") == 0)) {
+        fprintf(stderr, "Usage: %s [binary log, default %s]\n", argv[0], LOG_BINARY_FILE_NAME);
+        return EXIT_FAILURE;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    char magic[sizeof(LOG_RECORD_FILE_MAGIC) - 1];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, LOG_RECORD_FILE_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "%s: not a binary gateway log\n", path);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    /* Formats are learned as their records are met; a later run of the gateway redefines its IDs */
+    log_dict_init(&dict);
+    for (;;) {
+        size_t bytes_read = fread(buffer + length, 1, sizeof(buffer) - length, file);
+        length += bytes_read;
+
+        size_t pos = 0;
+        log_record_header_t header;
+        int status;
+        while ((status = log_record_peek(buffer + pos, length - pos, &header)) == 1) {
+            if (header.type == LOG_RECORD_FORMAT) {
+                if (log_dict_add(&dict, buffer + pos, &header) != GATEWAY_SUCCESS) {
+                    fprintf(stderr, "Out of memory\n");
+                    return EXIT_FAILURE;
+                }
+            } else {
+                log_record_render(buffer + pos, &header, &dict, line, sizeof(line));
+                printf("%lu %s\n", sequence_number++, line);
+            }
+            pos += header.size;
+        }
+        if (status < 0) {
+            fprintf(stderr, "%s: corrupt record, stopping\n", path);
+            break;
+        }
+        length -= pos;
+        memmove(buffer, buffer + pos, length);
+        if (bytes_read == 0) {
+            if (length > 0) {
+                fprintf(stderr, "%s: %zu bytes of a partial record at the end\n", path, length);
+            }
+            break;
+        }
+    }
+
+    log_dict_free(&dict);
+    fclose(file);
+    return EXIT_SUCCESS;
+}
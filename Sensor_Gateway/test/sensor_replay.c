@@ -0,0 +1,560 @@
+/* sensor_replay.c - Feeds a capture file (sensor_gateway -c) back at its recorded pace, N times
+ * faster or as fast as possible: to a gateway over TCP or UDP, or straight into a shared buffer
+ * read by an in-process data manager and storage manager, to benchmark those on their own. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <endian.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include "common.h"
+#include "config.h"
+#include "capture.h"
+#include "protocol.h"
+#include "sbuffer.h"
+#include "logger.h"
+#include "metrics.h"
+#include "datamgt.h"
+#include "storagemgt.h"
+
+/* --- Configuration --- */
+#define REPLAY_MAX_BLOCK PROTOCOL_V2_MAX_RECORDS /* Readings sent (or inserted) together at most */
+#define REPLAY_STREAMS 65536                     /* Capture stream tags are 16 bit */
+#define REPLAY_REPORT_SEC 1                      /* Interval of the progress lines */
+#define REPLAY_DRAIN_IDLE_MS 5000                /* Buffer mode: give up waiting for commits after this long without one */
+
+typedef enum {
+    REPLAY_TCP = 0,
+    REPLAY_UDP,
+    REPLAY_BUFFER
+} replay_mode_t;
+
+/* Referenced by the data manager; main.c defines it in the gateway */
+volatile sig_atomic_t terminate_flag = 0;
+
+static volatile sig_atomic_t interrupted = 0;
+
+/* Options */
+static replay_mode_t mode = REPLAY_TCP;
+static int protocol_version = 1;
+static struct sockaddr_in target;
+static struct in_addr source = { .s_addr = INADDR_ANY };
+static long per_source = 5;
+
+/* TCP mode: one connection per captured stream, opened when the stream first sends */
+static int *stream_fds = NULL;
+static unsigned long connections_opened = 0;
+static int udp_sd = -1;
+static unsigned long send_errors = 0;
+
+/* Buffer mode */
+static sbuffer_t *buffer = NULL;
+
+/* --- Function Prototypes --- */
+static void print_usage(const char *prog_name);
+static int parse_target(const char *text, struct sockaddr_in *addr);
+static int send_block(const capture_record_t *block, size_t count);
+static int start_pipeline(const char *map_file, long workers, long buffer_size);
+static void stop_pipeline(unsigned long long injected);
+
+/**
+ * @brief Stops the replay on SIGINT/SIGTERM; what was fed is still processed.
+ */
+static void on_signal(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+/**
+ * @brief Returns the clock in microseconds.
+ */
+static uint64_t clock_us(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}
+
+/* --- Main Function --- */
+
+int main(int argc, char *argv[]) {
+    double speed = 1.0;
+    bool keep_timestamps = false;
+    const char *map_file = MAP_FILE_NAME;
+    long workers = DATAMGT_WORKERS, buffer_size = SBUFFER_SIZE;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:v:t:u:ba:p:km:w:B:")) != -1) {
+        char *end;
+        switch (opt) {
+        case 's':
+            errno = 0;
+            speed = strtod(optarg, &end);
+            if (errno != 0 || end == optarg || *end != '\0' || speed < 0.0) {
+                fprintf(stderr, "Error: Invalid speed '%s'.\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'v':
+            protocol_version = atoi(optarg);
+            if (protocol_version != 1 && protocol_version != 2) {
+                fprintf(stderr, "Error: Protocol must be 1 or 2.\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 't':
+        case 'u':
+            mode = opt == 't' ? REPLAY_TCP : REPLAY_UDP;
+            if (parse_target(optarg, &target) < 0) {
+                fprintf(stderr, "Error: Invalid target '%s', expected <host>:<port>.\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b': mode = REPLAY_BUFFER; break;
+        case 'a':
+            if (inet_pton(AF_INET, optarg, &source) != 1) {
+                fprintf(stderr, "Error: Invalid source address '%s'.\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'p': per_source = atol(optarg); break;
+        case 'k': keep_timestamps = true; break;
+        case 'm': map_file = optarg; break;
+        case 'w': workers = atol(optarg); break;
+        case 'B': buffer_size = atol(optarg); break;
+        default:
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 1 || per_source < 1 || workers < 1 || workers > DATAMGT_MAX_WORKERS || buffer_size < 1 ||
+        (mode != REPLAY_BUFFER && target.sin_port == 0)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* 1. Open the capture */
+    const char *path = argv[optind];
+    FILE *file = fopen(path, "rb");
+    uint8_t header[CAPTURE_HEADER_SIZE];
+    uint64_t capture_start_us;
+    if (file == NULL) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    if (fread(header, sizeof(header), 1, file) != 1 || capture_parse_header(header, &capture_start_us) != GATEWAY_SUCCESS) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+    /* Timestamps move by the time since the capture, so the replay looks like live traffic */
+    int64_t ts_shift = keep_timestamps ? 0 : (int64_t)((clock_us(CLOCK_REALTIME) - capture_start_us) / 1000000u);
+
+    /* 2. Set up the sink */
+    if (mode == REPLAY_TCP) {
+        stream_fds = malloc(REPLAY_STREAMS * sizeof(*stream_fds));
+        if (stream_fds == NULL) {
+            fclose(file);
+            return EXIT_FAILURE;
+        }
+        for (int i = 0; i < REPLAY_STREAMS; ++i) {
+            stream_fds[i] = -1;
+        }
+    } else if (mode == REPLAY_UDP) {
+        udp_sd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (udp_sd < 0) {
+            perror("Error creating socket");
+            fclose(file);
+            return EXIT_FAILURE;
+        }
+    } else if (start_pipeline(map_file, workers, buffer_size) < 0) {
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    char pace[32] = "max speed";
+    if (speed > 0.0) {
+        snprintf(pace, sizeof(pace), "%.4gx speed", speed);
+    }
+    printf("INFO: Replaying '%s' at %s to %s\n", path, pace,
+           mode == REPLAY_BUFFER ? "the in-process pipeline" : inet_ntoa(target.sin_addr));
+
+    /* 3. Replay: a block is a run of records that arrived together on one stream */
+    capture_record_t block[REPLAY_MAX_BLOCK], next;
+    uint8_t raw[CAPTURE_RECORD_SIZE];
+    size_t count = 0;
+    bool have_next = false;
+    uint64_t capture_us = 0;                  /* Arrival time of the block in the capture */
+    uint64_t start_us = clock_us(CLOCK_MONOTONIC), report_us = start_us;
+    unsigned long long replayed = 0, reported = 0;
+    int status = EXIT_SUCCESS;
+
+    while (!interrupted) {
+        if (!have_next) {
+            if (fread(raw, sizeof(raw), 1, file) != 1) {
+                break;
+            }
+            capture_decode_record(raw, &next);
+            next.reading.ts += ts_shift;
+            have_next = true;
+        }
+        if (count > 0 && (next.delta_us != 0 || next.stream != block[0].stream || count == REPLAY_MAX_BLOCK)) {
+            if (send_block(block, count) < 0) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            replayed += count;
+            count = 0;
+        }
+        if (count == 0) {
+            /* Wait for the block's time in the replay */
+            capture_us += next.delta_us;
+            if (speed > 0.0) {
+                uint64_t due = start_us + (uint64_t)((double)capture_us / speed);
+                struct timespec wake = { .tv_sec = (time_t)(due / 1000000u), .tv_nsec = (long)(due % 1000000u) * 1000 };
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+            }
+            uint64_t now = clock_us(CLOCK_MONOTONIC);
+            if (now - report_us >= REPLAY_REPORT_SEC * 1000000u) {
+                printf("[%5.0fs] %8.0f readings/s, %llu replayed\n", (double)(now - start_us) / 1e6,
+                       (double)(replayed - reported) * 1e6 / (double)(now - report_us), replayed);
+                fflush(stdout);
+                report_us = now;
+                reported = replayed;
+            }
+        }
+        block[count++] = next;
+        have_next = false;
+    }
+    if (count > 0 && status == EXIT_SUCCESS && send_block(block, count) == 0) {
+        replayed += count;
+    }
+    fclose(file);
+
+    double seconds = (double)(clock_us(CLOCK_MONOTONIC) - start_us) / 1e6;
+    printf("INFO: Replayed %llu readings in %.2f s: %.0f readings/s (the capture spans %.2f s)\n",
+           replayed, seconds, seconds > 0.0 ? (double)replayed / seconds : 0.0, (double)capture_us / 1e6);
+
+    /* 4. Tear down */
+    if (mode == REPLAY_TCP) {
+        for (int i = 0; i < REPLAY_STREAMS; ++i) {
+            if (stream_fds[i] >= 0) {
+                close(stream_fds[i]);
+            }
+        }
+        free(stream_fds);
+        printf("INFO: %lu connections opened, %lu send errors\n", connections_opened, send_errors);
+    } else if (mode == REPLAY_UDP) {
+        close(udp_sd);
+        printf("INFO: %lu send errors\n", send_errors);
+    } else {
+        stop_pipeline(replayed);
+    }
+    return status;
+}
+
+/**
+ * @brief Prints command line usage instructions.
+ * @param prog_name The name of the executable (argv[0]).
+ */
+static void print_usage(const char *prog_name) {
+    fprintf(stderr, "Usage: %s [-s speed] (-t host:port | -u host:port | -b) [options] <capture_file>\n", prog_name);
+    fprintf(stderr, "  <capture_file>  : Written by sensor_gateway -c\n");
+    fprintf(stderr, "  -s <speed>      : 1 = recorded pace (default), N = N times faster, 0 = as fast as possible\n");
+    fprintf(stderr, "  -t <host:port>  : Send to a gateway over TCP, one connection per captured connection\n");
+    fprintf(stderr, "  -u <host:port>  : Send to a gateway over UDP (sensor_gateway -u), one datagram per block\n");
+    fprintf(stderr, "  -b              : Insert into a shared buffer read by an in-process data manager and storage\n");
+    fprintf(stderr, "                    manager (database, logs and archive in the working directory)\n");
+    fprintf(stderr, "  -v <1|2>        : TCP/UDP protocol: 1 = legacy frames (default), 2 = v2 frames with timestamps\n");
+    fprintf(stderr, "  -a <source_ip>  : TCP: bind connections to consecutive source addresses from this one\n");
+    fprintf(stderr, "  -p <per_source> : TCP: connections per source address with -a (default 5)\n");
+    fprintf(stderr, "  -k              : Keep the captured timestamps instead of moving them to the present\n");
+    fprintf(stderr, "  -m <map_file>   : -b: room sensor map of the data manager (default %s)\n", MAP_FILE_NAME);
+    fprintf(stderr, "  -w <workers>    : -b: data manager workers (default %d)\n", DATAMGT_WORKERS);
+    fprintf(stderr, "  -B <capacity>   : -b: shared buffer capacity in readings (default %d)\n", SBUFFER_SIZE);
+}
+
+/**
+ * @brief Parses "<host>:<port>" into an address.
+ * @return 0 on success, -1 if malformed or unresolvable.
+ */
+static int parse_target(const char *text, struct sockaddr_in *addr) {
+    char host[256];
+    const char *colon = strrchr(text, ':');
+    char *end;
+
+    if (colon == NULL || (size_t)(colon - text) >= sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, text, (size_t)(colon - text));
+    host[colon - text] = '\0';
+    long port = strtol(colon + 1, &end, 10);
+    if (end == colon + 1 || *end != '\0' || port < 1 || port > 65535) {
+        return -1;
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &addr->sin_addr) <= 0) {
+        struct hostent *server_host = gethostbyname(host);
+        if (server_host == NULL || server_host->h_addr_list[0] == NULL) {
+            return -1;
+        }
+        memcpy(&addr->sin_addr, server_host->h_addr_list[0], sizeof(addr->sin_addr));
+    }
+    return 0;
+}
+
+/**
+ * @brief Encodes a block as legacy frames or one v2 frame.
+ * @return The number of bytes written to out (at least PROTOCOL_MAX_FRAME_SIZE).
+ */
+static size_t encode_block(uint8_t *out, const capture_record_t *block, size_t count) {
+    size_t len = 0;
+
+    if (protocol_version == 2) {
+        uint16_t records = htobe16((uint16_t)count);
+        out[0] = PROTOCOL_V2_MAGIC;
+        out[1] = PROTOCOL_V2_VERSION;
+        memcpy(out + 2, &records, sizeof(records));
+        len = PROTOCOL_V2_HEADER_SIZE;
+        for (size_t i = 0; i < count; ++i, len += PROTOCOL_V2_RECORD_SIZE) {
+            uint16_t id = htobe16(block[i].reading.id);
+            uint64_t ts = htobe64((uint64_t)(int64_t)block[i].reading.ts);
+            uint64_t bits;
+            memcpy(&bits, &block[i].reading.value, sizeof(bits));
+            bits = htobe64(bits);
+            memcpy(out + len, &id, sizeof(id));
+            memcpy(out + len + sizeof(id), &ts, sizeof(ts));
+            memcpy(out + len + sizeof(id) + sizeof(ts), &bits, sizeof(bits));
+        }
+        return len;
+    }
+    for (size_t i = 0; i < count; ++i, len += PROTOCOL_LEGACY_FRAME_SIZE) {
+        uint16_t id = htons(block[i].reading.id);
+        memcpy(out + len, &id, sizeof(id));
+        memcpy(out + len + sizeof(id), &block[i].reading.value, sizeof(double));
+    }
+    return len;
+}
+
+/**
+ * @brief Returns the connection of a captured stream, connecting it first if needed.
+ * @return The socket, or -1 if the connection failed.
+ */
+static int stream_socket(uint16_t stream) {
+    if (stream_fds[stream] >= 0) {
+        return stream_fds[stream];
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (source.s_addr != htonl(INADDR_ANY)) {
+        struct sockaddr_in local = { .sin_family = AF_INET };
+        local.sin_addr.s_addr = htonl(ntohl(source.s_addr) + (uint32_t)(connections_opened / (unsigned long)per_source));
+        if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    if (connect(fd, (struct sockaddr *)&target, sizeof(target)) < 0) {
+        close(fd);
+        return -1;
+    }
+    connections_opened++;
+    stream_fds[stream] = fd;
+    return fd;
+}
+
+/**
+ * @brief Injects readings into the shared buffer, stamped for the latency histograms.
+ * @return 0 on success, -1 if the buffer refused them.
+ */
+static int inject_block(const capture_record_t *block, size_t count) {
+    sensor_data_t readings[REPLAY_MAX_BLOCK];
+    uint32_t stamp = metrics_ingest_stamp();
+
+    for (size_t i = 0; i < count; ++i) {
+        readings[i] = block[i].reading;
+        readings[i].ingest_us = stamp;
+    }
+    if (sbuffer_insert_batch(buffer, readings, count) != GATEWAY_SUCCESS) {
+        fprintf(stderr, "Error: The shared buffer refused readings.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Hands one block of readings to the sink.
+ * @return 0, or -1 if the replay cannot go on. Lost TCP/UDP blocks are only counted.
+ */
+static int send_block(const capture_record_t *block, size_t count) {
+    uint8_t frame[REPLAY_MAX_BLOCK * PROTOCOL_LEGACY_FRAME_SIZE + PROTOCOL_MAX_FRAME_SIZE];
+
+    if (mode == REPLAY_BUFFER) {
+        return inject_block(block, count);
+    }
+    size_t len = encode_block(frame, block, count);
+    if (mode == REPLAY_UDP) {
+        if (sendto(udp_sd, frame, len, 0, (struct sockaddr *)&target, sizeof(target)) < 0) {
+            send_errors++;
+        }
+        return 0;
+    }
+
+    int fd = stream_socket(block[0].stream);
+    if (fd < 0) {
+        send_errors++;
+        return 0;
+    }
+    for (size_t sent = 0; sent < len;) {
+        ssize_t n = send(fd, frame + sent, len - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            /* Closed by the gateway (or broken): reconnect when the stream sends again */
+            close(fd);
+            stream_fds[block[0].stream] = -1;
+            send_errors++;
+            return 0;
+        }
+        sent += (size_t)n;
+    }
+    return 0;
+}
+
+/* --- Buffer Mode --- */
+
+static pid_t log_pid = -1;
+static room_sensor_map_t *room_map = NULL;
+static datamgt_args_t datamgt_args;
+static storagemgt_args_t storagemgt_args;
+static pthread_t datamgt_thread, storagemgt_thread;
+
+/**
+ * @brief Starts the log process, the shared buffer, the data manager and the storage manager
+ *        as sensor_gateway does, without the connection manager.
+ * @return 0 on success, -1 on failure.
+ */
+static int start_pipeline(const char *map_file, long workers, long buffer_size) {
+    if (logger_init() != GATEWAY_SUCCESS) {
+        return -1;
+    }
+    log_pid = fork();
+    if (log_pid == -1) {
+        perror("fork() failed");
+        logger_cleanup();
+        return -1;
+    } else if (log_pid == 0) {
+        run_log_process();
+        exit(EXIT_FAILURE);
+    }
+    if (logger_open_write_fifo() != GATEWAY_SUCCESS) {
+        goto fail;
+    }
+    if (datamgt_load_room_sensor_map(map_file, &room_map) != GATEWAY_SUCCESS) {
+        fprintf(stderr, "WARN: Failed to load room sensor map '%s'. Continuing without map.\n", map_file);
+        room_map = NULL;
+    }
+    if (sbuffer_init(&buffer, (size_t)buffer_size, SBUFFER_MAX_SIZE) != GATEWAY_SUCCESS) {
+        goto fail;
+    }
+
+    memset(&datamgt_args, 0, sizeof(datamgt_args));
+    datamgt_args.buffer = buffer;
+    datamgt_args.map = room_map;
+    datamgt_args.map_filename = map_file;
+    datamgt_args.rules_filename = ALERT_RULES_FILE_NAME;
+    datamgt_args.num_workers = (int)workers;
+    memset(&storagemgt_args, 0, sizeof(storagemgt_args));
+    storagemgt_args.buffer = buffer;
+    if (sbuffer_register_reader(buffer, &datamgt_args.reader_id) != GATEWAY_SUCCESS ||
+        sbuffer_register_reader(buffer, &storagemgt_args.reader_id) != GATEWAY_SUCCESS) {
+        goto fail;
+    }
+    if (pthread_create(&storagemgt_thread, NULL, storagemgt_run, &storagemgt_args) != 0) {
+        goto fail;
+    }
+    if (pthread_create(&datamgt_thread, NULL, datamgt_run, &datamgt_args) != 0) {
+        storagemgt_stop();
+        sbuffer_signal_shutdown(buffer);
+        pthread_join(storagemgt_thread, NULL);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    fprintf(stderr, "Error: Failed to start the pipeline.\n");
+    if (buffer != NULL) {
+        sbuffer_free(&buffer);
+    }
+    datamgt_free_room_sensor_map(&room_map);
+    logger_cleanup();
+    waitpid(log_pid, NULL, 0);
+    return -1;
+}
+
+/**
+ * @brief Waits until the storage manager committed every injected reading (or stopped making
+ *        progress), reports its throughput and latency, then shuts the pipeline down.
+ * @param injected Readings inserted into the shared buffer.
+ */
+static void stop_pipeline(unsigned long long injected) {
+    uint64_t start_us = clock_us(CLOCK_MONOTONIC), progress_us = start_us;
+    uint64_t committed = 0, last = 0;
+
+    while (!interrupted) {
+        metrics_quantile(METRIC_LATENCY_COMMITTED_US, 0.5, &committed);
+        uint64_t now = clock_us(CLOCK_MONOTONIC);
+        if (committed >= injected) {
+            break;
+        }
+        if (committed != last) {
+            last = committed;
+            progress_us = now;
+        } else if (now - progress_us > REPLAY_DRAIN_IDLE_MS * 1000u) {
+            fprintf(stderr, "WARN: Storage stalled at %llu of %llu readings.\n",
+                    (unsigned long long)committed, injected);
+            break;
+        }
+        usleep(10000);
+    }
+    printf("INFO: Storage committed %llu readings, %.2f s after the replay ended\n",
+           (unsigned long long)committed, (double)(clock_us(CLOCK_MONOTONIC) - start_us) / 1e6);
+    printf("INFO: Latency from insert to commit: p50 %llu us, p99 %llu us, p999 %llu us\n",
+           (unsigned long long)metrics_quantile(METRIC_LATENCY_COMMITTED_US, 0.5, NULL),
+           (unsigned long long)metrics_quantile(METRIC_LATENCY_COMMITTED_US, 0.99, NULL),
+           (unsigned long long)metrics_quantile(METRIC_LATENCY_COMMITTED_US, 0.999, NULL));
+
+    /* Same order as the gateway's shutdown */
+    terminate_flag = 1;
+    datamgt_stop();
+    storagemgt_stop();
+    sbuffer_signal_shutdown(buffer);
+    pthread_join(storagemgt_thread, NULL);
+    pthread_join(datamgt_thread, NULL);
+    room_map = datamgt_args.map;
+    datamgt_free_room_sensor_map(&room_map);
+    sbuffer_free(&buffer);
+    logger_cleanup();
+    waitpid(log_pid, NULL, 0);
+}
@@ -10,19 +10,47 @@
 #include <time.h>       /* For time() to seed rand() */
 #include <errno.h>      /* For errno */
 #include <limits.h>     /* For LONG_MAX, LONG_MIN */
+#include <endian.h>     /* For htobe16, htobe64 */
+#include <getopt.h>     /* For getopt in load generator mode */
+#include <pthread.h>    /* Load generator threads */
+#include <signal.h>     /* For SIGINT/SIGTERM handling in load generator mode */
+#include <stdatomic.h>  /* Load generator counters */
+#include <stddef.h>     /* For offsetof */
+#include <sys/epoll.h>  /* Load generator event loops */
+#include <sys/resource.h> /* For RLIMIT_NOFILE */
 
 /* --- Configuration --- */
 #define BASE_TEMP 100.0  /* Base temperature for simulation */
 #define TEMP_FLUCTUATION 5.0 /* Max +/- fluctuation from base temp */
 
+/* Batched protocol v2 framing, must match protocol.h */
+#define V2_MAGIC 0xA5
+#define V2_VERSION 2
+#define V2_HEADER_SIZE 4
+#define V2_RECORD_SIZE (sizeof(uint16_t) + sizeof(int64_t) + sizeof(uint64_t))
+#define V2_MAX_RECORDS 64
+
+/* Load generator mode */
+#define LOAD_MAX_THREADS 64
+#define LOAD_EPOLL_EVENTS 256
+#define LOAD_TICK_MS 1          /* Pacing resolution of a load thread */
+#define LOAD_RETRY_MS 500       /* Delay before reconnecting a failed or closed sensor */
+#define LOAD_CREDIT_MAX_MS 100  /* Sends a stalled thread may catch up on, in ms of its rate */
+
 /* --- Function Prototypes --- */
 static void print_usage(const char *prog_name);
 static double generate_temperature(void);
+static size_t build_v2_frame(uint8_t *frame, int first_id, int records);
+static void put_v2_record(uint8_t *record, uint16_t id, int64_t ts, double value);
+static int run_load(int argc, char *argv[]);
 
 /* --- Main Function --- */
 
 int main(int argc, char *argv[]) {
-    if (argc != 5) {
+    if (argc >= 2 && strcmp(argv[1], "--load") == 0) {
+        return run_load(argc - 1, argv + 1);
+    }
+    if (argc != 5 && argc != 6) {
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
@@ -36,7 +64,9 @@ int main(int argc, char *argv[]) {
     struct sockaddr_in server_addr;
     struct hostent *server_host;
     char send_buffer[sizeof(uint16_t) + sizeof(double)];
+    uint8_t batch_buffer[V2_HEADER_SIZE + V2_MAX_RECORDS * V2_RECORD_SIZE];
     uint16_t network_sensor_id;
+    int batch_records = 0; /* 0 = legacy protocol, otherwise records per v2 frame */
 
     errno = 0;
     port_long = strtol(argv[2], &endptr_port, 10);
@@ -66,6 +96,19 @@ int main(int argc, char *argv[]) {
     }
     interval_ms = (int)interval_ms_long;
 
+    if (argc == 6) {
+        char *endptr_batch;
+        errno = 0;
+        long batch_long = strtol(argv[5], &endptr_batch, 10);
+        if (errno != 0 || endptr_batch == argv[5] || *endptr_batch != '\0' || batch_long < 1 || batch_long > V2_MAX_RECORDS ||
+            sensor_id_int + batch_long - 1 > 65535) {
+            fprintf(stderr, "Error: Invalid batch size '%s'. Must be 1-%d (and sensor_id + batch - 1 <= 65535).\n", argv[5], V2_MAX_RECORDS);
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        batch_records = (int)batch_long;
+    }
+
     printf("INFO: Sensor Simulator started for Sensor ID: %d\n", sensor_id_int);
     printf("INFO: Connecting to %s:%d\n", server_ip_or_hostname, server_port);
     printf("INFO: Sending data every %d ms\n", interval_ms);
@@ -112,16 +155,28 @@ int main(int argc, char *argv[]) {
     /* 5. Send Data Loop */
     while (1) { /* Loop indefinitely until error or Ctrl+C */
         double current_temp = generate_temperature();
-        
+        const void *packet = send_buffer;
+        size_t packet_size = sizeof(send_buffer);
+
         /* Prepare data packet */
-        memcpy(send_buffer, &network_sensor_id, sizeof(uint16_t));
-        memcpy(send_buffer + sizeof(uint16_t), &current_temp, sizeof(double));
+        if (batch_records > 0) {
+            packet_size = build_v2_frame(batch_buffer, sensor_id_int, batch_records);
+            packet = batch_buffer;
+        } else {
+            memcpy(send_buffer, &network_sensor_id, sizeof(uint16_t));
+            memcpy(send_buffer + sizeof(uint16_t), &current_temp, sizeof(double));
+        }
 
         /* Send data */
-        ssize_t bytes_sent = write(client_sd, send_buffer, sizeof(send_buffer));
+        ssize_t bytes_sent = write(client_sd, packet, packet_size);
 
-        if (bytes_sent == sizeof(send_buffer)) {
-            printf("INFO: Sent Sensor ID: %d, Temp: %.2f\n", sensor_id_int, current_temp);
+        if (bytes_sent >= 0 && (size_t)bytes_sent == packet_size) {
+            if (batch_records > 0) {
+                printf("INFO: Sent v2 batch of %d readings (Sensor IDs %d-%d)\n",
+                       batch_records, sensor_id_int, sensor_id_int + batch_records - 1);
+            } else {
+                printf("INFO: Sent Sensor ID: %d, Temp: %.2f\n", sensor_id_int, current_temp);
+            }
         } else if (bytes_sent < 0) {
              /* Error sending data */
              if (errno == EPIPE) {
@@ -159,11 +214,66 @@ int main(int argc, char *argv[]) {
  * @param prog_name The name of the executable (argv[0]).
  */
 static void print_usage(const char *prog_name) {
-    fprintf(stderr, "Usage: %s <server_ip_or_hostname> <port> <sensor_id> <interval_ms>\n", prog_name);
+    fprintf(stderr, "Usage: %s <server_ip_or_hostname> <port> <sensor_id> <interval_ms> [batch]\n", prog_name);
     fprintf(stderr, "  <server_ip_or_hostname>: IP address or hostname of the Sensor Gateway\n");
     fprintf(stderr, "  <port>                 : TCP port number of the Sensor Gateway (1-65535)\n");
     fprintf(stderr, "  <sensor_id>            : Unique ID for this sensor (1-65535)\n");
     fprintf(stderr, "  <interval_ms>          : Interval between readings in milliseconds (>= 10)\n");
+    fprintf(stderr, "  [batch]                : Act as a concentrator: send v2 frames of this many readings\n");
+    fprintf(stderr, "                           for sensor IDs sensor_id..sensor_id+batch-1 (1-%d)\n", V2_MAX_RECORDS);
+    fprintf(stderr, "   or: %s --load [options] <server_ip_or_hostname> <port>\n", prog_name);
+    fprintf(stderr, "  Load generator: drives many sensors, one TCP connection each, from a few threads\n");
+    fprintf(stderr, "  -n <sensors>           : Number of simulated sensors (default 100)\n");
+    fprintf(stderr, "  -i <first_id>          : Sensor ID of the first sensor, the others follow (default 1)\n");
+    fprintf(stderr, "  -t <threads>           : Sending threads, sensors are spread over them (default 2, max %d)\n", LOAD_MAX_THREADS);
+    fprintf(stderr, "  -r <rate>              : Aggregate readings per second (default: one per sensor per second)\n");
+    fprintf(stderr, "  -v <1|2>               : Protocol: 1 = legacy frames, 2 = v2 frames of one record (default 1)\n");
+    fprintf(stderr, "  -b <on_ms>:<off_ms>    : Burst pattern: send for on_ms, pause for off_ms, same average rate\n");
+    fprintf(stderr, "  -c <churn>             : Connections closed and reopened per second (default 0)\n");
+    fprintf(stderr, "  -s <source_ip>         : Bind connections to consecutive source addresses from this one\n");
+    fprintf(stderr, "  -p <per_source>        : Connections per source address with -s (default 5)\n");
+    fprintf(stderr, "  -d <seconds>           : Run time, 0 = until interrupted (default 10)\n");
+}
+
+/**
+ * @brief Builds one v2 batch frame with a fresh reading for each relayed sensor.
+ * @param frame Output buffer of at least V2_HEADER_SIZE + records * V2_RECORD_SIZE bytes.
+ * @param first_id Sensor ID of the first record, the others follow consecutively.
+ * @param records Number of records (1..V2_MAX_RECORDS).
+ * @return The frame size in bytes.
+ */
+static size_t build_v2_frame(uint8_t *frame, int first_id, int records) {
+    uint16_t count = htobe16((uint16_t)records);
+    int64_t now = (int64_t)time(NULL);
+    uint8_t *record = frame + V2_HEADER_SIZE;
+
+    frame[0] = V2_MAGIC;
+    frame[1] = V2_VERSION;
+    memcpy(frame + 2, &count, sizeof(count));
+
+    for (int i = 0; i < records; ++i, record += V2_RECORD_SIZE) {
+        put_v2_record(record, (uint16_t)(first_id + i), now, generate_temperature());
+    }
+    return V2_HEADER_SIZE + (size_t)records * V2_RECORD_SIZE;
+}
+
+/**
+ * @brief Encodes one v2 record.
+ * @param record Output buffer of V2_RECORD_SIZE bytes.
+ * @param id Sensor ID.
+ * @param ts Device timestamp, Unix seconds.
+ * @param value The reading.
+ */
+static void put_v2_record(uint8_t *record, uint16_t id, int64_t ts, double value) {
+    uint16_t be_id = htobe16(id);
+    uint64_t be_ts = htobe64((uint64_t)ts);
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    bits = htobe64(bits);
+    memcpy(record, &be_id, sizeof(be_id));
+    memcpy(record + sizeof(be_id), &be_ts, sizeof(be_ts));
+    memcpy(record + sizeof(be_id) + sizeof(be_ts), &bits, sizeof(bits));
 }
 
 /**
@@ -174,4 +284,567 @@ static double generate_temperature(void) {
     /* Generate random number between -1.0 and +1.0 */
     double fluctuation = ((double)rand() / (double)RAND_MAX) * 2.0 - 1.0; 
     return BASE_TEMP + fluctuation * TEMP_FLUCTUATION;
-}
\ No newline at end of file
+}
+/* --- Load Generator Mode --- */
+
+typedef enum {
+    LOAD_IDLE = 0,   /* Not connected, reconnects at retry_ns */
+    LOAD_CONNECTING, /* Non-blocking connect in progress */
+    LOAD_CONNECTED
+} load_state_t;
+
+typedef struct {
+    int fd;
+    uint16_t id;
+    uint8_t state;           /* load_state_t */
+    uint8_t pending_len;     /* Bytes of a partially written frame left to send */
+    uint8_t pending_off;
+    uint8_t pending[V2_HEADER_SIZE + V2_RECORD_SIZE];
+    uint64_t retry_ns;
+    struct in_addr source;   /* INADDR_ANY = let the kernel choose */
+} load_sensor_t;
+
+typedef struct {
+    pthread_t thread;
+    int index;
+    int epfd;
+    load_sensor_t *sensors;
+    int count;
+    int next;                /* Round-robin position of the next sensor to send */
+    int idle;                /* Sensors in LOAD_IDLE */
+    double rate;             /* Readings per second of this thread */
+    double churn;            /* Reconnections per second of this thread */
+    unsigned int seed;
+    /* Written by the thread, read by the reporter */
+    _Atomic uint64_t sent;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t connects;
+    _Atomic uint64_t failures;    /* Connects that failed */
+    _Atomic uint64_t disconnects; /* Connections closed by the gateway or a send error */
+    _Atomic uint64_t churned;     /* Connections closed on purpose */
+    _Atomic uint64_t blocked;     /* Sends that hit a full socket buffer */
+    _Atomic int open;
+} load_worker_t;
+
+typedef struct {
+    struct sockaddr_in server;
+    int version;
+    int burst_on_ms;
+    int burst_off_ms;
+    uint64_t start_ns;
+} load_config_t;
+
+static load_config_t load_config;
+static atomic_int load_stop;
+static volatile sig_atomic_t load_interrupted;
+
+/**
+ * @brief Returns CLOCK_MONOTONIC in nanoseconds.
+ */
+static uint64_t load_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Parses a decimal option value into [min, max].
+ * @return 0 on success, -1 if the value is malformed or out of range.
+ */
+static int load_parse_long(const char *text, long min, long max, long *value) {
+    char *end;
+    errno = 0;
+    long parsed = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || parsed < min || parsed > max) {
+        return -1;
+    }
+    *value = parsed;
+    return 0;
+}
+
+/**
+ * @brief Returns the rate multiplier of the burst pattern at a point in time:
+ *        (on + off) / on while sending, 0 while paused, so the average is unchanged.
+ */
+static double load_burst_factor(uint64_t now_ns) {
+    if (load_config.burst_on_ms <= 0) {
+        return 1.0;
+    }
+    uint64_t period_ms = (uint64_t)(load_config.burst_on_ms + load_config.burst_off_ms);
+    uint64_t phase_ms = ((now_ns - load_config.start_ns) / 1000000ull) % period_ms;
+    if (phase_ms >= (uint64_t)load_config.burst_on_ms) {
+        return 0.0;
+    }
+    return (double)period_ms / (double)load_config.burst_on_ms;
+}
+
+/**
+ * @brief Encodes one fresh reading of a sensor in the configured protocol.
+ * @param out Buffer of at least V2_HEADER_SIZE + V2_RECORD_SIZE bytes.
+ * @return The frame size in bytes.
+ */
+static size_t load_encode(uint8_t *out, uint16_t id, unsigned int *seed) {
+    double fluctuation = ((double)rand_r(seed) / (double)RAND_MAX) * 2.0 - 1.0;
+    double value = BASE_TEMP + fluctuation * TEMP_FLUCTUATION;
+
+    if (load_config.version == 2) {
+        uint16_t count = htobe16(1);
+        out[0] = V2_MAGIC;
+        out[1] = V2_VERSION;
+        memcpy(out + 2, &count, sizeof(count));
+        put_v2_record(out + V2_HEADER_SIZE, id, (int64_t)time(NULL), value);
+        return V2_HEADER_SIZE + V2_RECORD_SIZE;
+    }
+    uint16_t network_id = htons(id);
+    memcpy(out, &network_id, sizeof(network_id));
+    memcpy(out + sizeof(network_id), &value, sizeof(value));
+    return sizeof(uint16_t) + sizeof(double);
+}
+
+/**
+ * @brief Closes the connection of a sensor.
+ * @param retry_ms Delay before it reconnects, 0 to leave reconnecting to the caller.
+ */
+static void load_close(load_worker_t *worker, load_sensor_t *sensor, uint64_t now_ns, int retry_ms) {
+    if (sensor->state == LOAD_CONNECTED) {
+        atomic_fetch_sub_explicit(&worker->open, 1, memory_order_relaxed);
+    }
+    close(sensor->fd); /* Also removes it from the epoll set */
+    sensor->fd = -1;
+    sensor->state = LOAD_IDLE;
+    sensor->pending_len = 0;
+    sensor->retry_ns = now_ns + (uint64_t)retry_ms * 1000000ull;
+    worker->idle++;
+}
+
+/**
+ * @brief Marks a sensor connected and watches its socket for the gateway closing it.
+ */
+static void load_connected(load_worker_t *worker, load_sensor_t *sensor) {
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = sensor };
+    epoll_ctl(worker->epfd, EPOLL_CTL_MOD, sensor->fd, &ev);
+    sensor->state = LOAD_CONNECTED;
+    atomic_fetch_add_explicit(&worker->open, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&worker->connects, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Starts a non-blocking connect for an idle sensor.
+ */
+static void load_connect(load_worker_t *worker, load_sensor_t *sensor, uint64_t now_ns) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        atomic_fetch_add_explicit(&worker->failures, 1, memory_order_relaxed);
+        sensor->retry_ns = now_ns + (uint64_t)LOAD_RETRY_MS * 1000000ull;
+        return;
+    }
+    if (sensor->source.s_addr != htonl(INADDR_ANY)) {
+        struct sockaddr_in local = { .sin_family = AF_INET, .sin_addr = sensor->source };
+        if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+            goto failed;
+        }
+    }
+    int rc = connect(fd, (struct sockaddr *)&load_config.server, sizeof(load_config.server));
+    if (rc < 0 && errno != EINPROGRESS) {
+        goto failed;
+    }
+    struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = sensor };
+    if (epoll_ctl(worker->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        goto failed;
+    }
+    sensor->fd = fd;
+    sensor->state = LOAD_CONNECTING;
+    worker->idle--;
+    if (rc == 0) {
+        load_connected(worker, sensor);
+    }
+    return;
+
+failed:
+    close(fd);
+    atomic_fetch_add_explicit(&worker->failures, 1, memory_order_relaxed);
+    sensor->retry_ns = now_ns + (uint64_t)LOAD_RETRY_MS * 1000000ull;
+}
+
+/**
+ * @brief Writes the rest of a partially sent frame.
+ * @return 1 once the frame is out, 0 if the socket is still full, -1 on error.
+ */
+static int load_flush(load_worker_t *worker, load_sensor_t *sensor) {
+    while (sensor->pending_off < sensor->pending_len) {
+        ssize_t n = send(sensor->fd, sensor->pending + sensor->pending_off,
+                         sensor->pending_len - sensor->pending_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        sensor->pending_off += (uint8_t)n;
+        atomic_fetch_add_explicit(&worker->bytes, (uint64_t)n, memory_order_relaxed);
+    }
+    sensor->pending_len = 0;
+    sensor->pending_off = 0;
+    atomic_fetch_add_explicit(&worker->sent, 1, memory_order_relaxed);
+    return 1;
+}
+
+/**
+ * @brief Sends one reading on a connected sensor. A frame the socket takes only partly
+ *        is finished on EPOLLOUT before the sensor sends again.
+ * @return 1 if the reading was handed to the socket (or queued), 0 if the sensor cannot send now.
+ */
+static int load_send(load_worker_t *worker, load_sensor_t *sensor, uint64_t now_ns) {
+    if (sensor->state != LOAD_CONNECTED || sensor->pending_len != 0) {
+        return 0;
+    }
+    sensor->pending_len = (uint8_t)load_encode(sensor->pending, sensor->id, &worker->seed);
+    sensor->pending_off = 0;
+
+    int rc = load_flush(worker, sensor);
+    if (rc < 0) {
+        atomic_fetch_add_explicit(&worker->disconnects, 1, memory_order_relaxed);
+        load_close(worker, sensor, now_ns, LOAD_RETRY_MS);
+        return 0;
+    }
+    if (rc == 0) {
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | EPOLLOUT, .data.ptr = sensor };
+        epoll_ctl(worker->epfd, EPOLL_CTL_MOD, sensor->fd, &ev);
+        atomic_fetch_add_explicit(&worker->blocked, 1, memory_order_relaxed);
+    }
+    return 1;
+}
+
+/**
+ * @brief Handles one epoll event of a sensor socket.
+ */
+static void load_event(load_worker_t *worker, load_sensor_t *sensor, uint32_t events, uint64_t now_ns) {
+    if (sensor->state == LOAD_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(sensor->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            atomic_fetch_add_explicit(&worker->failures, 1, memory_order_relaxed);
+            load_close(worker, sensor, now_ns, LOAD_RETRY_MS);
+            return;
+        }
+        load_connected(worker, sensor);
+        return;
+    }
+    if (sensor->state != LOAD_CONNECTED) {
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        /* The gateway never sends to sensors: anything readable means it closed the connection */
+        atomic_fetch_add_explicit(&worker->disconnects, 1, memory_order_relaxed);
+        load_close(worker, sensor, now_ns, LOAD_RETRY_MS);
+        return;
+    }
+    if (events & EPOLLOUT) {
+        int rc = load_flush(worker, sensor);
+        if (rc < 0) {
+            atomic_fetch_add_explicit(&worker->disconnects, 1, memory_order_relaxed);
+            load_close(worker, sensor, now_ns, LOAD_RETRY_MS);
+        } else if (rc > 0) {
+            struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = sensor };
+            epoll_ctl(worker->epfd, EPOLL_CTL_MOD, sensor->fd, &ev);
+        }
+    }
+}
+
+/**
+ * @brief Main function of a load thread: keeps its sensors connected and sends readings
+ *        round-robin over them, paced by a token bucket refilled from the monotonic clock.
+ */
+static void *load_worker_run(void *arg) {
+    load_worker_t *worker = (load_worker_t *)arg;
+    struct epoll_event events[LOAD_EPOLL_EVENTS];
+    uint64_t last_ns = load_now_ns();
+    double credit = 0.0, churn_credit = 0.0;
+    double credit_max = worker->rate * LOAD_CREDIT_MAX_MS / 1000.0 + 1.0;
+
+    for (int i = 0; i < worker->count; ++i) {
+        load_connect(worker, &worker->sensors[i], last_ns);
+    }
+
+    while (!atomic_load_explicit(&load_stop, memory_order_relaxed)) {
+        int ready = epoll_wait(worker->epfd, events, LOAD_EPOLL_EVENTS, LOAD_TICK_MS);
+        uint64_t now_ns = load_now_ns();
+
+        for (int i = 0; i < ready; ++i) {
+            load_event(worker, (load_sensor_t *)events[i].data.ptr, events[i].events, now_ns);
+        }
+
+        if (worker->idle > 0) {
+            for (int i = 0; i < worker->count; ++i) {
+                load_sensor_t *sensor = &worker->sensors[i];
+                if (sensor->state == LOAD_IDLE && sensor->retry_ns <= now_ns) {
+                    load_connect(worker, sensor, now_ns);
+                }
+            }
+        }
+
+        double elapsed = (double)(now_ns - last_ns) / 1e9;
+        last_ns = now_ns;
+
+        /* Churn: drop random connected sensors and reconnect them straight away */
+        churn_credit += worker->churn * elapsed;
+        while (churn_credit >= 1.0) {
+            load_sensor_t *sensor = &worker->sensors[rand_r(&worker->seed) % (unsigned int)worker->count];
+            churn_credit -= 1.0;
+            if (sensor->state != LOAD_CONNECTED) {
+                continue;
+            }
+            load_close(worker, sensor, now_ns, 0);
+            atomic_fetch_add_explicit(&worker->churned, 1, memory_order_relaxed);
+            load_connect(worker, sensor, now_ns);
+        }
+
+        credit += worker->rate * elapsed * load_burst_factor(now_ns);
+        if (credit > credit_max) {
+            credit = credit_max;
+        }
+        /* One pass over the sensors at most: if none can send, the credit waits for the next tick */
+        for (int tried = 0; credit >= 1.0 && tried < worker->count; ++tried) {
+            load_sensor_t *sensor = &worker->sensors[worker->next];
+            worker->next = (worker->next + 1) % worker->count;
+            if (load_send(worker, sensor, now_ns)) {
+                credit -= 1.0;
+                tried = -1; /* Progress: allow another full pass */
+            }
+        }
+    }
+
+    for (int i = 0; i < worker->count; ++i) {
+        if (worker->sensors[i].state != LOAD_IDLE) {
+            load_close(worker, &worker->sensors[i], 0, 0);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Stops the load generator on SIGINT/SIGTERM.
+ */
+static void load_signal(int sig) {
+    (void)sig;
+    load_interrupted = 1;
+}
+
+/**
+ * @brief Sums a counter over the load threads.
+ */
+static uint64_t load_total(load_worker_t *workers, int threads, size_t offset) {
+    uint64_t total = 0;
+    for (int i = 0; i < threads; ++i) {
+        total += atomic_load_explicit((_Atomic uint64_t *)((char *)&workers[i] + offset), memory_order_relaxed);
+    }
+    return total;
+}
+
+/**
+ * @brief Runs the load generator mode: N sensors, one TCP connection each, driven from a few
+ *        epoll threads. Reports the achieved send rate every second and a summary at the end.
+ * @param argc Arguments after the program name, starting with "--load".
+ * @param argv Arguments.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int run_load(int argc, char *argv[]) {
+    const char *prog_name = "sensor_sim";
+    long sensors = 100, first_id = 1, threads = 2, version = 1, per_source = 5, duration = 10;
+    long burst_on = 0, burst_off = 0;
+    double rate = -1.0, churn = 0.0;
+    struct in_addr source = { .s_addr = htonl(INADDR_ANY) };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:i:t:r:v:b:c:s:p:d:")) != -1) {
+        int bad = 0;
+        char *end;
+        switch (opt) {
+        case 'n': bad = load_parse_long(optarg, 1, 65535, &sensors); break;
+        case 'i': bad = load_parse_long(optarg, 1, 65535, &first_id); break;
+        case 't': bad = load_parse_long(optarg, 1, LOAD_MAX_THREADS, &threads); break;
+        case 'v': bad = load_parse_long(optarg, 1, 2, &version); break;
+        case 'p': bad = load_parse_long(optarg, 1, 65535, &per_source); break;
+        case 'd': bad = load_parse_long(optarg, 0, 86400, &duration); break;
+        case 'r':
+        case 'c': {
+            errno = 0;
+            double value = strtod(optarg, &end);
+            bad = errno != 0 || end == optarg || *end != '\0' || value < 0.0;
+            if (opt == 'r') rate = value; else churn = value;
+            break;
+        }
+        case 'b':
+            errno = 0;
+            burst_on = strtol(optarg, &end, 10);
+            if (end == optarg || *end != ':') {
+                bad = 1;
+                break;
+            }
+            {
+                char *off = end + 1;
+                burst_off = strtol(off, &end, 10);
+                bad = errno != 0 || end == off || *end != '\0' || burst_on < 1 || burst_off < 0;
+            }
+            break;
+        case 's':
+            bad = inet_pton(AF_INET, optarg, &source) != 1;
+            break;
+        default:
+            print_usage(prog_name);
+            return EXIT_FAILURE;
+        }
+        if (bad) {
+            fprintf(stderr, "Error: Invalid value '%s' for option -%c.\n", optarg, opt);
+            print_usage(prog_name);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 2) {
+        print_usage(prog_name);
+        return EXIT_FAILURE;
+    }
+    if (first_id + sensors - 1 > 65535) {
+        fprintf(stderr, "Error: Sensor IDs %ld..%ld exceed 65535.\n", first_id, first_id + sensors - 1);
+        return EXIT_FAILURE;
+    }
+    if (threads > sensors) {
+        threads = sensors;
+    }
+    if (rate < 0.0) {
+        rate = (double)sensors;
+    }
+
+    const char *host = argv[optind];
+    long port;
+    if (load_parse_long(argv[optind + 1], 1, 65535, &port) < 0) {
+        fprintf(stderr, "Error: Invalid port number '%s'. Must be 1-65535.\n", argv[optind + 1]);
+        return EXIT_FAILURE;
+    }
+    memset(&load_config.server, 0, sizeof(load_config.server));
+    load_config.server.sin_family = AF_INET;
+    load_config.server.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &load_config.server.sin_addr) <= 0) {
+        struct hostent *server_host = gethostbyname(host);
+        if (server_host == NULL || server_host->h_addr_list[0] == NULL) {
+            fprintf(stderr, "Error: Could not resolve host '%s'\n", host);
+            return EXIT_FAILURE;
+        }
+        memcpy(&load_config.server.sin_addr, server_host->h_addr_list[0], sizeof(load_config.server.sin_addr));
+    }
+    load_config.version = (int)version;
+    load_config.burst_on_ms = (int)burst_on;
+    load_config.burst_off_ms = (int)burst_off;
+
+    /* One descriptor per sensor: raise the soft limit as far as the hard limit allows */
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur != RLIM_INFINITY &&
+        files.rlim_cur < (rlim_t)(sensors + threads + 16)) {
+        fprintf(stderr, "Error: %ld sensors need more than the %lu open files allowed (ulimit -n).\n",
+                sensors, (unsigned long)files.rlim_cur);
+        return EXIT_FAILURE;
+    }
+
+    load_sensor_t *all = calloc((size_t)sensors, sizeof(*all));
+    load_worker_t *workers = calloc((size_t)threads, sizeof(*workers));
+    if (all == NULL || workers == NULL) {
+        fprintf(stderr, "Error: Out of memory for %ld sensors.\n", sensors);
+        free(all);
+        free(workers);
+        return EXIT_FAILURE;
+    }
+    for (long i = 0; i < sensors; ++i) {
+        all[i].fd = -1;
+        all[i].id = (uint16_t)(first_id + i);
+        all[i].source = source;
+        if (source.s_addr != htonl(INADDR_ANY)) {
+            all[i].source.s_addr = htonl(ntohl(source.s_addr) + (uint32_t)(i / per_source));
+        }
+    }
+
+    printf("INFO: Load generator: %ld sensors (IDs %ld-%ld) on %ld threads to %s:%ld\n",
+           sensors, first_id, first_id + sensors - 1, threads, inet_ntoa(load_config.server.sin_addr), port);
+    printf("INFO: Target %.0f readings/s, protocol %ld", rate, version);
+    if (burst_on > 0) {
+        printf(", bursts of %ld ms every %ld ms", burst_on, burst_on + burst_off);
+    }
+    if (churn > 0.0) {
+        printf(", %.1f reconnections/s", churn);
+    }
+    printf("\n");
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = load_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    load_config.start_ns = load_now_ns();
+    int started = 0;
+    for (long t = 0, first = 0; t < threads; ++t) {
+        load_worker_t *worker = &workers[t];
+        long count = sensors / threads + (t < sensors % threads ? 1 : 0);
+        worker->index = (int)t;
+        worker->sensors = all + first;
+        worker->count = (int)count;
+        worker->idle = (int)count;
+        worker->rate = rate * (double)count / (double)sensors;
+        worker->churn = churn * (double)count / (double)sensors;
+        worker->seed = (unsigned int)(time(NULL) ^ getpid()) + (unsigned int)t;
+        first += count;
+        worker->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (worker->epfd < 0 || pthread_create(&worker->thread, NULL, load_worker_run, worker) != 0) {
+            perror("Error starting load thread");
+            if (worker->epfd >= 0) {
+                close(worker->epfd);
+            }
+            break;
+        }
+        started++;
+    }
+
+    uint64_t last_sent = 0, start_ns = load_config.start_ns, last_ns = start_ns;
+    int status = started == threads ? EXIT_SUCCESS : EXIT_FAILURE;
+    while (status == EXIT_SUCCESS && !load_interrupted) {
+        struct timespec tick = { .tv_sec = 1, .tv_nsec = 0 };
+        nanosleep(&tick, NULL);
+        uint64_t now_ns = load_now_ns();
+        uint64_t sent = load_total(workers, started, offsetof(load_worker_t, sent));
+        int open = 0;
+        for (int t = 0; t < started; ++t) {
+            open += atomic_load_explicit(&workers[t].open, memory_order_relaxed);
+        }
+        printf("[%5.0fs] %8.0f readings/s  open %d/%ld  connects %llu  failed %llu  dropped %llu  churned %llu  blocked %llu\n",
+               (double)(now_ns - start_ns) / 1e9,
+               (double)(sent - last_sent) * 1e9 / (double)(now_ns - last_ns), open, sensors,
+               (unsigned long long)load_total(workers, started, offsetof(load_worker_t, connects)),
+               (unsigned long long)load_total(workers, started, offsetof(load_worker_t, failures)),
+               (unsigned long long)load_total(workers, started, offsetof(load_worker_t, disconnects)),
+               (unsigned long long)load_total(workers, started, offsetof(load_worker_t, churned)),
+               (unsigned long long)load_total(workers, started, offsetof(load_worker_t, blocked)));
+        fflush(stdout);
+        last_sent = sent;
+        last_ns = now_ns;
+        if (duration > 0 && now_ns - start_ns >= (uint64_t)duration * 1000000000ull) {
+            break;
+        }
+    }
+
+    atomic_store(&load_stop, 1);
+    for (int t = 0; t < started; ++t) {
+        pthread_join(workers[t].thread, NULL);
+        close(workers[t].epfd);
+    }
+
+    double seconds = (double)(load_now_ns() - start_ns) / 1e9;
+    uint64_t sent = load_total(workers, started, offsetof(load_worker_t, sent));
+    uint64_t bytes = load_total(workers, started, offsetof(load_worker_t, bytes));
+    printf("INFO: Sent %llu readings (%llu bytes) in %.1f s: %.0f readings/s, %.1f%% of the %.0f/s target\n",
+           (unsigned long long)sent, (unsigned long long)bytes, seconds, (double)sent / seconds,
+           rate > 0.0 ? 100.0 * (double)sent / seconds / rate : 0.0, rate);
+
+    free(workers);
+    free(all);
+    return status;
+}